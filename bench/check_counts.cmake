@@ -0,0 +1,46 @@
+# Copyright (c) 2024, Ondrej Tethal
+# All rights reserved.
+# This source code is licensed under the BSD-style license found in the
+# LICENSE file in the root directory of this source tree.
+
+# Runs each workload in WORKLOAD_DIR with `natrix --count` and compares the counts with the expectations in
+# EXPECTED_DIR, printing the differences. With UPDATE set, the expectations are replaced by the counts instead.
+# Usage: cmake -DNATRIX=... -DWORKLOAD_DIR=... -DEXPECTED_DIR=... -DOUTPUT_DIR=... [-DUPDATE=ON] -P check_counts.cmake
+
+# the counts depend on the policy of the garbage collector, which must not be changed by the environment
+foreach(OPTION YOUNG HEAP GROWTH MAX_HEAP THREADS SWEEP PAUSE REGION PAGES RELEASE)
+    unset(ENV{NATRIX_GC_${OPTION}})
+endforeach()
+
+file(MAKE_DIRECTORY ${OUTPUT_DIR})
+file(GLOB WORKLOADS ${WORKLOAD_DIR}/*.ntx)
+set(FAILED "")
+foreach(WORKLOAD ${WORKLOADS})
+    get_filename_component(NAME ${WORKLOAD} NAME_WE)
+    set(ACTUAL ${OUTPUT_DIR}/${NAME}.json)
+    set(EXPECTED ${EXPECTED_DIR}/${NAME}.json)
+    execute_process(COMMAND ${NATRIX} --count=${ACTUAL} ${WORKLOAD} OUTPUT_QUIET RESULT_VARIABLE STATUS)
+    if(NOT STATUS EQUAL 0)
+        message(FATAL_ERROR "${NAME}: natrix failed")
+    endif()
+    if(UPDATE)
+        configure_file(${ACTUAL} ${EXPECTED} COPYONLY)
+        message(STATUS "${NAME}: updated")
+    elseif(NOT EXISTS ${EXPECTED})
+        message(STATUS "${NAME}: no expected counts")
+        list(APPEND FAILED ${NAME})
+    else()
+        execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${EXPECTED} ${ACTUAL} RESULT_VARIABLE DIFFERENT)
+        if(DIFFERENT)
+            message(STATUS "${NAME}: counts changed")
+            execute_process(COMMAND diff -u ${EXPECTED} ${ACTUAL})
+            list(APPEND FAILED ${NAME})
+        else()
+            message(STATUS "${NAME}: ok")
+        endif()
+    endif()
+endforeach()
+if(FAILED)
+    message(FATAL_ERROR "The counts of ${FAILED} differ from the expectations, "
+            "run `make bench-counts-update` if the change is intended")
+endif()
@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <benchmark/benchmark.h>
+#include "natrix/util/arena.h"
+
+//! Number of allocations between two resets of the arena, so that chunks are both added and reused.
+static constexpr int BATCH = 4096;
+
+static void BM_ArenaAlloc(benchmark::State &state) {
+    size_t size = state.range(0);
+    Arena arena = arena_init();
+    for (auto _ : state) {
+        for (int i = 0; i < BATCH; i++) {
+            benchmark::DoNotOptimize(arena_alloc(&arena, size));
+        }
+        arena_reset(&arena);
+    }
+    state.SetItemsProcessed((int64_t) state.iterations() * BATCH);
+    arena_free(&arena);
+}
+
+static void BM_ArenaInitFree(benchmark::State &state) {
+    for (auto _ : state) {
+        Arena arena = arena_init();
+        benchmark::DoNotOptimize(arena_alloc(&arena, 64));
+        arena_free(&arena);
+    }
+    arena_release_pool();
+}
+
+BENCHMARK(BM_ArenaAlloc)->ArgName("bytes")->Arg(8)->Arg(32)->Arg(128)->Arg(1024);
+BENCHMARK(BM_ArenaInitFree);
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <benchmark/benchmark.h>
+#include "natrix/util/gc.h"
+
+struct Leaf : GcHeader {
+    int64_t value;
+};
+
+struct Node : GcHeader {
+    GcHeader *next;
+};
+
+static void trace_node(void *ptr) {
+    gc_visit(((Node *) ptr)->next);
+}
+
+static const GcClassId node_class = gc_register_class(trace_node, nullptr);
+
+/**
+ * \brief Builds a rooted chain of live nodes.
+ * \param count number of nodes
+ * \return the head of the chain, rooted
+ */
+static Node *build_chain(int64_t count) {
+    Node *head = nullptr;
+    for (int64_t i = 0; i < count; i++) {
+        Node *node = (Node *) gc_alloc(sizeof(Node), node_class);
+        node->next = head;
+        if (head) {
+            gc_unroot(head);
+        }
+        gc_root(node);
+        head = node;
+    }
+    return head;
+}
+
+static void BM_GcAlloc(benchmark::State &state) {
+    size_t size = state.range(0);
+    for (auto _ : state) {
+        Leaf *leaf = (Leaf *) gc_alloc(size, GC_CLASS_LEAF);
+        leaf->value = 1;
+        benchmark::DoNotOptimize(leaf);
+    }
+    state.SetItemsProcessed(state.iterations());
+    gc_collect();
+}
+
+static void BM_GcAllocWithLiveHeap(benchmark::State &state) {
+    Node *head = build_chain(state.range(0));
+    gc_collect();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(gc_alloc(sizeof(Leaf), GC_CLASS_LEAF));
+    }
+    state.SetItemsProcessed(state.iterations());
+    gc_unroot(head);
+    gc_collect();
+}
+
+static void BM_GcCollect(benchmark::State &state) {
+    int64_t live = state.range(0);
+    Node *head = build_chain(live);
+    for (auto _ : state) {
+        gc_collect();
+    }
+    // the throughput is the number of live objects marked per second
+    state.SetItemsProcessed((int64_t) state.iterations() * live);
+    gc_unroot(head);
+    gc_collect();
+}
+
+static void BM_GcCollectMinor(benchmark::State &state) {
+    int64_t live = state.range(0);
+    Node *head = build_chain(live);
+    gc_collect();
+    for (auto _ : state) {
+        state.PauseTiming();
+        for (int i = 0; i < 1000; i++) {
+            gc_alloc(sizeof(Leaf), GC_CLASS_LEAF);
+        }
+        state.ResumeTiming();
+        gc_collect_minor();
+    }
+    gc_unroot(head);
+    gc_collect();
+}
+
+BENCHMARK(BM_GcAlloc)->ArgName("bytes")->Arg(16)->Arg(32)->Arg(128);
+BENCHMARK(BM_GcAllocWithLiveHeap)->ArgName("live")->RangeMultiplier(16)->Range(1 << 10, 1 << 20);
+BENCHMARK(BM_GcCollect)->ArgName("live")->RangeMultiplier(8)->Range(1 << 10, 1 << 22);
+BENCHMARK(BM_GcCollectMinor)->ArgName("live")->RangeMultiplier(16)->Range(1 << 10, 1 << 20);
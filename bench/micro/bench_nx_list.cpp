@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <benchmark/benchmark.h>
+#include "natrix/obj/nx_int.h"
+#include "natrix/obj/nx_list.h"
+
+static void BM_ListAppendInts(benchmark::State &state) {
+    int64_t count = state.range(0);
+    for (auto _ : state) {
+        NxObject *list = nx_list_create(1);
+        gc_root(nxo_gc_header(list));
+        for (int64_t i = 0; i < count; i++) {
+            nx_list_append(list, nx_int_create(i));
+        }
+        gc_unroot(nxo_gc_header(list));
+    }
+    state.SetItemsProcessed((int64_t) state.iterations() * count);
+    gc_collect();
+}
+
+static void BM_ListAppendObjects(benchmark::State &state) {
+    int64_t count = state.range(0);
+    NxObject *item = nx_int_create(INT64_MAX);
+    gc_root(nxo_gc_header(item));
+    for (auto _ : state) {
+        NxObject *list = nx_list_create(1);
+        gc_root(nxo_gc_header(list));
+        for (int64_t i = 0; i < count; i++) {
+            nx_list_append(list, item);
+        }
+        gc_unroot(nxo_gc_header(list));
+    }
+    state.SetItemsProcessed((int64_t) state.iterations() * count);
+    gc_unroot(nxo_gc_header(item));
+    gc_collect();
+}
+
+BENCHMARK(BM_ListAppendInts)->ArgName("items")->RangeMultiplier(32)->Range(32, 1 << 20);
+BENCHMARK(BM_ListAppendObjects)->ArgName("items")->RangeMultiplier(32)->Range(32, 1 << 20);
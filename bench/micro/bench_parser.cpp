@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <benchmark/benchmark.h>
+#include <string>
+#include "natrix/parser/lexer.h"
+#include "natrix/parser/parser.h"
+#include "natrix/util/arena.h"
+#include "source_gen.h"
+
+//! Kinds of synthetic sources, selected by the first argument of the benchmarks.
+enum SourceKind {
+    DEEP_INDENTATION,
+    LONG_EXPRESSIONS,
+    MANY_IDENTIFIERS,
+    NESTED_PARENTHESES,
+};
+
+static std::string generate(int kind, size_t size) {
+    switch (kind) {
+        case DEEP_INDENTATION:
+            return gen_deep_indentation(size, 48);
+        case LONG_EXPRESSIONS:
+            return gen_long_expressions(size, 200);
+        case MANY_IDENTIFIERS:
+            return gen_many_identifiers(size, 1000);
+        default:
+            return gen_nested_parentheses(size, 100);
+    }
+}
+
+static const char *const KIND_NAMES[] = {"deep_indentation", "long_expressions", "many_identifiers",
+                                        "nested_parentheses"};
+
+static void BM_Lexer(benchmark::State &state) {
+    std::string src = generate(state.range(0), state.range(1));
+    int64_t tokens = 0;
+    for (auto _ : state) {
+        Lexer lexer;
+        lexer_init(&lexer, src.c_str());
+        Token token;
+        do {
+            token = lexer_next_token(&lexer);
+            tokens++;
+        } while (token.type != TOKEN_EOF && token.type != TOKEN_ERROR);
+        if (token.type == TOKEN_ERROR) {
+            state.SkipWithError(lexer_error_message(&lexer));
+            break;
+        }
+        benchmark::DoNotOptimize(token);
+    }
+    state.SetItemsProcessed(tokens);
+    state.SetBytesProcessed((int64_t) state.iterations() * (int64_t) src.size());
+    state.SetLabel(KIND_NAMES[state.range(0)]);
+}
+
+static void BM_Parser(benchmark::State &state) {
+    std::string text = generate(state.range(0), state.range(1));
+    Source src = source_from_string("<bench>", text.c_str());
+    Arena arena = arena_init();
+    for (auto _ : state) {
+        Stmt *stmt = parse_file(&arena, &src, diag_default_handler, nullptr);
+        if (!stmt) {
+            state.SkipWithError("syntax error");
+            break;
+        }
+        benchmark::DoNotOptimize(stmt);
+        arena_reset(&arena);
+    }
+    state.SetBytesProcessed((int64_t) state.iterations() * (int64_t) text.size());
+    state.SetLabel(KIND_NAMES[state.range(0)]);
+    arena_free(&arena);
+    source_free(&src);
+}
+
+static void source_args(benchmark::internal::Benchmark *b) {
+    for (int kind = DEEP_INDENTATION; kind <= NESTED_PARENTHESES; kind++) {
+        for (int64_t size = 16 << 10; size <= 4 << 20; size *= 16) {
+            b->Args({kind, size});
+        }
+    }
+    b->ArgNames({"kind", "bytes"});
+}
+
+BENCHMARK(BM_Lexer)->Apply(source_args);
+BENCHMARK(BM_Parser)->Apply(source_args);
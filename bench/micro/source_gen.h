@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#ifndef SOURCE_GEN_H
+#define SOURCE_GEN_H
+
+#include <cstddef>
+#include <string>
+
+/**
+ * \brief Generates nested `if` blocks of the given depth, repeated until the source has at least `size` bytes.
+ *
+ * Stresses the indentation tracking of the lexer and the recursion of the statement parser.
+ * \param size minimal size of the source in bytes
+ * \param depth nesting depth, less than `MAX_INDENT_STACK`
+ * \return the source code
+ */
+inline std::string gen_deep_indentation(size_t size, int depth) {
+    std::string src;
+    while (src.size() < size) {
+        for (int level = 0; level < depth; level++) {
+            src.append(level * 4, ' ').append("if x > ").append(std::to_string(level)).append(":\n");
+        }
+        src.append(depth * 4, ' ').append("x = x - 1\n");
+    }
+    return src;
+}
+
+/**
+ * \brief Generates assignments of long arithmetic expressions with the given number of terms.
+ *
+ * Every fourth term is parenthesized, so that the expression parser both loops and recurses.
+ * \param size minimal size of the source in bytes
+ * \param terms number of terms of each expression
+ * \return the source code
+ */
+inline std::string gen_long_expressions(size_t size, int terms) {
+    static const char *const OPS[] = {" + ", " * ", " - "};
+    std::string src;
+    while (src.size() < size) {
+        src.append("x = ");
+        for (int i = 0; i < terms; i++) {
+            if (i > 0) {
+                src.append(OPS[i % 3]);
+            }
+            if (i % 4 == 3) {
+                src.append("(y + ").append(std::to_string(i)).append(")");
+            } else {
+                src.append(std::to_string(i * 7919));
+            }
+        }
+        src.append("\n");
+    }
+    return src;
+}
+
+/**
+ * \brief Generates assignments of expressions with the given depth of parentheses.
+ *
+ * Each level compares or combines the nested expression with a name, so that every operator precedence is used.
+ * \param size minimal size of the source in bytes
+ * \param depth number of nested parentheses of each expression
+ * \return the source code
+ */
+inline std::string gen_nested_parentheses(size_t size, int depth) {
+    static const char *const OPS[] = {" + ", " * ", " < ", " - ", " / "};
+    std::string src;
+    while (src.size() < size) {
+        src.append("x = ").append(depth, '(').append("y");
+        for (int i = 0; i < depth; i++) {
+            src.append(OPS[i % 5]).append("z)");
+        }
+        src.append("\n");
+    }
+    return src;
+}
+
+/**
+ * \brief Generates assignments between many distinct identifiers.
+ *
+ * Stresses the scanning of identifiers and keywords.
+ * \param size minimal size of the source in bytes
+ * \param count number of distinct identifiers
+ * \return the source code
+ */
+inline std::string gen_many_identifiers(size_t size, int count) {
+    std::string src;
+    for (int i = 0; src.size() < size; i++) {
+        src.append("variable_").append(std::to_string(i % count))
+                .append(" = value_").append(std::to_string((i * 31 + 7) % count))
+                .append(" + other_").append(std::to_string((i * 17 + 3) % count)).append("\n");
+    }
+    return src;
+}
+
+#endif //SOURCE_GEN_H
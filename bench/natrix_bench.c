@@ -0,0 +1,460 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file natrix_bench.c
+ * \brief End-to-end benchmark harness.
+ *
+ * Each workload is run the given number of times, every run in a fresh child process so that the runs do not share
+ * the heap and the peak resident set size can be measured. The child parses, compiles and executes the program in
+ * the virtual machine, as `natrix` does with the default options, with the output discarded. It reports the wall
+ * time, the number of instructions executed in user space (if `perf_event_open()` is permitted) and the statistics of
+ * the garbage collector back to the parent through a pipe.
+ *
+ * The results are printed as JSON. If a baseline produced by an earlier run is given, the results are compared with
+ * it and workloads which got slower by more than the threshold (10 % by default) are reported as regressions. If the
+ * baseline does not exist yet, it is created from the results.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "natrix/interp/program.h"
+#include "natrix/interp/vm.h"
+#include "natrix/obj/nx_int.h"
+#include "natrix/util/gc.h"
+#include "natrix/util/mem.h"
+#include "natrix/util/output.h"
+#include "natrix/util/perf_counters.h"
+
+//! Default number of runs of each workload.
+#define DEFAULT_RUNS 5
+
+//! Default relative slowdown reported as a regression.
+#define DEFAULT_THRESHOLD 0.10
+
+/**
+ * \brief Measurements of a single run, sent from the child to the parent.
+ */
+typedef struct {
+    uint64_t wall_ns;               //!< Wall time of loading, compiling and executing the program
+    int64_t instructions;           //!< Instructions executed in user space, -1 if not available
+    uint64_t allocated_objects;     //!< Number of objects allocated by the garbage collector
+    uint64_t allocated_bytes;       //!< Number of bytes allocated by the garbage collector
+    uint64_t gc_count;              //!< Number of minor and major collections
+} RunResult;
+
+/**
+ * \brief Aggregated measurements of a workload.
+ */
+typedef struct {
+    const char *path;               //!< Path of the source file
+    char name[64];                  //!< Name of the workload, the file name without the extension
+    uint64_t wall_ns;               //!< Median wall time
+    uint64_t wall_ns_min;           //!< Minimal wall time
+    int64_t instructions;           //!< Median number of instructions, -1 if not available
+    RunResult last;                 //!< The last run, for the counters which do not vary between runs
+    long peak_rss_kb;               //!< Maximal peak resident set size of the runs in KiB
+    int64_t baseline_wall_ns_min;   //!< Minimal wall time in the baseline, -1 if not in the baseline
+    int64_t baseline_instructions;  //!< Median number of instructions in the baseline, -1 if not available
+    bool regression;                //!< The workload is slower than the baseline by more than the threshold
+} Workload;
+
+/**
+ * \brief Returns the value of the monotonic clock in nanoseconds.
+ * \return the time in nanoseconds
+ */
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/**
+ * \brief Runs the program in the child process and writes the measurements to the pipe.
+ * \param path the path of the source file
+ * \param fd the write end of the pipe
+ * \return the exit status of the child
+ */
+static int child_main(const char *path, int fd) {
+#if ENABLE_CONSERVATIVE_GC
+    gc_set_stack_bottom(__builtin_frame_address(0));
+#endif
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd < 0 || dup2(null_fd, STDOUT_FILENO) < 0) {
+        return 1;
+    }
+    close(null_fd);
+    PerfCounters counters;
+    perf_counters_start(&counters);
+    uint64_t start = now_ns();
+    Source source = source_from_file(path);
+    if (!source.start) {
+        fprintf(stderr, "Unable to read file %s\n", path);
+        return 1;
+    }
+    Env env = env_init();
+    gc_root(&env.gc_header);
+    Program program;
+    program_init(&program);
+    if (!program_build(&program, &env, &source, nx_int_create(0), false)) {
+        return 1;
+    }
+    vm_exec(&env, &program.code);
+    // the buffered output is written to /dev/null within the measured time, as by `natrix`
+    output_flush();
+    RunResult result = {.wall_ns = now_ns() - start, .instructions = -1};
+    perf_counters_stop(&counters);
+    uint64_t count;
+    if (perf_counters_read(&counters, PERF_COUNTER_INSTRUCTIONS, &count)) {
+        result.instructions = (int64_t) count;
+    }
+    perf_counters_close(&counters);
+    GcStats stats;
+    gc_get_stats(&stats);
+    result.allocated_objects = stats.allocated_objects;
+    result.allocated_bytes = stats.allocated_bytes;
+    result.gc_count = stats.minor_collections + stats.major_collections;
+    // the process exits right away, the heap and the source are not freed
+    return write(fd, &result, sizeof(result)) == sizeof(result) ? 0 : 1;
+}
+
+/**
+ * \brief Runs a workload once in a child process.
+ * \param path the path of the source file
+ * \param result receives the measurements
+ * \param peak_rss_kb receives the peak resident set size of the child in KiB
+ * \return true if the run succeeded
+ */
+static bool run_once(const char *path, RunResult *result, long *peak_rss_kb) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        return false;
+    }
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return false;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        _exit(child_main(path, fds[1]));
+    }
+    close(fds[1]);
+    ssize_t received = 0;
+    while (received < (ssize_t) sizeof(*result)) {
+        ssize_t n = read(fds[0], (char *) result + received, sizeof(*result) - received);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        received += n;
+    }
+    close(fds[0]);
+    int status;
+    struct rusage usage;
+    while (wait4(pid, &status, 0, &usage) < 0) {
+        if (errno != EINTR) {
+            perror("wait4");
+            return false;
+        }
+    }
+    *peak_rss_kb = usage.ru_maxrss;
+    return received == sizeof(*result) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+//! Comparison of unsigned 64-bit integers for `qsort()`.
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+//! Comparison of signed 64-bit integers for `qsort()`.
+static int compare_i64(const void *a, const void *b) {
+    int64_t x = *(const int64_t *) a;
+    int64_t y = *(const int64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * \brief Runs a workload the given number of times and aggregates the measurements.
+ * \param workload the workload, `path` and `name` must be set
+ * \param runs number of runs, at least one
+ * \return true if all runs succeeded
+ */
+static bool run_workload(Workload *workload, int runs) {
+    uint64_t *wall = nx_alloc(runs * sizeof(uint64_t));
+    int64_t *instructions = nx_alloc(runs * sizeof(int64_t));
+    workload->peak_rss_kb = 0;
+    bool ok = true;
+    for (int i = 0; i < runs && ok; i++) {
+        long rss;
+        ok = run_once(workload->path, &workload->last, &rss);
+        wall[i] = workload->last.wall_ns;
+        instructions[i] = workload->last.instructions;
+        workload->peak_rss_kb = rss > workload->peak_rss_kb ? rss : workload->peak_rss_kb;
+    }
+    if (ok) {
+        qsort(wall, runs, sizeof(uint64_t), compare_u64);
+        qsort(instructions, runs, sizeof(int64_t), compare_i64);
+        workload->wall_ns = wall[runs / 2];
+        workload->wall_ns_min = wall[0];
+        // a counter which failed in some of the runs is reported as unavailable
+        workload->instructions = instructions[0] < 0 ? -1 : instructions[runs / 2];
+    }
+    nx_free(wall);
+    nx_free(instructions);
+    return ok;
+}
+
+/**
+ * \brief Finds an integer field of a JSON object.
+ * \param object the start of the object
+ * \param end the end of the object
+ * \param key the name of the field, including the quotes
+ * \return the value of the field, -1 if it is missing or null
+ */
+static int64_t find_field(const char *object, const char *end, const char *key) {
+    const char *p = strstr(object, key);
+    if (!p || p >= end) {
+        return -1;
+    }
+    p += strlen(key);
+    while (*p == ' ' || *p == ':') {
+        p++;
+    }
+    char *value_end;
+    long long value = strtoll(p, &value_end, 10);
+    return value_end == p ? -1 : value;
+}
+
+/**
+ * \brief Reads a baseline produced by an earlier run and fills the baseline fields of the workloads.
+ *
+ * Only the output of this program is supported, which has one workload per line. Workloads missing in the baseline
+ * are not compared.
+ * \param path the path of the baseline
+ * \param workloads the workloads
+ * \param count number of workloads
+ * \return true if the baseline could be read
+ */
+static bool load_baseline(const char *path, Workload *workloads, int count) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "Unable to read baseline %s\n", path);
+        return false;
+    }
+    char line[1024];
+    while (fgets(line, sizeof(line), f)) {
+        const char *name = strstr(line, "\"name\": \"");
+        if (!name) {
+            continue;
+        }
+        name += strlen("\"name\": \"");
+        const char *name_end = strchr(name, '"');
+        const char *object_end = strchr(line, '}');
+        if (!name_end || !object_end) {
+            continue;
+        }
+        for (int i = 0; i < count; i++) {
+            if (strlen(workloads[i].name) == (size_t) (name_end - name)
+                && memcmp(workloads[i].name, name, name_end - name) == 0) {
+                workloads[i].baseline_wall_ns_min = find_field(name_end, object_end, "\"wall_ns_min\"");
+                workloads[i].baseline_instructions = find_field(name_end, object_end, "\"instructions\"");
+            }
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+/**
+ * \brief Compares a workload with its baseline.
+ *
+ * The instruction counts are compared if available in both, since they are much less noisy than the wall time.
+ * Otherwise the minimal wall times are compared, which are less affected by other load of the machine than the
+ * medians.
+ * \param w the workload
+ * \param threshold the relative slowdown reported as a regression
+ */
+static void compare_with_baseline(Workload *w, double threshold) {
+    if (w->instructions >= 0 && w->baseline_instructions > 0) {
+        w->regression = (double) w->instructions > (double) w->baseline_instructions * (1 + threshold);
+    } else if (w->baseline_wall_ns_min > 0) {
+        w->regression = (double) w->wall_ns_min > (double) w->baseline_wall_ns_min * (1 + threshold);
+    }
+}
+
+/**
+ * \brief Prints an integer JSON field, or null if the value is negative.
+ * \param f the output file
+ * \param key the name of the field
+ * \param value the value
+ */
+static void print_optional(FILE *f, const char *key, int64_t value) {
+    if (value < 0) {
+        fprintf(f, ", \"%s\": null", key);
+    } else {
+        fprintf(f, ", \"%s\": %lld", key, (long long) value);
+    }
+}
+
+/**
+ * \brief Prints the results as JSON, one workload per line.
+ * \param f the output file
+ * \param workloads the workloads
+ * \param count number of workloads
+ * \param runs number of runs of each workload
+ * \param baseline true if the workloads were compared with a baseline
+ */
+static void print_results(FILE *f, const Workload *workloads, int count, int runs, bool baseline) {
+    fprintf(f, "{\n  \"runs\": %d,\n  \"workloads\": [\n", runs);
+    for (int i = 0; i < count; i++) {
+        const Workload *w = &workloads[i];
+        fprintf(f, "    {\"name\": \"%s\", \"wall_ns\": %llu, \"wall_ns_min\": %llu", w->name,
+                (unsigned long long) w->wall_ns, (unsigned long long) w->wall_ns_min);
+        print_optional(f, "instructions", w->instructions);
+        fprintf(f, ", \"allocated_objects\": %llu, \"allocated_bytes\": %llu, \"gc_count\": %llu, \"peak_rss_kb\": %ld",
+                (unsigned long long) w->last.allocated_objects, (unsigned long long) w->last.allocated_bytes,
+                (unsigned long long) w->last.gc_count, w->peak_rss_kb);
+        if (baseline) {
+            print_optional(f, "baseline_wall_ns_min", w->baseline_wall_ns_min);
+            print_optional(f, "baseline_instructions", w->baseline_instructions);
+            fprintf(f, ", \"regression\": %s", w->regression ? "true" : "false");
+        }
+        fprintf(f, "}%s\n", i + 1 < count ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+}
+
+/**
+ * \brief Prints the usage information.
+ * \param program the name of the executable
+ */
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [--runs=N] [--baseline=FILE] [--threshold=PERCENT] [--output=FILE] <workload.ntx>...\n",
+            program);
+}
+
+/**
+ * \brief Entry point of the benchmark harness.
+ * \return 0 if successful, 1 on errors, 2 if a regression was detected
+ */
+int main(int argc, char **argv) {
+    static const struct option long_options[] = {
+            {"runs", required_argument, NULL, 'r'},
+            {"baseline", required_argument, NULL, 'b'},
+            {"threshold", required_argument, NULL, 't'},
+            {"output", required_argument, NULL, 'o'},
+            {NULL, 0, NULL, 0},
+    };
+    int runs = DEFAULT_RUNS;
+    double threshold = DEFAULT_THRESHOLD;
+    const char *baseline = NULL;
+    const char *output = NULL;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        char *end;
+        if (opt == 'r') {
+            runs = (int) strtol(optarg, &end, 10);
+            if (end == optarg || *end != '\0' || runs < 1) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (opt == 't') {
+            threshold = strtod(optarg, &end) / 100;
+            if (end == optarg || *end != '\0' || threshold < 0) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (opt == 'b') {
+            baseline = optarg;
+        } else if (opt == 'o') {
+            output = optarg;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    int count = argc - optind;
+    if (count == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    Workload *workloads = nx_alloc(count * sizeof(Workload));
+    for (int i = 0; i < count; i++) {
+        Workload *w = &workloads[i];
+        memset(w, 0, sizeof(*w));
+        w->path = argv[optind + i];
+        const char *base = strrchr(w->path, '/') ? strrchr(w->path, '/') + 1 : w->path;
+        size_t length = strcspn(base, ".");
+        length = length < sizeof(w->name) ? length : sizeof(w->name) - 1;
+        memcpy(w->name, base, length);
+        w->baseline_wall_ns_min = -1;
+        w->baseline_instructions = -1;
+    }
+    bool compare = baseline && access(baseline, F_OK) == 0;
+    if (compare && !load_baseline(baseline, workloads, count)) {
+        nx_free(workloads);
+        return 1;
+    }
+    int status = 0;
+    for (int i = 0; i < count && status != 1; i++) {
+        Workload *w = &workloads[i];
+        fprintf(stderr, "%s...", w->name);
+        if (!run_workload(w, runs)) {
+            fprintf(stderr, " failed\n");
+            status = 1;
+            break;
+        }
+        compare_with_baseline(w, threshold);
+        fprintf(stderr, " %.1f ms%s\n", (double) w->wall_ns_min / 1e6, w->regression ? " REGRESSION" : "");
+        if (w->regression) {
+            status = 2;
+        }
+    }
+    if (status != 1) {
+        FILE *f = output ? fopen(output, "w") : stdout;
+        if (!f) {
+            fprintf(stderr, "Unable to write %s\n", output);
+            status = 1;
+        } else {
+            print_results(f, workloads, count, runs, compare);
+            if (f != stdout) {
+                fclose(f);
+            }
+        }
+    }
+    if (status == 0 && baseline && !compare) {
+        FILE *f = fopen(baseline, "w");
+        if (!f) {
+            fprintf(stderr, "Unable to write baseline %s\n", baseline);
+            status = 1;
+        } else {
+            print_results(f, workloads, count, runs, false);
+            fclose(f);
+            fprintf(stderr, "Created baseline %s\n", baseline);
+        }
+    }
+    nx_free(workloads);
+    return status;
+}
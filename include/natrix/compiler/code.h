@@ -0,0 +1,320 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file code.h
+ * \brief Bytecode representation of natrix programs.
+ *
+ * A `Code` object holds the bytecode of a program together with its constant pool and the names of variable slots.
+ * The bytecode is a contiguous sequence of instructions for a stack-based virtual machine. Each instruction
+ * consists of a one byte opcode optionally followed by a 32-bit operand in native byte order, see `opcodes.inc`
+ * for the list of instructions. Jump operands are signed offsets relative to the start of the next instruction.
+ *
+ * For example, `print(n + 1)` is compiled to:
+ * \code
+ *     0000 LOAD_VAR 0 (n)
+ *     0005 CONST 0 (1)
+ *     0010 ADD 0
+ *     0015 PRINT
+ * \endcode
+ *
+ * Binary operators are quickened: each of them has a site which collects type feedback, and the virtual machine
+ * rewrites the opcode in place into a variant specialized for the observed operand types, see `vm.c`. Common
+ * sequences of instructions start with a superinstruction executing the whole sequence, see `opcodes.inc`.
+ *
+ * The back edge of each loop is a `LOOP` instruction referring to a loop record, which counts the iterations and
+ * holds the native code of the loop once the loop becomes hot, see `jit.h`.
+ */
+
+#ifndef CODE_H
+#define CODE_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "natrix/obj/nx_object.h"
+#include "natrix/parser/ast.h"
+#include "natrix/util/sb.h"
+
+/**
+ * \brief Determines the meaning of the operand of an instruction.
+ */
+typedef enum {
+    OPERAND_NONE,           //!< The instruction has no operand
+    OPERAND_CONST,          //!< Index into the constant pool
+    OPERAND_SLOT,           //!< Slot of a variable in the environment
+    OPERAND_COUNT,          //!< Number of items
+    OPERAND_JUMP,           //!< Signed offset of the jump target relative to the next instruction
+    OPERAND_SITE,           //!< Index of the site of a binary operator
+    OPERAND_LOOP,           //!< Index of the loop record of a back edge
+    OPERAND_CALL,           //!< Index of a built-in function and number of arguments, see `code_call_operand()`
+} OperandKind;
+
+/**
+ * \brief Instruction opcodes.
+ *
+ * See `opcodes.inc` for the list of opcodes. For each opcode in the file, a corresponding enum value
+ * is defined with the `OP_` prefix.
+ */
+typedef enum {
+    #define OP(x, operand) OP_##x,
+    #include "opcodes.inc"
+    #undef OP
+    OPCODE_COUNT
+} Opcode;
+
+//! Size of an instruction operand in bytes.
+#define OPERAND_SIZE    4
+
+//! Number of executions of a binary operator before it is specialized.
+#define CODE_SITE_WARMUP 8
+
+/**
+ * \brief Type feedback and counters of a binary operator instruction.
+ */
+typedef struct {
+    size_t offset;                  //!< Offset of the instruction in the bytecode
+    BinaryOp op;                    //!< The binary operator
+    uint32_t warmup;                //!< Number of executions left before the instruction is specialized
+    uint32_t specialized;           //!< Number of times the instruction was specialized
+    uint32_t deoptimized;           //!< Number of times a specialized instruction fell back to the adaptive one
+    bool temporary;                 //!< Whether the result is a temporary, see `ExprBinary.temporary`
+} CodeSite;
+
+typedef struct JitCode JitCode;
+
+/**
+ * \brief Bytecode range and counters of a loop.
+ *
+ * The loop spans from `start`, the target of its back edge, to `end`, which is where its condition jumps when
+ * it is false. The operand stack is empty at both.
+ */
+typedef struct {
+    size_t start;                   //!< Offset of the first instruction of the loop
+    size_t end;                     //!< Offset of the instruction following the back edge
+    uint32_t counter;               //!< Number of back edges taken
+    uint32_t deoptimized;           //!< Number of times the native code returned before the loop finished
+    JitCode *native;                //!< Native code of the loop, `NULL` if not compiled
+    bool failed;                    //!< Whether the loop cannot be or should no longer be compiled
+} CodeLoop;
+
+/**
+ * \brief Name of a variable slot referenced by the bytecode.
+ */
+typedef struct {
+    const char *start;              //!< Start of the name in the source code
+    size_t length;                  //!< Length of the name
+} CodeName;
+
+//! Value of `CodeLine.parent` for top-level statements.
+#define CODE_NO_PARENT UINT32_MAX
+
+/**
+ * \brief Statement which a range of instructions belongs to, used by the profiler.
+ * An entry applies to the instructions from its offset up to the offset of the next entry. A statement containing
+ * other statements has an entry for each range of its own instructions, e.g. the condition of a loop and its back
+ * edge, all with the same position and parent.
+ */
+typedef struct {
+    size_t offset;                  //!< Offset of the first instruction of the range
+    const char *position;           //!< Position of the statement in the source code, see `ast_get_stmt_position()`
+    uint32_t parent;                //!< Index of an entry of the enclosing statement, `CODE_NO_PARENT` if none
+} CodeLine;
+
+/**
+ * \brief Compiled program.
+ *
+ * The code object is not allocated by the garbage collector, but it contains references to the constants,
+ * which are. Therefore, it must be rooted using `gc_root(&code.gc_header)` before any constant is added.
+ * The members should not be modified directly, use the provided functions instead. The only exception is the
+ * virtual machine, which rewrites the opcodes of binary operators, updates their sites and compiles the loops
+ * during execution.
+ */
+typedef struct {
+    GcHeader gc_header;             //!< Header for the garbage collector, traces the constants
+    uint8_t *bytecode;              //!< The instructions
+    size_t bytecode_size;           //!< Number of bytes of the instructions
+    size_t bytecode_capacity;       //!< Capacity of the `bytecode` buffer
+    NxObject **constants;           //!< The constant pool
+    size_t constant_count;          //!< Number of constants in the pool
+    size_t constant_capacity;       //!< Capacity of the `constants` array
+    CodeName *names;                //!< Names of the variable slots for disassembly, indexed by slot
+    size_t name_count;              //!< Number of entries in `names`, one more than the highest slot with a name
+    size_t name_capacity;           //!< Capacity of the `names` array
+    CodeSite *sites;                //!< Sites of the binary operators
+    size_t site_count;              //!< Number of sites
+    size_t site_capacity;           //!< Capacity of the `sites` array
+    CodeLoop *loops;                //!< Loop records of the back edges
+    size_t loop_count;              //!< Number of loop records
+    size_t loop_capacity;           //!< Capacity of the `loops` array
+    CodeLine *lines;                //!< Statements of the ranges of instructions, ordered by offset
+    size_t line_count;              //!< Number of entries in `lines`
+    size_t line_capacity;           //!< Capacity of the `lines` array
+    size_t max_stack;               //!< Maximum depth of the operand stack needed to execute the bytecode
+} Code;
+
+/**
+ * \brief Initializes an empty code object.
+ * \return the initialized code object
+ */
+Code code_init();
+
+/**
+ * \brief Frees the memory allocated by the code object.
+ * \param code the code object, must not be rooted
+ */
+void code_free(Code *code);
+
+/**
+ * \brief Appends an instruction without an operand.
+ * \param code the code object
+ * \param op the opcode, which must not require an operand
+ * \return offset of the instruction in the bytecode
+ */
+size_t code_emit(Code *code, Opcode op);
+
+/**
+ * \brief Appends an instruction with an operand.
+ * \param code the code object
+ * \param op the opcode, which must require an operand
+ * \param operand the operand
+ * \return offset of the instruction in the bytecode
+ */
+size_t code_emit_with_operand(Code *code, Opcode op, uint32_t operand);
+
+/**
+ * \brief Sets the target of a previously emitted jump instruction.
+ * \param code the code object
+ * \param offset offset of the jump instruction returned by `code_emit_with_operand`
+ * \param target offset of the target instruction
+ */
+void code_patch_jump(Code *code, size_t offset, size_t target);
+
+/**
+ * \brief Adds a constant to the constant pool.
+ * \param code the code object, must be rooted
+ * \param value the constant
+ * \return the index of the constant in the pool
+ */
+uint32_t code_add_constant(Code *code, NxObject *value);
+
+/**
+ * \brief Adds a site for a binary operator instruction.
+ *
+ * The site refers to the next instruction, so it must be added right before the instruction is emitted.
+ * \param code the code object
+ * \param op the binary operator
+ * \param temporary whether the result is a temporary, which the VM allocates among the temporaries of the statement
+ * \return the index of the site, to be used as the operand of the instruction
+ */
+uint32_t code_add_site(Code *code, BinaryOp op, bool temporary);
+
+/**
+ * \brief Adds a loop record for a back edge.
+ *
+ * The back edge must be emitted right after the loop record is added, the end of the loop is the offset following
+ * the back edge.
+ * \param code the code object
+ * \param start offset of the first instruction of the loop
+ * \return the index of the loop record, to be used as the operand of the `LOOP` instruction
+ */
+uint32_t code_add_loop(Code *code, size_t start);
+
+/**
+ * \brief Records that the instructions emitted next belong to a statement.
+ * \param code the code object
+ * \param position position of the statement in the source code
+ * \param parent index of an entry of the enclosing statement, `CODE_NO_PARENT` if none
+ * \return the index of the entry, to be used as the parent of nested statements
+ */
+uint32_t code_add_line(Code *code, const char *position, uint32_t parent);
+
+/**
+ * \brief Records the name of a variable slot for disassembly.
+ * \param code the code object
+ * \param slot the slot of the variable
+ * \param start start of the name, must outlive the code object
+ * \param length length of the name
+ */
+void code_set_slot_name(Code *code, uint32_t slot, const char *start, size_t length);
+
+/**
+ * \brief Returns the name of the opcode as a string.
+ * \param op the opcode
+ * \return name of the opcode or "UNKNOWN" if the opcode is not recognized
+ */
+const char *code_get_opcode_name(Opcode op);
+
+/**
+ * \brief Returns the kind of the operand of the given opcode.
+ * \param op the opcode
+ * \return the kind of the operand
+ */
+OperandKind code_get_operand_kind(Opcode op);
+
+/**
+ * \brief Reads the operand of the instruction.
+ * \param ip pointer to the opcode of the instruction
+ * \return the operand
+ */
+static inline uint32_t code_read_operand(const uint8_t *ip) {
+    uint32_t operand;
+    memcpy(&operand, ip + 1, OPERAND_SIZE);
+    return operand;
+}
+
+/**
+ * \brief Encodes the operand of a call instruction.
+ * \param builtin index of the built-in function
+ * \param argc number of arguments, at most `AST_MAX_ARGS`
+ * \return the operand, the number of arguments is stored in the lowest byte
+ */
+static inline uint32_t code_call_operand(uint32_t builtin, uint32_t argc) {
+    assert(argc <= AST_MAX_ARGS && builtin < (UINT32_MAX >> 8));
+    return builtin << 8 | argc;
+}
+
+/**
+ * \brief Returns the index of the built-in function called by a call instruction.
+ * \param operand the operand of the instruction
+ * \return the index of the function
+ */
+static inline uint32_t code_call_builtin(uint32_t operand) {
+    return operand >> 8;
+}
+
+/**
+ * \brief Returns the number of arguments of a call instruction.
+ * \param operand the operand of the instruction
+ * \return the number of arguments
+ */
+static inline uint32_t code_call_argc(uint32_t operand) {
+    return operand & 0xFF;
+}
+
+/**
+ * \brief Disassembles the bytecode to a string builder.
+ * \param sb string builder to which the disassembly will be written
+ * \param code the code object
+ */
+void code_dump(StringBuilder *sb, const Code *code);
+
+/**
+ * \brief Dumps the sites of the binary operators with their current opcodes and counters to a string builder.
+ * \param sb string builder to which the sites will be written
+ * \param code the code object
+ */
+void code_dump_sites(StringBuilder *sb, const Code *code);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //CODE_H
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file code_cache.h
+ * \brief On-disk cache of compiled programs.
+ *
+ * A cache file holds everything the virtual machine needs to run a program without lexing, parsing, resolving and
+ * compiling it again: the bytecode, the constant pool, the sites of the binary operators, the loop records and the
+ * names of the variable slots. The file starts with a header identifying the format and the version of the
+ * interpreter, followed by the hash and the size of the source code and the flags the program was compiled with.
+ * A file whose header does not match is stale and is ignored, it is overwritten by the next `code_cache_save()`.
+ * The header also holds a hash of the sections, and the bytecode is checked by abstract interpretation before it is
+ * accepted (valid jump targets and stack depths), so that a corrupted file is treated as stale too.
+ *
+ * The sections are stored in the native layout and are aligned to 8 bytes, so loading a file maps it into memory,
+ * copies the bytecode and the tables and creates the constants. The names of the slots point into the mapping,
+ * which therefore must outlive the environment and the code object, see `code_cache_close()`.
+ */
+
+#ifndef CODE_CACHE_H
+#define CODE_CACHE_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "natrix/compiler/code.h"
+#include "natrix/interp/env.h"
+#include "natrix/parser/source.h"
+
+//! Version of the cache format, to be incremented whenever the format or the bytecode changes.
+#define CODE_CACHE_VERSION 10
+
+/**
+ * \brief Memory mapping of a loaded cache file.
+ */
+typedef struct {
+    void *data;                     //!< Start of the mapping, `NULL` if no file is loaded
+    size_t size;                    //!< Size of the mapping
+} CodeCache;
+
+//! Size of the header of a cache file, which is followed by the sections protected by its payload hash.
+#define CODE_CACHE_HEADER_SIZE 112
+
+//! Offset of the hash of the sections in the header of a cache file.
+#define CODE_CACHE_PAYLOAD_HASH_OFFSET 104
+
+/**
+ * \brief Computes the hash of bytes used by cache files, for the source code and the sections following the header.
+ *
+ * The hash only detects modified sources and corrupted files, it does not resist attacks.
+ * \param data the bytes
+ * \param length the number of bytes
+ * \return the hash
+ */
+uint64_t code_cache_hash_bytes(const void *data, size_t length);
+
+/**
+ * \brief Computes the hash of the source code which identifies it in the cache.
+ * \param source the source code
+ * \return the hash
+ */
+uint64_t code_cache_hash(const Source *source);
+
+/**
+ * \brief Loads a compiled program from a cache file.
+ *
+ * May trigger garbage collection.
+ * \param cache receives the mapping of the file, must be closed by `code_cache_close()` if the load succeeds
+ * \param path the path of the cache file
+ * \param source the source code of the program, used to detect a stale file
+ * \param flags the flags that affect compilation, used to detect a stale file
+ * \param env an empty environment, must be rooted, receives the variable slots of the program
+ * \param code an empty code object, must be rooted, receives the compiled program
+ * \return true if the file exists and matches the source code, false if the program must be compiled
+ */
+bool code_cache_load(CodeCache *cache, const char *path, const Source *source, uint32_t flags, Env *env, Code *code);
+
+/**
+ * \brief Unmaps a cache file loaded by `code_cache_load()`.
+ *
+ * The environment and the code object filled by the load must already be freed.
+ * \param cache the cache
+ */
+void code_cache_close(CodeCache *cache);
+
+/**
+ * \brief Saves a compiled program to a cache file.
+ *
+ * The program must not have been executed yet, since the virtual machine rewrites the bytecode. The file is
+ * written to a temporary file first and then renamed, so that concurrent runs never see a partially written file.
+ * \param path the path of the cache file
+ * \param source the source code of the program
+ * \param flags the flags that affect compilation
+ * \param env the environment the program was resolved in
+ * \param code the compiled program
+ * \return true if the file was written
+ */
+bool code_cache_save(const char *path, const Source *source, uint32_t flags, const Env *env, const Code *code);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //CODE_CACHE_H
@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file compiler.h
+ * \brief Compiler from the abstract syntax tree to bytecode.
+ *
+ * The compiler lowers the abstract syntax tree produced by the parser to the bytecode executed by the virtual
+ * machine. Expressions are evaluated on the operand stack, the values of literals are taken from the literal pool
+ * into the constant pool of the code object and control flow statements are translated to conditional and unconditional jumps:
+ * \code
+ *     while cond:            loop: <cond>
+ *         body                     JUMP_IF_FALSE end
+ *                                  <body>
+ *                                  LOOP loop
+ *                            end:
+ * \endcode
+ */
+
+#ifndef COMPILER_H
+#define COMPILER_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "natrix/compiler/code.h"
+#include "natrix/interp/literal_pool.h"
+#include "natrix/parser/ast.h"
+
+/**
+ * \brief Compiles a program to bytecode.
+ *
+ * The bytecode is terminated by the `HALT` instruction.
+ * \param code the code object to which the bytecode will be appended, must be empty and rooted
+ * \param literals the literal pool filled by `resolve_program`
+ * \param stmt the first statement of the program, must be resolved by `resolve_program`
+ */
+void compile_program(Code *code, const LiteralPool *literals, const Stmt *stmt);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //COMPILER_H
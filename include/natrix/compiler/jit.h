@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file jit.h
+ * \brief Baseline compiler of hot loops to native code.
+ *
+ * The virtual machine counts the back edges taken by each loop (see `CodeLoop`). When the counter reaches the
+ * threshold of the policy, the bytecode of the loop, including nested loops, is translated to native code, which
+ * then runs instead of the interpreter every time the loop reaches its back edge.
+ *
+ * The translation is template-based: each instruction is replaced by a fixed sequence of machine instructions.
+ * Only loops computing with integers are compiled, the supported instructions are `CONST` of an immediate integer,
+ * `LOAD_VAR`, `STORE_VAR`, the binary operators except those the interpreter has specialized to `BINARY` or
+ * `ADD_STR`, `JUMP`, `JUMP_IF_FALSE`, `LOOP` and `POP`. Comparisons are only supported right before `JUMP_IF_FALSE`,
+ * since their result is a `bool` rather than an integer. On entry, the variables used by the loop are guarded to hold
+ * immediate integers and unboxed into the native stack frame, which also holds the operand stack. Arithmetic works
+ * on the raw 64-bit values. When the result of an operation would not fit in an immediate integer or a division
+ * by zero is attempted, the native code deoptimizes: it boxes the assigned variables and the operand stack back
+ * and returns the offset of the failed instruction, so that the interpreter executes it with the generic semantics.
+ * Since boxing an immediate integer does not allocate, native code never triggers garbage collection. At every back
+ * edge, the native code polls the safepoint of the thread and returns to the interpreter at the `LOOP` instruction
+ * if a request is pending, so that the interpreter handles it (see safepoint.h).
+ *
+ * Native code is generated for x86-64 only, on other architectures `jit_compile_loop()` always fails and
+ * the loops are interpreted. When `JitPolicy.perf_map` is set, each compiled loop is recorded in
+ * `/tmp/perf-<pid>.map`, which `perf report` uses to attribute samples to the generated code.
+ */
+
+#ifndef JIT_H
+#define JIT_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include "natrix/compiler/code.h"
+#include "natrix/util/safepoint.h"
+
+/**
+ * \brief Configuration of the loop compiler.
+ */
+typedef struct {
+    bool enabled;                   //!< Whether hot loops are compiled
+    uint32_t threshold;             //!< Number of back edges of a loop after which the loop is compiled
+    bool perf_map;                  //!< Whether to record the compiled loops in `/tmp/perf-<pid>.map`
+} JitPolicy;
+
+//! Default number of back edges after which a loop is compiled.
+#define JIT_DEFAULT_THRESHOLD 1000
+
+/**
+ * \brief State of the interpreter when native code returns.
+ */
+typedef struct {
+    size_t offset;                  //!< Offset of the bytecode instruction to continue with
+    size_t depth;                   //!< Number of values the native code pushed to the operand stack
+} JitExit;
+
+/**
+ * \brief Returns the default policy of the loop compiler.
+ *
+ * The compiler is enabled by default if it supports the architecture.
+ * \return the default policy
+ */
+JitPolicy jit_default_policy();
+
+/**
+ * \brief Returns the current policy of the loop compiler.
+ * \return the current policy
+ */
+JitPolicy jit_get_policy();
+
+/**
+ * \brief Changes the policy of the loop compiler.
+ *
+ * Panics if the threshold is zero.
+ * \param policy the new policy
+ */
+void jit_set_policy(const JitPolicy *policy);
+
+/**
+ * \brief Determines whether native code can be generated for the architecture.
+ * \return true if the loop compiler is supported
+ */
+bool jit_is_supported();
+
+/**
+ * \brief Compiles a loop to native code.
+ *
+ * The opcodes of the binary operators in the loop determine which of them are compiled, so the loop should have
+ * been executed by the interpreter for a while.
+ * \param code the code object containing the loop
+ * \param loop the loop record
+ * \return the native code, `NULL` if the loop contains an unsupported instruction or it cannot be compiled for
+ *         another reason
+ */
+JitCode *jit_compile_loop(const Code *code, const CodeLoop *loop);
+
+/**
+ * \brief Executes the native code of a loop.
+ *
+ * The execution starts at the beginning of the loop. The native code either leaves the loop, or returns to the
+ * interpreter at the instruction it could not execute. If the variables do not hold immediate integers, it returns
+ * immediately with the offset of the start of the loop.
+ * \param native the native code
+ * \param values the values of the variables in the environment
+ * \param stack the top of the operand stack, receives the values the interpreter needs to continue
+ * \param safepoint the safepoint polled at the back edges
+ * \return the instruction to continue with and the number of values pushed to the operand stack
+ */
+JitExit jit_enter(const JitCode *native, NxObject **values, NxObject **stack, Safepoint *safepoint);
+
+/**
+ * \brief Frees native code.
+ * \param native the native code, may be `NULL`
+ */
+void jit_free(JitCode *native);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //JIT_H
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file optimizer.h
+ * \brief Optimizations of the resolved abstract syntax tree.
+ *
+ * The optimizer is an optional stage between the resolver and the execution engines. It rewrites the tree in place:
+ * - binary operations whose operands are literals are folded into a new literal, unless they would fail
+ *   (e.g. division by zero or mismatched types), so that the error is still reported at run time; comparisons,
+ *   whose value is a `bool`, only if they are the condition of an `if` or `while` statement,
+ * - `if` statements with a literal condition are replaced by the branch that is taken and `while` loops with
+ *   a false literal condition are removed,
+ * - `pass` statements are removed, a body consisting only of `pass` statements is reduced to a single one,
+ * - loop-invariant expressions are hoisted out of `while` loops into temporary variables assigned right before
+ *   the loop.
+ *
+ * Since evaluating a hoisted expression before the loop must not change the behavior of the program even if the
+ * loop or the branch containing the expression is never executed, only expressions which cannot fail are hoisted:
+ * integer arithmetic (no division, unless by a non-zero literal, and no comparisons) of integer literals and of
+ * variables which are only ever assigned integers and are certainly assigned before the loop. The values already
+ * stored in the environment, such as `arg`, are taken into account, so the environment must be in the state in which
+ * the execution starts. The temporary variables are named `$` followed by their slot, which cannot clash with
+ * a user variable.
+ *
+ * The text of a folded literal is its value written out in the arena, so `ast_dump()` shows
+ * `EXPR_INT_LITERAL {literal: "3600"}` for a folded `60 * 60`.
+ */
+
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "natrix/interp/env.h"
+#include "natrix/interp/literal_pool.h"
+#include "natrix/parser/ast.h"
+#include "natrix/util/arena.h"
+
+/**
+ * \brief Optimizes a resolved program.
+ *
+ * May trigger garbage collection.
+ * \param arena the arena in which the program was allocated, receives the new nodes
+ * \param env the environment the program was resolved in, receives the temporary variables
+ * \param literals the literal pool of the program, must be rooted, receives the folded values
+ * \param stmt the first statement of the program
+ * \return the first statement of the optimized program, NULL if the program does nothing
+ */
+Stmt *optimize_program(Arena *arena, Env *env, LiteralPool *literals, Stmt *stmt);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //OPTIMIZER_H
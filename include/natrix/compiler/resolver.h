@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file resolver.h
+ * \brief Resolution of variable names to environment slots and materialization of literals.
+ *
+ * The resolver walks the abstract syntax tree right after parsing and assigns a slot of the environment to every
+ * `EXPR_NAME` node (see `ExprName.slot`). All occurrences of the same identifier share the same slot.
+ * The values of integer and string literals are created and stored in the literal pool, the nodes refer to them
+ * by index (see `ExprLiteral.index`). The callees of calls are resolved to built-in functions instead of slots.
+ * Both execution engines require the program to be resolved, they access variables only by their slots and
+ * literals only by their indices.
+ */
+
+#ifndef RESOLVER_H
+#define RESOLVER_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "natrix/interp/env.h"
+#include "natrix/interp/literal_pool.h"
+#include "natrix/parser/ast.h"
+
+/**
+ * \brief Assigns environment slots to all names in the program and adds the values of literals to the pool.
+ *
+ * Slots of names already declared in the environment are reused, new slots are created for the remaining names.
+ * Literals with the same interned symbol (see symbol.h) share one value in the pool.
+ * Arithmetic operations whose result is an operand of another binary operation are marked as temporaries
+ * (see `ExprBinary.temporary`): the result cannot escape, because no binary operation keeps its operands.
+ * Panics if the program calls an undefined function or passes a wrong number of arguments.
+ * May trigger garbage collection.
+ * \param env the environment in which the program will be executed
+ * \param literals the literal pool of the program, must be rooted
+ * \param stmt the first statement of the program
+ */
+void resolve_program(Env *env, LiteralPool *literals, Stmt *stmt);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //RESOLVER_H
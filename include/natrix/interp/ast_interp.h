@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file ast_interp.h
+ * \brief Tree-walking interpreter.
+ *
+ * Executes the abstract syntax tree directly by recursively evaluating its nodes. It is the simplest execution
+ * engine and serves as the reference implementation which the bytecode virtual machine is compared against.
+ */
+
+#ifndef AST_INTERP_H
+#define AST_INTERP_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include "natrix/interp/env.h"
+#include "natrix/interp/literal_pool.h"
+#include "natrix/parser/ast.h"
+
+/**
+ * \brief Executes the given list of statements.
+ *
+ * The output of the program is flushed when it finishes, see `output_flush()`. The safepoint of the calling thread
+ * is polled at every loop back-edge, an interrupt stops the program there (see safepoint.h).
+ * \param env the environment for variable lookup, must be rooted
+ * \param literals the literal pool filled by `resolve_program`
+ * \param stmt the first statement of the program, must be resolved by `resolve_program`
+ * \return true if the program finished, false if it has been interrupted
+ */
+bool ast_interp_exec(Env *env, const LiteralPool *literals, const Stmt *stmt);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //AST_INTERP_H
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file builtins.h
+ * \brief Built-in functions implemented in C.
+ *
+ * The built-in functions are identified by their index in a static table, which the resolver assigns to the callee
+ * of each call expression. The functions receive their arguments as an array of values, which is the top of the
+ * operand stack of the virtual machine, so that a call does not allocate. The names of the functions are not
+ * variables and are not affected by assignments.
+ */
+
+#ifndef BUILTINS_H
+#define BUILTINS_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "natrix/obj/nx_object.h"
+#include "natrix/parser/ast.h"
+
+/**
+ * \brief Indices of the built-in functions, in alphabetical order.
+ */
+typedef enum {
+    BUILTIN_LEN,                //!< `len(x)`, the length of a list, a string or a dict
+    BUILTIN_MAX,                //!< `max(list)` or `max(a, b, ...)`, the largest value
+    BUILTIN_MIN,                //!< `min(list)` or `min(a, b, ...)`, the smallest value
+    BUILTIN_RANGE,              //!< `range([start,] stop[, step])`, the list of integers in the range
+    BUILTIN_READ_FILE,          //!< `read_file([path])`, the contents of the file or of the standard input
+    BUILTIN_READ_LINES,         //!< `read_lines([path])`, an iterator over the lines of the file or of the standard input
+    BUILTIN_SUM,                //!< `sum(list)`, the sum of the items
+    BUILTIN_COUNT               //!< Number of built-in functions
+} BuiltinId;
+
+/**
+ * \brief Implementation of a built-in function.
+ *
+ * May trigger garbage collection.
+ * \param args the arguments, must be rooted
+ * \param argc number of arguments, checked against the arity by the resolver
+ * \return the result of the function
+ */
+typedef NxObject *(*BuiltinFn)(NxObject *const *args, uint32_t argc);
+
+/**
+ * \brief Description of a built-in function.
+ */
+typedef struct {
+    const char *name;           //!< Name of the function
+    uint32_t min_args;          //!< Minimum number of arguments
+    uint32_t max_args;          //!< Maximum number of arguments, `UINT32_MAX` if unlimited
+    BuiltinFn fn;               //!< Implementation
+} Builtin;
+
+/**
+ * \brief Descriptions of the built-in functions, indexed by `BuiltinId`.
+ */
+extern const Builtin builtin_table[BUILTIN_COUNT];
+
+/**
+ * \brief Returns the description of a built-in function.
+ * \param id index of the function, less than `BUILTIN_COUNT`
+ * \return the description
+ */
+static inline const Builtin *builtin_get(uint32_t id) {
+    assert(id < BUILTIN_COUNT);
+    return &builtin_table[id];
+}
+
+/**
+ * \brief Finds a built-in function by name.
+ * \param name the name, not necessarily null-terminated
+ * \param length length of the name
+ * \return the index of the function, `BUILTIN_COUNT` if there is no such function
+ */
+uint32_t builtin_lookup(const char *name, size_t length);
+
+/**
+ * \brief Calls a built-in function.
+ *
+ * May trigger garbage collection.
+ * \param id index of the function, less than `BUILTIN_COUNT`
+ * \param args the arguments, must be rooted
+ * \param argc number of arguments, within the arity of the function
+ * \return the result of the function
+ */
+static inline NxObject *builtin_call(uint32_t id, NxObject *const *args, uint32_t argc) {
+    return builtin_get(id)->fn(args, argc);
+}
+
+/**
+ * \brief Determines whether the expression is a call of `range()`, which a `for` loop iterates without creating
+ * the list.
+ * \param expr the expression, must be resolved
+ * \return true if the expression calls the built-in function `range()`
+ */
+static inline bool builtin_is_range_call(const Expr *expr) {
+    return expr->kind == EXPR_CALL && expr->call.callee->identifier.slot == BUILTIN_RANGE;
+}
+
+/**
+ * \brief Evaluates a call of `range()` which is the iterable of a `for` loop.
+ *
+ * The arguments are checked as by `range()`, but the result is a lazy range (see nx_range.h) instead of a list,
+ * so that the loop does not allocate the items. May trigger garbage collection.
+ * \param args the arguments, must be rooted
+ * \param argc number of arguments, between 1 and 3
+ * \return the range
+ */
+NxObject *builtin_range_iter(NxObject *const *args, uint32_t argc);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //BUILTINS_H
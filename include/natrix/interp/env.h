@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file env.h
+ * \brief Environment holding the values of variables.
+ *
+ * The environment is shared by both execution engines, the tree-walking interpreter and the bytecode virtual machine.
+ * Variables are identified by slot indices, which are assigned before execution by the resolver (see `resolver.h`),
+ * so that reading or writing a variable is a simple array access regardless of the number of variables. The names are
+ * indexed by their hash (see hash.h), so that resolving a name takes constant time.
+ */
+
+#ifndef ENV_H
+#define ENV_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include "natrix/obj/nx_object.h"
+
+/**
+ * \brief Name of a variable slot.
+ */
+typedef struct {
+    const char *start;                  //!< start of the name, a copy owned by the environment
+    size_t length;                      //!< length of the name
+    uint64_t hash;                      //!< hash of the name computed by `hash_bytes()`
+} EnvName;
+
+/**
+ * \brief Represents the environment, i.e. the mapping of variable slots to their values.
+ *
+ * The values are stored in a dense array indexed by the slot, a `NULL` value means that the variable has not been
+ * assigned yet. The names are kept only for error reporting.
+ * The environment itself is not allocated by the garbage collector, it is expected to be rooted for as long
+ * as it is in use.
+ */
+typedef struct Env {
+    GcHeader gc_header;                 //!< header for garbage collector, traces the values of all slots
+    NxObject **values;                  //!< values of the variables, indexed by slot
+    EnvName *names;                     //!< names of the variables, indexed by slot
+    size_t count;                       //!< number of slots
+    size_t capacity;                    //!< capacity of the `values` and `names` arrays
+    uint32_t *index;                    //!< open addressing table of the slots by the hash of the name, slot + 1 or 0 if empty
+    size_t index_capacity;              //!< number of buckets of `index`, a power of two
+} Env;
+
+/**
+ * \brief Initializes an empty environment.
+ *
+ * The environment must be rooted using `gc_root(&env.gc_header)` before any variable is stored.
+ * \return the initialized environment
+ */
+Env env_init();
+
+/**
+ * \brief Frees the memory allocated by the environment.
+ * \param env the environment, must not be rooted
+ */
+void env_free(Env *env);
+
+/**
+ * \brief Returns the slot of the variable with the given name, creating it if it does not exist yet.
+ *
+ * The value of a newly created slot is undefined (`NULL`).
+ * \param env the environment
+ * \param name_start start of the name, copied if a new slot is created
+ * \param name_len length of the name
+ * \return the slot of the variable
+ */
+uint32_t env_declare(Env *env, const char *name_start, size_t name_len);
+
+/**
+ * \brief Returns the slot of the variable with the given name and precomputed hash, creating it if it does not exist.
+ *
+ * Same as `env_declare()`, used with the hashes of interned symbols (see symbol.h).
+ * \param env the environment
+ * \param name_start start of the name, copied if a new slot is created
+ * \param name_len length of the name
+ * \param hash the hash of the name computed by `hash_bytes()`
+ * \return the slot of the variable
+ */
+uint32_t env_declare_hashed(Env *env, const char *name_start, size_t name_len, uint64_t hash);
+
+/**
+ * \brief Reports an access to a variable which has not been assigned yet and terminates the program.
+ * \param env the environment
+ * \param slot the slot of the variable
+ */
+void env_undefined_variable(const Env *env, uint32_t slot) __attribute__((noreturn, cold));
+
+/**
+ * \brief Gets the value of the variable in the given slot.
+ *
+ * If the variable has not been assigned yet, the program panics.
+ * \param env the environment
+ * \param slot the slot of the variable
+ * \return the value of the variable
+ */
+static inline NxObject *env_load(const Env *env, uint32_t slot) {
+    NxObject *value = env->values[slot];
+    if (!value) {
+        env_undefined_variable(env, slot);
+    }
+    return value;
+}
+
+/**
+ * \brief Sets the value of the variable in the given slot.
+ * \param env the environment, must be rooted
+ * \param slot the slot of the variable
+ * \param value the value to set
+ */
+static inline void env_store(Env *env, uint32_t slot, NxObject *value) {
+    env->values[slot] = value;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif //ENV_H
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file exec_counts.h
+ * \brief Deterministic counts of the work done by a program, reported by `natrix --count`.
+ *
+ * The wall time and even the number of retired instructions vary between runs, which hides small regressions on
+ * shared machines. The counts collected here depend only on the program, its argument and the interpreter: the
+ * instructions executed by the virtual machine by opcode, the statements and expressions evaluated by the tree-walking
+ * interpreter by kind, the allocations, collections and marked objects of the garbage collector and the events of
+ * counters.h. Running a program twice with the same options gives the same counts, so they can be compared exactly
+ * with expectations produced by an earlier version of the interpreter.
+ *
+ * While counting, loops are not compiled to native code, since their instructions would not be counted. The counts
+ * of the garbage collector are deterministic only if the marking is not incremental, whose slices depend on the time,
+ * and the stack is not scanned conservatively (`ENABLE_CONSERVATIVE_GC`). Only the current thread is counted.
+ */
+
+#ifndef EXEC_COUNTS_H
+#define EXEC_COUNTS_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "natrix/compiler/code.h"
+#include "natrix/parser/ast.h"
+#include "natrix/util/counters.h"
+#include "natrix/util/gc.h"
+#include "natrix/util/sb.h"
+
+//! Number of kinds of expressions.
+#define EXEC_COUNTS_EXPR_KINDS (EXPR_CALL + 1)
+
+//! Number of kinds of statements.
+#define EXEC_COUNTS_STMT_KINDS (STMT_PRINT + 1)
+
+/**
+ * \brief Counts of the work done between `exec_counts_start()` and `exec_counts_stop()`.
+ */
+typedef struct {
+    uint64_t opcodes[OPCODE_COUNT];             //!< Instructions executed by the virtual machine, by opcode
+    uint64_t stmts[EXEC_COUNTS_STMT_KINDS];     //!< Statements executed by the tree-walking interpreter, by kind
+    uint64_t exprs[EXEC_COUNTS_EXPR_KINDS];     //!< Expressions evaluated by the tree-walking interpreter, by kind
+    uint64_t events[COUNTER_COUNT];             //!< Occurrences of the events of counters.h
+    GcStats gc;                                 //!< Statistics of the garbage collector, only the counts are valid
+} ExecCounts;
+
+#ifndef __cplusplus
+/**
+ * \brief Counts updated by the execution engines of the current thread, NULL if not counting.
+ */
+extern _Thread_local ExecCounts *exec_counts_current;
+#endif
+
+/**
+ * \brief Starts counting the work done by the current thread.
+ *
+ * The counts are cleared. They are not valid until `exec_counts_stop()` is called.
+ * \param counts receives the counts, must stay valid until `exec_counts_stop()`
+ */
+void exec_counts_start(ExecCounts *counts);
+
+/**
+ * \brief Stops counting and computes the counts of the garbage collector and of the events since the start.
+ * \param counts the counts passed to `exec_counts_start()`
+ */
+void exec_counts_stop(ExecCounts *counts);
+
+/**
+ * \brief Writes the counts as a JSON object, one field per line.
+ *
+ * Opcodes and kinds which were not executed are omitted, so that the output does not change when new ones are added.
+ * \param counts the counts
+ * \param sb the string builder to append to
+ */
+void exec_counts_to_json(const ExecCounts *counts, StringBuilder *sb);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //EXEC_COUNTS_H
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file isolate.h
+ * \brief Independent instances of the interpreter for embedding.
+ *
+ * An isolate owns a heap (see `gc_state_create()`) with its own roots, policy and statistics, and an environment
+ * holding the variables of the programs it runs. Programs run by the same isolate share the variables, programs run
+ * by different isolates share nothing but the statically allocated immutable objects, such as `true`, `false` and
+ * the strings of length 1. An isolate can be used by one thread at a time, but different isolates can run programs
+ * on different threads simultaneously. A thread which has run programs should call `arena_release_pool()` and
+ * `output_release()` before it exits, since the memory used for parsing and the output buffer are per thread.
+ *
+ * Independent jobs are run by `nx_isolate_run_program()` instead, which gives each program its own variables and keeps
+ * the compiled programs in a small cache of the isolate, so that running the same program again skips parsing and
+ * compiling. The compiled code contains objects of the heap of the isolate, therefore it cannot be shared by
+ * isolates.
+ *
+ * A program which fails at runtime terminates the whole process, as it does outside of isolates, unless the thread
+ * has installed a panic handler (see panic.h). The isolate is then left in the middle of the run and can only be
+ * freed by `nx_isolate_discard()`. A program running too long can be stopped by requesting an interrupt on the
+ * safepoint of the thread running it (see safepoint.h).
+ */
+
+#ifndef ISOLATE_H
+#define ISOLATE_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "natrix/parser/source.h"
+#include "natrix/util/gc.h"
+
+//! Number of compiled programs kept by each isolate for `nx_isolate_run_program()`.
+#define NX_ISOLATE_PROGRAM_CACHE_SIZE 16
+
+/**
+ * \brief An instance of the interpreter.
+ */
+typedef struct NxIsolate NxIsolate;
+
+/**
+ * \brief Measurements of a program run by `nx_isolate_run_program()`.
+ */
+typedef struct {
+    bool executed;                  //!< The program was executed, false if it contains syntax errors
+    bool cached;                    //!< The compiled program was found in the cache of the isolate
+    uint64_t compile_ns;            //!< Time spent parsing, resolving and compiling, 0 if cached
+    uint64_t execute_ns;            //!< Time spent executing, including the garbage collection pauses
+    uint64_t allocated_bytes;       //!< Bytes allocated by the program
+    uint64_t collections;           //!< Number of minor and major collections during the run
+} NxRunStats;
+
+/**
+ * \brief Creates a new isolate with an empty heap and an empty environment.
+ *
+ * Panics if the policy is invalid.
+ * \param policy the policy of the garbage collector of the isolate, NULL for the default policy
+ * \return the isolate, to be destroyed by `nx_isolate_destroy()`
+ */
+NxIsolate *nx_isolate_create(const GcPolicy *policy);
+
+/**
+ * \brief Compiles a program and executes it in the virtual machine of the isolate.
+ *
+ * The variable `arg` is set to the argument before execution, other variables keep the values assigned by the
+ * programs the isolate has run before. The isolate takes ownership of the source code and frees it when the isolate
+ * is destroyed, since the names of the variables refer to it.
+ * \param isolate the isolate
+ * \param source the source code of the program, emptied by the call
+ * \param arg the argument of the program
+ * \return true if the program was executed, false if it contains syntax errors, which are reported to `stderr`, or
+ *         it has been interrupted
+ */
+bool nx_isolate_run_source(NxIsolate *isolate, Source *source, int64_t arg);
+
+/**
+ * \brief Executes a program with its own variables, reusing its compiled code if the isolate has run it recently.
+ *
+ * The compiled programs are looked up by the hash of the source code, the least recently used one is dropped when
+ * the cache is full. Only the variable `arg` is defined when the program starts, neither the variables of
+ * `nx_isolate_run_source()` nor those of earlier runs of the program are visible. The isolate takes ownership of the
+ * source code, which is either kept with the compiled program or freed.
+ * \param isolate the isolate
+ * \param source the source code of the program, emptied by the call
+ * \param arg the argument of the program
+ * \param stats receives the measurements of the run
+ * \return true if the program was executed, false if it contains syntax errors, which are reported to `stderr`, or
+ *         it has been interrupted
+ */
+bool nx_isolate_run_program(NxIsolate *isolate, Source *source, int64_t arg, NxRunStats *stats);
+
+/**
+ * \brief Frees an isolate together with all its objects.
+ *
+ * The isolate must not be running a program.
+ * \param isolate the isolate
+ */
+void nx_isolate_destroy(NxIsolate *isolate);
+
+/**
+ * \brief Frees an isolate whose run has been abandoned by a panic recovered by a panic handler.
+ *
+ * Must be called by the thread which ran the program, with the heap still switched to the isolate. The thread is
+ * switched back to the heap it used before the run. The operand stacks of the abandoned run are freed as well (see
+ * `vm_release_abandoned()`), other memory allocated outside of the heap by the functions it was running may leak.
+ * \param isolate the isolate
+ */
+void nx_isolate_discard(NxIsolate *isolate);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //ISOLATE_H
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file literal_pool.h
+ * \brief Pool of the values of literals of a program.
+ *
+ * The values of integer and string literals are created once by the resolver (see `resolver.h`) and stored
+ * in the pool. Literal AST nodes refer to their values by index (see `ExprLiteral.index`), so evaluating
+ * a literal does not allocate.
+ */
+
+#ifndef LITERAL_POOL_H
+#define LITERAL_POOL_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include "natrix/obj/nx_object.h"
+
+/**
+ * \brief Pool of literal values.
+ *
+ * The pool itself is not allocated by the garbage collector, it is expected to be rooted for as long as
+ * the program is in use, which keeps the values alive.
+ */
+typedef struct {
+    GcHeader gc_header;                 //!< header for garbage collector, traces the values
+    NxObject **values;                  //!< the values of the literals
+    size_t count;                       //!< number of values in the pool
+    size_t capacity;                    //!< capacity of the `values` array
+} LiteralPool;
+
+/**
+ * \brief Initializes an empty literal pool.
+ *
+ * The pool must be rooted using `gc_root(&pool.gc_header)` before any value is added.
+ * \return the initialized pool
+ */
+LiteralPool literal_pool_init();
+
+/**
+ * \brief Frees the memory allocated by the pool.
+ * \param pool the pool, must not be rooted
+ */
+void literal_pool_free(LiteralPool *pool);
+
+/**
+ * \brief Adds a value to the pool.
+ * \param pool the pool, must be rooted
+ * \param value the value
+ * \return the index of the value
+ */
+uint32_t literal_pool_add(LiteralPool *pool, NxObject *value);
+
+/**
+ * \brief Returns the value at the given index.
+ * \param pool the pool
+ * \param index the index returned by `literal_pool_add`
+ * \return the value
+ */
+static inline NxObject *literal_pool_get(const LiteralPool *pool, uint32_t index) {
+    return pool->values[index];
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif //LITERAL_POOL_H
@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file ops.h
+ * \brief Operations shared by the execution engines.
+ *
+ * Both the tree-walking interpreter and the bytecode virtual machine delegate the semantics of the language
+ * operations to the functions declared here, which guarantees that both engines produce the same results.
+ */
+
+#ifndef OPS_H
+#define OPS_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "natrix/obj/nx_bool.h"
+#include "natrix/obj/nx_int.h"
+#include "natrix/obj/nx_object.h"
+#include "natrix/obj/nx_str.h"
+#include "natrix/parser/ast.h"
+
+/**
+ * \brief Converts the given string to an integer.
+ *
+ * May trigger garbage collection.
+ * \param str the string, must contain only digits
+ * \param len the length of the string
+ * \return the integer value
+ */
+NxObject *ops_int_from_str(const char *str, size_t len);
+
+/**
+ * \brief Creates the value of a string literal.
+ *
+ * May trigger garbage collection.
+ * \param start pointer to the opening quote of the literal in the source code
+ * \param end pointer to the character after the closing quote of the literal
+ * \return the `str` object
+ */
+NxObject *ops_str_from_literal(const char *start, const char *end);
+
+/**
+ * \brief Determines whether the given operator is a comparison.
+ * \param op binary operation
+ * \return true for `==`, `!=`, `<`, `<=`, `>` and `>=`
+ */
+static inline bool ops_is_comparison(BinaryOp op) {
+    return op >= BINOP_EQ && op <= BINOP_GE;
+}
+
+/**
+ * \brief Evaluates the given comparison from the result of a three-way comparison of the operands.
+ * \param cmp negative, zero or positive if the left operand is less than, equal to or greater than the right one
+ * \param op comparison operator
+ * \return the result of the comparison
+ */
+static inline bool ops_compare_result(int cmp, BinaryOp op) {
+    switch (op) {
+        case BINOP_EQ:
+            return cmp == 0;
+        case BINOP_NE:
+            return cmp != 0;
+        case BINOP_LT:
+            return cmp < 0;
+        case BINOP_LE:
+            return cmp <= 0;
+        case BINOP_GT:
+            return cmp > 0;
+        default:
+            assert(op == BINOP_GE);
+            return cmp >= 0;
+    }
+}
+
+/**
+ * \brief Evaluates the given comparison of integers to a C boolean.
+ *
+ * Does not allocate.
+ * \param left left operand, must be an `int`
+ * \param op comparison operator
+ * \param right right operand, must be an `int`
+ * \return the result of the comparison
+ */
+static inline bool ops_compare_int(NxObject *left, BinaryOp op, NxObject *right) {
+    return ops_compare_result(nx_int_compare(left, right), op);
+}
+
+/**
+ * \brief Evaluates the given comparison of strings to a C boolean.
+ *
+ * Equality does not order the strings, so it benefits from the shortcuts of `nx_str_equals()`. May trigger garbage
+ * collection, the operands do not need to be rooted.
+ * \param left left operand, must be a `str`
+ * \param op comparison operator
+ * \param right right operand, must be a `str`
+ * \return the result of the comparison
+ */
+static inline bool ops_compare_str(NxObject *left, BinaryOp op, NxObject *right) {
+    if (op == BINOP_EQ || op == BINOP_NE) {
+        return nx_str_equals(left, right) == (op == BINOP_EQ);
+    }
+    return ops_compare_result(nx_str_compare(left, right), op);
+}
+
+/**
+ * \brief Evaluates the given binary operation on integers.
+ *
+ * May trigger garbage collection, the operands do not need to be rooted.
+ * \param left left operand, must be an `int`
+ * \param op binary operation
+ * \param right right operand, must be an `int`
+ * \return the result of the operation, comparisons return a `bool`
+ */
+static inline NxObject *ops_binary_int(NxObject *left, BinaryOp op, NxObject *right) {
+    switch (op) {
+        case BINOP_ADD:
+            return nx_int_add(left, right);
+        case BINOP_SUB:
+            return nx_int_sub(left, right);
+        case BINOP_MUL:
+            return nx_int_mul(left, right);
+        case BINOP_DIV:
+            return nx_int_div(left, right);
+        case BINOP_EQ:
+            return nx_bool_wrap(nx_int_compare(left, right) == 0);
+        case BINOP_NE:
+            return nx_bool_wrap(nx_int_compare(left, right) != 0);
+        case BINOP_LT:
+            return nx_bool_wrap(nx_int_compare(left, right) < 0);
+        case BINOP_LE:
+            return nx_bool_wrap(nx_int_compare(left, right) <= 0);
+        case BINOP_GT:
+            return nx_bool_wrap(nx_int_compare(left, right) > 0);
+        case BINOP_GE:
+            return nx_bool_wrap(nx_int_compare(left, right) >= 0);
+        default:
+            assert(0);
+    }
+}
+
+/**
+ * \brief Evaluates the given binary operation.
+ *
+ * Integer operands take a fast path, other operands are dispatched through the operator slots of their types
+ * (see `NxType`): the slot of the left operand's type is tried first, then that of the right operand's type. A `bool`
+ * operand behaves as the integer 0 or 1, e.g. `(a < b) + 1` is 1 or 2. If neither type supports the operator,
+ * `==` and `!=` compare the operands with nxo_eq(), other operators panic.
+ *
+ * May trigger garbage collection.
+ * \param left left operand, must be rooted
+ * \param op binary operation
+ * \param right right operand
+ * \return the result of the operation
+ */
+NxObject *ops_binary(NxObject *left, BinaryOp op, NxObject *right);
+
+/**
+ * \brief Evaluates the binary operation of an augmented assignment such as `a += b`.
+ *
+ * `list += list` appends the items of the right operand to the left list in place, so all references to the list see
+ * the new items, like in Python. Every other combination behaves as ops_binary(). A `str` is never mutated: other
+ * references to it cannot be ruled out without reference counts, and concatenation builds ropes, which already keep
+ * repeated appends linear.
+ *
+ * May trigger garbage collection.
+ * \param left current value of the target, must be rooted
+ * \param op binary operation, not a comparison
+ * \param right right operand
+ * \return the new value of the target, `left` itself if it was updated in place
+ */
+NxObject *ops_inplace(NxObject *left, BinaryOp op, NxObject *right);
+
+/**
+ * \brief Converts the value of a condition to a C boolean.
+ * \param value the value of the condition
+ * \return the truth value of the condition
+ */
+bool ops_is_true(NxObject *value);
+
+/**
+ * \brief Implements the `print` statement.
+ * \param value the value to print
+ */
+void ops_print(NxObject *value);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //OPS_H
@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file profiler.h
+ * \brief Sampling profiler of natrix programs.
+ *
+ * The profiler attributes the CPU time of a program to the statements of its source code. While it is running,
+ * the execution engine publishes in `profiler_current` what it is executing: the virtual machine the address
+ * of each instruction, the tree-walking interpreter each statement. A timer measuring the CPU time of the
+ * profiled thread periodically sends it `SIGPROF`, and the signal handler looks the published value up in
+ * a table of statements built before the execution (see `profiler_attach_code()` and `profiler_attach_ast()`)
+ * and increments the sample counter of the statement. The handler neither allocates nor locks, and when the
+ * profiler is not running the engines do not publish anything, so the overhead is one store per instruction
+ * or statement while profiling and none otherwise.
+ *
+ * Each statement knows its enclosing statement, so a sample is reported as a stack of source lines, e.g.
+ * the `while` loop, the `if` nested in it and the assignment in the `if`. Samples taken while no statement was
+ * executing, e.g. while parsing, are attributed to the frame `(interpreter)`. Loops compiled to native code do
+ * not publish their instructions, their samples are attributed to the `while` statement.
+ *
+ * The profiler can also record the allocations of the program (see `ProfilerOptions.allocations`). Using
+ * `GcAllocTracker`, each object allocated in the heap of the profiled thread is attributed to the statement being
+ * executed and the type of the object. The collector then reports whether the object survived the first collection
+ * after its allocation. Objects which die young are cheap, those which survive are promoted to the old generation
+ * and make major collections more frequent.
+ *
+ * The profiler is process-wide, only one thread can be profiled at a time.
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "natrix/compiler/code.h"
+#include "natrix/parser/ast.h"
+#include "natrix/parser/source.h"
+#include "natrix/util/sb.h"
+
+//! Default interval between two samples in microseconds of CPU time.
+#define PROFILER_DEFAULT_INTERVAL_US 1000
+
+#ifndef __cplusplus
+/**
+ * \brief Instruction or statement being executed by the profiled thread, NULL if none.
+ *
+ * Written by the execution engines only while `profiler_is_running()`, read by the signal handler and the
+ * allocation tracker.
+ */
+extern const void *volatile profiler_current;
+#endif
+
+/**
+ * \brief What the profiler records.
+ */
+typedef struct {
+    unsigned interval_us;           //!< Interval between two samples in microseconds of CPU time, 0 to not sample
+    bool allocations;               //!< Whether to record the allocations
+} ProfilerOptions;
+
+/**
+ * \brief Starts profiling the calling thread.
+ *
+ * Discards the results of the previous run. Panics if the profiler is already running or the timer cannot
+ * be created.
+ * \param source the source code of the profiled program, must outlive the results
+ * \param options what to record
+ */
+void profiler_start(Source *source, const ProfilerOptions *options);
+
+/**
+ * \brief Registers the statements of the compiled program which the virtual machine is about to execute.
+ *
+ * Only one program can be attached to a run of the profiler.
+ * \param code the compiled program, its line table is copied
+ */
+void profiler_attach_code(const Code *code);
+
+/**
+ * \brief Registers the statements of the program which the tree-walking interpreter is about to execute.
+ *
+ * Only one program can be attached to a run of the profiler.
+ * \param stmt the first statement of the program
+ */
+void profiler_attach_ast(const Stmt *stmt);
+
+/**
+ * \brief Stops profiling, the results remain available until the next start or `profiler_free()`.
+ */
+void profiler_stop();
+
+/**
+ * \brief Determines whether the profiler is running.
+ * \return true between `profiler_start()` and `profiler_stop()`
+ */
+bool profiler_is_running();
+
+/**
+ * \brief Returns the number of samples taken, including those attributed to `(interpreter)`.
+ * \return the number of samples
+ */
+uint64_t profiler_sample_count();
+
+/**
+ * \brief Appends the samples in the collapsed stack format used by flame graph tools.
+ *
+ * Each line consists of the frames separated by `;`, starting with the outermost statement, followed by a space
+ * and the number of samples. A frame is the location `file:line` followed by the trimmed source line, in which
+ * any `;` is replaced by `,`.
+ * \param sb the string builder to append to
+ */
+void profiler_dump_collapsed(StringBuilder *sb);
+
+/**
+ * \brief Appends a report of the source lines with the most samples.
+ *
+ * For each line, the report shows the share of the samples taken while executing the line itself (self) and
+ * while executing the line or any statement nested in it (total), ordered by self.
+ * \param sb the string builder to append to
+ * \param max_lines maximum number of lines in the report
+ */
+void profiler_dump_hot_lines(StringBuilder *sb, size_t max_lines);
+
+/**
+ * \brief Appends a report of the allocations by type and by source line.
+ *
+ * For each type and for each of the source lines which allocated the most bytes, the report shows the number
+ * of objects and bytes allocated and how many of them survived the first collection after their allocation.
+ * Objects allocated since the last collection have not been collected yet and are not counted as survivors.
+ * \param sb the string builder to append to
+ * \param max_lines maximum number of source lines in the report
+ */
+void profiler_dump_allocations(StringBuilder *sb, size_t max_lines);
+
+/**
+ * \brief Frees the results of the profiler, which must not be running.
+ */
+void profiler_free();
+
+#ifdef __cplusplus
+}
+#endif
+#endif //PROFILER_H
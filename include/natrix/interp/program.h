@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file program.h
+ * \brief The pipeline preparing a source code for execution: parsing, resolving, optimizing and compiling.
+ *
+ * A program owns its syntax tree, its literals and its bytecode, the variables live in an environment owned by the
+ * caller, which can be shared by several programs (e.g. the batches of a streamed file). Every front end runs the
+ * same steps through these functions: `natrix` itself, the isolates and the benchmark harness.
+ *
+ * The literals and the code are rooted by `program_init()` in place, so the program must not be moved until
+ * `program_free()`, and programs must be freed in the reverse order of their initialization.
+ */
+
+#ifndef PROGRAM_H
+#define PROGRAM_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include "natrix/compiler/code.h"
+#include "natrix/interp/env.h"
+#include "natrix/interp/literal_pool.h"
+#include "natrix/parser/ast.h"
+#include "natrix/parser/source.h"
+#include "natrix/util/arena.h"
+
+/**
+ * \brief A program being prepared for execution.
+ */
+typedef struct {
+    Arena arena;                    //!< Memory of the syntax tree
+    Stmt *stmt;                     //!< The syntax tree, NULL if not parsed, empty or containing syntax errors
+    LiteralPool literals;           //!< Values of the literals, rooted
+    Code code;                      //!< The compiled program, rooted
+} Program;
+
+/**
+ * \brief Initializes an empty program and roots its literals and code.
+ * \param program the program, must stay at the same address until `program_free()`
+ */
+void program_init(Program *program);
+
+/**
+ * \brief Frees the literals and the code, the program stays rooted and can be compiled again.
+ *
+ * The syntax tree is not freed, see `program_release_tree()`.
+ * \param program the program
+ */
+void program_clear(Program *program);
+
+/**
+ * \brief Frees the program and unroots it.
+ * \param program the program
+ */
+void program_free(Program *program);
+
+/**
+ * \brief Parses the source code into the syntax tree of the program, syntax errors are reported to `stderr`.
+ * \param program the program, not parsed yet
+ * \param source the source code, must outlive the syntax tree
+ * \return false if the source code contains syntax errors
+ */
+bool program_parse(Program *program, Source *source);
+
+/**
+ * \brief Resolves the names of the parsed program in the environment and optionally optimizes it.
+ *
+ * The variable `arg` is declared before the names of the program, so it is the first slot of a new environment.
+ * May trigger garbage collection.
+ * \param program the parsed program
+ * \param env the environment, must be rooted
+ * \param arg the value stored to `arg`, NULL to keep its current value
+ * \param optimize whether to run the optimizer (see optimizer.h)
+ */
+void program_resolve(Program *program, Env *env, NxObject *arg, bool optimize);
+
+/**
+ * \brief Compiles the resolved program to bytecode.
+ * \param program the resolved program
+ */
+void program_compile(Program *program);
+
+/**
+ * \brief Frees the syntax tree, which is no longer needed once the program is compiled.
+ *
+ * The arena is emptied, so that the program can be parsed again.
+ * \param program the program
+ */
+void program_release_tree(Program *program);
+
+/**
+ * \brief Parses, resolves and compiles a source code.
+ *
+ * May trigger garbage collection.
+ * \param program the program, not parsed yet
+ * \param env the environment, must be rooted
+ * \param source the source code
+ * \param arg the value stored to `arg`, NULL to keep its current value
+ * \param optimize whether to run the optimizer
+ * \return false if the source code contains syntax errors, which are reported to `stderr`
+ */
+bool program_build(Program *program, Env *env, Source *source, NxObject *arg, bool optimize);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //PROGRAM_H
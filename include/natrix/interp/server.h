@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file server.h
+ * \brief Batch execution of programs by a pool of worker threads, used by `natrix --serve`.
+ *
+ * The requests are read line by line, each line contains the path of a program, optionally followed by a space and
+ * its integer argument. The thread reading the requests also reads the source files and queues the jobs, the workers
+ * run them. Each worker thread owns an isolate (see isolate.h), which caches the programs it has compiled, so a job is
+ * queued to the worker chosen by the hash of its source code. A worker which runs out of jobs steals the most
+ * recently queued job of another worker.
+ *
+ * The output of a job is captured (see `output_begin_capture()`). When the job finishes, a single line with a JSON
+ * object describing it is written:
+ *
+ *     {"id": 0, "path": "a.ntx", "status": "ok", "worker": 1, "cached": false, "compile_ns": 81200,
+ *      "execute_ns": 1543000, "allocated_bytes": 52480, "collections": 0, "output": "42\n"}
+ *
+ * The `id` is the number of the request line, counted from 0 and without empty lines, since the jobs finish in any
+ * order. The `status` is `ok`, `error` (the program contains syntax errors, which are reported to `stderr`, or has
+ * failed at runtime), `interrupted` (see safepoint.h), `unreadable` (the file cannot be read) or `invalid` (the
+ * request cannot be parsed). Only `id`, `path` and `status` are present unless the program has been executed.
+ *
+ * A runtime error fails only its job: the worker recovers from the panic (see panic.h), replaces its isolate, whose
+ * compiled programs are lost, and writes the `worker`, the `message` of the error and the `output` printed before it:
+ *
+ *     {"id": 3, "path": "b.ntx", "status": "error", "worker": 0, "message": "Division by zero", "output": ""}
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include "natrix/util/gc.h"
+
+/**
+ * \brief A pool of worker threads running programs.
+ */
+typedef struct NxServer NxServer;
+
+/**
+ * \brief Starts the worker threads.
+ * \param worker_count the number of worker threads, greater than zero
+ * \param policy the policy of the garbage collector of the isolate of each worker, NULL for the default policy
+ * \return the server, to be destroyed by `nx_server_destroy()`
+ */
+NxServer *nx_server_create(size_t worker_count, const GcPolicy *policy);
+
+/**
+ * \brief Runs the jobs requested by a stream of lines and writes their results.
+ *
+ * Returns once all requests have been read and all jobs have finished. A server serves one stream at a time.
+ * \param server the server
+ * \param in_fd the file descriptor to read the requests from, not closed by the call
+ * \param out_fd the file descriptor to write the results to, not closed by the call
+ * \return the number of requests
+ */
+size_t nx_server_serve(NxServer *server, int in_fd, int out_fd);
+
+/**
+ * \brief Stops the worker threads and frees the server.
+ *
+ * The server must not be serving a stream.
+ * \param server the server
+ */
+void nx_server_destroy(NxServer *server);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //SERVER_H
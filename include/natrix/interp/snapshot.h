@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file snapshot.h
+ * \brief Heap snapshots for a fast warm startup.
+ *
+ * A snapshot holds the values of the variables of an environment together with all objects reachable from them,
+ * so that a prelude which builds large tables can be executed once and its results reused by later runs without
+ * executing it again. The objects are stored in their native layout in a page-aligned image, with the pointers
+ * already set for the image being mapped at a preferred address. Loading a snapshot maps the file privately: if the
+ * preferred address is available, nothing in the image is touched and its pages are shared with the page cache until
+ * they are written (copy-on-write), otherwise the pointers are relocated using a table stored in the file.
+ *
+ * The objects of the image are permanently marked and never collected (see `GC_FLAG_IMAGE`), the collector only
+ * traces the image objects which have been written since the load. The mapping must therefore outlive every object
+ * which may point into it, see `snapshot_close()`.
+ *
+ * Only values of the built-in types can be saved. Strings are always saved flat.
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "natrix/interp/env.h"
+
+//! Version of the snapshot format, to be incremented whenever the format or the layout of any object changes.
+#define SNAPSHOT_VERSION 1
+
+//! Address at which the image of a snapshot is preferably mapped, so that its pointers need no relocation.
+#define SNAPSHOT_BASE ((uintptr_t) 0x200000000000ull)
+
+//! Alignment of the image within the file, the largest page size of the supported platforms.
+#define SNAPSHOT_PAGE_SIZE 65536
+
+/**
+ * \brief Memory mapping of a loaded snapshot.
+ */
+typedef struct {
+    void *data;                     //!< Start of the mapping, `NULL` if no snapshot is loaded
+    size_t size;                    //!< Size of the mapping
+} Snapshot;
+
+/**
+ * \brief Saves the values of the variables and all objects reachable from them to a snapshot file.
+ *
+ * May trigger garbage collection. The file is written to a temporary file first and then renamed, so that
+ * concurrent runs never see a partially written file.
+ * \param path the path of the snapshot file
+ * \param env the environment, must be rooted
+ * \return true if the file was written, false if it cannot be written or a value cannot be saved
+ */
+bool snapshot_save(const char *path, const Env *env);
+
+/**
+ * \brief Loads a snapshot file into an environment.
+ *
+ * Declares the variables of the snapshot in the environment and sets those which had a value when the snapshot
+ * was saved, other variables of the environment are left untouched. Before the image is used, every object of it is
+ * checked to be of a class which can be saved and to lie within the image, and every pointer to point to an object,
+ * so that a corrupted file is rejected and the program can be run without the snapshot.
+ * \param snapshot receives the mapping of the file, must be closed by `snapshot_close()` if the load succeeds
+ * \param path the path of the snapshot file
+ * \param env the environment, must be rooted
+ * \return true if the file exists and is a valid snapshot
+ */
+bool snapshot_load(Snapshot *snapshot, const char *path, Env *env);
+
+/**
+ * \brief Unmaps a snapshot loaded by `snapshot_load()`.
+ *
+ * No reachable object may point into the snapshot anymore, in particular the environment it was loaded into must
+ * already be freed.
+ * \param snapshot the snapshot
+ */
+void snapshot_close(Snapshot *snapshot);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //SNAPSHOT_H
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file vm.h
+ * \brief Bytecode virtual machine.
+ *
+ * The virtual machine executes the bytecode produced by the compiler. It is a simple stack machine: instructions
+ * pop their operands from the operand stack and push their results back. The operand stack is sized according
+ * to `Code.max_stack` computed by the compiler, so no overflow checks are necessary during execution.
+ * The values on the operand stack are reported to the garbage collector, therefore the instructions can
+ * keep their operands on the stack while performing operations that may trigger garbage collection.
+ *
+ * Binary operators are quickened. The compiler emits adaptive instructions (`ADD`, `LT`, ...) which execute the
+ * generic operation and count down the warmup of their site. When the warmup reaches zero, the instruction
+ * rewrites itself into a variant specialized for the operand types seen at that moment: `ADD_INT` to `GE_INT` if
+ * both are integers, `ADD_STR` if both are strings, or `BINARY` otherwise. The specialized variants guard the
+ * operand types and, on a miss, deoptimize back to the adaptive instruction with a longer warmup. A site which
+ * keeps deoptimizing eventually stays `BINARY` for good. The sites count both events, see `code_dump_sites()`.
+ */
+
+#ifndef VM_H
+#define VM_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include "natrix/compiler/code.h"
+#include "natrix/interp/env.h"
+
+/**
+ * \brief Executes the bytecode.
+ *
+ * The output of the program is flushed when it finishes, see `output_flush()`. The safepoint of the calling thread
+ * is polled at every loop back-edge, an interrupt stops the program there (see safepoint.h).
+ * \param env the environment for variable lookup, must be rooted and contain all slots used by the code
+ * \param code the compiled program, must be rooted, its binary operators are specialized in place
+ * \return true if the program finished, false if it has been interrupted
+ */
+bool vm_exec(Env *env, Code *code);
+
+/**
+ * \brief Frees the operand stacks of the executions of the calling thread abandoned by a recovered panic.
+ *
+ * Must be called after recovering from a panic (see panic.h) before the thread executes bytecode again. The roots of
+ * the abandoned executions are not removed, see `gc_scope_end()`.
+ */
+void vm_release_abandoned();
+
+#ifdef __cplusplus
+}
+#endif
+#endif //VM_H
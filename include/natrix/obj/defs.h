@@ -19,6 +19,19 @@ extern "C" {
 #include "natrix/obj/nx_object.h"
 #include "natrix/obj/nx_type.h"
 
+extern const NxType nx_type_int;
+
+/**
+ * \brief Returns the type of the object.
+ *
+ * The type is found by the class of the object, immediate integers are handled as well.
+ * \param obj the object
+ * \return the type of the object
+ */
+static inline const NxType *nxo_type(const NxObject *obj) {
+    return nxo_is_immediate_int(obj) ? &nx_type_int : nx_types[obj->gc_header.class_id];
+}
+
 /**
  * \brief Allocate memory for an object of given size and type.
  * \param size size of the object in bytes
@@ -26,9 +39,7 @@ extern "C" {
  * \return pointer to the allocated memory (declared as `void *` to avoid casting)
  */
 static inline void *nxo_alloc(size_t size, const NxType *type) {
-    NxObject *obj = (NxObject *) gc_alloc(size, type->gc_trace_fn);
-    obj->type = type;
-    return obj;
+    return gc_alloc(size, type->class_id);
 }
 
 /**
@@ -36,7 +47,11 @@ static inline void *nxo_alloc(size_t size, const NxType *type) {
  * \param obj the object to root
  */
 static inline void nxo_root(NxObject *obj) {
-    gc_root(&obj->gc_header);
+#if ENABLE_CONSERVATIVE_GC
+    (void) obj;             // temporaries are found by scanning the stack
+#else
+    gc_root(nxo_gc_header(obj));
+#endif
 }
 
 /**
@@ -44,7 +59,11 @@ static inline void nxo_root(NxObject *obj) {
  * \param obj the object to unroot
  */
 static inline void nxo_unroot(NxObject *obj) {
-    gc_unroot(&obj->gc_header);
+#if ENABLE_CONSERVATIVE_GC
+    (void) obj;
+#else
+    gc_unroot(nxo_gc_header(obj));
+#endif
 }
 
 /**
@@ -55,6 +74,18 @@ static inline void nxo_unroot(NxObject *obj) {
  */
 int64_t nxo_check_index(NxObject *index, int64_t len);
 
+/**
+ * \brief Convenience function for converting the bounds of a slice of a sequence of given length.
+ *
+ * Negative bounds are relative to the end of the sequence, bounds out of range are clamped, as in Python.
+ * \param lower the lower bound, must be an instance of `int`, NULL means the start of the sequence
+ * \param upper the upper bound, must be an instance of `int`, NULL means the end of the sequence
+ * \param len the length of the sequence, must be non-negative
+ * \param start receives the index of the first element of the slice, between 0 and len
+ * \param end receives the index after the last element of the slice, between start and len
+ */
+void nxo_check_slice(NxObject *lower, NxObject *upper, int64_t len, int64_t *start, int64_t *end);
+
 /**
  * \brief Converts an object to a boolean.
  * \param obj the object to convert
@@ -78,6 +109,46 @@ NxObject *nxo_get_element(NxObject *obj, NxObject *index);
  */
 void nxo_set_element(NxObject *obj, NxObject *index, NxObject *value);
 
+/**
+ * \brief Slicing operator for natrix objects.
+ * \param obj the object to slice
+ * \param lower the lower bound, NULL if omitted
+ * \param upper the upper bound, NULL if omitted
+ * \return the slice `obj[lower:upper]`
+ */
+NxObject *nxo_get_slice(NxObject *obj, NxObject *lower, NxObject *upper);
+
+/**
+ * \brief Gets the next item of an object iterated by a `for` loop.
+ *
+ * Panics if the object is not iterable. Does not allocate for `list`, `str` and ranges, except when a rope is
+ * flattened by the first step.
+ * \param obj the iterated object
+ * \param position the position of the iteration, 0 before the first item, advanced past the returned item
+ * \return the item, NULL if there are no more items
+ */
+NxObject *nxo_iter_next(NxObject *obj, int64_t *position);
+
+/**
+ * \brief Computes the hash of a natrix object.
+ *
+ * Panics if the object is not hashable. May trigger garbage collection (e.g. when a rope is flattened).
+ * \param obj the object, must be rooted if it is used afterwards
+ * \return the hash of the object, equal objects have equal hashes
+ */
+uint64_t nxo_hash(NxObject *obj);
+
+/**
+ * \brief Compares two natrix objects for equality.
+ *
+ * Identical objects are equal, otherwise `eq_fn` of the type of `left` decides, objects whose type does not define it
+ * are only equal to themselves. May trigger garbage collection (e.g. when a rope is flattened).
+ * \param left the left operand, must be rooted if it is used afterwards
+ * \param right the right operand, must be rooted if it is used afterwards
+ * \return true if the objects are equal
+ */
+bool nxo_eq(NxObject *left, NxObject *right);
+
 #ifdef __cplusplus
 }
 #endif
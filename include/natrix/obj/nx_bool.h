@@ -58,7 +58,7 @@ static inline NxObject *nx_bool_wrap(bool value) {
  * \return true if the object is an instance of the `bool` type, false otherwise
  */
 static inline bool nx_bool_is_instance(NxObject *object) {
-    return object->type == &nx_type_bool;
+    return nxo_type(object) == &nx_type_bool;
 }
 
 /**
@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file nx_dict.h
+ * \brief Representation and operations of natrix `dict` objects.
+ *
+ * A dictionary is a hash table with open addressing in the style of SwissTable. The slots of the table are divided
+ * into groups of `NX_DICT_GROUP_SIZE`, and besides the array of entries the table has an array of control bytes, one
+ * per slot. The control byte of an empty slot is `NX_DICT_CTRL_EMPTY`, that of a full slot holds the low 7 bits
+ * of the hash of its key (h2). The remaining bits of the hash (h1) select the group where the probing starts.
+ * A lookup loads the control bytes of a whole group as one 64-bit word and finds the slots whose control byte
+ * matches h2 with a few bitwise operations, so that keys are compared only in slots which are likely to match.
+ * If the group has an empty slot, the key is not in the table, otherwise the probing continues with the next group
+ * of a triangular sequence, which visits every group since the number of groups is a power of two.
+ *
+ * The table grows to twice its capacity when it would be more than 7/8 full. Entries are never removed, so there
+ * are no tombstones. Keys are hashed and compared by nxo_hash() and nxo_eq(), keys which are equal (e.g. `1` and
+ * `True`) are the same key.
+ */
+
+#ifndef NX_DICT_H
+#define NX_DICT_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <assert.h>
+#include <stdbool.h>
+#include "natrix/obj/defs.h"
+
+//! Number of slots whose control bytes are examined at once.
+#define NX_DICT_GROUP_SIZE 8
+
+//! Control byte of an empty slot, the control bytes of full slots have the most significant bit clear.
+#define NX_DICT_CTRL_EMPTY 0x80
+
+/**
+ * \brief Key and value stored in a slot of a table.
+ */
+typedef struct {
+    NxObject *key;              //!< The key, NULL in empty slots
+    NxObject *value;            //!< The value, NULL in empty slots
+} NxDictEntry;
+
+/**
+ * \brief Storage of the entries of a dictionary.
+ *
+ * The table is allocated by the garbage collector as a single block consisting of this structure, the array
+ * of `capacity` entries and the array of `capacity` control bytes.
+ */
+typedef struct {
+    GcHeader gc_header;         //!< GC header
+    const int64_t capacity;     //!< Number of slots, a power of two and a multiple of `NX_DICT_GROUP_SIZE`
+    NxDictEntry entries[];      //!< The slots, followed by the control bytes
+} NxDictTable;
+
+/**
+ * \brief Layout of `dict` instances.
+ */
+typedef struct {
+    NxObject header;            //!< Header common to all natrix objects
+    int64_t length;             //!< Number of entries in the dictionary
+    int64_t growth_left;        //!< Number of entries which can be inserted before the table grows
+    NxDictTable *table;         //!< The table of the entries, never NULL
+} NxDict;
+
+/**
+ * \brief Type of all `dict` instances.
+ */
+extern const NxType nx_type_dict;
+
+/**
+ * \brief Creates a new empty `dict` object.
+ *
+ * May trigger garbage collection.
+ * \param expected_length number of entries which can be inserted before the table grows, must not be negative
+ * \return the new dict object
+ */
+NxObject *nx_dict_create(int64_t expected_length);
+
+/**
+ * \brief Creates a new `dict` object containing the given keys and values.
+ *
+ * If a key occurs more than once, the last value wins. Panics if a key is not hashable. May trigger garbage collection.
+ * \param items the keys and values, each key followed by its value, must be rooted
+ * \param count number of entries, i.e. half the number of items
+ * \return the new dict object
+ */
+NxObject *nx_dict_create_from(NxObject *const *items, int64_t count);
+
+/**
+ * \brief Determines whether the object is an instance of the `dict` type.
+ * \param object the object to check
+ * \return true if the object is an instance of the `dict` type, false otherwise
+ */
+static inline bool nx_dict_is_instance(NxObject *object) {
+    return nxo_type(object) == &nx_type_dict;
+}
+
+/**
+ * \brief Returns the number of entries in the dictionary.
+ * \param dict the dictionary
+ * \return the number of entries
+ */
+static inline int64_t nx_dict_get_length(NxObject *dict) {
+    assert(nx_dict_is_instance(dict));
+    return ((NxDict *) dict)->length;
+}
+
+/**
+ * \brief Looks up the value of a key.
+ *
+ * Panics if the key is not hashable. May trigger garbage collection (see nxo_hash() and nxo_eq()).
+ * \param dict the dictionary, must be rooted
+ * \param key the key, must be rooted
+ * \return the value of the key, NULL if the dictionary does not contain the key
+ */
+NxObject *nx_dict_get(NxObject *dict, NxObject *key);
+
+/**
+ * \brief Sets the value of a key, inserting the key if the dictionary does not contain it yet.
+ *
+ * Panics if the key is not hashable. May trigger garbage collection.
+ * \param dict the dictionary, must be rooted
+ * \param key the key, must be rooted
+ * \param value the value, must be rooted
+ */
+void nx_dict_set(NxObject *dict, NxObject *key, NxObject *value);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //NX_DICT_H
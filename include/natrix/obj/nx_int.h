@@ -18,34 +18,84 @@ extern "C" {
 
 #include <assert.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include "natrix/obj/defs.h"
+#include "natrix/util/arena.h"
+#include "natrix/util/sb.h"
 
 /**
- * \brief Defines the layout of a natrix `int` object.
+ * \brief Defines the layout of a boxed natrix `int` object.
  *
- * The `int` object is a simple wrapper around a 64-bit integer value. It is immutable.
- * For simplicity, the `int` object has fixed precision and overflow behavior is inherited from the underlying C type.
- * This may change as the language evolves - either arbitrary precision or overflow checking could be implemented.
+ * The `int` object is an immutable integer of arbitrary precision.
+ *
+ * Values in the range `NX_INT_IMMEDIATE_MIN..NX_INT_IMMEDIATE_MAX` are represented as immediate values encoded
+ * in the `NxObject *` pointer (see `nx_object.h`), so creating them never allocates. Only the values outside
+ * of this range are allocated on the heap using this structure, which is followed by the magnitude of the value
+ * as an array of 64-bit limbs (see `bignum.h`). The arithmetic functions return immediate values whenever the
+ * result fits, so a heap-allocated `int` can only hold a small value if created by `nx_int_create_boxed`.
  */
 typedef struct {
     NxObject header;        //!< Header common to all natrix objects
-    const int64_t value;    //!< The value of the `int` object
+    const int64_t size;     //!< Number of limbs of the magnitude, negated for negative values, 0 for zero
 } NxInt;
 
+//! The minimum value representable as an immediate integer.
+#define NX_INT_IMMEDIATE_MIN (INT64_MIN / 2)
+//! The maximum value representable as an immediate integer.
+#define NX_INT_IMMEDIATE_MAX (INT64_MAX / 2)
+
 /**
  * \brief Type of all `int` objects.
  */
 extern const NxType nx_type_int;
 
+/**
+ * \brief Region receiving the `int` objects allocated by the current thread instead of the heap, `NULL` if none.
+ *
+ * The interpreters set it only while evaluating a binary operation whose result is consumed by the enclosing binary
+ * operation and then dropped (see `ExprBinary.temporary`), and reset the region once the statement is finished.
+ * Objects in the region are permanently marked, so the garbage collector ignores them, and contain no pointers.
+ * No object may keep a reference to them, the operations on `int` always return a new object.
+ */
+#ifdef __cplusplus
+extern thread_local Arena *nx_int_temporaries;
+#else
+extern _Thread_local Arena *nx_int_temporaries;
+#endif
+
+/**
+ * \brief Creates a new natrix `int` object allocated on the heap regardless of its value.
+ *
+ * May trigger garbage collection. Use `nx_int_create` instead, unless a heap-allocated object is needed.
+ * \param value the value of the `int` object
+ * \return the new `int` object
+ */
+NxObject *nx_int_create_boxed(int64_t value);
+
 /**
  * \brief Creates a new natrix `int` object.
  *
- * May trigger garbage collection.
+ * Returns an immediate value if the value fits, otherwise may trigger garbage collection.
  * \param value the value of the `int` object
  * \return the new `int` object
  */
-NxObject *nx_int_create(int64_t value);
+static inline NxObject *nx_int_create(int64_t value) {
+    if (value >= NX_INT_IMMEDIATE_MIN && value <= NX_INT_IMMEDIATE_MAX) {
+        return (NxObject *) (uintptr_t) (((uint64_t) value << 1) | NXO_INT_TAG);
+    }
+    return nx_int_create_boxed(value);
+}
+
+/**
+ * \brief Creates a new natrix `int` object from its decimal representation.
+ *
+ * May trigger garbage collection.
+ * \param str the decimal digits, without sign
+ * \param length the number of digits
+ * \return the new `int` object
+ */
+NxObject *nx_int_from_str(const char *str, size_t length);
 
 /**
  * \brief Determines whether the object is an instance of the `int` type.
@@ -53,19 +103,154 @@ NxObject *nx_int_create(int64_t value);
  * \return true if the object is an instance of the `int` type, false otherwise
  */
 static inline bool nx_int_is_instance(NxObject *object) {
-    return object->type == &nx_type_int;
+    return nxo_is_immediate_int(object) || object->gc_header.class_id == NX_CLASS_INT;
 }
 
 /**
- * \brief Returns the value of the `int` object.
+ * \brief Determines whether the value of a heap-allocated `int` object fits into `int64_t`.
+ * \param object the heap-allocated `int` object
+ * \return true if the value fits into `int64_t`
+ */
+bool nx_int_fits_int64_boxed(NxObject *object);
+
+/**
+ * \brief Returns the value of a heap-allocated `int` object.
+ * \param object the heap-allocated `int` object, its value must fit into `int64_t`
+ * \return the value of the `int` object
+ */
+int64_t nx_int_get_value_boxed(NxObject *object);
+
+/**
+ * \brief Determines whether the value of the `int` object fits into `int64_t`.
  * \param object the `int` object
+ * \return true if the value fits into `int64_t`, i.e. `nx_int_get_value()` can be used
+ */
+static inline bool nx_int_fits_int64(NxObject *object) {
+    assert(nx_int_is_instance(object));
+    return nxo_is_immediate_int(object) || nx_int_fits_int64_boxed(object);
+}
+
+/**
+ * \brief Returns the value of the `int` object.
+ * \param object the `int` object, its value must fit into `int64_t`
  * \return the value of the `int` object
  */
 static inline int64_t nx_int_get_value(NxObject *object) {
     assert(nx_int_is_instance(object));
-    return ((NxInt *) object)->value;
+    if (nxo_is_immediate_int(object)) {
+        return (int64_t) (intptr_t) object >> 1;
+    }
+    return nx_int_get_value_boxed(object);
 }
 
+/**
+ * \brief Returns the sign of the `int` object.
+ * \param object the `int` object
+ * \return -1 if the value is negative, 0 if it is zero, 1 if it is positive
+ */
+int nx_int_sign(NxObject *object);
+
+/**
+ * \brief Adds two `int` objects, see `nx_int_add()`.
+ */
+NxObject *nx_int_add_slow(NxObject *left, NxObject *right);
+
+/**
+ * \brief Subtracts two `int` objects, see `nx_int_sub()`.
+ */
+NxObject *nx_int_sub_slow(NxObject *left, NxObject *right);
+
+/**
+ * \brief Multiplies two `int` objects, see `nx_int_mul()`.
+ */
+NxObject *nx_int_mul_slow(NxObject *left, NxObject *right);
+
+/**
+ * \brief Compares two `int` objects, see `nx_int_compare()`.
+ */
+int nx_int_compare_slow(NxObject *left, NxObject *right);
+
+/**
+ * \brief Adds two `int` objects.
+ *
+ * Immediate operands are handled inline, the rest of the cases, including overflow, in `nx_int_add_slow()`.
+ * May trigger garbage collection, the operands do not need to be rooted.
+ * \param left left operand
+ * \param right right operand
+ * \return the sum
+ */
+static inline NxObject *nx_int_add(NxObject *left, NxObject *right) {
+    if (nxo_is_immediate_int(left) && nxo_is_immediate_int(right)) {
+        // cannot overflow, the immediate values use only 63 bits
+        return nx_int_create(nx_int_get_value(left) + nx_int_get_value(right));
+    }
+    return nx_int_add_slow(left, right);
+}
+
+/**
+ * \brief Subtracts two `int` objects.
+ *
+ * May trigger garbage collection, the operands do not need to be rooted.
+ * \param left left operand
+ * \param right right operand
+ * \return the difference
+ */
+static inline NxObject *nx_int_sub(NxObject *left, NxObject *right) {
+    if (nxo_is_immediate_int(left) && nxo_is_immediate_int(right)) {
+        return nx_int_create(nx_int_get_value(left) - nx_int_get_value(right));
+    }
+    return nx_int_sub_slow(left, right);
+}
+
+/**
+ * \brief Multiplies two `int` objects.
+ *
+ * May trigger garbage collection, the operands do not need to be rooted.
+ * \param left left operand
+ * \param right right operand
+ * \return the product
+ */
+static inline NxObject *nx_int_mul(NxObject *left, NxObject *right) {
+    int64_t result;
+    if (nxo_is_immediate_int(left) && nxo_is_immediate_int(right)
+            && !__builtin_mul_overflow(nx_int_get_value(left), nx_int_get_value(right), &result)) {
+        return nx_int_create(result);
+    }
+    return nx_int_mul_slow(left, right);
+}
+
+/**
+ * \brief Divides two `int` objects, rounding towards zero.
+ *
+ * Panics if the divisor is zero. May trigger garbage collection, the operands do not need to be rooted.
+ * \param left the dividend
+ * \param right the divisor
+ * \return the quotient
+ */
+NxObject *nx_int_div(NxObject *left, NxObject *right);
+
+/**
+ * \brief Compares two `int` objects.
+ * \param left left operand
+ * \param right right operand
+ * \return negative if `left < right`, zero if `left == right`, positive if `left > right`
+ */
+static inline int nx_int_compare(NxObject *left, NxObject *right) {
+    if (nxo_is_immediate_int(left) && nxo_is_immediate_int(right)) {
+        int64_t l = nx_int_get_value(left);
+        int64_t r = nx_int_get_value(right);
+        return (l > r) - (l < r);
+    }
+    return nx_int_compare_slow(left, right);
+}
+
+/**
+ * \brief Appends the decimal representation of the `int` object to a string builder.
+ * \param sb the string builder
+ * \param object the `int` object
+ */
+void nx_int_append_to(StringBuilder *sb, NxObject *object);
+
 #ifdef __cplusplus
 }
 #endif
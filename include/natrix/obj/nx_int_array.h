@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file nx_int_array.h
+ * \brief Fixed-size array of unboxed 64-bit integers.
+ *
+ * Like `NxObjectArray`, these arrays are not natrix objects themselves, they are used as the storage of lists which
+ * contain only integers. They contain no pointers, so the garbage collector never traces their items.
+ */
+
+#ifndef NX_INT_ARRAY_H
+#define NX_INT_ARRAY_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "natrix/obj/nx_object.h"
+
+/**
+ * \brief Layout of the integer array.
+ */
+typedef struct {
+    GcHeader gc_header;                 //!< Header common to all natrix objects
+    const int64_t size;                 //!< Capacity of the array
+    int64_t data[];                     //!< The integers
+} NxIntArray;
+
+/**
+ * \brief Creates a new array of integers.
+ *
+ * All items in the array are initialized to zero.
+ * May trigger garbage collection.
+ * \param size capacity of the array
+ * \return new array of integers
+ */
+NxIntArray *nx_int_array_create(int64_t size);
+
+/**
+ * \brief Creates a new array of integers, copying the items from the source array.
+ *
+ * If the new size is greater than the source size, the extra items are initialized to zero.
+ * If the new size is smaller than the source size, the extra items are not copied.
+ * May trigger garbage collection.
+ * \param source array to copy items from, must not be NULL and must be rooted
+ * \param new_size capacity of the new array
+ * \return new array of integers
+ */
+NxIntArray *nx_int_array_copy(NxIntArray *source, int64_t new_size);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //NX_INT_ARRAY_H
@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file nx_lines.h
+ * \brief Representation and operations of line readers, the iterators returned by `read_lines()`.
+ *
+ * A line reader reads a file in large blocks, each of which is a flat `str` allocated by the garbage collector.
+ * The lines are slices of the blocks (see `nx_str_view()`), so reading a line does not copy its bytes unless it is
+ * shorter than `NX_STR_VIEW_MIN_LENGTH` or it spans two blocks, in which case its beginning is moved to the next
+ * block. A line which is kept alive keeps its whole block alive.
+ *
+ * The reader is consumed by iterating it, a second `for` loop continues where the first one stopped. The file is
+ * closed when its end is reached.
+ */
+
+#ifndef NX_LINES_H
+#define NX_LINES_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "natrix/obj/defs.h"
+
+//! Size of the blocks in which the files are read, a longer line gets a block of twice its length.
+#define NX_LINES_BLOCK_SIZE ((int64_t) 1 << 20)
+
+/**
+ * \brief Layout of `lines` instances.
+ */
+typedef struct {
+    NxObject header;            //!< Header common to all natrix objects
+    int fd;                     //!< The file descriptor, -1 once the end of the file has been reached
+    bool owns_fd;               //!< Whether the descriptor is closed at the end of the file
+    NxObject *block;            //!< Flat `str` holding the bytes read so far, NULL before the first read
+    int64_t start;              //!< Offset in `block` of the next line
+    int64_t end;                //!< Number of bytes of `block` read from the file
+} NxLines;
+
+/**
+ * \brief Type of all `lines` instances.
+ */
+extern const NxType nx_type_lines;
+
+/**
+ * \brief Creates a new line reader of a file descriptor.
+ *
+ * May trigger garbage collection.
+ * \param fd the file descriptor, open for reading
+ * \param owns_fd whether the reader closes the descriptor at the end of the file
+ * \return the new line reader
+ */
+NxObject *nx_lines_create(int fd, bool owns_fd);
+
+/**
+ * \brief Reads the next line without its terminating newline.
+ *
+ * Panics if the file cannot be read. May trigger garbage collection.
+ * \param self the line reader, must be rooted
+ * \return the line, NULL at the end of the file
+ */
+NxObject *nx_lines_next(NxObject *self);
+
+/**
+ * \brief Determines whether the object is a line reader.
+ * \param object the object to check
+ * \return true if the object is an instance of the `lines` type, false otherwise
+ */
+static inline bool nx_lines_is_instance(NxObject *object) {
+    return nxo_type(object) == &nx_type_lines;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif //NX_LINES_H
@@ -8,6 +8,12 @@
 /**
  * \file nx_list.h
  * \brief Representation and operations of natrix `list` objects.
+ *
+ * The items of a list are stored according to a strategy. A new list stores its items as unboxed 64-bit integers in
+ * an `NxIntArray`, which the garbage collector does not need to trace and which can be processed by vectorized loops.
+ * The first time an item other than an immediate integer is stored, the list switches to the generic strategy,
+ * which stores pointers to the items in an `NxObjectArray`. The switch is permanent. Only immediate integers are
+ * stored unboxed, so reading an item never allocates and heap-allocated integers keep their identity.
  */
 
 #ifndef NX_LIST_H
@@ -19,15 +25,29 @@ extern "C" {
 #include <assert.h>
 #include <stdbool.h>
 #include "natrix/obj/defs.h"
+#include "natrix/obj/nx_int.h"
+#include "natrix/obj/nx_int_array.h"
 #include "natrix/obj/nx_object_array.h"
 
+/**
+ * \brief Storage strategies of lists.
+ */
+typedef enum {
+    NX_LIST_INTS,               //!< All items are immediate integers, stored in `NxList.ints`
+    NX_LIST_OBJECTS,            //!< Items are arbitrary objects, stored in `NxList.items`
+} NxListStrategy;
+
 /**
  * \brief Layout of `list` instances.
  */
 typedef struct {
     NxObject header;            //!< Header common to all natrix objects
-    int64_t length;             //!< Number of items in the list, always less than or equal to items->size
-    NxObjectArray *items;       //!< Array of items, never NULL but may be of zero size
+    int64_t length;             //!< Number of items in the list, always less than or equal to the size of the storage
+    NxListStrategy strategy;    //!< Strategy determining which member of the union holds the items
+    union {
+        NxIntArray *ints;       //!< Values of the items with the `NX_LIST_INTS` strategy
+        NxObjectArray *items;   //!< Items with the `NX_LIST_OBJECTS` strategy
+    };                          //!< Storage of the items, never NULL but may be of zero size
 } NxList;
 
 /**
@@ -40,17 +60,28 @@ extern const NxType nx_type_list;
  *
  * May trigger garbage collection.
  * \param initial_capacity initial capacity of the list, must be greater than zero
- * \return the new list object
+ * \return the new list object, using the `NX_LIST_INTS` strategy
  */
 NxObject *nx_list_create(int64_t initial_capacity);
 
+/**
+ * \brief Creates a new `list` object containing the given items.
+ *
+ * The strategy is chosen up front, so that a list of arbitrary objects does not allocate an integer array first.
+ * May trigger garbage collection.
+ * \param items the items of the list, must be rooted
+ * \param count number of items
+ * \return the new list object
+ */
+NxObject *nx_list_create_from(NxObject *const *items, int64_t count);
+
 /**
  * \brief Determines whether the object is an instance of the `list` type.
  * \param object the object to check
  * \return true if the object is an instance of the `list` type, false otherwise
  */
 static inline bool nx_list_is_instance(NxObject *object) {
-    return object->type == &nx_type_list;
+    return nxo_type(object) == &nx_type_list;
 }
 
 /**
@@ -63,6 +94,21 @@ static inline int64_t nx_list_get_length(NxObject *list) {
     return ((NxList *) list)->length;
 }
 
+/**
+ * \brief Returns the item at the given index, which must be within the bounds of the list.
+ *
+ * Does not allocate, the values of the `NX_LIST_INTS` strategy are within the range of immediate integers.
+ * \param list the list
+ * \param index the index of the item, between 0 and the length of the list minus one
+ * \return the item
+ */
+static inline NxObject *nx_list_get_item(NxObject *list, int64_t index) {
+    assert(nx_list_is_instance(list));
+    NxList *l = (NxList *) list;
+    assert(index >= 0 && index < l->length);
+    return l->strategy == NX_LIST_INTS ? nx_int_create(l->ints->data[index]) : l->items->data[index];
+}
+
 /**
  * \brief Appends the given item to the list.
  *
@@ -72,6 +118,27 @@ static inline int64_t nx_list_get_length(NxObject *list) {
  */
 void nx_list_append(NxObject *list, NxObject *item);
 
+/**
+ * \brief Appends the given items to the list.
+ *
+ * The storage grows at most once and the strategy is switched at most once, so extending a list by many items costs
+ * a single allocation. May trigger garbage collection. Panics if the list would be too long.
+ * \param list the list to extend, must be a non-NULL, rooted instance of the `list` type
+ * \param items the items to append, must be rooted and must not point into the storage of `list` itself
+ * \param count number of items
+ */
+void nx_list_extend(NxObject *list, NxObject *const *items, int64_t count);
+
+/**
+ * \brief Appends the items of another list to the list, implementing `list += other`.
+ *
+ * Two integer lists are joined with a single memmove() without boxing. May trigger garbage collection. Panics if the
+ * list would be too long.
+ * \param list the list to extend, must be a non-NULL, rooted instance of the `list` type
+ * \param other the list whose items are appended, must be rooted, may be `list` itself
+ */
+void nx_list_extend_list(NxObject *list, NxObject *other);
+
 #ifdef __cplusplus
 }
 #endif
@@ -9,7 +9,8 @@
  * \file nx_object.h
  * \brief Defines the header common to all natrix objects.
  *
- * The header contains a pointer to the type of the object and GC-related fields.
+ * The header is the GC header, whose class identifies the type of the object (see `nxo_type()`), so that it
+ * occupies only a single word.
  * The macro `NX_OBJECT_HEADER` should be used to include the header in a concrete object structure:
  * \code{.c}
  * typedef struct {
@@ -17,6 +18,10 @@
  *    // ... other fields specific to the object
  * } NxSomeObject;
  * \endcode
+ *
+ * Not every `NxObject *` points to an object in memory. Integers which fit into 63 bits are encoded directly
+ * in the pointer: the value is shifted left by one bit and the least significant bit is set to `NXO_INT_TAG`.
+ * Such pointers must never be dereferenced, use `nxo_type()` to get the type of any object.
  */
 
 #ifndef NX_OBJECT_H
@@ -31,10 +36,62 @@ extern "C" {
  * \brief Header common to all natrix objects.
  */
 typedef struct {
-    GcHeader gc_header;                     //!< GC header
-    const struct NxType *type;              //!< Type of the object
+    GcHeader gc_header;                     //!< GC header, its class identifies the type of the object
 } NxObject;
 
+/**
+ * \brief Returns the header of an object, to be passed to the functions of the garbage collector.
+ *
+ * Unlike `&obj->gc_header`, which is undefined for the tagged pointer of an immediate integer, the conversion keeps
+ * such a pointer as it is, and the collector ignores it.
+ * \param obj the object or immediate value
+ * \return the header of the object
+ */
+static inline GcHeader *nxo_gc_header(NxObject *obj) {
+    return (GcHeader *) obj;
+}
+
+/**
+ * \brief Garbage collector classes of the built-in objects.
+ *
+ * The ids are fixed at compile time, so that statically allocated objects (types, booleans, cached strings) can
+ * refer to them. The classes of types are defined in `nx_type.c`, the others in the files implementing them.
+ */
+typedef enum {
+    NX_CLASS_TYPE = GC_CLASS_LEAF + 1,      //!< Instances of `type`
+    NX_CLASS_BOOL,                          //!< Instances of `bool`
+    NX_CLASS_INT,                           //!< Instances of `int`
+    NX_CLASS_STR,                           //!< Instances of `str`
+    NX_CLASS_LIST,                          //!< Instances of `list`
+    NX_CLASS_DICT,                          //!< Instances of `dict`
+    NX_CLASS_RANGE,                         //!< Instances of `range`, the lazy ranges iterated by `for` loops
+    NX_CLASS_OBJECT_ARRAY,                  //!< `NxObjectArray`
+    NX_CLASS_INT_ARRAY,                     //!< `NxIntArray`
+    NX_CLASS_DICT_TABLE,                    //!< `NxDictTable`
+    NX_CLASS_LINES,                         //!< Instances of `lines`, the line readers returned by `read_lines()`
+    NX_CLASS_COUNT,                         //!< Number of the ids, not a class
+} NxClassId;
+
+/**
+ * \brief Initializes the header of a statically allocated object.
+ *
+ * Such objects are permanently marked, see gc.h.
+ * \param id the class of the object, one of `NxClassId`
+ */
+#define NX_STATIC_HEADER_INIT(id) {.gc_header = {.mark = GC_FLAG_MARK, .class_id = (id)}}
+
+//! Tag in the least significant bit of `NxObject *` denoting an immediate integer.
+#define NXO_INT_TAG GC_IMMEDIATE_TAG_MASK
+
+/**
+ * \brief Determines whether the object is an immediate integer encoded in the pointer.
+ * \param obj the object
+ * \return true if the object is an immediate integer
+ */
+static inline bool nxo_is_immediate_int(const NxObject *obj) {
+    return ((uintptr_t) obj & NXO_INT_TAG) != 0;
+}
+
 #ifdef __cplusplus
 }
 #endif
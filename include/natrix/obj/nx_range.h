@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file nx_range.h
+ * \brief Representation and operations of lazy ranges of integers.
+ *
+ * A range is created in place of the list returned by `range()` when the call is the iterable of a `for` loop, see
+ * builtin_range_iter(). It is never visible to the program, its items are computed as the loop steps through them.
+ */
+
+#ifndef NX_RANGE_H
+#define NX_RANGE_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "natrix/obj/defs.h"
+
+/**
+ * \brief Layout of `range` instances.
+ */
+typedef struct {
+    NxObject header;            //!< Header common to all natrix objects
+    int64_t start;              //!< The first item
+    int64_t step;               //!< Difference between consecutive items, not zero
+    int64_t length;             //!< Number of items, all of them are immediate integers
+} NxRange;
+
+/**
+ * \brief Type of all `range` instances.
+ */
+extern const NxType nx_type_range;
+
+/**
+ * \brief Creates a new range.
+ *
+ * May trigger garbage collection.
+ * \param start the first item
+ * \param step difference between consecutive items, must not be zero
+ * \param length number of items, `start + (length - 1) * step` must be an immediate integer
+ * \return the new range
+ */
+NxObject *nx_range_create(int64_t start, int64_t step, int64_t length);
+
+/**
+ * \brief Determines whether the object is a range.
+ * \param object the object to check
+ * \return true if the object is an instance of the `range` type, false otherwise
+ */
+static inline bool nx_range_is_instance(NxObject *object) {
+    return nxo_type(object) == &nx_type_range;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif //NX_RANGE_H
@@ -20,20 +20,49 @@ extern "C" {
 #include <stdbool.h>
 #include "natrix/obj/defs.h"
 
+//! Minimum length of the result of a concatenation that is represented as a rope instead of being copied.
+#define NX_STR_ROPE_MIN_LENGTH 64
+
+//! Minimum length of a slice that shares the bytes of the sliced string instead of copying them.
+#define NX_STR_VIEW_MIN_LENGTH 16
+
 /**
  * \brief Layout of `str` instances.
  *
- * The length of the string is given explicitly, the string may contain null bytes. However, the string is
- * also always null-terminated, so it can be used safely with standard C library functions.
+ * The length of the string is given explicitly, the string may contain null bytes. However, the bytes returned
+ * by nx_str_get_cstr() are always null-terminated, so they can be used safely with standard C library functions.
  * Strings are sequences of bytes, not characters. The encoding is currently not specified, but it is assumed
  * that only ASCII strings are used. Support for UTF-8 may be added in the future.
+ *
+ * A flat string stores its bytes followed by a null terminator right after this structure and `data` points to
+ * them. The result of a long concatenation is a rope (see `NxRope`) whose `data` is NULL until the contiguous
+ * bytes are needed. A slice is a view (also an `NxRope`) whose `data` points into the bytes of a flat string,
+ * so it is not necessarily followed by a null terminator.
+ *
+ * The hash of a string is computed when it is first needed, e.g. when the string is used as a key of a `dict`,
+ * and stored in the string, which is immutable otherwise.
  */
 typedef struct {
     NxObject header;            //!< Header common to all natrix objects
     const int64_t length;       //!< Number of bytes in the string, excluding the null terminator
-    const char data[];          //!< Array of bytes, with an additional null terminator at the end
+    const char *const data;     //!< Array of `length` bytes, NULL if not flattened yet
+    uint64_t hash;              //!< Hash of the bytes computed by nx_str_get_hash(), 0 if not computed yet
 } NxStr;
 
+/**
+ * \brief Layout of `str` instances created by concatenation or slicing, which do not store their bytes inline.
+ *
+ * The rope defers copying the bytes of its operands until they are needed, which makes building a string by
+ * repeated concatenation linear in its total length. When the rope is flattened, the bytes are copied to a new
+ * flat string which replaces `left`, `right` is cleared and `data` points to the bytes of the flat string.
+ * A flattened rope is thus a view of a flat string; views created by slicing point into the middle of it.
+ */
+typedef struct {
+    NxStr str;                  //!< Common part of all `str` instances
+    NxObject *left;             //!< The left operand, or the flat string that owns the bytes of a view
+    NxObject *right;            //!< The right operand, NULL for a view
+} NxRope;
+
 /**
  * \brief Type of all `str` instances.
  */
@@ -50,25 +79,84 @@ extern const NxType nx_type_str;
  */
 NxObject *nx_str_create(const char *data, int64_t length);
 
+/**
+ * \brief Creates a new flat `str` object whose bytes are filled in by the caller, e.g. by reading a file into it.
+ *
+ * May trigger garbage collection. The null terminator is already set. The bytes must be written before the string
+ * is hashed or used by the program.
+ * \param length length of the string, must not be negative
+ * \param bytes receives the pointer to the `length` bytes of the string
+ * \return the new str object
+ */
+NxObject *nx_str_create_buffer(int64_t length, char **bytes);
+
+/**
+ * \brief Returns a substring of a flat `str` object, sharing its bytes if the substring is long enough.
+ *
+ * A substring of at least `NX_STR_VIEW_MIN_LENGTH` bytes is a view which keeps the whole flat string alive,
+ * shorter ones are copied. May trigger garbage collection.
+ * \param owner a flat `str` object, must be rooted
+ * \param start offset of the first byte of the substring
+ * \param length length of the substring, `start + length` must not exceed the length of `owner`
+ * \return the substring
+ */
+NxObject *nx_str_view(NxObject *owner, int64_t start, int64_t length);
+
+/**
+ * \brief Returns the shared `str` object consisting of the given single byte.
+ *
+ * Does not allocate, the 256 single-byte strings are allocated statically.
+ * \param c the byte
+ * \return the `str` object of length 1
+ */
+NxObject *nx_str_from_char(char c);
+
 /**
  * \brief Determines whether the object is an instance of the `str` type.
  * \param object the object to check
  * \return true if the object is an instance of the `str` type, false otherwise
  */
 static inline bool nx_str_is_instance(NxObject *object) {
-    return object->type == &nx_type_str;
+    return nxo_type(object) == &nx_type_str;
 }
 
 /**
- * \brief Returns pointer to the value of the `str` object.
+ * \brief Copies the bytes of an unflattened rope or of a view into a new null-terminated flat string.
+ *
+ * Slow path of nx_str_get_data() and nx_str_get_cstr(), do not call directly. May trigger garbage collection.
+ * \param object the `str` object whose `data` is NULL or not null-terminated
+ * \return pointer to the value of the `str` object
+ */
+const char *nx_str_flatten(NxObject *object);
+
+/**
+ * \brief Returns pointer to the bytes of the `str` object, which are not necessarily null-terminated.
  *
  * The returned pointer is valid as long as the `str` object is not deallocated.
+ * If the string is a rope that has not been flattened yet, it is flattened first, which may trigger garbage
+ * collection (the string itself need not be rooted).
+ * \param object the `str` object
+ * \return pointer to the `nx_str_get_length()` bytes of the `str` object
+ */
+static inline const char *nx_str_get_data(NxObject *object) {
+    assert(nx_str_is_instance(object));
+    const char *data = ((NxStr *) object)->data;
+    return data != NULL ? data : nx_str_flatten(object);
+}
+
+/**
+ * \brief Returns pointer to the null-terminated value of the `str` object.
+ *
+ * The returned pointer is valid as long as the `str` object is not deallocated.
+ * If the string is a rope that has not been flattened yet or a view that is not followed by a null terminator,
+ * its bytes are copied first, which may trigger garbage collection (the string itself need not be rooted).
  * \param object the `str` object
  * \return pointer to the value of the `str` object
  */
 static inline const char *nx_str_get_cstr(NxObject *object) {
     assert(nx_str_is_instance(object));
-    return ((NxStr *) object)->data;
+    const NxStr *str = (NxStr *) object;
+    return str->data != NULL && str->data[str->length] == '\0' ? str->data : nx_str_flatten(object);
 }
 
 /**
@@ -83,6 +171,52 @@ static inline int64_t nx_str_get_length(NxObject *object) {
     return ((NxStr *) object)->length;
 }
 
+/**
+ * \brief Computes and stores the hash of the `str` object.
+ *
+ * Slow path of nx_str_get_hash(), do not call directly. May trigger garbage collection.
+ * \param object the `str` object whose hash has not been computed yet
+ * \return the hash of the bytes of the `str` object
+ */
+uint64_t nx_str_compute_hash(NxObject *object);
+
+/**
+ * \brief Returns the hash of the bytes of the `str` object.
+ *
+ * The hash is the 64-bit FNV-1a hash of the bytes, except that 0 is replaced by 1. It is computed only once,
+ * which requires the string to be flattened and may thus trigger garbage collection (the string itself need not
+ * be rooted).
+ * \param object the `str` object
+ * \return the hash, never 0
+ */
+static inline uint64_t nx_str_get_hash(NxObject *object) {
+    assert(nx_str_is_instance(object));
+    uint64_t hash = ((NxStr *) object)->hash;
+    return hash != 0 ? hash : nx_str_compute_hash(object);
+}
+
+/**
+ * \brief Determines whether two `str` objects consist of the same bytes.
+ *
+ * The same object (e.g. two occurrences of an interned literal) is equal without looking at the bytes, strings of
+ * different lengths or whose hashes have both been computed and differ are not. Only the remaining strings are
+ * flattened and compared byte by byte, which may trigger garbage collection (the strings need not be rooted).
+ * \param left the first `str` object
+ * \param right the second `str` object
+ * \return true if the strings are equal
+ */
+bool nx_str_equals(NxObject *left, NxObject *right);
+
+/**
+ * \brief Compares the bytes of two `str` objects lexicographically.
+ *
+ * May trigger garbage collection, the strings need not be rooted.
+ * \param left the first `str` object
+ * \param right the second `str` object
+ * \return negative, zero or positive if `left` is less than, equal to or greater than `right`
+ */
+int nx_str_compare(NxObject *left, NxObject *right);
+
 /**
  * \brief Concatenates two `str` objects.
  *
@@ -16,6 +16,8 @@
 extern "C" {
 #endif
 
+#include <stdbool.h>
+#include <stdint.h>
 #include "natrix/obj/nx_object.h"
 
 /**
@@ -24,34 +26,62 @@ extern "C" {
  * This macro should be used to initialize the header of a statically allocated type, like this:
  * \code{.c}
  * const NxType nx_type_some_type = {
- *         NX_TYPE_HEADER_INIT("SomeType", some_type_trace_fn),
+ *         NX_TYPE_HEADER_INIT(NX_CLASS_SOME_TYPE, "SomeType", some_type_trace_fn),
  *         // ... initialization of other fields
  * };
  * \endcode
+ * The class id must have an entry in `nx_types`.
  */
-#define NX_TYPE_HEADER_INIT(type_name, trace_obj_fn)    \
-        .header = {                                     \
-                .gc_header = {                          \
-                        .next = NULL,                   \
-                        .trace_fn = gc_trace_nop,       \
-                },                                      \
-                .type = &nx_type_type,                  \
-        },                                              \
-        .name = type_name,                              \
-        .gc_trace_fn = trace_obj_fn
+#define NX_TYPE_HEADER_INIT(id, type_name, trace_obj_fn)        \
+        .header = NX_STATIC_HEADER_INIT(NX_CLASS_TYPE),         \
+        .name = type_name,                                      \
+        .gc_trace_fn = trace_obj_fn,                            \
+        .class_id = id
+
+/**
+ * \brief Implementation of a binary operator for some combinations of the types of its operands.
+ *
+ * The function receives the operands in the order in which they appear in the expression, regardless of which of
+ * them has the type the function belongs to. The operands do not need to be rooted, the function may trigger
+ * garbage collection, but only after deciding that it supports the operands.
+ * \param left the left operand
+ * \param right the right operand
+ * \return the result, NULL if the operator is not supported for the types of the operands
+ */
+typedef NxObject *(*NxBinaryFn)(NxObject *left, NxObject *right);
 
 /**
  * \brief Represents a natrix type.
  *
  * A type is also an object, so it has a header with type pointing to itself. Types are immutable.
+ *
+ * Objects which are equal according to `eq_fn` must have the same hash, `eq_fn` of either of them may be called.
+ *
+ * A binary operator is dispatched in two levels (see ops_binary()): the slot of the type of the left operand is
+ * tried first, and if it is NULL or does not support the right operand, the slot of the type of the right operand.
+ * This way e.g. `3 * [0]` is implemented by `list`, although `int` is the type of the left operand.
+ *
+ * A `for` loop keeps its position in the iterated object as a plain integer and passes it to `iter_next_fn`, so that
+ * stepping through the items of a type which does not need to box them, like `list` or `str`, does not allocate.
  */
 typedef struct NxType {
     NxObject header;                                //!< Header common to all natrix objects
     const char *name;                               //!< Name of the type, statically allocated
-    GcTraceFn gc_trace_fn;                          //!< Function to trace pointers in objects of this type
+    GcTraceFn gc_trace_fn;                          //!< Function to trace pointers in objects of this type, NULL
+                                                    //!< if they contain no pointers
+    GcClassId class_id;                             //!< Class of the objects of this type, see `NxClassId`
     NxObject *(*as_bool_fn)(NxObject *self);        //!< Converts an object of this type to a boolean
     NxObject *(*get_element_fn)(NxObject *self, NxObject *index);        //!< Gets an element at the given index
     void (*set_element_fn)(NxObject *self, NxObject *index, NxObject *value);        //!< Sets an element at the given index
+    NxObject *(*get_slice_fn)(NxObject *self, NxObject *lower, NxObject *upper);     //!< Gets a slice between the given bounds
+    uint64_t (*hash_fn)(NxObject *self);            //!< Computes the hash of an object of this type, NULL if unhashable
+    bool (*eq_fn)(NxObject *self, NxObject *other); //!< Compares for equality, NULL to compare identities
+    NxBinaryFn add_fn;                              //!< Implements `+`
+    NxBinaryFn sub_fn;                              //!< Implements `-`
+    NxBinaryFn mul_fn;                              //!< Implements `*`
+    NxBinaryFn div_fn;                              //!< Implements `/`
+    NxBinaryFn compare_fn;                          //!< Three-way comparison, returns the `int` -1, 0 or 1
+    NxObject *(*iter_next_fn)(NxObject *self, int64_t *position);        //!< Gets the item at the position and advances it, NULL when exhausted
 } NxType;
 
 /**
@@ -59,6 +89,11 @@ typedef struct NxType {
  */
 extern const NxType nx_type_type;
 
+/**
+ * \brief The built-in types indexed by the class of their instances, NULL for classes which are not types.
+ */
+extern const NxType *const nx_types[NX_CLASS_COUNT];
+
 #ifdef __cplusplus
 }
 #endif
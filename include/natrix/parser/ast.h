@@ -20,6 +20,9 @@
 extern "C" {
 #endif
 
+#include <stdbool.h>
+#include <stdint.h>
+#include "natrix/parser/symbol.h"
 #include "natrix/util/arena.h"
 #include "natrix/util/sb.h"
 
@@ -30,9 +33,12 @@ typedef enum {
     EXPR_INT_LITERAL,       //!< Integer literal
     EXPR_STR_LITERAL,       //!< String literal
     EXPR_LIST_LITERAL,      //!< List literal
+    EXPR_DICT_LITERAL,      //!< Dictionary literal
     EXPR_NAME,              //!< Identifier
     EXPR_BINARY,            //!< Binary operation
     EXPR_SUBSCRIPT,         //!< Subscript operation
+    EXPR_SLICE,             //!< Slice operation
+    EXPR_CALL,              //!< Call of a built-in function
 } ExprKind;
 
 /**
@@ -41,7 +47,9 @@ typedef enum {
 typedef enum {
     STMT_EXPR,              //!< Expression statement, e.g. function call
     STMT_ASSIGNMENT,        //!< Assignment statement
+    STMT_AUG_ASSIGNMENT,    //!< Augmented assignment statement, e.g. `a += 1`
     STMT_WHILE,             //!< While loop
+    STMT_FOR,               //!< For loop over the items of an iterable
     STMT_IF,                //!< If statement
     STMT_PASS,              //!< Empty statement
     STMT_PRINT,             //!< Print statement, to be removed once function calls and built-ins are implemented
@@ -67,13 +75,23 @@ typedef enum {
 typedef struct Expr Expr;
 typedef struct Stmt Stmt;
 
+//! Value of `ExprName.slot` and `ExprLiteral.index` before the node is resolved.
+#define AST_UNRESOLVED UINT32_MAX
+
+//! Maximum number of arguments of a call.
+#define AST_MAX_ARGS 255
+
 /**
- * \brief Attributes of the `EXPR_INT_LITERAL`, `EXPR_STR_LITERAL` and `EXPR_LIST_LITERAL` AST nodes.
+ * \brief Attributes of the `EXPR_INT_LITERAL`, `EXPR_STR_LITERAL`, `EXPR_LIST_LITERAL` and `EXPR_DICT_LITERAL` AST nodes.
  */
 typedef struct {
     const char *start;              //!< Pointer to the start of the literal in the source code
     const char *end;                //!< Pointer to the character after the end of the literal
-    Expr *head;                     //!< Head of list literal, `NULL` if the literal is not a list or is empty
+    union {
+        Expr *head;                 //!< Head of list literal or of the alternating keys and values of dictionary literal, `NULL` if empty
+        const Symbol *symbol;       //!< Interned text of integer or string literal, `NULL` unless created by the parser
+    };
+    uint32_t index;                 //!< Index of the value of integer or string literal in the literal pool, assigned by the resolver
 } ExprLiteral;
 
 /**
@@ -82,6 +100,8 @@ typedef struct {
 typedef struct {
     const char *start;              //!< Pointer to the start of the identifier in the source code
     const char *end;                //!< Pointer to the character after the end of the identifier
+    const Symbol *symbol;           //!< Interned identifier, `NULL` unless created by the parser
+    uint32_t slot;                  //!< Slot of the variable or index of the built-in function if the name is a callee, assigned by the resolver
 } ExprName;
 
 /**
@@ -90,6 +110,9 @@ typedef struct {
 typedef struct {
     Expr *left;                     //!< Left operand
     BinaryOp op;                    //!< Binary operator
+    //! Whether the result is only consumed by the enclosing binary operation, so that it can be allocated in the
+    //! region of temporaries instead of the heap (see `nx_int_temporaries`), set by the resolver
+    bool temporary;
     Expr *right;                    //!< Right operand
 } ExprBinary;
 
@@ -102,6 +125,25 @@ typedef struct {
     const char *end;                //!< Pointer to the character after the closing bracket
 } ExprSubscript;
 
+/**
+ * \brief Attributes of the `EXPR_SLICE` AST node.
+ */
+typedef struct {
+    Expr *receiver;                 //!< Receiver of the slice operation
+    Expr *lower;                    //!< Lower bound of the slice, `NULL` if omitted
+    Expr *upper;                    //!< Upper bound of the slice, `NULL` if omitted
+    const char *end;                //!< Pointer to the character after the closing bracket
+} ExprSlice;
+
+/**
+ * \brief Attributes of the `EXPR_CALL` AST node.
+ */
+typedef struct {
+    Expr *callee;                   //!< Name of the called function, an `EXPR_NAME` node
+    Expr *args;                     //!< Head of the arguments, `NULL` if there are none
+    const char *end;                //!< Pointer to the character after the closing parenthesis
+} ExprCall;
+
 /**
  * \brief AST node representing an expression.
  */
@@ -112,10 +154,12 @@ struct Expr {
      * \brief Union of all possible kinds of expression nodes.
      */
     union {
-        ExprLiteral literal;        //!< Value of a literal, active when `kind` is `EXPR_INT_LITERAL`, `EXPR_STR_LITERAL` or `EXPR_LIST_LITERAL`
+        ExprLiteral literal;        //!< Value of a literal, active when `kind` is `EXPR_INT_LITERAL`, `EXPR_STR_LITERAL`, `EXPR_LIST_LITERAL` or `EXPR_DICT_LITERAL`
         ExprName identifier;        //!< Identifier, active when `kind` is `EXPR_NAME`
         ExprBinary binary;          //!< Binary operation, active when `kind` is `EXPR_BINARY`
         ExprSubscript subscript;    //!< Subscript operation, active when `kind` is `EXPR_SUBSCRIPT`
+        ExprSlice slice;            //!< Slice operation, active when `kind` is `EXPR_SLICE`
+        ExprCall call;              //!< Function call, active when `kind` is `EXPR_CALL`
     };
 };
 
@@ -125,6 +169,7 @@ struct Expr {
 typedef struct {
     Expr *left;                     //!< Left-hand side of the assignment
     Expr *right;                    //!< Right-hand side of the assignment
+    BinaryOp op;                    //!< Operator of an augmented assignment, unused for plain assignments
 } StmtAssignment;
 
 /**
@@ -135,6 +180,16 @@ typedef struct {
     Stmt *body;                     //!< Body of the loop
 } StmtWhile;
 
+/**
+ * \brief AST node representing a `for` statement.
+ */
+typedef struct {
+    Expr *target;                   //!< Variable assigned the items, an `EXPR_NAME` node
+    Expr *iterable;                 //!< Object whose items are iterated
+    Stmt *body;                     //!< Body of the loop
+    uint32_t iter_slot;             //!< First of the two hidden slots holding the state of the iteration, assigned by the resolver
+} StmtFor;
+
 /**
  * \brief AST node representing an `if` statement.
  */
@@ -155,8 +210,9 @@ struct Stmt {
      */
     union {
         Expr *expr;                 //!< Expression statement, active when `kind` is `STMT_EXPR` or `STMT_PRINT`
-        StmtAssignment assignment;  //!< Assignment statement, active when `kind` is `STMT_ASSIGNMENT`
+        StmtAssignment assignment;  //!< Assignment statement, active when `kind` is `STMT_ASSIGNMENT` or `STMT_AUG_ASSIGNMENT`
         StmtWhile while_stmt;       //!< While loop, active when `kind` is `STMT_WHILE`
+        StmtFor for_stmt;           //!< For loop, active when `kind` is `STMT_FOR`
         StmtIf if_stmt;             //!< If statement, active when `kind` is `STMT_IF`
     };
 };
@@ -189,6 +245,16 @@ Expr *ast_create_expr_str_literal(Arena *arena, const char *start, const char *e
  */
 Expr *ast_create_expr_list_literal(Arena *arena, const char *start, const char *end, Expr *head);
 
+/**
+ * \brief Creates a new node representing a dictionary literal.
+ * \param arena arena allocator from which the node will be allocated
+ * \param start pointer to the start of the dictionary literal in the source code
+ * \param end pointer to the character after the end of the dictionary literal
+ * \param head head of the list of keys and values, each key followed by its value, `NULL` if the dictionary is empty
+ * \return the newly allocated node
+ */
+Expr *ast_create_expr_dict_literal(Arena *arena, const char *start, const char *end, Expr *head);
+
 /**
  * \brief Creates a new node representing a name.
  * \param arena arena allocator from which the node will be allocated
@@ -218,6 +284,27 @@ Expr *ast_create_expr_binary(Arena *arena, Expr *left, BinaryOp op, Expr *right)
  */
 Expr *ast_create_expr_subscript(Arena *arena, Expr *receiver, Expr *index, const char *end);
 
+/**
+ * \brief Creates a new node representing a slice operation.
+ * \param arena arena allocator from which the node will be allocated
+ * \param receiver receiver of the slice operation
+ * \param lower lower bound of the slice, `NULL` if omitted
+ * \param upper upper bound of the slice, `NULL` if omitted
+ * \param end pointer to the character after the closing bracket
+ * \return the newly allocated node
+ */
+Expr *ast_create_expr_slice(Arena *arena, Expr *receiver, Expr *lower, Expr *upper, const char *end);
+
+/**
+ * \brief Creates a new node representing a function call.
+ * \param arena arena allocator from which the node will be allocated
+ * \param callee name of the called function, an `EXPR_NAME` node
+ * \param args head of the arguments, `NULL` if there are none
+ * \param end pointer to the character after the closing parenthesis
+ * \return the newly allocated node
+ */
+Expr *ast_create_expr_call(Arena *arena, Expr *callee, Expr *args, const char *end);
+
 /**
  * \brief Creates a new node representing an expression statement.
  * \param arena arena allocator from which the node will be allocated
@@ -235,6 +322,18 @@ Stmt *ast_create_stmt_expr(Arena *arena, Expr *expr);
  */
 Stmt *ast_create_stmt_assignment(Arena *arena, Expr *left, Expr *right);
 
+/**
+ * \brief Creates a new node representing an augmented assignment statement such as `a[i] += x`.
+ *
+ * The target is evaluated only once, so the receiver and index of a subscript target are not computed twice.
+ * \param arena arena allocator from which the node will be allocated
+ * \param left the target of the assignment, an `EXPR_NAME` or `EXPR_SUBSCRIPT` node
+ * \param op the operator combining the current value of the target with the right-hand side
+ * \param right the right-hand side of the assignment
+ * \return the newly allocated node
+ */
+Stmt *ast_create_stmt_aug_assignment(Arena *arena, Expr *left, BinaryOp op, Expr *right);
+
 /**
  * \brief Creates a new node representing a `while` statement.
  * \param arena arena allocator from which the node will be allocated
@@ -244,6 +343,16 @@ Stmt *ast_create_stmt_assignment(Arena *arena, Expr *left, Expr *right);
  */
 Stmt *ast_create_stmt_while(Arena *arena, Expr *condition, Stmt *body);
 
+/**
+ * \brief Creates a new node representing a `for` statement.
+ * \param arena arena allocator from which the node will be allocated
+ * \param target the variable assigned the items, an `EXPR_NAME` node
+ * \param iterable the object whose items are iterated
+ * \param body the body of the loop
+ * \return the newly allocated node
+ */
+Stmt *ast_create_stmt_for(Arena *arena, Expr *target, Expr *iterable, Stmt *body);
+
 /**
  * \brief Creates a new node representing an `if` statement.
  * \param arena arena allocator from which the node will be allocated
@@ -283,6 +392,24 @@ const char *ast_get_expr_start(const Expr *expr);
  */
 const char *ast_get_expr_end(const Expr *expr);
 
+/**
+ * \brief Returns a position on the first line of the given statement in the source code.
+ *
+ * The statement nodes do not store their position, the position of their first expression is used instead. For an
+ * assignment, it is the start of the assigned value, which is in the source code also for the assignments created
+ * by the optimizer.
+ * \param stmt the statement
+ * \return pointer into the source code, NULL for `STMT_PASS`
+ */
+const char *ast_get_stmt_position(const Stmt *stmt);
+
+/**
+ * \brief Returns the name of a binary operator, as used in the AST dump.
+ * \param op the binary operator
+ * \return the name of the operator
+ */
+const char *ast_get_binary_op_name(BinaryOp op);
+
 /**
  * \brief Dumps the AST tree to a string builder.
  * \param sb string builder to which the AST will be dumped
@@ -0,0 +1,320 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file compact_ast.h
+ * \brief Compact, index-based representation of the abstract syntax tree.
+ *
+ * The compact AST holds the same information as the pointer-based AST from ast.h, but the nodes are stored
+ * in contiguous arrays (one array per field, i.e. as a structure of arrays) and refer to each other using 32-bit
+ * indices instead of pointers. Positions in the source code are stored as 32-bit offsets from the start of the
+ * source code. A node thus takes 17 bytes instead of 40 or 48 bytes, and the nodes of a tree built in the usual
+ * order (children before parents) are laid out sequentially.
+ *
+ * Expression and statement nodes are kept in separate arrays and have separate indices. Each node has a kind,
+ * the index of the next node in the sequence (`AST_NONE` if it is the last one) and three 32-bit fields whose
+ * meaning depends on the kind of the node:
+ *
+ * | Kind                                    | `a`           | `b`           | `c`                            |
+ * |-----------------------------------------|---------------|---------------|--------------------------------|
+ * | `EXPR_INT_LITERAL`, `EXPR_STR_LITERAL`  | start offset  | end offset    | index in the literal pool      |
+ * | `EXPR_LIST_LITERAL`                     | start offset  | end offset    | head of the elements           |
+ * | `EXPR_DICT_LITERAL`                     | start offset  | end offset    | head of the keys and values    |
+ * | `EXPR_NAME`                             | start offset  | end offset    | slot of the variable           |
+ * | `EXPR_BINARY`                           | left operand  | right operand | operator                       |
+ * | `EXPR_SUBSCRIPT`                        | receiver      | index         | end offset                     |
+ * | `EXPR_SLICE`                            | receiver      | lower bound   | upper bound                    |
+ * | `EXPR_CALL`                             | callee        | head of args  | end offset                     |
+ * | `STMT_EXPR`, `STMT_PRINT`               | expression    | unused        | unused                         |
+ * | `STMT_ASSIGNMENT`                       | left side     | right side    | unused                         |
+ * | `STMT_AUG_ASSIGNMENT`                   | left side     | right side    | operator                       |
+ * | `STMT_WHILE`                            | condition     | head of body  | unused                         |
+ * | `STMT_FOR`                              | target        | iterable      | head of body                   |
+ * | `STMT_IF`                               | condition     | head of then  | head of else                   |
+ * | `STMT_PASS`                             | unused        | unused        | unused                         |
+ *
+ * Omitted bounds of a slice are `AST_NONE`. The end offset of a slice does not fit, so `EXPR_SLICE` nodes occupy two
+ * consecutive slots, the `a` field of the second one holds the end offset. Similarly, `STMT_FOR` nodes occupy two
+ * consecutive slots, the `a` field of the second one holds the first hidden slot of the iteration state.
+ *
+ * The tree can be built directly using the `compact_ast_add_*` functions, which mirror the `ast_create_*`
+ * functions, or converted from the pointer-based AST produced by `parse_file()`.
+ */
+
+#ifndef COMPACT_AST_H
+#define COMPACT_AST_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "natrix/parser/ast.h"
+#include "natrix/util/sb.h"
+
+//! Index of a node in the compact AST.
+typedef uint32_t AstId;
+
+//! Index representing no node, e.g. the end of a sequence or an empty list.
+#define AST_NONE UINT32_MAX
+
+/**
+ * \brief Array of nodes of the same category (expressions or statements) in the structure-of-arrays layout.
+ */
+typedef struct {
+    uint8_t *kind;                  //!< Kind of each node, `ExprKind` or `StmtKind`
+    AstId *next;                    //!< Next node in the sequence
+    uint32_t *a;                    //!< First field of each node, see the table in compact_ast.h
+    uint32_t *b;                    //!< Second field of each node
+    uint32_t *c;                    //!< Third field of each node
+    uint32_t count;                 //!< Number of nodes
+    uint32_t capacity;              //!< Capacity of the arrays
+} AstNodes;
+
+/**
+ * \brief The compact AST.
+ *
+ * The arrays are reallocated as nodes are added, so pointers into them must not be kept across additions.
+ */
+typedef struct {
+    const char *base;               //!< Start of the source code, offsets are relative to it
+    AstNodes exprs;                 //!< Expression nodes
+    AstNodes stmts;                 //!< Statement nodes
+} CompactAst;
+
+/**
+ * \brief Initializes an empty compact AST.
+ * \param base start of the source code, e.g. `Source.start`, all positions are relative to it
+ * \return the initialized compact AST
+ */
+CompactAst compact_ast_init(const char *base);
+
+/**
+ * \brief Frees the memory of the compact AST.
+ * \param ast the compact AST
+ */
+void compact_ast_free(CompactAst *ast);
+
+/**
+ * \brief Adds a node representing an integer literal.
+ * \param ast the compact AST
+ * \param start pointer to the start of the integer literal in the source code
+ * \param end pointer to the character after the end of the integer literal
+ * \return index of the new node
+ */
+AstId compact_ast_add_expr_int_literal(CompactAst *ast, const char *start, const char *end);
+
+/**
+ * \brief Adds a node representing a string literal.
+ * \param ast the compact AST
+ * \param start pointer to the start of the string literal in the source code
+ * \param end pointer to the character after the end of the string literal
+ * \return index of the new node
+ */
+AstId compact_ast_add_expr_str_literal(CompactAst *ast, const char *start, const char *end);
+
+/**
+ * \brief Adds a node representing a list literal.
+ * \param ast the compact AST
+ * \param start pointer to the start of the list literal in the source code
+ * \param end pointer to the character after the end of the list literal
+ * \param head the first element of the list, `AST_NONE` if the list is empty
+ * \return index of the new node
+ */
+AstId compact_ast_add_expr_list_literal(CompactAst *ast, const char *start, const char *end, AstId head);
+
+/**
+ * \brief Adds a node representing a dictionary literal.
+ * \param ast the compact AST
+ * \param start pointer to the start of the dictionary literal in the source code
+ * \param end pointer to the character after the end of the dictionary literal
+ * \param head the first key, followed by its value and the other keys and values, `AST_NONE` if the dictionary is empty
+ * \return index of the new node
+ */
+AstId compact_ast_add_expr_dict_literal(CompactAst *ast, const char *start, const char *end, AstId head);
+
+/**
+ * \brief Adds a node representing a name.
+ * \param ast the compact AST
+ * \param start pointer to the start of the identifier in the source code
+ * \param end pointer to the character after the end of the identifier
+ * \return index of the new node
+ */
+AstId compact_ast_add_expr_name(CompactAst *ast, const char *start, const char *end);
+
+/**
+ * \brief Adds a node representing a binary operation.
+ * \param ast the compact AST
+ * \param left left operand
+ * \param op binary operator
+ * \param right right operand
+ * \return index of the new node
+ */
+AstId compact_ast_add_expr_binary(CompactAst *ast, AstId left, BinaryOp op, AstId right);
+
+/**
+ * \brief Adds a node representing a subscript operation.
+ * \param ast the compact AST
+ * \param receiver receiver of the subscript operation
+ * \param index index of the subscript operation
+ * \param end pointer to the character after the closing bracket
+ * \return index of the new node
+ */
+AstId compact_ast_add_expr_subscript(CompactAst *ast, AstId receiver, AstId index, const char *end);
+
+/**
+ * \brief Adds a node representing a slice operation.
+ * \param ast the compact AST
+ * \param receiver receiver of the slice operation
+ * \param lower lower bound of the slice, `AST_NONE` if omitted
+ * \param upper upper bound of the slice, `AST_NONE` if omitted
+ * \param end pointer to the character after the closing bracket
+ * \return index of the new node
+ */
+AstId compact_ast_add_expr_slice(CompactAst *ast, AstId receiver, AstId lower, AstId upper, const char *end);
+
+/**
+ * \brief Adds a node representing a function call.
+ * \param ast the compact AST
+ * \param callee name of the called function, an `EXPR_NAME` node
+ * \param args head of the arguments, `AST_NONE` if there are none
+ * \param end pointer to the character after the closing parenthesis
+ * \return index of the new node
+ */
+AstId compact_ast_add_expr_call(CompactAst *ast, AstId callee, AstId args, const char *end);
+
+/**
+ * \brief Adds a node representing an expression statement.
+ * \param ast the compact AST
+ * \param expr expression to be used as the statement
+ * \return index of the new node
+ */
+AstId compact_ast_add_stmt_expr(CompactAst *ast, AstId expr);
+
+/**
+ * \brief Adds a node representing an assignment statement.
+ * \param ast the compact AST
+ * \param left the left-hand side of the assignment
+ * \param right the right-hand side of the assignment
+ * \return index of the new node
+ */
+AstId compact_ast_add_stmt_assignment(CompactAst *ast, AstId left, AstId right);
+
+/**
+ * \brief Adds a node representing an augmented assignment statement.
+ * \param ast the compact AST
+ * \param left the target of the assignment
+ * \param op the operator combining the current value of the target with the right-hand side
+ * \param right the right-hand side of the assignment
+ * \return index of the new node
+ */
+AstId compact_ast_add_stmt_aug_assignment(CompactAst *ast, AstId left, BinaryOp op, AstId right);
+
+/**
+ * \brief Adds a node representing a `while` statement.
+ * \param ast the compact AST
+ * \param condition the condition of the loop
+ * \param body the first statement of the body of the loop
+ * \return index of the new node
+ */
+AstId compact_ast_add_stmt_while(CompactAst *ast, AstId condition, AstId body);
+
+/**
+ * \brief Adds a node representing a `for` statement.
+ * \param ast the compact AST
+ * \param target the variable assigned the items, an `EXPR_NAME` node
+ * \param iterable the object whose items are iterated
+ * \param body the first statement of the body of the loop
+ * \return index of the new node
+ */
+AstId compact_ast_add_stmt_for(CompactAst *ast, AstId target, AstId iterable, AstId body);
+
+/**
+ * \brief Adds a node representing an `if` statement.
+ * \param ast the compact AST
+ * \param condition the condition of the `if` statement
+ * \param then_body the first statement of the true branch
+ * \param else_body the first statement of the false branch, use `STMT_PASS` if there is no `else` branch
+ * \return index of the new node
+ */
+AstId compact_ast_add_stmt_if(CompactAst *ast, AstId condition, AstId then_body, AstId else_body);
+
+/**
+ * \brief Adds a node representing an empty statement.
+ * \param ast the compact AST
+ * \return index of the new node
+ */
+AstId compact_ast_add_stmt_pass(CompactAst *ast);
+
+/**
+ * \brief Adds a node representing a `print` statement.
+ * \param ast the compact AST
+ * \param expr expression to be printed
+ * \return index of the new node
+ */
+AstId compact_ast_add_stmt_print(CompactAst *ast, AstId expr);
+
+/**
+ * \brief Sets the expression following the given one in a sequence (e.g. elements of a list literal).
+ * \param ast the compact AST
+ * \param expr the expression
+ * \param next the next expression
+ */
+void compact_ast_set_next_expr(CompactAst *ast, AstId expr, AstId next);
+
+/**
+ * \brief Sets the statement following the given one in a sequence.
+ * \param ast the compact AST
+ * \param stmt the statement
+ * \param next the next statement
+ */
+void compact_ast_set_next_stmt(CompactAst *ast, AstId stmt, AstId next);
+
+/**
+ * \brief Adds a copy of a sequence of statements of the pointer-based AST, including all their children.
+ *
+ * Resolved slots and literal indices are copied as well.
+ * \param ast the compact AST, its base must be the start of the source code the statements were parsed from
+ * \param stmt the first statement of the sequence, can be NULL
+ * \return index of the first statement of the copy, `AST_NONE` if `stmt` is NULL
+ */
+AstId compact_ast_add_stmts(CompactAst *ast, const Stmt *stmt);
+
+/**
+ * \brief Returns the start position of the given expression node in the source code.
+ * \param ast the compact AST
+ * \param expr the expression node
+ * \return pointer to the start of the expression in the source code
+ */
+const char *compact_ast_get_expr_start(const CompactAst *ast, AstId expr);
+
+/**
+ * \brief Returns the end position of the given expression node in the source code.
+ * \param ast the compact AST
+ * \param expr the expression node
+ * \return pointer to the character after the end of the expression in the source code
+ */
+const char *compact_ast_get_expr_end(const CompactAst *ast, AstId expr);
+
+/**
+ * \brief Returns the number of bytes used by the nodes, excluding unused capacity.
+ * \param ast the compact AST
+ * \return the number of bytes
+ */
+size_t compact_ast_get_size(const CompactAst *ast);
+
+/**
+ * \brief Dumps a sequence of statements to a string builder, in the same format as `ast_dump()`.
+ * \param sb string builder to which the AST will be dumped
+ * \param ast the compact AST
+ * \param stmt the first statement of the sequence
+ */
+void compact_ast_dump(StringBuilder *sb, const CompactAst *ast, AstId stmt);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //COMPACT_AST_H
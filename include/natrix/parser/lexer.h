@@ -40,6 +40,7 @@ extern "C" {
 typedef struct {
     const char *start;                      //!< Start of the current token
     const char *current;                    //!< Current character
+    const char *end;                        //!< The null terminator of the source code
     const char *error_message;              //!< Error message or NULL if no error occurred
     size_t indent_stack[MAX_INDENT_STACK];  //!< Stack of indentation levels
     int indent_stack_size;                  //!< Number of entries in the indentation stack
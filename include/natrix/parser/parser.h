@@ -22,8 +22,14 @@ extern "C" {
 #include "natrix/parser/ast.h"
 #include "natrix/parser/diag.h"
 
+//! Maximum depth of nested expressions, i.e. of parentheses, brackets, braces, subscripts and call arguments.
+#define PARSER_MAX_NESTING 1000
+
 /**
  * \brief Parses a natrix source.
+ *
+ * The identifiers and the integer and string literals of the tree refer to interned symbols allocated in the arena
+ * (see symbol.h), equal texts within the source share a symbol.
  * \param arena memory arena to allocate the abstract syntax tree nodes from
  * \param source source code to parse
  * \param diag_handler diagnostics handler for reporting errors
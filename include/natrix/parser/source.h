@@ -25,8 +25,12 @@ extern "C" {
  * Upon creation, the source code is read from a file or a string, all line endings are normalized to `\n`,
  * a newline is appended to the end of the source code unless already present, the string is null-terminated,
  * and the end pointer is set to the null terminator.
- * The structure contains copies of the filename and the source code and needs to be freed with `source_free`.
+ * The structure contains a copy of the filename and either a copy of the source code or, for files which already use
+ * only `\n`, a private memory mapping of the file. It needs to be freed with `source_free`.
  * The members should not be modified directly, use the provided functions instead.
+ *
+ * A `Source` may also hold only a part of a file, the statements read by a `SourceStream` (see `source_stream.h`).
+ * Such a source is owned by the stream, and its line numbers are those of the whole file.
  */
 typedef struct {
     const char *filename;     //!< Name of the file containing the source code
@@ -34,12 +38,15 @@ typedef struct {
     const char *end;          //!< Pointer to the null terminator of the source code
     const char **line_starts; //!< Array of pointers to the start of each line
     size_t line_count;        //!< Number of lines in the source code
+    size_t mapping_size;      //!< Size of the memory mapping containing the source code, 0 if it is a copy
+    size_t first_line;        //!< Number of lines of the file preceding the source code, 0 unless streamed
 } Source;
 
 /**
  * \brief Initializes the source code from a file.
  *
- * The file is read into memory and the source code is normalized as described in the structure documentation.
+ * The file is mapped into memory if it contains no `\r`, otherwise it is read into memory and the source code is
+ * normalized as described in the structure documentation.
  * If the file cannot be read, the function sets all members of the source structure to NULL or zero.
  * \param filename the name of the file containing the source code
  * \return the initialized source code (filled with NULLs if the file cannot be read)
@@ -73,7 +80,8 @@ size_t source_get_line_number(Source *source, const char *position);
 /**
  * \brief Returns the start of the given line in the source code.
  * \param source the source code
- * \param line the 1-based line number, must be between 1 and `source->line_count`, inclusive
+ * \param line the 1-based line number, must be between `source->first_line + 1` and
+ *             `source->first_line + source->line_count`, inclusive
  * \return pointer to the start of the line
  */
 const char *source_get_line_start(Source *source, size_t line);
@@ -81,7 +89,8 @@ const char *source_get_line_start(Source *source, size_t line);
 /**
  * \brief Returns the end of the given line in the source code.
  * \param source the source code
- * \param line the 1-based line number, must be between 1 and `source->line_count`, inclusive
+ * \param line the 1-based line number, must be between `source->first_line + 1` and
+ *             `source->first_line + source->line_count`, inclusive
  * \return pointer to the newline character or the null terminator at the end of the line
  */
 const char *source_get_line_end(Source *source, size_t line);
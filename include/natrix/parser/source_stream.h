@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file source_stream.h
+ * \brief Reading of a source file a few top-level statements at a time.
+ *
+ * The stream reads the file in chunks into a buffer and splits it after top-level statements, so that a program
+ * can be parsed and executed before the rest of the file is read. A top-level statement starts with a line which
+ * is not indented, its body (the indented lines) and the `elif` and `else` clauses of an `if` belong to it. Since
+ * neither strings nor parentheses span lines, the boundaries of the statements can be found without tokenizing.
+ *
+ * Each call to `source_stream_next()` returns the complete top-level statements which start in the next chunk of the
+ * file, at least one even if it is larger than a chunk, as a `Source` whose line numbers are those of the whole file.
+ * The buffer holds only these statements and the text read ahead, so its size is bounded by the size of the largest
+ * statement plus the chunk size rather than by the size of the file. Line endings are normalized and a newline
+ * is appended at the end of the file as by `source_from_file()`. Unlike `source_from_file()`, the stream can also
+ * read from pipes and other files which are not regular.
+ */
+
+#ifndef SOURCE_STREAM_H
+#define SOURCE_STREAM_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "natrix/parser/source.h"
+
+//! Default number of bytes read from the file at once.
+#define SOURCE_STREAM_DEFAULT_CHUNK_SIZE (64 * 1024)
+
+/**
+ * \brief State of a stream.
+ *
+ * The members should not be accessed directly, only through the functions below, except for `source`.
+ */
+typedef struct {
+    int fd;                     //!< File descriptor of the file, -1 once the end of the file has been reached
+    char *buffer;               //!< The statements returned last followed by the normalized text read ahead
+    size_t capacity;            //!< Size of `buffer` in bytes
+    size_t length;              //!< Number of bytes of text in `buffer`, followed by a null terminator
+    size_t consumed;            //!< Number of bytes at the start of `buffer` holding the statements returned last
+    size_t chunk_size;          //!< Number of bytes read from the file at once
+    char saved;                 //!< Character of the text read ahead overwritten by the null terminator of `source`
+    bool pending_cr;            //!< The last byte read was `\r`, a `\n` following it must be dropped
+    bool read_any;              //!< At least one byte has been read from the file
+    bool failed;                //!< Reading the file failed
+    Source source;              //!< The statements returned last
+} SourceStream;
+
+/**
+ * \brief Opens a file for streaming.
+ * \param stream the stream to initialize
+ * \param filename the name of the file, copied
+ * \param chunk_size the number of bytes read from the file at once, must be positive
+ * \return false if the file cannot be opened, in which case the stream does not need to be closed
+ */
+bool source_stream_open(SourceStream *stream, const char *filename, size_t chunk_size);
+
+/**
+ * \brief Returns the next top-level statements of the file.
+ *
+ * The returned source code is valid until the next call or until the stream is closed, it must not be freed
+ * with `source_free()`. If the file contains no statement at all, its text (e.g. only comments) is returned
+ * once so that the parser reports the error as for the whole file.
+ * \param stream the stream
+ * \return the statements, NULL at the end of the file or if reading the file failed (see `source_stream_failed()`)
+ */
+Source *source_stream_next(SourceStream *stream);
+
+/**
+ * \brief Determines whether reading the file failed.
+ * \param stream the stream
+ * \return true if `source_stream_next()` returned NULL because of an error rather than the end of the file
+ */
+bool source_stream_failed(const SourceStream *stream);
+
+/**
+ * \brief Closes the file and frees the buffer.
+ * \param stream the stream
+ */
+void source_stream_close(SourceStream *stream);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //SOURCE_STREAM_H
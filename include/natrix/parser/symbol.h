@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file symbol.h
+ * \brief Interned identifiers and literals.
+ *
+ * The parser interns the text of every identifier and integer or string literal into a symbol table, so that all
+ * occurrences of the same text share one `Symbol` with a unique id and a precomputed hash (see hash.h). Later phases
+ * compare symbols by pointer or id instead of comparing the text: the resolver looks up variables by the hash and
+ * creates the value of each distinct literal only once.
+ *
+ * The symbols are allocated in the arena of the syntax tree and live as long as the tree, the table itself is only
+ * needed while the tree is being built.
+ */
+
+#ifndef SYMBOL_H
+#define SYMBOL_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include "natrix/util/arena.h"
+
+/**
+ * \brief Interned text of an identifier or a literal.
+ */
+typedef struct {
+    const char *start;              //!< Start of the first occurrence of the text in the source code
+    size_t length;                  //!< Length of the text
+    uint64_t hash;                  //!< Hash of the text computed by `hash_bytes()`
+    uint32_t id;                    //!< Index of the symbol in the table, the symbols are numbered from zero
+} Symbol;
+
+/**
+ * \brief Hash table of the symbols.
+ */
+typedef struct {
+    Arena *arena;                   //!< Arena in which the symbols are allocated
+    Symbol **buckets;               //!< Open addressing table of the symbols, `NULL` for empty buckets
+    size_t capacity;                //!< Number of buckets, a power of two
+    uint32_t count;                 //!< Number of symbols
+} SymbolTable;
+
+/**
+ * \brief Initializes an empty symbol table.
+ * \param arena the arena in which the symbols are allocated
+ * \return the initialized table
+ */
+SymbolTable symbol_table_init(Arena *arena);
+
+/**
+ * \brief Frees the memory of the table, the symbols stay valid until the arena is freed.
+ * \param table the table
+ */
+void symbol_table_free(SymbolTable *table);
+
+/**
+ * \brief Returns the symbol with the given text, creating it if it does not exist yet.
+ * \param table the table
+ * \param start start of the text, must live as long as the arena
+ * \param length length of the text
+ * \return the symbol
+ */
+const Symbol *symbol_intern(SymbolTable *table, const char *start, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //SYMBOL_H
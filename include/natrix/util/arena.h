@@ -15,8 +15,17 @@
  *
  * The allocator is implemented as a singly linked list of chunks. When the current chunk is full, a new chunk
  * is allocated and added to the end of the list. When the allocator is destroyed, all chunks are deallocated
- * at once. Chunks are 8192 bytes long. If an object is larger than 8192 bytes, a special chunk (exactly sized
- * for the object) is allocated and put to the front of the list.
+ * at once. Chunks are 8192 bytes long by default, the size can be chosen using `arena_init_with_chunk_size()`.
+ * If an object is larger than the chunk size, a special chunk (exactly sized for the object) is allocated and put
+ * to the front of the list.
+ *
+ * The state of the arena can be saved using `arena_mark()` and restored using `arena_rewind()`, which deallocates
+ * all objects allocated since the mark at once. Regular chunks which are no longer used are kept in the list
+ * and reused by subsequent allocations, special chunks are deallocated.
+ *
+ * Regular chunks of destroyed arenas are not returned to the system immediately, they are kept in a pool
+ * (one per thread, of limited size) from which new chunks are taken, so that creating and destroying arenas
+ * repeatedly, e.g. when parsing many small scripts, does not need to call malloc() and free().
  */
 
 #ifndef ARENA_H
@@ -28,6 +37,11 @@ extern "C" {
 #include <stddef.h>
 #include <stdint.h>
 
+//! Default size of a chunk in bytes.
+#define ARENA_DEFAULT_CHUNK_SIZE 8192
+//! Maximum number of free chunks kept in the pool of each thread.
+#define ARENA_POOL_LIMIT 64
+
 /**
  * \brief A chunk of memory from which objects are allocated.
  *
@@ -50,8 +64,19 @@ typedef struct {
     ArenaChunk *first_chunk;    //!< First chunk in the list
     ArenaChunk *current_chunk;  //!< Current chunk where the next allocation will be made
     size_t alloc_count;         //!< Total number of allocations made from this arena
+    size_t chunk_size;          //!< Size of the regular chunks in bytes, excluding headers
 } Arena;
 
+/**
+ * \brief Saved state of an arena, created by `arena_mark` and restored by `arena_rewind`.
+ */
+typedef struct {
+    ArenaChunk *first_chunk;    //!< First chunk at the time of the mark
+    ArenaChunk *current_chunk;  //!< Current chunk at the time of the mark
+    uint8_t *ptr;               //!< Current position in the current chunk at the time of the mark
+    size_t alloc_count;         //!< Number of allocations at the time of the mark
+} ArenaMark;
+
 /**
  * \brief Statistics about the arena allocator, filled by `arena_get_stats`.
  */
@@ -63,15 +88,23 @@ typedef struct {
 } ArenaStats;
 
 /**
- * \brief Initializes the arena allocator.
+ * \brief Initializes the arena allocator with the default chunk size.
  * \return the initialized arena
  */
 Arena arena_init();
 
+/**
+ * \brief Initializes the arena allocator with the given chunk size.
+ * \param chunk_size size of the regular chunks in bytes, must be greater than 0
+ * \return the initialized arena
+ */
+Arena arena_init_with_chunk_size(size_t chunk_size);
+
 /**
  * \brief Destroys the arena allocator and deallocates all memory.
  *
- * All pointers returned by `arena_alloc` become invalid after this function is called.
+ * All pointers returned by `arena_alloc` become invalid after this function is called. Regular chunks are put
+ * to the pool of the current thread unless it is full.
  * \param arena the arena to destroy, must be initialized by `arena_create`
  */
 void arena_free(Arena *arena);
@@ -80,13 +113,44 @@ void arena_free(Arena *arena);
  * \brief Allocates a block of memory from the arena.
  *
  * Never returns NULL. If the allocation fails, the program panics. The memory is not initialized.
- * The returned pointer is aligned to 16 bytes. The pointer is valid until the arena is destroyed.
+ * The returned pointer is aligned to 16 bytes. The pointer is valid until the arena is destroyed,
+ * reset or rewound to a mark created before the allocation.
  * \param arena the arena from which to allocate, must be initialized by `arena_create`
  * \param size size of the block to allocate
  * \return pointer to the allocated block
  */
 void *arena_alloc(Arena *arena, size_t size);
 
+/**
+ * \brief Saves the current state of the arena.
+ * \param arena the arena
+ * \return the mark to be passed to `arena_rewind`
+ */
+ArenaMark arena_mark(const Arena *arena);
+
+/**
+ * \brief Deallocates all objects allocated since the mark was created.
+ *
+ * All pointers returned by `arena_alloc` after the mark was created become invalid. Marks created after `mark`
+ * become invalid as well, while `mark` itself and earlier marks can be used again.
+ * \param arena the arena
+ * \param mark the mark created by `arena_mark` on the same arena
+ */
+void arena_rewind(Arena *arena, ArenaMark mark);
+
+/**
+ * \brief Deallocates all objects, keeping the regular chunks for reuse.
+ *
+ * All pointers returned by `arena_alloc` and all marks become invalid.
+ * \param arena the arena
+ */
+void arena_reset(Arena *arena);
+
+/**
+ * \brief Returns the chunks in the pool of the current thread to the system.
+ */
+void arena_release_pool();
+
 /**
  * \brief Fills the `stats` structure with statistics about the arena.
  * \param arena the arena to get statistics for
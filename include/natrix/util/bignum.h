@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file bignum.h
+ * \brief Arithmetic on arbitrary-precision unsigned integers.
+ *
+ * A number is an array of 64-bit limbs, least significant limb first, together with its length. A number is
+ * normalized if its most significant limb is not zero, zero is represented by the length 0. The functions do not
+ * allocate the results, the caller provides buffers of sufficient size. Unless stated otherwise, the inputs do not
+ * need to be normalized and the results are not normalized, use `bn_normalize()`.
+ */
+
+#ifndef BIGNUM_H
+#define BIGNUM_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include "natrix/util/sb.h"
+
+/**
+ * \brief Returns the length of a number without the most significant zero limbs.
+ * \param a the number
+ * \param n the number of limbs of `a`
+ * \return the length of the normalized number
+ */
+size_t bn_normalize(const uint64_t *a, size_t n);
+
+/**
+ * \brief Compares two normalized numbers.
+ * \param a the first number
+ * \param an the number of limbs of `a`
+ * \param b the second number
+ * \param bn the number of limbs of `b`
+ * \return negative if `a < b`, zero if `a == b`, positive if `a > b`
+ */
+int bn_compare(const uint64_t *a, size_t an, const uint64_t *b, size_t bn);
+
+/**
+ * \brief Computes `r = a + b`.
+ * \param r the result, `an` limbs, may be the same as `a`
+ * \param a the first number
+ * \param an the number of limbs of `a`
+ * \param b the second number
+ * \param bn the number of limbs of `b`, at most `an`
+ * \return the carry out of the most significant limb
+ */
+uint64_t bn_add(uint64_t *r, const uint64_t *a, size_t an, const uint64_t *b, size_t bn);
+
+/**
+ * \brief Computes `r = a - b`.
+ * \param r the result, `an` limbs, may be the same as `a`
+ * \param a the first number
+ * \param an the number of limbs of `a`
+ * \param b the second number
+ * \param bn the number of limbs of `b`, at most `an`
+ * \return the borrow out of the most significant limb, 0 if `a >= b`
+ */
+uint64_t bn_sub(uint64_t *r, const uint64_t *a, size_t an, const uint64_t *b, size_t bn);
+
+/**
+ * \brief Computes `r = r * m + c` in place.
+ * \param r the number
+ * \param n the number of limbs of `r`
+ * \param m the multiplier
+ * \param c the addend
+ * \return the limb carried out of the most significant limb
+ */
+uint64_t bn_mul_limb(uint64_t *r, size_t n, uint64_t m, uint64_t c);
+
+/**
+ * \brief Computes `r = a * b`.
+ *
+ * Uses Karatsuba multiplication for large operands. May allocate temporary buffers.
+ * \param r the result, `an + bn` limbs, must not overlap the operands
+ * \param a the first number
+ * \param an the number of limbs of `a`
+ * \param b the second number
+ * \param bn the number of limbs of `b`
+ */
+void bn_mul(uint64_t *r, const uint64_t *a, size_t an, const uint64_t *b, size_t bn);
+
+/**
+ * \brief Computes `q = a / d` for a single-limb divisor.
+ * \param q the quotient, `n` limbs, may be the same as `a`
+ * \param a the dividend
+ * \param n the number of limbs of `a`
+ * \param d the divisor, must not be zero
+ * \return the remainder
+ */
+uint64_t bn_div_limb(uint64_t *q, const uint64_t *a, size_t n, uint64_t d);
+
+/**
+ * \brief Computes the quotient and the remainder of `a / b`.
+ *
+ * May allocate temporary buffers.
+ * \param q the quotient, `an - bn + 1` limbs, must not overlap the operands, can be NULL if not needed
+ * \param r the remainder, `bn` limbs, must not overlap the operands, can be NULL if not needed
+ * \param a the dividend
+ * \param an the number of limbs of `a`, at least `bn`
+ * \param b the divisor, must be normalized and not zero
+ * \param bn the number of limbs of `b`
+ */
+void bn_divmod(uint64_t *q, uint64_t *r, const uint64_t *a, size_t an, const uint64_t *b, size_t bn);
+
+/**
+ * \brief Parses a number from its decimal representation.
+ * \param r the result, at least `length / 19 + 1` limbs
+ * \param str the decimal digits, without sign
+ * \param length the number of digits
+ * \return the length of the normalized result
+ */
+size_t bn_from_decimal(uint64_t *r, const char *str, size_t length);
+
+/**
+ * \brief Appends the decimal representation of a number to a string builder.
+ *
+ * May allocate temporary buffers.
+ * \param sb the string builder
+ * \param a the number
+ * \param n the number of limbs of `a`
+ */
+void bn_append_decimal(StringBuilder *sb, const uint64_t *a, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //BIGNUM_H
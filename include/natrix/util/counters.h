@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file counters.h
+ * \brief Counters of internal events whose number depends only on the program, not on the machine.
+ *
+ * The counters belong to the current thread and are always counting. They are incremented where a table or an array
+ * grows or memory is allocated, never on the hot paths of the interpreters, so the cost is negligible. The values are
+ * reported by `natrix --count` (see exec_counts.h) as the difference between the start and the end of the program.
+ */
+
+#ifndef COUNTERS_H
+#define COUNTERS_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/**
+ * \brief Counted events.
+ */
+typedef enum {
+    COUNTER_ENV_PROBES,         //!< Buckets of the index of the variable names probed by `env_declare_hashed()`
+    COUNTER_ARRAY_COPIES,       //!< Object arrays copied by `nx_object_array_copy()`, i.e. growths of lists
+    COUNTER_ARENA_CHUNKS,       //!< Chunks allocated by arenas, not counting those reused from the pool
+    COUNTER_COUNT,
+} Counter;
+
+//! Names of the counted events, indexed by `Counter`.
+extern const char *const COUNTER_NAMES[COUNTER_COUNT];
+
+#ifndef __cplusplus
+//! Values of the counters of the current thread, indexed by `Counter`.
+extern _Thread_local uint64_t counter_values[COUNTER_COUNT];
+
+/**
+ * \brief Counts occurrences of an event in the current thread.
+ * \param counter the event
+ * \param n the number of occurrences
+ */
+static inline void counter_add(Counter counter, uint64_t n) {
+    counter_values[counter] += n;
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif //COUNTERS_H
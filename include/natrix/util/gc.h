@@ -9,21 +9,63 @@
  * \file gc.h
  * \brief Memory management with garbage collection.
  *
- * The garbage collector is a simple mark-and-sweep algorithm. All objects are allocated using malloc().
- * The garbage collector keeps track of all allocated objects using a singly linked list.
- * It also keeps a stack of roots, which are pointers to objects that are known to be reachable.
- * When malloc() fails, or the number of allocated objects exceeds a certain threshold, the garbage collector is invoked.
- * In the mark phase, the garbage collector performs a depth-first search starting from the roots, marking all reachable objects.
- * In the sweep phase, the garbage collector iterates over all allocated objects, freeing (using free()) those that are not marked.
- * After garbage collection, if the number of surviving objects is still above or near the threshold, the threshold is increased.
- * In order to be able to find all allocated objects, the garbage collector needs to know about all pointers in all objects.
- * Each object has a pointer to a function which is called by the garbage collector during the mark phase
- * to find all pointers in the object. The function must call gc_visit() for each pointer in the object.
- * Every allocated object needs to be reachable from a root, otherwise it will be collected. This means that
- * after allocating an object, the pointer to it needs to be either written to another reachable object or added to the
- * stack of roots before any garbage collection can occur, i.e. before the next allocation.
- * The stack of roots is implemented as a fixed-size array of pointers. Rooting and unrooting must be done in a LIFO manner.
- * The garbage collector is not thread-safe.
+ * The garbage collector is a generational mark-and-sweep algorithm. Objects are never moved. Mark bits are "sticky":
+ * they are not cleared after a collection, so a marked object is an object which survived a collection, i.e. an object
+ * in the old generation.
+ *
+ * Generations: allocations are accounted in bytes. When the number of bytes allocated since the last collection
+ * exceeds the young generation size, a minor collection is performed. It marks only young (unmarked) objects, starting
+ * from the roots and from the remembered set, which contains old objects that may point to young objects, so its cost
+ * is proportional to the number of surviving young objects, not to the size of the heap. When the size of the old
+ * generation exceeds the heap threshold, or when malloc() fails, a major collection clears all mark bits and marks all
+ * reachable objects. Afterwards, the heap threshold is set to the size of the surviving objects multiplied by the
+ * growth factor, but never below the initial heap size nor above the maximum heap size (see `GcPolicy`).
+ *
+ * Slabs and bitmaps: small objects are allocated using the slab allocator (see slab.h), which keeps their mark bits in
+ * side bitmaps. Larger objects are allocated using malloc() and linked through a hidden prefix allocated in front of
+ * them. The header of an object is a single 64-bit word holding its flags and the id of its class (see `GcClassId`),
+ * the classes are kept in a table shared by all heaps.
+ *
+ * Sweep: a collection only marks objects. Unmarked small objects are freed lazily, one slab at a time, when the slab is
+ * about to be used for allocation again, thus the pause time depends only on the mark work. Optionally
+ * (see `GcPolicy.background_sweep`), a background thread frees the unreachable large objects and sweeps the slabs
+ * ahead of the allocator while the interpreter continues.
+ *
+ * Marking: the class of an object provides a function which finds all pointers in the object by calling gc_visit() for
+ * each of them. gc_visit() marks the object and pushes it onto an explicit mark stack drained by the collector, so the
+ * depth of the C stack does not depend on the shape of the object graph; if the mark stack cannot grow, the collector
+ * falls back to rescanning the marked objects. Large arrays of pointers should be visited by gc_visit_array(), which
+ * allows the collector to split them into chunks. Major collections can mark using several threads
+ * (see `GcPolicy.mark_threads`), each with its own work-stealing deque and setting mark bits atomically, so trace
+ * functions must not modify any state other than by calling gc_visit() or gc_visit_array().
+ *
+ * Incremental marking (see `GcPolicy.pause_budget_us`): the mark phase of a major collection is split into slices of
+ * bounded duration interleaved with the allocations. Objects allocated in the meantime are not marked, and pointers
+ * written to already marked objects are marked by the write barrier. The roots are marked again in a short final
+ * pause. No minor collections are performed while the incremental mark phase is in progress.
+ *
+ * Roots and barriers: every allocated object needs to be reachable from a root before the next allocation, i.e. its
+ * pointer must be written to another reachable object or pushed to the stack of roots. The stack of roots is a
+ * growable array of pointers (a shadow stack) used in a LIFO manner; gc_scope_begin() and gc_scope_end() release all
+ * objects rooted in a scope at once. A pointer written to an object which existed before the last allocation must be
+ * reported by gc_write_barrier(), so that old objects pointing to young objects are added to the remembered set (or,
+ * during incremental marking, the young object gets marked). Rooted structures which are not allocated by the garbage
+ * collector do not need the barrier. Optionally, the C stack can be scanned conservatively
+ * (see gc_set_stack_bottom()): with `ENABLE_CONSERVATIVE_GC`, every word on the stack which looks like a pointer into
+ * a live object keeps it alive and temporaries are not rooted by nxo_root().
+ *
+ * Immediate values: pointers with the least significant bit set encode values such as small integers. They can be
+ * passed to gc_visit(), gc_root() and gc_unroot(), which ignore them.
+ *
+ * Heaps: each heap has its own objects, roots, policy and statistics and is collected independently
+ * (see `gc_state_create()`). All functions operate on the current heap of the calling thread, the main heap unless
+ * the thread has switched using `gc_state_switch()`. A heap must be used by one thread at a time. Objects must never
+ * point to objects of another heap, except to permanently marked static objects without pointers.
+ *
+ * Snapshots: objects can also live in an image mapped from a heap snapshot (see snapshot.h). They are permanently
+ * marked and never freed, and their pages stay shared with the file until written. The first pointer written to an
+ * image object adds it to a list of dirty image objects traced as roots by every collection, so the collector never
+ * scans the clean part of the image.
  */
 
 #ifndef GC_H
@@ -32,44 +74,132 @@
 extern "C" {
 #endif
 
+#include <assert.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
+#include "natrix/util/slab.h"
+
+//! Bits of a pointer which, if any of them is set, mark an immediate value instead of a pointer to an object.
+#define GC_IMMEDIATE_TAG_MASK 1
+//! Mark bit of objects which are not allocated from slabs.
+#define GC_FLAG_MARK ((uint32_t) 1)
+//! Flag in `GcHeader.mark` set on objects allocated from slabs, their mark bits are kept in the slab.
+#define GC_FLAG_SLAB ((uint32_t) 2)
+//! Flag in `GcHeader.mark` set on objects allocated using malloc(), which are linked through their hidden prefix.
+#define GC_FLAG_LARGE ((uint32_t) 4)
+//! Flag in `GcHeader.mark` set on old objects which are in the remembered set.
+#define GC_FLAG_REMEMBERED ((uint32_t) 8)
+//! Flag in `GcHeader.mark` set on objects mapped from a heap snapshot, which are never collected.
+#define GC_FLAG_IMAGE ((uint32_t) 16)
 
 /**
  * \brief Type of the function for tracing pointers in an object.
  *
- * Every object has a pointer to a function of this type, assigned upon creation of the object.
- * The function is called by the garbage collector during the mark phase.
+ * The function is provided by the class of the object and called by the garbage collector during the mark phase.
  * The function must call gc_visit() for each pointer in the object.
  */
 typedef void (*GcTraceFn)(void *ptr);
 
+/**
+ * \brief Identifies the class of an object, i.e. the layout of its pointers, in the table of classes.
+ *
+ * Ids below `GC_FIRST_DYNAMIC_CLASS` are fixed at compile time, so that statically allocated objects can refer
+ * to them, and must be defined using `gc_define_class()` before any object of the class is allocated or traced.
+ * Other ids are assigned by `gc_register_class()`.
+ */
+typedef uint32_t GcClassId;
+
+//! Class of objects which contain no pointers, always defined.
+#define GC_CLASS_LEAF ((GcClassId) 0)
+//! First id assigned by `gc_register_class()`, lower ids are reserved for classes with fixed ids.
+#define GC_FIRST_DYNAMIC_CLASS ((GcClassId) 32)
+//! Maximum number of classes.
+#define GC_MAX_CLASSES ((GcClassId) 256)
+
 /**
  * \brief Header of all GC-allocated objects, it must be the first field of every object.
  */
 typedef struct GcHeader {
-    union {
-        struct GcHeader *next;      //!< Pointer to the next object in the linked list
-        uintptr_t mark;             //!< The least significant bit is used as the mark bit
-    };
-    GcTraceFn trace_fn;             //!< Function to trace pointers in the object, never NULL
+    uint32_t mark;                  //!< The mark bit and flags
+    GcClassId class_id;             //!< Class of the object
 } GcHeader;
 
+/**
+ * \brief Determines whether the pointer encodes an immediate value instead of pointing to an object.
+ * \param ptr the pointer
+ * \return true if the pointer is tagged as an immediate value
+ */
+static inline bool gc_is_immediate(const void *ptr) {
+    return ((uintptr_t) ptr & GC_IMMEDIATE_TAG_MASK) != 0;
+}
+
+/**
+ * \brief Defines a class with an id fixed at compile time.
+ *
+ * Defining the same class again has no effect.
+ * \param id the id of the class, less than `GC_FIRST_DYNAMIC_CLASS`
+ * \param trace_fn function to trace pointers in the objects, can be NULL if the objects do not contain any pointers
+ * \param name name of the class, statically allocated, NULL if unknown
+ */
+void gc_define_class(GcClassId id, GcTraceFn trace_fn, const char *name);
+
+/**
+ * \brief Returns the id of a class, registering it if it has not been registered yet.
+ *
+ * Classes are identified by the pair of the trace function and the name, so registering the same class again returns
+ * the same id. Can be called from multiple threads. Panics if there are too many classes.
+ * \param trace_fn function to trace pointers in the objects, can be NULL if the objects do not contain any pointers
+ * \param name name of the class, statically allocated, NULL if unknown
+ * \return the id of the class
+ */
+GcClassId gc_register_class(GcTraceFn trace_fn, const char *name);
+
 /**
  * \brief Allocates memory for an object of the given size.
  *
  * Never returns NULL, panics if the necessary memory cannot be allocated even after garbage collection.
  * \param size_in_bytes size of the object in bytes, including the header
- * \param trace_fn function to trace pointers in the object, can be NULL if the object does not contain any pointers
- * \return pointer to the allocated object
+ * \param class_id the class of the object, its name is reported to the allocation tracker (see `GcAllocTracker`)
+ * \return pointer to the allocated object with initialized header
+ */
+GcHeader *gc_alloc(size_t size_in_bytes, GcClassId class_id);
+
+/**
+ * \brief The stack of roots.
+ *
+ * Exposed only to allow inlining of the rooting functions, must not be accessed directly.
+ */
+typedef struct {
+    GcHeader **items;               //!< Rooted objects
+    size_t count;                   //!< Number of rooted objects
+    size_t capacity;                //!< Capacity of the `items` array
+} GcRootStack;
+
+//! The stack of roots of the current heap of the calling thread.
+extern __thread GcRootStack gc_root_stack;
+
+/**
+ * \brief Identifies the depth of the root stack at the beginning of a scope.
  */
-GcHeader *gc_alloc(size_t size_in_bytes, GcTraceFn trace_fn);
+typedef size_t GcScope;
+
+/**
+ * \brief Grows the stack of roots so that at least one more root fits.
+ */
+void gc_grow_roots();
 
 /**
  * \brief Roots an object, preventing it from being collected by the garbage collector.
  * \param root pointer to the object to root
  */
-void gc_root(GcHeader *root);
+static inline void gc_root(GcHeader *root) {
+    if (gc_root_stack.count == gc_root_stack.capacity) {
+        gc_grow_roots();
+    }
+    gc_root_stack.items[gc_root_stack.count++] = root;
+}
 
 /**
  * \brief Unroots an object, allowing it to be collected by the garbage collector.
@@ -77,16 +207,266 @@ void gc_root(GcHeader *root);
  *
  * The object must be the last object rooted, it is passed as a parameter only to check that this is the case.
  */
-void gc_unroot(GcHeader *root);
+static inline void gc_unroot(GcHeader *root) {
+    (void) root;
+    assert(gc_root_stack.count > 0);
+    assert(gc_root_stack.items[gc_root_stack.count - 1] == root);
+    gc_root_stack.count--;
+}
 
 /**
- * \brief Marks an object and all objects reachable from it.
- * \param ptr pointer to the object to visit, can be NULL
+ * \brief Opens a scope of roots.
+ * \return the scope to be passed to `gc_scope_end()`
+ */
+static inline GcScope gc_scope_begin() {
+    return gc_root_stack.count;
+}
+
+/**
+ * \brief Unroots all objects rooted since the corresponding call to `gc_scope_begin()`.
+ * \param scope the scope returned by `gc_scope_begin()`
+ */
+static inline void gc_scope_end(GcScope scope) {
+    assert(scope <= gc_root_stack.count);
+    gc_root_stack.count = scope;
+}
+
+/**
+ * \brief Enables or disables conservative scanning of the C stack.
+ *
+ * Registers are spilled to the stack before scanning, so pointers held only in registers are found as well.
+ * \param bottom the highest address of the stack to scan, e.g. the frame address of main(), NULL disables scanning
+ */
+void gc_set_stack_bottom(const void *bottom);
+
+/**
+ * \brief Marks an object and schedules it for tracing, so that all objects reachable from it get marked.
+ * \param ptr pointer to the object to visit, can be NULL or an immediate value
  */
 void gc_visit(GcHeader *ptr);
 
 /**
- * \brief Runs the garbage collector explicitly.
+ * \brief Visits all objects in an array of pointers.
+ *
+ * Equivalent to calling gc_visit() for each element, but during parallel marking large arrays are split
+ * into chunks which can be traced by different threads.
+ * \param items the array of pointers, which can be NULL or immediate values
+ * \param count the number of elements in the array
+ */
+void gc_visit_array(GcHeader *const *items, size_t count);
+
+/**
+ * \brief Slow path of gc_write_barrier(), called when a pointer to an unmarked object is written to a marked one.
+ *
+ * Adds the old object to the remembered set or, during incremental marking, marks the value (Dijkstra's
+ * insertion barrier), so that no object reachable only from an already traced object remains unmarked.
+ * An object of a snapshot image is instead added permanently to the list of dirty image objects on the first write.
+ * \param obj pointer to the marked object being modified
+ * \param value the unmarked object written to `obj`
+ */
+void gc_write_barrier_slow(GcHeader *obj, GcHeader *value);
+
+/**
+ * \brief Removes the objects of a snapshot image from the list of dirty image objects before the image is unmapped.
+ *
+ * The objects of the image must no longer be reachable from the current heap.
+ * \param start the first byte of the image
+ * \param size the size of the image in bytes
+ */
+void gc_forget_image(const void *start, size_t size);
+
+/**
+ * \brief Parameters controlling when garbage collection is performed.
+ */
+typedef struct {
+    size_t young_size;              //!< Number of bytes allocated between two minor collections
+    size_t initial_heap_size;       //!< Initial and minimal size of the old generation triggering a major collection
+    double growth_factor;           //!< Ratio of the heap threshold to the size of the live objects, at least 1
+    size_t max_heap_size;           //!< Maximum size of all objects in bytes, zero means unlimited
+    unsigned mark_threads;          //!< Number of threads marking the heap in a major collection, at least 1
+    bool background_sweep;          //!< Whether to sweep in a background thread instead of lazily by the allocator
+    unsigned pause_budget_us;       //!< Maximum duration of an incremental marking slice in microseconds, zero
+                                    //!< disables incremental marking
+    SlabRegionPolicy regions;       //!< How the memory of the slabs is reserved and returned to the system
+} GcPolicy;
+
+//! Default size of the young generation in bytes.
+#define GC_DEFAULT_YOUNG_SIZE ((size_t) 256 * 1024)
+//! Default initial heap threshold in bytes.
+#define GC_DEFAULT_INITIAL_HEAP_SIZE ((size_t) 4 * 1024 * 1024)
+//! Default heap growth factor.
+#define GC_DEFAULT_GROWTH_FACTOR 2.0
+//! Default number of marking threads.
+#define GC_DEFAULT_MARK_THREADS 1
+//! Whether sweeping is done in a background thread by default.
+#define GC_DEFAULT_BACKGROUND_SWEEP false
+//! Default pause budget of incremental marking, major collections are not incremental by default.
+#define GC_DEFAULT_PAUSE_BUDGET_US 0
+
+/**
+ * \brief Returns the default policy of the garbage collector.
+ * \return the default policy
+ */
+GcPolicy gc_default_policy();
+
+/**
+ * \brief Returns the current policy of the garbage collector.
+ * \return the current policy
+ */
+GcPolicy gc_get_policy();
+
+/**
+ * \brief Changes the policy of the garbage collector.
+ *
+ * Panics if the policy is invalid, i.e. if `young_size` or `mark_threads` is zero, `growth_factor` is less than 1 or
+ * the region size is not a multiple of `SLAB_SIZE`. The region policy applies to regions reserved afterwards.
+ * \param policy the new policy
+ */
+void gc_set_policy(const GcPolicy *policy);
+
+/**
+ * \brief State of a heap, opaque outside of the garbage collector.
+ */
+typedef struct GcState GcState;
+
+/**
+ * \brief Creates a new empty heap.
+ *
+ * Panics if the policy is invalid.
+ * \param policy the policy of the collector of the heap, NULL for the default policy
+ * \return the state of the heap, to be destroyed by `gc_state_destroy()`
+ */
+GcState *gc_state_create(const GcPolicy *policy);
+
+/**
+ * \brief Frees all objects of a heap and the heap itself.
+ *
+ * The heap must not be current on any thread. The main heap cannot be destroyed.
+ * \param state the state of the heap created by `gc_state_create()`
+ */
+void gc_state_destroy(GcState *state);
+
+/**
+ * \brief Makes a heap current on the calling thread.
+ *
+ * The stack of roots of the previous heap is saved and the stack of roots of the new heap is restored.
+ * \param state the state of the heap, NULL selects the main heap
+ * \return the state of the previous heap, to be passed to `gc_state_switch()` to switch back
+ */
+GcState *gc_state_switch(GcState *state);
+
+//! Number of buckets of the pause time histogram.
+#define GC_PAUSE_HISTOGRAM_SIZE 16
+
+/**
+ * \brief Kinds of garbage collection pauses.
+ */
+typedef enum {
+    GC_PAUSE_MINOR,                 //!< Minor collection
+    GC_PAUSE_MAJOR,                 //!< Major collection, or the final pause of an incremental one
+    GC_PAUSE_INCREMENTAL,           //!< Start or a slice of an incremental mark phase
+} GcPauseKind;
+
+/**
+ * \brief Cumulative statistics of the garbage collector, filled by `gc_get_stats()`.
+ */
+typedef struct {
+    uint64_t minor_collections;     //!< Number of minor collections
+    uint64_t major_collections;     //!< Number of completed major collections, including incremental ones
+    uint64_t pause_count;           //!< Number of pauses, including the slices of incremental marking
+    uint64_t total_pause_ns;        //!< Total duration of all pauses in nanoseconds
+    uint64_t max_pause_ns;          //!< Duration of the longest pause in nanoseconds
+    uint64_t allocated_bytes;       //!< Number of bytes allocated, as accounted by the collector
+    uint64_t allocated_objects;     //!< Number of objects allocated
+    uint64_t freed_bytes;           //!< Number of bytes of objects found unreachable
+    uint64_t marked_objects;        //!< Number of objects marked by all collections, i.e. found reachable
+    //! High-water mark of the heap, the largest number of bytes allocated at the start of a pause or when the
+    //! statistics were read, the heap only grows between pauses
+    uint64_t peak_heap_bytes;
+    //! Number of pauses by duration, bucket 0 counts pauses shorter than 1 µs, bucket `i` pauses from `2^(i-1)`
+    //! up to `2^i` µs, the last bucket also counts all longer pauses
+    uint64_t pause_histogram[GC_PAUSE_HISTOGRAM_SIZE];
+} GcStats;
+
+/**
+ * \brief Information about a single garbage collection pause, passed to the `GcCallback`.
+ */
+typedef struct {
+    GcPauseKind kind;               //!< Kind of the pause
+    uint64_t duration_ns;           //!< Duration of the pause in nanoseconds
+    size_t freed_bytes;             //!< Number of bytes of objects found unreachable during the pause
+    size_t heap_bytes;              //!< Number of bytes of objects which remain allocated after the pause
+} GcEvent;
+
+/**
+ * \brief Type of the function called after each garbage collection pause.
+ *
+ * The function must not allocate objects using the garbage collector.
+ */
+typedef void (*GcCallback)(const GcEvent *event, void *data);
+
+/**
+ * \brief Observer of the allocations of a heap, used by the allocation profiler.
+ *
+ * While a tracker is set, the collector records each allocated object with the tag returned by `alloc`. In the
+ * first collection after the allocation, i.e. when the object stops being young, it reports to `collect` whether
+ * the object survived. Neither function may allocate objects using the garbage collector.
+ */
+typedef struct {
+    //! Called after an object is allocated, returns a tag identifying the allocation, e.g. its site
+    uint32_t (*alloc)(void *data, size_t size_in_bytes, const char *type_name);
+    //! Called for each tagged object in the first collection after its allocation
+    void (*collect)(void *data, uint32_t tag, size_t size_in_bytes, bool survived);
+    void *data;                     //!< Arbitrary pointer passed to the functions
+} GcAllocTracker;
+
+/**
+ * \brief Fills the `stats` structure with the statistics collected since the start of the program.
+ * \param stats the structure to fill with statistics
+ */
+void gc_get_stats(GcStats *stats);
+
+/**
+ * \brief Sets the function to be called after each garbage collection pause.
+ * \param callback the function, NULL to disable the notifications
+ * \param data arbitrary pointer passed to the callback
+ */
+void gc_set_callback(GcCallback callback, void *data);
+
+/**
+ * \brief Sets the observer of the allocations of the current heap.
+ *
+ * Objects allocated before the tracker is removed but not collected yet are not reported.
+ * \param tracker the tracker, copied, NULL to stop tracking
+ */
+void gc_set_alloc_tracker(const GcAllocTracker *tracker);
+
+/**
+ * \brief Determines whether the object is marked, i.e. whether it is in the old generation outside of a collection.
+ * \param obj pointer to the object
+ * \return true if the object is marked
+ */
+static inline bool gc_is_marked(const GcHeader *obj) {
+    return (obj->mark & GC_FLAG_SLAB) ? slab_is_marked(obj) : (obj->mark & GC_FLAG_MARK) != 0;
+}
+
+/**
+ * \brief Reports that a pointer to `value` was written to the object `obj`.
+ *
+ * Must be called after every pointer write to a GC-allocated object, unless the object was allocated after
+ * the last possible garbage collection (i.e. since the last allocation).
+ * \param obj pointer to the object being modified
+ * \param value the pointer written to the object, can be NULL or an immediate value
+ */
+static inline void gc_write_barrier(GcHeader *obj, const GcHeader *value) {
+    if (value != NULL && !gc_is_immediate(value) && !(obj->mark & GC_FLAG_REMEMBERED)
+            && ((obj->mark & GC_FLAG_IMAGE) || (gc_is_marked(obj) && !gc_is_marked(value)))) {
+        gc_write_barrier_slow(obj, (GcHeader *) value);
+    }
+}
+
+/**
+ * \brief Runs a full garbage collection explicitly.
  *
  * There is usually no need to call this function manually, as the garbage collector is invoked automatically.
  * However, it can be useful to call this function manually in order to free memory as soon as possible after a large
@@ -94,14 +474,76 @@ void gc_visit(GcHeader *ptr);
  */
 void gc_collect();
 
+/**
+ * \brief Runs a minor garbage collection of the young generation explicitly.
+ *
+ * Used in the unit tests, minor collections are normally invoked automatically. If an incremental mark phase is in
+ * progress, it is completed instead.
+ */
+void gc_collect_minor();
+
+/**
+ * \brief Performs a slice of the incremental mark phase explicitly.
+ *
+ * Completes the collection if no marking work is left. Does nothing if no incremental mark phase is in progress.
+ * Used in the unit tests, slices are normally performed automatically by gc_alloc().
+ */
+void gc_collect_step();
+
+//! Number of the largest objects whose retention paths are reported by `gc_dump_heap()`.
+#define GC_HEAP_DUMP_LARGEST 10
 
 /**
- * \brief Tracing function for objects that do not contain any pointers. Does nothing.
+ * \brief Type of the function naming the pointers in an object for heap dumps.
  * \param ptr pointer to the object
+ * \param edge index of the pointer, i.e. the number of gc_visit() calls preceding it when the object is traced
+ * \param length receives the length of the name
+ * \return the name, not necessarily null-terminated, or NULL if the pointer has no name
  */
-static inline void gc_trace_nop(void *ptr) {
-    (void) ptr;
-}
+typedef const char *(*GcEdgeNameFn)(const void *ptr, size_t edge, size_t *length);
+
+/**
+ * \brief Sets the function naming the pointers in the objects of a class, used in retention paths of heap dumps.
+ * \param class_id the class
+ * \param edge_name the function, NULL if the pointers have no names
+ */
+void gc_set_edge_namer(GcClassId class_id, GcEdgeNameFn edge_name);
+
+/**
+ * \brief Performs a full collection of the current heap and writes a report of the live objects as JSON.
+ *
+ * The report is a single line holding an object with the total number (`objects`) and size (`bytes`) of the live
+ * objects, their number and size per class sorted by decreasing size (`classes`) and the `GC_HEAP_DUMP_LARGEST`
+ * largest objects with their retention paths from the roots (`largest`). If `objects` is true, it also lists every
+ * live object (`heap`) with its address, class, size and the object which retains it, so that two dumps of the same
+ * run can be diffed to find the objects which keep accumulating. Objects are never moved, so an address identifies
+ * the same object in both dumps as long as it stays alive.
+ * \param out the file to write the report to
+ * \param objects whether to list all live objects
+ */
+void gc_dump_heap(FILE *out, bool objects);
+
+/**
+ * \brief Sets the file to which heap dumps requested by `gc_request_heap_dump()` are appended.
+ * \param path the path of the file, copied, NULL disables the requested dumps
+ */
+void gc_set_heap_dump_path(const char *path);
+
+/**
+ * \brief Requests a heap dump including all objects, async-signal-safe.
+ *
+ * The dump is performed by the next thread which reaches a collection trigger in gc_alloc(), or by the signal
+ * target of the safepoints at its next loop back-edge (see safepoint.h), and appended to the file set by
+ * `gc_set_heap_dump_path()`.
+ */
+void gc_request_heap_dump();
+
+/**
+ * \brief Performs the work requested from the collector at a safepoint, i.e. a pending heap dump.
+ *
+ * May trigger garbage collection, all live objects must be reachable from the roots.
+ */
+void gc_safepoint();
 
 #ifdef __cplusplus
 }
@@ -19,31 +19,258 @@
 extern "C" {
 #endif
 
-//! Determines whether the object is marked as reachable during the garbage collection.
-#define IS_MARKED(p)    ((p)->mark & 1)
-//! Marks the object as reachable during the mark phase of garbage collection.
-#define MARK(p)         ((p)->mark |= 1)
-//! Unmarks the object during the sweep phase of garbage collection.
-#define UNMARK(p)       ((p)->mark &= ~1)
-//! The maximum number of roots.
-#define MAX_ROOTS 64
+#include "natrix/util/gc.h"
+#include "natrix/util/mem.h"
+
+//! Determines whether the object which is not allocated from a slab is marked.
+#define IS_MARKED(p)    ((p)->mark & GC_FLAG_MARK)
+//! Marks the object which is not allocated from a slab.
+#define MARK(p)         ((p)->mark |= GC_FLAG_MARK)
+//! Unmarks the object which is not allocated from a slab.
+#define UNMARK(p)       ((p)->mark &= ~GC_FLAG_MARK)
+//! Determines whether the object is allocated by the garbage collector (as opposed to a static or stack object).
+#define IS_HEAP(p)      (((p)->mark & (GC_FLAG_SLAB | GC_FLAG_LARGE)) != 0)
+//! Determines whether the object is mapped from a heap snapshot.
+#define IS_IMAGE(p)     (((p)->mark & GC_FLAG_IMAGE) != 0)
+//! Returns the next object in the list of large objects.
+#define GC_NEXT(p)      (gc_large_prefix(p)->next)
+//! Sets the next object in the list of large objects.
+#define GC_SET_NEXT(p, n) (gc_large_prefix(p)->next = (n))
+//! Size of the hidden prefix of large objects.
+#define LARGE_PREFIX_SIZE NX_ALIGN_UP(sizeof(GcLargePrefix))
+//! Number of elements of an array traced at once by a marking thread, the rest of the array can be stolen.
+#define GC_MARK_CHUNK 256
+//! Number of objects traced by an incremental marking slice between two checks of the elapsed time.
+#define GC_SLICE_CHECK_INTERVAL 64
+//! Default maximum number of entries in the mark stack.
+#define GC_DEFAULT_MARK_STACK_LIMIT ((size_t) 1 << 24)
 
 /**
- * \brief Internal state of the garbage collector, exposed for testing purposes.
+ * \brief Hidden prefix allocated in front of each large object.
+ */
+typedef struct {
+    GcHeader *next;                 //!< Next object in the list of large objects of the heap
+    size_t size;                    //!< Size of the object in bytes, excluding the prefix
+} GcLargePrefix;
+
+/**
+ * \brief Returns the hidden prefix of a large object.
+ * \param ptr pointer to the large object
+ * \return the prefix
+ */
+static inline GcLargePrefix *gc_large_prefix(const GcHeader *ptr) {
+    return (GcLargePrefix *) ((char *) ptr - LARGE_PREFIX_SIZE);
+}
+
+/**
+ * \brief Entry of the table of classes.
  */
 typedef struct {
-    GcHeader *head;                 //!< Head of the linked list of all allocated objects
-    size_t objects_count;           //!< Number of allocated objects
-    size_t threshold;               //!< Threshold of `objects_count` after which the garbage collection is triggered
-    size_t roots_count;             //!< Number of roots
-    GcHeader *roots[MAX_ROOTS];     //!< Stack of roots
-} GcState;
+    GcTraceFn trace_fn;             //!< Function to trace pointers in the objects, NULL if they have none
+    const char *name;               //!< Name of the class, NULL if unknown
+    GcEdgeNameFn edge_name;         //!< Function naming the pointers in the objects for heap dumps, can be NULL
+    bool defined;                   //!< Whether the class has been defined or registered
+} GcClass;
+
+//! The table of classes, indexed by `GcClassId`, shared by all heaps.
+extern GcClass gc_classes[GC_MAX_CLASSES];
+
+/**
+ * \brief Returns the trace function of the class of an object.
+ * \param ptr pointer to the object
+ * \return the trace function, NULL if the object contains no pointers
+ */
+static inline GcTraceFn gc_trace_fn_of(const GcHeader *ptr) {
+    assert(ptr->class_id < GC_MAX_CLASSES && gc_classes[ptr->class_id].defined);
+    return gc_classes[ptr->class_id].trace_fn;
+}
+
+/**
+ * \brief Traces the pointers in an object.
+ * \param ptr pointer to the object
+ */
+static inline void gc_trace(GcHeader *ptr) {
+    GcTraceFn trace_fn = gc_trace_fn_of(ptr);
+    if (trace_fn) {
+        trace_fn(ptr);
+    }
+}
+
+/**
+ * \brief Object recorded for the allocation tracker until the next collection.
+ */
+typedef struct {
+    GcHeader *obj;                  //!< The object
+    size_t size;                    //!< Size of the object in bytes
+    uint32_t tag;                   //!< Tag returned by `GcAllocTracker.alloc`
+} GcTrackedObject;
+
+//! State of the background sweeper, see `gc_sweeper_start()`.
+typedef struct GcSweeper GcSweeper;
+
+//! Recorder of the objects marked during a heap dump, see `gc_heap_walk_create()`.
+typedef struct GcHeapWalk GcHeapWalk;
+
+/**
+ * \brief Internal state of the garbage collector, exposed for testing purposes.
+ */
+struct GcState {
+    GcHeader *large;                //!< Head of the list of objects not allocated from slabs, see `GC_NEXT()`
+    GcPolicy policy;                //!< Parameters of the collector
+    size_t young_bytes;             //!< Number of bytes allocated since the last collection
+    size_t old_bytes;               //!< Number of bytes which survived a collection since the last major collection
+    size_t old_threshold;           //!< Threshold of `old_bytes` after which a major collection is triggered
+    size_t marked_bytes;            //!< Number of bytes marked in the current collection
+    bool minor;                     //!< Whether a minor collection is in progress
+    bool parallel;                  //!< Whether a parallel mark phase is in progress
+    bool marking;                   //!< Whether an incremental mark phase is in progress
+    GcHeader **remembered;          //!< Old objects which may contain pointers to young objects
+    size_t remembered_count;        //!< Number of objects in the remembered set
+    size_t remembered_capacity;     //!< Capacity of the `remembered` array
+    GcHeader **image_dirty;         //!< Objects of snapshot images which have been written, traced as roots
+    size_t image_dirty_count;       //!< Number of objects in `image_dirty`
+    size_t image_dirty_capacity;    //!< Capacity of the `image_dirty` array
+    GcHeader **mark_stack;          //!< Marked objects which have not been traced yet
+    size_t mark_stack_count;        //!< Number of objects in the mark stack
+    size_t mark_stack_capacity;     //!< Capacity of the `mark_stack` array
+    size_t mark_stack_limit;        //!< Maximum capacity of the `mark_stack` array
+    bool mark_stack_overflow;       //!< Whether a marked object could not be pushed onto the mark stack
+    const void *stack_bottom;       //!< Highest address of the C stack to scan conservatively, NULL if disabled
+    GcHeader **stack_roots;         //!< Objects found by scanning the C stack in the current collection
+    size_t stack_roots_count;       //!< Number of objects in `stack_roots`
+    size_t stack_roots_capacity;    //!< Capacity of the `stack_roots` array
+    GcStats stats;                  //!< Statistics, `allocated_bytes` does not include `young_bytes`
+    GcCallback callback;            //!< Function called after each pause, can be NULL
+    void *callback_data;            //!< Data passed to `callback`
+    GcAllocTracker tracker;         //!< Observer of the allocations, `tracker.alloc` is NULL if none
+    GcTrackedObject *tracked;       //!< Objects allocated since the last collection while the tracker was set
+    size_t tracked_count;           //!< Number of objects in `tracked`
+    size_t tracked_capacity;        //!< Capacity of the `tracked` array
+    SlabHeap *slabs;                //!< Slabs of the heap, NULL for the main heap
+    GcSweeper *sweeper;             //!< Background sweeper, NULL until the first background sweep
+    GcRootStack roots;              //!< Stack of roots while the heap is not current, see `gc_state_switch()`
+    GcHeapWalk *walk;               //!< Recorder of the marked objects during a heap dump, NULL otherwise
+};
 
 /**
  * \brief Provides access to the internal state of the garbage collector for testing purposes.
+ * \return the state of the current heap of the calling thread
  */
 GcState *gc_get_internal_state();
 
+/**
+ * \brief Makes a heap current on the calling thread without switching the stack of roots.
+ *
+ * Used by the threads of the collector which work on behalf of the thread owning the heap.
+ * \param state the state of the heap
+ */
+void gc_bind_state(GcState *state);
+
+/**
+ * \brief Returns the size of a heap object in bytes, as accounted by the collector.
+ * \param ptr pointer to the object allocated by `gc_alloc()`
+ * \return size of the object in bytes
+ */
+static inline size_t gc_object_size(const GcHeader *ptr) {
+    if (ptr->mark & GC_FLAG_SLAB) {
+        return slab_of(ptr)->cell_size;
+    }
+    return gc_large_prefix(ptr)->size;
+}
+
+/**
+ * \brief Marks the heap using multiple threads.
+ *
+ * The `seed` function is called on the current thread with `GcState.parallel` set, it should visit the roots.
+ * The objects it visits are then traced by all threads. Objects which could not be pushed onto a deque are left
+ * marked but not traced and `GcState.mark_stack_overflow` is set. The number of marked bytes is added to
+ * `GcState.marked_bytes`. If the worker threads cannot be started, `seed` is called in sequential mode.
+ * \param thread_count the number of threads, including the current one
+ * \param seed function which visits the roots
+ */
+void gc_parallel_mark(unsigned thread_count, void (*seed)());
+
+/**
+ * \brief Parallel version of gc_visit(), must be called only during the parallel mark phase.
+ * \param ptr pointer to the object, not NULL nor an immediate value
+ */
+void gc_parallel_visit(GcHeader *ptr);
+
+/**
+ * \brief Parallel version of gc_visit_array(), must be called only during the parallel mark phase.
+ * \param items the array of pointers
+ * \param count the number of elements in the array
+ */
+void gc_parallel_visit_array(GcHeader *const *items, size_t count);
+
+/**
+ * \brief Starts sweeping in the background thread.
+ *
+ * Must be called after `slab_start_sweep()`. If the thread cannot be created, the large objects are freed
+ * immediately and the slabs are left to be swept lazily.
+ * \param dead list of unreachable large objects to free, linked using `GC_NEXT()`
+ */
+void gc_sweeper_start(GcHeader *dead);
+
+/**
+ * \brief Stops the background sweep and waits for the sweeper thread to become idle.
+ *
+ * Slabs which have not been swept yet remain to be swept lazily. Must be called before the slabs are released
+ * or a new sweep epoch is started. Does nothing if no background sweep has been started.
+ */
+void gc_sweeper_wait();
+
+/**
+ * \brief Terminates the sweeper thread of the current heap and frees the state of the sweeper.
+ *
+ * An unfinished background sweep is cancelled first. Does nothing if no background sweep has been started.
+ */
+void gc_sweeper_stop();
+
+/**
+ * \brief Creates a recorder of the object graph for a heap dump.
+ *
+ * While the recorder is set as `GcState.walk`, the collector reports each visited pointer, each object it marks and
+ * each object it starts tracing. Parallel marking must not be used.
+ * \return the recorder, to be destroyed by `gc_heap_walk_destroy()`
+ */
+GcHeapWalk *gc_heap_walk_create();
+
+/**
+ * \brief Frees the recorder of the object graph.
+ * \param walk the recorder
+ */
+void gc_heap_walk_destroy(GcHeapWalk *walk);
+
+/**
+ * \brief Counts a pointer visited by the object being traced, called by gc_visit() for every pointer.
+ * \param walk the recorder
+ */
+void gc_heap_walk_edge(GcHeapWalk *walk);
+
+/**
+ * \brief Records an object marked for the first time, reached through the last pointer counted by
+ * `gc_heap_walk_edge()`.
+ * \param walk the recorder
+ * \param obj the object
+ */
+void gc_heap_walk_add(GcHeapWalk *walk, GcHeader *obj);
+
+/**
+ * \brief Records that the collector starts tracing an object.
+ * \param walk the recorder
+ * \param obj the object
+ */
+void gc_heap_walk_enter(GcHeapWalk *walk, GcHeader *obj);
+
+/**
+ * \brief Writes the report of the live objects recorded after the mark phase, see `gc_dump_heap()`.
+ * \param walk the recorder
+ * \param out the file to write the JSON document to
+ * \param objects whether to include the list of all objects
+ */
+void gc_heap_walk_write(const GcHeapWalk *walk, FILE *out, bool objects);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file hash.h
+ * \brief Hash function of byte sequences.
+ *
+ * The strings (see `nx_str_get_hash()`), the interned symbols of the parser and the names of the variables use the
+ * same hash, so that a hash computed once for a name is valid for all of them.
+ */
+
+#ifndef HASH_H
+#define HASH_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+//! Initial value of the 64-bit FNV-1a hash.
+#define HASH_FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+
+//! Multiplier of the 64-bit FNV-1a hash.
+#define HASH_FNV_PRIME 0x100000001b3ULL
+
+/**
+ * \brief Computes the 64-bit FNV-1a hash of bytes, except that 0 is replaced by 1.
+ *
+ * The hash is never 0, so that 0 can mean that a hash has not been computed yet.
+ * \param data the bytes
+ * \param length the number of bytes
+ * \return the hash, never 0
+ */
+static inline uint64_t hash_bytes(const void *data, size_t length) {
+    const unsigned char *bytes = (const unsigned char *) data;
+    uint64_t hash = HASH_FNV_OFFSET_BASIS;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ bytes[i]) * HASH_FNV_PRIME;
+    }
+    return hash != 0 ? hash : 1;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif //HASH_H
@@ -64,6 +64,16 @@ void *nx_alloc_no_panic(size_t size_in_bytes);
  */
 void *nx_realloc(void *ptr, size_t new_size_in_bytes);
 
+/**
+ * \brief Reallocates a block of memory using the system allocator.
+ *
+ * Unlike `nx_realloc`, this function may return NULL, in which case the original block is left intact.
+ * \param ptr a pointer to the block to reallocate
+ * \param new_size_in_bytes the new size of the block, must be greater than 0
+ * \return a pointer to the reallocated block or NULL if the allocation fails
+ */
+void *nx_realloc_no_panic(void *ptr, size_t new_size_in_bytes);
+
 /**
  * \brief Frees a block of memory allocated using `nx_alloc`.
  *
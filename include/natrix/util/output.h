@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file output.h
+ * \brief Buffered standard output of the programs.
+ *
+ * The output of the `print` statement bypasses `stdio`: it is collected in a buffer (one per thread) and written to
+ * the standard output file descriptor with `write()` or `writev()` when the buffer is full, when the program finishes
+ * and before the process panics. Data larger than the buffer is written directly, together with the buffered data.
+ * If the standard output is a terminal, the buffer is also flushed at the end of each line.
+ *
+ * The output is not synchronized with `stdout`, code mixing both must flush one before using the other. A thread which
+ * has written output should call `output_release()` before it exits.
+ *
+ * A thread can also capture its output in memory, e.g. to send it elsewhere (see `output_begin_capture()`).
+ */
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+//! Default size of the output buffer in bytes.
+#define OUTPUT_DEFAULT_BUFFER_SIZE (64 * 1024)
+
+//! Maximum number of characters of a formatted 64-bit integer, including the sign.
+#define OUTPUT_INT64_MAX_LENGTH 20
+
+/**
+ * \brief Sets the size of the output buffers.
+ *
+ * Flushes and frees the buffer of the calling thread, the new size applies to buffers allocated afterwards.
+ * \param size the size of the buffer in bytes, must be greater than zero
+ */
+void output_set_buffer_size(size_t size);
+
+/**
+ * \brief Formats a 64-bit integer in decimal.
+ * \param buf receives the characters, not null-terminated, at least `OUTPUT_INT64_MAX_LENGTH` bytes
+ * \param value the integer
+ * \return the number of characters
+ */
+size_t output_format_int64(char *buf, int64_t value);
+
+/**
+ * \brief Appends data to the output.
+ * \param data the data
+ * \param length the length of the data in bytes
+ */
+void output_write(const char *data, size_t length);
+
+/**
+ * \brief Appends a 64-bit integer formatted in decimal to the output.
+ * \param value the integer
+ */
+void output_write_int64(int64_t value);
+
+/**
+ * \brief Appends a newline to the output.
+ */
+void output_end_line();
+
+/**
+ * \brief Writes the buffered output of the calling thread.
+ *
+ * Write errors other than interrupted system calls discard the buffered data, as `stdio` would.
+ */
+void output_flush();
+
+/**
+ * \brief Flushes and frees the buffer of the calling thread.
+ */
+void output_release();
+
+/**
+ * \brief Starts keeping the output of the calling thread in memory instead of writing it.
+ *
+ * Flushes the buffered output first. While capturing, the buffer grows as needed and `output_flush()` does nothing.
+ */
+void output_begin_capture();
+
+/**
+ * \brief Stops capturing the output of the calling thread and returns the captured data.
+ * \param length receives the number of bytes captured
+ * \return the captured data, valid until the next output of the calling thread
+ */
+const char *output_end_capture(size_t *length);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //OUTPUT_H
@@ -8,6 +8,11 @@
 /**
  * \file panic.h
  * \brief Macro for aborting the program with a message.
+ *
+ * A thread can recover from panics by installing a handler (see `panic_push_handler()`), `panic()` then jumps back
+ * to the handler instead of exiting. The code between the handler and the panic is abandoned in the middle: its locks
+ * stay held, its roots stay on the root stack and its memory is not freed, so the state it was working with must be
+ * discarded, e.g. the whole isolate running the program (see `nx_isolate_discard()`).
  */
 
 #ifndef PANIC_H
@@ -16,8 +21,22 @@
 extern "C" {
 #endif
 
+#include <setjmp.h>
+
+//! Size of the buffer receiving the message of a recovered panic, including the terminating null character.
+#define PANIC_MESSAGE_SIZE 256
+
+/**
+ * \brief A point to which the calling thread returns when it panics, instead of exiting the program.
+ */
+typedef struct PanicHandler {
+    jmp_buf jump;                       //!< Initialized by `setjmp()`, `panic()` jumps to it with the value 1
+    char message[PANIC_MESSAGE_SIZE];   //!< The message of the panic, truncated to fit
+    struct PanicHandler *prev;          //!< The handler installed before, NULL if none
+} PanicHandler;
+
 /**
- * \brief Prints a message to stderr and exits the program.
+ * \brief Prints a message to stderr and exits the program, or recovers at the panic handler of the calling thread.
  *
  * This macro is used in situations where the program reaches an unrecoverable state.
  * \param fmt format string, as in printf
@@ -26,7 +45,33 @@ extern "C" {
 #define PANIC(fmt, ...) panic(__LINE__, __FILE__, __func__, fmt, ##__VA_ARGS__)
 
 /**
- * \brief Prints a message to stderr and exits the program.
+ * \brief Installs a panic handler for the calling thread.
+ *
+ * The handler must be initialized by `setjmp()` right after the call, in a function which stays active until the
+ * handler is removed:
+ *
+ *     PanicHandler handler;
+ *     panic_push_handler(&handler);
+ *     if (setjmp(handler.jump) == 0) {
+ *         ...
+ *         panic_pop_handler(&handler);
+ *     } else {
+ *         // handler.message holds the message, the handler has been removed
+ *     }
+ * \param handler the handler
+ */
+void panic_push_handler(PanicHandler *handler);
+
+/**
+ * \brief Removes the most recently installed panic handler of the calling thread.
+ * \param handler the handler, must be the most recently installed one
+ */
+void panic_pop_handler(PanicHandler *handler);
+
+/**
+ * \brief Prints a message to stderr and exits the program, or jumps to the panic handler of the calling thread.
+ *
+ * The handler is removed before the jump, so a panic during the recovery goes to the enclosing handler.
  * \param line line number
  * \param file file name
  * \param func function name
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file perf_counters.h
+ * \brief Hardware performance counters of the calling process.
+ *
+ * The counters are opened with `perf_event_open()` and count the events in user space of the calling thread and of
+ * the threads it creates afterwards, e.g. the marking threads of the garbage collector. Opening a counter fails if
+ * the kernel does not permit it (see `/proc/sys/kernel/perf_event_paranoid`) or the hardware does not provide it,
+ * such counters are reported as not available. On other platforms than Linux no counter is available.
+ */
+
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * \brief Events counted by the performance counters.
+ */
+typedef enum {
+    PERF_COUNTER_INSTRUCTIONS,      //!< Retired instructions
+    PERF_COUNTER_CYCLES,            //!< CPU cycles
+    PERF_COUNTER_CACHE_MISSES,      //!< Last level cache misses
+    PERF_COUNTER_BRANCH_MISSES,     //!< Mispredicted branches
+    PERF_COUNTER_COUNT,
+} PerfCounter;
+
+/**
+ * \brief Set of open performance counters.
+ */
+typedef struct {
+    int fds[PERF_COUNTER_COUNT];    //!< File descriptors of the counters, -1 for those which are not available
+} PerfCounters;
+
+//! Names of the counted events, indexed by `PerfCounter`.
+extern const char *const PERF_COUNTER_NAMES[PERF_COUNTER_COUNT];
+
+/**
+ * \brief Opens and starts the counters.
+ * \param counters receives the counters
+ * \return true if at least one counter is available
+ */
+bool perf_counters_start(PerfCounters *counters);
+
+/**
+ * \brief Stops the counters, their values can still be read.
+ * \param counters the counters
+ */
+void perf_counters_stop(const PerfCounters *counters);
+
+/**
+ * \brief Reads the value of a counter.
+ * \param counters the counters
+ * \param counter the counter to read
+ * \param value receives the number of events counted while the counters were running
+ * \return true if the counter is available
+ */
+bool perf_counters_read(const PerfCounters *counters, PerfCounter counter, uint64_t *value);
+
+/**
+ * \brief Closes the counters.
+ * \param counters the counters
+ */
+void perf_counters_close(PerfCounters *counters);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //PERF_COUNTERS_H
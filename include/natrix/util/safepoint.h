@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file safepoint.h
+ * \brief Cooperative safepoints polled at the loop back-edges.
+ *
+ * Work which must not run at an arbitrary instruction, such as stopping a program whose CPU time budget has been
+ * exhausted or dumping the heap on a signal, is requested by setting a bit in the safepoint word of the thread
+ * executing the program. The interpreters poll the word at every loop back-edge, which is a single load and a
+ * predictable branch (a load and a compare in the code of the loop compiler), and call `safepoint_handle()` only if
+ * a request is pending. Since every long-running program goes through a back-edge, a request is served within one
+ * iteration of the innermost loop.
+ *
+ * Requests can be made from other threads and from signal handlers. Since a signal handler does not know which thread
+ * executes the program, the process has one signal target, see `safepoint_set_signal_target()`.
+ *
+ * An interrupt is sticky: it stays pending after it has been handled, so that all enclosing loops and callers stop as
+ * well, until it is cleared by `safepoint_clear_interrupt()`.
+ */
+
+#ifndef SAFEPOINT_H
+#define SAFEPOINT_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//! Request to stop the execution of the program.
+#define SAFEPOINT_INTERRUPT ((uint32_t) 1)
+
+//! Request to perform the heap dump requested by `gc_request_heap_dump()`.
+#define SAFEPOINT_HEAP_DUMP ((uint32_t) 2)
+
+/**
+ * \brief Interrupt word of a thread.
+ */
+typedef struct {
+    volatile uint32_t requests;     //!< Bitwise OR of the pending `SAFEPOINT_*` requests, accessed atomically
+} Safepoint;
+
+/**
+ * \brief Returns the safepoint of the calling thread.
+ * \return the safepoint, valid until the thread exits
+ */
+Safepoint *safepoint_current();
+
+/**
+ * \brief Requests work at the next safepoint, thread-safe and async-signal-safe.
+ * \param safepoint the safepoint of the thread which should perform the work
+ * \param reasons bitwise OR of the `SAFEPOINT_*` requests
+ */
+void safepoint_request(Safepoint *safepoint, uint32_t reasons);
+
+/**
+ * \brief Sets the safepoint to which `safepoint_signal()` delivers requests.
+ * \param safepoint the safepoint, usually of the thread executing the program, NULL to drop signalled requests
+ */
+void safepoint_set_signal_target(Safepoint *safepoint);
+
+/**
+ * \brief Requests work at the next safepoint of the signal target, if any, async-signal-safe.
+ * \param reasons bitwise OR of the `SAFEPOINT_*` requests
+ */
+void safepoint_signal(uint32_t reasons);
+
+/**
+ * \brief Checks whether a request is pending, the poll performed at the back-edges.
+ * \param safepoint the safepoint of the calling thread
+ * \return true if `safepoint_handle()` should be called
+ */
+static inline bool safepoint_is_pending(const Safepoint *safepoint) {
+    return __atomic_load_n(&safepoint->requests, __ATOMIC_RELAXED) != 0;
+}
+
+/**
+ * \brief Performs the pending requests.
+ *
+ * May trigger garbage collection, so all live objects must be reachable from the roots.
+ * \param safepoint the safepoint of the calling thread
+ * \return true if the program has been interrupted and must stop
+ */
+bool safepoint_handle(Safepoint *safepoint);
+
+/**
+ * \brief Clears a pending interrupt, so that the thread can execute another program.
+ * \param safepoint the safepoint
+ */
+void safepoint_clear_interrupt(Safepoint *safepoint);
+
+#ifdef __cplusplus
+}
+#endif
+#endif //SAFEPOINT_H
@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file simd.h
+ * \brief Portable subset of vector instructions for scanning text.
+ *
+ * Provides vectors of bytes and the few operations needed to classify bytes of text, implemented using AVX2, SSE2
+ * or NEON, depending on the target of the compiler. If none of them is available, `NX_SIMD` is 0 and nothing else
+ * is defined, the callers then fall back to bytewise loops.
+ *
+ * Comparisons produce vectors with all bits of the matching bytes set, vec_mask() then converts such a vector
+ * to a mask with `1 << VEC_MASK_SHIFT` bits for each byte, the lowest bits corresponding to the first byte.
+ */
+
+#ifndef SIMD_H
+#define SIMD_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#if defined(__AVX2__)
+
+//! Whether vector instructions are available.
+#define NX_SIMD 1
+//! Vector of bytes.
+typedef __m256i Vec;
+//! Number of bytes in a vector.
+#define VEC_SIZE 32
+//! Base-2 logarithm of the number of bits of a mask corresponding to a single byte.
+#define VEC_MASK_SHIFT 0
+//! Mask with the bits of all bytes of a vector set.
+#define VEC_FULL_MASK 0xFFFFFFFFu
+
+//! Loads a vector from an unaligned address.
+static inline Vec vec_load(const char *p) {
+    return _mm256_loadu_si256((const __m256i *) p);
+}
+
+//! Sets the bytes equal to `c`.
+static inline Vec vec_eq(Vec v, char c) {
+    return _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c));
+}
+
+//! Sets the bytes in the range `lo` to `hi`, both must be positive as signed bytes.
+static inline Vec vec_in_range(Vec v, char lo, char hi) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8((char) (lo - 1))),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8((char) (hi + 1)), v));
+}
+
+//! Bitwise or of two vectors.
+static inline Vec vec_or(Vec a, Vec b) {
+    return _mm256_or_si256(a, b);
+}
+
+//! Converts ASCII letters to lower case, other bytes change as well.
+static inline Vec vec_to_lower(Vec v) {
+    return _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+}
+
+//! Collects the most significant bits of the bytes into a mask.
+static inline uint64_t vec_mask(Vec v) {
+    return (uint32_t) _mm256_movemask_epi8(v);
+}
+
+#elif defined(__SSE2__)
+
+// the same operations as above, on 16-byte vectors
+#define NX_SIMD 1
+typedef __m128i Vec;
+#define VEC_SIZE 16
+#define VEC_MASK_SHIFT 0
+#define VEC_FULL_MASK 0xFFFFu
+
+static inline Vec vec_load(const char *p) {
+    return _mm_loadu_si128((const __m128i *) p);
+}
+
+static inline Vec vec_eq(Vec v, char c) {
+    return _mm_cmpeq_epi8(v, _mm_set1_epi8(c));
+}
+
+static inline Vec vec_in_range(Vec v, char lo, char hi) {
+    return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8((char) (lo - 1))),
+                         _mm_cmpgt_epi8(_mm_set1_epi8((char) (hi + 1)), v));
+}
+
+static inline Vec vec_or(Vec a, Vec b) {
+    return _mm_or_si128(a, b);
+}
+
+static inline Vec vec_to_lower(Vec v) {
+    return _mm_or_si128(v, _mm_set1_epi8(0x20));
+}
+
+static inline uint64_t vec_mask(Vec v) {
+    return (uint32_t) _mm_movemask_epi8(v);
+}
+
+#elif defined(__ARM_NEON)
+
+#define NX_SIMD 1
+typedef uint8x16_t Vec;
+#define VEC_SIZE 16
+// NEON has no movemask, narrowing the comparison result yields four bits per byte
+#define VEC_MASK_SHIFT 2
+#define VEC_FULL_MASK UINT64_MAX
+
+static inline Vec vec_load(const char *p) {
+    return vld1q_u8((const uint8_t *) p);
+}
+
+static inline Vec vec_eq(Vec v, char c) {
+    return vceqq_u8(v, vdupq_n_u8((uint8_t) c));
+}
+
+static inline Vec vec_in_range(Vec v, char lo, char hi) {
+    return vcleq_u8(vsubq_u8(v, vdupq_n_u8((uint8_t) lo)), vdupq_n_u8((uint8_t) (hi - lo)));
+}
+
+static inline Vec vec_or(Vec a, Vec b) {
+    return vorrq_u8(a, b);
+}
+
+static inline Vec vec_to_lower(Vec v) {
+    return vorrq_u8(v, vdupq_n_u8(0x20));
+}
+
+static inline uint64_t vec_mask(Vec v) {
+    return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(v), 4)), 0);
+}
+
+#else
+#define NX_SIMD 0
+#endif
+
+#if NX_SIMD
+/**
+ * \brief Returns the index of the first byte in a mask produced by vec_mask().
+ * \param mask the mask, must not be zero
+ * \return the index of the byte
+ */
+static inline size_t vec_mask_first(uint64_t mask) {
+    return __builtin_ctzll(mask) >> VEC_MASK_SHIFT;
+}
+
+/**
+ * \brief Removes the first byte from a mask produced by vec_mask().
+ * \param mask the mask, must not be zero
+ * \return the mask without the first byte
+ */
+static inline uint64_t vec_mask_clear_first(uint64_t mask) {
+    return mask & ~((((uint64_t) 1 << (1 << VEC_MASK_SHIFT)) - 1) << __builtin_ctzll(mask));
+}
+
+/**
+ * \brief Counts the bytes in a mask produced by vec_mask().
+ * \param mask the mask
+ * \return the number of bytes
+ */
+static inline size_t vec_mask_count(uint64_t mask) {
+    return __builtin_popcountll(mask) >> VEC_MASK_SHIFT;
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif //SIMD_H
@@ -0,0 +1,330 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file slab.h
+ * \brief Segregated-fit allocator for small garbage-collected objects.
+ *
+ * Small blocks are allocated from slabs, which are large blocks of memory aligned to their size and divided into
+ * cells of the same size. Each size class (a multiple of `NX_ALIGNMENT` up to `SLAB_MAX_SIZE` bytes) has its own
+ * list of slabs. Since slabs are aligned, the slab containing a block can be found by masking its address.
+ *
+ * Each slab keeps two bitmaps in its header, one with a bit for each allocated cell and one with the mark bits used
+ * by the garbage collector, so the collector never needs to touch the objects themselves to mark or sweep them.
+ * Freeing is implicit: after the garbage collector has marked all live objects, it calls `slab_start_sweep()`,
+ * and each slab is then swept lazily, just before the next allocation from it, by replacing its allocation bitmap
+ * with its mark bitmap. Mark bits are not cleared by sweeping, which allows the garbage collector to use them
+ * to distinguish old objects (marked in a previous collection) from young ones.
+ *
+ * A slab can also be swept eagerly using `slab_sweep()`, possibly by another thread than the one allocating: the
+ * epoch of the slab is claimed atomically, so each slab is swept exactly once per epoch and the allocator never
+ * hands out a block of a slab before its sweep has completed.
+ *
+ * Empty slabs are not returned to the system immediately, they are released in batches by `slab_release_empty()`.
+ *
+ * Slabs are carved out of large regions reserved using mmap(), so that the heap occupies few pages and TLB entries
+ * and can optionally be backed by huge pages. A released slab becomes free for reuse within its region, and once all
+ * slabs of a region are free, the memory of the whole region is returned to the system (see `SlabRegionPolicy`).
+ *
+ * The slabs belong to a heap (see `SlabHeap`). Each thread allocates from its current heap, which is the main heap
+ * unless the thread selects another one using `slab_set_heap()`, so that independent heaps can be used by different
+ * threads at the same time. All functions operate on the current heap, so a thread sweeping the slabs of another
+ * thread must select their heap first.
+ *
+ * Blocks larger than `SLAB_MAX_SIZE` must be allocated by other means, e.g. `nx_alloc()`.
+ */
+
+#ifndef SLAB_H
+#define SLAB_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//! Size of a slab in bytes, slabs are aligned to this size.
+#define SLAB_SIZE (64 * 1024)
+//! Maximum size of a block which can be allocated using the slab allocator.
+#define SLAB_MAX_SIZE 512
+//! Number of 64-bit words of each bitmap in a slab, enough for the smallest size class.
+#define SLAB_BITMAP_WORDS (SLAB_SIZE / 16 / 64)
+
+/**
+ * \brief Header of a slab, stored at the beginning of the slab memory.
+ *
+ * Exposed only to allow inlining of `slab_is_marked()` and `slab_try_mark()`, the fields must not be accessed
+ * outside of the allocator.
+ */
+typedef struct Slab {
+    struct Slab *next;                          //!< next slab of the same size class
+    char *start;                                //!< address of the first cell
+    uint32_t cell_size;                         //!< size of the cells in bytes
+    uint32_t cell_count;                        //!< number of cells in the slab
+    uint64_t cell_reciprocal;                   //!< `2^32 / cell_size` rounded up, for computing cell indices
+    uint32_t cursor;                            //!< index of the word of `alloc_bits` where the search for free cells starts
+    uint32_t used;                              //!< number of allocated cells, valid only if the slab is swept
+    uint64_t epoch;                             //!< sweep epoch in which the slab was last swept, accessed atomically
+    uint64_t alloc_bits[SLAB_BITMAP_WORDS];     //!< bit set for each allocated cell
+    uint64_t mark_bits[SLAB_BITMAP_WORDS];      //!< bit set for each marked cell
+} Slab;
+
+/**
+ * \brief Returns the slab containing the given block.
+ * \param ptr pointer to the block allocated using `slab_alloc`
+ * \return the slab
+ */
+static inline Slab *slab_of(const void *ptr) {
+    return (Slab *) ((uintptr_t) ptr & ~((uintptr_t) SLAB_SIZE - 1));
+}
+
+/**
+ * \brief Returns the index of the cell of the block within its slab.
+ * \param slab the slab containing the block
+ * \param ptr pointer to the block
+ * \return the index of the cell
+ */
+static inline uint32_t slab_cell_index(const Slab *slab, const void *ptr) {
+    return (uint32_t) (((uint64_t) ((const char *) ptr - slab->start) * slab->cell_reciprocal) >> 32);
+}
+
+/**
+ * \brief Determines whether the block is marked.
+ * \param ptr pointer to the block allocated using `slab_alloc`
+ * \return true if the mark bit of the block is set
+ */
+static inline bool slab_is_marked(const void *ptr) {
+    const Slab *slab = slab_of(ptr);
+    uint32_t index = slab_cell_index(slab, ptr);
+    return (slab->mark_bits[index / 64] >> (index % 64)) & 1;
+}
+
+/**
+ * \brief Sets the mark bit of the block.
+ * \param ptr pointer to the block allocated using `slab_alloc`
+ * \return true if the block was not marked before
+ */
+static inline bool slab_try_mark(const void *ptr) {
+    Slab *slab = slab_of(ptr);
+    uint32_t index = slab_cell_index(slab, ptr);
+    uint64_t bit = (uint64_t) 1 << (index % 64);
+    if (slab->mark_bits[index / 64] & bit) {
+        return false;
+    }
+    slab->mark_bits[index / 64] |= bit;
+    return true;
+}
+
+/**
+ * \brief Atomically sets the mark bit of the block, can be called concurrently from multiple threads.
+ * \param ptr pointer to the block allocated using `slab_alloc`
+ * \return true if the block was not marked before, i.e. if the calling thread marked it
+ */
+static inline bool slab_try_mark_atomic(const void *ptr) {
+    Slab *slab = slab_of(ptr);
+    uint32_t index = slab_cell_index(slab, ptr);
+    uint64_t bit = (uint64_t) 1 << (index % 64);
+    uint64_t *word = &slab->mark_bits[index / 64];
+    if (__atomic_load_n(word, __ATOMIC_RELAXED) & bit) {
+        return false;
+    }
+    return !(__atomic_fetch_or(word, bit, __ATOMIC_RELAXED) & bit);
+}
+
+/**
+ * \brief Kinds of pages backing the regions.
+ */
+typedef enum {
+    SLAB_PAGES_NORMAL,                          //!< Regular pages
+    SLAB_PAGES_TRANSPARENT,                     //!< Regular pages advised to be merged into transparent huge pages
+    SLAB_PAGES_HUGETLB,                         //!< Explicit huge pages from the hugetlbfs pool, regular pages are
+                                                //!< used if the pool is exhausted
+} SlabPages;
+
+/**
+ * \brief Ways of returning the memory of empty regions to the system.
+ */
+typedef enum {
+    SLAB_RELEASE_UNMAP,                         //!< The region is unmapped, a new one is mapped when needed
+    SLAB_RELEASE_DONTNEED,                      //!< The pages are discarded by `MADV_DONTNEED`, the region stays
+                                                //!< reserved and its slabs are reused
+    SLAB_RELEASE_FREE,                          //!< The pages are discarded lazily by `MADV_FREE` when the system is
+                                                //!< short of memory, which is cheaper if the region is reused soon
+} SlabRelease;
+
+/**
+ * \brief Parameters of the regions the slabs are carved from.
+ */
+typedef struct {
+    size_t region_size;                         //!< Size of a region in bytes, a multiple of `SLAB_SIZE`, zero
+                                                //!< allocates each slab separately using aligned_alloc()
+    SlabPages pages;                            //!< Pages backing the regions
+    SlabRelease release;                        //!< How empty regions are returned to the system
+} SlabRegionPolicy;
+
+//! Default size of a region.
+#define SLAB_DEFAULT_REGION_SIZE ((size_t) 4 * 1024 * 1024)
+//! Size of a huge page, regions backed by huge pages are aligned to it and their size is rounded up to it.
+#define SLAB_HUGE_PAGE_SIZE ((size_t) 2 * 1024 * 1024)
+
+/**
+ * \brief Set of slabs from which the blocks are allocated, with its own size classes and sweep epoch.
+ */
+typedef struct SlabHeap SlabHeap;
+
+/**
+ * \brief Creates a new empty heap.
+ * \return the heap, to be destroyed by `slab_heap_destroy()`
+ */
+SlabHeap *slab_heap_create();
+
+/**
+ * \brief Frees all slabs of a heap and the heap itself.
+ *
+ * The heap must not be the current heap of any thread, the main heap cannot be destroyed.
+ * \param heap the heap created by `slab_heap_create()`
+ */
+void slab_heap_destroy(SlabHeap *heap);
+
+/**
+ * \brief Selects the current heap of the calling thread.
+ * \param heap the heap, NULL selects the main heap
+ * \return the previous current heap of the thread
+ */
+SlabHeap *slab_set_heap(SlabHeap *heap);
+
+/**
+ * \brief Returns the default parameters of the regions.
+ * \return the default parameters
+ */
+SlabRegionPolicy slab_default_region_policy();
+
+/**
+ * \brief Changes the parameters of the regions of the current heap.
+ *
+ * The regions which are already mapped are kept, the new parameters apply to the regions mapped from now on and to
+ * the release of empty regions.
+ * \param policy the parameters, `region_size` must be a multiple of `SLAB_SIZE`
+ */
+void slab_set_region_policy(const SlabRegionPolicy *policy);
+
+/**
+ * \brief Allocates a block of memory from a slab of the appropriate size class.
+ *
+ * The memory is aligned to NX_ALIGNMENT and it is not marked. The block stays allocated until the next sweep
+ * of its slab after a call to `slab_start_sweep()` with the block not marked.
+ * \param size_in_bytes the size of the block to allocate, must be greater than 0 and at most `SLAB_MAX_SIZE`
+ * \return a pointer to the allocated block or NULL if a new slab cannot be allocated
+ */
+void *slab_alloc(size_t size_in_bytes);
+
+/**
+ * \brief Clears the mark bits of all blocks.
+ */
+void slab_clear_marks();
+
+/**
+ * \brief Calls the function for each marked block.
+ * \param fn the function to call with the pointer to the block
+ */
+void slab_for_each_marked(void (*fn)(void *ptr));
+
+/**
+ * \brief Starts a new sweep epoch, all unmarked blocks will be freed lazily.
+ */
+void slab_start_sweep();
+
+/**
+ * \brief Sweeps the slab unless it has already been swept in the current epoch.
+ *
+ * Can be called from a thread other than the allocating one, as long as the slab is not released and no new
+ * epoch is started in the meantime. If the slab is being swept by another thread, waits for it to finish.
+ * \param slab the slab
+ */
+void slab_sweep(Slab *slab);
+
+/**
+ * \brief Sweeps all slabs which have not been swept in the current epoch yet.
+ *
+ * After that, the mark bits can be cleared without losing track of the allocated blocks.
+ */
+void slab_sweep_all();
+
+/**
+ * \brief Returns all allocated slabs.
+ * \param count receives the number of slabs
+ * \return array of the slabs allocated using `nx_alloc()` which must be freed by the caller, NULL if there are none
+ */
+Slab **slab_get_all(size_t *count);
+
+/**
+ * \brief Finds the allocated block containing the address, taking pending sweeps into account.
+ *
+ * The address may point anywhere inside the block, or anywhere at all: the function can be used to recognize
+ * pointers into the slabs among arbitrary words (e.g. when scanning the stack conservatively).
+ * The lookup takes logarithmic time in the number of slabs.
+ * \param ptr the address
+ * \return pointer to the start of the allocated block containing `ptr`, or NULL if there is no such block
+ */
+void *slab_find_block(const void *ptr);
+
+/**
+ * \brief Determines whether the block is allocated, taking pending sweeps into account.
+ *
+ * Only slabs which have not been released are considered, so the function can be called with a dangling pointer.
+ * \param ptr pointer to a block
+ * \return true if `ptr` points to a block which is allocated and will not be freed by a pending sweep
+ */
+bool slab_is_live(const void *ptr);
+
+/**
+ * \brief Returns the number of allocated blocks, taking pending sweeps into account.
+ * \return the number of blocks
+ */
+size_t slab_get_live_count();
+
+/**
+ * \brief Returns the memory of empty slabs to the system.
+ *
+ * Slabs without live blocks (swept slabs with no allocated blocks or unswept slabs with no marked blocks) are
+ * released, one empty slab is kept in each size class to avoid allocating a new slab immediately. The memory of
+ * regions left without slabs is returned to the system as configured by `SlabRegionPolicy.release`.
+ */
+void slab_release_empty();
+
+/**
+ * \brief Returns the number of slabs currently allocated.
+ * \return the number of slabs
+ */
+size_t slab_get_count();
+
+/**
+ * \brief Returns the number of regions currently mapped, including the empty ones whose pages were discarded.
+ * \return the number of regions
+ */
+size_t slab_get_region_count();
+
+/**
+ * \brief Returns the number of bytes of the regions which are not known to be discarded.
+ *
+ * Slabs allocated separately (see `SlabRegionPolicy.region_size`) are included as well.
+ * \return the number of bytes
+ */
+size_t slab_get_mapped_bytes();
+
+/**
+ * \brief Frees all slabs, including the blocks which are still allocated.
+ *
+ * Intended for the unit tests.
+ */
+void slab_free_all();
+
+#ifdef __cplusplus
+}
+#endif
+#endif //SLAB_H
@@ -0,0 +1,272 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file code.c
+ * \brief Implementation of the bytecode representation.
+ */
+
+#include "natrix/compiler/code.h"
+#include <assert.h>
+#include "natrix/compiler/jit.h"
+#include "natrix/interp/builtins.h"
+#include "natrix/obj/nx_int.h"
+#include "natrix/obj/nx_str.h"
+#include "natrix/util/mem.h"
+
+//! Initial capacity of the growable arrays of the code object.
+#define INITIAL_CAPACITY 16
+
+/**
+ * \brief Names of opcodes.
+ */
+static const char *OPCODE_NAMES[] = {
+    #define OP(x, operand) [OP_##x] = #x,
+    #include "natrix/compiler/opcodes.inc"
+    #undef OP
+};
+
+/**
+ * \brief Kinds of operands of opcodes.
+ */
+static const OperandKind OPERAND_KINDS[] = {
+    #define OP(x, operand) [OP_##x] = operand,
+    #include "natrix/compiler/opcodes.inc"
+    #undef OP
+};
+
+/**
+ * \brief Reports all constants to the garbage collector.
+ * \param ptr pointer to the code object
+ */
+static void code_gc_trace(void *ptr) {
+    Code *code = (Code *) ptr;
+    for (size_t i = 0; i < code->constant_count; i++) {
+        gc_visit(nxo_gc_header(code->constants[i]));
+    }
+}
+
+/**
+ * \brief Ensures that a growable array has room for the given number of additional items.
+ * \param data pointer to the array
+ * \param count number of items in the array
+ * \param capacity pointer to the capacity of the array, updated if the array grows
+ * \param item_size size of one item in bytes
+ * \param extra number of items to make room for
+ */
+static void ensure_capacity(void **data, size_t count, size_t *capacity, size_t item_size, size_t extra) {
+    if (count + extra <= *capacity) {
+        return;
+    }
+    size_t new_capacity = *capacity ? *capacity * 2 : INITIAL_CAPACITY;
+    while (new_capacity < count + extra) {
+        new_capacity *= 2;
+    }
+    *data = nx_realloc(*data, new_capacity * item_size);
+    *capacity = new_capacity;
+}
+
+Code code_init() {
+    return (Code) {
+            .gc_header = {.mark = 0, .class_id = gc_register_class(code_gc_trace, "code")},
+            .bytecode = NULL,
+            .bytecode_size = 0,
+            .bytecode_capacity = 0,
+            .constants = NULL,
+            .constant_count = 0,
+            .constant_capacity = 0,
+            .names = NULL,
+            .name_count = 0,
+            .name_capacity = 0,
+            .sites = NULL,
+            .site_count = 0,
+            .site_capacity = 0,
+            .loops = NULL,
+            .loop_count = 0,
+            .loop_capacity = 0,
+            .lines = NULL,
+            .line_count = 0,
+            .line_capacity = 0,
+            .max_stack = 0,
+    };
+}
+
+void code_free(Code *code) {
+    nx_free(code->bytecode);
+    nx_free(code->constants);
+    nx_free(code->names);
+    nx_free(code->sites);
+    for (size_t i = 0; i < code->loop_count; i++) {
+        jit_free(code->loops[i].native);
+    }
+    nx_free(code->loops);
+    nx_free(code->lines);
+    *code = code_init();
+}
+
+size_t code_emit(Code *code, Opcode op) {
+    assert(OPERAND_KINDS[op] == OPERAND_NONE);
+    ensure_capacity((void **) &code->bytecode, code->bytecode_size, &code->bytecode_capacity, 1, 1);
+    size_t offset = code->bytecode_size;
+    code->bytecode[code->bytecode_size++] = op;
+    return offset;
+}
+
+size_t code_emit_with_operand(Code *code, Opcode op, uint32_t operand) {
+    assert(OPERAND_KINDS[op] != OPERAND_NONE);
+    ensure_capacity((void **) &code->bytecode, code->bytecode_size, &code->bytecode_capacity, 1, 1 + OPERAND_SIZE);
+    size_t offset = code->bytecode_size;
+    code->bytecode[offset] = op;
+    memcpy(code->bytecode + offset + 1, &operand, OPERAND_SIZE);
+    code->bytecode_size += 1 + OPERAND_SIZE;
+    return offset;
+}
+
+void code_patch_jump(Code *code, size_t offset, size_t target) {
+    assert(offset + 1 + OPERAND_SIZE <= code->bytecode_size);
+    assert(OPERAND_KINDS[code->bytecode[offset]] == OPERAND_JUMP);
+    int32_t relative = (int32_t) ((int64_t) target - (int64_t) (offset + 1 + OPERAND_SIZE));
+    memcpy(code->bytecode + offset + 1, &relative, OPERAND_SIZE);
+}
+
+uint32_t code_add_constant(Code *code, NxObject *value) {
+    assert(code->constant_count < UINT32_MAX);
+    ensure_capacity((void **) &code->constants, code->constant_count, &code->constant_capacity, sizeof(NxObject *), 1);
+    code->constants[code->constant_count] = value;
+    return code->constant_count++;
+}
+
+uint32_t code_add_site(Code *code, BinaryOp op, bool temporary) {
+    assert(code->site_count < UINT32_MAX);
+    ensure_capacity((void **) &code->sites, code->site_count, &code->site_capacity, sizeof(CodeSite), 1);
+    code->sites[code->site_count] = (CodeSite) {
+            .offset = code->bytecode_size,
+            .op = op,
+            .warmup = CODE_SITE_WARMUP,
+            .specialized = 0,
+            .deoptimized = 0,
+            .temporary = temporary,
+    };
+    return code->site_count++;
+}
+
+uint32_t code_add_loop(Code *code, size_t start) {
+    assert(code->loop_count < UINT32_MAX && start <= code->bytecode_size);
+    ensure_capacity((void **) &code->loops, code->loop_count, &code->loop_capacity, sizeof(CodeLoop), 1);
+    code->loops[code->loop_count] = (CodeLoop) {
+            .start = start,
+            .end = code->bytecode_size + 1 + OPERAND_SIZE,
+            .counter = 0,
+            .deoptimized = 0,
+            .native = NULL,
+            .failed = false,
+    };
+    return code->loop_count++;
+}
+
+uint32_t code_add_line(Code *code, const char *position, uint32_t parent) {
+    assert(code->line_count < UINT32_MAX && (parent == CODE_NO_PARENT || parent < code->line_count));
+    ensure_capacity((void **) &code->lines, code->line_count, &code->line_capacity, sizeof(CodeLine), 1);
+    code->lines[code->line_count] = (CodeLine) {
+            .offset = code->bytecode_size,
+            .position = position,
+            .parent = parent,
+    };
+    return code->line_count++;
+}
+
+void code_set_slot_name(Code *code, uint32_t slot, const char *start, size_t length) {
+    if (slot >= code->name_count) {
+        ensure_capacity((void **) &code->names, code->name_count, &code->name_capacity, sizeof(CodeName), slot + 1 - code->name_count);
+        memset(code->names + code->name_count, 0, (slot + 1 - code->name_count) * sizeof(CodeName));
+        code->name_count = slot + 1;
+    }
+    code->names[slot] = (CodeName) {.start = start, .length = length};
+}
+
+const char *code_get_opcode_name(Opcode op) {
+    return op >= 0 && op < OPCODE_COUNT ? OPCODE_NAMES[op] : "UNKNOWN";
+}
+
+OperandKind code_get_operand_kind(Opcode op) {
+    assert(op >= 0 && op < OPCODE_COUNT);
+    return OPERAND_KINDS[op];
+}
+
+/**
+ * \brief Dumps a constant to the given string builder.
+ * \param sb the string builder
+ * \param value the constant
+ */
+static void dump_constant(StringBuilder *sb, NxObject *value) {
+    if (nx_int_is_instance(value)) {
+        nx_int_append_to(sb, value);
+    } else if (nx_str_is_instance(value)) {
+        sb_append_char(sb, '"');
+        sb_append_escaped_str_len(sb, nx_str_get_data(value), nx_str_get_length(value));
+        sb_append_char(sb, '"');
+    } else {
+        sb_append_formatted(sb, "<%s>", nxo_type(value)->name);
+    }
+}
+
+void code_dump(StringBuilder *sb, const Code *code) {
+    size_t offset = 0;
+    while (offset < code->bytecode_size) {
+        Opcode op = code->bytecode[offset];
+        OperandKind kind = code_get_operand_kind(op);
+        sb_append_formatted(sb, "%04zu %s", offset, code_get_opcode_name(op));
+        if (kind == OPERAND_NONE) {
+            sb_append_char(sb, '\n');
+            offset++;
+            continue;
+        }
+        uint32_t operand = code_read_operand(code->bytecode + offset);
+        offset += 1 + OPERAND_SIZE;
+        switch (kind) {
+            case OPERAND_CONST:
+                assert(operand < code->constant_count);
+                sb_append_formatted(sb, " %u (", operand);
+                dump_constant(sb, code->constants[operand]);
+                sb_append_str(sb, ")\n");
+                break;
+            case OPERAND_SLOT:
+                if (operand < code->name_count && code->names[operand].start) {
+                    sb_append_formatted(sb, " %u (%.*s)\n", operand, (int) code->names[operand].length, code->names[operand].start);
+                } else {
+                    sb_append_formatted(sb, " %u\n", operand);
+                }
+                break;
+            case OPERAND_COUNT:
+            case OPERAND_SITE:
+                sb_append_formatted(sb, " %u\n", operand);
+                break;
+            case OPERAND_JUMP:
+                sb_append_formatted(sb, " %d (-> %04zu)\n", (int32_t) operand, offset + (int32_t) operand);
+                break;
+            case OPERAND_LOOP:
+                assert(operand < code->loop_count);
+                sb_append_formatted(sb, " %u (-> %04zu)\n", operand, code->loops[operand].start);
+                break;
+            case OPERAND_CALL:
+                sb_append_formatted(sb, " %u (%s/%u)\n", operand, builtin_get(code_call_builtin(operand))->name,
+                                    code_call_argc(operand));
+                break;
+            default:
+                assert(0 && "Invalid OperandKind");
+        }
+    }
+}
+
+void code_dump_sites(StringBuilder *sb, const Code *code) {
+    for (size_t i = 0; i < code->site_count; i++) {
+        const CodeSite *site = &code->sites[i];
+        assert(site->offset < code->bytecode_size);
+        sb_append_formatted(sb, "%zu %04zu %s specialized=%u deoptimized=%u\n", i, site->offset,
+                            code_get_opcode_name(code->bytecode[site->offset]), site->specialized, site->deoptimized);
+    }
+}
@@ -0,0 +1,690 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file code_cache.c
+ * \brief Implementation of the cache of compiled programs.
+ *
+ * The layout of a cache file is:
+ * \code
+ *     CacheHeader
+ *     uint8_t bytecode[bytecode_size], padded to 8 bytes
+ *     CacheConstant constants[constant_count]
+ *     CacheName slots[slot_count]
+ *     CacheSite sites[site_count]
+ *     CacheLoop loops[loop_count]
+ *     CacheLine lines[line_count]
+ *     char blob[blob_size], texts referenced by constants and slot names
+ * \endcode
+ */
+
+#include "natrix/compiler/code_cache.h"
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "natrix/interp/builtins.h"
+#include "natrix/interp/ops.h"
+#include "natrix/obj/nx_int.h"
+#include "natrix/obj/nx_str.h"
+#include "natrix/util/mem.h"
+#include "natrix/util/sb.h"
+
+//! Identifies a cache file.
+static const char CACHE_MAGIC[8] = "NATRIXC";
+
+//! Stack depth of an offset which is not the start of an instruction.
+#define NOT_INSTRUCTION UINT32_MAX
+//! Stack depth of the start of an instruction which has not been reached yet.
+#define UNREACHED (UINT32_MAX - 1)
+
+/**
+ * \brief Header of a cache file.
+ */
+typedef struct {
+    char magic[8];                  //!< `CACHE_MAGIC`
+    uint32_t version;               //!< `CODE_CACHE_VERSION`
+    uint32_t opcode_count;          //!< Number of opcodes of the interpreter which wrote the file
+    uint32_t pointer_size;          //!< Size of a pointer of the interpreter which wrote the file
+    uint32_t flags;                 //!< Flags the program was compiled with
+    uint64_t source_hash;           //!< Hash of the source code, see `code_cache_hash()`
+    uint64_t source_size;           //!< Size of the source code in bytes
+    uint64_t bytecode_size;         //!< Number of bytes of the bytecode
+    uint64_t constant_count;        //!< Number of constants
+    uint64_t slot_count;            //!< Number of variable slots
+    uint64_t site_count;            //!< Number of sites of the binary operators
+    uint64_t loop_count;            //!< Number of loop records
+    uint64_t line_count;            //!< Number of entries of the line table
+    uint64_t max_stack;             //!< Maximum depth of the operand stack
+    uint64_t blob_size;             //!< Number of bytes of texts
+    uint64_t payload_hash;          //!< Hash of the sections following the header, detects corrupted files
+} CacheHeader;
+
+_Static_assert(sizeof(CacheHeader) == CODE_CACHE_HEADER_SIZE, "CODE_CACHE_HEADER_SIZE must match the header");
+_Static_assert(offsetof(CacheHeader, payload_hash) == CODE_CACHE_PAYLOAD_HASH_OFFSET,
+               "CODE_CACHE_PAYLOAD_HASH_OFFSET must match the header");
+
+/**
+ * \brief Kinds of constants.
+ */
+typedef enum {
+    CONSTANT_INT,                   //!< Integer which fits in 64 bits, `value` is the integer
+    CONSTANT_BIG_INT,               //!< Other integer, `value` and `length` locate its decimal form in the blob
+    CONSTANT_STR,                   //!< String, `value` and `length` locate its contents in the blob
+} CacheConstantKind;
+
+/**
+ * \brief Constant in a cache file.
+ */
+typedef struct {
+    uint64_t kind;                  //!< Kind of the constant, see `CacheConstantKind`
+    uint64_t value;                 //!< Value or offset in the blob, depending on the kind
+    uint64_t length;                //!< Length of the text in the blob, if any
+} CacheConstant;
+
+/**
+ * \brief Name of a variable slot in a cache file.
+ */
+typedef struct {
+    uint64_t offset;                //!< Offset of the name in the blob
+    uint64_t length;                //!< Length of the name
+} CacheName;
+
+/**
+ * \brief Site of a binary operator in a cache file.
+ */
+typedef struct {
+    uint64_t offset;                //!< Offset of the instruction in the bytecode
+    uint64_t op;                    //!< The binary operator
+    uint64_t temporary;             //!< Whether the result is a temporary, 0 or 1
+} CacheSite;
+
+/**
+ * \brief Loop record in a cache file.
+ */
+typedef struct {
+    uint64_t start;                 //!< Offset of the first instruction of the loop
+    uint64_t end;                   //!< Offset of the instruction following the back edge
+} CacheLoop;
+
+/**
+ * \brief Entry of the line table in a cache file.
+ */
+typedef struct {
+    uint64_t offset;                //!< Offset of the first instruction of the range
+    uint64_t position;              //!< Offset of the position of the statement in the source code
+    uint64_t parent;                //!< Index of an entry of the enclosing statement, `CODE_NO_PARENT` if none
+} CacheLine;
+
+/**
+ * \brief Rounds a size up to a multiple of 8.
+ * \param size the size
+ * \return the rounded size
+ */
+static uint64_t align8(uint64_t size) {
+    return (size + 7) & ~(uint64_t) 7;
+}
+
+uint64_t code_cache_hash_bytes(const void *data, size_t length) {
+    // word-at-a-time multiplicative hash
+    const char *p = data;
+    size_t n = length;
+    uint64_t h = 0x9E3779B97F4A7C15ull ^ n;
+    for (; n >= 8; p += 8, n -= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        h = (h ^ w) * 0xFF51AFD7ED558CCDull;
+        h ^= h >> 32;
+    }
+    uint64_t w = 0;
+    memcpy(&w, p, n);
+    h = (h ^ w) * 0xC4CEB9FE1A85EC53ull;
+    return h ^ (h >> 29);
+}
+
+uint64_t code_cache_hash(const Source *source) {
+    return code_cache_hash_bytes(source->start, source->end - source->start);
+}
+
+/**
+ * \brief Fills the header describing a program.
+ * \param header the header to fill
+ * \param source the source code of the program
+ * \param flags the flags that affect compilation
+ */
+static void init_header(CacheHeader *header, const Source *source, uint32_t flags) {
+    memset(header, 0, sizeof(CacheHeader));
+    memcpy(header->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header->version = CODE_CACHE_VERSION;
+    header->opcode_count = OPCODE_COUNT;
+    header->pointer_size = sizeof(void *);
+    header->flags = flags;
+    header->source_hash = code_cache_hash(source);
+    header->source_size = source->end - source->start;
+}
+
+/**
+ * \brief Checks that the operands of all instructions refer to existing entries of the tables.
+ * \param bytecode the bytecode
+ * \param header the header of the cache file
+ * \param depths receives `UNREACHED` at the start of each instruction, must be filled with `NOT_INSTRUCTION`
+ * \return true if the bytecode is well-formed
+ */
+static bool validate_bytecode(const uint8_t *bytecode, const CacheHeader *header, uint32_t *depths) {
+    size_t offset = 0;
+    while (offset < header->bytecode_size) {
+        depths[offset] = UNREACHED;
+        Opcode op = bytecode[offset];
+        if (op >= OPCODE_COUNT) {
+            return false;
+        }
+        OperandKind kind = code_get_operand_kind(op);
+        if (kind == OPERAND_NONE) {
+            offset++;
+            continue;
+        }
+        if (offset + 1 + OPERAND_SIZE > header->bytecode_size) {
+            return false;
+        }
+        uint32_t operand = code_read_operand(bytecode + offset);
+        offset += 1 + OPERAND_SIZE;
+        // the superinstructions read the instructions following them, whose operands are checked as usual
+        if (op == OP_UPDATE_VAR && (offset + 3 * (1 + OPERAND_SIZE) > header->bytecode_size
+                || bytecode[offset] != OP_CONST || bytecode[offset + 1 + OPERAND_SIZE] >= OPCODE_COUNT
+                || code_get_operand_kind(bytecode[offset + 1 + OPERAND_SIZE]) != OPERAND_SITE
+                || bytecode[offset + 2 * (1 + OPERAND_SIZE)] != OP_STORE_VAR)) {
+            return false;
+        }
+        if (op == OP_COMPARE_JUMP && (offset + 1 + OPERAND_SIZE > header->bytecode_size
+                || bytecode[offset] != OP_JUMP_IF_FALSE)) {
+            return false;
+        }
+        if (op == OP_FOR_ITER && (operand + 1 >= header->slot_count || offset + 1 + OPERAND_SIZE > header->bytecode_size
+                || bytecode[offset] != OP_JUMP)) {
+            return false;
+        }
+        if (op == OP_RANGE && (operand < builtin_get(BUILTIN_RANGE)->min_args
+                || operand > builtin_get(BUILTIN_RANGE)->max_args)) {
+            return false;
+        }
+        switch (kind) {
+            case OPERAND_CONST:
+                if (operand >= header->constant_count) {
+                    return false;
+                }
+                break;
+            case OPERAND_SLOT:
+                if (operand >= header->slot_count) {
+                    return false;
+                }
+                break;
+            case OPERAND_SITE:
+                if (operand >= header->site_count) {
+                    return false;
+                }
+                break;
+            case OPERAND_LOOP:
+                if (operand >= header->loop_count) {
+                    return false;
+                }
+                break;
+            case OPERAND_CALL: {
+                uint32_t id = code_call_builtin(operand);
+                if (id >= BUILTIN_COUNT || code_call_argc(operand) < builtin_get(id)->min_args
+                    || code_call_argc(operand) > builtin_get(id)->max_args) {
+                    return false;
+                }
+                break;
+            }
+            case OPERAND_JUMP: {
+                int64_t target = (int64_t) offset + (int32_t) operand;
+                if (target < 0 || (uint64_t) target >= header->bytecode_size) {
+                    return false;
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    return header->bytecode_size > 0 && bytecode[header->bytecode_size - 1] == OP_HALT;
+}
+
+/**
+ * \brief Returns the number of values an instruction pops from and pushes onto the operand stack.
+ *
+ * Superinstructions have the effect of the first instruction of their sequence, which they replace, and `FOR_ITER`
+ * the effect of its path through the following `JUMP`, the item is only pushed when the jump is skipped.
+ * \param op the opcode
+ * \param operand the operand of the instruction, 0 if none
+ * \param pops receives the number of popped values
+ * \param pushes receives the number of pushed values
+ */
+static void get_stack_effect(Opcode op, uint32_t operand, uint64_t *pops, uint64_t *pushes) {
+    *pops = 0;
+    *pushes = 0;
+    switch (op) {
+        case OP_CONST:
+        case OP_LOAD_VAR:
+        case OP_UPDATE_VAR:
+            *pushes = 1;
+            break;
+        case OP_STORE_VAR:
+        case OP_JUMP_IF_FALSE:
+        case OP_POP:
+        case OP_PRINT:
+            *pops = 1;
+            break;
+        case OP_LIST:
+        case OP_RANGE:
+            *pops = operand;
+            *pushes = 1;
+            break;
+        case OP_DICT:
+            *pops = 2 * (uint64_t) operand;
+            *pushes = 1;
+            break;
+        case OP_CALL:
+            *pops = code_call_argc(operand);
+            *pushes = 1;
+            break;
+        case OP_GET_SLICE:
+            *pops = 3;
+            *pushes = 1;
+            break;
+        case OP_SET_ELEMENT:
+            *pops = 3;
+            break;
+        case OP_DUP_TWO:
+            *pops = 2;
+            *pushes = 4;
+            break;
+        case OP_FOR_ITER:
+        case OP_JUMP:
+        case OP_LOOP:
+        case OP_RELEASE_TEMPS:
+        case OP_HALT:
+            break;
+        default:
+            // the binary operators and the subscripts
+            assert(code_get_operand_kind(op) == OPERAND_SITE || code_get_operand_kind(op) == OPERAND_NONE);
+            *pops = 2;
+            *pushes = 1;
+            break;
+    }
+}
+
+/**
+ * \brief Records the stack depth at the start of an instruction reached by the abstract interpretation.
+ * \param header the header of the cache file
+ * \param depths the stack depths, indexed by offset
+ * \param pending the offsets of the instructions still to be interpreted
+ * \param pending_count the number of pending offsets
+ * \param target the offset of the reached instruction
+ * \param depth the stack depth at the reached instruction
+ * \return false if the target is not the start of an instruction, the depth exceeds `max_stack` or differs from the
+ * depth on another path
+ */
+static bool reach(const CacheHeader *header, uint32_t *depths, size_t *pending, size_t *pending_count,
+                  uint64_t target, uint64_t depth) {
+    if (target >= header->bytecode_size || depths[target] == NOT_INSTRUCTION || depth > header->max_stack) {
+        return false;
+    }
+    if (depths[target] == UNREACHED) {
+        depths[target] = (uint32_t) depth;
+        pending[(*pending_count)++] = target;
+        return true;
+    }
+    return depths[target] == depth;
+}
+
+/**
+ * \brief Checks the control flow and the operand stack of well-formed bytecode by abstract interpretation.
+ *
+ * Every path from the entry must reach jump targets and loop starts at instruction boundaries, with the same stack
+ * depth whichever path is taken, never pop more values than the stack holds, never push more than `max_stack` and end
+ * with `HALT` on an empty stack. The sites must be located at the instructions using them, since the virtual machine rewrites the
+ * opcode at their offset.
+ * \param bytecode the bytecode, accepted by `validate_bytecode()`
+ * \param header the header of the cache file
+ * \param sites the sites of the binary operators
+ * \param loops the loop records
+ * \param depths the stack depths, filled by `validate_bytecode()`
+ * \return true if the bytecode can be executed safely
+ */
+static bool validate_stack(const uint8_t *bytecode, const CacheHeader *header, const CacheSite *sites,
+                           const CacheLoop *loops, uint32_t *depths) {
+    if (header->max_stack >= UNREACHED) {
+        return false;
+    }
+    for (uint64_t i = 0; i < header->loop_count; i++) {
+        if (depths[loops[i].start] == NOT_INSTRUCTION
+            || (loops[i].end < header->bytecode_size && depths[loops[i].end] == NOT_INSTRUCTION)) {
+            return false;
+        }
+    }
+    // each instruction is pending at most once, when it is reached for the first time
+    size_t *pending = nx_alloc(header->bytecode_size * sizeof(size_t));
+    size_t pending_count = 0;
+    bool valid = reach(header, depths, pending, &pending_count, 0, 0);
+    while (valid && pending_count > 0) {
+        size_t offset = pending[--pending_count];
+        Opcode op = bytecode[offset];
+        if (op == OP_HALT) {
+            // every statement leaves the stack empty
+            if (depths[offset] != 0) {
+                valid = false;
+                break;
+            }
+            continue;
+        }
+        OperandKind kind = code_get_operand_kind(op);
+        uint32_t operand = kind == OPERAND_NONE ? 0 : code_read_operand(bytecode + offset);
+        size_t next = offset + (kind == OPERAND_NONE ? 1 : 1 + OPERAND_SIZE);
+        if (kind == OPERAND_SITE && (sites[operand].offset != offset
+                || (op == OP_COMPARE_JUMP && !ops_is_comparison((BinaryOp) sites[operand].op)))) {
+            valid = false;
+            break;
+        }
+        uint64_t pops, pushes;
+        get_stack_effect(op, operand, &pops, &pushes);
+        if (pops > depths[offset]) {
+            valid = false;
+            break;
+        }
+        uint64_t depth = depths[offset] - pops + pushes;
+        int64_t target = (int64_t) next + (int32_t) operand;
+        switch (op) {
+            case OP_JUMP:
+                valid = reach(header, depths, pending, &pending_count, target, depth);
+                break;
+            case OP_JUMP_IF_FALSE:
+                valid = reach(header, depths, pending, &pending_count, next, depth)
+                        && reach(header, depths, pending, &pending_count, target, depth);
+                break;
+            case OP_LOOP:
+                valid = reach(header, depths, pending, &pending_count, loops[operand].start, depth);
+                break;
+            case OP_FOR_ITER:
+                valid = reach(header, depths, pending, &pending_count, next, depth)
+                        && reach(header, depths, pending, &pending_count, next + 1 + OPERAND_SIZE, depth + 1);
+                break;
+            default:
+                valid = reach(header, depths, pending, &pending_count, next, depth);
+                break;
+        }
+    }
+    nx_free(pending);
+    return valid;
+}
+
+/**
+ * \brief Checks that a text is within the blob.
+ * \param header the header of the cache file
+ * \param offset the offset of the text
+ * \param length the length of the text
+ * \return true if the text is within the blob
+ */
+static bool in_blob(const CacheHeader *header, uint64_t offset, uint64_t length) {
+    return offset <= header->blob_size && length <= header->blob_size - offset;
+}
+
+/**
+ * \brief Checks that a constant is well-formed.
+ * \param header the header of the cache file
+ * \param c the constant
+ * \param blob the texts
+ * \return true if the constant is valid
+ */
+static bool validate_constant(const CacheHeader *header, const CacheConstant *c, const char *blob) {
+    switch (c->kind) {
+        case CONSTANT_INT:
+            return true;
+        case CONSTANT_BIG_INT: {
+            if (!in_blob(header, c->value, c->length) || c->length == 0) {
+                return false;
+            }
+            const char *digits = blob + c->value;
+            size_t negative = digits[0] == '-';
+            for (size_t i = negative; i < c->length; i++) {
+                if (digits[i] < '0' || digits[i] > '9') {
+                    return false;
+                }
+            }
+            return c->length > negative;
+        }
+        case CONSTANT_STR:
+            return in_blob(header, c->value, c->length);
+        default:
+            return false;
+    }
+}
+
+/**
+ * \brief Creates the constants of the program.
+ * \param code the code object, must be rooted
+ * \param constants the constants in the cache file, must be valid
+ * \param header the header of the cache file
+ * \param blob the texts
+ */
+static void load_constants(Code *code, const CacheConstant *constants, const CacheHeader *header, const char *blob) {
+    for (uint64_t i = 0; i < header->constant_count; i++) {
+        const CacheConstant *c = &constants[i];
+        NxObject *value;
+        if (c->kind == CONSTANT_INT) {
+            value = nx_int_create((int64_t) c->value);
+        } else if (c->kind == CONSTANT_BIG_INT) {
+            const char *digits = blob + c->value;
+            size_t negative = digits[0] == '-';
+            value = nx_int_from_str(digits + negative, c->length - negative);
+            if (negative) {
+                value = nx_int_sub(nx_int_create(0), value);
+            }
+        } else {
+            value = nx_str_create(blob + c->value, (int64_t) c->length);
+        }
+        code_add_constant(code, value);
+    }
+}
+
+bool code_cache_load(CodeCache *cache, const char *path, const Source *source, uint32_t flags, Env *env, Code *code) {
+    *cache = (CodeCache) {.data = NULL, .size = 0};
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(CacheHeader)) {
+        close(fd);
+        return false;
+    }
+    size_t size = (size_t) st.st_size;
+    void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    const CacheHeader *header = data;
+    CacheHeader expected;
+    init_header(&expected, source, flags);
+    // the counts are bounded before computing the sizes of the sections, so that they cannot overflow
+    uint64_t limit = size;
+    if (memcmp(header, &expected, offsetof(CacheHeader, bytecode_size)) != 0
+        || header->bytecode_size > limit || header->constant_count > limit || header->slot_count > limit
+        || header->site_count > limit || header->loop_count > limit || header->line_count > limit
+        || header->blob_size > limit
+        || header->max_stack > header->bytecode_size
+        || header->slot_count > UINT32_MAX
+        || sizeof(CacheHeader) + align8(header->bytecode_size) + header->constant_count * sizeof(CacheConstant)
+           + header->slot_count * sizeof(CacheName) + header->site_count * sizeof(CacheSite)
+           + header->loop_count * sizeof(CacheLoop) + header->line_count * sizeof(CacheLine)
+           + header->blob_size != size
+        || code_cache_hash_bytes(header + 1, size - sizeof(CacheHeader)) != header->payload_hash) {
+        munmap(data, size);
+        return false;
+    }
+    const uint8_t *bytecode = (const uint8_t *) (header + 1);
+    const CacheConstant *constants = (const CacheConstant *) (bytecode + align8(header->bytecode_size));
+    const CacheName *names = (const CacheName *) (constants + header->constant_count);
+    const CacheSite *sites = (const CacheSite *) (names + header->slot_count);
+    const CacheLoop *loops = (const CacheLoop *) (sites + header->site_count);
+    const CacheLine *lines = (const CacheLine *) (loops + header->loop_count);
+    const char *blob = (const char *) (lines + header->line_count);
+    bool valid = header->bytecode_size > 0;
+    for (uint64_t i = 0; valid && i < header->slot_count; i++) {
+        valid = in_blob(header, names[i].offset, names[i].length);
+    }
+    for (uint64_t i = 0; valid && i < header->site_count; i++) {
+        valid = sites[i].offset < header->bytecode_size && sites[i].op < BINOP_COUNT && sites[i].temporary <= 1;
+    }
+    for (uint64_t i = 0; valid && i < header->loop_count; i++) {
+        valid = loops[i].start < loops[i].end && loops[i].end <= header->bytecode_size;
+    }
+    if (valid) {
+        // a corrupted file must be rejected here, the virtual machine trusts the bytecode
+        uint32_t *depths = nx_alloc(header->bytecode_size * sizeof(uint32_t));
+        memset(depths, 0xff, header->bytecode_size * sizeof(uint32_t));
+        valid = validate_bytecode(bytecode, header, depths) && validate_stack(bytecode, header, sites, loops, depths);
+        nx_free(depths);
+    }
+    for (uint64_t i = 0; valid && i < header->line_count; i++) {
+        valid = lines[i].offset <= header->bytecode_size && lines[i].position < header->source_size
+                && (i == 0 || lines[i].offset >= lines[i - 1].offset)
+                && (lines[i].parent == CODE_NO_PARENT || lines[i].parent < i);
+    }
+    for (uint64_t i = 0; valid && i < header->constant_count; i++) {
+        valid = validate_constant(header, &constants[i], blob);
+    }
+    if (!valid) {
+        munmap(data, size);
+        return false;
+    }
+    load_constants(code, constants, header, blob);
+    for (uint64_t i = 0; i < header->slot_count; i++) {
+        const char *name = blob + names[i].offset;
+        env_declare(env, name, names[i].length);
+        code_set_slot_name(code, (uint32_t) i, name, names[i].length);
+    }
+    code->bytecode = nx_alloc(header->bytecode_size);
+    memcpy(code->bytecode, bytecode, header->bytecode_size);
+    code->bytecode_size = code->bytecode_capacity = header->bytecode_size;
+    for (uint64_t i = 0; i < header->site_count; i++) {
+        code_add_site(code, (BinaryOp) sites[i].op, sites[i].temporary);
+        code->sites[i].offset = sites[i].offset;
+    }
+    for (uint64_t i = 0; i < header->loop_count; i++) {
+        code_add_loop(code, loops[i].start);
+        code->loops[i].end = loops[i].end;
+    }
+    for (uint64_t i = 0; i < header->line_count; i++) {
+        code_add_line(code, source->start + lines[i].position, (uint32_t) lines[i].parent);
+        code->lines[i].offset = lines[i].offset;
+    }
+    code->max_stack = header->max_stack;
+    cache->data = data;
+    cache->size = size;
+    return true;
+}
+
+void code_cache_close(CodeCache *cache) {
+    if (cache->data) {
+        munmap(cache->data, cache->size);
+    }
+    *cache = (CodeCache) {.data = NULL, .size = 0};
+}
+
+/**
+ * \brief Appends bytes to the contents of a cache file.
+ * \param sb the contents
+ * \param data the bytes
+ * \param length the number of bytes
+ */
+static void append(StringBuilder *sb, const void *data, size_t length) {
+    sb_append_str_len(sb, data, length);
+}
+
+bool code_cache_save(const char *path, const Source *source, uint32_t flags, const Env *env, const Code *code) {
+    CacheHeader header;
+    init_header(&header, source, flags);
+    header.bytecode_size = code->bytecode_size;
+    header.constant_count = code->constant_count;
+    header.slot_count = env->count;
+    header.site_count = code->site_count;
+    header.loop_count = code->loop_count;
+    header.line_count = code->line_count;
+    header.max_stack = code->max_stack;
+
+    StringBuilder blob = sb_init();
+    StringBuilder sb = sb_init();
+    append(&sb, &header, sizeof(header));
+    append(&sb, code->bytecode, code->bytecode_size);
+    append(&sb, "\0\0\0\0\0\0\0", align8(code->bytecode_size) - code->bytecode_size);
+    for (size_t i = 0; i < code->constant_count; i++) {
+        NxObject *value = code->constants[i];
+        CacheConstant c = {.kind = CONSTANT_INT, .value = 0, .length = 0};
+        if (nx_int_is_instance(value) && nx_int_fits_int64(value)) {
+            c.value = (uint64_t) nx_int_get_value(value);
+        } else {
+            c.value = blob.length;
+            if (nx_int_is_instance(value)) {
+                c.kind = CONSTANT_BIG_INT;
+                nx_int_append_to(&blob, value);
+            } else {
+                c.kind = CONSTANT_STR;
+                sb_append_str_len(&blob, nx_str_get_data(value), nx_str_get_length(value));
+            }
+            c.length = blob.length - c.value;
+        }
+        append(&sb, &c, sizeof(c));
+    }
+    for (size_t i = 0; i < env->count; i++) {
+        CacheName name = {.offset = blob.length, .length = env->names[i].length};
+        sb_append_str_len(&blob, env->names[i].start, env->names[i].length);
+        append(&sb, &name, sizeof(name));
+    }
+    for (size_t i = 0; i < code->site_count; i++) {
+        const CodeSite *code_site = &code->sites[i];
+        CacheSite site = {.offset = code_site->offset, .op = code_site->op, .temporary = code_site->temporary};
+        append(&sb, &site, sizeof(site));
+    }
+    for (size_t i = 0; i < code->loop_count; i++) {
+        CacheLoop loop = {.start = code->loops[i].start, .end = code->loops[i].end};
+        append(&sb, &loop, sizeof(loop));
+    }
+    for (size_t i = 0; i < code->line_count; i++) {
+        CacheLine line = {
+                .offset = code->lines[i].offset,
+                .position = code->lines[i].position - source->start,
+                .parent = code->lines[i].parent,
+        };
+        append(&sb, &line, sizeof(line));
+    }
+    append(&sb, blob.str, blob.length);
+    memcpy(sb.str + offsetof(CacheHeader, blob_size), &blob.length, sizeof(uint64_t));
+    sb_free(&blob);
+    uint64_t payload_hash = code_cache_hash_bytes(sb.str + sizeof(CacheHeader), sb.length - sizeof(CacheHeader));
+    memcpy(sb.str + offsetof(CacheHeader, payload_hash), &payload_hash, sizeof(uint64_t));
+
+    StringBuilder tmp = sb_init();
+    sb_append_formatted(&tmp, "%s.%d.tmp", path, (int) getpid());
+    FILE *f = fopen(tmp.str, "wb");
+    bool ok = f != NULL;
+    if (f) {
+        ok = fwrite(sb.str, 1, sb.length, f) == sb.length;
+        ok &= fclose(f) == 0;
+        ok = ok && rename(tmp.str, path) == 0;
+        if (!ok) {
+            unlink(tmp.str);
+        }
+    }
+    sb_free(&tmp);
+    sb_free(&sb);
+    return ok;
+}
@@ -0,0 +1,419 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file compiler.c
+ * \brief Implementation of the bytecode compiler.
+ */
+
+#include "natrix/compiler/compiler.h"
+#include <assert.h>
+#include <stdbool.h>
+#include "natrix/interp/builtins.h"
+#include "natrix/interp/ops.h"
+#include "natrix/obj/nx_int.h"
+#include "natrix/util/panic.h"
+
+/**
+ * \brief Internal state of the compiler.
+ */
+typedef struct {
+    Code *code;                     //!< code object being generated
+    const LiteralPool *literals;    //!< values of the literals of the program
+    size_t stack_depth;             //!< depth of the operand stack at the current instruction
+    uint32_t line;                  //!< entry of the line table of the statement being compiled
+    uint32_t loop_depth;            //!< number of loops enclosing the current statement
+    bool temporaries;               //!< whether the current statement has a site allocating temporaries
+} Compiler;
+
+/**
+ * \brief Updates the tracked depth of the operand stack after emitting an instruction.
+ * \param compiler the compiler state
+ * \param pops number of values the instruction pops from the stack
+ * \param pushes number of values the instruction pushes onto the stack
+ */
+static void adjust_stack(Compiler *compiler, size_t pops, size_t pushes) {
+    assert(compiler->stack_depth >= pops);
+    compiler->stack_depth = compiler->stack_depth - pops + pushes;
+    if (compiler->stack_depth > compiler->code->max_stack) {
+        compiler->code->max_stack = compiler->stack_depth;
+    }
+}
+
+/**
+ * \brief Emits an instruction without an operand.
+ * \param compiler the compiler state
+ * \param op the opcode
+ * \param pops number of values the instruction pops from the stack
+ * \param pushes number of values the instruction pushes onto the stack
+ * \return offset of the instruction
+ */
+static size_t emit(Compiler *compiler, Opcode op, size_t pops, size_t pushes) {
+    adjust_stack(compiler, pops, pushes);
+    return code_emit(compiler->code, op);
+}
+
+/**
+ * \brief Emits an instruction with an operand.
+ * \param compiler the compiler state
+ * \param op the opcode
+ * \param operand the operand
+ * \param pops number of values the instruction pops from the stack
+ * \param pushes number of values the instruction pushes onto the stack
+ * \return offset of the instruction
+ */
+static size_t emit_with_operand(Compiler *compiler, Opcode op, uint32_t operand, size_t pops, size_t pushes) {
+    adjust_stack(compiler, pops, pushes);
+    return code_emit_with_operand(compiler->code, op, operand);
+}
+
+/**
+ * \brief Emits an instruction pushing a constant.
+ * \param compiler the compiler state
+ * \param value the constant, must be rooted
+ */
+static void emit_constant(Compiler *compiler, NxObject *value) {
+    emit_with_operand(compiler, OP_CONST, code_add_constant(compiler->code, value), 0, 1);
+}
+
+/**
+ * \brief Returns the slot of a resolved variable and records its name for the disassembler.
+ * \param compiler the compiler state
+ * \param name the name node, must be resolved
+ * \return the slot of the variable
+ */
+static uint32_t resolve_slot(Compiler *compiler, const ExprName *name) {
+    assert(name->slot != AST_UNRESOLVED);
+    code_set_slot_name(compiler->code, name->slot, name->start, name->end - name->start);
+    return name->slot;
+}
+
+/**
+ * \brief Opcodes implementing the binary operators.
+ */
+static const Opcode BINOP_OPCODES[] = {
+        [BINOP_ADD] = OP_ADD,
+        [BINOP_SUB] = OP_SUB,
+        [BINOP_MUL] = OP_MUL,
+        [BINOP_DIV] = OP_DIV,
+        [BINOP_EQ] = OP_EQ,
+        [BINOP_NE] = OP_NE,
+        [BINOP_LT] = OP_LT,
+        [BINOP_LE] = OP_LE,
+        [BINOP_GT] = OP_GT,
+        [BINOP_GE] = OP_GE,
+};
+
+/**
+ * \brief Compiles an expression, leaving its value on the top of the operand stack.
+ * \param compiler the compiler state
+ * \param expr the expression
+ */
+static void compile_expr(Compiler *compiler, const Expr *expr) {
+    switch (expr->kind) {
+        case EXPR_INT_LITERAL:
+        case EXPR_STR_LITERAL:
+            assert(expr->literal.index < compiler->literals->count);
+            emit_constant(compiler, literal_pool_get(compiler->literals, expr->literal.index));
+            break;
+        case EXPR_LIST_LITERAL: {
+            uint32_t cnt = 0;
+            for (const Expr *e = expr->literal.head; e; e = e->next) {
+                compile_expr(compiler, e);
+                cnt++;
+            }
+            emit_with_operand(compiler, OP_LIST, cnt, cnt, 1);
+            break;
+        }
+        case EXPR_DICT_LITERAL: {
+            uint32_t cnt = 0;
+            for (const Expr *e = expr->literal.head; e; e = e->next) {
+                compile_expr(compiler, e);
+                cnt++;
+            }
+            emit_with_operand(compiler, OP_DICT, cnt / 2, cnt, 1);
+            break;
+        }
+        case EXPR_NAME:
+            emit_with_operand(compiler, OP_LOAD_VAR, resolve_slot(compiler, &expr->identifier), 0, 1);
+            break;
+        case EXPR_BINARY:
+            assert(expr->binary.op >= 0 && expr->binary.op < BINOP_COUNT);
+            compile_expr(compiler, expr->binary.left);
+            compile_expr(compiler, expr->binary.right);
+            compiler->temporaries |= expr->binary.temporary;
+            emit_with_operand(compiler, BINOP_OPCODES[expr->binary.op],
+                              code_add_site(compiler->code, expr->binary.op, expr->binary.temporary), 2, 1);
+            break;
+        case EXPR_SUBSCRIPT:
+            compile_expr(compiler, expr->subscript.receiver);
+            compile_expr(compiler, expr->subscript.index);
+            emit(compiler, OP_GET_ELEMENT, 2, 1);
+            break;
+        case EXPR_SLICE:
+            // omitted bounds are replaced by bounds that are clamped to the start and the end of the sequence
+            compile_expr(compiler, expr->slice.receiver);
+            if (expr->slice.lower) {
+                compile_expr(compiler, expr->slice.lower);
+            } else {
+                emit_constant(compiler, nx_int_create(0));
+            }
+            if (expr->slice.upper) {
+                compile_expr(compiler, expr->slice.upper);
+            } else {
+                emit_constant(compiler, nx_int_create(INT64_MAX));
+            }
+            emit(compiler, OP_GET_SLICE, 3, 1);
+            break;
+        case EXPR_CALL: {
+            uint32_t argc = 0;
+            for (const Expr *e = expr->call.args; e; e = e->next) {
+                compile_expr(compiler, e);
+                argc++;
+            }
+            assert(expr->call.callee->identifier.slot != AST_UNRESOLVED);
+            emit_with_operand(compiler, OP_CALL, code_call_operand(expr->call.callee->identifier.slot, argc), argc, 1);
+            break;
+        }
+        default:
+            assert(0 && "Invalid ExprKind");
+    }
+}
+
+/**
+ * \brief Compiles the assignment of an expression to a variable.
+ *
+ * An assignment such as `n = n - 1` or `i = j + 2` starts with the superinstruction `UPDATE_VAR` in place of
+ * `LOAD_VAR`, the rest of the sequence is emitted as usual.
+ * \param compiler the compiler state
+ * \param name the assigned variable
+ * \param value the assigned expression
+ */
+static void compile_store(Compiler *compiler, const ExprName *name, const Expr *value) {
+    size_t start = compiler->code->bytecode_size;
+    compile_expr(compiler, value);
+    emit_with_operand(compiler, OP_STORE_VAR, resolve_slot(compiler, name), 1, 0);
+    if (value->kind == EXPR_BINARY && value->binary.left->kind == EXPR_NAME
+            && value->binary.right->kind == EXPR_INT_LITERAL) {
+        assert(compiler->code->bytecode[start] == OP_LOAD_VAR);
+        compiler->code->bytecode[start] = OP_UPDATE_VAR;
+    }
+}
+
+/**
+ * \brief Compiles an augmented assignment such as `a += b` or `a[i] += b`.
+ *
+ * The target is evaluated once: a subscript target leaves its receiver and index on the stack and duplicates them for
+ * `GET_ELEMENT`, the final `SET_ELEMENT` consumes the originals. `+=` is compiled to `INPLACE`, which extends a list
+ * in place, the other operators use the adaptive instructions. A variable updated by an integer literal, e.g.
+ * `n -= 1`, starts with `UPDATE_VAR` just like `n = n - 1`.
+ * \param compiler the compiler state
+ * \param stmt the `STMT_AUG_ASSIGNMENT` statement
+ */
+static void compile_aug_assignment(Compiler *compiler, const Stmt *stmt) {
+    const Expr *left = stmt->assignment.left;
+    BinaryOp op = stmt->assignment.op;
+    assert(op >= 0 && op < BINOP_COUNT && !ops_is_comparison(op));
+    size_t start = compiler->code->bytecode_size;
+    if (left->kind == EXPR_NAME) {
+        compile_expr(compiler, left);
+    } else {
+        assert(left->kind == EXPR_SUBSCRIPT);
+        compile_expr(compiler, left->subscript.receiver);
+        compile_expr(compiler, left->subscript.index);
+        emit(compiler, OP_DUP_TWO, 2, 4);
+        emit(compiler, OP_GET_ELEMENT, 2, 1);
+    }
+    compile_expr(compiler, stmt->assignment.right);
+    emit_with_operand(compiler, op == BINOP_ADD ? OP_INPLACE : BINOP_OPCODES[op], code_add_site(compiler->code, op, false), 2, 1);
+    if (left->kind == EXPR_SUBSCRIPT) {
+        emit(compiler, OP_SET_ELEMENT, 3, 0);
+        return;
+    }
+    emit_with_operand(compiler, OP_STORE_VAR, resolve_slot(compiler, &left->identifier), 1, 0);
+    if (stmt->assignment.right->kind == EXPR_INT_LITERAL) {
+        assert(compiler->code->bytecode[start] == OP_LOAD_VAR);
+        compiler->code->bytecode[start] = OP_UPDATE_VAR;
+    }
+}
+
+/**
+ * \brief Compiles the condition of a `while` or `if` statement followed by a conditional jump to be patched.
+ *
+ * A comparison is emitted as the superinstruction `COMPARE_JUMP`, which also executes the jump.
+ * \param compiler the compiler state
+ * \param condition the condition
+ * \return offset of the `JUMP_IF_FALSE` instruction
+ */
+static size_t compile_condition(Compiler *compiler, const Expr *condition) {
+    compile_expr(compiler, condition);
+    if (condition->kind == EXPR_BINARY && ops_is_comparison(condition->binary.op)) {
+        size_t compare = compiler->code->bytecode_size - 1 - OPERAND_SIZE;
+        assert(compiler->code->bytecode[compare] == BINOP_OPCODES[condition->binary.op]);
+        compiler->code->bytecode[compare] = OP_COMPARE_JUMP;
+    }
+    return emit_with_operand(compiler, OP_JUMP_IF_FALSE, 0, 1, 0);
+}
+
+static void compile_stmts(Compiler *compiler, const Stmt *stmt);
+
+/**
+ * \brief Determines whether the list of statements does nothing, i.e. contains only `STMT_PASS` statements.
+ * \param stmt the first statement in the list, may be NULL
+ * \return true if the statements do nothing
+ */
+static bool is_empty_body(const Stmt *stmt) {
+    while (stmt) {
+        if (stmt->kind != STMT_PASS) {
+            return false;
+        }
+        stmt = stmt->next;
+    }
+    return true;
+}
+
+/**
+ * \brief Compiles a statement, the operand stack is left unchanged.
+ *
+ * A statement outside of loops which allocates temporaries is followed by `RELEASE_TEMPS`, see opcodes.inc.
+ * \param compiler the compiler state
+ * \param stmt the statement
+ */
+static void compile_stmt(Compiler *compiler, const Stmt *stmt) {
+    const char *position = ast_get_stmt_position(stmt);
+    uint32_t parent = compiler->line;
+    if (position) {
+        compiler->line = code_add_line(compiler->code, position, parent);
+    }
+    bool enclosing_temporaries = compiler->temporaries;
+    compiler->temporaries = false;
+    switch (stmt->kind) {
+        case STMT_EXPR:
+            compile_expr(compiler, stmt->expr);
+            emit(compiler, OP_POP, 1, 0);
+            break;
+        case STMT_ASSIGNMENT: {
+            const Expr *left = stmt->assignment.left;
+            if (left->kind == EXPR_NAME) {
+                compile_store(compiler, &left->identifier, stmt->assignment.right);
+            } else if (left->kind == EXPR_SUBSCRIPT) {
+                compile_expr(compiler, left->subscript.receiver);
+                compile_expr(compiler, left->subscript.index);
+                compile_expr(compiler, stmt->assignment.right);
+                emit(compiler, OP_SET_ELEMENT, 3, 0);
+            } else {
+                assert(0);
+            }
+            break;
+        }
+        case STMT_AUG_ASSIGNMENT:
+            compile_aug_assignment(compiler, stmt);
+            break;
+        case STMT_WHILE: {
+            size_t loop = compiler->code->bytecode_size;
+            size_t exit_jump = compile_condition(compiler, stmt->while_stmt.condition);
+            compiler->loop_depth++;
+            compile_stmts(compiler, stmt->while_stmt.body);
+            compiler->loop_depth--;
+            code_add_line(compiler->code, position, parent);
+            emit_with_operand(compiler, OP_LOOP, code_add_loop(compiler->code, loop), 0, 0);
+            code_patch_jump(compiler->code, exit_jump, compiler->code->bytecode_size);
+            break;
+        }
+        case STMT_FOR: {
+            const Expr *iterable = stmt->for_stmt.iterable;
+            if (builtin_is_range_call(iterable)) {
+                uint32_t argc = 0;
+                for (const Expr *e = iterable->call.args; e; e = e->next) {
+                    compile_expr(compiler, e);
+                    argc++;
+                }
+                emit_with_operand(compiler, OP_RANGE, argc, argc, 1);
+            } else {
+                compile_expr(compiler, iterable);
+            }
+            uint32_t slot = stmt->for_stmt.iter_slot;
+            assert(slot != AST_UNRESOLVED);
+            emit_with_operand(compiler, OP_STORE_VAR, slot, 1, 0);
+            emit_constant(compiler, nx_int_create(0));
+            emit_with_operand(compiler, OP_STORE_VAR, slot + 1, 1, 0);
+            size_t loop = emit_with_operand(compiler, OP_FOR_ITER, slot, 0, 0);
+            size_t exit_jump = emit_with_operand(compiler, OP_JUMP, 0, 0, 0);
+            // the item is only pushed when the jump is skipped
+            adjust_stack(compiler, 0, 1);
+            emit_with_operand(compiler, OP_STORE_VAR, resolve_slot(compiler, &stmt->for_stmt.target->identifier), 1, 0);
+            compiler->loop_depth++;
+            compile_stmts(compiler, stmt->for_stmt.body);
+            compiler->loop_depth--;
+            code_add_line(compiler->code, position, parent);
+            emit_with_operand(compiler, OP_LOOP, code_add_loop(compiler->code, loop), 0, 0);
+            code_patch_jump(compiler->code, exit_jump, compiler->code->bytecode_size);
+            break;
+        }
+        case STMT_IF: {
+            size_t else_jump = compile_condition(compiler, stmt->if_stmt.condition);
+            compile_stmts(compiler, stmt->if_stmt.then_body);
+            if (is_empty_body(stmt->if_stmt.else_body)) {
+                code_patch_jump(compiler->code, else_jump, compiler->code->bytecode_size);
+            } else {
+                code_add_line(compiler->code, position, parent);
+                size_t end_jump = emit_with_operand(compiler, OP_JUMP, 0, 0, 0);
+                code_patch_jump(compiler->code, else_jump, compiler->code->bytecode_size);
+                compile_stmts(compiler, stmt->if_stmt.else_body);
+                code_patch_jump(compiler->code, end_jump, compiler->code->bytecode_size);
+            }
+            break;
+        }
+        case STMT_PASS:
+            break;
+        case STMT_PRINT:
+            compile_expr(compiler, stmt->expr);
+            emit(compiler, OP_PRINT, 1, 0);
+            break;
+        default:
+            assert(0 && "Invalid StmtKind");
+    }
+    assert(compiler->stack_depth == 0);
+    if (compiler->temporaries && compiler->loop_depth == 0) {
+        if (stmt->kind == STMT_IF && position) {
+            // the instruction belongs to the condition rather than to the last statement of a body
+            code_add_line(compiler->code, position, parent);
+        }
+        emit(compiler, OP_RELEASE_TEMPS, 0, 0);
+    }
+    compiler->temporaries |= enclosing_temporaries;
+    compiler->line = parent;
+}
+
+/**
+ * \brief Compiles a list of statements.
+ * \param compiler the compiler state
+ * \param stmt the first statement in the list
+ */
+static void compile_stmts(Compiler *compiler, const Stmt *stmt) {
+    while (stmt) {
+        compile_stmt(compiler, stmt);
+        stmt = stmt->next;
+    }
+}
+
+void compile_program(Code *code, const LiteralPool *literals, const Stmt *stmt) {
+    assert(code->bytecode_size == 0);
+    Compiler compiler = {
+            .code = code,
+            .literals = literals,
+            .stack_depth = 0,
+            .line = CODE_NO_PARENT,
+            .loop_depth = 0,
+            .temporaries = false,
+    };
+    compile_stmts(&compiler, stmt);
+    emit(&compiler, OP_HALT, 0, 0);
+    if (code->bytecode_size > INT32_MAX) {
+        PANIC("Program too large");
+    }
+}
@@ -0,0 +1,678 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file jit.c
+ * \brief Implementation of the loop compiler.
+ *
+ * The native code uses the following frame, with `r12` pointing to the values of the variables, `r13` to the
+ * top of the operand stack of the interpreter and `rsp` to the unboxed variables followed by the unboxed operand
+ * stack:
+ * \code
+ *     [rsp + 8 * i]               variable i of the loop, see `Jit.slots`
+ *     [rsp + 8 * (count + j)]     operand stack entry j
+ *     [rsp + 8 * (count + max)]   safepoint polled at the back edges, `max` being the maximum stack depth
+ * \endcode
+ */
+
+#include "natrix/compiler/jit.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "natrix/interp/ops.h"
+#include "natrix/obj/nx_int.h"
+#include "natrix/util/mem.h"
+#include "natrix/util/panic.h"
+#include "natrix/util/safepoint.h"
+
+/**
+ * \brief Native code of a loop.
+ */
+struct JitCode {
+    void *memory;                   //!< Executable mapping containing the code
+    size_t size;                    //!< Size of the mapping
+    JitExit (*entry)(NxObject **values, NxObject **stack, Safepoint *safepoint);  //!< Entry point of the loop
+};
+
+//! Current policy of the loop compiler, `enabled` is masked by `jit_is_supported()` when the policy is read.
+static JitPolicy jit_policy = {
+        .enabled = true,
+        .threshold = JIT_DEFAULT_THRESHOLD,
+        .perf_map = false,
+};
+
+JitPolicy jit_default_policy() {
+    return (JitPolicy) {
+        .enabled = jit_is_supported(),
+        .threshold = JIT_DEFAULT_THRESHOLD,
+        .perf_map = false,
+    };
+}
+
+JitPolicy jit_get_policy() {
+    JitPolicy policy = jit_policy;
+    policy.enabled &= jit_is_supported();
+    return policy;
+}
+
+void jit_set_policy(const JitPolicy *policy) {
+    if (policy->threshold == 0) {
+        PANIC("Invalid loop compiler policy");
+    }
+    jit_policy = *policy;
+}
+
+bool jit_is_supported() {
+#if defined(__x86_64__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+JitExit jit_enter(const JitCode *native, NxObject **values, NxObject **stack, Safepoint *safepoint) {
+    return native->entry(values, stack, safepoint);
+}
+
+void jit_free(JitCode *native) {
+    if (native) {
+        munmap(native->memory, native->size);
+        nx_free(native);
+    }
+}
+
+#if defined(__x86_64__)
+
+//! Marks an unknown stack depth or a slot without a variable of the loop.
+#define UNKNOWN UINT32_MAX
+
+/**
+ * \brief Reference to code which is resolved once its address is known.
+ */
+typedef struct {
+    size_t at;                      //!< Position of the 32-bit relative displacement to patch
+    size_t offset;                  //!< Bytecode offset the reference jumps to
+    uint32_t depth;                 //!< Depth of the operand stack at the target, used by exits
+} Fixup;
+
+/**
+ * \brief State of the loop compiler.
+ */
+typedef struct {
+    const Code *code;               //!< The code object
+    const CodeLoop *loop;           //!< The compiled loop
+    uint8_t *buf;                   //!< Generated machine code
+    size_t size;                    //!< Number of bytes in `buf`
+    size_t capacity;                //!< Capacity of `buf`
+    uint32_t *slots;                //!< Slots of the variables of the loop
+    bool *assigned;                 //!< Whether the variable is assigned by the loop, indexed like `slots`
+    uint32_t count;                 //!< Number of variables of the loop
+    uint32_t *local_of_slot;        //!< Index into `slots` for each slot, `UNKNOWN` if not used by the loop
+    uint32_t slot_limit;            //!< One more than the highest slot used by the loop
+    size_t *labels;                 //!< Position of the code of each instruction, indexed by offset from the start
+    uint32_t *depths;               //!< Stack depth at jump targets, indexed by offset from the start
+    Fixup *jumps;                   //!< Forward jumps within the loop
+    size_t jump_count;              //!< Number of forward jumps
+    Fixup *exits;                   //!< Jumps to the exit stubs returning to the interpreter
+    size_t exit_count;              //!< Number of exits
+    size_t capacity_jumps;          //!< Capacity of `jumps`
+    size_t capacity_exits;          //!< Capacity of `exits`
+} Jit;
+
+//! Registers used by the generated code.
+enum {
+    RAX = 0,
+    RCX = 1,
+    RDX = 2,
+    RSP = 4,
+    R12 = 12,
+    R13 = 13,
+};
+
+//! Condition codes of `jcc` and `setcc`.
+enum {
+    CC_O = 0x0,
+    CC_E = 0x4,
+    CC_NE = 0x5,
+    CC_L = 0xC,
+    CC_GE = 0xD,
+    CC_LE = 0xE,
+    CC_G = 0xF,
+};
+
+/**
+ * \brief Appends machine code to the buffer.
+ * \param jit the compiler state
+ * \param bytes the machine code
+ * \param length the number of bytes
+ */
+static void emit(Jit *jit, const void *bytes, size_t length) {
+    if (jit->size + length > jit->capacity) {
+        jit->capacity = jit->capacity ? jit->capacity * 2 : 4096;
+        jit->buf = nx_realloc(jit->buf, jit->capacity);
+    }
+    memcpy(jit->buf + jit->size, bytes, length);
+    jit->size += length;
+}
+
+static void emit_byte(Jit *jit, uint8_t byte) {
+    emit(jit, &byte, 1);
+}
+
+static void emit_u32(Jit *jit, uint32_t value) {
+    emit(jit, &value, 4);
+}
+
+/**
+ * \brief Emits an instruction with a 64-bit register operand and a `[base + disp32]` memory operand.
+ * \param jit the compiler state
+ * \param opcode the opcode, prefixed with `0x0F` if it is two bytes long
+ * \param reg the register operand
+ * \param base the base register of the memory operand
+ * \param disp the displacement of the memory operand
+ */
+static void emit_mem(Jit *jit, uint16_t opcode, int reg, int base, int32_t disp) {
+    emit_byte(jit, 0x48 | (reg >= 8 ? 4 : 0) | (base >= 8 ? 1 : 0));
+    if (opcode > 0xFF) {
+        emit_byte(jit, opcode >> 8);
+    }
+    emit_byte(jit, opcode & 0xFF);
+    emit_byte(jit, 0x80 | (reg & 7) << 3 | (base & 7));
+    if ((base & 7) == RSP) {
+        emit_byte(jit, 0x24);
+    }
+    emit_u32(jit, (uint32_t) disp);
+}
+
+//! Opcodes of the instructions with a memory operand.
+enum {
+    MOV_LOAD = 0x8B,
+    MOV_STORE = 0x89,
+    ADD_LOAD = 0x03,
+    SUB_LOAD = 0x2B,
+    CMP_LOAD = 0x3B,
+    IMUL_LOAD = 0x0FAF,
+};
+
+/**
+ * \brief Returns the displacement of a variable of the loop in the frame.
+ * \param index the index of the variable in `Jit.slots`
+ * \return the displacement relative to `rsp`
+ */
+static int32_t local_disp(uint32_t index) {
+    return (int32_t) (8 * index);
+}
+
+/**
+ * \brief Returns the displacement of an operand stack entry in the frame.
+ * \param jit the compiler state
+ * \param depth the index of the entry, counted from the bottom of the stack
+ * \return the displacement relative to `rsp`
+ */
+static int32_t stack_disp(const Jit *jit, uint32_t depth) {
+    return (int32_t) (8 * (jit->count + depth));
+}
+
+/**
+ * \brief Returns the displacement of the pointer to the safepoint in the frame.
+ * \param jit the compiler state
+ * \return the displacement relative to `rsp`
+ */
+static int32_t safepoint_disp(const Jit *jit) {
+    return stack_disp(jit, (uint32_t) jit->code->max_stack);
+}
+
+/**
+ * \brief Emits a conditional or unconditional jump with a displacement to be patched.
+ * \param jit the compiler state
+ * \param cc the condition code, -1 for an unconditional jump
+ * \return position of the displacement
+ */
+static size_t emit_jump(Jit *jit, int cc) {
+    if (cc < 0) {
+        emit_byte(jit, 0xE9);
+    } else {
+        emit_byte(jit, 0x0F);
+        emit_byte(jit, 0x80 | cc);
+    }
+    size_t at = jit->size;
+    emit_u32(jit, 0);
+    return at;
+}
+
+/**
+ * \brief Sets the displacement of a jump.
+ * \param jit the compiler state
+ * \param at the position of the displacement returned by `emit_jump()`
+ * \param target the position of the target
+ */
+static void patch(Jit *jit, size_t at, size_t target) {
+    int32_t rel = (int32_t) ((int64_t) target - (int64_t) (at + 4));
+    memcpy(jit->buf + at, &rel, 4);
+}
+
+/**
+ * \brief Appends a fixup to a growable array.
+ * \param fixups pointer to the array
+ * \param count pointer to the number of fixups
+ * \param capacity pointer to the capacity of the array
+ * \param fixup the fixup to append
+ */
+static void add_fixup(Fixup **fixups, size_t *count, size_t *capacity, Fixup fixup) {
+    if (*count == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 16;
+        *fixups = nx_realloc(*fixups, *capacity * sizeof(Fixup));
+    }
+    (*fixups)[(*count)++] = fixup;
+}
+
+/**
+ * \brief Emits a conditional jump to an exit stub resuming the interpreter at the given instruction.
+ * \param jit the compiler state
+ * \param cc the condition code, -1 for an unconditional jump
+ * \param offset the bytecode offset of the instruction
+ * \param depth the depth of the operand stack before the instruction
+ */
+static void emit_exit(Jit *jit, int cc, size_t offset, uint32_t depth) {
+    Fixup fixup = {.at = emit_jump(jit, cc), .offset = offset, .depth = depth};
+    add_fixup(&jit->exits, &jit->exit_count, &jit->capacity_exits, fixup);
+}
+
+/**
+ * \brief Records the stack depth at a jump target, checking it is consistent with other jumps to it.
+ * \param jit the compiler state
+ * \param target the offset of the target
+ * \param depth the depth of the operand stack at the target
+ * \return true if the depth is consistent
+ */
+static bool set_depth(Jit *jit, size_t target, uint32_t depth) {
+    uint32_t *known = &jit->depths[target - jit->loop->start];
+    if (*known != UNKNOWN && *known != depth) {
+        return false;
+    }
+    *known = depth;
+    return true;
+}
+
+/**
+ * \brief Emits a jump to a bytecode offset within the loop or to its end.
+ * \param jit the compiler state
+ * \param cc the condition code, -1 for an unconditional jump
+ * \param ip the offset of the jump instruction
+ * \param target the target offset
+ * \param depth the depth of the operand stack at the target
+ * \return true if the jump is supported
+ */
+static bool emit_branch(Jit *jit, int cc, size_t ip, size_t target, uint32_t depth) {
+    if (target == jit->loop->end) {
+        emit_exit(jit, cc, target, depth);
+        return depth == 0;
+    }
+    if (target <= ip || target > jit->loop->end || !set_depth(jit, target, depth)) {
+        return false;
+    }
+    Fixup fixup = {.at = emit_jump(jit, cc), .offset = target, .depth = depth};
+    add_fixup(&jit->jumps, &jit->jump_count, &jit->capacity_jumps, fixup);
+    return true;
+}
+
+/**
+ * \brief Collects the variables used by the loop and determines which of them are assigned.
+ * \param jit the compiler state
+ */
+static void collect_slots(Jit *jit) {
+    const Code *code = jit->code;
+    jit->slot_limit = 0;
+    for (size_t ip = jit->loop->start; ip < jit->loop->end;) {
+        Opcode op = code->bytecode[ip];
+        if (code_get_operand_kind(op) == OPERAND_SLOT) {
+            uint32_t slot = code_read_operand(code->bytecode + ip);
+            if (slot >= jit->slot_limit) {
+                jit->slot_limit = slot + 1;
+            }
+        }
+        ip += code_get_operand_kind(op) == OPERAND_NONE ? 1 : 1 + OPERAND_SIZE;
+    }
+    jit->local_of_slot = nx_alloc((jit->slot_limit + 1) * sizeof(uint32_t));
+    jit->slots = nx_alloc((jit->slot_limit + 1) * sizeof(uint32_t));
+    jit->assigned = nx_alloc((jit->slot_limit + 1) * sizeof(bool));
+    for (uint32_t i = 0; i < jit->slot_limit; i++) {
+        jit->local_of_slot[i] = UNKNOWN;
+    }
+    jit->count = 0;
+    for (size_t ip = jit->loop->start; ip < jit->loop->end;) {
+        Opcode op = code->bytecode[ip];
+        if (code_get_operand_kind(op) == OPERAND_SLOT) {
+            uint32_t slot = code_read_operand(code->bytecode + ip);
+            if (jit->local_of_slot[slot] == UNKNOWN) {
+                jit->local_of_slot[slot] = jit->count;
+                jit->slots[jit->count] = slot;
+                jit->assigned[jit->count] = false;
+                jit->count++;
+            }
+            if (op == OP_STORE_VAR) {
+                jit->assigned[jit->local_of_slot[slot]] = true;
+            }
+        }
+        ip += code_get_operand_kind(op) == OPERAND_NONE ? 1 : 1 + OPERAND_SIZE;
+    }
+}
+
+/**
+ * \brief Emits the code of a binary operator.
+ * \param jit the compiler state
+ * \param ip the offset of the instruction
+ * \param op the binary operator
+ * \param depth the depth of the operand stack before the instruction
+ */
+static void emit_binary(Jit *jit, size_t ip, BinaryOp op, uint32_t depth) {
+    int32_t left = stack_disp(jit, depth - 2);
+    int32_t right = stack_disp(jit, depth - 1);
+    static const uint8_t SETCC[] = {
+            [BINOP_EQ] = CC_E, [BINOP_NE] = CC_NE, [BINOP_LT] = CC_L,
+            [BINOP_LE] = CC_LE, [BINOP_GT] = CC_G, [BINOP_GE] = CC_GE,
+    };
+    switch (op) {
+        case BINOP_ADD:
+        case BINOP_SUB:
+        case BINOP_MUL:
+            emit_mem(jit, MOV_LOAD, RAX, RSP, left);
+            emit_mem(jit, op == BINOP_ADD ? ADD_LOAD : op == BINOP_SUB ? SUB_LOAD : IMUL_LOAD, RAX, RSP, right);
+            emit_exit(jit, CC_O, ip, depth);
+            // the result must fit in an immediate integer, i.e. doubling it must not overflow
+            emit(jit, "\x48\x89\xC1\x48\x01\xC9", 6);     // mov rcx, rax; add rcx, rcx
+            emit_exit(jit, CC_O, ip, depth);
+            break;
+        case BINOP_DIV:
+            emit_mem(jit, MOV_LOAD, RCX, RSP, right);
+            emit(jit, "\x48\x85\xC9", 3);                 // test rcx, rcx
+            emit_exit(jit, CC_E, ip, depth);
+            emit_mem(jit, MOV_LOAD, RAX, RSP, left);
+            emit(jit, "\x48\x99\x48\xF7\xF9", 5);         // cqo; idiv rcx
+            break;
+        default:
+            emit_mem(jit, MOV_LOAD, RAX, RSP, left);
+            emit_mem(jit, CMP_LOAD, RAX, RSP, right);
+            emit_byte(jit, 0x0F);                         // setcc al; movzx eax, al
+            emit_byte(jit, 0x90 | SETCC[op]);
+            emit(jit, "\xC0\x0F\xB6\xC0", 4);
+            break;
+    }
+    emit_mem(jit, MOV_STORE, RAX, RSP, left);
+}
+
+/**
+ * \brief Translates the bytecode of the loop.
+ * \param jit the compiler state
+ * \return false if the loop contains an instruction which is not supported
+ */
+static bool emit_body(Jit *jit) {
+    const Code *code = jit->code;
+    const CodeLoop *loop = jit->loop;
+    uint32_t depth = 0;
+    set_depth(jit, loop->start, 0);
+    for (size_t ip = loop->start; ip < loop->end;) {
+        Opcode op = code->bytecode[ip];
+        bool has_operand = code_get_operand_kind(op) != OPERAND_NONE;
+        uint32_t operand = has_operand ? code_read_operand(code->bytecode + ip) : 0;
+        size_t next = ip + (has_operand ? 1 + OPERAND_SIZE : 1);
+        uint32_t known = jit->depths[ip - loop->start];
+        if (known != UNKNOWN) {
+            if (depth != UNKNOWN && depth != known) {
+                return false;
+            }
+            depth = known;
+        }
+        if (depth == UNKNOWN) {
+            return false;
+        }
+        jit->labels[ip - loop->start] = jit->size;
+        switch (op) {
+            case OP_CONST: {
+                NxObject *value = code->constants[operand];
+                if (!nxo_is_immediate_int(value)) {
+                    return false;
+                }
+                int64_t raw = nx_int_get_value(value);
+                emit(jit, "\x48\xB8", 2);                 // mov rax, imm64
+                emit(jit, &raw, 8);
+                emit_mem(jit, MOV_STORE, RAX, RSP, stack_disp(jit, depth));
+                depth++;
+                break;
+            }
+            case OP_LOAD_VAR:
+            case OP_UPDATE_VAR:
+                emit_mem(jit, MOV_LOAD, RAX, RSP, local_disp(jit->local_of_slot[operand]));
+                emit_mem(jit, MOV_STORE, RAX, RSP, stack_disp(jit, depth));
+                depth++;
+                break;
+            case OP_STORE_VAR:
+                depth--;
+                emit_mem(jit, MOV_LOAD, RAX, RSP, stack_disp(jit, depth));
+                emit_mem(jit, MOV_STORE, RAX, RSP, local_disp(jit->local_of_slot[operand]));
+                break;
+            case OP_ADD:
+            case OP_SUB:
+            case OP_MUL:
+            case OP_DIV:
+            case OP_EQ:
+            case OP_NE:
+            case OP_LT:
+            case OP_LE:
+            case OP_GT:
+            case OP_GE:
+            case OP_ADD_INT:
+            case OP_SUB_INT:
+            case OP_MUL_INT:
+            case OP_DIV_INT:
+            case OP_EQ_INT:
+            case OP_NE_INT:
+            case OP_LT_INT:
+            case OP_LE_INT:
+            case OP_GT_INT:
+            case OP_GE_INT:
+            case OP_INPLACE:
+            case OP_COMPARE_JUMP:
+                assert(operand < code->site_count);
+                // the result of a comparison is a `bool`, which the native code only supports as a condition
+                if (ops_is_comparison(code->sites[operand].op) && code->bytecode[next] != OP_JUMP_IF_FALSE) {
+                    return false;
+                }
+                emit_binary(jit, ip, code->sites[operand].op, depth);
+                depth--;
+                break;
+            case OP_JUMP:
+                if (!emit_branch(jit, -1, ip, next + (int32_t) operand, depth)) {
+                    return false;
+                }
+                depth = UNKNOWN;
+                break;
+            case OP_JUMP_IF_FALSE:
+                depth--;
+                emit_mem(jit, MOV_LOAD, RAX, RSP, stack_disp(jit, depth));
+                emit(jit, "\x48\x85\xC0", 3);             // test rax, rax
+                if (!emit_branch(jit, CC_E, ip, next + (int32_t) operand, depth)) {
+                    return false;
+                }
+                break;
+            case OP_LOOP: {
+                assert(operand < code->loop_count);
+                size_t target = code->loops[operand].start;
+                if (target < loop->start || depth != 0) {
+                    return false;
+                }
+                // a pending safepoint returns to the interpreter, which handles it at this instruction
+                emit_mem(jit, MOV_LOAD, RAX, RSP, safepoint_disp(jit));
+                emit(jit, "\x83\x38\x00", 3);                 // cmp dword [rax], 0
+                emit_exit(jit, CC_NE, ip, 0);
+                patch(jit, emit_jump(jit, -1), jit->labels[target - loop->start]);
+                depth = UNKNOWN;
+                break;
+            }
+            case OP_POP:
+                depth--;
+                break;
+            default:
+                return false;
+        }
+        ip = next;
+    }
+    return true;
+}
+
+/**
+ * \brief Emits the prologue, which saves the pointer to the safepoint and unboxes the variables of the loop.
+ * \param jit the compiler state
+ * \param frame_size size of the frame
+ * \param entry_failure receives the positions of the jumps taken when a variable does not hold an immediate integer
+ */
+static void emit_prologue(Jit *jit, uint32_t frame_size, size_t *entry_failure) {
+    emit(jit, "\x41\x54\x41\x55", 4);                     // push r12; push r13
+    emit(jit, "\x49\x89\xFC\x49\x89\xF5", 6);             // mov r12, rdi; mov r13, rsi
+    emit(jit, "\x48\x81\xEC", 3);                         // sub rsp, frame_size
+    emit_u32(jit, frame_size);
+    emit_mem(jit, MOV_STORE, RDX, RSP, safepoint_disp(jit));
+    for (uint32_t i = 0; i < jit->count; i++) {
+        emit_mem(jit, MOV_LOAD, RAX, R12, (int32_t) (8 * jit->slots[i]));
+        emit(jit, "\xA8\x01", 2);                         // test al, 1
+        entry_failure[i] = emit_jump(jit, CC_E);
+        emit(jit, "\x48\xD1\xF8", 3);                     // sar rax, 1
+        emit_mem(jit, MOV_STORE, RAX, RSP, local_disp(i));
+    }
+}
+
+/**
+ * \brief Emits the exit stubs, the code writing back the variables and the epilogue.
+ * \param jit the compiler state
+ * \param frame_size size of the frame
+ * \param entry_failure positions of the jumps taken when a variable does not hold an immediate integer
+ */
+static void emit_exits(Jit *jit, uint32_t frame_size, const size_t *entry_failure) {
+    size_t *stubs = nx_alloc((jit->exit_count + 1) * sizeof(size_t));
+    for (size_t i = 0; i < jit->exit_count; i++) {
+        const Fixup *exit = &jit->exits[i];
+        patch(jit, exit->at, jit->size);
+        for (uint32_t j = 0; j < exit->depth; j++) {
+            emit_mem(jit, MOV_LOAD, RAX, RSP, stack_disp(jit, j));
+            emit(jit, "\x48\x8D\x44\x00\x01", 5);         // lea rax, [rax + rax + 1]
+            emit_mem(jit, MOV_STORE, RAX, R13, (int32_t) (8 * j));
+        }
+        emit_byte(jit, 0xB8);                             // mov eax, offset
+        emit_u32(jit, (uint32_t) exit->offset);
+        emit_byte(jit, 0xBA);                             // mov edx, depth
+        emit_u32(jit, exit->depth);
+        stubs[i] = emit_jump(jit, -1);
+    }
+    size_t write_back = jit->size;
+    for (uint32_t i = 0; i < jit->count; i++) {
+        if (jit->assigned[i]) {
+            emit_mem(jit, MOV_LOAD, RCX, RSP, local_disp(i));
+            emit(jit, "\x48\x8D\x4C\x09\x01", 5);         // lea rcx, [rcx + rcx + 1]
+            emit_mem(jit, MOV_STORE, RCX, R12, (int32_t) (8 * jit->slots[i]));
+        }
+    }
+    size_t epilogue = jit->size;
+    emit(jit, "\x48\x81\xC4", 3);                         // add rsp, frame_size
+    emit_u32(jit, frame_size);
+    emit(jit, "\x41\x5D\x41\x5C\xC3", 5);                 // pop r13; pop r12; ret
+    size_t failure = jit->size;
+    emit_byte(jit, 0xB8);                                 // mov eax, start
+    emit_u32(jit, (uint32_t) jit->loop->start);
+    emit(jit, "\x31\xD2", 2);                             // xor edx, edx
+    patch(jit, emit_jump(jit, -1), epilogue);
+    for (size_t i = 0; i < jit->exit_count; i++) {
+        patch(jit, stubs[i], write_back);
+    }
+    for (uint32_t i = 0; i < jit->count; i++) {
+        patch(jit, entry_failure[i], failure);
+    }
+    nx_free(stubs);
+}
+
+/**
+ * \brief Copies the generated code to an executable mapping.
+ * \param jit the compiler state
+ * \return the native code, `NULL` if the mapping cannot be created
+ */
+static JitCode *install(const Jit *jit) {
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t size = (jit->size + page - 1) / page * page;
+    void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return NULL;
+    }
+    memcpy(memory, jit->buf, jit->size);
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, size);
+        return NULL;
+    }
+    JitCode *native = nx_alloc(sizeof(JitCode));
+    native->memory = memory;
+    native->size = size;
+    native->entry = (JitExit (*)(NxObject **, NxObject **, Safepoint *)) memory;
+    if (jit_policy.perf_map) {
+        char path[64];
+        snprintf(path, sizeof(path), "/tmp/perf-%d.map", (int) getpid());
+        FILE *f = fopen(path, "a");
+        if (f) {
+            fprintf(f, "%lx %zx natrix_loop_%04zu\n", (unsigned long) (uintptr_t) memory, jit->size, jit->loop->start);
+            fclose(f);
+        }
+    }
+    return native;
+}
+
+JitCode *jit_compile_loop(const Code *code, const CodeLoop *loop) {
+    assert(loop->start < loop->end && loop->end <= code->bytecode_size);
+    size_t length = loop->end - loop->start;
+    Jit jit = {
+            .code = code,
+            .loop = loop,
+            .labels = nx_alloc(length * sizeof(size_t)),
+            .depths = nx_alloc(length * sizeof(uint32_t)),
+    };
+    for (size_t i = 0; i < length; i++) {
+        jit.depths[i] = UNKNOWN;
+    }
+    collect_slots(&jit);
+    uint32_t frame_words = jit.count + (uint32_t) code->max_stack + 1;
+    // two pushes and the return address leave rsp 8 bytes off the 16-byte alignment
+    uint32_t frame_size = (frame_words * 8 + 15) / 16 * 16 + 8;
+    size_t *entry_failure = nx_alloc((jit.count + 1) * sizeof(size_t));
+    emit_prologue(&jit, frame_size, entry_failure);
+    JitCode *native = NULL;
+    if (emit_body(&jit)) {
+        for (size_t i = 0; i < jit.jump_count; i++) {
+            // all forward jumps target instructions within the loop, whose labels are known by now
+            patch(&jit, jit.jumps[i].at, jit.labels[jit.jumps[i].offset - loop->start]);
+        }
+        emit_exits(&jit, frame_size, entry_failure);
+        native = install(&jit);
+    }
+    nx_free(entry_failure);
+    nx_free(jit.buf);
+    nx_free(jit.labels);
+    nx_free(jit.depths);
+    nx_free(jit.jumps);
+    nx_free(jit.exits);
+    nx_free(jit.slots);
+    nx_free(jit.assigned);
+    nx_free(jit.local_of_slot);
+    return native;
+}
+
+#else
+
+JitCode *jit_compile_loop(const Code *code, const CodeLoop *loop) {
+    (void) code;
+    (void) loop;
+    return NULL;
+}
+
+#endif
@@ -0,0 +1,665 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file optimizer.c
+ * \brief Implementation of the optimizer.
+ */
+
+#include "natrix/compiler/optimizer.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "natrix/interp/builtins.h"
+#include "natrix/interp/ops.h"
+#include "natrix/obj/nx_int.h"
+#include "natrix/obj/nx_str.h"
+#include "natrix/util/panic.h"
+
+/**
+ * \brief Internal state of the optimizer.
+ */
+typedef struct {
+    Arena *arena;               //!< arena receiving the new nodes
+    Env *env;                   //!< environment receiving the temporary variables
+    LiteralPool *literals;      //!< pool receiving the values of folded literals
+    size_t slot_count;          //!< number of slots the sets below can hold, including future temporaries
+    bool *int_typed;            //!< slots which are only ever assigned integers
+    size_t binary_count;        //!< number of binary operations remaining after folding
+} Optimizer;
+
+/**
+ * \brief Returns the value of an integer or string literal.
+ * \param opt the optimizer state
+ * \param expr the literal
+ * \return the value of the literal
+ */
+static NxObject *literal_value(const Optimizer *opt, const Expr *expr) {
+    assert(expr->kind == EXPR_INT_LITERAL || expr->kind == EXPR_STR_LITERAL);
+    return literal_pool_get(opt->literals, expr->literal.index);
+}
+
+/**
+ * \brief Copies the contents of a string builder into the arena.
+ * \param opt the optimizer state
+ * \param sb the string builder
+ * \param end receives the pointer to the character after the end of the copy
+ * \return the pointer to the start of the copy
+ */
+static const char *arena_copy(const Optimizer *opt, const StringBuilder *sb, const char **end) {
+    char *copy = arena_alloc(opt->arena, sb->length);
+    memcpy(copy, sb->str, sb->length);
+    *end = copy + sb->length;
+    return copy;
+}
+
+/**
+ * \brief Folds a binary operation whose operands are literals.
+ *
+ * The node is turned into a literal in place, the text of the literal is the value written out in the arena.
+ * There are no `bool` literals, so a comparison is only folded if it is the condition of a statement, into
+ * the integer 0 or 1 which has the same truth value.
+ * \param opt the optimizer state
+ * \param expr the binary operation
+ * \param condition whether the operation is the condition of an `if` or `while` statement
+ */
+static void fold_binary(Optimizer *opt, Expr *expr, bool condition) {
+    Expr *left = expr->binary.left;
+    Expr *right = expr->binary.right;
+    BinaryOp op = expr->binary.op;
+    bool ints = left->kind == EXPR_INT_LITERAL && right->kind == EXPR_INT_LITERAL;
+    bool strs = left->kind == EXPR_STR_LITERAL && right->kind == EXPR_STR_LITERAL && op == BINOP_ADD;
+    if ((!ints && !strs) || (ops_is_comparison(op) && !condition)) {
+        return;
+    }
+    if (op == BINOP_DIV && nx_int_sign(literal_value(opt, right)) == 0) {
+        return;
+    }
+    NxObject *value = ops_binary(literal_value(opt, left), op, literal_value(opt, right));
+    if (nx_bool_is_instance(value)) {
+        value = nx_int_create(nx_bool_is_true(value));
+    }
+    uint32_t index = literal_pool_add(opt->literals, value);
+    StringBuilder sb = sb_init();
+    if (ints) {
+        nx_int_append_to(&sb, value);
+    } else {
+        sb_append_formatted(&sb, "\"%.*s\"", (int) nx_str_get_length(value), nx_str_get_data(value));
+    }
+    expr->kind = ints ? EXPR_INT_LITERAL : EXPR_STR_LITERAL;
+    expr->literal.start = arena_copy(opt, &sb, &expr->literal.end);
+    expr->literal.head = NULL;
+    expr->literal.index = index;
+    sb_free(&sb);
+}
+
+/**
+ * \brief Folds constant subexpressions of an expression and its successors, bottom-up.
+ * \param opt the optimizer state
+ * \param expr the first expression, may be NULL
+ */
+static void fold_exprs(Optimizer *opt, Expr *expr) {
+    for (; expr; expr = expr->next) {
+        switch (expr->kind) {
+            case EXPR_INT_LITERAL:
+            case EXPR_STR_LITERAL:
+            case EXPR_NAME:
+                break;
+            case EXPR_LIST_LITERAL:
+            case EXPR_DICT_LITERAL:
+                fold_exprs(opt, expr->literal.head);
+                break;
+            case EXPR_BINARY:
+                fold_exprs(opt, expr->binary.left);
+                fold_exprs(opt, expr->binary.right);
+                fold_binary(opt, expr, false);
+                if (expr->kind == EXPR_BINARY) {
+                    opt->binary_count++;
+                }
+                break;
+            case EXPR_SUBSCRIPT:
+                fold_exprs(opt, expr->subscript.receiver);
+                fold_exprs(opt, expr->subscript.index);
+                break;
+            case EXPR_SLICE:
+                fold_exprs(opt, expr->slice.receiver);
+                fold_exprs(opt, expr->slice.lower);
+                fold_exprs(opt, expr->slice.upper);
+                break;
+            case EXPR_CALL:
+                fold_exprs(opt, expr->call.args);
+                break;
+            default:
+                assert(0 && "Invalid ExprKind");
+        }
+    }
+}
+
+/**
+ * \brief Folds constant subexpressions of the condition of an `if` or `while` statement.
+ * \param opt the optimizer state
+ * \param condition the condition
+ */
+static void fold_condition(Optimizer *opt, Expr *condition) {
+    fold_exprs(opt, condition);
+    if (condition->kind == EXPR_BINARY) {
+        fold_binary(opt, condition, true);
+    }
+}
+
+/**
+ * \brief Folds constant subexpressions in a list of statements and their nested statements.
+ * \param opt the optimizer state
+ * \param stmt the first statement, may be NULL
+ */
+static void fold_stmts(Optimizer *opt, Stmt *stmt) {
+    for (; stmt; stmt = stmt->next) {
+        switch (stmt->kind) {
+            case STMT_EXPR:
+            case STMT_PRINT:
+                fold_exprs(opt, stmt->expr);
+                break;
+            case STMT_ASSIGNMENT:
+            case STMT_AUG_ASSIGNMENT:
+                fold_exprs(opt, stmt->assignment.left);
+                fold_exprs(opt, stmt->assignment.right);
+                break;
+            case STMT_WHILE:
+                fold_condition(opt, stmt->while_stmt.condition);
+                fold_stmts(opt, stmt->while_stmt.body);
+                break;
+            case STMT_FOR:
+                fold_exprs(opt, stmt->for_stmt.iterable);
+                fold_stmts(opt, stmt->for_stmt.body);
+                break;
+            case STMT_IF:
+                fold_condition(opt, stmt->if_stmt.condition);
+                fold_stmts(opt, stmt->if_stmt.then_body);
+                fold_stmts(opt, stmt->if_stmt.else_body);
+                break;
+            case STMT_PASS:
+                break;
+            default:
+                assert(0 && "Invalid StmtKind");
+        }
+    }
+}
+
+/**
+ * \brief Marks the slots assigned by a list of statements and their nested statements.
+ * \param stmt the first statement, may be NULL
+ * \param assigned the set of slots to update
+ */
+static void collect_assigned(const Stmt *stmt, bool *assigned) {
+    for (; stmt; stmt = stmt->next) {
+        switch (stmt->kind) {
+            case STMT_ASSIGNMENT:
+            case STMT_AUG_ASSIGNMENT:
+                if (stmt->assignment.left->kind == EXPR_NAME) {
+                    assigned[stmt->assignment.left->identifier.slot] = true;
+                }
+                break;
+            case STMT_WHILE:
+                collect_assigned(stmt->while_stmt.body, assigned);
+                break;
+            case STMT_FOR:
+                assigned[stmt->for_stmt.target->identifier.slot] = true;
+                collect_assigned(stmt->for_stmt.body, assigned);
+                break;
+            case STMT_IF:
+                collect_assigned(stmt->if_stmt.then_body, assigned);
+                collect_assigned(stmt->if_stmt.else_body, assigned);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+/**
+ * \brief Determines whether an expression always evaluates to an integer, assuming the current `int_typed` set.
+ * \param opt the optimizer state
+ * \param expr the expression
+ * \return true if the value of the expression is an integer
+ */
+static bool is_int_typed(const Optimizer *opt, const Expr *expr) {
+    switch (expr->kind) {
+        case EXPR_INT_LITERAL:
+            return true;
+        case EXPR_NAME:
+            return opt->int_typed[expr->identifier.slot];
+        case EXPR_BINARY:
+            return !ops_is_comparison(expr->binary.op) && is_int_typed(opt, expr->binary.left)
+                   && is_int_typed(opt, expr->binary.right);
+        default:
+            return false;
+    }
+}
+
+/**
+ * \brief Removes slots assigned a value which may not be an integer from the `int_typed` set.
+ * \param opt the optimizer state
+ * \param stmt the first statement, may be NULL
+ * \return true if the set has changed
+ */
+static bool refine_int_typed(Optimizer *opt, const Stmt *stmt) {
+    bool changed = false;
+    for (; stmt; stmt = stmt->next) {
+        switch (stmt->kind) {
+            case STMT_ASSIGNMENT:
+            case STMT_AUG_ASSIGNMENT: {
+                const Expr *left = stmt->assignment.left;
+                if (left->kind == EXPR_NAME && opt->int_typed[left->identifier.slot]
+                    && !is_int_typed(opt, stmt->assignment.right)) {
+                    opt->int_typed[left->identifier.slot] = false;
+                    changed = true;
+                }
+                break;
+            }
+            case STMT_WHILE:
+                changed |= refine_int_typed(opt, stmt->while_stmt.body);
+                break;
+            case STMT_FOR: {
+                // only the items of a range are known to be integers
+                uint32_t target = stmt->for_stmt.target->identifier.slot;
+                if (opt->int_typed[target] && !builtin_is_range_call(stmt->for_stmt.iterable)) {
+                    opt->int_typed[target] = false;
+                    changed = true;
+                }
+                changed |= refine_int_typed(opt, stmt->for_stmt.body);
+                break;
+            }
+            case STMT_IF:
+                changed |= refine_int_typed(opt, stmt->if_stmt.then_body);
+                changed |= refine_int_typed(opt, stmt->if_stmt.else_body);
+                break;
+            default:
+                break;
+        }
+    }
+    return changed;
+}
+
+/**
+ * \brief Loop being optimized, collects the assignments of the temporaries hoisted out of it.
+ */
+typedef struct {
+    const bool *assigned_before;    //!< slots certainly assigned before the loop
+    const bool *assigned_inside;    //!< slots assigned anywhere in the loop
+    Stmt *preheader;                //!< first hoisted assignment
+    Stmt *preheader_tail;           //!< last hoisted assignment
+} Loop;
+
+/**
+ * \brief Determines whether an expression is invariant in the loop and can be safely evaluated before it.
+ * \param opt the optimizer state
+ * \param loop the loop
+ * \param expr the expression
+ * \return true if the expression can be hoisted
+ */
+static bool is_hoistable(const Optimizer *opt, const Loop *loop, const Expr *expr) {
+    switch (expr->kind) {
+        case EXPR_INT_LITERAL:
+            return true;
+        case EXPR_NAME: {
+            uint32_t slot = expr->identifier.slot;
+            return opt->int_typed[slot] && loop->assigned_before[slot] && !loop->assigned_inside[slot];
+        }
+        case EXPR_BINARY: {
+            const Expr *right = expr->binary.right;
+            // the temporaries hold integers, and a comparison left in a condition is evaluated without boxing
+            if (ops_is_comparison(expr->binary.op)) {
+                return false;
+            }
+            if (expr->binary.op == BINOP_DIV
+                && (right->kind != EXPR_INT_LITERAL || nx_int_sign(literal_value(opt, right)) == 0)) {
+                return false;
+            }
+            return is_hoistable(opt, loop, expr->binary.left) && is_hoistable(opt, loop, right);
+        }
+        default:
+            return false;
+    }
+}
+
+/**
+ * \brief Determines whether two hoistable expressions compute the same value.
+ * \param opt the optimizer state
+ * \param a the first expression
+ * \param b the second expression
+ * \return true if the expressions are structurally equal
+ */
+static bool is_same_expr(const Optimizer *opt, const Expr *a, const Expr *b) {
+    if (a->kind != b->kind) {
+        return false;
+    }
+    switch (a->kind) {
+        case EXPR_INT_LITERAL:
+            return nx_int_compare(literal_value(opt, a), literal_value(opt, b)) == 0;
+        case EXPR_NAME:
+            return a->identifier.slot == b->identifier.slot;
+        case EXPR_BINARY:
+            return a->binary.op == b->binary.op && is_same_expr(opt, a->binary.left, b->binary.left)
+                   && is_same_expr(opt, a->binary.right, b->binary.right);
+        default:
+            return false;
+    }
+}
+
+/**
+ * \brief Replaces a hoistable expression with a temporary assigned before the loop.
+ *
+ * Equal expressions in the loop share the temporary and its assignment.
+ * \param opt the optimizer state
+ * \param loop the loop
+ * \param expr the expression, turned into a name of the temporary in place
+ */
+static void hoist(Optimizer *opt, Loop *loop, Expr *expr) {
+    Stmt *s = loop->preheader;
+    while (s && !is_same_expr(opt, s->assignment.right, expr)) {
+        s = s->next;
+    }
+    if (!s) {
+        StringBuilder sb = sb_init();
+        sb_append_formatted(&sb, "$%zu", opt->env->count);
+        const char *end;
+        const char *start = arena_copy(opt, &sb, &end);
+        sb_free(&sb);
+        uint32_t slot = env_declare(opt->env, start, end - start);
+        assert(slot < opt->slot_count);
+        opt->int_typed[slot] = true;
+        Expr *copy = arena_alloc(opt->arena, sizeof(Expr));
+        *copy = *expr;
+        copy->next = NULL;
+        // the value is stored now, it must not be allocated among the temporaries of the statement
+        copy->binary.temporary = false;
+        Expr *name = ast_create_expr_name(opt->arena, start, end);
+        name->identifier.slot = slot;
+        s = ast_create_stmt_assignment(opt->arena, name, copy);
+        if (loop->preheader_tail) {
+            loop->preheader_tail->next = s;
+        } else {
+            loop->preheader = s;
+        }
+        loop->preheader_tail = s;
+    }
+    expr->kind = EXPR_NAME;
+    expr->identifier = s->assignment.left->identifier;
+}
+
+/**
+ * \brief Hoists the maximal invariant subexpressions of an expression and its successors.
+ * \param opt the optimizer state
+ * \param loop the loop
+ * \param expr the first expression, may be NULL
+ */
+static void hoist_exprs(Optimizer *opt, Loop *loop, Expr *expr) {
+    for (; expr; expr = expr->next) {
+        switch (expr->kind) {
+            case EXPR_INT_LITERAL:
+            case EXPR_STR_LITERAL:
+            case EXPR_NAME:
+                break;
+            case EXPR_LIST_LITERAL:
+            case EXPR_DICT_LITERAL:
+                hoist_exprs(opt, loop, expr->literal.head);
+                break;
+            case EXPR_BINARY:
+                if (is_hoistable(opt, loop, expr)) {
+                    hoist(opt, loop, expr);
+                } else {
+                    hoist_exprs(opt, loop, expr->binary.left);
+                    hoist_exprs(opt, loop, expr->binary.right);
+                }
+                break;
+            case EXPR_SUBSCRIPT:
+                hoist_exprs(opt, loop, expr->subscript.receiver);
+                hoist_exprs(opt, loop, expr->subscript.index);
+                break;
+            case EXPR_SLICE:
+                hoist_exprs(opt, loop, expr->slice.receiver);
+                hoist_exprs(opt, loop, expr->slice.lower);
+                hoist_exprs(opt, loop, expr->slice.upper);
+                break;
+            case EXPR_CALL:
+                // the callee is not a variable, calls themselves are not hoisted since they may allocate
+                hoist_exprs(opt, loop, expr->call.args);
+                break;
+            default:
+                assert(0 && "Invalid ExprKind");
+        }
+    }
+}
+
+/**
+ * \brief Hoists the invariant expressions from a list of statements, including nested loops.
+ * \param opt the optimizer state
+ * \param loop the loop
+ * \param stmt the first statement, may be NULL
+ */
+static void hoist_stmts(Optimizer *opt, Loop *loop, Stmt *stmt) {
+    for (; stmt; stmt = stmt->next) {
+        switch (stmt->kind) {
+            case STMT_EXPR:
+            case STMT_PRINT:
+                hoist_exprs(opt, loop, stmt->expr);
+                break;
+            case STMT_ASSIGNMENT:
+            case STMT_AUG_ASSIGNMENT:
+                hoist_exprs(opt, loop, stmt->assignment.left);
+                hoist_exprs(opt, loop, stmt->assignment.right);
+                break;
+            case STMT_WHILE:
+                hoist_exprs(opt, loop, stmt->while_stmt.condition);
+                hoist_stmts(opt, loop, stmt->while_stmt.body);
+                break;
+            case STMT_FOR:
+                hoist_exprs(opt, loop, stmt->for_stmt.iterable);
+                hoist_stmts(opt, loop, stmt->for_stmt.body);
+                break;
+            case STMT_IF:
+                hoist_exprs(opt, loop, stmt->if_stmt.condition);
+                hoist_stmts(opt, loop, stmt->if_stmt.then_body);
+                hoist_stmts(opt, loop, stmt->if_stmt.else_body);
+                break;
+            case STMT_PASS:
+                break;
+            default:
+                assert(0 && "Invalid StmtKind");
+        }
+    }
+}
+
+/**
+ * \brief Allocates a copy of a slot set.
+ * \param opt the optimizer state
+ * \param set the set to copy
+ * \return the copy, to be released by `free()`
+ */
+static bool *copy_set(const Optimizer *opt, const bool *set) {
+    bool *copy = malloc(opt->slot_count * sizeof(bool));
+    if (!copy) {
+        PANIC("Out of memory");
+    }
+    memcpy(copy, set, opt->slot_count * sizeof(bool));
+    return copy;
+}
+
+/**
+ * \brief Determines whether an expression is an integer or string literal.
+ * \param expr the expression
+ * \return true if the value of the expression is known
+ */
+static bool is_constant(const Expr *expr) {
+    return expr->kind == EXPR_INT_LITERAL || expr->kind == EXPR_STR_LITERAL;
+}
+
+static Stmt *optimize_stmts(Optimizer *opt, Stmt *stmt, bool *assigned);
+
+/**
+ * \brief Optimizes a loop: hoists its invariant expressions and optimizes its body.
+ *
+ * The iterable of a `for` loop is evaluated only once, so only its body is searched for invariants.
+ * \param opt the optimizer state
+ * \param stmt the `while` or `for` statement
+ * \param assigned the slots certainly assigned before the loop
+ * \return the first statement replacing the loop, i.e. the first hoisted assignment or the loop itself
+ */
+static Stmt *optimize_loop(Optimizer *opt, Stmt *stmt, bool *assigned) {
+    Stmt **body = stmt->kind == STMT_FOR ? &stmt->for_stmt.body : &stmt->while_stmt.body;
+    bool *inside = calloc(opt->slot_count, sizeof(bool));
+    if (!inside) {
+        PANIC("Out of memory");
+    }
+    collect_assigned(*body, inside);
+    Loop loop = {
+            .assigned_before = assigned,
+            .assigned_inside = inside,
+    };
+    if (stmt->kind == STMT_FOR) {
+        inside[stmt->for_stmt.target->identifier.slot] = true;
+    } else {
+        hoist_exprs(opt, &loop, stmt->while_stmt.condition);
+    }
+    hoist_stmts(opt, &loop, *body);
+    free(inside);
+    for (Stmt *s = loop.preheader; s; s = s->next) {
+        assigned[s->assignment.left->identifier.slot] = true;
+    }
+    bool *body_assigned = copy_set(opt, assigned);
+    if (stmt->kind == STMT_FOR) {
+        body_assigned[stmt->for_stmt.target->identifier.slot] = true;
+    }
+    *body = optimize_stmts(opt, *body, body_assigned);
+    free(body_assigned);
+    if (!*body) {
+        *body = ast_create_stmt_pass(opt->arena);
+    }
+    if (loop.preheader) {
+        loop.preheader_tail->next = stmt;
+        return loop.preheader;
+    }
+    return stmt;
+}
+
+/**
+ * \brief Optimizes an `if` statement with a condition which is not constant.
+ * \param opt the optimizer state
+ * \param stmt the `if` statement
+ * \param assigned the slots certainly assigned before the statement, updated with the slots assigned by both branches
+ */
+static void optimize_if(Optimizer *opt, Stmt *stmt, bool *assigned) {
+    bool *then_assigned = copy_set(opt, assigned);
+    stmt->if_stmt.then_body = optimize_stmts(opt, stmt->if_stmt.then_body, then_assigned);
+    if (!stmt->if_stmt.then_body) {
+        stmt->if_stmt.then_body = ast_create_stmt_pass(opt->arena);
+    }
+    bool *else_assigned = copy_set(opt, assigned);
+    stmt->if_stmt.else_body = optimize_stmts(opt, stmt->if_stmt.else_body, else_assigned);
+    if (!stmt->if_stmt.else_body) {
+        stmt->if_stmt.else_body = ast_create_stmt_pass(opt->arena);
+    }
+    for (size_t i = 0; i < opt->slot_count; i++) {
+        assigned[i] = then_assigned[i] && else_assigned[i];
+    }
+    free(then_assigned);
+    free(else_assigned);
+}
+
+/**
+ * \brief Prunes constant branches, removes `pass` statements and hoists loop invariants in a list of statements.
+ * \param opt the optimizer state
+ * \param stmt the first statement, may be NULL
+ * \param assigned the slots certainly assigned before the first statement, updated as the statements are processed
+ * \return the first statement of the optimized list, NULL if the list does nothing
+ */
+static Stmt *optimize_stmts(Optimizer *opt, Stmt *stmt, bool *assigned) {
+    Stmt *head = NULL;
+    Stmt **link = &head;
+    while (stmt) {
+        Stmt *next = stmt->next;
+        Stmt *replacement = stmt;
+        switch (stmt->kind) {
+            case STMT_EXPR:
+            case STMT_PRINT:
+                break;
+            case STMT_ASSIGNMENT:
+            case STMT_AUG_ASSIGNMENT:
+                if (stmt->assignment.left->kind == EXPR_NAME) {
+                    assigned[stmt->assignment.left->identifier.slot] = true;
+                }
+                break;
+            case STMT_WHILE:
+                if (is_constant(stmt->while_stmt.condition)
+                    && !ops_is_true(literal_value(opt, stmt->while_stmt.condition))) {
+                    replacement = NULL;
+                } else {
+                    replacement = optimize_loop(opt, stmt, assigned);
+                }
+                break;
+            case STMT_FOR:
+                replacement = optimize_loop(opt, stmt, assigned);
+                break;
+            case STMT_IF:
+                if (is_constant(stmt->if_stmt.condition)) {
+                    Stmt *branch = ops_is_true(literal_value(opt, stmt->if_stmt.condition))
+                                   ? stmt->if_stmt.then_body : stmt->if_stmt.else_body;
+                    replacement = optimize_stmts(opt, branch, assigned);
+                } else {
+                    optimize_if(opt, stmt, assigned);
+                }
+                break;
+            case STMT_PASS:
+                replacement = NULL;
+                break;
+            default:
+                assert(0 && "Invalid StmtKind");
+        }
+        if (replacement) {
+            // the replacement is either the statement itself, a chain ending with it or an independent chain
+            *link = replacement;
+            while (replacement != stmt && replacement->next) {
+                replacement = replacement->next;
+            }
+            link = &replacement->next;
+        }
+        stmt = next;
+    }
+    *link = NULL;
+    return head;
+}
+
+Stmt *optimize_program(Arena *arena, Env *env, LiteralPool *literals, Stmt *stmt) {
+    Optimizer opt = {
+            .arena = arena,
+            .env = env,
+            .literals = literals,
+    };
+    fold_stmts(&opt, stmt);
+    opt.slot_count = env->count + opt.binary_count;
+    opt.int_typed = calloc(opt.slot_count, sizeof(bool));
+    bool *assigned = calloc(opt.slot_count, sizeof(bool));
+    if (!opt.int_typed || !assigned) {
+        PANIC("Out of memory");
+    }
+    // start with all slots which are assigned or hold an initial value and remove those assigned anything
+    // but an integer until a fixpoint is reached
+    collect_assigned(stmt, opt.int_typed);
+    for (size_t slot = 0; slot < env->count; slot++) {
+        NxObject *value = env->values[slot];
+        if (value) {
+            assigned[slot] = true;
+            opt.int_typed[slot] = nx_int_is_instance(value);
+        }
+    }
+    while (refine_int_typed(&opt, stmt)) {
+    }
+    stmt = optimize_stmts(&opt, stmt, assigned);
+    free(assigned);
+    free(opt.int_typed);
+    return stmt;
+}
@@ -0,0 +1,247 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file resolver.c
+ * \brief Implementation of the name resolver.
+ */
+
+#include "natrix/compiler/resolver.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include "natrix/interp/builtins.h"
+#include "natrix/interp/ops.h"
+#include "natrix/obj/nx_str.h"
+#include "natrix/util/mem.h"
+#include "natrix/util/panic.h"
+
+/**
+ * \brief Internal state of the resolver.
+ */
+typedef struct {
+    Env *env;                   //!< environment in which the slots are declared
+    LiteralPool *literals;      //!< pool receiving the values of literals
+    uint32_t *symbol_literals;  //!< index in the pool + 1 of the value of each literal symbol by id, 0 if not created
+    size_t symbol_capacity;     //!< number of entries of `symbol_literals`
+} Resolver;
+
+static void resolve_stmts(Resolver *resolver, Stmt *stmt);
+
+/**
+ * \brief Resolves the callee of a call to a built-in function and checks the number of arguments.
+ *
+ * Panics if there is no such function or the number of arguments does not match.
+ * \param expr the call expression
+ */
+static void resolve_callee(Expr *expr) {
+    ExprName *callee = &expr->call.callee->identifier;
+    int length = (int) (callee->end - callee->start);
+    uint32_t id = builtin_lookup(callee->start, length);
+    if (id == BUILTIN_COUNT) {
+        PANIC("Undefined function: %.*s", length, callee->start);
+    }
+    uint32_t argc = 0;
+    for (const Expr *e = expr->call.args; e; e = e->next) {
+        argc++;
+    }
+    const Builtin *builtin = builtin_get(id);
+    if (argc < builtin->min_args || argc > builtin->max_args) {
+        PANIC("Wrong number of arguments of %s(): %u", builtin->name, argc);
+    }
+    callee->slot = id;
+}
+
+/**
+ * \brief Returns the entry of the value of an interned literal, growing the table to include it.
+ * \param resolver the resolver state
+ * \param symbol the symbol of the literal
+ * \return pointer to the index in the literal pool + 1, 0 if the value has not been created yet
+ */
+static uint32_t *symbol_literal(Resolver *resolver, const Symbol *symbol) {
+    if (symbol->id >= resolver->symbol_capacity) {
+        size_t capacity = resolver->symbol_capacity ? resolver->symbol_capacity : 64;
+        while (capacity <= symbol->id) {
+            capacity *= 2;
+        }
+        resolver->symbol_literals = nx_realloc(resolver->symbol_literals, capacity * sizeof(uint32_t));
+        memset(resolver->symbol_literals + resolver->symbol_capacity, 0,
+               (capacity - resolver->symbol_capacity) * sizeof(uint32_t));
+        resolver->symbol_capacity = capacity;
+    }
+    return &resolver->symbol_literals[symbol->id];
+}
+
+/**
+ * \brief Resolves an integer or string literal.
+ *
+ * Literals with the same interned text share a value, which is created only once. The hash of a string value is
+ * computed in advance, so that using the literal as a key of a `dict` does not hash it again.
+ * \param resolver the resolver state
+ * \param expr the literal
+ */
+static void resolve_literal(Resolver *resolver, Expr *expr) {
+    const Symbol *symbol = expr->literal.symbol;
+    uint32_t *known = symbol ? symbol_literal(resolver, symbol) : NULL;
+    if (known && *known) {
+        expr->literal.index = *known - 1;
+        return;
+    }
+    NxObject *value;
+    if (expr->kind == EXPR_INT_LITERAL) {
+        value = ops_int_from_str(expr->literal.start, expr->literal.end - expr->literal.start);
+    } else {
+        value = ops_str_from_literal(expr->literal.start, expr->literal.end);
+    }
+    expr->literal.index = literal_pool_add(resolver->literals, value);
+    if (expr->kind == EXPR_STR_LITERAL) {
+        nx_str_get_hash(value);
+    }
+    if (known) {
+        *known = expr->literal.index + 1;
+    }
+}
+
+/**
+ * \brief Marks an operand of a binary operation as a temporary if it is an arithmetic operation.
+ *
+ * Comparisons are left alone, their `bool` results are never allocated.
+ * \param operand the operand
+ */
+static void mark_temporary(Expr *operand) {
+    if (operand->kind == EXPR_BINARY && !ops_is_comparison(operand->binary.op)) {
+        operand->binary.temporary = true;
+    }
+}
+
+/**
+ * \brief Resolves all names and literals in the expression.
+ * \param resolver the resolver state
+ * \param expr the expression
+ */
+static void resolve_expr(Resolver *resolver, Expr *expr) {
+    switch (expr->kind) {
+        case EXPR_INT_LITERAL:
+        case EXPR_STR_LITERAL:
+            resolve_literal(resolver, expr);
+            break;
+        case EXPR_LIST_LITERAL:
+        case EXPR_DICT_LITERAL:
+            for (Expr *e = expr->literal.head; e; e = e->next) {
+                resolve_expr(resolver, e);
+            }
+            break;
+        case EXPR_NAME: {
+            const Symbol *symbol = expr->identifier.symbol;
+            expr->identifier.slot = symbol
+                    ? env_declare_hashed(resolver->env, symbol->start, symbol->length, symbol->hash)
+                    : env_declare(resolver->env, expr->identifier.start, expr->identifier.end - expr->identifier.start);
+            break;
+        }
+        case EXPR_BINARY:
+            resolve_expr(resolver, expr->binary.left);
+            resolve_expr(resolver, expr->binary.right);
+            mark_temporary(expr->binary.left);
+            mark_temporary(expr->binary.right);
+            break;
+        case EXPR_SUBSCRIPT:
+            resolve_expr(resolver, expr->subscript.receiver);
+            resolve_expr(resolver, expr->subscript.index);
+            break;
+        case EXPR_SLICE:
+            resolve_expr(resolver, expr->slice.receiver);
+            if (expr->slice.lower) {
+                resolve_expr(resolver, expr->slice.lower);
+            }
+            if (expr->slice.upper) {
+                resolve_expr(resolver, expr->slice.upper);
+            }
+            break;
+        case EXPR_CALL:
+            resolve_callee(expr);
+            for (Expr *e = expr->call.args; e; e = e->next) {
+                resolve_expr(resolver, e);
+            }
+            break;
+        default:
+            assert(0 && "Invalid ExprKind");
+    }
+}
+
+/**
+ * \brief Declares a slot which is not visible to the program, named `$` followed by the slot.
+ * \param resolver the resolver state
+ * \return the slot
+ */
+static uint32_t declare_hidden(Resolver *resolver) {
+    char name[24];
+    int length = snprintf(name, sizeof(name), "$%zu", resolver->env->count);
+    return env_declare(resolver->env, name, length);
+}
+
+/**
+ * \brief Resolves all names and literals in the statement.
+ * \param resolver the resolver state
+ * \param stmt the statement
+ */
+static void resolve_stmt(Resolver *resolver, Stmt *stmt) {
+    switch (stmt->kind) {
+        case STMT_EXPR:
+        case STMT_PRINT:
+            resolve_expr(resolver, stmt->expr);
+            break;
+        case STMT_ASSIGNMENT:
+        case STMT_AUG_ASSIGNMENT:
+            resolve_expr(resolver, stmt->assignment.left);
+            resolve_expr(resolver, stmt->assignment.right);
+            break;
+        case STMT_WHILE:
+            resolve_expr(resolver, stmt->while_stmt.condition);
+            resolve_stmts(resolver, stmt->while_stmt.body);
+            break;
+        case STMT_FOR:
+            resolve_expr(resolver, stmt->for_stmt.target);
+            resolve_expr(resolver, stmt->for_stmt.iterable);
+            // the iterated object and the position, kept in the environment so that nested loops do not share them
+            stmt->for_stmt.iter_slot = declare_hidden(resolver);
+            declare_hidden(resolver);
+            resolve_stmts(resolver, stmt->for_stmt.body);
+            break;
+        case STMT_IF:
+            resolve_expr(resolver, stmt->if_stmt.condition);
+            resolve_stmts(resolver, stmt->if_stmt.then_body);
+            resolve_stmts(resolver, stmt->if_stmt.else_body);
+            break;
+        case STMT_PASS:
+            break;
+        default:
+            assert(0 && "Invalid StmtKind");
+    }
+}
+
+/**
+ * \brief Resolves a list of statements.
+ * \param resolver the resolver state
+ * \param stmt the first statement in the list, may be NULL
+ */
+static void resolve_stmts(Resolver *resolver, Stmt *stmt) {
+    while (stmt) {
+        resolve_stmt(resolver, stmt);
+        stmt = stmt->next;
+    }
+}
+
+void resolve_program(Env *env, LiteralPool *literals, Stmt *stmt) {
+    Resolver resolver = {
+            .env = env,
+            .literals = literals,
+            .symbol_literals = NULL,
+            .symbol_capacity = 0,
+    };
+    resolve_stmts(&resolver, stmt);
+    nx_free(resolver.symbol_literals);
+}
@@ -0,0 +1,364 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file ast_interp.c
+ * \brief Implementation of the tree-walking interpreter.
+ */
+
+#include "natrix/interp/ast_interp.h"
+#include <assert.h>
+#include "natrix/interp/builtins.h"
+#include "natrix/interp/exec_counts.h"
+#include "natrix/interp/ops.h"
+#include "natrix/interp/profiler.h"
+#include "natrix/obj/nx_dict.h"
+#include "natrix/obj/nx_int.h"
+#include "natrix/obj/nx_list.h"
+#include "natrix/util/output.h"
+#include "natrix/util/safepoint.h"
+
+/**
+ * \brief Internal state of the interpreter.
+ */
+typedef struct {
+    Env *env;                       //!< environment for variable lookup
+    const LiteralPool *literals;    //!< values of the literals of the program
+    bool profile;                   //!< whether to publish the executed statements to the profiler
+    ExecCounts *counts;             //!< counts of the executed statements and expressions, NULL if not counting
+    Safepoint *safepoint;           //!< safepoint of the thread, polled at the loop back-edges
+    bool interrupted;               //!< whether the program has been interrupted at a safepoint
+    Arena temporaries;              //!< region of the temporaries, released after each statement
+} AstInterp;
+
+static void exec_stmts(AstInterp *interp, const Stmt *stmt);
+static NxObject *eval_call(AstInterp *interp, const Expr *expr, BuiltinFn fn);
+
+/**
+ * \brief Polls the safepoint at a loop back-edge.
+ * \param interp the interpreter state
+ * \return true if the program has been interrupted and the loop must stop
+ */
+static inline bool interrupted_at_back_edge(AstInterp *interp) {
+    if (safepoint_is_pending(interp->safepoint) && safepoint_handle(interp->safepoint)) {
+        interp->interrupted = true;
+    }
+    return interp->interrupted;
+}
+
+/**
+ * \brief Evaluates the given expression.
+ * \param interp the interpreter state
+ * \param expr the expression to evaluate
+ * \return the result of the expression
+ */
+static NxObject *eval_expr(AstInterp *interp, const Expr *expr) {
+    if (interp->counts) {
+        interp->counts->exprs[expr->kind]++;
+    }
+    switch (expr->kind) {
+        case EXPR_INT_LITERAL:
+        case EXPR_STR_LITERAL:
+            assert(expr->literal.index < interp->literals->count);
+            return literal_pool_get(interp->literals, expr->literal.index);
+        case EXPR_LIST_LITERAL: {
+            int64_t cnt = 0;
+            Expr *e = expr->literal.head;
+            while (e) {
+                cnt++;
+                e = e->next;
+            }
+            // the items are collected first, so that the list is created with the right strategy and size at once
+            NxObjectArray *values = nx_object_array_create(cnt);
+            gc_root(&values->gc_header);
+            e = expr->literal.head;
+            for (int64_t i = 0; i < cnt; i++) {
+                NxObject *value = eval_expr(interp, e);
+                values->data[i] = value;
+                gc_write_barrier(&values->gc_header, nxo_gc_header(value));
+                e = e->next;
+            }
+            NxObject *result = nx_list_create_from(values->data, cnt);
+            gc_unroot(&values->gc_header);
+            return result;
+        }
+        case EXPR_DICT_LITERAL: {
+            NxObject *result = nx_dict_create(0);
+            nxo_root(result);
+            for (const Expr *key = expr->literal.head; key; key = key->next->next) {
+                NxObject *k = eval_expr(interp, key);
+                nxo_root(k);
+                NxObject *v = eval_expr(interp, key->next);
+                nxo_root(v);
+                nx_dict_set(result, k, v);
+                nxo_unroot(v);
+                nxo_unroot(k);
+            }
+            nxo_unroot(result);
+            return result;
+        }
+        case EXPR_NAME:
+            assert(expr->identifier.slot < interp->env->count);
+            return env_load(interp->env, expr->identifier.slot);
+        case EXPR_BINARY: {
+            NxObject *left = eval_expr(interp, expr->binary.left);
+            nxo_root(left);
+            NxObject *right = eval_expr(interp, expr->binary.right);
+            NxObject *res;
+            if (expr->binary.temporary) {
+                nx_int_temporaries = &interp->temporaries;
+                res = ops_binary(left, expr->binary.op, right);
+                nx_int_temporaries = NULL;
+            } else {
+                res = ops_binary(left, expr->binary.op, right);
+            }
+            nxo_unroot(left);
+            return res;
+        }
+        case EXPR_SUBSCRIPT: {
+            GcScope scope = gc_scope_begin();
+            NxObject *receiver = eval_expr(interp, expr->subscript.receiver);
+            nxo_root(receiver);
+            NxObject *index = eval_expr(interp, expr->subscript.index);
+            nxo_root(index);
+            NxObject *res = nxo_get_element(receiver, index);
+            gc_scope_end(scope);
+            return res;
+        }
+        case EXPR_SLICE: {
+            GcScope scope = gc_scope_begin();
+            NxObject *receiver = eval_expr(interp, expr->slice.receiver);
+            nxo_root(receiver);
+            NxObject *lower = NULL;
+            if (expr->slice.lower) {
+                lower = eval_expr(interp, expr->slice.lower);
+                nxo_root(lower);
+            }
+            NxObject *upper = expr->slice.upper ? eval_expr(interp, expr->slice.upper) : NULL;
+            NxObject *res = nxo_get_slice(receiver, lower, upper);
+            gc_scope_end(scope);
+            return res;
+        }
+        case EXPR_CALL:
+            return eval_call(interp, expr, builtin_get(expr->call.callee->identifier.slot)->fn);
+        default:
+            assert(0);
+    }
+}
+
+/**
+ * \brief Evaluates the arguments of a call and calls the given implementation with them.
+ * \param interp the interpreter state
+ * \param expr the call expression
+ * \param fn the implementation, usually that of the callee
+ * \return the result of the call
+ */
+static NxObject *eval_call(AstInterp *interp, const Expr *expr, BuiltinFn fn) {
+    NxObject *args[AST_MAX_ARGS];
+    uint32_t argc = 0;
+    GcScope scope = gc_scope_begin();
+    for (const Expr *e = expr->call.args; e; e = e->next) {
+        assert(argc < AST_MAX_ARGS);
+        args[argc] = eval_expr(interp, e);
+        nxo_root(args[argc++]);
+    }
+    NxObject *res = fn(args, argc);
+    gc_scope_end(scope);
+    return res;
+}
+
+/**
+ * \brief Determines whether evaluating the expression cannot trigger garbage collection.
+ * \param expr the expression
+ * \return true for literals and variables
+ */
+static bool is_non_allocating(const Expr *expr) {
+    return expr->kind == EXPR_INT_LITERAL || expr->kind == EXPR_STR_LITERAL || expr->kind == EXPR_NAME;
+}
+
+/**
+ * \brief Evaluates an expression and returns the result as a boolean value.
+ *
+ * A comparison of integers is evaluated directly to a C boolean, without creating the `bool` object.
+ * \param interp the interpreter state
+ * \param expr the condition expression
+ * \return the result of the condition
+ */
+static bool eval_cond(AstInterp *interp, const Expr *expr) {
+    if (expr->kind != EXPR_BINARY || !ops_is_comparison(expr->binary.op)) {
+        return ops_is_true(eval_expr(interp, expr));
+    }
+    if (interp->counts) {
+        interp->counts->exprs[EXPR_BINARY]++;
+    }
+    NxObject *left = eval_expr(interp, expr->binary.left);
+    // the left operand only needs to be rooted if evaluating the right one can collect garbage
+    bool rooted = !is_non_allocating(expr->binary.right);
+    if (rooted) {
+        nxo_root(left);
+    }
+    NxObject *right = eval_expr(interp, expr->binary.right);
+    bool result;
+    if (nx_int_is_instance(left) && nx_int_is_instance(right)) {
+        result = ops_compare_int(left, expr->binary.op, right);
+    } else {
+        // comparisons do not allocate
+        result = ops_is_true(ops_binary(left, expr->binary.op, right));
+    }
+    if (rooted) {
+        nxo_unroot(left);
+    }
+    return result;
+}
+
+/**
+ * \brief Executes the given statement.
+ * \param interp the interpreter state
+ * \param stmt the statement
+ */
+static void exec_stmt(AstInterp *interp, const Stmt *stmt) {
+    switch (stmt->kind) {
+        case STMT_EXPR:
+            eval_expr(interp, stmt->expr);
+            break;
+        case STMT_ASSIGNMENT: {
+            if (stmt->assignment.left->kind == EXPR_NAME) {
+                NxObject *rhs = eval_expr(interp, stmt->assignment.right);
+                assert(stmt->assignment.left->identifier.slot < interp->env->count);
+                env_store(interp->env, stmt->assignment.left->identifier.slot, rhs);
+            } else if (stmt->assignment.left->kind == EXPR_SUBSCRIPT) {
+                GcScope scope = gc_scope_begin();
+                NxObject *receiver = eval_expr(interp, stmt->assignment.left->subscript.receiver);
+                nxo_root(receiver);
+                NxObject *index = eval_expr(interp, stmt->assignment.left->subscript.index);
+                nxo_root(index);
+                NxObject *value = eval_expr(interp, stmt->assignment.right);
+                nxo_root(value);
+                nxo_set_element(receiver, index, value);
+                gc_scope_end(scope);
+            } else {
+                assert(0);
+            }
+            break;
+        }
+        case STMT_AUG_ASSIGNMENT: {
+            const Expr *left = stmt->assignment.left;
+            GcScope scope = gc_scope_begin();
+            if (left->kind == EXPR_NAME) {
+                assert(left->identifier.slot < interp->env->count);
+                NxObject *current = eval_expr(interp, left);
+                nxo_root(current);
+                NxObject *rhs = eval_expr(interp, stmt->assignment.right);
+                env_store(interp->env, left->identifier.slot, ops_inplace(current, stmt->assignment.op, rhs));
+            } else {
+                assert(left->kind == EXPR_SUBSCRIPT);
+                // the receiver and the index are evaluated only once
+                NxObject *receiver = eval_expr(interp, left->subscript.receiver);
+                nxo_root(receiver);
+                NxObject *index = eval_expr(interp, left->subscript.index);
+                nxo_root(index);
+                NxObject *current = nxo_get_element(receiver, index);
+                nxo_root(current);
+                NxObject *rhs = eval_expr(interp, stmt->assignment.right);
+                NxObject *value = ops_inplace(current, stmt->assignment.op, rhs);
+                nxo_root(value);
+                nxo_set_element(receiver, index, value);
+            }
+            gc_scope_end(scope);
+            break;
+        }
+        case STMT_WHILE:
+            while (eval_cond(interp, stmt->while_stmt.condition)) {
+                exec_stmts(interp, stmt->while_stmt.body);
+                if (interrupted_at_back_edge(interp)) {
+                    break;
+                }
+            }
+            break;
+        case STMT_FOR: {
+            const Expr *iterable = stmt->for_stmt.iterable;
+            NxObject *obj;
+            if (builtin_is_range_call(iterable)) {
+                if (interp->counts) {
+                    interp->counts->exprs[EXPR_CALL]++;
+                }
+                obj = eval_call(interp, iterable, builtin_range_iter);
+            } else {
+                obj = eval_expr(interp, iterable);
+            }
+            // the hidden slot keeps the iterated object alive, the position can stay in a local variable
+            uint32_t slot = stmt->for_stmt.iter_slot;
+            assert(slot < interp->env->count && stmt->for_stmt.target->identifier.slot < interp->env->count);
+            env_store(interp->env, slot, obj);
+            int64_t position = 0;
+            NxObject *item;
+            while ((item = nxo_iter_next(interp->env->values[slot], &position)) != NULL) {
+                env_store(interp->env, stmt->for_stmt.target->identifier.slot, item);
+                exec_stmts(interp, stmt->for_stmt.body);
+                if (interrupted_at_back_edge(interp)) {
+                    break;
+                }
+            }
+            break;
+        }
+        case STMT_IF:
+            if (eval_cond(interp, stmt->if_stmt.condition)) {
+                exec_stmts(interp, stmt->if_stmt.then_body);
+            } else if (stmt->if_stmt.else_body) {
+                exec_stmts(interp, stmt->if_stmt.else_body);
+            }
+            break;
+        case STMT_PASS:
+            break;
+        case STMT_PRINT:
+            ops_print(eval_expr(interp, stmt->expr));
+            break;
+        default:
+            assert(0);
+    }
+}
+
+/**
+ * \brief Executes a list of statements, stopping early if the program is interrupted.
+ * \param interp the interpreter state
+ * \param stmt the first statement in the list, may be NULL
+ */
+static void exec_stmts(AstInterp *interp, const Stmt *stmt) {
+    while (stmt && !interp->interrupted) {
+        if (interp->counts) {
+            interp->counts->stmts[stmt->kind]++;
+        }
+        if (interp->profile) {
+            // restored afterwards, so that the condition of an enclosing loop is attributed to the loop
+            const void *parent = profiler_current;
+            profiler_current = stmt;
+            exec_stmt(interp, stmt);
+            profiler_current = parent;
+        } else {
+            exec_stmt(interp, stmt);
+        }
+        if (interp->temporaries.alloc_count) {
+            arena_reset(&interp->temporaries);
+        }
+        stmt = stmt->next;
+    }
+}
+
+bool ast_interp_exec(Env *env, const LiteralPool *literals, const Stmt *stmt) {
+    AstInterp interp = {
+            .env = env,
+            .literals = literals,
+            .profile = profiler_is_running(),
+            .counts = exec_counts_current,
+            .safepoint = safepoint_current(),
+            .temporaries = arena_init(),
+    };
+    exec_stmts(&interp, stmt);
+    arena_free(&interp.temporaries);
+    output_flush();
+    return !interp.interrupted;
+}
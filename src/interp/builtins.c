@@ -0,0 +1,377 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file builtins.c
+ * \brief Implementation of the built-in functions.
+ */
+
+#include "natrix/interp/builtins.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "natrix/interp/ops.h"
+#include "natrix/obj/nx_dict.h"
+#include "natrix/obj/nx_int.h"
+#include "natrix/obj/nx_lines.h"
+#include "natrix/obj/nx_list.h"
+#include "natrix/obj/nx_range.h"
+#include "natrix/obj/nx_str.h"
+#include "natrix/util/mem.h"
+#include "natrix/util/panic.h"
+
+//! Offset added to immediate integers to make them non-negative, see `sum_ints()`.
+#define SUM_BIAS ((uint64_t) 1 << 62)
+
+//! Number of integers summed before the partial sums are combined, small enough for the partial sums not to overflow.
+#define SUM_BLOCK ((int64_t) 1 << 30)
+
+//! Implementation of `len()`.
+static NxObject *builtin_len(NxObject *const *args, uint32_t argc) {
+    assert(argc == 1);
+    if (nx_list_is_instance(args[0])) {
+        return nx_int_create(nx_list_get_length(args[0]));
+    }
+    if (nx_str_is_instance(args[0])) {
+        return nx_int_create(nx_str_get_length(args[0]));
+    }
+    if (nx_dict_is_instance(args[0])) {
+        return nx_int_create(nx_dict_get_length(args[0]));
+    }
+    PANIC("len() argument must be a list, a string or a dict");
+}
+
+/**
+ * \brief Returns the items of the single list argument or the arguments themselves.
+ *
+ * Panics if the function got a single argument which is not a list or no values at all.
+ * \param args the arguments
+ * \param argc number of arguments, at least one
+ * \param name name of the function, for error messages
+ * \param count receives the number of values
+ * \return the values, NULL if the argument is a list using the `NX_LIST_INTS` strategy
+ */
+static NxObject *const *get_values(NxObject *const *args, uint32_t argc, const char *name, int64_t *count) {
+    if (argc > 1) {
+        *count = argc;
+        return args;
+    }
+    if (!nx_list_is_instance(args[0])) {
+        PANIC("%s() argument must be a list", name);
+    }
+    NxList *list = (NxList *) args[0];
+    if (list->length == 0) {
+        PANIC("%s() argument is an empty list", name);
+    }
+    *count = list->length;
+    return list->strategy == NX_LIST_INTS ? NULL : list->items->data;
+}
+
+/**
+ * \brief Finds the smallest or the largest integer.
+ *
+ * Independent accumulators and a conditional move instead of a branch let the compiler vectorize the loop on
+ * targets with 64-bit vector comparisons and keep the dependency chains short elsewhere.
+ * \param data the integers
+ * \param count number of integers, at least one
+ * \param largest true to find the largest integer
+ * \return the result
+ */
+static int64_t extreme_int(const int64_t *data, int64_t count, bool largest) {
+    int64_t acc[4] = {data[0], data[0], data[0], data[0]};
+    int64_t i = 0;
+    if (largest) {
+        for (; i + 4 <= count; i += 4) {
+            for (int j = 0; j < 4; j++) {
+                acc[j] = data[i + j] > acc[j] ? data[i + j] : acc[j];
+            }
+        }
+    } else {
+        for (; i + 4 <= count; i += 4) {
+            for (int j = 0; j < 4; j++) {
+                acc[j] = data[i + j] < acc[j] ? data[i + j] : acc[j];
+            }
+        }
+    }
+    for (; i < count; i++) {
+        acc[0] = (data[i] > acc[0]) == largest ? data[i] : acc[0];
+    }
+    for (int j = 1; j < 4; j++) {
+        acc[0] = (acc[j] > acc[0]) == largest ? acc[j] : acc[0];
+    }
+    return acc[0];
+}
+
+/**
+ * \brief Common implementation of `min()` and `max()`.
+ * \param args the arguments
+ * \param argc number of arguments
+ * \param op `BINOP_LT` for `min()`, `BINOP_GT` for `max()`
+ * \return the smallest or the largest value
+ */
+static NxObject *extreme(NxObject *const *args, uint32_t argc, BinaryOp op) {
+    const char *name = op == BINOP_LT ? "min" : "max";
+    int64_t count;
+    NxObject *const *values = get_values(args, argc, name, &count);
+    if (!values) {
+        return nx_int_create(extreme_int(((NxList *) args[0])->ints->data, count, op == BINOP_GT));
+    }
+    NxObject *result = values[0];
+    for (int64_t i = 1; i < count; i++) {
+        // the values are either rooted arguments or items of a rooted list, comparisons do not allocate
+        if (ops_is_true(ops_binary(values[i], op, result))) {
+            result = values[i];
+        }
+    }
+    return result;
+}
+
+//! Implementation of `max()`.
+static NxObject *builtin_max(NxObject *const *args, uint32_t argc) {
+    return extreme(args, argc, BINOP_GT);
+}
+
+//! Implementation of `min()`.
+static NxObject *builtin_min(NxObject *const *args, uint32_t argc) {
+    return extreme(args, argc, BINOP_LT);
+}
+
+/**
+ * \brief Returns the value of an argument of `range()`.
+ *
+ * Panics if the argument is not an immediate integer, which guarantees that all items of the range are immediate.
+ * \param arg the argument
+ * \return the value of the argument
+ */
+static int64_t range_arg(NxObject *arg) {
+    if (!nxo_is_immediate_int(arg)) {
+        PANIC("range() arguments must be integers between %lld and %lld",
+              (long long) NX_INT_IMMEDIATE_MIN, (long long) NX_INT_IMMEDIATE_MAX);
+    }
+    return nx_int_get_value(arg);
+}
+
+/**
+ * \brief Validates the arguments of `range()` and computes the items of the range.
+ * \param args the arguments
+ * \param argc number of arguments, between 1 and 3
+ * \param start receives the first item
+ * \param step receives the difference between consecutive items
+ * \return the number of items
+ */
+static int64_t range_items(NxObject *const *args, uint32_t argc, int64_t *start, int64_t *step) {
+    assert(argc >= 1 && argc <= 3);
+    *start = argc == 1 ? 0 : range_arg(args[0]);
+    int64_t stop = range_arg(args[argc == 1 ? 0 : 1]);
+    *step = argc == 3 ? range_arg(args[2]) : 1;
+    if (*step == 0) {
+        PANIC("range() step must not be zero");
+    }
+    // the bounds are immediate integers, their difference cannot overflow
+    if (*step > 0 && stop > *start) {
+        return (stop - *start - 1) / *step + 1;
+    }
+    if (*step < 0 && stop < *start) {
+        return (*start - stop - 1) / -*step + 1;
+    }
+    return 0;
+}
+
+//! Implementation of `range()`.
+static NxObject *builtin_range(NxObject *const *args, uint32_t argc) {
+    int64_t start, step;
+    int64_t length = range_items(args, argc, &start, &step);
+    if (length > INT64_MAX / (int64_t) sizeof(int64_t)) {
+        PANIC("range() is too long");
+    }
+    NxObject *result = nx_list_create(length > 0 ? length : 1);
+    NxList *list = (NxList *) result;
+    assert(list->strategy == NX_LIST_INTS);
+    for (int64_t i = 0; i < length; i++) {
+        list->ints->data[i] = start + i * step;
+    }
+    list->length = length;
+    return result;
+}
+
+NxObject *builtin_range_iter(NxObject *const *args, uint32_t argc) {
+    int64_t start, step;
+    int64_t length = range_items(args, argc, &start, &step);
+    return nx_range_create(start, step, length);
+}
+
+/**
+ * \brief Computes the sum of integers which fit in immediate integers.
+ *
+ * Each integer is offset by `SUM_BIAS` and split into the high and low 32 bits, so that the block sums of both
+ * halves cannot overflow and the loop needs only additions, shifts and masks, which the compiler vectorizes.
+ * The exact sum is recombined in 128 bits.
+ * \param data the integers
+ * \param count number of integers
+ * \return the sum
+ */
+static NxObject *sum_ints(const int64_t *data, int64_t count) {
+    __int128 total = 0;
+    for (int64_t block = 0; block < count; block += SUM_BLOCK) {
+        int64_t n = count - block < SUM_BLOCK ? count - block : SUM_BLOCK;
+        const int64_t *p = data + block;
+        uint64_t high = 0;
+        uint64_t low = 0;
+        for (int64_t i = 0; i < n; i++) {
+            uint64_t biased = (uint64_t) p[i] + SUM_BIAS;
+            high += biased >> 32;
+            low += biased & 0xFFFFFFFFu;
+        }
+        total += ((__int128) high << 32) + low - (__int128) n * SUM_BIAS;
+    }
+    if (total >= INT64_MIN && total <= INT64_MAX) {
+        return nx_int_create((int64_t) total);
+    }
+    // at most 2^31 blocks of 2^30 integers, the sum has less than 124 bits and the high part fits in 64 bits
+    NxObject *half_shift = nx_int_create((int64_t) 1 << 31);
+    NxObject *result = nx_int_mul(nx_int_create((int64_t) (total >> 62)), half_shift);
+    nxo_root(result);
+    NxObject *high = nx_int_mul(result, half_shift);
+    nxo_unroot(result);
+    nxo_root(high);
+    result = nx_int_add(high, nx_int_create((int64_t) (total & (SUM_BIAS - 1))));
+    nxo_unroot(high);
+    return result;
+}
+
+//! Implementation of `sum()`.
+static NxObject *builtin_sum(NxObject *const *args, uint32_t argc) {
+    assert(argc == 1);
+    if (!nx_list_is_instance(args[0])) {
+        PANIC("sum() argument must be a list");
+    }
+    NxList *list = (NxList *) args[0];
+    if (list->strategy == NX_LIST_INTS) {
+        return sum_ints(list->ints->data, list->length);
+    }
+    NxObject *total = nx_int_create(0);
+    for (int64_t i = 0; i < list->length; i++) {
+        nxo_root(total);
+        NxObject *next = ops_binary(total, BINOP_ADD, list->items->data[i]);
+        nxo_unroot(total);
+        total = next;
+    }
+    return total;
+}
+
+/**
+ * \brief Opens the file named by the optional argument of `read_file()` or `read_lines()`.
+ *
+ * Panics if the argument is not a string or the file cannot be opened.
+ * \param args the arguments
+ * \param argc number of arguments, 0 or 1
+ * \param name name of the function, for error messages
+ * \return the file descriptor, `STDIN_FILENO` if there is no argument
+ */
+static int open_arg(NxObject *const *args, uint32_t argc, const char *name) {
+    assert(argc <= 1);
+    if (argc == 0) {
+        return STDIN_FILENO;
+    }
+    if (!nx_str_is_instance(args[0])) {
+        PANIC("%s() argument must be a string", name);
+    }
+    const char *path = nx_str_get_cstr(args[0]);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        PANIC("Cannot open %s: %s", path, strerror(errno));
+    }
+    return fd;
+}
+
+/**
+ * \brief Reads from a file descriptor until the buffer is full or the end of the file is reached.
+ *
+ * Panics if the file cannot be read.
+ * \param fd the file descriptor
+ * \param buffer the buffer
+ * \param size size of the buffer
+ * \return the number of bytes read
+ */
+static int64_t read_fully(int fd, char *buffer, int64_t size) {
+    int64_t total = 0;
+    while (total < size) {
+        ssize_t count = read(fd, buffer + total, size - total);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count < 0) {
+            PANIC("Cannot read file: %s", strerror(errno));
+        }
+        if (count == 0) {
+            break;
+        }
+        total += count;
+    }
+    return total;
+}
+
+//! Implementation of `read_file()`, a regular file is read directly into the string.
+static NxObject *builtin_read_file(NxObject *const *args, uint32_t argc) {
+    int fd = open_arg(args, argc, "read_file");
+    struct stat st;
+    NxObject *result;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        char *bytes;
+        result = nx_str_create_buffer(st.st_size, &bytes);
+        int64_t length = read_fully(fd, bytes, st.st_size);
+        if (length < st.st_size) {
+            // the file has been truncated in the meantime
+            NxObject *buffer = result;
+            nxo_root(buffer);
+            result = nx_str_view(buffer, 0, length);
+            nxo_unroot(buffer);
+        }
+    } else {
+        // the size of a pipe is unknown, its contents are collected first
+        int64_t capacity = NX_LINES_BLOCK_SIZE;
+        int64_t length = 0;
+        char *buffer = nx_alloc(capacity);
+        while ((length += read_fully(fd, buffer + length, capacity - length)) == capacity) {
+            capacity *= 2;
+            buffer = nx_realloc(buffer, capacity);
+        }
+        result = nx_str_create(buffer, length);
+        nx_free(buffer);
+    }
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+    return result;
+}
+
+//! Implementation of `read_lines()`.
+static NxObject *builtin_read_lines(NxObject *const *args, uint32_t argc) {
+    int fd = open_arg(args, argc, "read_lines");
+    return nx_lines_create(fd, fd != STDIN_FILENO);
+}
+
+const Builtin builtin_table[BUILTIN_COUNT] = {
+        [BUILTIN_LEN] = {"len", 1, 1, builtin_len},
+        [BUILTIN_MAX] = {"max", 1, UINT32_MAX, builtin_max},
+        [BUILTIN_MIN] = {"min", 1, UINT32_MAX, builtin_min},
+        [BUILTIN_RANGE] = {"range", 1, 3, builtin_range},
+        [BUILTIN_READ_FILE] = {"read_file", 0, 1, builtin_read_file},
+        [BUILTIN_READ_LINES] = {"read_lines", 0, 1, builtin_read_lines},
+        [BUILTIN_SUM] = {"sum", 1, 1, builtin_sum},
+};
+
+uint32_t builtin_lookup(const char *name, size_t length) {
+    for (uint32_t i = 0; i < BUILTIN_COUNT; i++) {
+        if (strlen(builtin_table[i].name) == length && memcmp(builtin_table[i].name, name, length) == 0) {
+            return i;
+        }
+    }
+    return BUILTIN_COUNT;
+}
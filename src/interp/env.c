@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file env.c
+ * \brief Implementation of the environment.
+ */
+
+#include "natrix/interp/env.h"
+#include <assert.h>
+#include <string.h>
+#include "natrix/util/counters.h"
+#include "natrix/util/hash.h"
+#include "natrix/util/mem.h"
+#include "natrix/util/panic.h"
+
+//! Initial number of slots allocated by the environment.
+#define INITIAL_CAPACITY 16
+
+/**
+ * \brief Reports the values of all slots to the garbage collector.
+ * \param ptr pointer to the environment
+ */
+static void env_gc_trace(void *ptr) {
+    Env *env = (Env *) ptr;
+    for (size_t i = 0; i < env->count; i++) {
+        gc_visit(nxo_gc_header(env->values[i]));
+    }
+}
+
+/**
+ * \brief Names the pointers of the environment in heap dumps after the variables.
+ * \param ptr pointer to the environment
+ * \param edge the slot, since every slot is visited by `env_gc_trace()`
+ * \param length receives the length of the name
+ * \return the name of the variable
+ */
+static const char *env_edge_name(const void *ptr, size_t edge, size_t *length) {
+    const Env *env = (const Env *) ptr;
+    if (edge >= env->count) {
+        return NULL;
+    }
+    *length = env->names[edge].length;
+    return env->names[edge].start;
+}
+
+Env env_init() {
+    GcClassId class_id = gc_register_class(env_gc_trace, "environment");
+    gc_set_edge_namer(class_id, env_edge_name);
+    return (Env) {
+            .gc_header = {.mark = 0, .class_id = class_id},
+            .values = NULL,
+            .names = NULL,
+            .count = 0,
+            .capacity = 0,
+            .index = NULL,
+            .index_capacity = 0,
+    };
+}
+
+void env_free(Env *env) {
+    for (size_t i = 0; i < env->count; i++) {
+        nx_free((char *) env->names[i].start);
+    }
+    nx_free(env->values);
+    nx_free(env->names);
+    nx_free(env->index);
+    *env = env_init();
+}
+
+/**
+ * \brief Doubles the number of buckets of the index of the names and reinserts the slots.
+ * \param env the environment
+ */
+static void grow_index(Env *env) {
+    size_t capacity = env->index_capacity ? env->index_capacity * 2 : 2 * INITIAL_CAPACITY;
+    uint32_t *index = nx_alloc(capacity * sizeof(uint32_t));
+    memset(index, 0, capacity * sizeof(uint32_t));
+    for (size_t slot = 0; slot < env->count; slot++) {
+        size_t i = env->names[slot].hash & (capacity - 1);
+        while (index[i]) {
+            i = (i + 1) & (capacity - 1);
+        }
+        index[i] = (uint32_t) slot + 1;
+    }
+    nx_free(env->index);
+    env->index = index;
+    env->index_capacity = capacity;
+}
+
+uint32_t env_declare(Env *env, const char *name_start, size_t name_len) {
+    return env_declare_hashed(env, name_start, name_len, hash_bytes(name_start, name_len));
+}
+
+uint32_t env_declare_hashed(Env *env, const char *name_start, size_t name_len, uint64_t hash) {
+    assert(hash == hash_bytes(name_start, name_len));
+    // the load factor is kept at most 1/2, so that the probe sequences stay short
+    if (2 * (env->count + 1) > env->index_capacity) {
+        grow_index(env);
+    }
+    size_t i = hash & (env->index_capacity - 1);
+    counter_add(COUNTER_ENV_PROBES, 1);
+    while (env->index[i]) {
+        const EnvName *existing = &env->names[env->index[i] - 1];
+        if (existing->hash == hash && existing->length == name_len
+                && memcmp(existing->start, name_start, name_len) == 0) {
+            return env->index[i] - 1;
+        }
+        i = (i + 1) & (env->index_capacity - 1);
+        counter_add(COUNTER_ENV_PROBES, 1);
+    }
+    assert(env->count < UINT32_MAX - 1);
+    if (env->count == env->capacity) {
+        env->capacity = env->capacity ? env->capacity * 2 : INITIAL_CAPACITY;
+        env->values = nx_realloc(env->values, env->capacity * sizeof(NxObject *));
+        env->names = nx_realloc(env->names, env->capacity * sizeof(EnvName));
+    }
+    // the name is copied, since the source code may be released before the environment (see `SourceStream`)
+    char *name = nx_alloc(name_len + 1);
+    memcpy(name, name_start, name_len);
+    name[name_len] = '\0';
+    env->values[env->count] = NULL;
+    env->names[env->count] = (EnvName) {.start = name, .length = name_len, .hash = hash};
+    env->index[i] = (uint32_t) env->count + 1;
+    return env->count++;
+}
+
+void env_undefined_variable(const Env *env, uint32_t slot) {
+    assert(slot < env->count);
+    PANIC("Undefined variable: %.*s", (int) env->names[slot].length, env->names[slot].start);
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file exec_counts.c
+ * \brief Implementation of the execution counts.
+ */
+
+#include "natrix/interp/exec_counts.h"
+#include <assert.h>
+#include <string.h>
+
+//! Names of the statement kinds in the report.
+static const char *const STMT_NAMES[EXEC_COUNTS_STMT_KINDS] = {
+    [STMT_EXPR] = "expr",
+    [STMT_ASSIGNMENT] = "assignment",
+    [STMT_AUG_ASSIGNMENT] = "aug_assignment",
+    [STMT_WHILE] = "while",
+    [STMT_FOR] = "for",
+    [STMT_IF] = "if",
+    [STMT_PASS] = "pass",
+    [STMT_PRINT] = "print",
+};
+
+//! Names of the expression kinds in the report.
+static const char *const EXPR_NAMES[EXEC_COUNTS_EXPR_KINDS] = {
+    [EXPR_INT_LITERAL] = "int_literal",
+    [EXPR_STR_LITERAL] = "str_literal",
+    [EXPR_LIST_LITERAL] = "list_literal",
+    [EXPR_DICT_LITERAL] = "dict_literal",
+    [EXPR_NAME] = "name",
+    [EXPR_BINARY] = "binary",
+    [EXPR_SUBSCRIPT] = "subscript",
+    [EXPR_SLICE] = "slice",
+    [EXPR_CALL] = "call",
+};
+
+_Thread_local ExecCounts *exec_counts_current = NULL;
+
+void exec_counts_start(ExecCounts *counts) {
+    assert(exec_counts_current == NULL);
+    memset(counts, 0, sizeof(*counts));
+    // the values at the start are kept in the counts and subtracted when counting stops
+    for (Counter counter = 0; counter < COUNTER_COUNT; counter++) {
+        counts->events[counter] = counter_values[counter];
+    }
+    gc_get_stats(&counts->gc);
+    exec_counts_current = counts;
+}
+
+void exec_counts_stop(ExecCounts *counts) {
+    assert(exec_counts_current == counts);
+    exec_counts_current = NULL;
+    for (Counter counter = 0; counter < COUNTER_COUNT; counter++) {
+        counts->events[counter] = counter_values[counter] - counts->events[counter];
+    }
+    GcStats start = counts->gc;
+    gc_get_stats(&counts->gc);
+    counts->gc.minor_collections -= start.minor_collections;
+    counts->gc.major_collections -= start.major_collections;
+    counts->gc.allocated_bytes -= start.allocated_bytes;
+    counts->gc.allocated_objects -= start.allocated_objects;
+    counts->gc.marked_objects -= start.marked_objects;
+}
+
+/**
+ * \brief Writes a field with the total of counts by kind, followed by an object with the non-zero counts.
+ * \param sb the string builder
+ * \param total_key the name of the field with the total
+ * \param key the name of the field with the object
+ * \param names the names of the kinds
+ * \param values the counts, indexed by kind
+ * \param count the number of kinds
+ */
+static void append_kinds(StringBuilder *sb, const char *total_key, const char *key, const char *const *names,
+                         const uint64_t *values, size_t count) {
+    uint64_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        total += values[i];
+    }
+    sb_append_formatted(sb, "  \"%s\": %llu,\n  \"%s\": {", total_key, (unsigned long long) total, key);
+    const char *separator = "\n";
+    for (size_t i = 0; i < count; i++) {
+        if (values[i]) {
+            sb_append_formatted(sb, "%s    \"%s\": %llu", separator, names[i], (unsigned long long) values[i]);
+            separator = ",\n";
+        }
+    }
+    sb_append_str(sb, total ? "\n  },\n" : "},\n");
+}
+
+void exec_counts_to_json(const ExecCounts *counts, StringBuilder *sb) {
+    const char *opcode_names[OPCODE_COUNT];
+    for (int op = 0; op < OPCODE_COUNT; op++) {
+        opcode_names[op] = code_get_opcode_name((Opcode) op);
+    }
+    sb_append_str(sb, "{\n");
+    append_kinds(sb, "instructions", "opcodes", opcode_names, counts->opcodes, OPCODE_COUNT);
+    append_kinds(sb, "statements", "stmts", STMT_NAMES, counts->stmts, EXEC_COUNTS_STMT_KINDS);
+    append_kinds(sb, "expressions", "exprs", EXPR_NAMES, counts->exprs, EXEC_COUNTS_EXPR_KINDS);
+    sb_append_formatted(sb, "  \"gc_allocations\": %llu,\n  \"gc_allocated_bytes\": %llu,\n"
+                            "  \"gc_minor_collections\": %llu,\n  \"gc_major_collections\": %llu,\n"
+                            "  \"gc_marked_objects\": %llu",
+                        (unsigned long long) counts->gc.allocated_objects,
+                        (unsigned long long) counts->gc.allocated_bytes,
+                        (unsigned long long) counts->gc.minor_collections,
+                        (unsigned long long) counts->gc.major_collections,
+                        (unsigned long long) counts->gc.marked_objects);
+    for (Counter counter = 0; counter < COUNTER_COUNT; counter++) {
+        sb_append_formatted(sb, ",\n  \"%s\": %llu", COUNTER_NAMES[counter],
+                            (unsigned long long) counts->events[counter]);
+    }
+    sb_append_str(sb, "\n}\n");
+}
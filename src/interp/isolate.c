@@ -0,0 +1,265 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file isolate.c
+ * \brief Implementation of isolates.
+ */
+
+#include "natrix/interp/isolate.h"
+#include <string.h>
+#include <time.h>
+#include "natrix/interp/env.h"
+#include "natrix/interp/program.h"
+#include "natrix/interp/vm.h"
+#include "natrix/obj/nx_int.h"
+#include "natrix/util/hash.h"
+#include "natrix/util/mem.h"
+
+/**
+ * \brief A compiled program kept by an isolate for `nx_isolate_run_program()`.
+ */
+typedef struct {
+    uint64_t hash;                  //!< Hash of the source code, 0 if the entry is empty
+    uint64_t last_used;             //!< Value of the `clock` of the isolate when the program was last run
+    Source source;                  //!< The source code, the compiled code refers to it
+    Env env;                        //!< The variables of the program, rooted, cleared before each run
+    Program program;                //!< The compiled program, without its syntax tree
+} CachedProgram;
+
+/**
+ * \brief State of an isolate.
+ */
+struct NxIsolate {
+    GcState *heap;                  //!< The heap of the isolate
+    Env env;                        //!< The variables, rooted in the heap of the isolate
+    Source *sources;                //!< Source codes of the programs run by the isolate
+    size_t source_count;            //!< Number of source codes
+    size_t source_capacity;         //!< Capacity of the `sources` array
+    CachedProgram *programs;        //!< The compiled programs, NULL until the first `nx_isolate_run_program()`
+    uint64_t clock;                 //!< Number of programs run by `nx_isolate_run_program()`
+    GcState *prev_heap;             //!< Heap of the thread before the current run, see `nx_isolate_discard()`
+    GcScope scope;                  //!< Roots of the isolate, to which the roots of an abandoned run are dropped
+};
+
+NxIsolate *nx_isolate_create(const GcPolicy *policy) {
+    NxIsolate *isolate = nx_alloc(sizeof(NxIsolate));
+    isolate->heap = gc_state_create(policy);
+    isolate->env = env_init();
+    isolate->sources = NULL;
+    isolate->source_count = 0;
+    isolate->source_capacity = 0;
+    isolate->programs = NULL;
+    isolate->clock = 0;
+    isolate->prev_heap = NULL;
+    GcState *prev = gc_state_switch(isolate->heap);
+    gc_root(&isolate->env.gc_header);
+    isolate->scope = gc_scope_begin();
+    gc_state_switch(prev);
+    return isolate;
+}
+
+/**
+ * \brief Marks a source code as empty after its contents have been freed or moved.
+ * \param source the source code
+ */
+static void clear_source(Source *source) {
+    *source = (Source) {.filename = NULL, .start = NULL, .end = NULL, .line_starts = NULL, .line_count = 0,
+                        .mapping_size = 0};
+}
+
+/**
+ * \brief Takes ownership of a source code.
+ * \param isolate the isolate
+ * \param source the source code, emptied by the call
+ * \return the source code owned by the isolate
+ */
+static Source *adopt_source(NxIsolate *isolate, Source *source) {
+    if (isolate->source_count == isolate->source_capacity) {
+        isolate->source_capacity = isolate->source_capacity ? isolate->source_capacity * 2 : 4;
+        isolate->sources = nx_realloc(isolate->sources, isolate->source_capacity * sizeof(Source));
+    }
+    Source *owned = &isolate->sources[isolate->source_count++];
+    *owned = *source;
+    clear_source(source);
+    return owned;
+}
+
+bool nx_isolate_run_source(NxIsolate *isolate, Source *source, int64_t arg) {
+    GcState *prev = gc_state_switch(isolate->heap);
+    isolate->prev_heap = prev;
+#if ENABLE_CONSERVATIVE_GC
+    gc_set_stack_bottom(__builtin_frame_address(0));
+#endif
+    // the sources are reallocated, but the names of the variables point to their contents, which do not move
+    Source *owned = adopt_source(isolate, source);
+    Program program;
+    program_init(&program);
+    bool completed = false;
+    if (program_build(&program, &isolate->env, owned, nx_int_create(arg), false)) {
+        completed = vm_exec(&isolate->env, &program.code);
+    }
+    program_free(&program);
+#if ENABLE_CONSERVATIVE_GC
+    gc_set_stack_bottom(NULL);
+#endif
+    gc_state_switch(prev);
+    return completed;
+}
+
+//! Returns the value of the monotonic clock in nanoseconds.
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/**
+ * \brief Frees a cached program and marks its entry as empty, the heap of the isolate must be the current one.
+ *
+ * The structures of the entry stay rooted, they are emptied by the free functions.
+ * \param program the entry
+ */
+static void drop_program(CachedProgram *program) {
+    program_clear(&program->program);
+    env_free(&program->env);
+    source_free(&program->source);
+    program->hash = 0;
+}
+
+/**
+ * \brief Finds the compiled program of a source code, or compiles it into the least recently used entry.
+ *
+ * The heap of the isolate must be the current one.
+ * \param isolate the isolate
+ * \param source the source code, emptied by the call
+ * \param stats receives whether the program was cached and the compilation time
+ * \return the entry of the program, NULL if the source code contains syntax errors
+ */
+static CachedProgram *find_program(NxIsolate *isolate, Source *source, NxRunStats *stats) {
+    if (!isolate->programs) {
+        // the entries are rooted once and never move, since the roots must be released in the reverse order
+        isolate->programs = nx_alloc(NX_ISOLATE_PROGRAM_CACHE_SIZE * sizeof(CachedProgram));
+        for (size_t i = 0; i < NX_ISOLATE_PROGRAM_CACHE_SIZE; i++) {
+            CachedProgram *program = &isolate->programs[i];
+            program->hash = 0;
+            program->env = env_init();
+            gc_root(&program->env.gc_header);
+            program_init(&program->program);
+        }
+        isolate->scope = gc_scope_begin();
+    }
+    size_t length = source->end - source->start;
+    uint64_t hash = hash_bytes(source->start, length);
+    CachedProgram *victim = &isolate->programs[0];
+    for (size_t i = 0; i < NX_ISOLATE_PROGRAM_CACHE_SIZE; i++) {
+        CachedProgram *program = &isolate->programs[i];
+        if (program->hash == hash && (size_t) (program->source.end - program->source.start) == length
+            && memcmp(program->source.start, source->start, length) == 0) {
+            source_free(source);
+            clear_source(source);
+            stats->cached = true;
+            return program;
+        }
+        if (victim->hash != 0 && (program->hash == 0 || program->last_used < victim->last_used)) {
+            victim = program;
+        }
+    }
+    stats->cached = false;
+    uint64_t start_ns = now_ns();
+    // the victim is dropped only once the source code is known to be valid, its tree is released after compilation
+    if (!program_parse(&victim->program, source)) {
+        program_release_tree(&victim->program);
+        source_free(source);
+        clear_source(source);
+        return NULL;
+    }
+    if (victim->hash != 0) {
+        drop_program(victim);
+    }
+    // the entry owns the source code from now on, so that it is freed with the isolate even if compiling panics
+    victim->source = *source;
+    victim->hash = hash;
+    clear_source(source);
+    program_resolve(&victim->program, &victim->env, NULL, false);
+    program_compile(&victim->program);
+    program_release_tree(&victim->program);
+    stats->compile_ns = now_ns() - start_ns;
+    return victim;
+}
+
+bool nx_isolate_run_program(NxIsolate *isolate, Source *source, int64_t arg, NxRunStats *stats) {
+    *stats = (NxRunStats) {0};
+    GcState *prev = gc_state_switch(isolate->heap);
+    isolate->prev_heap = prev;
+#if ENABLE_CONSERVATIVE_GC
+    gc_set_stack_bottom(__builtin_frame_address(0));
+#endif
+    bool completed = false;
+    CachedProgram *program = find_program(isolate, source, stats);
+    if (program) {
+        stats->executed = true;
+        program->last_used = ++isolate->clock;
+        Env *env = &program->env;
+        for (size_t slot = 0; slot < env->count; slot++) {
+            env->values[slot] = NULL;
+        }
+        GcStats before;
+        gc_get_stats(&before);
+        uint64_t start_ns = now_ns();
+        // `arg` is the first slot, declared before resolving
+        env_store(env, 0, nx_int_create(arg));
+        completed = vm_exec(env, &program->program.code);
+        stats->execute_ns = now_ns() - start_ns;
+        GcStats after;
+        gc_get_stats(&after);
+        stats->allocated_bytes = after.allocated_bytes - before.allocated_bytes;
+        stats->collections = after.minor_collections + after.major_collections - before.minor_collections
+                             - before.major_collections;
+    }
+#if ENABLE_CONSERVATIVE_GC
+    gc_set_stack_bottom(NULL);
+#endif
+    gc_state_switch(prev);
+    return completed;
+}
+
+void nx_isolate_discard(NxIsolate *isolate) {
+    // the roots and the thread-local state left behind by the abandoned frames are dropped
+    gc_scope_end(isolate->scope);
+    vm_release_abandoned();
+#if ENABLE_CONSERVATIVE_GC
+    gc_set_stack_bottom(NULL);
+#endif
+    gc_state_switch(isolate->prev_heap);
+    nx_isolate_destroy(isolate);
+}
+
+void nx_isolate_destroy(NxIsolate *isolate) {
+    GcState *prev = gc_state_switch(isolate->heap);
+    if (isolate->programs) {
+        for (size_t i = NX_ISOLATE_PROGRAM_CACHE_SIZE; i-- > 0;) {
+            CachedProgram *program = &isolate->programs[i];
+            program_free(&program->program);
+            gc_unroot(&program->env.gc_header);
+            if (program->hash != 0) {
+                env_free(&program->env);
+                source_free(&program->source);
+            }
+        }
+        nx_free(isolate->programs);
+    }
+    gc_unroot(&isolate->env.gc_header);
+    env_free(&isolate->env);
+    gc_state_switch(prev);
+    gc_state_destroy(isolate->heap);
+    for (size_t i = 0; i < isolate->source_count; i++) {
+        source_free(&isolate->sources[i]);
+    }
+    nx_free(isolate->sources);
+    nx_free(isolate);
+}
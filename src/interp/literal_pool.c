@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file literal_pool.c
+ * \brief Implementation of the literal pool.
+ */
+
+#include "natrix/interp/literal_pool.h"
+#include <assert.h>
+#include "natrix/util/mem.h"
+
+//! Initial capacity of the pool.
+#define INITIAL_CAPACITY 16
+
+/**
+ * \brief Reports all values in the pool to the garbage collector.
+ * \param ptr pointer to the pool
+ */
+static void literal_pool_gc_trace(void *ptr) {
+    LiteralPool *pool = (LiteralPool *) ptr;
+    for (size_t i = 0; i < pool->count; i++) {
+        gc_visit(nxo_gc_header(pool->values[i]));
+    }
+}
+
+LiteralPool literal_pool_init() {
+    return (LiteralPool) {
+            .gc_header = {.mark = 0, .class_id = gc_register_class(literal_pool_gc_trace, "literal pool")},
+            .values = NULL,
+            .count = 0,
+            .capacity = 0,
+    };
+}
+
+void literal_pool_free(LiteralPool *pool) {
+    nx_free(pool->values);
+    *pool = literal_pool_init();
+}
+
+uint32_t literal_pool_add(LiteralPool *pool, NxObject *value) {
+    assert(pool->count < UINT32_MAX);
+    if (pool->count == pool->capacity) {
+        pool->capacity = pool->capacity ? pool->capacity * 2 : INITIAL_CAPACITY;
+        pool->values = nx_realloc(pool->values, pool->capacity * sizeof(NxObject *));
+    }
+    pool->values[pool->count] = value;
+    return pool->count++;
+}
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file ops.c
+ * \brief Implementation of the operations shared by the execution engines.
+ */
+
+#include "natrix/interp/ops.h"
+#include <assert.h>
+#include "natrix/obj/nx_bool.h"
+#include "natrix/obj/nx_int.h"
+#include "natrix/obj/nx_list.h"
+#include "natrix/obj/nx_str.h"
+#include "natrix/util/output.h"
+#include "natrix/util/panic.h"
+
+NxObject *ops_int_from_str(const char *str, size_t len) {
+    return nx_int_from_str(str, len);
+}
+
+NxObject *ops_str_from_literal(const char *start, const char *end) {
+    assert(start[0] == '"' && end[-1] == '"');
+    return nx_str_create(start + 1, end - start - 2);
+}
+
+//! Symbols of the binary operators used in error messages.
+static const char *const BINOP_SYMBOLS[BINOP_COUNT] = {
+    [BINOP_ADD] = "+",
+    [BINOP_SUB] = "-",
+    [BINOP_MUL] = "*",
+    [BINOP_DIV] = "/",
+    [BINOP_EQ] = "==",
+    [BINOP_NE] = "!=",
+    [BINOP_LT] = "<",
+    [BINOP_LE] = "<=",
+    [BINOP_GT] = ">",
+    [BINOP_GE] = ">=",
+};
+
+/**
+ * \brief Returns the slot of a type implementing the given operator.
+ * \param type the type
+ * \param op binary operation, comparisons are implemented by the `compare` slot
+ * \return the slot, NULL if the type does not implement the operator
+ */
+static NxBinaryFn get_slot(const NxType *type, BinaryOp op) {
+    switch (op) {
+        case BINOP_ADD:
+            return type->add_fn;
+        case BINOP_SUB:
+            return type->sub_fn;
+        case BINOP_MUL:
+            return type->mul_fn;
+        case BINOP_DIV:
+            return type->div_fn;
+        default:
+            assert(ops_is_comparison(op));
+            return type->compare_fn;
+    }
+}
+
+NxObject *ops_binary(NxObject *left, BinaryOp op, NxObject *right) {
+    if (nx_int_is_instance(left) && nx_int_is_instance(right)) {
+        return ops_binary_int(left, op, right);
+    }
+    if (ops_is_comparison(op) && nx_str_is_instance(left) && nx_str_is_instance(right)) {
+        return nx_bool_wrap(ops_compare_str(left, op, right));
+    }
+    const NxType *left_type = nxo_type(left);
+    const NxType *right_type = nxo_type(right);
+    NxBinaryFn fn = get_slot(left_type, op);
+    NxObject *result = fn != NULL ? fn(left, right) : NULL;
+    if (result == NULL && right_type != left_type) {
+        fn = get_slot(right_type, op);
+        result = fn != NULL ? fn(left, right) : NULL;
+    }
+    if (!ops_is_comparison(op)) {
+        if (result == NULL) {
+            PANIC("unsupported operand type(s) for %s: '%s' and '%s'", BINOP_SYMBOLS[op], left_type->name,
+                  right_type->name);
+        }
+        return result;
+    }
+    if (result != NULL) {
+        return nx_bool_wrap(ops_compare_result((int) nx_int_get_value(result), op));
+    }
+    if (op == BINOP_EQ || op == BINOP_NE) {
+        return nx_bool_wrap(nxo_eq(left, right) == (op == BINOP_EQ));
+    }
+    PANIC("'%s' not supported between instances of '%s' and '%s'", BINOP_SYMBOLS[op], left_type->name,
+          right_type->name);
+}
+
+NxObject *ops_inplace(NxObject *left, BinaryOp op, NxObject *right) {
+    if (op == BINOP_ADD && nx_list_is_instance(left) && nx_list_is_instance(right)) {
+        nxo_root(right);
+        nx_list_extend_list(left, right);
+        nxo_unroot(right);
+        return left;
+    }
+    return ops_binary(left, op, right);
+}
+
+bool ops_is_true(NxObject *value) {
+    if (nx_bool_is_instance(value)) {
+        return nx_bool_is_true(value);
+    }
+    nxo_root(value);
+    NxObject *res = nxo_as_bool(value);
+    nxo_unroot(value);
+    return nx_bool_is_true(res);
+}
+
+void ops_print(NxObject *value) {
+    if (nx_int_is_instance(value) && nx_int_fits_int64(value)) {
+        output_write_int64(nx_int_get_value(value));
+    } else if (nx_int_is_instance(value)) {
+        StringBuilder sb = sb_init();
+        nx_int_append_to(&sb, value);
+        output_write(sb.str, sb.length);
+        sb_free(&sb);
+    } else if (nx_str_is_instance(value)) {
+        output_write(nx_str_get_data(value), nx_str_get_length(value));
+    } else if (nx_bool_is_instance(value)) {
+        output_write(nx_bool_is_true(value) ? "True" : "False", nx_bool_is_true(value) ? 4 : 5);
+    } else {
+        PANIC("Unexpected value type in print()");
+    }
+    output_end_line();
+}
@@ -0,0 +1,638 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file profiler.c
+ * \brief Implementation of the sampling profiler.
+ */
+
+#include "natrix/interp/profiler.h"
+#include <assert.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include "natrix/util/gc.h"
+#include "natrix/util/mem.h"
+#include "natrix/util/panic.h"
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+//! Name of the frame of the samples taken while no statement was executing.
+#define OTHER_FRAME "(interpreter)"
+
+//! Name of the type of objects allocated without naming it.
+#define UNNAMED_TYPE "(unnamed)"
+
+//! Initial capacity of the hash table of allocation sites, a power of two.
+#define INITIAL_SITE_TABLE_CAPACITY 64
+
+/**
+ * \brief Statement known to the profiler.
+ */
+typedef struct {
+    uintptr_t key;                  //!< address published in `profiler_current` while executing the statement
+    const char *position;           //!< position of the statement in the source code
+    uint32_t parent;                //!< index of the node of the enclosing statement, `CODE_NO_PARENT` if none
+    uint64_t samples;               //!< number of samples attributed to the statement itself
+} ProfilerNode;
+
+/**
+ * \brief Allocations of objects of one type by one statement.
+ */
+typedef struct {
+    uint32_t node;                  //!< index of the node of the statement, `CODE_NO_PARENT` if none
+    const char *type_name;          //!< name of the type, NULL if unnamed
+    uint64_t objects;               //!< number of allocated objects
+    uint64_t bytes;                 //!< number of allocated bytes
+    uint64_t survivors;             //!< number of objects which survived the first collection after the allocation
+    uint64_t survivor_bytes;        //!< number of bytes of the survivors
+} AllocSite;
+
+/**
+ * \brief State of the profiler.
+ *
+ * The signal handler runs on the profiled thread, so the counters are only ever modified by that thread and
+ * read after the profiler stops.
+ */
+static struct {
+    Source *source;                 //!< source code of the profiled program
+    unsigned interval_us;           //!< interval between two samples, 0 if not sampling
+    bool running;                   //!< whether the profiler is running
+    bool allocations;               //!< whether the allocations are tracked
+    timer_t timer;                  //!< timer sending the signals
+    struct sigaction old_action;    //!< action of `SIGPROF` before the profiler started
+    ProfilerNode *nodes;            //!< statements ordered by key
+    size_t node_count;              //!< number of statements
+    size_t node_capacity;           //!< capacity of the `nodes` array
+    bool exact;                     //!< whether a node matches only its key, otherwise all addresses up to the next key
+    volatile sig_atomic_t attached; //!< whether the nodes are complete and can be used by the signal handler
+    uint64_t other_samples;         //!< number of samples taken while no statement was executing
+    AllocSite *sites;               //!< allocation sites in the order of their first allocation
+    size_t site_count;              //!< number of allocation sites
+    uint32_t *site_table;           //!< hash table of indices of the sites plus one, 0 for empty slots
+    size_t site_table_capacity;     //!< capacity of `site_table`, a power of two at least twice `site_count`
+} profiler;
+
+const void *volatile profiler_current;
+
+/**
+ * \brief Finds the node the currently executing address belongs to.
+ * \param current the address
+ * \return the node, NULL if not found
+ */
+static ProfilerNode *find_node(uintptr_t current) {
+    // finds the last node with a key not greater than the address
+    size_t lo = 0;
+    size_t hi = profiler.node_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (profiler.nodes[mid].key <= current) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0 || (profiler.exact && profiler.nodes[lo - 1].key != current)) {
+        return NULL;
+    }
+    return &profiler.nodes[lo - 1];
+}
+
+static void profiler_handle_signal(int signal) {
+    (void) signal;
+    // the expirations of the timer are signalled once per scheduler tick, which is usually longer than the interval
+    int overrun = timer_getoverrun(profiler.timer);
+    uint64_t samples = 1 + (overrun > 0 ? (uint64_t) overrun : 0);
+    const void *current = profiler_current;
+    ProfilerNode *node = current && profiler.attached ? find_node((uintptr_t) current) : NULL;
+    if (node) {
+        node->samples += samples;
+    } else {
+        profiler.other_samples += samples;
+    }
+}
+
+/**
+ * \brief Starts the timer sending the signals to the calling thread.
+ */
+static void start_timer() {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = profiler_handle_signal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, &profiler.old_action) != 0) {
+        PANIC("Unable to install the profiler signal handler");
+    }
+    struct sigevent event;
+    memset(&event, 0, sizeof(event));
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = SIGPROF;
+    event.sigev_notify_thread_id = (pid_t) syscall(SYS_gettid);
+    if (timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &profiler.timer) != 0) {
+        PANIC("Unable to create the profiler timer");
+    }
+    unsigned interval_us = profiler.interval_us;
+    struct itimerspec spec = {
+            .it_interval = {.tv_sec = interval_us / 1000000, .tv_nsec = (long) (interval_us % 1000000) * 1000},
+    };
+    spec.it_value = spec.it_interval;
+    if (timer_settime(profiler.timer, 0, &spec, NULL) != 0) {
+        PANIC("Unable to start the profiler timer");
+    }
+}
+
+/**
+ * \brief Computes the hash of an allocation site.
+ * \param node index of the node of the statement
+ * \param type_name name of the type
+ * \return the hash
+ */
+static size_t site_hash(uint32_t node, const char *type_name) {
+    return (size_t) (((uint64_t) node * 0x9E3779B97F4A7C15u) ^ ((uintptr_t) type_name >> 3));
+}
+
+/**
+ * \brief Inserts an allocation site into the hash table, which must have a free slot.
+ * \param index index of the site
+ */
+static void insert_site(uint32_t index) {
+    size_t mask = profiler.site_table_capacity - 1;
+    size_t i = site_hash(profiler.sites[index].node, profiler.sites[index].type_name) & mask;
+    while (profiler.site_table[i] != 0) {
+        i = (i + 1) & mask;
+    }
+    profiler.site_table[i] = index + 1;
+}
+
+/**
+ * \brief Finds the allocation site of a statement and a type, or adds it.
+ * \param node index of the node of the statement, `CODE_NO_PARENT` if none
+ * \param type_name name of the type, NULL if unnamed
+ * \return index of the site
+ */
+static uint32_t find_site(uint32_t node, const char *type_name) {
+    size_t mask = profiler.site_table_capacity - 1;
+    for (size_t i = site_hash(node, type_name) & mask; profiler.site_table[i] != 0; i = (i + 1) & mask) {
+        AllocSite *site = &profiler.sites[profiler.site_table[i] - 1];
+        if (site->node == node && site->type_name == type_name) {
+            return profiler.site_table[i] - 1;
+        }
+    }
+    if (2 * (profiler.site_count + 1) > profiler.site_table_capacity) {
+        profiler.site_table_capacity *= 2;
+        nx_free(profiler.site_table);
+        profiler.site_table = nx_alloc(profiler.site_table_capacity * sizeof(uint32_t));
+        memset(profiler.site_table, 0, profiler.site_table_capacity * sizeof(uint32_t));
+        profiler.sites = nx_realloc(profiler.sites, profiler.site_table_capacity / 2 * sizeof(AllocSite));
+        for (uint32_t i = 0; i < profiler.site_count; i++) {
+            insert_site(i);
+        }
+    }
+    uint32_t index = (uint32_t) profiler.site_count++;
+    profiler.sites[index] = (AllocSite) {.node = node, .type_name = type_name};
+    insert_site(index);
+    return index;
+}
+
+static uint32_t track_alloc(void *data, size_t size_in_bytes, const char *type_name) {
+    (void) data;
+    const void *current = profiler_current;
+    ProfilerNode *node = current && profiler.attached ? find_node((uintptr_t) current) : NULL;
+    uint32_t index = find_site(node ? (uint32_t) (node - profiler.nodes) : CODE_NO_PARENT, type_name);
+    profiler.sites[index].objects++;
+    profiler.sites[index].bytes += size_in_bytes;
+    return index;
+}
+
+static void track_collect(void *data, uint32_t tag, size_t size_in_bytes, bool survived) {
+    (void) data;
+    assert(tag < profiler.site_count);
+    if (survived) {
+        profiler.sites[tag].survivors++;
+        profiler.sites[tag].survivor_bytes += size_in_bytes;
+    }
+}
+
+void profiler_start(Source *source, const ProfilerOptions *options) {
+    if (profiler.running) {
+        PANIC("Profiler is already running");
+    }
+    profiler_free();
+    profiler.source = source;
+    profiler.interval_us = options->interval_us;
+    profiler.allocations = options->allocations;
+    if (profiler.interval_us > 0) {
+        start_timer();
+    }
+    if (profiler.allocations) {
+        profiler.site_table_capacity = INITIAL_SITE_TABLE_CAPACITY;
+        profiler.site_table = nx_alloc(profiler.site_table_capacity * sizeof(uint32_t));
+        memset(profiler.site_table, 0, profiler.site_table_capacity * sizeof(uint32_t));
+        profiler.sites = nx_alloc(profiler.site_table_capacity / 2 * sizeof(AllocSite));
+        GcAllocTracker tracker = {.alloc = track_alloc, .collect = track_collect, .data = NULL};
+        gc_set_alloc_tracker(&tracker);
+    }
+    profiler.running = true;
+}
+
+/**
+ * \brief Adds a node, the nodes must not be attached yet.
+ * \param key address of the statement
+ * \param position position of the statement in the source code
+ * \param parent index of the node of the enclosing statement
+ * \return index of the node
+ */
+static uint32_t add_node(uintptr_t key, const char *position, uint32_t parent) {
+    if (profiler.node_count == profiler.node_capacity) {
+        profiler.node_capacity = profiler.node_capacity ? profiler.node_capacity * 2 : 64;
+        profiler.nodes = nx_realloc(profiler.nodes, profiler.node_capacity * sizeof(ProfilerNode));
+    }
+    profiler.nodes[profiler.node_count] = (ProfilerNode) {.key = key, .position = position, .parent = parent};
+    return (uint32_t) profiler.node_count++;
+}
+
+/**
+ * \brief Publishes the nodes to the signal handler.
+ */
+static void attach_nodes() {
+    atomic_signal_fence(memory_order_seq_cst);
+    profiler.attached = 1;
+}
+
+void profiler_attach_code(const Code *code) {
+    assert(profiler.running && !profiler.attached);
+    for (size_t i = 0; i < code->line_count; i++) {
+        const CodeLine *line = &code->lines[i];
+        add_node((uintptr_t) (code->bytecode + line->offset), line->position, line->parent);
+    }
+    profiler.exact = false;
+    attach_nodes();
+}
+
+/**
+ * \brief Adds the nodes of a list of statements and the statements nested in them.
+ * \param stmt the first statement of the list
+ * \param parent index of the node of the enclosing statement
+ */
+static void add_stmt_nodes(const Stmt *stmt, uint32_t parent) {
+    for (; stmt; stmt = stmt->next) {
+        const char *position = ast_get_stmt_position(stmt);
+        if (!position) {
+            continue;
+        }
+        uint32_t index = add_node((uintptr_t) stmt, position, parent);
+        if (stmt->kind == STMT_WHILE) {
+            add_stmt_nodes(stmt->while_stmt.body, index);
+        } else if (stmt->kind == STMT_FOR) {
+            add_stmt_nodes(stmt->for_stmt.body, index);
+        } else if (stmt->kind == STMT_IF) {
+            add_stmt_nodes(stmt->if_stmt.then_body, index);
+            add_stmt_nodes(stmt->if_stmt.else_body, index);
+        }
+    }
+}
+
+//! Node together with its index before sorting.
+typedef struct {
+    ProfilerNode node;
+    uint32_t index;
+} IndexedNode;
+
+static int compare_indexed_nodes(const void *a, const void *b) {
+    uintptr_t ka = ((const IndexedNode *) a)->node.key;
+    uintptr_t kb = ((const IndexedNode *) b)->node.key;
+    return ka < kb ? -1 : ka > kb;
+}
+
+void profiler_attach_ast(const Stmt *stmt) {
+    assert(profiler.running && !profiler.attached);
+    add_stmt_nodes(stmt, CODE_NO_PARENT);
+    size_t count = profiler.node_count;
+    IndexedNode *sorted = nx_alloc((count + 1) * sizeof(IndexedNode));
+    uint32_t *new_index = nx_alloc((count + 1) * sizeof(uint32_t));
+    for (size_t i = 0; i < count; i++) {
+        sorted[i] = (IndexedNode) {.node = profiler.nodes[i], .index = (uint32_t) i};
+    }
+    qsort(sorted, count, sizeof(IndexedNode), compare_indexed_nodes);
+    for (size_t i = 0; i < count; i++) {
+        new_index[sorted[i].index] = (uint32_t) i;
+    }
+    for (size_t i = 0; i < count; i++) {
+        profiler.nodes[i] = sorted[i].node;
+        if (profiler.nodes[i].parent != CODE_NO_PARENT) {
+            profiler.nodes[i].parent = new_index[profiler.nodes[i].parent];
+        }
+    }
+    nx_free(new_index);
+    nx_free(sorted);
+    profiler.exact = true;
+    attach_nodes();
+}
+
+void profiler_stop() {
+    if (!profiler.running) {
+        return;
+    }
+    if (profiler.interval_us > 0) {
+        timer_delete(profiler.timer);
+        // ignoring the signal discards a pending one, which the previous action might not expect
+        signal(SIGPROF, SIG_IGN);
+        sigaction(SIGPROF, &profiler.old_action, NULL);
+    }
+    if (profiler.allocations) {
+        gc_set_alloc_tracker(NULL);
+    }
+    profiler.running = false;
+    profiler_current = NULL;
+}
+
+bool profiler_is_running() {
+    return profiler.running;
+}
+
+uint64_t profiler_sample_count() {
+    uint64_t count = profiler.other_samples;
+    for (size_t i = 0; i < profiler.node_count; i++) {
+        count += profiler.nodes[i].samples;
+    }
+    return count;
+}
+
+/**
+ * \brief Appends the location and the trimmed text of a source line.
+ * \param sb the string builder to append to
+ * \param line the 1-based line number
+ */
+static void append_line(StringBuilder *sb, size_t line) {
+    const char *start = source_get_line_start(profiler.source, line);
+    const char *end = source_get_line_end(profiler.source, line);
+    while (start < end && (*start == ' ' || *start == '\t')) {
+        start++;
+    }
+    while (end > start && (end[-1] == ' ' || end[-1] == '\t')) {
+        end--;
+    }
+    sb_append_formatted(sb, "%s:%zu ", profiler.source->filename, line);
+    for (const char *p = start; p < end; p++) {
+        sb_append_char(sb, *p == ';' ? ',' : *p);
+    }
+}
+
+/**
+ * \brief Returns the line of a node.
+ * \param index index of the node
+ * \return the 1-based line number
+ */
+static size_t node_line(uint32_t index) {
+    return source_get_line_number(profiler.source, profiler.nodes[index].position);
+}
+
+//! Stack of frames with its number of samples.
+typedef struct {
+    char *frames;
+    uint64_t samples;
+} CollapsedStack;
+
+static int compare_collapsed_stacks(const void *a, const void *b) {
+    return strcmp(((const CollapsedStack *) a)->frames, ((const CollapsedStack *) b)->frames);
+}
+
+void profiler_dump_collapsed(StringBuilder *sb) {
+    CollapsedStack *stacks = nx_alloc((profiler.node_count + 1) * sizeof(CollapsedStack));
+    uint32_t *chain = nx_alloc((profiler.node_count + 1) * sizeof(uint32_t));
+    size_t stack_count = 0;
+    for (size_t i = 0; i < profiler.node_count; i++) {
+        if (profiler.nodes[i].samples == 0) {
+            continue;
+        }
+        size_t depth = 0;
+        for (uint32_t n = (uint32_t) i; n != CODE_NO_PARENT; n = profiler.nodes[n].parent) {
+            chain[depth++] = n;
+        }
+        StringBuilder frames = sb_init();
+        while (depth > 0) {
+            append_line(&frames, node_line(chain[--depth]));
+            if (depth > 0) {
+                sb_append_char(&frames, ';');
+            }
+        }
+        stacks[stack_count++] = (CollapsedStack) {.frames = frames.str, .samples = profiler.nodes[i].samples};
+    }
+    qsort(stacks, stack_count, sizeof(CollapsedStack), compare_collapsed_stacks);
+    for (size_t i = 0; i < stack_count; i++) {
+        uint64_t samples = stacks[i].samples;
+        // statements with several ranges of instructions have several nodes with the same stack
+        while (i + 1 < stack_count && strcmp(stacks[i].frames, stacks[i + 1].frames) == 0) {
+            nx_free(stacks[i].frames);
+            samples += stacks[++i].samples;
+        }
+        sb_append_formatted(sb, "%s %" PRIu64 "\n", stacks[i].frames, samples);
+        nx_free(stacks[i].frames);
+    }
+    if (profiler.other_samples > 0) {
+        sb_append_formatted(sb, OTHER_FRAME " %" PRIu64 "\n", profiler.other_samples);
+    }
+    nx_free(chain);
+    nx_free(stacks);
+}
+
+//! Samples of a source line.
+typedef struct {
+    size_t line;
+    uint64_t self;
+    uint64_t total;
+} LineSamples;
+
+static int compare_line_samples(const void *a, const void *b) {
+    const LineSamples *la = a;
+    const LineSamples *lb = b;
+    if (la->self != lb->self) {
+        return la->self > lb->self ? -1 : 1;
+    }
+    if (la->total != lb->total) {
+        return la->total > lb->total ? -1 : 1;
+    }
+    return la->line < lb->line ? -1 : la->line > lb->line;
+}
+
+void profiler_dump_hot_lines(StringBuilder *sb, size_t max_lines) {
+    uint64_t sample_count = profiler_sample_count();
+    sb_append_formatted(sb, "%" PRIu64 " samples, %.3f s of CPU time\n", sample_count,
+                        (double) sample_count * profiler.interval_us / 1e6);
+    if (sample_count == 0) {
+        return;
+    }
+    size_t line_count = profiler.node_count > 0 ? profiler.source->line_count : 0;
+    LineSamples *lines = nx_alloc((line_count + 1) * sizeof(LineSamples));
+    // the node whose samples were last added to the total of each line, so that recursion is counted once
+    size_t *counted_by = nx_alloc((line_count + 1) * sizeof(size_t));
+    for (size_t i = 0; i <= line_count; i++) {
+        lines[i] = (LineSamples) {.line = i, .self = 0, .total = 0};
+        counted_by[i] = SIZE_MAX;
+    }
+    for (size_t i = 0; i < profiler.node_count; i++) {
+        uint64_t samples = profiler.nodes[i].samples;
+        if (samples == 0) {
+            continue;
+        }
+        lines[node_line((uint32_t) i)].self += samples;
+        for (uint32_t n = (uint32_t) i; n != CODE_NO_PARENT; n = profiler.nodes[n].parent) {
+            size_t line = node_line(n);
+            if (counted_by[line] != i) {
+                counted_by[line] = i;
+                lines[line].total += samples;
+            }
+        }
+    }
+    qsort(lines, line_count + 1, sizeof(LineSamples), compare_line_samples);
+    sb_append_str(sb, "  self   total  line\n");
+    for (size_t i = 0; i < max_lines && i <= line_count && lines[i].total > 0; i++) {
+        sb_append_formatted(sb, "%5.1f%%  %5.1f%%  ", 100.0 * (double) lines[i].self / (double) sample_count,
+                            100.0 * (double) lines[i].total / (double) sample_count);
+        append_line(sb, lines[i].line);
+        sb_append_char(sb, '\n');
+    }
+    if (profiler.other_samples > 0) {
+        sb_append_formatted(sb, "%5.1f%%  %5.1f%%  " OTHER_FRAME "\n",
+                            100.0 * (double) profiler.other_samples / (double) sample_count,
+                            100.0 * (double) profiler.other_samples / (double) sample_count);
+    }
+    nx_free(counted_by);
+    nx_free(lines);
+}
+
+//! Allocations aggregated by source line and type.
+typedef struct {
+    size_t line;                    //!< 1-based line number, 0 if allocated while no statement was executing
+    const char *type_name;          //!< name of the type
+    uint64_t objects;               //!< number of allocated objects
+    uint64_t bytes;                 //!< number of allocated bytes
+    uint64_t survivors;             //!< number of surviving objects
+} AllocRow;
+
+static int compare_alloc_rows_by_key(const void *a, const void *b) {
+    const AllocRow *ra = a;
+    const AllocRow *rb = b;
+    if (ra->line != rb->line) {
+        return ra->line < rb->line ? -1 : 1;
+    }
+    return strcmp(ra->type_name, rb->type_name);
+}
+
+static int compare_alloc_rows_by_bytes(const void *a, const void *b) {
+    const AllocRow *ra = a;
+    const AllocRow *rb = b;
+    if (ra->bytes != rb->bytes) {
+        return ra->bytes > rb->bytes ? -1 : 1;
+    }
+    return compare_alloc_rows_by_key(a, b);
+}
+
+/**
+ * \brief Merges the rows with the same line and type and orders them by the number of bytes.
+ * \param rows the rows
+ * \param count number of rows
+ * \return number of rows after merging
+ */
+static size_t merge_alloc_rows(AllocRow *rows, size_t count) {
+    qsort(rows, count, sizeof(AllocRow), compare_alloc_rows_by_key);
+    size_t merged = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (merged > 0 && compare_alloc_rows_by_key(&rows[merged - 1], &rows[i]) == 0) {
+            rows[merged - 1].objects += rows[i].objects;
+            rows[merged - 1].bytes += rows[i].bytes;
+            rows[merged - 1].survivors += rows[i].survivors;
+        } else {
+            rows[merged++] = rows[i];
+        }
+    }
+    qsort(rows, merged, sizeof(AllocRow), compare_alloc_rows_by_bytes);
+    return merged;
+}
+
+/**
+ * \brief Appends the counters of a row of the allocation report.
+ * \param sb the string builder to append to
+ * \param row the row
+ */
+static void append_alloc_counters(StringBuilder *sb, const AllocRow *row) {
+    sb_append_formatted(sb, "%10" PRIu64 "  %12" PRIu64 "  %7.1f%%  ", row->objects, row->bytes,
+                        row->objects ? 100.0 * (double) row->survivors / (double) row->objects : 0.0);
+}
+
+void profiler_dump_allocations(StringBuilder *sb, size_t max_lines) {
+    AllocRow *rows = nx_alloc((profiler.site_count + 1) * sizeof(AllocRow));
+    AllocRow total = {.objects = 0};
+    uint64_t survivor_bytes = 0;
+    for (size_t i = 0; i < profiler.site_count; i++) {
+        const AllocSite *site = &profiler.sites[i];
+        rows[i] = (AllocRow) {
+                .line = 0,
+                .type_name = site->type_name ? site->type_name : UNNAMED_TYPE,
+                .objects = site->objects,
+                .bytes = site->bytes,
+                .survivors = site->survivors,
+        };
+        total.objects += site->objects;
+        total.bytes += site->bytes;
+        total.survivors += site->survivors;
+        survivor_bytes += site->survivor_bytes;
+    }
+    sb_append_formatted(sb, "%" PRIu64 " objects, %" PRIu64 " bytes allocated, %" PRIu64 " objects, %" PRIu64
+                        " bytes survived a collection\n", total.objects, total.bytes, total.survivors, survivor_bytes);
+    sb_append_str(sb, "   objects         bytes  survived  type\n");
+    size_t count = merge_alloc_rows(rows, profiler.site_count);
+    for (size_t i = 0; i < count; i++) {
+        append_alloc_counters(sb, &rows[i]);
+        sb_append_formatted(sb, "%s\n", rows[i].type_name);
+    }
+    for (size_t i = 0; i < profiler.site_count; i++) {
+        uint32_t node = profiler.sites[i].node;
+        rows[i].line = node == CODE_NO_PARENT ? 0 : node_line(node);
+        rows[i].type_name = profiler.sites[i].type_name ? profiler.sites[i].type_name : UNNAMED_TYPE;
+        rows[i].objects = profiler.sites[i].objects;
+        rows[i].bytes = profiler.sites[i].bytes;
+        rows[i].survivors = profiler.sites[i].survivors;
+    }
+    sb_append_str(sb, "   objects         bytes  survived  type          line\n");
+    count = merge_alloc_rows(rows, profiler.site_count);
+    for (size_t i = 0; i < count && i < max_lines; i++) {
+        append_alloc_counters(sb, &rows[i]);
+        sb_append_formatted(sb, "%-12s  ", rows[i].type_name);
+        if (rows[i].line == 0) {
+            sb_append_str(sb, OTHER_FRAME);
+        } else {
+            append_line(sb, rows[i].line);
+        }
+        sb_append_char(sb, '\n');
+    }
+    nx_free(rows);
+}
+
+void profiler_free() {
+    assert(!profiler.running);
+    profiler.attached = 0;
+    nx_free(profiler.nodes);
+    profiler.nodes = NULL;
+    profiler.node_count = 0;
+    profiler.node_capacity = 0;
+    profiler.other_samples = 0;
+    nx_free(profiler.sites);
+    profiler.sites = NULL;
+    profiler.site_count = 0;
+    nx_free(profiler.site_table);
+    profiler.site_table = NULL;
+    profiler.site_table_capacity = 0;
+}
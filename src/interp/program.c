@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file program.c
+ * \brief Implementation of the preparation of programs.
+ */
+
+#include "natrix/interp/program.h"
+#include "natrix/compiler/compiler.h"
+#include "natrix/compiler/optimizer.h"
+#include "natrix/compiler/resolver.h"
+#include "natrix/parser/diag.h"
+#include "natrix/parser/parser.h"
+
+void program_init(Program *program) {
+    program->arena = arena_init();
+    program->stmt = NULL;
+    program->literals = literal_pool_init();
+    gc_root(&program->literals.gc_header);
+    program->code = code_init();
+    gc_root(&program->code.gc_header);
+}
+
+void program_release_tree(Program *program) {
+    arena_free(&program->arena);
+    program->arena = arena_init();
+    program->stmt = NULL;
+}
+
+void program_clear(Program *program) {
+    code_free(&program->code);
+    literal_pool_free(&program->literals);
+}
+
+void program_free(Program *program) {
+    gc_unroot(&program->code.gc_header);
+    gc_unroot(&program->literals.gc_header);
+    arena_free(&program->arena);
+    program_clear(program);
+}
+
+bool program_parse(Program *program, Source *source) {
+    program->stmt = parse_file(&program->arena, source, diag_default_handler, NULL);
+    return program->stmt != NULL;
+}
+
+void program_resolve(Program *program, Env *env, NxObject *arg, bool optimize) {
+    uint32_t arg_slot = env_declare(env, "arg", 3);
+    if (arg) {
+        env_store(env, arg_slot, arg);
+    }
+    resolve_program(env, &program->literals, program->stmt);
+    if (optimize) {
+        program->stmt = optimize_program(&program->arena, env, &program->literals, program->stmt);
+    }
+}
+
+void program_compile(Program *program) {
+    compile_program(&program->code, &program->literals, program->stmt);
+}
+
+bool program_build(Program *program, Env *env, Source *source, NxObject *arg, bool optimize) {
+    if (!program_parse(program, source)) {
+        return false;
+    }
+    program_resolve(program, env, arg, optimize);
+    program_compile(program);
+    return true;
+}
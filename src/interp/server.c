@@ -0,0 +1,407 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file server.c
+ * \brief Implementation of the worker pool of `natrix --serve`.
+ */
+
+#include "natrix/interp/server.h"
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "natrix/interp/isolate.h"
+#include "natrix/parser/source.h"
+#include "natrix/util/arena.h"
+#include "natrix/util/hash.h"
+#include "natrix/util/mem.h"
+#include "natrix/util/output.h"
+#include "natrix/util/panic.h"
+#include "natrix/util/sb.h"
+
+/**
+ * \brief A program to be run by a worker.
+ */
+typedef struct {
+    size_t id;                      //!< Number of the request line
+    char *path;                     //!< Path of the program as requested
+    Source source;                  //!< The source code, emptied by the worker
+    int64_t arg;                    //!< The argument of the program
+    int out_fd;                     //!< The file descriptor to write the result to
+} Job;
+
+/**
+ * \brief Double-ended queue of the jobs of a worker.
+ *
+ * The owner takes the jobs from the front, in the order in which they were queued, thieves take them from the back.
+ */
+typedef struct {
+    pthread_mutex_t lock;           //!< Protects the other members
+    Job **jobs;                     //!< Circular buffer of the jobs
+    size_t head;                    //!< Index of the front job in `jobs`
+    size_t count;                   //!< Number of jobs
+    size_t capacity;                //!< Capacity of `jobs`
+} JobQueue;
+
+/**
+ * \brief A worker thread.
+ */
+typedef struct {
+    NxServer *server;               //!< The server owning the worker
+    size_t index;                   //!< Index of the worker in `server->workers`
+    pthread_t thread;               //!< The thread
+    JobQueue queue;                 //!< The jobs queued to the worker
+} Worker;
+
+struct NxServer {
+    Worker *workers;                //!< The workers
+    size_t worker_count;            //!< Number of workers
+    GcPolicy policy;                //!< Policy of the garbage collectors of the isolates
+    pthread_mutex_t lock;           //!< Protects `queued`, `pending` and `stopping`
+    pthread_cond_t work_cond;       //!< Signalled when a job is queued or the workers should stop
+    pthread_cond_t idle_cond;       //!< Signalled when the last pending job finishes
+    //! Number of jobs in the queues which have not been claimed by a worker, a worker which decrements it is
+    //! guaranteed to find a job in one of the queues
+    size_t queued;
+    size_t pending;                 //!< Number of jobs queued or running
+    bool stopping;                  //!< The workers should exit once the queues are empty
+    pthread_mutex_t write_lock;     //!< Serializes writing the results
+};
+
+/**
+ * \brief Appends a job to the back of a queue.
+ * \param queue the queue
+ * \param job the job
+ */
+static void queue_push(JobQueue *queue, Job *job) {
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count == queue->capacity) {
+        size_t capacity = queue->capacity ? queue->capacity * 2 : 16;
+        Job **jobs = nx_alloc(capacity * sizeof(Job *));
+        for (size_t i = 0; i < queue->count; i++) {
+            jobs[i] = queue->jobs[(queue->head + i) % queue->capacity];
+        }
+        nx_free(queue->jobs);
+        queue->jobs = jobs;
+        queue->head = 0;
+        queue->capacity = capacity;
+    }
+    queue->jobs[(queue->head + queue->count++) % queue->capacity] = job;
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/**
+ * \brief Removes a job from a queue.
+ * \param queue the queue
+ * \param front whether to take the front job, as the owner does, or the back one, as a thief does
+ * \return the job, NULL if the queue is empty
+ */
+static Job *queue_take(JobQueue *queue, bool front) {
+    pthread_mutex_lock(&queue->lock);
+    Job *job = NULL;
+    if (queue->count > 0) {
+        if (front) {
+            job = queue->jobs[queue->head];
+            queue->head = (queue->head + 1) % queue->capacity;
+        } else {
+            job = queue->jobs[(queue->head + queue->count - 1) % queue->capacity];
+        }
+        queue->count--;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return job;
+}
+
+/**
+ * \brief Waits for a job and takes it from the queue of the worker, or steals it from another worker.
+ * \param worker the worker
+ * \return the job, NULL if the worker should exit
+ */
+static Job *take_job(Worker *worker) {
+    NxServer *server = worker->server;
+    pthread_mutex_lock(&server->lock);
+    while (server->queued == 0 && !server->stopping) {
+        pthread_cond_wait(&server->work_cond, &server->lock);
+    }
+    if (server->queued == 0) {
+        pthread_mutex_unlock(&server->lock);
+        return NULL;
+    }
+    server->queued--;
+    pthread_mutex_unlock(&server->lock);
+    // a job is claimed, but another worker may take it before this one finds it, in which case it leaves one of the
+    // jobs it has claimed
+    while (1) {
+        Job *job = queue_take(&worker->queue, true);
+        for (size_t i = 1; !job && i < server->worker_count; i++) {
+            job = queue_take(&server->workers[(worker->index + i) % server->worker_count].queue, false);
+        }
+        if (job) {
+            return job;
+        }
+    }
+}
+
+/**
+ * \brief Writes all bytes to a file descriptor, giving up on errors other than interrupted system calls.
+ * \param fd the file descriptor
+ * \param data the bytes
+ * \param length the number of bytes
+ */
+static void write_all(int fd, const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        data += written;
+        length -= written;
+    }
+}
+
+/**
+ * \brief Writes the result of a job and frees the job.
+ * \param server the server
+ * \param job the job
+ * \param sb the result started by `start_result()`, the closing brace is appended by the call
+ */
+static void finish_job(NxServer *server, Job *job, StringBuilder *sb) {
+    sb_append_str(sb, "}\n");
+    pthread_mutex_lock(&server->write_lock);
+    write_all(job->out_fd, sb->str, sb->length);
+    pthread_mutex_unlock(&server->write_lock);
+    source_free(&job->source);
+    nx_free(job->path);
+    nx_free(job);
+    pthread_mutex_lock(&server->lock);
+    if (--server->pending == 0) {
+        pthread_cond_broadcast(&server->idle_cond);
+    }
+    pthread_mutex_unlock(&server->lock);
+}
+
+/**
+ * \brief Starts the result of a job with its identification and status.
+ * \param job the job
+ * \param status the status
+ * \return the result, to be passed to `finish_job()`
+ */
+static StringBuilder start_result(const Job *job, const char *status) {
+    StringBuilder sb = sb_init();
+    sb_append_formatted(&sb, "{\"id\": %zu, \"path\": \"", job->id);
+    sb_append_escaped_str(&sb, job->path);
+    sb_append_formatted(&sb, "\", \"status\": \"%s\"", status);
+    return sb;
+}
+
+/**
+ * \brief Writes the result of a job whose program has panicked.
+ * \param worker the worker
+ * \param job the job
+ * \param message the message of the panic
+ */
+static void fail_job(Worker *worker, Job *job, const char *message) {
+    size_t output_length;
+    const char *output = output_end_capture(&output_length);
+    StringBuilder sb = start_result(job, "error");
+    sb_append_formatted(&sb, ", \"worker\": %zu, \"message\": \"", worker->index);
+    sb_append_escaped_str(&sb, message);
+    sb_append_str(&sb, "\", \"output\": \"");
+    sb_append_escaped_str_len(&sb, output, output_length);
+    sb_append_char(&sb, '"');
+    finish_job(worker->server, job, &sb);
+    sb_free(&sb);
+}
+
+/**
+ * \brief Runs a job in the isolate of the worker and writes its result.
+ *
+ * A panic of the program fails the job instead of exiting the server. The isolate is then left in the middle of the
+ * run, so it is discarded and replaced by a new one.
+ * \param worker the worker
+ * \param isolate the isolate of the worker, replaced if the program panics
+ * \param job the job
+ */
+static void run_job(Worker *worker, NxIsolate **isolate, Job *job) {
+    output_begin_capture();
+    NxRunStats stats;
+    bool completed = false;
+    PanicHandler handler;
+    panic_push_handler(&handler);
+    if (setjmp(handler.jump) == 0) {
+        completed = nx_isolate_run_program(*isolate, &job->source, job->arg, &stats);
+        panic_pop_handler(&handler);
+    } else {
+        nx_isolate_discard(*isolate);
+        *isolate = nx_isolate_create(&worker->server->policy);
+        fail_job(worker, job, handler.message);
+        return;
+    }
+    size_t output_length;
+    const char *output = output_end_capture(&output_length);
+    StringBuilder sb = start_result(job, completed ? "ok" : stats.executed ? "interrupted" : "error");
+    if (stats.executed) {
+        sb_append_formatted(&sb, ", \"worker\": %zu, \"cached\": %s, \"compile_ns\": %llu, \"execute_ns\": %llu, "
+                                 "\"allocated_bytes\": %llu, \"collections\": %llu, \"output\": \"",
+                            worker->index, stats.cached ? "true" : "false", (unsigned long long) stats.compile_ns,
+                            (unsigned long long) stats.execute_ns, (unsigned long long) stats.allocated_bytes,
+                            (unsigned long long) stats.collections);
+        sb_append_escaped_str_len(&sb, output, output_length);
+        sb_append_char(&sb, '"');
+    }
+    finish_job(worker->server, job, &sb);
+    sb_free(&sb);
+}
+
+/**
+ * \brief Entry point of the worker threads.
+ * \param ptr the worker
+ * \return NULL
+ */
+static void *worker_main(void *ptr) {
+    Worker *worker = (Worker *) ptr;
+    NxIsolate *isolate = nx_isolate_create(&worker->server->policy);
+    Job *job;
+    while ((job = take_job(worker)) != NULL) {
+        run_job(worker, &isolate, job);
+    }
+    nx_isolate_destroy(isolate);
+    arena_release_pool();
+    output_release();
+    return NULL;
+}
+
+NxServer *nx_server_create(size_t worker_count, const GcPolicy *policy) {
+    assert(worker_count > 0);
+    NxServer *server = nx_alloc(sizeof(NxServer));
+    server->workers = nx_alloc(worker_count * sizeof(Worker));
+    server->worker_count = worker_count;
+    server->policy = policy ? *policy : gc_default_policy();
+    pthread_mutex_init(&server->lock, NULL);
+    pthread_cond_init(&server->work_cond, NULL);
+    pthread_cond_init(&server->idle_cond, NULL);
+    server->queued = 0;
+    server->pending = 0;
+    server->stopping = false;
+    pthread_mutex_init(&server->write_lock, NULL);
+    for (size_t i = 0; i < worker_count; i++) {
+        Worker *worker = &server->workers[i];
+        worker->server = server;
+        worker->index = i;
+        pthread_mutex_init(&worker->queue.lock, NULL);
+        worker->queue.jobs = NULL;
+        worker->queue.head = 0;
+        worker->queue.count = 0;
+        worker->queue.capacity = 0;
+    }
+    for (size_t i = 0; i < worker_count; i++) {
+        pthread_create(&server->workers[i].thread, NULL, worker_main, &server->workers[i]);
+    }
+    return server;
+}
+
+/**
+ * \brief Parses a request, reads the source code and queues the job, or writes its result if it cannot be run.
+ * \param server the server
+ * \param id the number of the request
+ * \param line the request without the newline, null-terminated
+ * \param out_fd the file descriptor to write the result to
+ */
+static void submit(NxServer *server, size_t id, char *line, int out_fd) {
+    Job *job = nx_alloc(sizeof(Job));
+    job->id = id;
+    job->source = (Source) {.filename = NULL, .start = NULL, .end = NULL, .line_starts = NULL, .line_count = 0,
+                            .mapping_size = 0};
+    job->arg = 0;
+    job->out_fd = out_fd;
+    char *space = strchr(line, ' ');
+    bool valid = true;
+    if (space) {
+        *space = '\0';
+        char *end;
+        errno = 0;
+        job->arg = strtoll(space + 1, &end, 10);
+        valid = end != space + 1 && *end == '\0' && errno == 0;
+    }
+    job->path = nx_alloc(strlen(line) + 1);
+    strcpy(job->path, line);
+    pthread_mutex_lock(&server->lock);
+    server->pending++;
+    pthread_mutex_unlock(&server->lock);
+    if (valid) {
+        job->source = source_from_file(job->path);
+    }
+    if (!valid || !job->source.start) {
+        StringBuilder sb = start_result(job, valid ? "unreadable" : "invalid");
+        finish_job(server, job, &sb);
+        sb_free(&sb);
+        return;
+    }
+    // the same program always goes to the same worker, which has probably compiled it already
+    uint64_t hash = hash_bytes(job->source.start, job->source.end - job->source.start);
+    queue_push(&server->workers[hash % server->worker_count].queue, job);
+    pthread_mutex_lock(&server->lock);
+    server->queued++;
+    pthread_cond_signal(&server->work_cond);
+    pthread_mutex_unlock(&server->lock);
+}
+
+size_t nx_server_serve(NxServer *server, int in_fd, int out_fd) {
+    FILE *in = fdopen(dup(in_fd), "r");
+    size_t count = 0;
+    if (in) {
+        char *line = NULL;
+        size_t capacity = 0;
+        ssize_t length;
+        while ((length = getline(&line, &capacity, in)) >= 0) {
+            while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+                line[--length] = '\0';
+            }
+            if (length > 0) {
+                submit(server, count++, line, out_fd);
+            }
+        }
+        free(line);
+        fclose(in);
+    }
+    pthread_mutex_lock(&server->lock);
+    while (server->pending > 0) {
+        pthread_cond_wait(&server->idle_cond, &server->lock);
+    }
+    pthread_mutex_unlock(&server->lock);
+    return count;
+}
+
+void nx_server_destroy(NxServer *server) {
+    pthread_mutex_lock(&server->lock);
+    server->stopping = true;
+    pthread_cond_broadcast(&server->work_cond);
+    pthread_mutex_unlock(&server->lock);
+    for (size_t i = 0; i < server->worker_count; i++) {
+        pthread_join(server->workers[i].thread, NULL);
+    }
+    for (size_t i = 0; i < server->worker_count; i++) {
+        pthread_mutex_destroy(&server->workers[i].queue.lock);
+        nx_free(server->workers[i].queue.jobs);
+    }
+    pthread_mutex_destroy(&server->write_lock);
+    pthread_cond_destroy(&server->idle_cond);
+    pthread_cond_destroy(&server->work_cond);
+    pthread_mutex_destroy(&server->lock);
+    nx_free(server->workers);
+    nx_free(server);
+}
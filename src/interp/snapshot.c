@@ -0,0 +1,797 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file snapshot.c
+ * \brief Implementation of heap snapshots.
+ *
+ * The layout of a snapshot file is:
+ * \code
+ *     SnapshotHeader
+ *     uint64_t relocations[relocation_count], offsets of the pointers within the image
+ *     SnapshotStaticRef statics[static_count]
+ *     SnapshotName names[slot_count]
+ *     char blob[blob_size], the names of the slots
+ *     padding to SNAPSHOT_PAGE_SIZE
+ *     image[image_size]
+ * \endcode
+ * The image consists of the objects, each aligned to `NX_ALIGNMENT`, the first of which is an `NxObjectArray` holding
+ * the values of the slots. A pointer in the image holds the address of its target for the file mapped at
+ * `SNAPSHOT_BASE`. Pointers to the statically allocated `true` and `false` objects cannot be known in advance,
+ * they are stored as zero and set by every load.
+ */
+
+#include "natrix/interp/snapshot.h"
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "natrix/obj/nx_bool.h"
+#include "natrix/obj/nx_dict.h"
+#include "natrix/obj/nx_int.h"
+#include "natrix/obj/nx_int_array.h"
+#include "natrix/obj/nx_list.h"
+#include "natrix/obj/nx_object_array.h"
+#include "natrix/obj/nx_range.h"
+#include "natrix/obj/nx_str.h"
+#include "natrix/util/mem.h"
+#include "natrix/util/sb.h"
+
+//! Identifies a snapshot file.
+static const char SNAPSHOT_MAGIC[8] = "NXSNAP";
+
+/**
+ * \brief Header of a snapshot file.
+ */
+typedef struct {
+    char magic[8];                  //!< `SNAPSHOT_MAGIC`
+    uint32_t version;               //!< `SNAPSHOT_VERSION`
+    uint32_t class_count;           //!< Number of the built-in classes of the interpreter which wrote the file
+    uint32_t pointer_size;          //!< Size of a pointer of the interpreter which wrote the file
+    uint32_t page_size;             //!< `SNAPSHOT_PAGE_SIZE`
+    uint64_t base;                  //!< `SNAPSHOT_BASE`
+    uint64_t slot_count;            //!< Number of variable slots
+    uint64_t relocation_count;      //!< Number of pointers within the image
+    uint64_t static_count;          //!< Number of pointers to statically allocated objects
+    uint64_t blob_size;             //!< Number of bytes of the names
+    uint64_t image_offset;          //!< Offset of the image in the file, a multiple of `SNAPSHOT_PAGE_SIZE`
+    uint64_t image_size;            //!< Number of bytes of the image
+} SnapshotHeader;
+
+/**
+ * \brief Statically allocated objects which can be pointed to from the image.
+ */
+typedef enum {
+    STATIC_FALSE,                   //!< `nx_false`
+    STATIC_TRUE,                    //!< `nx_true`
+    STATIC_COUNT,
+} SnapshotStatic;
+
+/**
+ * \brief Pointer to a statically allocated object.
+ */
+typedef struct {
+    uint64_t offset;                //!< Offset of the pointer within the image
+    uint64_t id;                    //!< The object, see `SnapshotStatic`
+} SnapshotStaticRef;
+
+/**
+ * \brief Name of a variable slot in a snapshot file.
+ */
+typedef struct {
+    uint64_t offset;                //!< Offset of the name in the blob
+    uint64_t length;                //!< Length of the name
+} SnapshotName;
+
+/**
+ * \brief Entry of the table of the objects being saved.
+ */
+typedef struct {
+    const NxObject *object;         //!< The object, NULL in empty entries
+    uint64_t offset;                //!< Offset of its copy within the image
+} SnapshotEntry;
+
+/**
+ * \brief State of saving a snapshot.
+ *
+ * Objects are assigned their offsets in the order they are discovered and copied in the same order, so the image
+ * grows by appending and each object is copied exactly once.
+ */
+typedef struct {
+    SnapshotEntry *entries;         //!< Open-addressing table of the discovered objects
+    size_t capacity;                //!< Capacity of `entries`, a power of two
+    NxObject **queue;               //!< The discovered objects in the order of their offsets
+    size_t count;                   //!< Number of discovered objects
+    uint64_t size;                  //!< Size of the image including all discovered objects
+    StringBuilder image;            //!< The objects copied so far
+    StringBuilder relocations;      //!< Offsets of the pointers within the image
+    StringBuilder statics;          //!< Pointers to statically allocated objects
+    bool failed;                    //!< Whether an object which cannot be saved was found
+} SnapshotWriter;
+
+/**
+ * \brief Returns the size of the copy of an object in the image.
+ * \param obj the object
+ * \return the size in bytes, 0 if the object cannot be saved
+ */
+static uint64_t image_size_of(NxObject *obj) {
+    switch (obj->gc_header.class_id) {
+        case NX_CLASS_INT: {
+            int64_t size = ((NxInt *) obj)->size;
+            return sizeof(NxInt) + (size < 0 ? -size : size) * sizeof(uint64_t);
+        }
+        case NX_CLASS_STR:
+            return sizeof(NxStr) + nx_str_get_length(obj) + 1;
+        case NX_CLASS_LIST:
+            return sizeof(NxList);
+        case NX_CLASS_DICT:
+            return sizeof(NxDict);
+        case NX_CLASS_RANGE:
+            return sizeof(NxRange);
+        case NX_CLASS_OBJECT_ARRAY:
+            return sizeof(NxObjectArray) + ((NxObjectArray *) obj)->size * sizeof(NxObject *);
+        case NX_CLASS_INT_ARRAY:
+            return sizeof(NxIntArray) + ((NxIntArray *) obj)->size * sizeof(int64_t);
+        case NX_CLASS_DICT_TABLE:
+            return sizeof(NxDictTable) + ((NxDictTable *) obj)->capacity * (sizeof(NxDictEntry) + 1);
+        default:
+            return 0;
+    }
+}
+
+/**
+ * \brief Returns the slot of the table of discovered objects for an object.
+ * \param writer the state of the save
+ * \param obj the object
+ * \return the entry holding the object or the empty entry where it belongs
+ */
+static SnapshotEntry *slot_of(const SnapshotWriter *writer, const NxObject *obj) {
+    size_t mask = writer->capacity - 1;
+    size_t i = (size_t) (((uintptr_t) obj >> 4) * 0x9E3779B97F4A7C15ull) & mask;
+    while (writer->entries[i].object != NULL && writer->entries[i].object != obj) {
+        i = (i + 1) & mask;
+    }
+    return &writer->entries[i];
+}
+
+/**
+ * \brief Doubles the capacity of the table of discovered objects.
+ * \param writer the state of the save
+ */
+static void grow_entries(SnapshotWriter *writer) {
+    SnapshotEntry *old = writer->entries;
+    size_t old_capacity = writer->capacity;
+    writer->capacity *= 2;
+    writer->entries = nx_alloc(writer->capacity * sizeof(SnapshotEntry));
+    memset(writer->entries, 0, writer->capacity * sizeof(SnapshotEntry));
+    writer->queue = nx_realloc(writer->queue, writer->capacity / 2 * sizeof(NxObject *));
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old[i].object != NULL) {
+            *slot_of(writer, old[i].object) = old[i];
+        }
+    }
+    nx_free(old);
+}
+
+/**
+ * \brief Returns the offset of the copy of an object in the image, assigning it if the object is new.
+ * \param writer the state of the save
+ * \param obj the object, not an immediate value nor a static object
+ * \return the offset within the image
+ */
+static uint64_t offset_of(SnapshotWriter *writer, NxObject *obj) {
+    SnapshotEntry *entry = slot_of(writer, obj);
+    if (entry->object != NULL) {
+        return entry->offset;
+    }
+    uint64_t size = image_size_of(obj);
+    if (size == 0) {
+        writer->failed = true;
+        return 0;
+    }
+    if (2 * (writer->count + 1) > writer->capacity) {
+        grow_entries(writer);
+        entry = slot_of(writer, obj);
+    }
+    entry->object = obj;
+    entry->offset = writer->size;
+    writer->queue[writer->count++] = obj;
+    writer->size += NX_ALIGN_UP(size);
+    return entry->offset;
+}
+
+/**
+ * \brief Translates a pointer stored at the given offset of the image and records how to restore it on load.
+ * \param writer the state of the save
+ * \param offset the offset of the pointer within the image
+ * \param obj the pointer, can be NULL or an immediate value
+ * \return the value to store in the image
+ */
+static uint64_t translate(SnapshotWriter *writer, uint64_t offset, NxObject *obj) {
+    if (obj == NULL || gc_is_immediate(obj)) {
+        return (uint64_t) (uintptr_t) obj;
+    }
+    if (obj == nx_false || obj == nx_true) {
+        SnapshotStaticRef ref = {.offset = offset, .id = obj == nx_true ? STATIC_TRUE : STATIC_FALSE};
+        sb_append_str_len(&writer->statics, (const char *) &ref, sizeof(ref));
+        return 0;
+    }
+    sb_append_str_len(&writer->relocations, (const char *) &offset, sizeof(offset));
+    return offset_of(writer, obj);
+}
+
+/**
+ * \brief Translates the pointers in a copy of an object.
+ * \param writer the state of the save
+ * \param base the offset of the copy within the image
+ * \param copy the copy, in its native layout
+ * \param field the offset of the first pointer within the copy
+ * \param count the number of consecutive pointers
+ * \param stride the distance between consecutive pointers in bytes
+ */
+static void translate_fields(SnapshotWriter *writer, uint64_t base, char *copy, size_t field, size_t count,
+                             size_t stride) {
+    for (size_t i = 0; i < count; i++, field += stride) {
+        NxObject *obj;
+        memcpy(&obj, copy + field, sizeof(obj));
+        uint64_t value = translate(writer, base + field, obj);
+        memcpy(copy + field, &value, sizeof(value));
+    }
+}
+
+/**
+ * \brief Appends the copy of an object to the image.
+ *
+ * The pointers are translated to offsets within the image, the address of the image is added to them once the
+ * whole image is known.
+ * \param writer the state of the save
+ * \param obj the object, its offset is the current size of the image
+ */
+static void copy_object(SnapshotWriter *writer, NxObject *obj) {
+    uint64_t base = writer->image.length;
+    uint64_t size = image_size_of(obj);
+    sb_ensure_can_append(&writer->image, NX_ALIGN_UP(size));
+    char *copy = writer->image.str + base;
+    memset(copy, 0, NX_ALIGN_UP(size));
+    if (obj->gc_header.class_id == NX_CLASS_STR) {
+        // ropes and views are flattened, the copy always keeps its bytes inline
+        NxStr str = {
+                .header = {.gc_header = {.mark = 0, .class_id = NX_CLASS_STR}},
+                .length = nx_str_get_length(obj),
+                .data = (const char *) (uintptr_t) (base + sizeof(NxStr)),
+                .hash = nx_str_get_hash(obj),
+        };
+        memcpy(copy, &str, sizeof(str));
+        memcpy(copy + sizeof(NxStr), nx_str_get_data(obj), str.length);
+        sb_append_str_len(&writer->relocations, (const char *) &(uint64_t) {base + offsetof(NxStr, data)},
+                          sizeof(uint64_t));
+    } else {
+        memcpy(copy, obj, size);
+    }
+    switch (obj->gc_header.class_id) {
+        case NX_CLASS_LIST:
+            translate_fields(writer, base, copy, offsetof(NxList, items), 1, 0);
+            break;
+        case NX_CLASS_DICT:
+            translate_fields(writer, base, copy, offsetof(NxDict, table), 1, 0);
+            break;
+        case NX_CLASS_OBJECT_ARRAY:
+            translate_fields(writer, base, copy, offsetof(NxObjectArray, data), ((NxObjectArray *) obj)->size,
+                             sizeof(NxObject *));
+            break;
+        case NX_CLASS_DICT_TABLE:
+            translate_fields(writer, base, copy, offsetof(NxDictTable, entries), 2 * ((NxDictTable *) obj)->capacity,
+                             sizeof(NxObject *));
+            break;
+        default:
+            break;
+    }
+    ((GcHeader *) copy)->mark = GC_FLAG_MARK | GC_FLAG_IMAGE;
+    writer->image.length = base + NX_ALIGN_UP(size);
+}
+
+/**
+ * \brief Writes the contents of a snapshot file to a temporary file and renames it.
+ * \param path the path of the snapshot file
+ * \param sb the contents
+ * \return true if the file was written
+ */
+static bool write_file(const char *path, const StringBuilder *sb) {
+    StringBuilder tmp = sb_init();
+    sb_append_formatted(&tmp, "%s.%d.tmp", path, (int) getpid());
+    FILE *f = fopen(tmp.str, "wb");
+    bool ok = f != NULL;
+    if (f) {
+        ok = fwrite(sb->str, 1, sb->length, f) == sb->length;
+        ok &= fclose(f) == 0;
+        ok = ok && rename(tmp.str, path) == 0;
+        if (!ok) {
+            unlink(tmp.str);
+        }
+    }
+    sb_free(&tmp);
+    return ok;
+}
+
+bool snapshot_save(const char *path, const Env *env) {
+    SnapshotWriter writer = {
+            .capacity = 256,
+            .count = 0,
+            .image = sb_init(),
+            .relocations = sb_init(),
+            .statics = sb_init(),
+            .failed = false,
+    };
+    writer.entries = nx_alloc(writer.capacity * sizeof(SnapshotEntry));
+    memset(writer.entries, 0, writer.capacity * sizeof(SnapshotEntry));
+    writer.queue = nx_alloc(writer.capacity / 2 * sizeof(NxObject *));
+
+    // the values of the slots form the first object of the image
+    uint64_t roots_size = sizeof(NxObjectArray) + env->count * sizeof(NxObject *);
+    writer.size = NX_ALIGN_UP(roots_size);
+    sb_ensure_can_append(&writer.image, writer.size);
+    memset(writer.image.str, 0, writer.size);
+    NxObjectArray *roots = (NxObjectArray *) writer.image.str;
+    roots->gc_header.mark = GC_FLAG_MARK | GC_FLAG_IMAGE;
+    roots->gc_header.class_id = NX_CLASS_OBJECT_ARRAY;
+    *(int64_t *) &roots->size = (int64_t) env->count;
+    for (size_t i = 0; i < env->count; i++) {
+        uint64_t offset = offsetof(NxObjectArray, data) + i * sizeof(NxObject *);
+        uint64_t value = translate(&writer, offset, env->values[i]);
+        memcpy(writer.image.str + offset, &value, sizeof(value));
+    }
+    writer.image.length = NX_ALIGN_UP(roots_size);
+    for (size_t i = 0; i < writer.count && !writer.failed; i++) {
+        copy_object(&writer, writer.queue[i]);
+    }
+
+    bool ok = !writer.failed;
+    if (ok) {
+        SnapshotHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+        header.version = SNAPSHOT_VERSION;
+        header.class_count = NX_CLASS_COUNT;
+        header.pointer_size = sizeof(void *);
+        header.page_size = SNAPSHOT_PAGE_SIZE;
+        header.base = SNAPSHOT_BASE;
+        header.slot_count = env->count;
+        header.relocation_count = writer.relocations.length / sizeof(uint64_t);
+        header.static_count = writer.statics.length / sizeof(SnapshotStaticRef);
+        header.image_size = writer.image.length;
+
+        StringBuilder blob = sb_init();
+        StringBuilder names = sb_init();
+        for (size_t i = 0; i < env->count; i++) {
+            SnapshotName name = {.offset = blob.length, .length = env->names[i].length};
+            sb_append_str_len(&blob, env->names[i].start, env->names[i].length);
+            sb_append_str_len(&names, (const char *) &name, sizeof(name));
+        }
+        header.blob_size = blob.length;
+        header.image_offset = NX_ROUND_UP(sizeof(header) + writer.relocations.length + writer.statics.length
+                                          + names.length + blob.length, SNAPSHOT_PAGE_SIZE);
+
+        const uint64_t *relocations = (const uint64_t *) writer.relocations.str;
+        for (uint64_t i = 0; i < header.relocation_count; i++) {
+            uint64_t value;
+            memcpy(&value, writer.image.str + relocations[i], sizeof(value));
+            value += SNAPSHOT_BASE + header.image_offset;
+            memcpy(writer.image.str + relocations[i], &value, sizeof(value));
+        }
+
+        StringBuilder sb = sb_init_with_capacity(header.image_offset + header.image_size + 1);
+        sb_append_str_len(&sb, (const char *) &header, sizeof(header));
+        sb_append_str_len(&sb, writer.relocations.str, writer.relocations.length);
+        sb_append_str_len(&sb, writer.statics.str, writer.statics.length);
+        sb_append_str_len(&sb, names.str, names.length);
+        sb_append_str_len(&sb, blob.str, blob.length);
+        sb_ensure_can_append(&sb, header.image_offset - sb.length);
+        memset(sb.str + sb.length, 0, header.image_offset - sb.length);
+        sb.length = header.image_offset;
+        sb_append_str_len(&sb, writer.image.str, writer.image.length);
+        ok = write_file(path, &sb);
+        sb_free(&sb);
+        sb_free(&names);
+        sb_free(&blob);
+    }
+    sb_free(&writer.statics);
+    sb_free(&writer.relocations);
+    sb_free(&writer.image);
+    nx_free(writer.queue);
+    nx_free(writer.entries);
+    return ok;
+}
+
+/**
+ * \brief Checks that a pointer of the image lies within the image and is aligned.
+ * \param header the header of the snapshot file
+ * \param offset the offset of the pointer within the image
+ * \return true if the pointer can be read and written
+ */
+static bool valid_pointer_offset(const SnapshotHeader *header, uint64_t offset) {
+    return offset % sizeof(uint64_t) == 0 && offset < header->image_size
+           && header->image_size - offset >= sizeof(uint64_t);
+}
+
+/**
+ * \brief Roles of the 8-byte words of the image, recorded while it is checked.
+ */
+typedef enum {
+    WORD_OBJECT = 1,                //!< The word starts an object
+    WORD_POINTER = 2,               //!< The word is a pointer field of an object
+    WORD_INLINE = 4,                //!< The word is the `data` field of a string, pointing to its own bytes
+    WORD_RELOCATED = 8,             //!< The word is listed in the relocations
+    WORD_STATIC = 16,               //!< The word is listed in the pointers to statically allocated objects
+} SnapshotWord;
+
+/**
+ * \brief State of checking the objects of an image before it is used.
+ */
+typedef struct {
+    const SnapshotHeader *header;   //!< The header of the snapshot file
+    const char *image;              //!< The image, not relocated yet
+    uint64_t start;                 //!< Address of the image for which its pointers are stored
+    uint8_t *words;                 //!< Roles of the words of the image, see `SnapshotWord`
+} ImageCheck;
+
+/**
+ * \brief Marks consecutive pointer fields of an object.
+ * \param check the state of the check
+ * \param field the offset of the first field within the image
+ * \param count the number of fields, at most the number of words following `field` within the image
+ */
+static void mark_pointers(ImageCheck *check, uint64_t field, uint64_t count) {
+    for (uint64_t i = 0; i < count; i++) {
+        check->words[field / sizeof(uint64_t) + i] |= WORD_POINTER;
+    }
+}
+
+/**
+ * \brief Returns whether an array of elements following the fixed part of an object fits in the image.
+ * \param available the number of bytes of the image from the start of the object
+ * \param fixed the size of the fixed part of the object
+ * \param count the number of elements, may be negative
+ * \param element_size the size of an element
+ * \return true if the array is within the image
+ */
+static bool fits(uint64_t available, uint64_t fixed, int64_t count, uint64_t element_size) {
+    return available >= fixed && count >= 0 && (uint64_t) count <= (available - fixed) / element_size;
+}
+
+/**
+ * \brief Checks the header and the size of an object of the image and marks its pointer fields.
+ * \param check the state of the check
+ * \param offset the offset of the object within the image, aligned to `NX_ALIGNMENT`
+ * \return the size of the object in bytes, 0 if it is invalid
+ */
+static uint64_t check_object(ImageCheck *check, uint64_t offset) {
+    const char *obj = check->image + offset;
+    uint64_t available = check->header->image_size - offset;
+    if (available < sizeof(GcHeader)) {
+        return 0;
+    }
+    GcHeader gc_header;
+    memcpy(&gc_header, obj, sizeof(gc_header));
+    if (gc_header.mark != (GC_FLAG_MARK | GC_FLAG_IMAGE)) {
+        return 0;
+    }
+    // the sizes are read only once the fixed part of the object is known to be within the image
+    switch (gc_header.class_id) {
+        case NX_CLASS_INT: {
+            const NxInt *i = (const NxInt *) obj;
+            if (available < sizeof(NxInt) || i->size == INT64_MIN) {
+                return 0;
+            }
+            int64_t limbs = i->size < 0 ? -i->size : i->size;
+            return fits(available, sizeof(NxInt), limbs, sizeof(uint64_t)) ? sizeof(NxInt) + limbs * sizeof(uint64_t)
+                                                                            : 0;
+        }
+        case NX_CLASS_STR: {
+            const NxStr *str = (const NxStr *) obj;
+            if (available < sizeof(NxStr) || !fits(available, sizeof(NxStr) + 1, str->length, 1)
+                || (uint64_t) (uintptr_t) str->data != check->start + offset + sizeof(NxStr)
+                || obj[sizeof(NxStr) + str->length] != 0) {
+                return 0;
+            }
+            check->words[(offset + offsetof(NxStr, data)) / sizeof(uint64_t)] |= WORD_INLINE;
+            return sizeof(NxStr) + str->length + 1;
+        }
+        case NX_CLASS_LIST: {
+            const NxList *list = (const NxList *) obj;
+            if (available < sizeof(NxList) || list->length < 0
+                || (list->strategy != NX_LIST_INTS && list->strategy != NX_LIST_OBJECTS)) {
+                return 0;
+            }
+            mark_pointers(check, offset + offsetof(NxList, items), 1);
+            return sizeof(NxList);
+        }
+        case NX_CLASS_DICT: {
+            const NxDict *dict = (const NxDict *) obj;
+            if (available < sizeof(NxDict) || dict->length < 0 || dict->growth_left < 0) {
+                return 0;
+            }
+            mark_pointers(check, offset + offsetof(NxDict, table), 1);
+            return sizeof(NxDict);
+        }
+        case NX_CLASS_RANGE: {
+            const NxRange *range = (const NxRange *) obj;
+            return available >= sizeof(NxRange) && range->step != 0 && range->length >= 0 ? sizeof(NxRange) : 0;
+        }
+        case NX_CLASS_OBJECT_ARRAY: {
+            const NxObjectArray *array = (const NxObjectArray *) obj;
+            if (available < sizeof(NxObjectArray)
+                || !fits(available, sizeof(NxObjectArray), array->size, sizeof(NxObject *))) {
+                return 0;
+            }
+            mark_pointers(check, offset + offsetof(NxObjectArray, data), array->size);
+            return sizeof(NxObjectArray) + array->size * sizeof(NxObject *);
+        }
+        case NX_CLASS_INT_ARRAY: {
+            const NxIntArray *array = (const NxIntArray *) obj;
+            if (available < sizeof(NxIntArray)
+                || !fits(available, sizeof(NxIntArray), array->size, sizeof(int64_t))) {
+                return 0;
+            }
+            return sizeof(NxIntArray) + array->size * sizeof(int64_t);
+        }
+        case NX_CLASS_DICT_TABLE: {
+            const NxDictTable *table = (const NxDictTable *) obj;
+            if (available < sizeof(NxDictTable)
+                || !fits(available, sizeof(NxDictTable), table->capacity, sizeof(NxDictEntry) + 1)
+                || table->capacity < NX_DICT_GROUP_SIZE || (table->capacity & (table->capacity - 1)) != 0) {
+                return 0;
+            }
+            mark_pointers(check, offset + offsetof(NxDictTable, entries), 2 * table->capacity);
+            return sizeof(NxDictTable) + table->capacity * (sizeof(NxDictEntry) + 1);
+        }
+        default:
+            return 0;
+    }
+}
+
+/**
+ * \brief Returns the object of the image a pointer field points to.
+ * \param check the state of the check
+ * \param field the offset of the pointer field within the image
+ * \param class_id the expected class of the object
+ * \return the object, NULL if the field is not relocated or points to an object of another class
+ */
+static const char *target_of(const ImageCheck *check, uint64_t field, GcClassId class_id) {
+    if (!(check->words[field / sizeof(uint64_t)] & WORD_RELOCATED)) {
+        return NULL;
+    }
+    uint64_t target;
+    memcpy(&target, check->image + field, sizeof(target));
+    const char *obj = check->image + (target - check->start);
+    return ((const GcHeader *) obj)->class_id == class_id ? obj : NULL;
+}
+
+/**
+ * \brief Returns whether the key or the value of a full slot of a dictionary table holds a value.
+ * \param check the state of the check
+ * \param field the offset of the field within the image
+ * \return true if the field is relocated, points to a statically allocated object or holds an immediate value
+ */
+static bool check_entry_field(const ImageCheck *check, uint64_t field) {
+    uint64_t value;
+    memcpy(&value, check->image + field, sizeof(value));
+    return (check->words[field / sizeof(uint64_t)] & (WORD_RELOCATED | WORD_STATIC)) || value != 0;
+}
+
+/**
+ * \brief Checks the references between the objects of a list or a dictionary and their storage.
+ * \param check the state of the check
+ * \param offset the offset of the object within the image
+ * \return true if the object is consistent with its storage
+ */
+static bool check_storage(const ImageCheck *check, uint64_t offset) {
+    const char *obj = check->image + offset;
+    switch (((const GcHeader *) obj)->class_id) {
+        case NX_CLASS_LIST: {
+            const NxList *list = (const NxList *) obj;
+            uint64_t field = offset + offsetof(NxList, items);
+            if (list->strategy == NX_LIST_INTS) {
+                const NxIntArray *ints = (const NxIntArray *) target_of(check, field, NX_CLASS_INT_ARRAY);
+                return ints != NULL && list->length <= ints->size;
+            }
+            const NxObjectArray *items = (const NxObjectArray *) target_of(check, field, NX_CLASS_OBJECT_ARRAY);
+            return items != NULL && list->length <= items->size;
+        }
+        case NX_CLASS_DICT: {
+            const NxDict *dict = (const NxDict *) obj;
+            uint64_t field = offset + offsetof(NxDict, table);
+            const NxDictTable *table = (const NxDictTable *) target_of(check, field, NX_CLASS_DICT_TABLE);
+            if (table == NULL || dict->length + dict->growth_left >= table->capacity) {
+                return false;
+            }
+            // the probing stops at an empty slot, every full slot holds a key and a value
+            const uint8_t *ctrl = (const uint8_t *) &table->entries[table->capacity];
+            uint64_t entries = (const char *) table->entries - check->image;
+            int64_t full = 0;
+            for (int64_t i = 0; i < table->capacity; i++) {
+                if (ctrl[i] == NX_DICT_CTRL_EMPTY) {
+                    continue;
+                }
+                uint64_t key = entries + i * sizeof(NxDictEntry) + offsetof(NxDictEntry, key);
+                uint64_t value = entries + i * sizeof(NxDictEntry) + offsetof(NxDictEntry, value);
+                if (ctrl[i] > NX_DICT_CTRL_EMPTY || !check_entry_field(check, key) || !check_entry_field(check, value)) {
+                    return false;
+                }
+                full++;
+            }
+            return full == dict->length;
+        }
+        default:
+            return true;
+    }
+}
+
+/**
+ * \brief Checks the objects of an image whose relocations and statics are within bounds.
+ *
+ * The image must be a sequence of objects of the classes which can be saved, each within the image. Every pointer
+ * field must either be relocated to the start of an object, be set to a statically allocated object, or hold NULL or
+ * an immediate value, and only pointer fields may be relocated. Lists and dictionaries must be consistent with their
+ * storage, which their operations assume.
+ * \param header the header of the snapshot file
+ * \param image the image, not relocated yet
+ * \param relocations the offsets of the relocated pointers
+ * \param statics the pointers to statically allocated objects
+ * \return true if the image can be used
+ */
+static bool check_image(const SnapshotHeader *header, const char *image, const uint64_t *relocations,
+                        const SnapshotStaticRef *statics) {
+    if (header->image_size % NX_ALIGNMENT != 0) {
+        return false;
+    }
+    uint64_t word_count = header->image_size / sizeof(uint64_t);
+    ImageCheck check = {
+            .header = header,
+            .image = image,
+            .start = SNAPSHOT_BASE + header->image_offset,
+            .words = nx_alloc(word_count),
+    };
+    memset(check.words, 0, word_count);
+    bool valid = true;
+    for (uint64_t offset = 0; valid && offset < header->image_size;) {
+        uint64_t size = check_object(&check, offset);
+        check.words[offset / sizeof(uint64_t)] |= WORD_OBJECT;
+        valid = size != 0;
+        offset += NX_ALIGN_UP(size);
+    }
+    for (uint64_t i = 0; valid && i < header->relocation_count; i++) {
+        uint8_t *word = &check.words[relocations[i] / sizeof(uint64_t)];
+        uint64_t target;
+        memcpy(&target, image + relocations[i], sizeof(target));
+        valid = (*word & (WORD_RELOCATED | WORD_STATIC)) == 0
+                && ((*word & WORD_INLINE) || ((*word & WORD_POINTER) && target % NX_ALIGNMENT == 0
+                    && (check.words[(target - check.start) / sizeof(uint64_t)] & WORD_OBJECT)));
+        *word |= WORD_RELOCATED;
+    }
+    for (uint64_t i = 0; valid && i < header->static_count; i++) {
+        uint8_t *word = &check.words[statics[i].offset / sizeof(uint64_t)];
+        valid = (*word & WORD_POINTER) && (*word & (WORD_RELOCATED | WORD_STATIC)) == 0;
+        *word |= WORD_STATIC;
+    }
+    for (uint64_t i = 0; valid && i < word_count; i++) {
+        uint8_t word = check.words[i];
+        if ((word & WORD_INLINE) && !(word & WORD_RELOCATED)) {
+            valid = false;
+        } else if ((word & WORD_POINTER) && !(word & (WORD_RELOCATED | WORD_STATIC))) {
+            uint64_t value;
+            memcpy(&value, image + i * sizeof(uint64_t), sizeof(value));
+            valid = value == 0 || gc_is_immediate((NxObject *) (uintptr_t) value);
+        }
+    }
+    for (uint64_t i = 0; valid && i < word_count; i++) {
+        if (check.words[i] & WORD_OBJECT) {
+            valid = check_storage(&check, i * sizeof(uint64_t));
+        }
+    }
+    nx_free(check.words);
+    return valid;
+}
+
+bool snapshot_load(Snapshot *snapshot, const char *path, Env *env) {
+    *snapshot = (Snapshot) {.data = NULL, .size = 0};
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(SnapshotHeader)) {
+        close(fd);
+        return false;
+    }
+    size_t size = (size_t) st.st_size;
+    // the mapping is private and writable, the pages are copied only when the objects in them are written
+    char *data = mmap((void *) SNAPSHOT_BASE, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    const SnapshotHeader *header = (const SnapshotHeader *) data;
+    // the counts are bounded before computing the sizes of the sections, so that they cannot overflow
+    uint64_t limit = size;
+    bool valid = memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) == 0
+                 && header->version == SNAPSHOT_VERSION && header->class_count == NX_CLASS_COUNT
+                 && header->pointer_size == sizeof(void *) && header->page_size == SNAPSHOT_PAGE_SIZE
+                 && header->base == SNAPSHOT_BASE
+                 && header->slot_count <= limit && header->relocation_count <= limit
+                 && header->static_count <= limit && header->blob_size <= limit
+                 && header->image_offset % SNAPSHOT_PAGE_SIZE == 0 && header->image_offset <= limit
+                 && header->image_size == size - header->image_offset
+                 && sizeof(SnapshotHeader) + header->relocation_count * sizeof(uint64_t)
+                    + header->static_count * sizeof(SnapshotStaticRef) + header->slot_count * sizeof(SnapshotName)
+                    + header->blob_size <= header->image_offset
+                 && header->image_size >= sizeof(NxObjectArray);
+    if (!valid) {
+        munmap(data, size);
+        return false;
+    }
+    const uint64_t *relocations = (const uint64_t *) (header + 1);
+    const SnapshotStaticRef *statics = (const SnapshotStaticRef *) (relocations + header->relocation_count);
+    const SnapshotName *names = (const SnapshotName *) (statics + header->static_count);
+    const char *blob = (const char *) (names + header->slot_count);
+    char *image = data + header->image_offset;
+    const NxObjectArray *roots = (const NxObjectArray *) image;
+    valid = roots->gc_header.class_id == NX_CLASS_OBJECT_ARRAY
+            && roots->gc_header.mark == (GC_FLAG_MARK | GC_FLAG_IMAGE)
+            && (uint64_t) roots->size == header->slot_count
+            && header->slot_count <= (header->image_size - sizeof(NxObjectArray)) / sizeof(NxObject *);
+    for (uint64_t i = 0; valid && i < header->slot_count; i++) {
+        valid = names[i].offset <= header->blob_size && names[i].length <= header->blob_size - names[i].offset;
+    }
+    uint64_t start = SNAPSHOT_BASE + header->image_offset;
+    for (uint64_t i = 0; valid && i < header->relocation_count; i++) {
+        uint64_t target;
+        valid = valid_pointer_offset(header, relocations[i]);
+        if (valid) {
+            memcpy(&target, image + relocations[i], sizeof(target));
+            valid = target >= start && target - start < header->image_size;
+        }
+    }
+    for (uint64_t i = 0; valid && i < header->static_count; i++) {
+        valid = valid_pointer_offset(header, statics[i].offset) && statics[i].id < STATIC_COUNT;
+    }
+    // the class and the size of every object are used by the collector and by the operations on the values
+    valid = valid && check_image(header, image, relocations, statics);
+    if (!valid) {
+        munmap(data, size);
+        return false;
+    }
+    if ((uintptr_t) data != SNAPSHOT_BASE) {
+        // the preferred address was taken, every pointer within the image has to be adjusted
+        uint64_t delta = (uintptr_t) data - SNAPSHOT_BASE;
+        for (uint64_t i = 0; i < header->relocation_count; i++) {
+            *(uint64_t *) (image + relocations[i]) += delta;
+        }
+    }
+    for (uint64_t i = 0; i < header->static_count; i++) {
+        *(NxObject **) (image + statics[i].offset) = statics[i].id == STATIC_TRUE ? nx_true : nx_false;
+    }
+    for (uint64_t i = 0; i < header->slot_count; i++) {
+        uint32_t slot = env_declare(env, blob + names[i].offset, names[i].length);
+        if (roots->data[i] != NULL) {
+            env_store(env, slot, roots->data[i]);
+        }
+    }
+    snapshot->data = data;
+    snapshot->size = size;
+    return true;
+}
+
+void snapshot_close(Snapshot *snapshot) {
+    if (snapshot->data) {
+        gc_forget_image(snapshot->data, snapshot->size);
+        munmap(snapshot->data, snapshot->size);
+    }
+    *snapshot = (Snapshot) {.data = NULL, .size = 0};
+}
@@ -0,0 +1,644 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file vm.c
+ * \brief Implementation of the bytecode virtual machine.
+ */
+
+#include "natrix/interp/vm.h"
+#include <assert.h>
+#include "natrix/compiler/jit.h"
+#include "natrix/interp/builtins.h"
+#include "natrix/interp/exec_counts.h"
+#include "natrix/interp/ops.h"
+#include "natrix/interp/profiler.h"
+#include "natrix/obj/nx_dict.h"
+#include "natrix/obj/nx_int.h"
+#include "natrix/obj/nx_list.h"
+#include "natrix/obj/nx_str.h"
+#include "natrix/util/mem.h"
+#include "natrix/util/output.h"
+#include "natrix/util/safepoint.h"
+
+//! Number of deoptimizations after which a site no longer attempts to specialize.
+#define MAX_DEOPTIMIZATIONS 4
+
+//! Number of early returns from the native code of a loop after which the loop is interpreted again.
+#define MAX_LOOP_DEOPTIMIZATIONS 16
+
+/**
+ * \brief Adaptive opcodes of the binary operators.
+ */
+static const Opcode ADAPTIVE_OPCODES[] = {
+        [BINOP_ADD] = OP_ADD,
+        [BINOP_SUB] = OP_SUB,
+        [BINOP_MUL] = OP_MUL,
+        [BINOP_DIV] = OP_DIV,
+        [BINOP_EQ] = OP_EQ,
+        [BINOP_NE] = OP_NE,
+        [BINOP_LT] = OP_LT,
+        [BINOP_LE] = OP_LE,
+        [BINOP_GT] = OP_GT,
+        [BINOP_GE] = OP_GE,
+};
+
+/**
+ * \brief Opcodes of the binary operators specialized for integers.
+ */
+static const Opcode INT_OPCODES[] = {
+        [BINOP_ADD] = OP_ADD_INT,
+        [BINOP_SUB] = OP_SUB_INT,
+        [BINOP_MUL] = OP_MUL_INT,
+        [BINOP_DIV] = OP_DIV_INT,
+        [BINOP_EQ] = OP_EQ_INT,
+        [BINOP_NE] = OP_NE_INT,
+        [BINOP_LT] = OP_LT_INT,
+        [BINOP_LE] = OP_LE_INT,
+        [BINOP_GT] = OP_GT_INT,
+        [BINOP_GE] = OP_GE_INT,
+};
+
+/**
+ * \brief The operand stack.
+ *
+ * The stack is not allocated by the garbage collector, it is rooted for the duration of the execution.
+ * The integers computed by the sites marked as temporary live in a region of the stack until `RELEASE_TEMPS` or
+ * the next back edge. The stacks of the running programs of a thread are linked, so that those abandoned by a
+ * recovered panic can be freed (see `vm_release_abandoned()`).
+ */
+typedef struct VmStack {
+    GcHeader gc_header;             //!< header for garbage collector, traces the values on the stack
+    NxObject **base;                //!< bottom of the stack
+    NxObject **top;                 //!< pointer to the slot above the topmost value
+    Arena temporaries;              //!< region of the temporaries, see `nx_int_temporaries`
+    struct VmStack *prev;           //!< the stack of the enclosing execution of the thread, NULL if none
+    NxObject *slots[];              //!< the values
+} VmStack;
+
+//! The operand stack of the innermost execution of the calling thread, NULL if none.
+static _Thread_local VmStack *current_stack = NULL;
+
+static void vm_stack_gc_trace(void *ptr) {
+    VmStack *stack = (VmStack *) ptr;
+    for (NxObject **p = stack->base; p < stack->top; p++) {
+        gc_visit(nxo_gc_header(*p));
+    }
+}
+
+/**
+ * \brief Executes a binary operation on the two topmost values, replacing them with the result.
+ * \param stack the operand stack
+ * \param site the site of the instruction, a temporary result is allocated in the region of the stack
+ */
+static void exec_binary(VmStack *stack, const CodeSite *site) {
+    NxObject **top = stack->top;
+    if (site->temporary) {
+        nx_int_temporaries = &stack->temporaries;
+        top[-2] = ops_binary(top[-2], site->op, top[-1]);
+        nx_int_temporaries = NULL;
+    } else {
+        top[-2] = ops_binary(top[-2], site->op, top[-1]);
+    }
+    stack->top--;
+}
+
+/**
+ * \brief Frees the temporaries, no value on the operand stack may refer to them.
+ * \param stack the operand stack
+ */
+static inline void release_temporaries(VmStack *stack) {
+    if (stack->temporaries.alloc_count) {
+        arena_reset(&stack->temporaries);
+    }
+}
+
+/**
+ * \brief Executes an adaptive binary operator and specializes it when its warmup runs out.
+ * \param code the code object
+ * \param stack the operand stack
+ * \param site the site of the instruction
+ */
+static void exec_adaptive(Code *code, VmStack *stack, CodeSite *site) {
+    assert(site->warmup > 0);
+    if (--site->warmup == 0) {
+        NxObject *left = stack->top[-2];
+        NxObject *right = stack->top[-1];
+        Opcode op;
+        if (nx_int_is_instance(left) && nx_int_is_instance(right)) {
+            op = INT_OPCODES[site->op];
+        } else if (site->op == BINOP_ADD && nx_str_is_instance(left) && nx_str_is_instance(right)) {
+            op = OP_ADD_STR;
+        } else {
+            op = OP_BINARY;
+        }
+        code->bytecode[site->offset] = op;
+        site->specialized++;
+    }
+    exec_binary(stack, site);
+}
+
+/**
+ * \brief Reverts a specialized binary operator whose type guard failed and executes the generic operation.
+ * \param code the code object
+ * \param stack the operand stack
+ * \param site the site of the instruction
+ */
+static void exec_deoptimize(Code *code, VmStack *stack, CodeSite *site) {
+    site->deoptimized++;
+    if (site->deoptimized >= MAX_DEOPTIMIZATIONS) {
+        code->bytecode[site->offset] = OP_BINARY;
+    } else {
+        // back off, so that a site with unstable types does not flip-flop
+        code->bytecode[site->offset] = ADAPTIVE_OPCODES[site->op];
+        site->warmup = CODE_SITE_WARMUP << site->deoptimized;
+    }
+    exec_binary(stack, site);
+}
+
+/**
+ * \brief Executes a binary operator specialized for integers.
+ * \param code the code object
+ * \param stack the operand stack
+ * \param op the binary operator, a constant so that the operation is folded into the caller
+ * \param site the site of the instruction, used on a type guard miss and for temporaries
+ */
+static inline void exec_int(Code *code, VmStack *stack, BinaryOp op, CodeSite *site) {
+    NxObject **top = stack->top;
+    if (nx_int_is_instance(top[-2]) && nx_int_is_instance(top[-1])) {
+        if (site->temporary) {
+            nx_int_temporaries = &stack->temporaries;
+            top[-2] = ops_binary_int(top[-2], op, top[-1]);
+            nx_int_temporaries = NULL;
+        } else {
+            top[-2] = ops_binary_int(top[-2], op, top[-1]);
+        }
+        stack->top--;
+    } else {
+        exec_deoptimize(code, stack, site);
+    }
+}
+
+/**
+ * \brief Executes the back edge of a loop, compiling the loop once it is hot and running its native code.
+ * \param env the environment
+ * \param code the code object
+ * \param stack the operand stack
+ * \param loop the loop record
+ * \param jit the policy of the loop compiler
+ * \param safepoint the safepoint polled by the native code
+ * \return the next instruction to execute
+ */
+static const uint8_t *exec_loop(Env *env, Code *code, VmStack *stack, CodeLoop *loop, const JitPolicy *jit,
+                                Safepoint *safepoint) {
+    if (!loop->native) {
+        if (!jit->enabled || loop->failed || ++loop->counter < jit->threshold) {
+            return code->bytecode + loop->start;
+        }
+        loop->native = jit_compile_loop(code, loop);
+        if (!loop->native) {
+            loop->failed = true;
+            return code->bytecode + loop->start;
+        }
+    }
+    JitExit exit = jit_enter(loop->native, env->values, stack->top, safepoint);
+    stack->top += exit.depth;
+    // a pending safepoint exits at a back-edge, which is not a failed speculation
+    if (exit.offset != loop->end && code->bytecode[exit.offset] != OP_LOOP
+            && ++loop->deoptimized >= MAX_LOOP_DEOPTIMIZATIONS) {
+        jit_free(loop->native);
+        loop->native = NULL;
+        loop->failed = true;
+    }
+    return code->bytecode + exit.offset;
+}
+
+/*
+ * Dispatch of the instructions.
+ *
+ * With `ENABLE_COMPUTED_GOTO` (and a compiler supporting labels as values), each handler jumps to the handler of
+ * the next instruction through a table of label addresses, so that every handler ends with its own indirect branch,
+ * which the processor predicts from the instruction being executed. Otherwise, the handlers are the cases of
+ * a `switch` in a loop and share a single indirect branch. The handlers are written once for both variants, labeled
+ * by `TARGET()` and ending with `DISPATCH()`, which continues with the instruction at `ip`.
+ */
+#if ENABLE_COMPUTED_GOTO && defined(__GNUC__)
+#define VM_COMPUTED_GOTO 1
+#define TARGET(x) case OP_##x: TARGET_##x
+#define DISPATCH() do { NEXT_INSTRUCTION(); goto *dispatch_table[*ip]; } while (0)
+// GCC never inlines a function containing a computed goto, `instrumented` is then a well predicted branch
+#define VM_RUN_INLINE
+#else
+#define VM_COMPUTED_GOTO 0
+#define TARGET(x) case OP_##x
+#define DISPATCH() continue
+#define VM_RUN_INLINE inline __attribute__((always_inline))
+#endif
+
+//! Checks the invariants, publishes the instruction at `ip` to the profiler and counts it, before it is executed.
+#define NEXT_INSTRUCTION() do { \
+        assert(ip >= code->bytecode && ip < code->bytecode + code->bytecode_size); \
+        assert(stack->top >= stack->base && stack->top <= stack->base + code->max_stack); \
+        if (instrumented) { \
+            if (profile) { \
+                profiler_current = ip; \
+            } \
+            if (opcode_counts) { \
+                opcode_counts[*ip]++; \
+            } \
+        } \
+    } while (0)
+
+//! Reads the operand of the instruction at `ip` and advances `ip` to the next instruction.
+#define READ_OPERAND() (ip += 1 + OPERAND_SIZE, code_read_operand(ip - 1 - OPERAND_SIZE))
+
+/**
+ * \brief Executes the bytecode.
+ * \param env the environment
+ * \param code the code object
+ * \param instrumented whether the executed instructions may be published to the profiler or counted (see
+ * exec_counts.h), a constant so that the check is folded into each of the two copies of the interpreter loop when it
+ * can be inlined
+ * \return false if the execution has been interrupted at a safepoint
+ */
+static VM_RUN_INLINE bool vm_run(Env *env, Code *code, bool instrumented) {
+    VmStack *stack = nx_alloc(sizeof(VmStack) + (code->max_stack + 1) * sizeof(NxObject *));
+    stack->gc_header = (GcHeader) {.mark = 0, .class_id = gc_register_class(vm_stack_gc_trace, "operand stack")};
+    stack->base = stack->slots;
+    stack->top = stack->base;
+    stack->temporaries = arena_init();
+    stack->prev = current_stack;
+    current_stack = stack;
+    gc_root(&stack->gc_header);
+    JitPolicy jit = jit_get_policy();
+    bool profile = instrumented && profiler_is_running();
+    uint64_t *opcode_counts = instrumented && exec_counts_current ? exec_counts_current->opcodes : NULL;
+    if (opcode_counts) {
+        // the instructions of native code are not counted
+        jit.enabled = false;
+    }
+    Safepoint *safepoint = safepoint_current();
+    bool completed = true;
+#if VM_COMPUTED_GOTO
+    // filled at run time, a constant table of label addresses would prevent the inlining of this function
+    void *dispatch_table[OPCODE_COUNT];
+    #define OP(x, operand) dispatch_table[OP_##x] = &&TARGET_##x;
+    #include "natrix/compiler/opcodes.inc"
+    #undef OP
+#endif
+
+    const uint8_t *ip = code->bytecode;
+    while (1) {
+        NEXT_INSTRUCTION();
+        switch ((Opcode) *ip) {
+            TARGET(CONST): {
+                uint32_t operand = READ_OPERAND();
+                assert(operand < code->constant_count);
+                *stack->top++ = code->constants[operand];
+                DISPATCH();
+            }
+            TARGET(LOAD_VAR): {
+                uint32_t operand = READ_OPERAND();
+                assert(operand < env->count);
+                *stack->top++ = env_load(env, operand);
+                DISPATCH();
+            }
+            TARGET(STORE_VAR): {
+                uint32_t operand = READ_OPERAND();
+                assert(operand < env->count);
+                env_store(env, operand, stack->top[-1]);
+                stack->top--;
+                DISPATCH();
+            }
+            TARGET(LIST): {
+                uint32_t operand = READ_OPERAND();
+                NxObject *list = nx_list_create_from(stack->top - operand, operand);
+                stack->top -= operand;
+                *stack->top++ = list;
+                DISPATCH();
+            }
+            TARGET(DICT): {
+                uint32_t operand = READ_OPERAND();
+                NxObject *dict = nx_dict_create_from(stack->top - 2 * operand, operand);
+                stack->top -= 2 * operand;
+                *stack->top++ = dict;
+                DISPATCH();
+            }
+            TARGET(ADD):
+            TARGET(SUB):
+            TARGET(MUL):
+            TARGET(DIV):
+            TARGET(EQ):
+            TARGET(NE):
+            TARGET(LT):
+            TARGET(LE):
+            TARGET(GT):
+            TARGET(GE): {
+                uint32_t operand = READ_OPERAND();
+                assert(operand < code->site_count);
+                exec_adaptive(code, stack, &code->sites[operand]);
+                DISPATCH();
+            }
+            TARGET(BINARY): {
+                uint32_t operand = READ_OPERAND();
+                assert(operand < code->site_count);
+                exec_binary(stack, &code->sites[operand]);
+                DISPATCH();
+            }
+            TARGET(ADD_INT): {
+                uint32_t operand = READ_OPERAND();
+                assert(operand < code->site_count);
+                exec_int(code, stack, BINOP_ADD, &code->sites[operand]);
+                DISPATCH();
+            }
+            TARGET(SUB_INT): {
+                uint32_t operand = READ_OPERAND();
+                assert(operand < code->site_count);
+                exec_int(code, stack, BINOP_SUB, &code->sites[operand]);
+                DISPATCH();
+            }
+            TARGET(MUL_INT): {
+                uint32_t operand = READ_OPERAND();
+                assert(operand < code->site_count);
+                exec_int(code, stack, BINOP_MUL, &code->sites[operand]);
+                DISPATCH();
+            }
+            TARGET(DIV_INT): {
+                uint32_t operand = READ_OPERAND();
+                assert(operand < code->site_count);
+                exec_int(code, stack, BINOP_DIV, &code->sites[operand]);
+                DISPATCH();
+            }
+            TARGET(EQ_INT): {
+                uint32_t operand = READ_OPERAND();
+                assert(operand < code->site_count);
+                exec_int(code, stack, BINOP_EQ, &code->sites[operand]);
+                DISPATCH();
+            }
+            TARGET(NE_INT): {
+                uint32_t operand = READ_OPERAND();
+                assert(operand < code->site_count);
+                exec_int(code, stack, BINOP_NE, &code->sites[operand]);
+                DISPATCH();
+            }
+            TARGET(LT_INT): {
+                uint32_t operand = READ_OPERAND();
+                assert(operand < code->site_count);
+                exec_int(code, stack, BINOP_LT, &code->sites[operand]);
+                DISPATCH();
+            }
+            TARGET(LE_INT): {
+                uint32_t operand = READ_OPERAND();
+                assert(operand < code->site_count);
+                exec_int(code, stack, BINOP_LE, &code->sites[operand]);
+                DISPATCH();
+            }
+            TARGET(GT_INT): {
+                uint32_t operand = READ_OPERAND();
+                assert(operand < code->site_count);
+                exec_int(code, stack, BINOP_GT, &code->sites[operand]);
+                DISPATCH();
+            }
+            TARGET(GE_INT): {
+                uint32_t operand = READ_OPERAND();
+                assert(operand < code->site_count);
+                exec_int(code, stack, BINOP_GE, &code->sites[operand]);
+                DISPATCH();
+            }
+            TARGET(ADD_STR): {
+                uint32_t operand = READ_OPERAND();
+                assert(operand < code->site_count);
+                if (nx_str_is_instance(stack->top[-2]) && nx_str_is_instance(stack->top[-1])) {
+                    // both operands stay on the stack, so they are rooted during the allocation
+                    stack->top[-2] = nx_str_concat(stack->top[-2], stack->top[-1]);
+                    stack->top--;
+                } else {
+                    exec_deoptimize(code, stack, &code->sites[operand]);
+                }
+                DISPATCH();
+            }
+            TARGET(INPLACE): {
+                uint32_t operand = READ_OPERAND();
+                assert(operand < code->site_count);
+                NxObject **top = stack->top;
+                if (nx_int_is_instance(top[-2]) && nx_int_is_instance(top[-1])) {
+                    top[-2] = ops_binary_int(top[-2], code->sites[operand].op, top[-1]);
+                } else {
+                    top[-2] = ops_inplace(top[-2], code->sites[operand].op, top[-1]);
+                }
+                stack->top--;
+                DISPATCH();
+            }
+            TARGET(UPDATE_VAR): {
+                // LOAD_VAR a; CONST c; op; STORE_VAR b
+                uint32_t slot = code_read_operand(ip);
+                NxObject *value = env_load(env, slot);
+                NxObject *constant = code->constants[code_read_operand(ip + 1 + OPERAND_SIZE)];
+                if (nx_int_is_instance(value) && nx_int_is_instance(constant)) {
+                    const CodeSite *site = &code->sites[code_read_operand(ip + 2 * (1 + OPERAND_SIZE))];
+                    // the operands are held by the environment and the constant pool during the allocation
+                    NxObject *result = ops_binary_int(value, site->op, constant);
+                    env_store(env, code_read_operand(ip + 3 * (1 + OPERAND_SIZE)), result);
+                    ip += 4 * (1 + OPERAND_SIZE);
+                } else {
+                    // the types do not match, execute the instructions separately from now on
+                    code->bytecode[ip - code->bytecode] = OP_LOAD_VAR;
+                    *stack->top++ = value;
+                    ip += 1 + OPERAND_SIZE;
+                }
+                DISPATCH();
+            }
+            TARGET(COMPARE_JUMP): {
+                // comparison; JUMP_IF_FALSE
+                CodeSite *site = &code->sites[code_read_operand(ip)];
+                NxObject *left = stack->top[-2];
+                NxObject *right = stack->top[-1];
+                bool ints = nx_int_is_instance(left) && nx_int_is_instance(right);
+                if (ints || (nx_str_is_instance(left) && nx_str_is_instance(right))) {
+                    // the operands stay on the stack while the strings are compared, which may flatten them
+                    bool result = ints ? ops_compare_int(left, site->op, right) : ops_compare_str(left, site->op, right);
+                    stack->top -= 2;
+                    int32_t jump = (int32_t) code_read_operand(ip + 1 + OPERAND_SIZE);
+                    ip += 2 * (1 + OPERAND_SIZE);
+                    if (!result) {
+                        ip += jump;
+                    }
+                } else {
+                    // the types do not match, the comparison is adaptive from now on
+                    code->bytecode[ip - code->bytecode] = ADAPTIVE_OPCODES[site->op];
+                }
+                DISPATCH();
+            }
+            TARGET(GET_ELEMENT): {
+                // the first receiver decides the specialization of the site
+                NxObject *receiver = stack->top[-2];
+                code->bytecode[ip - code->bytecode] = nx_list_is_instance(receiver) ? OP_GET_ELEMENT_LIST
+                                                      : nx_str_is_instance(receiver) ? OP_GET_ELEMENT_STR
+                                                      : OP_GET_ELEMENT_ANY;
+                DISPATCH();
+            }
+            TARGET(GET_ELEMENT_LIST): {
+                NxObject *receiver = stack->top[-2];
+                NxObject *index = stack->top[-1];
+                if (nx_list_is_instance(receiver)) {
+                    ip++;
+                    // a single unsigned comparison checks both bounds, negative indices take the generic path
+                    if (nxo_is_immediate_int(index)
+                        && (uint64_t) nx_int_get_value(index) < (uint64_t) nx_list_get_length(receiver)) {
+                        stack->top[-2] = nx_list_get_item(receiver, nx_int_get_value(index));
+                    } else {
+                        stack->top[-2] = nxo_get_element(receiver, index);
+                    }
+                    stack->top--;
+                } else {
+                    code->bytecode[ip - code->bytecode] = OP_GET_ELEMENT_ANY;
+                }
+                DISPATCH();
+            }
+            TARGET(GET_ELEMENT_STR): {
+                NxObject *receiver = stack->top[-2];
+                NxObject *index = stack->top[-1];
+                if (nx_str_is_instance(receiver)) {
+                    ip++;
+                    if (nxo_is_immediate_int(index)
+                        && (uint64_t) nx_int_get_value(index) < (uint64_t) nx_str_get_length(receiver)) {
+                        // the single-byte strings are static, the receiver only needs to be flattened
+                        stack->top[-2] = nx_str_from_char(nx_str_get_data(receiver)[nx_int_get_value(index)]);
+                    } else {
+                        stack->top[-2] = nxo_get_element(receiver, index);
+                    }
+                    stack->top--;
+                } else {
+                    code->bytecode[ip - code->bytecode] = OP_GET_ELEMENT_ANY;
+                }
+                DISPATCH();
+            }
+            TARGET(GET_ELEMENT_ANY):
+                ip++;
+                stack->top[-2] = nxo_get_element(stack->top[-2], stack->top[-1]);
+                stack->top--;
+                DISPATCH();
+            TARGET(GET_SLICE):
+                ip++;
+                stack->top[-3] = nxo_get_slice(stack->top[-3], stack->top[-2], stack->top[-1]);
+                stack->top -= 2;
+                DISPATCH();
+            TARGET(CALL): {
+                // the arguments stay on the stack during the call, so they are rooted without being copied
+                uint32_t operand = READ_OPERAND();
+                uint32_t argc = code_call_argc(operand);
+                NxObject *result = builtin_call(code_call_builtin(operand), stack->top - argc, argc);
+                stack->top -= argc;
+                *stack->top++ = result;
+                DISPATCH();
+            }
+            TARGET(RANGE): {
+                uint32_t argc = READ_OPERAND();
+                NxObject *range = builtin_range_iter(stack->top - argc, argc);
+                stack->top -= argc;
+                *stack->top++ = range;
+                DISPATCH();
+            }
+            TARGET(FOR_ITER): {
+                // FOR_ITER; JUMP
+                uint32_t slot = READ_OPERAND();
+                assert(slot + 1 < env->count);
+                int64_t position = nx_int_get_value(env->values[slot + 1]);
+                NxObject *item = nxo_iter_next(env->values[slot], &position);
+                if (item) {
+                    // the position stays far below the limit of immediate integers, storing it does not allocate
+                    env_store(env, slot + 1, nx_int_create(position));
+                    *stack->top++ = item;
+                    ip += 1 + OPERAND_SIZE;
+                }
+                DISPATCH();
+            }
+            TARGET(SET_ELEMENT):
+                ip++;
+                nxo_set_element(stack->top[-3], stack->top[-2], stack->top[-1]);
+                stack->top -= 3;
+                DISPATCH();
+            TARGET(JUMP): {
+                uint32_t operand = READ_OPERAND();
+                ip += (int32_t) operand;
+                DISPATCH();
+            }
+            TARGET(JUMP_IF_FALSE): {
+                uint32_t operand = READ_OPERAND();
+                if (!ops_is_true(stack->top[-1])) {
+                    ip += (int32_t) operand;
+                }
+                stack->top--;
+                DISPATCH();
+            }
+            TARGET(LOOP): {
+                uint32_t operand = READ_OPERAND();
+                assert(operand < code->loop_count);
+                if (safepoint_is_pending(safepoint) && safepoint_handle(safepoint)) {
+                    completed = false;
+                    goto finish;
+                }
+                release_temporaries(stack);
+                ip = exec_loop(env, code, stack, &code->loops[operand], &jit, safepoint);
+                DISPATCH();
+            }
+            TARGET(POP):
+                ip++;
+                stack->top--;
+                DISPATCH();
+            TARGET(DUP_TWO):
+                ip++;
+                stack->top[0] = stack->top[-2];
+                stack->top[1] = stack->top[-1];
+                stack->top += 2;
+                DISPATCH();
+            TARGET(PRINT):
+                ip++;
+                ops_print(stack->top[-1]);
+                stack->top--;
+                DISPATCH();
+            TARGET(RELEASE_TEMPS):
+                ip++;
+                release_temporaries(stack);
+                DISPATCH();
+            TARGET(HALT):
+                assert(stack->top == stack->base);
+                goto finish;
+            default:
+                assert(0 && "Invalid opcode");
+                __builtin_unreachable();
+        }
+    }
+finish:
+    gc_unroot(&stack->gc_header);
+    current_stack = stack->prev;
+    arena_free(&stack->temporaries);
+    nx_free(stack);
+    if (profile) {
+        profiler_current = NULL;
+    }
+    output_flush();
+    return completed;
+}
+
+bool vm_exec(Env *env, Code *code) {
+    if (profiler_is_running() || exec_counts_current) {
+        return vm_run(env, code, true);
+    } else {
+        return vm_run(env, code, false);
+    }
+}
+
+void vm_release_abandoned() {
+    while (current_stack) {
+        VmStack *stack = current_stack;
+        current_stack = stack->prev;
+        arena_free(&stack->temporaries);
+        nx_free(stack);
+    }
+    nx_int_temporaries = NULL;
+}
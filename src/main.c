@@ -10,349 +10,718 @@
  * \brief Entry point of the interpreter.
  */
 
-#include <assert.h>
+#include <errno.h>
+#include <getopt.h>
+#include <limits.h>
+#include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include "natrix/obj/nx_bool.h"
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include "natrix/compiler/code_cache.h"
+#include "natrix/compiler/jit.h"
+#include "natrix/interp/ast_interp.h"
+#include "natrix/interp/exec_counts.h"
+#include "natrix/interp/ops.h"
+#include "natrix/interp/profiler.h"
+#include "natrix/interp/program.h"
+#include "natrix/interp/server.h"
+#include "natrix/interp/snapshot.h"
+#include "natrix/interp/vm.h"
 #include "natrix/obj/nx_int.h"
-#include "natrix/obj/nx_list.h"
-#include "natrix/obj/nx_str.h"
-#include "natrix/parser/diag.h"
-#include "natrix/parser/parser.h"
-#include "natrix/util/panic.h"
+#include "natrix/parser/source_stream.h"
+#include "natrix/util/output.h"
+#include "natrix/util/perf_counters.h"
+#include "natrix/util/safepoint.h"
 
 /**
- * \brief Represents a variable in the environment.
+ * \brief Execution engines.
  */
-typedef struct Variable Variable;
-struct Variable {
-    GcHeader gc_header;                 //!< header for garbage collector
-    const char *name_start;             //!< start of the name
-    size_t name_len;                    //!< length of the name
-    NxObject *value;                    //!< value of the variable
-    Variable *next;                     //!< next variable in the list
+typedef enum {
+    ENGINE_VM,              //!< Compile to bytecode and execute it in the virtual machine
+    ENGINE_AST,             //!< Execute the abstract syntax tree directly
+} Engine;
+
+/**
+ * \brief Formats of the report printed by `--stats`.
+ */
+typedef enum {
+    STATS_NONE,             //!< Do not print the report
+    STATS_TEXT,             //!< Human-readable report
+    STATS_JSON,             //!< Single JSON object
+} StatsFormat;
+
+/**
+ * \brief Options of the front end.
+ */
+typedef struct {
+    bool optimize;          //!< Run the optimizer on the abstract syntax tree
+    bool dump_ast;          //!< Print the abstract syntax tree instead of executing it
+    bool cache;             //!< Load the compiled program from a cache file next to the source file, or create it
+    const char *profile;    //!< File to write the profile of the program to, NULL to not profile
+    bool profile_alloc;     //!< Report the allocations of the program
+    StatsFormat stats;      //!< Format of the report of the phases and resources printed to stderr
+    bool stream;            //!< Read, parse and execute the source file a few top-level statements at a time
+    const char *snapshot;   //!< Snapshot to load the variables from before running the program, NULL if none
+    const char *save_snapshot;  //!< File to save the variables to after running the program, NULL to not save
+} FrontEndOptions;
+
+/**
+ * \brief Phases of the execution timed for `--stats`.
+ */
+typedef enum {
+    PHASE_LOAD,             //!< Reading the source file
+    PHASE_PARSE,            //!< Lexing and parsing
+    PHASE_COMPILE,          //!< Resolving, optimizing and compiling, or loading the code cache
+    PHASE_EXECUTE,          //!< Executing the program, including the garbage collection pauses
+    PHASE_TEARDOWN,         //!< Writing the profile, freeing the program and the final garbage collection
+    PHASE_COUNT,
+} Phase;
+
+//! Names of the phases in the report.
+static const char *const PHASE_NAMES[PHASE_COUNT] = {
+    [PHASE_LOAD] = "load",
+    [PHASE_PARSE] = "parse",
+    [PHASE_COMPILE] = "compile",
+    [PHASE_EXECUTE] = "execute",
+    [PHASE_TEARDOWN] = "teardown",
 };
 
 /**
- * \brief Represents the environment, i.e. the mapping of variable names to their values.
- *
- * Currently, the environment is implemented as a linked list of variables to keep things simple.
- * It will be replaced with a more efficient data structure in the future.
+ * \brief Measurements of a run reported by `--stats`.
+ */
+typedef struct {
+    uint64_t phase_start_ns;            //!< Time at which the current phase started
+    uint64_t phase_ns[PHASE_COUNT];     //!< Time spent in each phase in nanoseconds
+    //! Usage of the arena of the syntax tree, zero if loaded from the cache, the largest batch if streamed
+    ArenaStats arena;
+} RunStats;
+
+//! Number of source lines in the reports of the profiler.
+#define PROFILE_HOT_LINES 10
+
+//! Flag of the cache file indicating that the program was optimized.
+#define CACHE_FLAG_OPTIMIZE 1
+
+/**
+ * \brief Options of the garbage collector, indexed by the option character minus `GC_OPTION_BASE`.
+ */
+typedef enum {
+    GC_OPTION_YOUNG,        //!< Size of the young generation
+    GC_OPTION_HEAP,         //!< Initial heap size
+    GC_OPTION_GROWTH,       //!< Heap growth factor
+    GC_OPTION_MAX_HEAP,     //!< Maximum heap size
+    GC_OPTION_THREADS,      //!< Number of marking threads
+    GC_OPTION_SWEEP,        //!< Sweeping mode
+    GC_OPTION_PAUSE,        //!< Pause budget of incremental marking
+    GC_OPTION_REGION,       //!< Size of the memory regions holding the slabs
+    GC_OPTION_PAGES,        //!< Kind of pages backing the regions
+    GC_OPTION_RELEASE,      //!< How empty regions are returned to the system
+    GC_OPTION_COUNT,
+} GcOption;
+
+//! First option character used for the garbage collector options in `getopt_long`.
+#define GC_OPTION_BASE 256
+
+//! Names of the environment variables corresponding to the garbage collector options.
+static const char *const GC_OPTION_ENV[GC_OPTION_COUNT] = {
+    [GC_OPTION_YOUNG] = "NATRIX_GC_YOUNG",
+    [GC_OPTION_HEAP] = "NATRIX_GC_HEAP",
+    [GC_OPTION_GROWTH] = "NATRIX_GC_GROWTH",
+    [GC_OPTION_MAX_HEAP] = "NATRIX_GC_MAX_HEAP",
+    [GC_OPTION_THREADS] = "NATRIX_GC_THREADS",
+    [GC_OPTION_SWEEP] = "NATRIX_GC_SWEEP",
+    [GC_OPTION_PAUSE] = "NATRIX_GC_PAUSE",
+    [GC_OPTION_REGION] = "NATRIX_GC_REGION",
+    [GC_OPTION_PAGES] = "NATRIX_GC_PAGES",
+    [GC_OPTION_RELEASE] = "NATRIX_GC_RELEASE",
+};
+
+/**
+ * \brief Parses a size in bytes with an optional K, M or G suffix.
+ * \param str the string to parse
+ * \param result receives the size
+ * \return true if the string is a valid size
  */
-typedef struct Env {
-    GcHeader gc_header;                 //!< header for garbage collector
-    Variable *head;                     //!< head of the list of variables
-} Env;
-
-static void variable_gc_trace(void *ptr) {
-    Variable *var = (Variable *) ptr;
-    gc_visit(&var->value->gc_header);
-    gc_visit(&var->next->gc_header);
+static bool parse_size(const char *str, size_t *result) {
+    char *end;
+    unsigned long long value = strtoull(str, &end, 10);
+    if (end == str || *str == '-') {
+        return false;
+    }
+    unsigned shift = 0;
+    switch (*end) {
+        case 'K': case 'k': shift = 10; end++; break;
+        case 'M': case 'm': shift = 20; end++; break;
+        case 'G': case 'g': shift = 30; end++; break;
+        default: break;
+    }
+    if (*end != '\0' || value > (SIZE_MAX >> shift)) {
+        return false;
+    }
+    *result = (size_t) value << shift;
+    return true;
 }
 
-static void env_gc_trace(void *ptr) {
-    Env *env = (Env *) ptr;
-    gc_visit(&env->head->gc_header);
+/**
+ * \brief Parses a positive number of seconds, possibly fractional.
+ * \param str the string to parse
+ * \param result receives the number of seconds
+ * \return true if the string is a valid duration
+ */
+static bool parse_seconds(const char *str, double *result) {
+    char *end;
+    double value = strtod(str, &end);
+    if (end == str || *end != '\0' || !(value > 0) || value > 1e9) {
+        return false;
+    }
+    *result = value;
+    return true;
 }
 
 /**
- * \brief Finds a variable in the environment.
- * \param env the environment
- * \param name_start start of the name
- * \param name_len length of the name
- * \return the variable if found, otherwise NULL
+ * \brief Applies a garbage collector option to the policy.
+ * \param policy the policy to update
+ * \param option the option
+ * \param value the value of the option
+ * \return true if the value is valid
  */
-static Variable *env_find(Env *env, const char *name_start, size_t name_len) {
-    for (Variable *var = env->head; var; var = var->next) {
-        if (var->name_len == name_len && memcmp(var->name_start, name_start, name_len) == 0) {
-            return var;
+static bool set_gc_option(GcPolicy *policy, GcOption option, const char *value) {
+    switch (option) {
+        case GC_OPTION_YOUNG:
+            return parse_size(value, &policy->young_size) && policy->young_size > 0;
+        case GC_OPTION_HEAP:
+            return parse_size(value, &policy->initial_heap_size);
+        case GC_OPTION_GROWTH: {
+            char *end;
+            policy->growth_factor = strtod(value, &end);
+            return end != value && *end == '\0' && policy->growth_factor >= 1.0;
+        }
+        case GC_OPTION_MAX_HEAP:
+            return parse_size(value, &policy->max_heap_size);
+        case GC_OPTION_THREADS: {
+            char *end;
+            unsigned long threads = strtoul(value, &end, 10);
+            policy->mark_threads = (unsigned) threads;
+            return end != value && *end == '\0' && *value != '-' && threads >= 1 && threads <= 256;
         }
+        case GC_OPTION_SWEEP:
+            policy->background_sweep = strcmp(value, "background") == 0;
+            return policy->background_sweep || strcmp(value, "lazy") == 0;
+        case GC_OPTION_PAUSE: {
+            char *end;
+            unsigned long budget = strtoul(value, &end, 10);
+            policy->pause_budget_us = (unsigned) budget;
+            return end != value && *end == '\0' && *value != '-' && budget <= UINT_MAX;
+        }
+        case GC_OPTION_REGION:
+            return parse_size(value, &policy->regions.region_size) && policy->regions.region_size % SLAB_SIZE == 0;
+        case GC_OPTION_PAGES:
+            if (strcmp(value, "normal") == 0) {
+                policy->regions.pages = SLAB_PAGES_NORMAL;
+            } else if (strcmp(value, "thp") == 0) {
+                policy->regions.pages = SLAB_PAGES_TRANSPARENT;
+            } else if (strcmp(value, "hugetlb") == 0) {
+                policy->regions.pages = SLAB_PAGES_HUGETLB;
+            } else {
+                return false;
+            }
+            return true;
+        case GC_OPTION_RELEASE:
+            if (strcmp(value, "unmap") == 0) {
+                policy->regions.release = SLAB_RELEASE_UNMAP;
+            } else if (strcmp(value, "dontneed") == 0) {
+                policy->regions.release = SLAB_RELEASE_DONTNEED;
+            } else if (strcmp(value, "free") == 0) {
+                policy->regions.release = SLAB_RELEASE_FREE;
+            } else {
+                return false;
+            }
+            return true;
+        default:
+            return false;
     }
-    return NULL;
 }
 
 /**
- * \brief Sets the value of the given variable in the environment.
- * \param env the environment
- * \param name_start start of the name
- * \param name_len length of the name
- * \param value the value to set
+ * \brief Returns the value of the monotonic clock in nanoseconds.
+ * \return the time in nanoseconds
+ */
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/**
+ * \brief Attributes the time since the end of the previous phase to the given phase.
+ * \param stats the measurements to update
+ * \param phase the phase which just ended
  */
-static void env_set(Env *env, const char *name_start, size_t name_len, NxObject *value) {
-    Variable *var = env_find(env, name_start, name_len);
-    if (!var) {
-        nxo_root(value);
-        var = (Variable *) gc_alloc(sizeof(Variable), variable_gc_trace);
-        nxo_unroot(value);
-        var->name_start = name_start;
-        var->name_len = name_len;
-        var->next = env->head;
-        env->head = var;
-    }
-    var->value = value;
+static void end_phase(RunStats *stats, Phase phase) {
+    uint64_t now = now_ns();
+    stats->phase_ns[phase] += now - stats->phase_start_ns;
+    stats->phase_start_ns = now;
 }
 
 /**
- * \brief Gets the value of the given variable in the environment.
+ * \brief Prints the report of the phases and resources of the run to stderr.
  *
- * If the variable is not found, the program panics.
- * \param env the environment
- * \param name_start start of the name
- * \param name_len length of the name
- * \return the value of the variable
+ * Counters which are not available are omitted from the text report and reported as null in JSON.
+ * \param stats the measurements of the run
+ * \param counters the hardware counters, stopped
+ * \param format the format of the report
  */
-static NxObject *env_get(Env *env, const char *name_start, size_t name_len) {
-    Variable *var = env_find(env, name_start, name_len);
-    if (!var) {
-        PANIC("Undefined variable: %.*s", (int) name_len, name_start);
+static void print_stats(const RunStats *stats, const PerfCounters *counters, StatsFormat format) {
+    GcStats gc_stats;
+    gc_get_stats(&gc_stats);
+    struct rusage usage;
+    long peak_rss_kb = getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : -1;
+    uint64_t total_ns = 0;
+    for (Phase phase = 0; phase < PHASE_COUNT; phase++) {
+        total_ns += stats->phase_ns[phase];
+    }
+    StringBuilder sb = sb_init();
+    if (format == STATS_JSON) {
+        sb_append_str(&sb, "{\"phases_ns\": {");
+        for (Phase phase = 0; phase < PHASE_COUNT; phase++) {
+            sb_append_formatted(&sb, "\"%s\": %llu, ", PHASE_NAMES[phase], (unsigned long long) stats->phase_ns[phase]);
+        }
+        sb_append_formatted(&sb, "\"total\": %llu}", (unsigned long long) total_ns);
+        sb_append_formatted(&sb, ", \"gc\": {\"pause_ns\": %llu, \"max_pause_ns\": %llu, \"pauses\": %llu, "
+                                 "\"minor_collections\": %llu, \"major_collections\": %llu, "
+                                 "\"allocated_objects\": %llu, \"allocated_bytes\": %llu, \"peak_heap_bytes\": %llu}",
+                            (unsigned long long) gc_stats.total_pause_ns, (unsigned long long) gc_stats.max_pause_ns,
+                            (unsigned long long) gc_stats.pause_count, (unsigned long long) gc_stats.minor_collections,
+                            (unsigned long long) gc_stats.major_collections,
+                            (unsigned long long) gc_stats.allocated_objects,
+                            (unsigned long long) gc_stats.allocated_bytes,
+                            (unsigned long long) gc_stats.peak_heap_bytes);
+        sb_append_formatted(&sb, ", \"arena\": {\"allocations\": %zu, \"allocated_bytes\": %zu, \"chunks\": %zu, "
+                                 "\"chunk_bytes\": %zu}",
+                            stats->arena.alloc_count, stats->arena.alloc_size, stats->arena.chunk_count,
+                            stats->arena.chunk_size);
+        sb_append_formatted(&sb, ", \"peak_rss_kb\": %ld, \"counters\": {", peak_rss_kb);
+        for (PerfCounter counter = 0; counter < PERF_COUNTER_COUNT; counter++) {
+            uint64_t value;
+            sb_append_formatted(&sb, "%s\"%s\": ", counter ? ", " : "", PERF_COUNTER_NAMES[counter]);
+            if (perf_counters_read(counters, counter, &value)) {
+                sb_append_formatted(&sb, "%llu", (unsigned long long) value);
+            } else {
+                sb_append_str(&sb, "null");
+            }
+        }
+        sb_append_str(&sb, "}}\n");
+    } else {
+        for (Phase phase = 0; phase < PHASE_COUNT; phase++) {
+            sb_append_formatted(&sb, "%-14s %10.3f ms\n", PHASE_NAMES[phase], stats->phase_ns[phase] / 1e6);
+        }
+        sb_append_formatted(&sb, "%-14s %10.3f ms\n", "total", total_ns / 1e6);
+        sb_append_formatted(&sb, "%-14s %10.3f ms in %llu pauses (%llu minor, %llu major), longest %.3f ms\n", "gc",
+                            gc_stats.total_pause_ns / 1e6, (unsigned long long) gc_stats.pause_count,
+                            (unsigned long long) gc_stats.minor_collections,
+                            (unsigned long long) gc_stats.major_collections, gc_stats.max_pause_ns / 1e6);
+        sb_append_formatted(&sb, "%-14s %llu bytes in %llu objects, peak heap %llu bytes\n", "allocated",
+                            (unsigned long long) gc_stats.allocated_bytes,
+                            (unsigned long long) gc_stats.allocated_objects,
+                            (unsigned long long) gc_stats.peak_heap_bytes);
+        sb_append_formatted(&sb, "%-14s %zu bytes in %zu allocations, %zu bytes in %zu chunks\n", "arena",
+                            stats->arena.alloc_size, stats->arena.alloc_count, stats->arena.chunk_size,
+                            stats->arena.chunk_count);
+        sb_append_formatted(&sb, "%-14s %ld KiB\n", "peak rss", peak_rss_kb);
+        for (PerfCounter counter = 0; counter < PERF_COUNTER_COUNT; counter++) {
+            uint64_t value;
+            if (perf_counters_read(counters, counter, &value)) {
+                sb_append_formatted(&sb, "%-14s %llu\n", PERF_COUNTER_NAMES[counter], (unsigned long long) value);
+            }
+        }
     }
-    return var->value;
+    fputs(sb.str, stderr);
+    sb_free(&sb);
 }
 
 /**
- * \brief Converts the given string to an integer.
- * \param str the string, must contain only digits
- * \param len the length of the string
- * \return the integer value
+ * \brief Writes the counts of the run as JSON.
+ * \param counts the counts, stopped
+ * \param path the file to write the counts to, NULL to print them to stderr
+ * \return true if the counts were written
  */
-static NxObject *int_from_str(const char *str, size_t len) {
-    int64_t value = 0;
-    for (size_t i = 0; i < len; i++) {
-        assert(str[i] >= '0' && str[i] <= '9');
-        value = value * 10 + (str[i] - '0');
-        if (value < 0) {
-            PANIC("Integer literal too large");
+static bool write_counts(const ExecCounts *counts, const char *path) {
+    StringBuilder sb = sb_init();
+    exec_counts_to_json(counts, &sb);
+    FILE *f = path ? fopen(path, "w") : stderr;
+    bool ok = f && fputs(sb.str, f) >= 0;
+    if (f && f != stderr) {
+        ok = fclose(f) == 0 && ok;
+    }
+    if (!ok) {
+        fprintf(stderr, "Unable to write counts to %s\n", path ? path : "stderr");
+    }
+    sb_free(&sb);
+    return ok;
+}
+
+/**
+ * \brief Stops the profiler and writes its results.
+ *
+ * The collapsed stacks are written to the profile file, the hottest lines and the allocations are printed to stderr.
+ * \param options the options of the front end
+ */
+static void write_profile(const FrontEndOptions *options) {
+    profiler_stop();
+    StringBuilder sb = sb_init();
+    if (options->profile) {
+        profiler_dump_collapsed(&sb);
+        FILE *file = fopen(options->profile, "w");
+        if (!file || fputs(sb.str, file) == EOF || fclose(file) != 0) {
+            fprintf(stderr, "Unable to write profile to %s\n", options->profile);
         }
+        sb_free(&sb);
+        sb = sb_init();
+        profiler_dump_hot_lines(&sb, PROFILE_HOT_LINES);
     }
-    return nx_int_create(value);
+    if (options->profile_alloc) {
+        profiler_dump_allocations(&sb, PROFILE_HOT_LINES);
+    }
+    fputs(sb.str, stderr);
+    sb_free(&sb);
+    profiler_free();
 }
 
 /**
- * \brief Evaluates the given binary operation on integers.
- * \param left left operand
- * \param op binary operation
- * \param right right operand
- * \return the result of the operation
+ * \brief Loads the snapshot requested by `--snapshot` into the environment, if any.
+ * \param options the options of the front end
+ * \param snapshot receives the mapping of the snapshot
+ * \param env the environment, must be rooted
+ * \return false if the snapshot cannot be loaded
  */
-static int64_t eval_binop_int(int64_t left, BinaryOp op, int64_t right) {
-    switch (op) {
-        case BINOP_ADD:
-            return left + right;
-        case BINOP_SUB:
-            return left - right;
-        case BINOP_MUL:
-            return left * right;
-        case BINOP_DIV:
-            if (right == 0) {
-                PANIC("Division by zero");
-            }
-            return left / right;
-        case BINOP_EQ:
-            return left == right;
-        case BINOP_NE:
-            return left != right;
-        case BINOP_LT:
-            return left < right;
-        case BINOP_LE:
-            return left <= right;
-        case BINOP_GT:
-            return left > right;
-        case BINOP_GE:
-            return left >= right;
-        default:
-            assert(0);
+static bool load_snapshot(const FrontEndOptions *options, Snapshot *snapshot, Env *env) {
+    *snapshot = (Snapshot) {.data = NULL, .size = 0};
+    if (options->snapshot && !snapshot_load(snapshot, options->snapshot, env)) {
+        fprintf(stderr, "Unable to load snapshot %s\n", options->snapshot);
+        return false;
     }
+    return true;
 }
 
 /**
- * \brief Evaluates the given binary operation.
- * \param env the environment for allocation
- * \param left left operand
- * \param op binary operation
- * \param right right operand
- * \return the result of the operation
+ * \brief Saves the environment to the snapshot requested by `--save-snapshot`, if any.
+ * \param options the options of the front end
+ * \param env the environment after the execution, must be rooted
+ * \return false if the snapshot cannot be saved
  */
-static NxObject *eval_binop(Env *env, NxObject *left, BinaryOp op, NxObject *right) {
-    if (nx_int_is_instance(left) && nx_int_is_instance(right)) {
-        int64_t result = eval_binop_int(nx_int_get_value(left), op, nx_int_get_value(right));
-        return nx_int_create(result);
-    }
-    if (op == BINOP_ADD && nx_str_is_instance(left) && nx_str_is_instance(right)) {
-        nxo_root(right);
-        NxObject *result = nx_str_concat(left, right);
-        nxo_unroot(right);
-        return result;
-    }
-    PANIC("Operands must be integers");
+static bool save_snapshot(const FrontEndOptions *options, const Env *env) {
+    if (options->save_snapshot && !snapshot_save(options->save_snapshot, env)) {
+        fprintf(stderr, "Unable to save snapshot %s\n", options->save_snapshot);
+        return false;
+    }
+    return true;
 }
 
 /**
- * \brief Evaluates the given expression.
- * \param env the environment for variable lookup
- * \param expr the expression to evaluate
- * \return the result of the expression
+ * \brief Parses and executes the given source code.
+ * \param filename the name of the source file
+ * \param source the source code
+ * \param arg the argument to the program
+ * \param engine the execution engine
+ * \param options the options of the front end
+ * \param stats receives the measurements of the phases, the current phase ends with the execution
+ * \return false if the snapshot cannot be loaded or saved or the program has been interrupted
  */
-static NxObject *eval_expr(Env *env, const Expr *expr) {
-    switch (expr->kind) {
-        case EXPR_INT_LITERAL:
-            return int_from_str(expr->literal.start, expr->literal.end - expr->literal.start);
-        case EXPR_STR_LITERAL: {
-            assert(expr->literal.start[0] == '"' && expr->literal.end[-1] == '"');
-            int64_t len = expr->literal.end - expr->literal.start - 2;
-            return nx_str_create(expr->literal.start + 1, len);
+static bool run(const char *filename, Source *source, NxObject *arg, Engine engine, FrontEndOptions options,
+                RunStats *stats) {
+    Env env = env_init();
+    gc_root(&env.gc_header);
+    Snapshot snapshot;
+    if (!load_snapshot(&options, &snapshot, &env)) {
+        gc_unroot(&env.gc_header);
+        env_free(&env);
+        return false;
+    }
+    Program program;
+    program_init(&program);
+    Code *code = &program.code;
+    CodeCache cache = {.data = NULL, .size = 0};
+    StringBuilder cache_path = sb_init();
+    sb_append_formatted(&cache_path, "%sc", filename);
+    uint32_t cache_flags = options.optimize ? CACHE_FLAG_OPTIMIZE : 0;
+    bool use_cache = options.cache && engine == ENGINE_VM && !options.dump_ast;
+    bool profile = options.profile || options.profile_alloc;
+    bool completed = true;
+    if (profile) {
+        ProfilerOptions profiler_options = {
+                .interval_us = options.profile ? PROFILER_DEFAULT_INTERVAL_US : 0,
+                .allocations = options.profile_alloc,
+        };
+        profiler_start(source, &profiler_options);
+    }
+    if (use_cache && code_cache_load(&cache, cache_path.str, source, cache_flags, &env, code)) {
+        env_store(&env, env_declare(&env, "arg", 3), arg);
+        if (profile) {
+            profiler_attach_code(code);
         }
-        case EXPR_LIST_LITERAL: {
-            int64_t cnt = 0;
-            Expr *e = expr->literal.head;
-            while (e) {
-                cnt++;
-                e = e->next;
+        end_phase(stats, PHASE_COMPILE);
+        completed = vm_exec(&env, code);
+        end_phase(stats, PHASE_EXECUTE);
+    } else {
+        // a syntax error has been reported, the rest of the pipeline runs with an empty program
+        program_parse(&program, source);
+        end_phase(stats, PHASE_PARSE);
+        program_resolve(&program, &env, arg, options.optimize);
+        end_phase(stats, PHASE_COMPILE);
+        if (options.dump_ast) {
+            StringBuilder sb = sb_init();
+            ast_dump(&sb, program.stmt);
+            fputs(sb.str, stdout);
+            sb_free(&sb);
+        } else if (engine == ENGINE_AST) {
+            if (profile) {
+                profiler_attach_ast(program.stmt);
+            }
+            completed = ast_interp_exec(&env, &program.literals, program.stmt);
+        } else {
+            program_compile(&program);
+            if (use_cache && program.stmt) {
+                code_cache_save(cache_path.str, source, cache_flags, &env, code);
             }
-            NxObject *result = nx_list_create(cnt);
-            nxo_root(result);
-            e = expr->literal.head;
-            for (size_t i = 0; i < cnt; i++) {
-                NxObject *value = eval_expr(env, e);
-                nxo_root(value);
-                nx_list_append(result, value);
-                nxo_unroot(value);
-                e = e->next;
+            if (profile) {
+                profiler_attach_code(code);
             }
-            nxo_unroot(result);
-            return result;
+            end_phase(stats, PHASE_COMPILE);
+            completed = vm_exec(&env, code);
         }
-        case EXPR_NAME:
-            return env_get(env, expr->identifier.start, expr->identifier.end - expr->identifier.start);
-        case EXPR_BINARY: {
-            NxObject *left = eval_expr(env, expr->binary.left);
-            nxo_root(left);
-            NxObject *right = eval_expr(env, expr->binary.right);
-            NxObject *res = eval_binop(env, left, expr->binary.op, right);
-            nxo_unroot(left);
-            return res;
+        end_phase(stats, PHASE_EXECUTE);
+        arena_get_stats(&program.arena, &stats->arena);
+    }
+    if (profile) {
+        write_profile(&options);
+    }
+    if (!completed) {
+        fprintf(stderr, "Execution interrupted\n");
+    }
+    bool ok = completed && (options.dump_ast || save_snapshot(&options, &env));
+    sb_free(&cache_path);
+    program_free(&program);
+    gc_unroot(&env.gc_header);
+    env_free(&env);
+    code_cache_close(&cache);
+    if (snapshot.data) {
+        // completes an incremental mark phase, which could still trace objects pointing into the snapshot
+        gc_collect();
+        snapshot_close(&snapshot);
+    }
+    return ok;
+}
+
+/**
+ * \brief Reads, parses and executes the source file a few top-level statements at a time.
+ *
+ * Each batch of statements returned by the `SourceStream` is resolved, optimized and compiled in the environment
+ * left by the previous ones and executed before the next batch is read. Then its syntax tree, literals and code
+ * are released, so the memory used is bounded by the size of the largest statement rather than of the file
+ * (apart from the variables). A syntax error stops the execution, the statements before it have been executed.
+ * \param filename the name of the source file
+ * \param arg the argument to the program
+ * \param engine the execution engine
+ * \param options the options of the front end
+ * \param stats receives the measurements of the phases, the current phase ends with the execution
+ * \return false if the file cannot be read, the snapshot cannot be loaded or saved or the program has been interrupted
+ */
+static bool run_stream(const char *filename, NxObject *arg, Engine engine, FrontEndOptions options,
+                       RunStats *stats) {
+    SourceStream stream;
+    if (!source_stream_open(&stream, filename, SOURCE_STREAM_DEFAULT_CHUNK_SIZE)) {
+        fprintf(stderr, "Unable to read file %s\n", filename);
+        return false;
+    }
+    Env env = env_init();
+    gc_root(&env.gc_header);
+    Snapshot snapshot;
+    if (!load_snapshot(&options, &snapshot, &env)) {
+        gc_unroot(&env.gc_header);
+        env_free(&env);
+        source_stream_close(&stream);
+        return false;
+    }
+    env_store(&env, env_declare(&env, "arg", 3), arg);
+    // the batches share one program, whose tree is rewound and whose literals and code are cleared after each batch
+    Program program;
+    program_init(&program);
+    ArenaMark mark = arena_mark(&program.arena);
+    Source *source;
+    bool completed = true;
+    while (completed && (source = source_stream_next(&stream)) != NULL) {
+        end_phase(stats, PHASE_LOAD);
+        bool parsed = program_parse(&program, source);
+        end_phase(stats, PHASE_PARSE);
+        if (!parsed) {
+            break;
         }
-        case EXPR_SUBSCRIPT: {
-            NxObject *receiver = eval_expr(env, expr->subscript.receiver);
-            nxo_root(receiver);
-            NxObject *index = eval_expr(env, expr->subscript.index);
-            nxo_root(index);
-            NxObject *res = nxo_get_element(receiver, index);
-            nxo_unroot(index);
-            nxo_unroot(receiver);
-            return res;
+        // `arg` was stored before the first batch, a batch may have assigned it since
+        program_resolve(&program, &env, NULL, options.optimize);
+        end_phase(stats, PHASE_COMPILE);
+        if (options.dump_ast) {
+            StringBuilder sb = sb_init();
+            ast_dump(&sb, program.stmt);
+            fputs(sb.str, stdout);
+            sb_free(&sb);
+        } else if (engine == ENGINE_AST) {
+            completed = ast_interp_exec(&env, &program.literals, program.stmt);
+        } else {
+            program_compile(&program);
+            end_phase(stats, PHASE_COMPILE);
+            completed = vm_exec(&env, &program.code);
         }
-        default:
-            assert(0);
+        end_phase(stats, PHASE_EXECUTE);
+        program_clear(&program);
+        ArenaStats arena_stats;
+        arena_get_stats(&program.arena, &arena_stats);
+        if (arena_stats.alloc_size > stats->arena.alloc_size) {
+            stats->arena = arena_stats;
+        }
+        arena_rewind(&program.arena, mark);
     }
+    end_phase(stats, PHASE_LOAD);
+    bool failed = !completed || source_stream_failed(&stream);
+    if (!completed) {
+        fprintf(stderr, "Execution interrupted\n");
+    } else if (failed) {
+        fprintf(stderr, "Unable to read file %s\n", filename);
+    } else if (!options.dump_ast) {
+        failed = !save_snapshot(&options, &env);
+    }
+    program_free(&program);
+    gc_unroot(&env.gc_header);
+    env_free(&env);
+    source_stream_close(&stream);
+    if (snapshot.data) {
+        gc_collect();
+        snapshot_close(&snapshot);
+    }
+    return !failed;
 }
 
-static void exec_stmts(Env *env, const Stmt *stmt);
+/**
+ * \brief Prints the usage information.
+ * \param program the name of the executable
+ */
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [--engine=vm|ast] [--optimize] [--dump-ast] [--cache] [--jit=on|off] [--perf-map] [--profile=FILE] [--profile-alloc] [--stats[=text|json]] [--count[=FILE]] [--stream] [--snapshot=FILE] [--save-snapshot=FILE] [--output-buffer=SIZE] [--heap-dump=FILE] [--cpu-limit=SECONDS] [--serve[=SOCKET]] [--workers=N] [--gc-young=SIZE] [--gc-heap=SIZE] [--gc-growth=FACTOR] "
+                    "[--gc-max-heap=SIZE] [--gc-threads=N] [--gc-sweep=lazy|background] "
+                    "[--gc-pause=MICROSECONDS] [--gc-region=SIZE] [--gc-pages=normal|thp|hugetlb] "
+                    "[--gc-release=unmap|dontneed|free] <filename> [arg]\n", program);
+}
 
 /**
- * \brief Evaluates an expression and returns the result as a boolean value.
- * \param env the environment for variable lookup
- * \param expr the condition expression
- * \return the result of the condition
+ * \brief Handles `SIGUSR1` by requesting a heap dump, which is written at the next collection trigger or loop back-edge.
+ * \param sig the signal number
  */
-static bool eval_cond(Env *env, const Expr *expr) {
-    NxObject *value = eval_expr(env, expr);
-    nxo_root(value);
-    NxObject *res = nxo_as_bool(value);
-    nxo_unroot(value);
-    return nx_bool_is_true(res);
+static void handle_heap_dump_signal(int sig) {
+    (void) sig;
+    gc_request_heap_dump();
 }
 
 /**
- * \brief Executes the given statement.
- * \param env the environment for variable lookup
- * \param stmt the statement
+ * \brief Appends heap dumps to a file whenever the process receives `SIGUSR1`.
+ * \param path the path of the file
+ * \return true if the signal handler was installed
  */
-static void exec_stmt(Env *env, const Stmt *stmt) {
-    switch (stmt->kind) {
-        case STMT_EXPR:
-            eval_expr(env, stmt->expr);
-            break;
-        case STMT_ASSIGNMENT: {
-            if (stmt->assignment.left->kind == EXPR_NAME) {
-                NxObject *rhs = eval_expr(env, stmt->assignment.right);
-                const char *start = stmt->assignment.left->identifier.start;
-                const char *end = stmt->assignment.left->identifier.end;
-                env_set(env, start, end - start, rhs);
-            } else if (stmt->assignment.left->kind == EXPR_SUBSCRIPT) {
-                NxObject *receiver = eval_expr(env, stmt->assignment.left->subscript.receiver);
-                nxo_root(receiver);
-                NxObject *index = eval_expr(env, stmt->assignment.left->subscript.index);
-                nxo_root(index);
-                NxObject *value = eval_expr(env, stmt->assignment.right);
-                nxo_root(value);
-                nxo_set_element(receiver, index, value);
-                nxo_unroot(value);
-                nxo_unroot(index);
-                nxo_unroot(receiver);
-            } else {
-                assert(0);
-            }
-            break;
-        }
-        case STMT_WHILE:
-            while (eval_cond(env, stmt->while_stmt.condition)) {
-                exec_stmts(env, stmt->while_stmt.body);
-            }
-            break;
-        case STMT_IF:
-            if (eval_cond(env, stmt->if_stmt.condition)) {
-                exec_stmts(env, stmt->if_stmt.then_body);
-            } else if (stmt->if_stmt.else_body) {
-                exec_stmts(env, stmt->if_stmt.else_body);
-            }
-            break;
-        case STMT_PASS:
-            break;
-        case STMT_PRINT: {
-            NxObject *value = eval_expr(env, stmt->expr);
-            if (nx_int_is_instance(value)) {
-                printf("%ld\n", nx_int_get_value(value));
-            } else if (nx_str_is_instance(value)) {
-                printf("%s\n", nx_str_get_cstr(value));
-            } else {
-                PANIC("Unexpected value type in print()");
-            }
-            break;
-        }
-        default:
-            assert(0);
-    }
+static bool enable_heap_dumps(const char *path) {
+    gc_set_heap_dump_path(path);
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_heap_dump_signal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    return sigaction(SIGUSR1, &action, NULL) == 0;
+}
+
+/**
+ * \brief Handles `SIGVTALRM` by interrupting the program at its next loop back-edge.
+ * \param sig the signal number
+ */
+static void handle_cpu_limit_signal(int sig) {
+    (void) sig;
+    safepoint_signal(SAFEPOINT_INTERRUPT);
 }
 
 /**
- * \brief Executes the given list of statements.
- * \param env the environment for variable lookup
- * \param stmt the first statement in the list
+ * \brief Interrupts the program once the process has consumed the given user CPU time.
+ * \param seconds the CPU time budget
+ * \return true if the timer was started
  */
-static void exec_stmts(Env *env, const Stmt *stmt) {
-    while (stmt) {
-        exec_stmt(env, stmt);
-        stmt = stmt->next;
+static bool start_cpu_limit(double seconds) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_cpu_limit_signal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGVTALRM, &action, NULL) != 0) {
+        return false;
     }
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    timer.it_value.tv_sec = (time_t) seconds;
+    timer.it_value.tv_usec = (suseconds_t) ((seconds - (double) timer.it_value.tv_sec) * 1e6);
+    if (timer.it_value.tv_sec == 0 && timer.it_value.tv_usec == 0) {
+        timer.it_value.tv_usec = 1;
+    }
+    return setitimer(ITIMER_VIRTUAL, &timer, NULL) == 0;
 }
 
 /**
- * \brief Parses and executes the given source code.
- * \param source the source code
- * \param arg the argument to the program
+ * \brief Runs the jobs requested on the standard input, or by the clients connecting to a Unix socket.
+ *
+ * The clients of the socket are served one at a time, each until it closes its end of the connection.
+ * \param socket_path the path of the socket to create, NULL to serve the standard input
+ * \param worker_count the number of worker threads
+ * \param policy the policy of the garbage collectors of the workers
+ * \return 0 if successful, 1 otherwise
  */
-static void run(Source *source, NxObject *arg) {
-    Env env = {
-            .gc_header = {.next = NULL, .trace_fn = env_gc_trace},
-            .head = NULL,
-    };
-    gc_root(&env.gc_header);
-    Arena arena = arena_init();
-    Stmt *stmt = parse_file(&arena, source, diag_default_handler, NULL);
-    env_set(&env, "arg", 3, arg);
-    exec_stmts(&env, stmt);
-    arena_free(&arena);
-    gc_unroot(&env.gc_header);
+static int serve(const char *socket_path, size_t worker_count, const GcPolicy *policy) {
+    int listen_fd = -1;
+    if (socket_path) {
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (strlen(socket_path) >= sizeof(address.sun_path)) {
+            fprintf(stderr, "Socket path too long: %s\n", socket_path);
+            return 1;
+        }
+        strcpy(address.sun_path, socket_path);
+        listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *) &address, sizeof(address)) != 0
+            || listen(listen_fd, SOMAXCONN) != 0) {
+            perror(socket_path);
+            return 1;
+        }
+    }
+    NxServer *server = nx_server_create(worker_count, policy);
+    if (!socket_path) {
+        nx_server_serve(server, STDIN_FILENO, STDOUT_FILENO);
+    } else {
+        while (1) {
+            int fd = accept(listen_fd, NULL, NULL);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                perror(socket_path);
+                break;
+            }
+            nx_server_serve(server, fd, fd);
+            close(fd);
+        }
+        close(listen_fd);
+        unlink(socket_path);
+    }
+    nx_server_destroy(server);
+    return socket_path ? 1 : 0;
 }
 
 /**
@@ -360,32 +729,206 @@ static void run(Source *source, NxObject *arg) {
  * \return 0 if successful, 1 otherwise
  */
 int main(const int argc, char **argv) {
-    if (argc != 2 && argc != 3) {
-        fprintf(stderr, "Usage: %s <filename> [arg]\n", argv[0]);
+#if ENABLE_CONSERVATIVE_GC
+    gc_set_stack_bottom(__builtin_frame_address(0));
+#endif
+    // the requests made by the signal handlers are served by the main thread, which executes the program
+    safepoint_set_signal_target(safepoint_current());
+    static const struct option long_options[] = {
+            {"engine", required_argument, NULL, 'e'},
+            {"optimize", no_argument, NULL, 'O'},
+            {"dump-ast", no_argument, NULL, 'd'},
+            {"cache", no_argument, NULL, 'c'},
+            {"jit", required_argument, NULL, 'j'},
+            {"perf-map", no_argument, NULL, 'p'},
+            {"profile", required_argument, NULL, 'P'},
+            {"profile-alloc", no_argument, NULL, 'A'},
+            {"stats", optional_argument, NULL, 's'},
+            {"count", optional_argument, NULL, 'C'},
+            {"stream", no_argument, NULL, 'S'},
+            {"snapshot", required_argument, NULL, 'L'},
+            {"save-snapshot", required_argument, NULL, 'W'},
+            {"output-buffer", required_argument, NULL, 'b'},
+            {"heap-dump", required_argument, NULL, 'H'},
+            {"cpu-limit", required_argument, NULL, 'T'},
+            {"serve", optional_argument, NULL, 'r'},
+            {"workers", required_argument, NULL, 'w'},
+            {"gc-young", required_argument, NULL, GC_OPTION_BASE + GC_OPTION_YOUNG},
+            {"gc-heap", required_argument, NULL, GC_OPTION_BASE + GC_OPTION_HEAP},
+            {"gc-growth", required_argument, NULL, GC_OPTION_BASE + GC_OPTION_GROWTH},
+            {"gc-max-heap", required_argument, NULL, GC_OPTION_BASE + GC_OPTION_MAX_HEAP},
+            {"gc-threads", required_argument, NULL, GC_OPTION_BASE + GC_OPTION_THREADS},
+            {"gc-sweep", required_argument, NULL, GC_OPTION_BASE + GC_OPTION_SWEEP},
+            {"gc-pause", required_argument, NULL, GC_OPTION_BASE + GC_OPTION_PAUSE},
+            {"gc-region", required_argument, NULL, GC_OPTION_BASE + GC_OPTION_REGION},
+            {"gc-pages", required_argument, NULL, GC_OPTION_BASE + GC_OPTION_PAGES},
+            {"gc-release", required_argument, NULL, GC_OPTION_BASE + GC_OPTION_RELEASE},
+            {NULL, 0, NULL, 0},
+    };
+    Engine engine = ENGINE_VM;
+    FrontEndOptions options = {0};
+    GcPolicy policy = gc_default_policy();
+    JitPolicy jit_policy = jit_default_policy();
+    size_t output_buffer_size;
+    double cpu_limit = 0;
+    bool count = false;
+    const char *count_path = NULL;
+    bool serve_mode = false;
+    const char *socket_path = NULL;
+    long worker_count = sysconf(_SC_NPROCESSORS_ONLN);
+    char *end;
+    for (GcOption option = 0; option < GC_OPTION_COUNT; option++) {
+        const char *value = getenv(GC_OPTION_ENV[option]);
+        if (value && !set_gc_option(&policy, option, value)) {
+            fprintf(stderr, "Invalid value of %s: %s\n", GC_OPTION_ENV[option], value);
+            return 1;
+        }
+    }
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        if (opt == 'e' && strcmp(optarg, "vm") == 0) {
+            engine = ENGINE_VM;
+        } else if (opt == 'e' && strcmp(optarg, "ast") == 0) {
+            engine = ENGINE_AST;
+        } else if (opt == 'O') {
+            options.optimize = true;
+        } else if (opt == 'd') {
+            options.dump_ast = true;
+        } else if (opt == 'c') {
+            options.cache = true;
+        } else if (opt == 'j' && strcmp(optarg, "on") == 0) {
+            jit_policy.enabled = true;
+        } else if (opt == 'j' && strcmp(optarg, "off") == 0) {
+            jit_policy.enabled = false;
+        } else if (opt == 'p') {
+            jit_policy.perf_map = true;
+        } else if (opt == 'P') {
+            options.profile = optarg;
+        } else if (opt == 'A') {
+            options.profile_alloc = true;
+        } else if (opt == 's' && (!optarg || strcmp(optarg, "text") == 0)) {
+            options.stats = STATS_TEXT;
+        } else if (opt == 's' && strcmp(optarg, "json") == 0) {
+            options.stats = STATS_JSON;
+        } else if (opt == 'C') {
+            count = true;
+            count_path = optarg;
+        } else if (opt == 'S') {
+            options.stream = true;
+        } else if (opt == 'L') {
+            options.snapshot = optarg;
+        } else if (opt == 'W') {
+            options.save_snapshot = optarg;
+        } else if (opt == 'b' && parse_size(optarg, &output_buffer_size) && output_buffer_size > 0) {
+            output_set_buffer_size(output_buffer_size);
+        } else if (opt == 'H') {
+            if (!enable_heap_dumps(optarg)) {
+                fprintf(stderr, "Unable to install the heap dump signal handler\n");
+                return 1;
+            }
+        } else if (opt == 'T' && parse_seconds(optarg, &cpu_limit)) {
+            continue;
+        } else if (opt == 'r') {
+            serve_mode = true;
+            socket_path = optarg;
+        } else if (opt == 'w' && (worker_count = strtol(optarg, &end, 10)) > 0 && *end == '\0') {
+            continue;
+        } else if (opt >= GC_OPTION_BASE && opt < GC_OPTION_BASE + GC_OPTION_COUNT
+                   && set_gc_option(&policy, opt - GC_OPTION_BASE, optarg)) {
+            continue;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (count) {
+        // the slices of incremental marking depend on the time
+        policy.pause_budget_us = 0;
+    }
+    gc_set_policy(&policy);
+    jit_set_policy(&jit_policy);
+    if (serve_mode && argc == optind) {
+        return serve(socket_path, worker_count > 0 ? (size_t) worker_count : 1, &policy);
+    }
+    if (argc - optind != 1 && argc - optind != 2) {
+        usage(argv[0]);
         return 1;
     }
+    if (options.stream && (options.cache || options.profile || options.profile_alloc)) {
+        fprintf(stderr, "--stream cannot be combined with --cache, --profile or --profile-alloc\n");
+        return 1;
+    }
+    if (options.snapshot && options.cache) {
+        fprintf(stderr, "--snapshot cannot be combined with --cache\n");
+        return 1;
+    }
+    if (count && options.cache) {
+        fprintf(stderr, "--count cannot be combined with --cache\n");
+        return 1;
+    }
+    const char *filename = argv[optind];
+    const char *arg_str = argc - optind == 2 ? argv[optind + 1] : NULL;
     NxObject *arg;
-    if (argc == 3) {
-        const char *ptr = argv[2];
+    if (arg_str) {
+        const char *ptr = arg_str;
         while (*ptr) {
             if (*ptr < '0' || *ptr > '9') {
-                fprintf(stderr, "Invalid argument: %s\n", argv[2]);
+                fprintf(stderr, "Invalid argument: %s\n", arg_str);
                 return 1;
             }
             ptr++;
         }
-        arg = int_from_str(argv[2], strlen(argv[2]));
+        arg = ops_int_from_str(arg_str, strlen(arg_str));
     } else {
         arg = nx_int_create(0);
     }
-    gc_root(&arg->gc_header);
-    Source source = source_from_file(argv[1]);
-    if (!source.start) {
-        fprintf(stderr, "Unable to read file %s\n", argv[1]);
+    gc_root(nxo_gc_header(arg));
+    if (cpu_limit > 0 && !start_cpu_limit(cpu_limit)) {
+        fprintf(stderr, "Unable to start the CPU time limit timer\n");
         return 1;
     }
-    run(&source, arg);
-    gc_unroot(&arg->gc_header);
-    gc_collect();
-    source_free(&source);
+    PerfCounters counters;
+    if (options.stats) {
+        perf_counters_start(&counters);
+    }
+    ExecCounts counts;
+    if (count) {
+        exec_counts_start(&counts);
+    }
+    RunStats stats = {.phase_start_ns = now_ns()};
+    if (options.stream) {
+        if (!run_stream(filename, arg, engine, options, &stats)) {
+            return 1;
+        }
+        gc_unroot(nxo_gc_header(arg));
+        gc_collect();
+    } else {
+        Source source = source_from_file(filename);
+        if (!source.start) {
+            fprintf(stderr, "Unable to read file %s\n", filename);
+            return 1;
+        }
+        end_phase(&stats, PHASE_LOAD);
+        bool ok = run(filename, &source, arg, engine, options, &stats);
+        gc_unroot(nxo_gc_header(arg));
+        gc_collect();
+        source_free(&source);
+        if (!ok) {
+            return 1;
+        }
+    }
+    end_phase(&stats, PHASE_TEARDOWN);
+    if (count) {
+        exec_counts_stop(&counts);
+        output_flush();
+        if (!write_counts(&counts, count_path)) {
+            return 1;
+        }
+    }
+    if (options.stats) {
+        perf_counters_stop(&counters);
+        output_flush();
+        print_stats(&stats, &counters, options.stats);
+        perf_counters_close(&counters);
+    }
 }
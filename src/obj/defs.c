@@ -22,6 +22,9 @@ int64_t nxo_check_index(NxObject *index, int64_t len) {
     if (!nx_int_is_instance(index)) {
         PANIC("Index must be an integer");
     }
+    if (!nx_int_fits_int64(index)) {
+        PANIC("Index out of range");
+    }
     int64_t i = nx_int_get_value(index);
     if (i < 0) {
         i += len;
@@ -32,12 +35,45 @@ int64_t nxo_check_index(NxObject *index, int64_t len) {
     return i;
 }
 
+/**
+ * \brief Converts a bound of a slice, see nxo_check_slice().
+ * \param bound the bound, NULL if omitted
+ * \param len the length of the sequence
+ * \param default_value the value of an omitted bound
+ * \return the bound as a number between 0 and len
+ */
+static int64_t check_slice_bound(NxObject *bound, int64_t len, int64_t default_value) {
+    if (bound == NULL) {
+        return default_value;
+    }
+    if (!nx_int_is_instance(bound)) {
+        PANIC("Slice indices must be integers");
+    }
+    if (!nx_int_fits_int64(bound)) {
+        return nx_int_sign(bound) < 0 ? 0 : len;
+    }
+    int64_t i = nx_int_get_value(bound);
+    if (i < 0) {
+        i = i < -len ? 0 : i + len;
+    }
+    return i > len ? len : i;
+}
+
+void nxo_check_slice(NxObject *lower, NxObject *upper, int64_t len, int64_t *start, int64_t *end) {
+    assert(len >= 0);
+    *start = check_slice_bound(lower, len, 0);
+    *end = check_slice_bound(upper, len, len);
+    if (*end < *start) {
+        *end = *start;
+    }
+}
+
 NxObject *nxo_as_bool(NxObject *obj) {
     assert(obj != NULL);
-    if (obj->type->as_bool_fn == NULL) {
-        PANIC("cannot convert '%s' object of to bool", obj->type->name);
+    if (nxo_type(obj)->as_bool_fn == NULL) {
+        PANIC("cannot convert '%s' object of to bool", nxo_type(obj)->name);
     }
-    NxObject *result = obj->type->as_bool_fn(obj);
+    NxObject *result = nxo_type(obj)->as_bool_fn(obj);
     if (result == NULL || !nx_bool_is_instance(result)) {
         PANIC("as_bool_fn returned non-bool object");
     }
@@ -47,10 +83,10 @@ NxObject *nxo_as_bool(NxObject *obj) {
 NxObject *nxo_get_element(NxObject *obj, NxObject *index) {
     assert(obj != NULL);
     assert(index != NULL);
-    if (obj->type->get_element_fn == NULL) {
-        PANIC("'%s' object is not subscriptable", obj->type->name);
+    if (nxo_type(obj)->get_element_fn == NULL) {
+        PANIC("'%s' object is not subscriptable", nxo_type(obj)->name);
     }
-    NxObject *result = obj->type->get_element_fn(obj, index);
+    NxObject *result = nxo_type(obj)->get_element_fn(obj, index);
     if (result == NULL) {
         PANIC("get_element_fn returned NULL");
     }
@@ -61,8 +97,46 @@ void nxo_set_element(NxObject *obj, NxObject *index, NxObject *value) {
     assert(obj != NULL);
     assert(index != NULL);
     assert(value != NULL);
-    if (obj->type->set_element_fn == NULL) {
-        PANIC("'%s' object does not support item assignment", obj->type->name);
+    if (nxo_type(obj)->set_element_fn == NULL) {
+        PANIC("'%s' object does not support item assignment", nxo_type(obj)->name);
+    }
+    nxo_type(obj)->set_element_fn(obj, index, value);
+}
+
+NxObject *nxo_get_slice(NxObject *obj, NxObject *lower, NxObject *upper) {
+    assert(obj != NULL);
+    if (nxo_type(obj)->get_slice_fn == NULL) {
+        PANIC("'%s' object is not sliceable", nxo_type(obj)->name);
+    }
+    NxObject *result = nxo_type(obj)->get_slice_fn(obj, lower, upper);
+    if (result == NULL) {
+        PANIC("get_slice_fn returned NULL");
+    }
+    return result;
+}
+
+NxObject *nxo_iter_next(NxObject *obj, int64_t *position) {
+    assert(obj != NULL);
+    assert(*position >= 0);
+    if (nxo_type(obj)->iter_next_fn == NULL) {
+        PANIC("'%s' object is not iterable", nxo_type(obj)->name);
+    }
+    return nxo_type(obj)->iter_next_fn(obj, position);
+}
+
+uint64_t nxo_hash(NxObject *obj) {
+    assert(obj != NULL);
+    if (nxo_type(obj)->hash_fn == NULL) {
+        PANIC("unhashable type: '%s'", nxo_type(obj)->name);
+    }
+    return nxo_type(obj)->hash_fn(obj);
+}
+
+bool nxo_eq(NxObject *left, NxObject *right) {
+    assert(left != NULL);
+    assert(right != NULL);
+    if (left == right) {
+        return true;
     }
-    obj->type->set_element_fn(obj, index, value);
+    return nxo_type(left)->eq_fn != NULL && nxo_type(left)->eq_fn(left, right);
 }
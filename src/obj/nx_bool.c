@@ -11,28 +11,17 @@
  */
 
 #include "natrix/obj/nx_bool.h"
+#include "natrix/obj/nx_int.h"
 
 //! The `false` object.
 static NxBool false_obj = {
-        .header = {
-                .gc_header = {
-                        .next = NULL,
-                        .trace_fn = gc_trace_nop,
-                },
-                .type = &nx_type_bool,
-        },
+        .header = NX_STATIC_HEADER_INIT(NX_CLASS_BOOL),
         .value = false,
 };
 
 //! The `true` object.
 static NxBool true_obj = {
-        .header = {
-                .gc_header = {
-                        .next = NULL,
-                        .trace_fn = gc_trace_nop,
-                },
-                .type = &nx_type_bool,
-        },
+        .header = NX_STATIC_HEADER_INIT(NX_CLASS_BOOL),
         .value = true,
 };
 
@@ -45,9 +34,71 @@ static NxObject *nx_bool_as_bool(NxObject *self) {
     return self;
 }
 
+//! Implementation of the `hash` method for the `bool` type, consistent with `int` since `True == 1`.
+static uint64_t nx_bool_hash(NxObject *self) {
+    assert(nx_bool_is_instance(self));
+    return nxo_hash(nx_int_create(self == nx_true));
+}
+
+//! Implementation of the `eq` method for the `bool` type, `int` operands are compared with 0 or 1.
+static bool nx_bool_eq(NxObject *self, NxObject *other) {
+    assert(nx_bool_is_instance(self));
+    return nx_int_is_instance(other) && nxo_eq(other, self);
+}
+
+/**
+ * \brief Applies an operator of the `int` type, with `bool` operands converted to the integer 0 or 1.
+ *
+ * The converted operands are immediate, so the conversion does not allocate. Operands of other types are passed
+ * unchanged, so that the operator of `int` does not support them.
+ * \param fn the operator of the `int` type
+ * \param left the left operand
+ * \param right the right operand
+ * \return the result, NULL if the other operand is neither a `bool` nor an `int`
+ */
+static NxObject *as_ints(NxBinaryFn fn, NxObject *left, NxObject *right) {
+    left = nx_bool_is_instance(left) ? nx_int_create(left == nx_true) : left;
+    right = nx_bool_is_instance(right) ? nx_int_create(right == nx_true) : right;
+    return fn(left, right);
+}
+
+//! Implementation of the `add` method for the `bool` type.
+static NxObject *nx_bool_op_add(NxObject *left, NxObject *right) {
+    return as_ints(nx_type_int.add_fn, left, right);
+}
+
+//! Implementation of the `sub` method for the `bool` type.
+static NxObject *nx_bool_op_sub(NxObject *left, NxObject *right) {
+    return as_ints(nx_type_int.sub_fn, left, right);
+}
+
+//! Implementation of the `mul` method for the `bool` type.
+static NxObject *nx_bool_op_mul(NxObject *left, NxObject *right) {
+    return as_ints(nx_type_int.mul_fn, left, right);
+}
+
+//! Implementation of the `div` method for the `bool` type.
+static NxObject *nx_bool_op_div(NxObject *left, NxObject *right) {
+    return as_ints(nx_type_int.div_fn, left, right);
+}
+
+//! Implementation of the `compare` method for the `bool` type.
+static NxObject *nx_bool_op_compare(NxObject *left, NxObject *right) {
+    return as_ints(nx_type_int.compare_fn, left, right);
+}
+
 const NxType nx_type_bool = {
-        NX_TYPE_HEADER_INIT("bool", gc_trace_nop),
+        NX_TYPE_HEADER_INIT(NX_CLASS_BOOL, "bool", NULL),
         .as_bool_fn = nx_bool_as_bool,
         .get_element_fn = NULL,
         .set_element_fn = NULL,
+        .get_slice_fn = NULL,
+        .hash_fn = nx_bool_hash,
+        .eq_fn = nx_bool_eq,
+        .add_fn = nx_bool_op_add,
+        .sub_fn = nx_bool_op_sub,
+        .mul_fn = nx_bool_op_mul,
+        .div_fn = nx_bool_op_div,
+        .compare_fn = nx_bool_op_compare,
+        .iter_next_fn = NULL,
 };
@@ -0,0 +1,329 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file nx_dict.c
+ * \brief Implementation of the `dict` type.
+ */
+
+#include "natrix/obj/nx_dict.h"
+#include <assert.h>
+#include <string.h>
+#include "natrix/obj/nx_bool.h"
+#include "natrix/util/panic.h"
+
+//! Word with the least significant bit of each byte set.
+#define LSBS 0x0101010101010101ULL
+//! Word with the most significant bit of each byte set.
+#define MSBS 0x8080808080808080ULL
+
+/**
+ * \brief Returns the control bytes of a table, which follow the entries.
+ * \param table the table
+ * \return pointer to the `capacity` control bytes
+ */
+static inline uint8_t *get_ctrl(NxDictTable *table) {
+    return (uint8_t *) (table->entries + table->capacity);
+}
+
+/**
+ * \brief Loads the control bytes of a group, the control byte of the i-th slot of the group becomes the i-th byte
+ * of the word counting from the least significant one.
+ * \param ctrl pointer to the control byte of the first slot of the group
+ * \return the control bytes of the group
+ */
+static inline uint64_t load_group(const uint8_t *ctrl) {
+    uint64_t group;
+    memcpy(&group, ctrl, sizeof(group));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    group = __builtin_bswap64(group);
+#endif
+    return group;
+}
+
+/**
+ * \brief Finds the slots of a group which may hold a key with the given h2.
+ *
+ * The result may contain false positives (in a byte above a byte which matches), keys must be compared anyway.
+ * \param group the control bytes of the group
+ * \param h2 the low 7 bits of the hash of the key
+ * \return word with the most significant bit set in the bytes of the candidate slots
+ */
+static inline uint64_t match_h2(uint64_t group, uint8_t h2) {
+    uint64_t x = group ^ (LSBS * h2);
+    return (x - LSBS) & ~x & MSBS;
+}
+
+/**
+ * \brief Finds the empty slots of a group.
+ * \param group the control bytes of the group
+ * \return word with the most significant bit set in the bytes of the empty slots
+ */
+static inline uint64_t match_empty(uint64_t group) {
+    return group & MSBS;
+}
+
+/**
+ * \brief Finds the full slots of a group.
+ * \param group the control bytes of the group
+ * \return word with the most significant bit set in the bytes of the full slots
+ */
+static inline uint64_t match_full(uint64_t group) {
+    return ~group & MSBS;
+}
+
+/**
+ * \brief Returns the index within the group of the first slot of a match.
+ * \param match the result of one of the matching functions, must not be zero
+ * \return the index of the slot corresponding to the lowest byte with the most significant bit set
+ */
+static inline int64_t lowest_slot(uint64_t match) {
+    assert(match != 0);
+    return __builtin_ctzll(match) / 8;
+}
+
+/**
+ * \brief Reports the keys and values of the full slots of the table to the garbage collector.
+ *
+ * Groups are skipped using their control bytes, so empty slots are never read.
+ * \param ptr pointer to the table
+ */
+static void nx_dict_table_gc_trace(void *ptr) {
+    NxDictTable *table = (NxDictTable *) ptr;
+    const uint8_t *ctrl = get_ctrl(table);
+    for (int64_t g = 0; g < table->capacity; g += NX_DICT_GROUP_SIZE) {
+        for (uint64_t full = match_full(load_group(ctrl + g)); full != 0; full &= full - 1) {
+            NxDictEntry *entry = &table->entries[g + lowest_slot(full)];
+            gc_visit(nxo_gc_header(entry->key));
+            gc_visit(nxo_gc_header(entry->value));
+        }
+    }
+}
+
+/**
+ * \brief Defines the class of the tables before main() is entered.
+ */
+__attribute__((constructor))
+static void define_table_class() {
+    gc_define_class(NX_CLASS_DICT_TABLE, nx_dict_table_gc_trace, "dict table");
+}
+
+/**
+ * \brief Allocates a table with all slots empty.
+ *
+ * May trigger garbage collection.
+ * \param capacity number of slots, a power of two and a multiple of `NX_DICT_GROUP_SIZE`
+ * \return the new table
+ */
+static NxDictTable *alloc_table(int64_t capacity) {
+    assert(capacity >= NX_DICT_GROUP_SIZE && (capacity & (capacity - 1)) == 0);
+    size_t bytes = sizeof(NxDictTable) + capacity * (sizeof(NxDictEntry) + 1);
+    NxDictTable *table = (NxDictTable *) gc_alloc(bytes, NX_CLASS_DICT_TABLE);
+    *((int64_t *) &table->capacity) = capacity;
+    memset(table->entries, 0, capacity * sizeof(NxDictEntry));
+    memset(get_ctrl(table), NX_DICT_CTRL_EMPTY, capacity);
+    return table;
+}
+
+/**
+ * \brief Returns the maximum number of entries of a table.
+ * \param capacity the number of slots of the table
+ * \return 7/8 of the capacity, so that every group which is probed has an empty slot with a high probability
+ */
+static inline int64_t max_length(int64_t capacity) {
+    return capacity - capacity / 8;
+}
+
+/**
+ * \brief Finds the slot holding a key.
+ *
+ * May trigger garbage collection (see nxo_eq()).
+ * \param table the table, must be reachable from a rooted dictionary
+ * \param key the key, must be rooted
+ * \param hash the hash of the key
+ * \return the index of the slot, -1 if the table does not contain the key
+ */
+static int64_t find_slot(NxDictTable *table, NxObject *key, uint64_t hash) {
+    const uint8_t *ctrl = get_ctrl(table);
+    uint64_t mask = table->capacity / NX_DICT_GROUP_SIZE - 1;
+    uint64_t pos = (hash >> 7) & mask;
+    for (uint64_t step = 1;; step++) {
+        int64_t first = (int64_t) pos * NX_DICT_GROUP_SIZE;
+        uint64_t group = load_group(ctrl + first);
+        for (uint64_t match = match_h2(group, hash & 0x7F); match != 0; match &= match - 1) {
+            int64_t slot = first + lowest_slot(match);
+            if (ctrl[slot] == (hash & 0x7F) && nxo_eq(key, table->entries[slot].key)) {
+                return slot;
+            }
+        }
+        if (match_empty(group) != 0) {
+            return -1;
+        }
+        pos = (pos + step) & mask;
+    }
+}
+
+/**
+ * \brief Finds the first empty slot in the probe sequence of a hash.
+ * \param table the table, must have an empty slot
+ * \param hash the hash of the key to insert
+ * \return the index of the slot
+ */
+static int64_t find_empty(NxDictTable *table, uint64_t hash) {
+    const uint8_t *ctrl = get_ctrl(table);
+    uint64_t mask = table->capacity / NX_DICT_GROUP_SIZE - 1;
+    uint64_t pos = (hash >> 7) & mask;
+    for (uint64_t step = 1;; step++) {
+        int64_t first = (int64_t) pos * NX_DICT_GROUP_SIZE;
+        uint64_t empty = match_empty(load_group(ctrl + first));
+        if (empty != 0) {
+            return first + lowest_slot(empty);
+        }
+        pos = (pos + step) & mask;
+    }
+}
+
+/**
+ * \brief Moves the entries of the dictionary to a table with twice the capacity.
+ *
+ * May trigger garbage collection. The keys are not compared and their hashes do not allocate, since they were
+ * computed (and the strings flattened) when the keys were inserted.
+ * \param d the dictionary, must be rooted
+ */
+static void grow(NxDict *d) {
+    NxDictTable *table = alloc_table(2 * d->table->capacity);
+    NxDictTable *old = d->table;
+    const uint8_t *old_ctrl = get_ctrl(old);
+    uint8_t *ctrl = get_ctrl(table);
+    // the new table is the last allocated object, so the entries are copied without the write barrier
+    for (int64_t g = 0; g < old->capacity; g += NX_DICT_GROUP_SIZE) {
+        for (uint64_t full = match_full(load_group(old_ctrl + g)); full != 0; full &= full - 1) {
+            int64_t old_slot = g + lowest_slot(full);
+            uint64_t hash = nxo_hash(old->entries[old_slot].key);
+            int64_t slot = find_empty(table, hash);
+            table->entries[slot] = old->entries[old_slot];
+            ctrl[slot] = old_ctrl[old_slot];
+        }
+    }
+    d->table = table;
+    gc_write_barrier(&d->header.gc_header, &table->gc_header);
+    d->growth_left = max_length(table->capacity) - d->length;
+}
+
+NxObject *nx_dict_create(int64_t expected_length) {
+    assert(expected_length >= 0);
+    int64_t capacity = NX_DICT_GROUP_SIZE;
+    while (max_length(capacity) < expected_length) {
+        capacity *= 2;
+    }
+    NxDictTable *table = alloc_table(capacity);
+    gc_root(&table->gc_header);
+    NxDict *dict = nxo_alloc(sizeof(NxDict), &nx_type_dict);
+    dict->length = 0;
+    dict->growth_left = max_length(capacity);
+    dict->table = table;
+    gc_unroot(&table->gc_header);
+    return &dict->header;
+}
+
+NxObject *nx_dict_create_from(NxObject *const *items, int64_t count) {
+    assert(count >= 0);
+    NxObject *dict = nx_dict_create(count);
+    nxo_root(dict);
+    for (int64_t i = 0; i < count; i++) {
+        nx_dict_set(dict, items[2 * i], items[2 * i + 1]);
+    }
+    nxo_unroot(dict);
+    return dict;
+}
+
+NxObject *nx_dict_get(NxObject *dict, NxObject *key) {
+    assert(nx_dict_is_instance(dict));
+    assert(key != NULL);
+    NxDict *d = (NxDict *) dict;
+    int64_t slot = find_slot(d->table, key, nxo_hash(key));
+    return slot >= 0 ? d->table->entries[slot].value : NULL;
+}
+
+void nx_dict_set(NxObject *dict, NxObject *key, NxObject *value) {
+    assert(nx_dict_is_instance(dict));
+    assert(key != NULL);
+    assert(value != NULL);
+    NxDict *d = (NxDict *) dict;
+    uint64_t hash = nxo_hash(key);
+    int64_t slot = find_slot(d->table, key, hash);
+    if (slot < 0) {
+        if (d->growth_left == 0) {
+            grow(d);
+        }
+        slot = find_empty(d->table, hash);
+        d->table->entries[slot].key = key;
+        gc_write_barrier(&d->table->gc_header, nxo_gc_header(key));
+        get_ctrl(d->table)[slot] = hash & 0x7F;
+        d->length++;
+        d->growth_left--;
+    }
+    d->table->entries[slot].value = value;
+    gc_write_barrier(&d->table->gc_header, nxo_gc_header(value));
+}
+
+/**
+ * \brief Reports the table of the dictionary to the garbage collector.
+ * \param obj the dictionary to trace
+ */
+static void nx_dict_gc_trace(void *obj) {
+    assert(nx_dict_is_instance(obj));
+    gc_visit(&((NxDict *) obj)->table->gc_header);
+}
+
+//! Implementation of the `as_bool` method for the `dict` type.
+static NxObject *nx_dict_as_bool(NxObject *self) {
+    assert(nx_dict_is_instance(self));
+    return nx_bool_wrap(nx_dict_get_length(self) > 0);
+}
+
+//! Implementation of the `get_element` method for the `dict` type.
+static NxObject *nx_dict_get_element(NxObject *self, NxObject *key) {
+    assert(nx_dict_is_instance(self));
+    nxo_root(self);
+    nxo_root(key);
+    NxObject *value = nx_dict_get(self, key);
+    nxo_unroot(key);
+    nxo_unroot(self);
+    if (value == NULL) {
+        PANIC("Key not found");
+    }
+    return value;
+}
+
+//! Implementation of the `set_element` method for the `dict` type.
+static void nx_dict_set_element(NxObject *self, NxObject *key, NxObject *value) {
+    assert(nx_dict_is_instance(self));
+    nxo_root(self);
+    nxo_root(key);
+    nxo_root(value);
+    nx_dict_set(self, key, value);
+    nxo_unroot(value);
+    nxo_unroot(key);
+    nxo_unroot(self);
+}
+
+const NxType nx_type_dict = {
+        NX_TYPE_HEADER_INIT(NX_CLASS_DICT, "dict", nx_dict_gc_trace),
+        .as_bool_fn = nx_dict_as_bool,
+        .get_element_fn = nx_dict_get_element,
+        .set_element_fn = nx_dict_set_element,
+        .get_slice_fn = NULL,
+        .hash_fn = NULL,
+        .eq_fn = NULL,
+        .add_fn = NULL,
+        .sub_fn = NULL,
+        .mul_fn = NULL,
+        .div_fn = NULL,
+        .compare_fn = NULL,
+        .iter_next_fn = NULL,
+};
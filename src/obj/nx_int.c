@@ -12,48 +12,350 @@
 
 #include "natrix/obj/nx_int.h"
 #include "natrix/obj/nx_bool.h"
+#include "natrix/util/bignum.h"
+#include "natrix/util/panic.h"
 
-//! The minimum cached integer value.
-#define CACHE_MIN (-1)
-//! The maximum cached integer value.
-#define CACHE_MAX 255
-//! The number of cached integers.
-#define CACHE_SIZE (CACHE_MAX - CACHE_MIN + 1)
-//! Check if the integer is cached.
-#define IS_CACHED(x) ((x) >= CACHE_MIN && (x) <= CACHE_MAX)
-//! Get the index of the integer in the cache, provided it is cached (use IS_CACHED to check).
-#define CACHE_INDEX(x) ((x) - CACHE_MIN)
-//! The cached integers, initialized in `init_int_cache`.
-static NxInt cached_ints[CACHE_SIZE];
-
-//! Initializes the cached integers. Executed before `main`.
-__attribute__((constructor)) static void init_int_cache() {
-    for (int64_t i = CACHE_MIN; i <= CACHE_MAX; i++) {
-        cached_ints[CACHE_INDEX(i)].header.gc_header.next = NULL;
-        cached_ints[CACHE_INDEX(i)].header.gc_header.trace_fn = gc_trace_nop;
-        cached_ints[CACHE_INDEX(i)].header.type = &nx_type_int;
-        *((int64_t *) &cached_ints[CACHE_INDEX(i)].value) = i;
-    }
-}
-
-NxObject *nx_int_create(int64_t value) {
-    if (IS_CACHED(value)) {
-        return (NxObject *) &cached_ints[CACHE_INDEX(value)];
-    }
-    NxInt *obj = nxo_alloc(sizeof(NxInt), &nx_type_int);
-    *((int64_t *) &obj->value) = value;
+/**
+ * \brief Magnitude and sign of an `int` object in the representation used by `bignum.h`.
+ *
+ * Must not be copied, `limbs` may point to `storage`.
+ */
+typedef struct {
+    const uint64_t *limbs;          //!< The limbs of the magnitude
+    size_t length;                  //!< Number of limbs, normalized
+    bool negative;                  //!< Whether the value is negative
+    uint64_t storage;               //!< The only limb of the magnitude of an immediate value
+} Magnitude;
+
+/**
+ * \brief Returns the limbs of the magnitude of a heap-allocated `int` object.
+ * \param obj the heap-allocated `int` object
+ * \return pointer to the limbs, which follow the structure
+ */
+static inline uint64_t *get_limbs(NxInt *obj) {
+    return (uint64_t *) (obj + 1);
+}
+
+/**
+ * \brief Computes the magnitude of an `int` object.
+ *
+ * The limbs of heap-allocated objects are not copied, the object must stay alive while the magnitude is used.
+ * \param object the `int` object
+ * \param m receives the magnitude
+ */
+static void get_magnitude(NxObject *object, Magnitude *m) {
+    assert(nx_int_is_instance(object));
+    if (nxo_is_immediate_int(object)) {
+        int64_t value = nx_int_get_value(object);
+        m->storage = value < 0 ? -(uint64_t) value : (uint64_t) value;
+        m->limbs = &m->storage;
+        m->length = value != 0;
+        m->negative = value < 0;
+    } else {
+        NxInt *obj = (NxInt *) object;
+        m->limbs = get_limbs(obj);
+        m->length = obj->size < 0 ? -obj->size : obj->size;
+        m->negative = obj->size < 0;
+    }
+}
+
+_Thread_local Arena *nx_int_temporaries;
+
+/**
+ * \brief Allocates a heap `int` object with room for the given number of limbs.
+ *
+ * May trigger garbage collection. The object is allocated in `nx_int_temporaries` instead if it is set.
+ * The value must be completed by `finish_int()`.
+ * \param capacity the number of limbs
+ * \return the new object
+ */
+static NxInt *alloc_int(size_t capacity) {
+    size_t size = sizeof(NxInt) + capacity * sizeof(uint64_t);
+    NxInt *obj;
+    if (nx_int_temporaries) {
+        obj = arena_alloc(nx_int_temporaries, size);
+        obj->header = (NxObject) NX_STATIC_HEADER_INIT(NX_CLASS_INT);
+    } else {
+        obj = nxo_alloc(size, &nx_type_int);
+    }
+    *((int64_t *) &obj->size) = 0;
+    return obj;
+}
+
+/**
+ * \brief Completes an `int` object allocated by `alloc_int()` once its limbs have been computed.
+ * \param obj the object
+ * \param length the number of limbs computed, not necessarily normalized
+ * \param negative whether the value is negative
+ * \return the object, or an immediate value if the value fits into one
+ */
+static NxObject *finish_int(NxInt *obj, size_t length, bool negative) {
+    const uint64_t *limbs = get_limbs(obj);
+    length = bn_normalize(limbs, length);
+    if (length == 0) {
+        return nx_int_create(0);
+    }
+    if (length == 1 && limbs[0] <= (uint64_t) NX_INT_IMMEDIATE_MAX + negative) {
+        return nx_int_create(negative ? -(int64_t) limbs[0] : (int64_t) limbs[0]);
+    }
+    *((int64_t *) &obj->size) = negative ? -(int64_t) length : (int64_t) length;
     return &obj->header;
 }
 
+NxObject *nx_int_create_boxed(int64_t value) {
+    NxInt *obj = alloc_int(1);
+    get_limbs(obj)[0] = value < 0 ? -(uint64_t) value : (uint64_t) value;
+    *((int64_t *) &obj->size) = value < 0 ? -1 : value > 0;
+    return &obj->header;
+}
+
+NxObject *nx_int_from_str(const char *str, size_t length) {
+    if (length <= 18) {
+        // fits into int64_t
+        int64_t value = 0;
+        for (size_t i = 0; i < length; i++) {
+            assert(str[i] >= '0' && str[i] <= '9');
+            value = value * 10 + (str[i] - '0');
+        }
+        return nx_int_create(value);
+    }
+    NxInt *obj = alloc_int(length / 19 + 1);
+    return finish_int(obj, bn_from_decimal(get_limbs(obj), str, length), false);
+}
+
+bool nx_int_fits_int64_boxed(NxObject *object) {
+    NxInt *obj = (NxInt *) object;
+    assert(nx_int_is_instance(object) && !nxo_is_immediate_int(object));
+    if (obj->size == 0) {
+        return true;
+    }
+    if (obj->size == 1) {
+        return get_limbs(obj)[0] <= INT64_MAX;
+    }
+    return obj->size == -1 && get_limbs(obj)[0] <= (uint64_t) INT64_MAX + 1;
+}
+
+int64_t nx_int_get_value_boxed(NxObject *object) {
+    NxInt *obj = (NxInt *) object;
+    assert(nx_int_fits_int64_boxed(object));
+    if (obj->size == 0) {
+        return 0;
+    }
+    uint64_t limb = get_limbs(obj)[0];
+    return obj->size < 0 ? (int64_t) -limb : (int64_t) limb;
+}
+
+int nx_int_sign(NxObject *object) {
+    assert(nx_int_is_instance(object));
+    if (nxo_is_immediate_int(object)) {
+        int64_t value = nx_int_get_value(object);
+        return (value > 0) - (value < 0);
+    }
+    int64_t size = ((NxInt *) object)->size;
+    return (size > 0) - (size < 0);
+}
+
+/**
+ * \brief Adds or subtracts two `int` objects of arbitrary size.
+ * \param left left operand
+ * \param right right operand
+ * \param subtract whether to subtract the right operand instead of adding it
+ * \return the result
+ */
+static NxObject *add_big(NxObject *left, NxObject *right, bool subtract) {
+    Magnitude a, b;
+    get_magnitude(left, &a);
+    get_magnitude(right, &b);
+    b.negative ^= subtract;
+    Magnitude *x = &a, *y = &b;
+    if (x->length < y->length) {
+        x = &b;
+        y = &a;
+    }
+    nxo_root(left);
+    nxo_root(right);
+    NxInt *result = alloc_int(x->length + 1);
+    nxo_unroot(right);
+    nxo_unroot(left);
+    uint64_t *limbs = get_limbs(result);
+    if (x->negative == y->negative) {
+        limbs[x->length] = bn_add(limbs, x->limbs, x->length, y->limbs, y->length);
+        return finish_int(result, x->length + 1, x->negative);
+    }
+    int cmp = bn_compare(x->limbs, x->length, y->limbs, y->length);
+    if (cmp < 0) {
+        Magnitude *t = x;
+        x = y;
+        y = t;
+    }
+    bn_sub(limbs, x->limbs, x->length, y->limbs, y->length);
+    return finish_int(result, x->length, x->negative);
+}
+
+NxObject *nx_int_add_slow(NxObject *left, NxObject *right) {
+    int64_t result;
+    if (nx_int_fits_int64(left) && nx_int_fits_int64(right)
+            && !__builtin_add_overflow(nx_int_get_value(left), nx_int_get_value(right), &result)) {
+        return nx_int_create(result);
+    }
+    return add_big(left, right, false);
+}
+
+NxObject *nx_int_sub_slow(NxObject *left, NxObject *right) {
+    int64_t result;
+    if (nx_int_fits_int64(left) && nx_int_fits_int64(right)
+            && !__builtin_sub_overflow(nx_int_get_value(left), nx_int_get_value(right), &result)) {
+        return nx_int_create(result);
+    }
+    return add_big(left, right, true);
+}
+
+NxObject *nx_int_mul_slow(NxObject *left, NxObject *right) {
+    int64_t value;
+    if (nx_int_fits_int64(left) && nx_int_fits_int64(right)
+            && !__builtin_mul_overflow(nx_int_get_value(left), nx_int_get_value(right), &value)) {
+        return nx_int_create(value);
+    }
+    Magnitude a, b;
+    get_magnitude(left, &a);
+    get_magnitude(right, &b);
+    nxo_root(left);
+    nxo_root(right);
+    NxInt *result = alloc_int(a.length + b.length);
+    nxo_unroot(right);
+    nxo_unroot(left);
+    bn_mul(get_limbs(result), a.limbs, a.length, b.limbs, b.length);
+    return finish_int(result, a.length + b.length, a.negative != b.negative);
+}
+
+NxObject *nx_int_div(NxObject *left, NxObject *right) {
+    if (nx_int_sign(right) == 0) {
+        PANIC("Division by zero");
+    }
+    if (nx_int_fits_int64(left) && nx_int_fits_int64(right)) {
+        int64_t l = nx_int_get_value(left);
+        int64_t r = nx_int_get_value(right);
+        if (l != INT64_MIN || r != -1) {
+            return nx_int_create(l / r);
+        }
+    }
+    Magnitude a, b;
+    get_magnitude(left, &a);
+    get_magnitude(right, &b);
+    if (bn_compare(a.limbs, a.length, b.limbs, b.length) < 0) {
+        return nx_int_create(0);
+    }
+    nxo_root(left);
+    nxo_root(right);
+    NxInt *result = alloc_int(a.length - b.length + 1);
+    nxo_unroot(right);
+    nxo_unroot(left);
+    bn_divmod(get_limbs(result), NULL, a.limbs, a.length, b.limbs, b.length);
+    return finish_int(result, a.length - b.length + 1, a.negative != b.negative);
+}
+
+int nx_int_compare_slow(NxObject *left, NxObject *right) {
+    if (nx_int_fits_int64(left) && nx_int_fits_int64(right)) {
+        int64_t l = nx_int_get_value(left);
+        int64_t r = nx_int_get_value(right);
+        return (l > r) - (l < r);
+    }
+    int ls = nx_int_sign(left);
+    int rs = nx_int_sign(right);
+    if (ls != rs) {
+        return ls < rs ? -1 : 1;
+    }
+    Magnitude a, b;
+    get_magnitude(left, &a);
+    get_magnitude(right, &b);
+    int cmp = bn_compare(a.limbs, a.length, b.limbs, b.length);
+    return ls < 0 ? -cmp : cmp;
+}
+
+void nx_int_append_to(StringBuilder *sb, NxObject *object) {
+    if (nx_int_fits_int64(object)) {
+        sb_append_formatted(sb, "%ld", nx_int_get_value(object));
+        return;
+    }
+    Magnitude m;
+    get_magnitude(object, &m);
+    if (m.negative) {
+        sb_append_char(sb, '-');
+    }
+    bn_append_decimal(sb, m.limbs, m.length);
+}
+
 //! Implementation of the `as_bool` method for the `int` type.
 static NxObject *nx_int_as_bool(NxObject *self) {
     assert(nx_int_is_instance(self));
-    return nx_bool_wrap(((NxInt *) self)->value != 0);
+    return nx_bool_wrap(nx_int_sign(self) != 0);
+}
+
+//! Implementation of the `hash` method for the `int` type.
+static uint64_t nx_int_hash(NxObject *self) {
+    Magnitude m;
+    get_magnitude(self, &m);
+    // the magnitude does not depend on the representation, so boxed small values hash like immediate ones
+    uint64_t hash = m.negative;
+    for (size_t i = 0; i < m.length; i++) {
+        hash = (hash ^ m.limbs[i]) * 0x9e3779b97f4a7c15ULL;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+//! Implementation of the `eq` method for the `int` type, `bool` operands behave as 0 or 1.
+static bool nx_int_eq(NxObject *self, NxObject *other) {
+    assert(nx_int_is_instance(self));
+    if (nx_bool_is_instance(other)) {
+        other = nx_int_create(other == nx_true);
+    } else if (!nx_int_is_instance(other)) {
+        return false;
+    }
+    return nx_int_compare(self, other) == 0;
+}
+
+//! Implementation of the `add` method for the `int` type.
+static NxObject *nx_int_op_add(NxObject *left, NxObject *right) {
+    return nx_int_is_instance(left) && nx_int_is_instance(right) ? nx_int_add(left, right) : NULL;
+}
+
+//! Implementation of the `sub` method for the `int` type.
+static NxObject *nx_int_op_sub(NxObject *left, NxObject *right) {
+    return nx_int_is_instance(left) && nx_int_is_instance(right) ? nx_int_sub(left, right) : NULL;
+}
+
+//! Implementation of the `mul` method for the `int` type.
+static NxObject *nx_int_op_mul(NxObject *left, NxObject *right) {
+    return nx_int_is_instance(left) && nx_int_is_instance(right) ? nx_int_mul(left, right) : NULL;
+}
+
+//! Implementation of the `div` method for the `int` type.
+static NxObject *nx_int_op_div(NxObject *left, NxObject *right) {
+    return nx_int_is_instance(left) && nx_int_is_instance(right) ? nx_int_div(left, right) : NULL;
+}
+
+//! Implementation of the `compare` method for the `int` type.
+static NxObject *nx_int_op_compare(NxObject *left, NxObject *right) {
+    if (!nx_int_is_instance(left) || !nx_int_is_instance(right)) {
+        return NULL;
+    }
+    int cmp = nx_int_compare(left, right);
+    return nx_int_create((cmp > 0) - (cmp < 0));
 }
 
 const NxType nx_type_int = {
-        NX_TYPE_HEADER_INIT("int", gc_trace_nop),
+        NX_TYPE_HEADER_INIT(NX_CLASS_INT, "int", NULL),
         .as_bool_fn = nx_int_as_bool,
         .get_element_fn = NULL,
         .set_element_fn = NULL,
+        .get_slice_fn = NULL,
+        .hash_fn = nx_int_hash,
+        .eq_fn = nx_int_eq,
+        .add_fn = nx_int_op_add,
+        .sub_fn = nx_int_op_sub,
+        .mul_fn = nx_int_op_mul,
+        .div_fn = nx_int_op_div,
+        .compare_fn = nx_int_op_compare,
+        .iter_next_fn = NULL,
 };
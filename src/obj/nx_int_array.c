@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file nx_int_array.c
+ * \brief Implementation of NxIntArray.
+ */
+
+#include "natrix/obj/nx_int_array.h"
+#include <assert.h>
+#include <string.h>
+
+/**
+ * \brief Defines the class of integer arrays before main() is entered.
+ */
+__attribute__((constructor))
+static void define_int_array_class() {
+    gc_define_class(NX_CLASS_INT_ARRAY, NULL, "int array");
+}
+
+/**
+ * \brief Allocates but does not initialize an array of integers.
+ *
+ * May trigger garbage collection.
+ * \param size size of the array
+ * \return pointer to the allocated array
+ */
+static NxIntArray *nx_int_array_alloc(int64_t size) {
+    assert(size >= 0);
+    size_t bytes = sizeof(NxIntArray) + size * sizeof(int64_t);
+    NxIntArray *array = (NxIntArray *) gc_alloc(bytes, NX_CLASS_INT_ARRAY);
+    *((int64_t *) &array->size) = size;
+    return array;
+}
+
+NxIntArray *nx_int_array_create(int64_t size) {
+    assert(size >= 0);
+    NxIntArray *array = nx_int_array_alloc(size);
+    memset(array->data, 0, size * sizeof(int64_t));
+    return array;
+}
+
+NxIntArray *nx_int_array_copy(NxIntArray *source, int64_t new_size) {
+    assert(new_size >= 0);
+    NxIntArray *array = nx_int_array_alloc(new_size);
+    int64_t copy_size = source->size < new_size ? source->size : new_size;
+    memcpy(array->data, source->data, copy_size * sizeof(int64_t));
+    memset(array->data + copy_size, 0, (new_size - copy_size) * sizeof(int64_t));
+    return array;
+}
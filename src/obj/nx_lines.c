@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file nx_lines.c
+ * \brief Implementation of the `lines` type.
+ */
+
+#include "natrix/obj/nx_lines.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include "natrix/obj/nx_bool.h"
+#include "natrix/obj/nx_str.h"
+#include "natrix/util/panic.h"
+
+/**
+ * \brief GC trace function for `lines` objects.
+ * \param ptr pointer to the line reader
+ */
+static void nx_lines_gc_trace(void *ptr) {
+    NxLines *lines = (NxLines *) ptr;
+    if (lines->block != NULL) {
+        gc_visit(&lines->block->gc_header);
+    }
+}
+
+NxObject *nx_lines_create(int fd, bool owns_fd) {
+    assert(fd >= 0);
+    NxLines *lines = nxo_alloc(sizeof(NxLines), &nx_type_lines);
+    lines->fd = fd;
+    lines->owns_fd = owns_fd;
+    lines->block = NULL;
+    lines->start = 0;
+    lines->end = 0;
+    return (NxObject *) lines;
+}
+
+/**
+ * \brief Reads more bytes of the file after the unread part of the current block.
+ *
+ * The bytes are appended to the current block while it has room, the lines already returned are views of its
+ * beginning, which does not change. A full block is replaced by a new one, which starts with the unread bytes.
+ * May trigger garbage collection.
+ * \param lines the line reader, must be rooted
+ * \return false at the end of the file
+ */
+static bool read_block(NxLines *lines) {
+    assert(lines->fd >= 0);
+    if (lines->block == NULL || lines->end == nx_str_get_length(lines->block)) {
+        int64_t pending = lines->end - lines->start;
+        int64_t capacity = pending >= NX_LINES_BLOCK_SIZE / 2 ? 2 * pending : NX_LINES_BLOCK_SIZE;
+        char *bytes;
+        NxObject *block = nx_str_create_buffer(capacity, &bytes);
+        if (pending > 0) {
+            memcpy(bytes, nx_str_get_data(lines->block) + lines->start, pending);
+        }
+        lines->block = block;
+        gc_write_barrier(&lines->header.gc_header, &block->gc_header);
+        lines->start = 0;
+        lines->end = pending;
+    }
+    // the bytes after `end` are not part of any string yet
+    char *free_space = (char *) nx_str_get_data(lines->block) + lines->end;
+    ssize_t count;
+    do {
+        count = read(lines->fd, free_space, nx_str_get_length(lines->block) - lines->end);
+    } while (count < 0 && errno == EINTR);
+    if (count < 0) {
+        PANIC("Cannot read lines: %s", strerror(errno));
+    }
+    if (count == 0) {
+        if (lines->owns_fd) {
+            close(lines->fd);
+        }
+        lines->fd = -1;
+        return false;
+    }
+    lines->end += count;
+    return true;
+}
+
+NxObject *nx_lines_next(NxObject *self) {
+    assert(nx_lines_is_instance(self));
+    NxLines *lines = (NxLines *) self;
+    // number of unread bytes already searched for a newline, they stay unread when a new block is started
+    int64_t searched = 0;
+    while (1) {
+        if (lines->block != NULL) {
+            const char *data = nx_str_get_data(lines->block);
+            const char *newline = memchr(data + lines->start + searched, '\n', lines->end - lines->start - searched);
+            if (newline != NULL) {
+                int64_t start = lines->start;
+                lines->start = newline - data + 1;
+                return nx_str_view(lines->block, start, newline - data - start);
+            }
+            searched = lines->end - lines->start;
+        }
+        if (lines->fd < 0 || !read_block(lines)) {
+            break;
+        }
+    }
+    if (lines->start == lines->end) {
+        return NULL;
+    }
+    // the last line is not terminated by a newline
+    int64_t start = lines->start;
+    lines->start = lines->end;
+    return nx_str_view(lines->block, start, lines->end - start);
+}
+
+//! Implementation of the `as_bool` method for the `lines` type, a reader is true even if exhausted, like a file.
+static NxObject *nx_lines_as_bool(NxObject *self) {
+    assert(nx_lines_is_instance(self));
+    return nx_true;
+}
+
+//! Implementation of the `iter_next` method for the `lines` type, the position counts the lines read by the loop.
+static NxObject *nx_lines_iter_next(NxObject *self, int64_t *position) {
+    NxObject *line = nx_lines_next(self);
+    if (line != NULL) {
+        (*position)++;
+    }
+    return line;
+}
+
+const NxType nx_type_lines = {
+        NX_TYPE_HEADER_INIT(NX_CLASS_LINES, "lines", nx_lines_gc_trace),
+        .as_bool_fn = nx_lines_as_bool,
+        .get_element_fn = NULL,
+        .set_element_fn = NULL,
+        .get_slice_fn = NULL,
+        .hash_fn = NULL,
+        .eq_fn = NULL,
+        .add_fn = NULL,
+        .sub_fn = NULL,
+        .mul_fn = NULL,
+        .div_fn = NULL,
+        .compare_fn = NULL,
+        .iter_next_fn = nx_lines_iter_next,
+};
@@ -12,10 +12,15 @@
 
 #include "natrix/obj/nx_list.h"
 #include <assert.h>
+#include <string.h>
 #include "natrix/obj/nx_bool.h"
+#include "natrix/obj/nx_int.h"
+#include "natrix/util/panic.h"
 
 /**
  * \brief Reports all references contained in the list to the garbage collector.
+ *
+ * Both kinds of storage start with the GC header, the integer array has no references of its own.
  * \param obj the list to trace
  */
 static void nx_list_gc_trace(void *obj) {
@@ -25,24 +30,198 @@ static void nx_list_gc_trace(void *obj) {
 
 NxObject *nx_list_create(int64_t initial_capacity) {
     assert(initial_capacity > 0);
-    NxObjectArray *items = nx_object_array_create(initial_capacity);
-    gc_root(&items->gc_header);
+    NxIntArray *ints = nx_int_array_create(initial_capacity);
+    gc_root(&ints->gc_header);
     NxList *list = nxo_alloc(sizeof(NxList), &nx_type_list);
     list->length = 0;
+    list->strategy = NX_LIST_INTS;
+    list->ints = ints;
+    gc_unroot(&ints->gc_header);
+    return &list->header;
+}
+
+/**
+ * \brief Creates a list using the generic strategy with the given storage.
+ *
+ * May trigger garbage collection.
+ * \param items the storage of the items, its first `length` items must be set
+ * \param length the number of items of the list
+ * \return the new list object, using the `NX_LIST_OBJECTS` strategy
+ */
+static NxObject *wrap_objects(NxObjectArray *items, int64_t length) {
+    gc_root(&items->gc_header);
+    NxList *list = nxo_alloc(sizeof(NxList), &nx_type_list);
+    list->length = length;
+    list->strategy = NX_LIST_OBJECTS;
     list->items = items;
     gc_unroot(&items->gc_header);
     return &list->header;
 }
 
+NxObject *nx_list_create_from(NxObject *const *items, int64_t count) {
+    assert(count >= 0);
+    bool all_ints = true;
+    for (int64_t i = 0; i < count && all_ints; i++) {
+        all_ints = items[i] != NULL && nxo_is_immediate_int(items[i]);
+    }
+    if (all_ints) {
+        NxObject *list = nx_list_create(count > 0 ? count : 1);
+        NxList *l = (NxList *) list;
+        for (int64_t i = 0; i < count; i++) {
+            l->ints->data[i] = nx_int_get_value(items[i]);
+        }
+        l->length = count;
+        return list;
+    }
+    // the array is the most recent allocation, storing to it does not need the write barrier
+    NxObjectArray *array = nx_object_array_create(count);
+    memcpy(array->data, items, count * sizeof(NxObject *));
+    return wrap_objects(array, count);
+}
+
+/**
+ * \brief Switches the list to the generic strategy, boxing the integers.
+ *
+ * May trigger garbage collection.
+ * \param l the list using the `NX_LIST_INTS` strategy, must be rooted
+ * \param capacity capacity of the new storage, at least the length of the list
+ */
+static void use_objects(NxList *l, int64_t capacity) {
+    assert(l->strategy == NX_LIST_INTS && capacity >= l->length);
+    NxObjectArray *items = nx_object_array_create(capacity);
+    for (int64_t i = 0; i < l->length; i++) {
+        // the values are within the range of immediate integers, boxing does not allocate
+        items->data[i] = nx_int_create(l->ints->data[i]);
+    }
+    l->strategy = NX_LIST_OBJECTS;
+    l->items = items;
+    gc_write_barrier(&l->header.gc_header, &items->gc_header);
+}
+
+/**
+ * \brief Computes the capacity of the storage needed to hold the given number of items.
+ *
+ * The capacity grows geometrically, so that appending items one at a time takes amortized constant time.
+ * Panics if the storage would be too large.
+ * \param l the list
+ * \param needed the number of items the storage must hold
+ * \return the current size of the storage if it suffices, the new capacity otherwise
+ */
+static int64_t grown_capacity(const NxList *l, int64_t needed) {
+    int64_t size = l->strategy == NX_LIST_INTS ? l->ints->size : l->items->size;
+    if (needed <= size) {
+        return size;
+    }
+    int64_t max_size = INT64_MAX / (int64_t) sizeof(NxObject *);
+    if (needed > max_size) {
+        PANIC("List is too long");
+    }
+    int64_t doubled = size < (max_size - 1) / 2 ? size * 2 + 1 : max_size;
+    return doubled > needed ? doubled : needed;
+}
+
+/**
+ * \brief Replaces the storage of the list with a larger one if it cannot hold the given number of items.
+ *
+ * May trigger garbage collection.
+ * \param l the list, must be rooted
+ * \param needed the number of items the storage must hold
+ */
+static void ensure_capacity(NxList *l, int64_t needed) {
+    int64_t capacity = grown_capacity(l, needed);
+    if (l->strategy == NX_LIST_INTS) {
+        if (capacity > l->ints->size) {
+            l->ints = nx_int_array_copy(l->ints, capacity);
+            gc_write_barrier(&l->header.gc_header, &l->ints->gc_header);
+        }
+    } else if (capacity > l->items->size) {
+        l->items = nx_object_array_copy(l->items, capacity);
+        gc_write_barrier(&l->header.gc_header, &l->items->gc_header);
+    }
+}
+
+/**
+ * \brief Returns an item of the list, see `nx_list_get_item()`.
+ * \param l the list
+ * \param i the index of the item, must be within the bounds of the list
+ * \return the item
+ */
+static inline NxObject *get_item(NxList *l, int64_t i) {
+    return nx_list_get_item(&l->header, i);
+}
+
 void nx_list_append(NxObject *list, NxObject *item) {
     assert(nx_list_is_instance(list));
     NxList *l = (NxList *) list;
-    if (l->length == l->items->size) {
-        // todo generic ensure_capacity, check overflow
-        int64_t new_capacity = l->items->size * 2 + 1;
-        l->items = nx_object_array_copy(l->items, new_capacity);
+    if (l->strategy == NX_LIST_INTS) {
+        if (item != NULL && nxo_is_immediate_int(item)) {
+            ensure_capacity(l, l->length + 1);
+            l->ints->data[l->length++] = nx_int_get_value(item);
+            return;
+        }
+        use_objects(l, grown_capacity(l, l->length + 1));
     }
+    ensure_capacity(l, l->length + 1);
     l->items->data[l->length++] = item;
+    gc_write_barrier(&l->items->gc_header, nxo_gc_header(item));
+}
+
+void nx_list_extend(NxObject *list, NxObject *const *items, int64_t count) {
+    assert(nx_list_is_instance(list) && count >= 0);
+    NxList *l = (NxList *) list;
+    if (count > INT64_MAX - l->length) {
+        PANIC("List is too long");
+    }
+    if (l->strategy == NX_LIST_INTS) {
+        bool all_ints = true;
+        for (int64_t i = 0; i < count && all_ints; i++) {
+            all_ints = items[i] != NULL && nxo_is_immediate_int(items[i]);
+        }
+        if (all_ints) {
+            ensure_capacity(l, l->length + count);
+            for (int64_t i = 0; i < count; i++) {
+                l->ints->data[l->length + i] = nx_int_get_value(items[i]);
+            }
+            l->length += count;
+            return;
+        }
+        use_objects(l, grown_capacity(l, l->length + count));
+    } else {
+        ensure_capacity(l, l->length + count);
+    }
+    memcpy(l->items->data + l->length, items, count * sizeof(NxObject *));
+    l->length += count;
+    for (int64_t i = 0; i < count; i++) {
+        gc_write_barrier(&l->items->gc_header, nxo_gc_header(items[i]));
+    }
+}
+
+void nx_list_extend_list(NxObject *list, NxObject *other) {
+    assert(nx_list_is_instance(list) && nx_list_is_instance(other));
+    NxList *l = (NxList *) list;
+    NxList *o = (NxList *) other;
+    // captured up front, `other` may be `list` itself
+    int64_t count = o->length;
+    if (count > INT64_MAX - l->length) {
+        PANIC("List is too long");
+    }
+    if (l->strategy == NX_LIST_INTS && o->strategy == NX_LIST_INTS) {
+        ensure_capacity(l, l->length + count);
+        memmove(l->ints->data + l->length, o->ints->data, count * sizeof(int64_t));
+        l->length += count;
+        return;
+    }
+    if (l->strategy == NX_LIST_INTS) {
+        use_objects(l, grown_capacity(l, l->length + count));
+    } else {
+        ensure_capacity(l, l->length + count);
+    }
+    for (int64_t i = 0; i < count; i++) {
+        NxObject *item = get_item(o, i);
+        l->items->data[l->length + i] = item;
+        gc_write_barrier(&l->items->gc_header, nxo_gc_header(item));
+    }
+    l->length += count;
 }
 
 //! Implementation of the `as_bool` method for the `list` type.
@@ -55,8 +234,37 @@ static NxObject *nx_list_as_bool(NxObject *self) {
 static NxObject *nx_list_get_element(NxObject *self, NxObject *index) {
     assert(nx_list_is_instance(self));
     NxList *l = (NxList *) self;
-    int64_t i = nxo_check_index(index, l->length);
-    return l->items->data[i];
+    return get_item(l, nxo_check_index(index, l->length));
+}
+
+//! Implementation of the `iter_next` method for the `list` type, items appended during the iteration are visited too.
+static NxObject *nx_list_iter_next(NxObject *self, int64_t *position) {
+    assert(nx_list_is_instance(self));
+    NxList *l = (NxList *) self;
+    if (*position >= l->length) {
+        return NULL;
+    }
+    return get_item(l, (*position)++);
+}
+
+//! Implementation of the `get_slice` method for the `list` type.
+static NxObject *nx_list_get_slice(NxObject *self, NxObject *lower, NxObject *upper) {
+    assert(nx_list_is_instance(self));
+    int64_t start, end;
+    nxo_check_slice(lower, upper, ((NxList *) self)->length, &start, &end);
+    NxList *l = (NxList *) self;
+    if (l->strategy == NX_LIST_OBJECTS) {
+        nxo_root(self);
+        NxObject *result = nx_list_create_from(l->items->data + start, end > start ? end - start : 0);
+        nxo_unroot(self);
+        return result;
+    }
+    NxObject *result = nx_list_create(end > start ? end - start : 1);
+    if (end > start) {
+        memcpy(((NxList *) result)->ints->data, l->ints->data + start, (end - start) * sizeof(int64_t));
+        ((NxList *) result)->length = end - start;
+    }
+    return result;
 }
 
 //! Implementation of the `set_element` method for the `list` type.
@@ -64,12 +272,137 @@ static void nx_list_set_element(NxObject *self, NxObject *index, NxObject *value
     assert(nx_list_is_instance(self));
     NxList *l = (NxList *) self;
     int64_t i = nxo_check_index(index, l->length);
+    if (l->strategy == NX_LIST_INTS) {
+        if (nxo_is_immediate_int(value)) {
+            l->ints->data[i] = nx_int_get_value(value);
+            return;
+        }
+        nxo_root(self);
+        nxo_root(value);
+        use_objects(l, l->ints->size);
+        nxo_unroot(value);
+        nxo_unroot(self);
+    }
     l->items->data[i] = value;
+    gc_write_barrier(&l->items->gc_header, nxo_gc_header(value));
+}
+
+/**
+ * \brief Fills memory with copies of the block at its start.
+ *
+ * The filled part doubles with each copy, so the number of memcpy() calls is logarithmic in the number of copies.
+ * \param dst the memory, whose first `block_size` bytes hold the block
+ * \param block_size size of the block in bytes
+ * \param total_size size of the memory to fill in bytes, a multiple of `block_size`
+ */
+static void fill_pattern(char *dst, size_t block_size, size_t total_size) {
+    for (size_t filled = block_size; filled < total_size; filled *= 2) {
+        memcpy(dst + filled, dst, filled < total_size - filled ? filled : total_size - filled);
+    }
+}
+
+/**
+ * \brief Creates a list consisting of the items of `left` repeated `left_times` times followed by the items of `right`
+ * repeated `right_times` times.
+ *
+ * May trigger garbage collection. Panics if the result would be too long.
+ * \param left the first list, must be rooted
+ * \param left_times the number of repetitions of the first list, must not be negative
+ * \param right the second list, must be rooted
+ * \param right_times the number of repetitions of the second list, must not be negative
+ * \return the new list object
+ */
+static NxObject *repeat(NxList *left, int64_t left_times, NxList *right, int64_t right_times) {
+    int64_t max_length = INT64_MAX / (int64_t) sizeof(NxObject *);
+    if ((left_times > 0 && left->length > max_length / left_times)
+            || (right_times > 0 && right->length > (max_length - left->length * left_times) / right_times)) {
+        PANIC("List is too long");
+    }
+    int64_t left_length = left->length * left_times;
+    int64_t length = left_length + right->length * right_times;
+    if (left->strategy == NX_LIST_INTS && right->strategy == NX_LIST_INTS) {
+        NxObject *result = nx_list_create(length > 0 ? length : 1);
+        int64_t *data = ((NxList *) result)->ints->data;
+        if (left_length > 0) {
+            memcpy(data, left->ints->data, left->length * sizeof(int64_t));
+            fill_pattern((char *) data, left->length * sizeof(int64_t), left_length * sizeof(int64_t));
+        }
+        if (length > left_length) {
+            memcpy(data + left_length, right->ints->data, right->length * sizeof(int64_t));
+            fill_pattern((char *) (data + left_length), right->length * sizeof(int64_t),
+                         (length - left_length) * sizeof(int64_t));
+        }
+        ((NxList *) result)->length = length;
+        return result;
+    }
+    // the array is the most recent allocation and getting an item does not allocate, so storing the items does not
+    // need the write barrier
+    NxObjectArray *array = nx_object_array_create(length);
+    if (left_length > 0) {
+        for (int64_t i = 0; i < left->length; i++) {
+            array->data[i] = get_item(left, i);
+        }
+        fill_pattern((char *) array->data, left->length * sizeof(NxObject *), left_length * sizeof(NxObject *));
+    }
+    if (length > left_length) {
+        for (int64_t i = 0; i < right->length; i++) {
+            array->data[left_length + i] = get_item(right, i);
+        }
+        fill_pattern((char *) (array->data + left_length), right->length * sizeof(NxObject *),
+                     (length - left_length) * sizeof(NxObject *));
+    }
+    return wrap_objects(array, length);
+}
+
+//! Implementation of the `add` method for the `list` type, which concatenates two lists.
+static NxObject *nx_list_op_add(NxObject *left, NxObject *right) {
+    if (!nx_list_is_instance(left) || !nx_list_is_instance(right)) {
+        return NULL;
+    }
+    nxo_root(left);
+    nxo_root(right);
+    NxObject *result = repeat((NxList *) left, 1, (NxList *) right, 1);
+    nxo_unroot(right);
+    nxo_unroot(left);
+    return result;
+}
+
+//! Implementation of the `mul` method for the `list` type, which repeats a list an integer number of times.
+static NxObject *nx_list_op_mul(NxObject *left, NxObject *right) {
+    NxObject *list = nx_list_is_instance(left) ? left : right;
+    NxObject *count = list == left ? right : left;
+    if (!nx_list_is_instance(list)) {
+        return NULL;
+    }
+    int64_t times;
+    if (nx_bool_is_instance(count)) {
+        times = nx_bool_is_true(count);
+    } else if (nx_int_is_instance(count)) {
+        if (!nx_int_fits_int64(count)) {
+            PANIC("List is too long");
+        }
+        times = nx_int_get_value(count);
+    } else {
+        return NULL;
+    }
+    nxo_root(list);
+    NxObject *result = repeat((NxList *) list, times > 0 ? times : 0, (NxList *) list, 0);
+    nxo_unroot(list);
+    return result;
 }
 
 const NxType nx_type_list = {
-        NX_TYPE_HEADER_INIT("list", nx_list_gc_trace),
+        NX_TYPE_HEADER_INIT(NX_CLASS_LIST, "list", nx_list_gc_trace),
         .as_bool_fn = nx_list_as_bool,
         .get_element_fn = nx_list_get_element,
         .set_element_fn = nx_list_set_element,
+        .get_slice_fn = nx_list_get_slice,
+        .hash_fn = NULL,
+        .eq_fn = NULL,
+        .add_fn = nx_list_op_add,
+        .sub_fn = NULL,
+        .mul_fn = nx_list_op_mul,
+        .div_fn = NULL,
+        .compare_fn = NULL,
+        .iter_next_fn = nx_list_iter_next,
 };
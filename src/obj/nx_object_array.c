@@ -13,6 +13,7 @@
 #include "natrix/obj/nx_object_array.h"
 #include <assert.h>
 #include <string.h>
+#include "natrix/util/counters.h"
 
 /**
  * \brief GC trace function for NxObjectArray.
@@ -20,9 +21,15 @@
  */
 static void nx_object_array_gc_trace(void *ptr) {
     NxObjectArray *array = (NxObjectArray *) ptr;
-    for (int64_t i = 0; i < array->size; i++) {
-        gc_visit(&array->data[i]->gc_header);
-    }
+    gc_visit_array((GcHeader *const *) array->data, array->size);
+}
+
+/**
+ * \brief Defines the class of object arrays before main() is entered.
+ */
+__attribute__((constructor))
+static void define_object_array_class() {
+    gc_define_class(NX_CLASS_OBJECT_ARRAY, nx_object_array_gc_trace, "object array");
 }
 
 /**
@@ -34,7 +41,8 @@ static void nx_object_array_gc_trace(void *ptr) {
  */
 static NxObjectArray *nx_object_array_alloc(int64_t size) {
     assert(size >= 0);
-    NxObjectArray *array = (NxObjectArray *) gc_alloc(sizeof(NxObjectArray) + size * sizeof(NxObject *), nx_object_array_gc_trace);
+    size_t bytes = sizeof(NxObjectArray) + size * sizeof(NxObject *);
+    NxObjectArray *array = (NxObjectArray *) gc_alloc(bytes, NX_CLASS_OBJECT_ARRAY);
     *((int64_t *) &array->size) = size;
     return array;
 }
@@ -52,5 +60,6 @@ NxObjectArray *nx_object_array_copy(NxObjectArray *source, int64_t new_size) {
     int64_t copy_size = source->size < new_size ? source->size : new_size;
     memcpy(array->data, source->data, copy_size * sizeof(NxObject *));
     memset(array->data + copy_size, 0, (new_size - copy_size) * sizeof(NxObject *));
+    counter_add(COUNTER_ARRAY_COPIES, 1);
     return array;
 }
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file nx_range.c
+ * \brief Implementation of the `range` type.
+ */
+
+#include "natrix/obj/nx_range.h"
+#include "natrix/obj/nx_bool.h"
+#include "natrix/obj/nx_int.h"
+
+NxObject *nx_range_create(int64_t start, int64_t step, int64_t length) {
+    assert(step != 0 && length >= 0);
+    NxRange *range = nxo_alloc(sizeof(NxRange), &nx_type_range);
+    range->start = start;
+    range->step = step;
+    range->length = length;
+    return (NxObject *) range;
+}
+
+//! Implementation of the `as_bool` method for the `range` type.
+static NxObject *nx_range_as_bool(NxObject *self) {
+    assert(nx_range_is_instance(self));
+    return nx_bool_wrap(((NxRange *) self)->length > 0);
+}
+
+//! Implementation of the `iter_next` method for the `range` type, the items are immediate, so it never allocates.
+static NxObject *nx_range_iter_next(NxObject *self, int64_t *position) {
+    assert(nx_range_is_instance(self));
+    const NxRange *range = (NxRange *) self;
+    if (*position >= range->length) {
+        return NULL;
+    }
+    return nx_int_create(range->start + (*position)++ * range->step);
+}
+
+const NxType nx_type_range = {
+        NX_TYPE_HEADER_INIT(NX_CLASS_RANGE, "range", NULL),
+        .as_bool_fn = nx_range_as_bool,
+        .get_element_fn = NULL,
+        .set_element_fn = NULL,
+        .get_slice_fn = NULL,
+        .hash_fn = NULL,
+        .eq_fn = NULL,
+        .add_fn = NULL,
+        .sub_fn = NULL,
+        .mul_fn = NULL,
+        .div_fn = NULL,
+        .compare_fn = NULL,
+        .iter_next_fn = nx_range_iter_next,
+};
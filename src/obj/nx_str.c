@@ -15,10 +15,35 @@
 #include <string.h>
 #include "natrix/obj/nx_bool.h"
 #include "natrix/obj/nx_int.h"
+#include "natrix/util/hash.h"
+#include "natrix/util/mem.h"
 #include "natrix/util/panic.h"
 
 /**
- * \brief Allocates but does not initialize a new `str` object.
+ * \brief Returns the address right after the `str` structure, where flat strings store their bytes.
+ * \param str the `str` object
+ * \return pointer to the inline bytes
+ */
+static inline char *inline_data(NxStr *str) {
+    return (char *) (str + 1);
+}
+
+/**
+ * \brief GC trace function for `str` objects.
+ * \param ptr pointer to the string
+ */
+static void nx_str_gc_trace(void *ptr) {
+    NxStr *str = (NxStr *) ptr;
+    if (str->data != inline_data(str)) {
+        gc_visit(&((NxRope *) str)->left->gc_header);
+        if (((NxRope *) str)->right != NULL) {
+            gc_visit(&((NxRope *) str)->right->gc_header);
+        }
+    }
+}
+
+/**
+ * \brief Allocates but does not initialize a new flat `str` object.
  * \param length the number of bytes (excluding the null terminator)
  * \return the newly allocated string object
  */
@@ -26,6 +51,8 @@ static NxStr *nx_str_alloc(int64_t length) {
     assert(length >= 0);
     NxStr *str = nxo_alloc(sizeof(NxStr) + length + 1, &nx_type_str);
     *((int64_t *) &str->length) = length;
+    *((const char **) &str->data) = inline_data(str);
+    str->hash = 0;
     return str;
 }
 
@@ -33,23 +60,142 @@ NxObject *nx_str_create(const char *data, int64_t length) {
     assert(data != NULL);
     assert(length >= 0);
     NxStr *str = nx_str_alloc(length);
-    memcpy((char *) &str->data, data, length);
-    ((char *) &str->data)[length] = '\0';
+    memcpy(inline_data(str), data, length);
+    inline_data(str)[length] = '\0';
+    return &str->header;
+}
+
+NxObject *nx_str_create_buffer(int64_t length, char **bytes) {
+    assert(length >= 0);
+    NxStr *str = nx_str_alloc(length);
+    inline_data(str)[length] = '\0';
+    *bytes = inline_data(str);
     return &str->header;
 }
 
+NxObject *nx_str_view(NxObject *owner, int64_t start, int64_t length) {
+    assert(nx_str_is_instance(owner) && ((NxStr *) owner)->data == inline_data((NxStr *) owner));
+    assert(start >= 0 && length >= 0 && start + length <= nx_str_get_length(owner));
+    const char *data = ((NxStr *) owner)->data;
+    if (length == 1) {
+        return nx_str_from_char(data[start]);
+    }
+    if (length < NX_STR_VIEW_MIN_LENGTH) {
+        return nx_str_create(data + start, length);
+    }
+    // the view shares the bytes with the flat string that owns them, which is kept alive by the view
+    NxRope *view = nxo_alloc(sizeof(NxRope), &nx_type_str);
+    *((int64_t *) &view->str.length) = length;
+    *((const char **) &view->str.data) = data + start;
+    view->str.hash = 0;
+    view->left = owner;
+    view->right = NULL;
+    return &view->str.header;
+}
+
 NxObject *nx_str_concat(NxObject *left, NxObject *right) {
     assert(nx_str_is_instance(left));
     assert(nx_str_is_instance(right));
     size_t len1 = nx_str_get_length(left);
     size_t len2 = nx_str_get_length(right);
+    if (len2 == 0) {
+        return left;
+    }
+    if (len1 == 0) {
+        return right;
+    }
+    if (len1 + len2 >= NX_STR_ROPE_MIN_LENGTH) {
+        NxRope *rope = nxo_alloc(sizeof(NxRope), &nx_type_str);
+        *((int64_t *) &rope->str.length) = (int64_t) (len1 + len2);
+        *((const char **) &rope->str.data) = NULL;
+        rope->str.hash = 0;
+        rope->left = left;
+        rope->right = right;
+        return &rope->str.header;
+    }
+    // both operands are shorter than NX_STR_ROPE_MIN_LENGTH, thus not ropes and their bytes are available
     NxStr *result = nx_str_alloc(len1 + len2);
-    memcpy((char *) &result->data, nx_str_get_cstr(left), len1);
-    memcpy((char *) &result->data + len1, nx_str_get_cstr(right), len2);
-    ((char *) &result->data)[len1 + len2] = '\0';
+    memcpy(inline_data(result), nx_str_get_data(left), len1);
+    memcpy(inline_data(result) + len1, nx_str_get_data(right), len2);
+    inline_data(result)[len1 + len2] = '\0';
     return &result->header;
 }
 
+const char *nx_str_flatten(NxObject *object) {
+    assert(nx_str_is_instance(object));
+    NxRope *rope = (NxRope *) object;
+    assert(rope->str.data != inline_data(&rope->str));
+    nxo_root(object);
+    NxStr *flat = nx_str_alloc(rope->str.length);
+    nxo_unroot(object);
+
+    // The bytes are copied from the end, so that the stack stays small for ropes built by appending (`s = s + x`),
+    // whose left operands are nested deeply. Views and flattened ropes are copied as a whole.
+    char *dst = inline_data(flat) + rope->str.length;
+    *dst = '\0';
+    size_t capacity = 16;
+    size_t count = 0;
+    NxStr **stack = nx_alloc(capacity * sizeof(NxStr *));
+    stack[count++] = &rope->str;
+    while (count > 0) {
+        NxStr *str = stack[--count];
+        if (str->data != NULL) {
+            dst -= str->length;
+            memcpy(dst, str->data, str->length);
+            continue;
+        }
+        if (count + 2 > capacity) {
+            capacity *= 2;
+            stack = nx_realloc(stack, capacity * sizeof(NxStr *));
+        }
+        stack[count++] = (NxStr *) ((NxRope *) str)->left;
+        stack[count++] = (NxStr *) ((NxRope *) str)->right;
+    }
+    nx_free(stack);
+    assert(dst == inline_data(flat));
+
+    rope->left = &flat->header;
+    gc_write_barrier(&rope->str.header.gc_header, &flat->header.gc_header);
+    rope->right = NULL;
+    *((const char **) &rope->str.data) = flat->data;
+    return flat->data;
+}
+
+//! Statically allocated string of length 1 with a null terminator.
+typedef struct {
+    NxStr str;                  //!< The string
+    char bytes[2];              //!< Its byte and the null terminator, right after `str` as in other flat strings
+} CharStr;
+
+//! Initializer of the element of `char_cache` for the byte `c`.
+#define CHAR_STR(c) {                                                                                            \
+        .str = {                                                                                                 \
+                .header = NX_STATIC_HEADER_INIT(NX_CLASS_STR),                                                   \
+                .length = 1,                                                                                     \
+                .data = char_cache[c].bytes,                                                                     \
+                .hash = (HASH_FNV_OFFSET_BASIS ^ (unsigned char) (c)) * HASH_FNV_PRIME,                          \
+        },                                                                                                       \
+        .bytes = {(char) (c), '\0'},                                                                             \
+}
+#define CHAR_STR4(c) CHAR_STR(c), CHAR_STR((c) + 1), CHAR_STR((c) + 2), CHAR_STR((c) + 3)
+#define CHAR_STR16(c) CHAR_STR4(c), CHAR_STR4((c) + 4), CHAR_STR4((c) + 8), CHAR_STR4((c) + 12)
+#define CHAR_STR64(c) CHAR_STR16(c), CHAR_STR16((c) + 16), CHAR_STR16((c) + 32), CHAR_STR16((c) + 48)
+
+//! The strings consisting of a single byte, indexed by the byte. Like `true` and `false`, they are not GC-allocated,
+//! they are permanently marked and shared by all heaps. Their hashes are computed in advance, so they are never written.
+static CharStr char_cache[256] = {CHAR_STR64(0), CHAR_STR64(64), CHAR_STR64(128), CHAR_STR64(192)};
+
+NxObject *nx_str_from_char(char c) {
+    return &char_cache[(unsigned char) c].str.header;
+}
+
+uint64_t nx_str_compute_hash(NxObject *object) {
+    assert(nx_str_is_instance(object));
+    uint64_t hash = hash_bytes(nx_str_get_data(object), (size_t) nx_str_get_length(object));
+    ((NxStr *) object)->hash = hash;
+    return hash;
+}
+
 //! Implementation of the `as_bool` method for the `str` type.
 static NxObject *nx_str_as_bool(NxObject *self) {
     assert(nx_str_is_instance(self));
@@ -60,12 +206,140 @@ static NxObject *nx_str_as_bool(NxObject *self) {
 static NxObject *nx_str_get_element(NxObject *self, NxObject *index) {
     assert(nx_str_is_instance(self));
     int64_t i = nxo_check_index(index, nx_str_get_length(self));
-    return nx_str_create(nx_str_get_cstr(self) + i, 1);
+    return nx_str_from_char(nx_str_get_data(self)[i]);
+}
+
+//! Implementation of the `iter_next` method for the `str` type, which steps through the bytes.
+static NxObject *nx_str_iter_next(NxObject *self, int64_t *position) {
+    assert(nx_str_is_instance(self));
+    if (*position >= nx_str_get_length(self)) {
+        return NULL;
+    }
+    // only the first step of a rope flattens it, the single-byte strings are static
+    return nx_str_from_char(nx_str_get_data(self)[(*position)++]);
+}
+
+//! Implementation of the `get_slice` method for the `str` type.
+static NxObject *nx_str_get_slice(NxObject *self, NxObject *lower, NxObject *upper) {
+    assert(nx_str_is_instance(self));
+    int64_t start, end;
+    nxo_check_slice(lower, upper, nx_str_get_length(self), &start, &end);
+    int64_t length = end - start;
+    if (length == nx_str_get_length(self)) {
+        return self;
+    }
+    const char *data = nx_str_get_data(self);
+    NxObject *owner = data == inline_data((NxStr *) self) ? self : ((NxRope *) self)->left;
+    return nx_str_view(owner, data - ((NxStr *) owner)->data + start, length);
+}
+
+//! Implementation of the `hash` method for the `str` type.
+static uint64_t nx_str_hash(NxObject *self) {
+    return nx_str_get_hash(self);
+}
+
+/**
+ * \brief Returns the bytes of two `str` objects, flattening them if needed.
+ *
+ * Flattening one string must not collect the other one, neither needs to be rooted. The bytes of a flat string are
+ * never moved, so the first pointer stays valid while the second string is flattened.
+ * \param left the first string
+ * \param right the second string
+ * \param left_data receives the bytes of `left`
+ * \param right_data receives the bytes of `right`
+ */
+static void get_both_data(NxObject *left, NxObject *right, const char **left_data, const char **right_data) {
+    nxo_root(right);
+    *left_data = nx_str_get_data(left);
+    nxo_unroot(right);
+    nxo_root(left);
+    *right_data = nx_str_get_data(right);
+    nxo_unroot(left);
+}
+
+bool nx_str_equals(NxObject *left, NxObject *right) {
+    assert(nx_str_is_instance(left) && nx_str_is_instance(right));
+    if (left == right) {
+        return true;
+    }
+    int64_t length = nx_str_get_length(left);
+    if (length != nx_str_get_length(right)) {
+        return false;
+    }
+    uint64_t hash1 = ((NxStr *) left)->hash;
+    uint64_t hash2 = ((NxStr *) right)->hash;
+    if (hash1 != 0 && hash2 != 0 && hash1 != hash2) {
+        return false;
+    }
+    if (length == 0) {
+        return true;
+    }
+    const char *data1, *data2;
+    get_both_data(left, right, &data1, &data2);
+    // the first bytes usually differ already, which saves the call of memcmp(), vectorized by the C library
+    return data1[0] == data2[0] && memcmp(data1, data2, length) == 0;
+}
+
+int nx_str_compare(NxObject *left, NxObject *right) {
+    assert(nx_str_is_instance(left) && nx_str_is_instance(right));
+    if (left == right) {
+        return 0;
+    }
+    int64_t len1 = nx_str_get_length(left);
+    int64_t len2 = nx_str_get_length(right);
+    int64_t common = len1 < len2 ? len1 : len2;
+    int cmp = 0;
+    if (common > 0) {
+        const char *data1, *data2;
+        get_both_data(left, right, &data1, &data2);
+        cmp = data1[0] != data2[0] ? (unsigned char) data1[0] - (unsigned char) data2[0]
+                                   : memcmp(data1, data2, common);
+    }
+    if (cmp == 0) {
+        cmp = (len1 > len2) - (len1 < len2);
+    }
+    return (cmp > 0) - (cmp < 0);
+}
+
+//! Implementation of the `eq` method for the `str` type.
+static bool nx_str_eq(NxObject *self, NxObject *other) {
+    assert(nx_str_is_instance(self));
+    return nx_str_is_instance(other) && nx_str_equals(self, other);
+}
+
+//! Implementation of the `add` method for the `str` type.
+static NxObject *nx_str_op_add(NxObject *left, NxObject *right) {
+    if (!nx_str_is_instance(left) || !nx_str_is_instance(right)) {
+        return NULL;
+    }
+    nxo_root(left);
+    nxo_root(right);
+    NxObject *result = nx_str_concat(left, right);
+    nxo_unroot(right);
+    nxo_unroot(left);
+    return result;
+}
+
+//! Implementation of the `compare` method for the `str` type, which compares the bytes lexicographically.
+static NxObject *nx_str_op_compare(NxObject *left, NxObject *right) {
+    if (!nx_str_is_instance(left) || !nx_str_is_instance(right)) {
+        return NULL;
+    }
+    return nx_int_create(nx_str_compare(left, right));
 }
 
 const NxType nx_type_str = {
-        NX_TYPE_HEADER_INIT("str", gc_trace_nop),
+        NX_TYPE_HEADER_INIT(NX_CLASS_STR, "str", nx_str_gc_trace),
         .as_bool_fn = nx_str_as_bool,
         .get_element_fn = nx_str_get_element,
         .set_element_fn = NULL,
+        .get_slice_fn = nx_str_get_slice,
+        .hash_fn = nx_str_hash,
+        .eq_fn = nx_str_eq,
+        .add_fn = nx_str_op_add,
+        .sub_fn = NULL,
+        .mul_fn = NULL,
+        .div_fn = NULL,
+        .compare_fn = nx_str_op_compare,
+        .iter_next_fn = nx_str_iter_next,
 };
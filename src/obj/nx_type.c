@@ -7,11 +7,18 @@
 
 /**
  * \file nx_type.c
- * \brief Definition of the `type` type.
+ * \brief Definition of the `type` type and of the table of the built-in types.
  */
 
 #include "natrix/obj/nx_type.h"
+#include <assert.h>
 #include "natrix/obj/nx_bool.h"
+#include "natrix/obj/nx_dict.h"
+#include "natrix/obj/nx_int.h"
+#include "natrix/obj/nx_lines.h"
+#include "natrix/obj/nx_list.h"
+#include "natrix/obj/nx_range.h"
+#include "natrix/obj/nx_str.h"
 
 //! Implementation of the `as_bool` method for the `type` type.
 static NxObject *nx_type_as_bool(NxObject *self) {
@@ -20,8 +27,44 @@ static NxObject *nx_type_as_bool(NxObject *self) {
 }
 
 const NxType nx_type_type = {
-        NX_TYPE_HEADER_INIT("type", gc_trace_nop),
+        NX_TYPE_HEADER_INIT(NX_CLASS_TYPE, "type", NULL),
         .as_bool_fn = nx_type_as_bool,
         .get_element_fn = NULL,
         .set_element_fn = NULL,
+        .get_slice_fn = NULL,
+        .hash_fn = NULL,
+        .eq_fn = NULL,
+        .add_fn = NULL,
+        .sub_fn = NULL,
+        .mul_fn = NULL,
+        .div_fn = NULL,
+        .compare_fn = NULL,
+        .iter_next_fn = NULL,
 };
+
+const NxType *const nx_types[NX_CLASS_COUNT] = {
+        [NX_CLASS_TYPE] = &nx_type_type,
+        [NX_CLASS_BOOL] = &nx_type_bool,
+        [NX_CLASS_INT] = &nx_type_int,
+        [NX_CLASS_STR] = &nx_type_str,
+        [NX_CLASS_LIST] = &nx_type_list,
+        [NX_CLASS_DICT] = &nx_type_dict,
+        [NX_CLASS_RANGE] = &nx_type_range,
+        [NX_CLASS_LINES] = &nx_type_lines,
+};
+
+_Static_assert(NX_CLASS_COUNT <= GC_FIRST_DYNAMIC_CLASS, "the built-in classes must have fixed ids");
+
+/**
+ * \brief Defines the classes of the instances of the built-in types before main() is entered.
+ */
+__attribute__((constructor))
+static void define_type_classes() {
+    for (GcClassId id = 0; id < NX_CLASS_COUNT; id++) {
+        const NxType *type = nx_types[id];
+        if (type != NULL) {
+            assert(type->class_id == id);
+            gc_define_class(id, type->gc_trace_fn, type->name);
+        }
+    }
+}
@@ -37,6 +37,7 @@ Expr *ast_create_expr_int_literal(Arena *arena, const char *start, const char *e
     expr->literal.start = start;
     expr->literal.end = end;
     expr->literal.head = NULL;
+    expr->literal.index = AST_UNRESOLVED;
     return expr;
 }
 
@@ -48,6 +49,7 @@ Expr *ast_create_expr_str_literal(Arena *arena, const char *start, const char *e
     expr->literal.start = start;
     expr->literal.end = end;
     expr->literal.head = NULL;
+    expr->literal.index = AST_UNRESOLVED;
     return expr;
 }
 
@@ -58,6 +60,18 @@ Expr *ast_create_expr_list_literal(Arena *arena, const char *start, const char *
     expr->literal.start = start;
     expr->literal.end = end;
     expr->literal.head = head;
+    expr->literal.index = AST_UNRESOLVED;
+    return expr;
+}
+
+Expr *ast_create_expr_dict_literal(Arena *arena, const char *start, const char *end, Expr *head) {
+    Expr *expr = arena_alloc(arena, sizeof(Expr));
+    expr->kind = EXPR_DICT_LITERAL;
+    expr->next = NULL;
+    expr->literal.start = start;
+    expr->literal.end = end;
+    expr->literal.head = head;
+    expr->literal.index = AST_UNRESOLVED;
     return expr;
 }
 
@@ -68,6 +82,8 @@ Expr *ast_create_expr_name(Arena *arena, const char *start, const char *end) {
     expr->next = NULL;
     expr->identifier.start = start;
     expr->identifier.end = end;
+    expr->identifier.symbol = NULL;
+    expr->identifier.slot = AST_UNRESOLVED;
     return expr;
 }
 
@@ -78,6 +94,7 @@ Expr *ast_create_expr_binary(Arena *arena, Expr *left, const BinaryOp op, Expr *
     expr->next = NULL;
     expr->binary.left = left;
     expr->binary.op = op;
+    expr->binary.temporary = false;
     expr->binary.right = right;
     return expr;
 }
@@ -93,6 +110,29 @@ Expr *ast_create_expr_subscript(Arena *arena, Expr *receiver, Expr *index, const
     return expr;
 }
 
+Expr *ast_create_expr_slice(Arena *arena, Expr *receiver, Expr *lower, Expr *upper, const char *end) {
+    assert(receiver != NULL);
+    Expr *expr = arena_alloc(arena, sizeof(Expr));
+    expr->kind = EXPR_SLICE;
+    expr->next = NULL;
+    expr->slice.receiver = receiver;
+    expr->slice.lower = lower;
+    expr->slice.upper = upper;
+    expr->slice.end = end;
+    return expr;
+}
+
+Expr *ast_create_expr_call(Arena *arena, Expr *callee, Expr *args, const char *end) {
+    assert(callee != NULL && callee->kind == EXPR_NAME);
+    Expr *expr = arena_alloc(arena, sizeof(Expr));
+    expr->kind = EXPR_CALL;
+    expr->next = NULL;
+    expr->call.callee = callee;
+    expr->call.args = args;
+    expr->call.end = end;
+    return expr;
+}
+
 Stmt *ast_create_stmt_assignment(Arena *arena, Expr *left, Expr *right) {
     assert(left != NULL && right != NULL);
     assert(left->kind == EXPR_NAME || left->kind == EXPR_SUBSCRIPT);
@@ -104,6 +144,13 @@ Stmt *ast_create_stmt_assignment(Arena *arena, Expr *left, Expr *right) {
     return stmt;
 }
 
+Stmt *ast_create_stmt_aug_assignment(Arena *arena, Expr *left, BinaryOp op, Expr *right) {
+    Stmt *stmt = ast_create_stmt_assignment(arena, left, right);
+    stmt->kind = STMT_AUG_ASSIGNMENT;
+    stmt->assignment.op = op;
+    return stmt;
+}
+
 Stmt *ast_create_stmt_expr(Arena *arena, Expr *expr) {
     assert(expr != NULL);
     Stmt *stmt = arena_alloc(arena, sizeof(Stmt));
@@ -123,6 +170,19 @@ Stmt *ast_create_stmt_while(Arena *arena, Expr *condition, Stmt *body) {
     return stmt;
 }
 
+Stmt *ast_create_stmt_for(Arena *arena, Expr *target, Expr *iterable, Stmt *body) {
+    assert(target != NULL && iterable != NULL && body != NULL);
+    assert(target->kind == EXPR_NAME);
+    Stmt *stmt = arena_alloc(arena, sizeof(Stmt));
+    stmt->kind = STMT_FOR;
+    stmt->next = NULL;
+    stmt->for_stmt.target = target;
+    stmt->for_stmt.iterable = iterable;
+    stmt->for_stmt.body = body;
+    stmt->for_stmt.iter_slot = AST_UNRESOLVED;
+    return stmt;
+}
+
 Stmt *ast_create_stmt_if(Arena *arena, Expr *condition, Stmt *then_body, Stmt *else_body) {
     assert(condition != NULL && then_body != NULL && else_body != NULL);
     Stmt *stmt = arena_alloc(arena, sizeof(Stmt));
@@ -150,11 +210,17 @@ Stmt *ast_create_stmt_print(Arena *arena, Expr *expr) {
     return stmt;
 }
 
+const char *ast_get_binary_op_name(BinaryOp op) {
+    assert(op >= 0 && op < BINOP_COUNT);
+    return BINOP_NAMES[op];
+}
+
 const char *ast_get_expr_start(const Expr *expr) {
     switch (expr->kind) {
         case EXPR_INT_LITERAL:
         case EXPR_STR_LITERAL:
         case EXPR_LIST_LITERAL:
+        case EXPR_DICT_LITERAL:
             return expr->literal.start;
         case EXPR_NAME:
             return expr->identifier.start;
@@ -162,6 +228,10 @@ const char *ast_get_expr_start(const Expr *expr) {
             return ast_get_expr_start(expr->binary.left);
         case EXPR_SUBSCRIPT:
             return ast_get_expr_start(expr->subscript.receiver);
+        case EXPR_SLICE:
+            return ast_get_expr_start(expr->slice.receiver);
+        case EXPR_CALL:
+            return expr->call.callee->identifier.start;
         default:
             assert(0);
     }
@@ -172,6 +242,7 @@ const char *ast_get_expr_end(const Expr *expr) {
         case EXPR_INT_LITERAL:
         case EXPR_STR_LITERAL:
         case EXPR_LIST_LITERAL:
+        case EXPR_DICT_LITERAL:
             return expr->literal.end;
         case EXPR_NAME:
             return expr->identifier.end;
@@ -179,6 +250,31 @@ const char *ast_get_expr_end(const Expr *expr) {
             return ast_get_expr_end(expr->binary.right);
         case EXPR_SUBSCRIPT:
             return expr->subscript.end;
+        case EXPR_SLICE:
+            return expr->slice.end;
+        case EXPR_CALL:
+            return expr->call.end;
+        default:
+            assert(0);
+    }
+}
+
+const char *ast_get_stmt_position(const Stmt *stmt) {
+    switch (stmt->kind) {
+        case STMT_EXPR:
+        case STMT_PRINT:
+            return ast_get_expr_start(stmt->expr);
+        case STMT_ASSIGNMENT:
+        case STMT_AUG_ASSIGNMENT:
+            return ast_get_expr_start(stmt->assignment.right);
+        case STMT_WHILE:
+            return ast_get_expr_start(stmt->while_stmt.condition);
+        case STMT_FOR:
+            return ast_get_expr_start(stmt->for_stmt.iterable);
+        case STMT_IF:
+            return ast_get_expr_start(stmt->if_stmt.condition);
+        case STMT_PASS:
+            return NULL;
         default:
             assert(0);
     }
@@ -209,12 +305,18 @@ static void ast_dump_expr(StringBuilder *sb, const Expr *expr, int indent, const
             sb_append_formatted(sb, "EXPR_LIST_LITERAL\n");
             ast_dump_exprs(sb, expr->literal.head, indent);
             break;
+        case EXPR_DICT_LITERAL:
+            sb_append_formatted(sb, "EXPR_DICT_LITERAL\n");
+            for (const Expr *key = expr->literal.head; key; key = key->next->next) {
+                ast_dump_expr(sb, key, indent + 2, "key");
+                ast_dump_expr(sb, key->next, indent + 2, "value");
+            }
+            break;
         case EXPR_NAME:
             sb_append_formatted(sb, "EXPR_NAME {identifier: \"%.*s\"}\n", (int) (expr->identifier.end - expr->identifier.start), expr->identifier.start);
             break;
         case EXPR_BINARY:
-            assert(expr->binary.op >= 0 && expr->binary.op < BINOP_COUNT);
-            sb_append_formatted(sb, "EXPR_BINARY {op: %s}\n", BINOP_NAMES[expr->binary.op]);
+            sb_append_formatted(sb, "EXPR_BINARY {op: %s}\n", ast_get_binary_op_name(expr->binary.op));
             ast_dump_expr(sb, expr->binary.left, indent + 2, "left");
             ast_dump_expr(sb, expr->binary.right, indent + 2, "right");
             break;
@@ -223,6 +325,22 @@ static void ast_dump_expr(StringBuilder *sb, const Expr *expr, int indent, const
             ast_dump_expr(sb, expr->subscript.receiver, indent + 2, "receiver");
             ast_dump_expr(sb, expr->subscript.index, indent + 2, "index");
             break;
+        case EXPR_SLICE:
+            sb_append_str(sb, "EXPR_SLICE\n");
+            ast_dump_expr(sb, expr->slice.receiver, indent + 2, "receiver");
+            if (expr->slice.lower) {
+                ast_dump_expr(sb, expr->slice.lower, indent + 2, "lower");
+            }
+            if (expr->slice.upper) {
+                ast_dump_expr(sb, expr->slice.upper, indent + 2, "upper");
+            }
+            break;
+        case EXPR_CALL: {
+            const ExprName *callee = &expr->call.callee->identifier;
+            sb_append_formatted(sb, "EXPR_CALL {function: \"%.*s\"}\n", (int) (callee->end - callee->start), callee->start);
+            ast_dump_exprs(sb, expr->call.args, indent);
+            break;
+        }
         default:
             assert(0 && "Invalid ExprKind");
     }
@@ -261,11 +379,22 @@ static void ast_dump_stmt(StringBuilder *sb, const Stmt *stmt, int indent) {
             ast_dump_expr(sb, stmt->assignment.left, indent + 2, "left");
             ast_dump_expr(sb, stmt->assignment.right, indent + 2, "right");
             break;
+        case STMT_AUG_ASSIGNMENT:
+            sb_append_formatted(sb, "STMT_AUG_ASSIGNMENT {op: %s}\n", ast_get_binary_op_name(stmt->assignment.op));
+            ast_dump_expr(sb, stmt->assignment.left, indent + 2, "left");
+            ast_dump_expr(sb, stmt->assignment.right, indent + 2, "right");
+            break;
         case STMT_WHILE:
             sb_append_str(sb, "STMT_WHILE\n");
             ast_dump_expr(sb, stmt->while_stmt.condition, indent + 2, "condition");
             ast_dump_stmts(sb, stmt->while_stmt.body, indent + 2, "body");
             break;
+        case STMT_FOR:
+            sb_append_str(sb, "STMT_FOR\n");
+            ast_dump_expr(sb, stmt->for_stmt.target, indent + 2, "target");
+            ast_dump_expr(sb, stmt->for_stmt.iterable, indent + 2, "iterable");
+            ast_dump_stmts(sb, stmt->for_stmt.body, indent + 2, "body");
+            break;
         case STMT_IF:
             sb_append_str(sb, "STMT_IF\n");
             ast_dump_expr(sb, stmt->if_stmt.condition, indent + 2, "condition");
@@ -0,0 +1,517 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file compact_ast.c
+ * \brief Compact abstract syntax tree implementation.
+ */
+
+#include "natrix/parser/compact_ast.h"
+#include <assert.h>
+#include "natrix/util/mem.h"
+#include "natrix/util/panic.h"
+
+//! Initial number of nodes of each category.
+#define INITIAL_CAPACITY 64
+
+/**
+ * \brief Frees the arrays of nodes.
+ * \param nodes the nodes
+ */
+static void free_nodes(AstNodes *nodes) {
+    nx_free(nodes->kind);
+    nx_free(nodes->next);
+    nx_free(nodes->a);
+    nx_free(nodes->b);
+    nx_free(nodes->c);
+}
+
+/**
+ * \brief Appends a node to the arrays, growing them if necessary.
+ * \param nodes the nodes
+ * \param kind kind of the node
+ * \param a first field
+ * \param b second field
+ * \param c third field
+ * \return index of the new node
+ */
+static AstId add_node(AstNodes *nodes, uint8_t kind, uint32_t a, uint32_t b, uint32_t c) {
+    if (nodes->count == nodes->capacity) {
+        if (nodes->capacity >= AST_NONE / 2) {
+            PANIC("Too many AST nodes");
+        }
+        uint32_t capacity = nodes->capacity ? nodes->capacity * 2 : INITIAL_CAPACITY;
+        nodes->kind = nx_realloc(nodes->kind, capacity * sizeof(uint8_t));
+        nodes->next = nx_realloc(nodes->next, capacity * sizeof(AstId));
+        nodes->a = nx_realloc(nodes->a, capacity * sizeof(uint32_t));
+        nodes->b = nx_realloc(nodes->b, capacity * sizeof(uint32_t));
+        nodes->c = nx_realloc(nodes->c, capacity * sizeof(uint32_t));
+        nodes->capacity = capacity;
+    }
+    AstId id = nodes->count++;
+    nodes->kind[id] = kind;
+    nodes->next[id] = AST_NONE;
+    nodes->a[id] = a;
+    nodes->b[id] = b;
+    nodes->c[id] = c;
+    return id;
+}
+
+/**
+ * \brief Converts a position in the source code to an offset.
+ * \param ast the compact AST
+ * \param ptr pointer into the source code
+ * \return the offset of `ptr` from the start of the source code
+ */
+static uint32_t offset_of(const CompactAst *ast, const char *ptr) {
+    assert(ptr >= ast->base);
+    if ((size_t) (ptr - ast->base) >= AST_NONE) {
+        PANIC("Source code too large");
+    }
+    return (uint32_t) (ptr - ast->base);
+}
+
+CompactAst compact_ast_init(const char *base) {
+    return (CompactAst) {
+        .base = base,
+        .exprs = {.kind = NULL, .next = NULL, .a = NULL, .b = NULL, .c = NULL, .count = 0, .capacity = 0},
+        .stmts = {.kind = NULL, .next = NULL, .a = NULL, .b = NULL, .c = NULL, .count = 0, .capacity = 0},
+    };
+}
+
+void compact_ast_free(CompactAst *ast) {
+    free_nodes(&ast->exprs);
+    free_nodes(&ast->stmts);
+}
+
+AstId compact_ast_add_expr_int_literal(CompactAst *ast, const char *start, const char *end) {
+    assert(start < end);
+    return add_node(&ast->exprs, EXPR_INT_LITERAL, offset_of(ast, start), offset_of(ast, end), AST_UNRESOLVED);
+}
+
+AstId compact_ast_add_expr_str_literal(CompactAst *ast, const char *start, const char *end) {
+    assert(start < end);
+    return add_node(&ast->exprs, EXPR_STR_LITERAL, offset_of(ast, start), offset_of(ast, end), AST_UNRESOLVED);
+}
+
+AstId compact_ast_add_expr_list_literal(CompactAst *ast, const char *start, const char *end, AstId head) {
+    return add_node(&ast->exprs, EXPR_LIST_LITERAL, offset_of(ast, start), offset_of(ast, end), head);
+}
+
+AstId compact_ast_add_expr_dict_literal(CompactAst *ast, const char *start, const char *end, AstId head) {
+    return add_node(&ast->exprs, EXPR_DICT_LITERAL, offset_of(ast, start), offset_of(ast, end), head);
+}
+
+AstId compact_ast_add_expr_name(CompactAst *ast, const char *start, const char *end) {
+    assert(start < end);
+    return add_node(&ast->exprs, EXPR_NAME, offset_of(ast, start), offset_of(ast, end), AST_UNRESOLVED);
+}
+
+AstId compact_ast_add_expr_binary(CompactAst *ast, AstId left, BinaryOp op, AstId right) {
+    assert(left != AST_NONE && right != AST_NONE);
+    return add_node(&ast->exprs, EXPR_BINARY, left, right, op);
+}
+
+AstId compact_ast_add_expr_subscript(CompactAst *ast, AstId receiver, AstId index, const char *end) {
+    assert(receiver != AST_NONE && index != AST_NONE);
+    return add_node(&ast->exprs, EXPR_SUBSCRIPT, receiver, index, offset_of(ast, end));
+}
+
+AstId compact_ast_add_expr_slice(CompactAst *ast, AstId receiver, AstId lower, AstId upper, const char *end) {
+    assert(receiver != AST_NONE);
+    AstId id = add_node(&ast->exprs, EXPR_SLICE, receiver, lower, upper);
+    add_node(&ast->exprs, EXPR_SLICE, offset_of(ast, end), AST_NONE, AST_NONE);
+    return id;
+}
+
+AstId compact_ast_add_expr_call(CompactAst *ast, AstId callee, AstId args, const char *end) {
+    assert(callee != AST_NONE && ast->exprs.kind[callee] == EXPR_NAME);
+    return add_node(&ast->exprs, EXPR_CALL, callee, args, offset_of(ast, end));
+}
+
+AstId compact_ast_add_stmt_expr(CompactAst *ast, AstId expr) {
+    assert(expr != AST_NONE);
+    return add_node(&ast->stmts, STMT_EXPR, expr, AST_NONE, AST_NONE);
+}
+
+AstId compact_ast_add_stmt_assignment(CompactAst *ast, AstId left, AstId right) {
+    assert(left != AST_NONE && right != AST_NONE);
+    assert(ast->exprs.kind[left] == EXPR_NAME || ast->exprs.kind[left] == EXPR_SUBSCRIPT);
+    return add_node(&ast->stmts, STMT_ASSIGNMENT, left, right, AST_NONE);
+}
+
+AstId compact_ast_add_stmt_aug_assignment(CompactAst *ast, AstId left, BinaryOp op, AstId right) {
+    assert(left != AST_NONE && right != AST_NONE);
+    assert(ast->exprs.kind[left] == EXPR_NAME || ast->exprs.kind[left] == EXPR_SUBSCRIPT);
+    return add_node(&ast->stmts, STMT_AUG_ASSIGNMENT, left, right, op);
+}
+
+AstId compact_ast_add_stmt_while(CompactAst *ast, AstId condition, AstId body) {
+    assert(condition != AST_NONE && body != AST_NONE);
+    return add_node(&ast->stmts, STMT_WHILE, condition, body, AST_NONE);
+}
+
+AstId compact_ast_add_stmt_for(CompactAst *ast, AstId target, AstId iterable, AstId body) {
+    assert(target != AST_NONE && iterable != AST_NONE && body != AST_NONE);
+    assert(ast->exprs.kind[target] == EXPR_NAME);
+    AstId id = add_node(&ast->stmts, STMT_FOR, target, iterable, body);
+    add_node(&ast->stmts, STMT_FOR, AST_UNRESOLVED, AST_NONE, AST_NONE);
+    return id;
+}
+
+AstId compact_ast_add_stmt_if(CompactAst *ast, AstId condition, AstId then_body, AstId else_body) {
+    assert(condition != AST_NONE && then_body != AST_NONE && else_body != AST_NONE);
+    return add_node(&ast->stmts, STMT_IF, condition, then_body, else_body);
+}
+
+AstId compact_ast_add_stmt_pass(CompactAst *ast) {
+    return add_node(&ast->stmts, STMT_PASS, AST_NONE, AST_NONE, AST_NONE);
+}
+
+AstId compact_ast_add_stmt_print(CompactAst *ast, AstId expr) {
+    assert(expr != AST_NONE);
+    return add_node(&ast->stmts, STMT_PRINT, expr, AST_NONE, AST_NONE);
+}
+
+void compact_ast_set_next_expr(CompactAst *ast, AstId expr, AstId next) {
+    assert(expr < ast->exprs.count);
+    ast->exprs.next[expr] = next;
+}
+
+void compact_ast_set_next_stmt(CompactAst *ast, AstId stmt, AstId next) {
+    assert(stmt < ast->stmts.count);
+    ast->stmts.next[stmt] = next;
+}
+
+static AstId add_exprs(CompactAst *ast, const Expr *expr);
+
+/**
+ * \brief Adds a copy of an expression of the pointer-based AST.
+ * \param ast the compact AST
+ * \param expr the expression
+ * \return index of the copy
+ */
+static AstId add_expr(CompactAst *ast, const Expr *expr) {
+    switch (expr->kind) {
+        case EXPR_INT_LITERAL:
+        case EXPR_STR_LITERAL:
+            return add_node(&ast->exprs, expr->kind, offset_of(ast, expr->literal.start),
+                            offset_of(ast, expr->literal.end), expr->literal.index);
+        case EXPR_LIST_LITERAL: {
+            AstId head = add_exprs(ast, expr->literal.head);
+            return compact_ast_add_expr_list_literal(ast, expr->literal.start, expr->literal.end, head);
+        }
+        case EXPR_DICT_LITERAL: {
+            AstId head = add_exprs(ast, expr->literal.head);
+            return compact_ast_add_expr_dict_literal(ast, expr->literal.start, expr->literal.end, head);
+        }
+        case EXPR_NAME:
+            return add_node(&ast->exprs, EXPR_NAME, offset_of(ast, expr->identifier.start),
+                            offset_of(ast, expr->identifier.end), expr->identifier.slot);
+        case EXPR_BINARY: {
+            AstId left = add_expr(ast, expr->binary.left);
+            AstId right = add_expr(ast, expr->binary.right);
+            return compact_ast_add_expr_binary(ast, left, expr->binary.op, right);
+        }
+        case EXPR_SUBSCRIPT: {
+            AstId receiver = add_expr(ast, expr->subscript.receiver);
+            AstId index = add_expr(ast, expr->subscript.index);
+            return compact_ast_add_expr_subscript(ast, receiver, index, expr->subscript.end);
+        }
+        case EXPR_SLICE: {
+            AstId receiver = add_expr(ast, expr->slice.receiver);
+            AstId lower = expr->slice.lower ? add_expr(ast, expr->slice.lower) : AST_NONE;
+            AstId upper = expr->slice.upper ? add_expr(ast, expr->slice.upper) : AST_NONE;
+            return compact_ast_add_expr_slice(ast, receiver, lower, upper, expr->slice.end);
+        }
+        case EXPR_CALL: {
+            AstId callee = add_expr(ast, expr->call.callee);
+            AstId args = add_exprs(ast, expr->call.args);
+            return compact_ast_add_expr_call(ast, callee, args, expr->call.end);
+        }
+        default:
+            assert(0 && "Invalid ExprKind");
+            return AST_NONE;
+    }
+}
+
+/**
+ * \brief Adds a copy of a sequence of expressions of the pointer-based AST.
+ * \param ast the compact AST
+ * \param expr the first expression of the sequence, can be NULL
+ * \return index of the first expression of the copy, `AST_NONE` if `expr` is NULL
+ */
+static AstId add_exprs(CompactAst *ast, const Expr *expr) {
+    AstId head = AST_NONE;
+    AstId tail = AST_NONE;
+    for (; expr; expr = expr->next) {
+        AstId id = add_expr(ast, expr);
+        if (tail == AST_NONE) {
+            head = id;
+        } else {
+            compact_ast_set_next_expr(ast, tail, id);
+        }
+        tail = id;
+    }
+    return head;
+}
+
+/**
+ * \brief Adds a copy of a statement of the pointer-based AST.
+ * \param ast the compact AST
+ * \param stmt the statement
+ * \return index of the copy
+ */
+static AstId add_stmt(CompactAst *ast, const Stmt *stmt) {
+    switch (stmt->kind) {
+        case STMT_EXPR:
+            return compact_ast_add_stmt_expr(ast, add_expr(ast, stmt->expr));
+        case STMT_ASSIGNMENT: {
+            AstId left = add_expr(ast, stmt->assignment.left);
+            AstId right = add_expr(ast, stmt->assignment.right);
+            return compact_ast_add_stmt_assignment(ast, left, right);
+        }
+        case STMT_AUG_ASSIGNMENT: {
+            AstId left = add_expr(ast, stmt->assignment.left);
+            AstId right = add_expr(ast, stmt->assignment.right);
+            return compact_ast_add_stmt_aug_assignment(ast, left, stmt->assignment.op, right);
+        }
+        case STMT_WHILE: {
+            AstId condition = add_expr(ast, stmt->while_stmt.condition);
+            AstId body = compact_ast_add_stmts(ast, stmt->while_stmt.body);
+            return compact_ast_add_stmt_while(ast, condition, body);
+        }
+        case STMT_FOR: {
+            AstId target = add_expr(ast, stmt->for_stmt.target);
+            AstId iterable = add_expr(ast, stmt->for_stmt.iterable);
+            AstId body = compact_ast_add_stmts(ast, stmt->for_stmt.body);
+            AstId id = compact_ast_add_stmt_for(ast, target, iterable, body);
+            ast->stmts.a[id + 1] = stmt->for_stmt.iter_slot;
+            return id;
+        }
+        case STMT_IF: {
+            AstId condition = add_expr(ast, stmt->if_stmt.condition);
+            AstId then_body = compact_ast_add_stmts(ast, stmt->if_stmt.then_body);
+            AstId else_body = compact_ast_add_stmts(ast, stmt->if_stmt.else_body);
+            return compact_ast_add_stmt_if(ast, condition, then_body, else_body);
+        }
+        case STMT_PASS:
+            return compact_ast_add_stmt_pass(ast);
+        case STMT_PRINT:
+            return compact_ast_add_stmt_print(ast, add_expr(ast, stmt->expr));
+        default:
+            assert(0 && "Invalid StmtKind");
+            return AST_NONE;
+    }
+}
+
+AstId compact_ast_add_stmts(CompactAst *ast, const Stmt *stmt) {
+    AstId head = AST_NONE;
+    AstId tail = AST_NONE;
+    for (; stmt; stmt = stmt->next) {
+        AstId id = add_stmt(ast, stmt);
+        if (tail == AST_NONE) {
+            head = id;
+        } else {
+            compact_ast_set_next_stmt(ast, tail, id);
+        }
+        tail = id;
+    }
+    return head;
+}
+
+const char *compact_ast_get_expr_start(const CompactAst *ast, AstId expr) {
+    const AstNodes *exprs = &ast->exprs;
+    while (exprs->kind[expr] == EXPR_BINARY || exprs->kind[expr] == EXPR_SUBSCRIPT
+           || exprs->kind[expr] == EXPR_SLICE || exprs->kind[expr] == EXPR_CALL) {
+        expr = exprs->a[expr];
+    }
+    return ast->base + exprs->a[expr];
+}
+
+const char *compact_ast_get_expr_end(const CompactAst *ast, AstId expr) {
+    const AstNodes *exprs = &ast->exprs;
+    while (exprs->kind[expr] == EXPR_BINARY) {
+        expr = exprs->b[expr];
+    }
+    switch (exprs->kind[expr]) {
+        case EXPR_SUBSCRIPT:
+        case EXPR_CALL:
+            return ast->base + exprs->c[expr];
+        case EXPR_SLICE:
+            return ast->base + exprs->a[expr + 1];
+        default:
+            return ast->base + exprs->b[expr];
+    }
+}
+
+size_t compact_ast_get_size(const CompactAst *ast) {
+    const size_t node_size = sizeof(uint8_t) + sizeof(AstId) + 3 * sizeof(uint32_t);
+    return ((size_t) ast->exprs.count + ast->stmts.count) * node_size;
+}
+
+static void dump_exprs(StringBuilder *sb, const CompactAst *ast, AstId expr, int indent);
+
+/**
+ * \brief Dumps the given expression to the given string builder.
+ * \param sb the string builder
+ * \param ast the compact AST
+ * \param expr the expression to dump
+ * \param indent the indentation level
+ * \param label the label to print before the expression
+ */
+static void dump_expr(StringBuilder *sb, const CompactAst *ast, AstId expr, int indent, const char *label) {
+    const AstNodes *exprs = &ast->exprs;
+    sb_append_formatted(sb, "%*s", indent, "");
+    if (label) {
+        sb_append_formatted(sb, "%s: ", label);
+    }
+    int length = (int) (exprs->b[expr] - exprs->a[expr]);
+    const char *start = ast->base + exprs->a[expr];
+    switch (exprs->kind[expr]) {
+        case EXPR_INT_LITERAL:
+            sb_append_formatted(sb, "EXPR_INT_LITERAL {literal: \"%.*s\"}\n", length, start);
+            break;
+        case EXPR_STR_LITERAL:
+            sb_append_formatted(sb, "EXPR_STR_LITERAL {literal: %.*s}\n", length, start);
+            break;
+        case EXPR_LIST_LITERAL:
+            sb_append_formatted(sb, "EXPR_LIST_LITERAL\n");
+            dump_exprs(sb, ast, exprs->c[expr], indent);
+            break;
+        case EXPR_DICT_LITERAL:
+            sb_append_formatted(sb, "EXPR_DICT_LITERAL\n");
+            for (AstId key = exprs->c[expr]; key != AST_NONE; key = exprs->next[exprs->next[key]]) {
+                dump_expr(sb, ast, key, indent + 2, "key");
+                dump_expr(sb, ast, exprs->next[key], indent + 2, "value");
+            }
+            break;
+        case EXPR_NAME:
+            sb_append_formatted(sb, "EXPR_NAME {identifier: \"%.*s\"}\n", length, start);
+            break;
+        case EXPR_BINARY:
+            sb_append_formatted(sb, "EXPR_BINARY {op: %s}\n", ast_get_binary_op_name(exprs->c[expr]));
+            dump_expr(sb, ast, exprs->a[expr], indent + 2, "left");
+            dump_expr(sb, ast, exprs->b[expr], indent + 2, "right");
+            break;
+        case EXPR_SUBSCRIPT:
+            sb_append_str(sb, "EXPR_SUBSCRIPT\n");
+            dump_expr(sb, ast, exprs->a[expr], indent + 2, "receiver");
+            dump_expr(sb, ast, exprs->b[expr], indent + 2, "index");
+            break;
+        case EXPR_SLICE:
+            sb_append_str(sb, "EXPR_SLICE\n");
+            dump_expr(sb, ast, exprs->a[expr], indent + 2, "receiver");
+            if (exprs->b[expr] != AST_NONE) {
+                dump_expr(sb, ast, exprs->b[expr], indent + 2, "lower");
+            }
+            if (exprs->c[expr] != AST_NONE) {
+                dump_expr(sb, ast, exprs->c[expr], indent + 2, "upper");
+            }
+            break;
+        case EXPR_CALL: {
+            AstId callee = exprs->a[expr];
+            sb_append_formatted(sb, "EXPR_CALL {function: \"%.*s\"}\n", (int) (exprs->b[callee] - exprs->a[callee]),
+                                ast->base + exprs->a[callee]);
+            dump_exprs(sb, ast, exprs->b[expr], indent);
+            break;
+        }
+        default:
+            assert(0 && "Invalid ExprKind");
+    }
+}
+
+/**
+ * \brief Dumps the given sequence of expressions to the given string builder.
+ * \param sb the string builder
+ * \param ast the compact AST
+ * \param expr the first expression to dump
+ * \param indent the indentation level
+ */
+static void dump_exprs(StringBuilder *sb, const CompactAst *ast, AstId expr, int indent) {
+    for (; expr != AST_NONE; expr = ast->exprs.next[expr]) {
+        dump_expr(sb, ast, expr, indent + 2, NULL);
+    }
+}
+
+static void dump_stmts(StringBuilder *sb, const CompactAst *ast, AstId stmt, int indent, const char *label);
+
+/**
+ * \brief Dumps the given statement to the given string builder.
+ * \param sb the string builder
+ * \param ast the compact AST
+ * \param stmt the statement to dump
+ * \param indent the indentation level
+ */
+static void dump_stmt(StringBuilder *sb, const CompactAst *ast, AstId stmt, int indent) {
+    const AstNodes *stmts = &ast->stmts;
+    sb_append_formatted(sb, "%*s", indent, "");
+    switch (stmts->kind[stmt]) {
+        case STMT_EXPR:
+            sb_append_str(sb, "STMT_EXPR\n");
+            dump_expr(sb, ast, stmts->a[stmt], indent + 2, "expr");
+            break;
+        case STMT_ASSIGNMENT:
+            sb_append_str(sb, "STMT_ASSIGNMENT\n");
+            dump_expr(sb, ast, stmts->a[stmt], indent + 2, "left");
+            dump_expr(sb, ast, stmts->b[stmt], indent + 2, "right");
+            break;
+        case STMT_AUG_ASSIGNMENT:
+            sb_append_formatted(sb, "STMT_AUG_ASSIGNMENT {op: %s}\n", ast_get_binary_op_name(stmts->c[stmt]));
+            dump_expr(sb, ast, stmts->a[stmt], indent + 2, "left");
+            dump_expr(sb, ast, stmts->b[stmt], indent + 2, "right");
+            break;
+        case STMT_WHILE:
+            sb_append_str(sb, "STMT_WHILE\n");
+            dump_expr(sb, ast, stmts->a[stmt], indent + 2, "condition");
+            dump_stmts(sb, ast, stmts->b[stmt], indent + 2, "body");
+            break;
+        case STMT_FOR:
+            sb_append_str(sb, "STMT_FOR\n");
+            dump_expr(sb, ast, stmts->a[stmt], indent + 2, "target");
+            dump_expr(sb, ast, stmts->b[stmt], indent + 2, "iterable");
+            dump_stmts(sb, ast, stmts->c[stmt], indent + 2, "body");
+            break;
+        case STMT_IF:
+            sb_append_str(sb, "STMT_IF\n");
+            dump_expr(sb, ast, stmts->a[stmt], indent + 2, "condition");
+            dump_stmts(sb, ast, stmts->b[stmt], indent + 2, "then_body");
+            dump_stmts(sb, ast, stmts->c[stmt], indent + 2, "else_body");
+            break;
+        case STMT_PASS:
+            sb_append_str(sb, "STMT_PASS\n");
+            break;
+        case STMT_PRINT:
+            sb_append_str(sb, "STMT_PRINT\n");
+            dump_expr(sb, ast, stmts->a[stmt], indent + 2, "expr");
+            break;
+        default:
+            assert(0 && "Invalid StmtKind");
+    }
+}
+
+/**
+ * \brief Dumps the given sequence of statements to the given string builder.
+ * \param sb the string builder
+ * \param ast the compact AST
+ * \param stmt the first statement to dump
+ * \param indent the indentation level
+ * \param label the label to print before the statements
+ */
+static void dump_stmts(StringBuilder *sb, const CompactAst *ast, AstId stmt, int indent, const char *label) {
+    if (label) {
+        sb_append_formatted(sb, "%*s", indent, "");
+        sb_append_formatted(sb, "%s:\n", label);
+    }
+    for (; stmt != AST_NONE; stmt = ast->stmts.next[stmt]) {
+        dump_stmt(sb, ast, stmt, indent + 2);
+    }
+}
+
+void compact_ast_dump(StringBuilder *sb, const CompactAst *ast, AstId stmt) {
+    dump_stmts(sb, ast, stmt, 0, "AST dump");
+}
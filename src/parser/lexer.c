@@ -13,6 +13,9 @@
 #include "natrix/parser/lexer.h"
 #include <assert.h>
 #include <ctype.h>
+#include <stdint.h>
+#include <string.h>
+#include "natrix/util/simd.h"
 
 #if ENABLE_TOKEN_LOGGING
 #include "natrix/util/log.h"
@@ -35,6 +38,79 @@ static Token make_token(const Lexer *lexer, TokenType type) {
     return token;
 }
 
+/*
+ * Classification of runs of characters.
+ *
+ * Runs of spaces, digits, identifier characters and the bodies of comments and strings are scanned a vector
+ * of bytes at a time. For each kind of run, a classifier computes a mask with the bits corresponding to the bytes
+ * that end the run, the index of the lowest set bit is then the length of the run within the vector. Vectors are
+ * only loaded if they lie entirely before the null terminator, the rest of the source code is scanned bytewise.
+ */
+
+#if NX_SIMD
+//! Mask of the bytes that end a run of spaces.
+static inline uint64_t end_of_spaces(Vec v) {
+    return ~vec_mask(vec_eq(v, ' ')) & VEC_FULL_MASK;
+}
+
+//! Mask of the bytes that end a run of digits.
+static inline uint64_t end_of_digits(Vec v) {
+    return ~vec_mask(vec_in_range(v, '0', '9')) & VEC_FULL_MASK;
+}
+
+//! Mask of the bytes that end a run of identifier characters.
+static inline uint64_t end_of_identifier(Vec v) {
+    Vec alnum = vec_or(vec_in_range(vec_to_lower(v), 'a', 'z'), vec_in_range(v, '0', '9'));
+    return ~vec_mask(vec_or(alnum, vec_eq(v, '_'))) & VEC_FULL_MASK;
+}
+
+//! Mask of the bytes that end the body of a comment.
+static inline uint64_t end_of_comment(Vec v) {
+    return vec_mask(vec_eq(v, '\n'));
+}
+
+//! Mask of the bytes that end the body of a string literal.
+static inline uint64_t end_of_string(Vec v) {
+    return vec_mask(vec_or(vec_eq(v, '"'), vec_eq(v, '\n')));
+}
+
+/**
+ * \brief Skips the vectors of bytes that do not contain any byte ending the run.
+ * \param p the start of the run
+ * \param end the null terminator of the source code
+ * \param classify the classifier of the run
+ * \return the end of the run or a position close to the null terminator from which the run must be scanned bytewise
+ */
+static inline const char *scan_vectors(const char *p, const char *end, uint64_t (*classify)(Vec)) {
+    while (end - p >= VEC_SIZE) {
+        uint64_t stop = classify(vec_load(p));
+        if (stop != 0) {
+            return p + vec_mask_first(stop);
+        }
+        p += VEC_SIZE;
+    }
+    return p;
+}
+
+#define SCAN_VECTORS(p, end, classify) ((p) = scan_vectors((p), (end), (classify)))
+#else
+#define SCAN_VECTORS(p, end, classify) ((void) 0)
+#endif
+
+/**
+ * \brief Skips spaces.
+ * \param p pointer into the source code
+ * \param end the null terminator of the source code
+ * \return pointer to the first character which is not a space
+ */
+static inline const char *skip_spaces(const char *p, const char *end) {
+    SCAN_VECTORS(p, end, end_of_spaces);
+    while (*p == ' ') {
+        p++;
+    }
+    return p;
+}
+
 /**
  * \brief Skips whitespace and comments.
  *
@@ -50,12 +126,11 @@ static Token make_token(const Lexer *lexer, TokenType type) {
  * \param lexer pointer to the lexer
  */
 static void skip_whitespace(Lexer *lexer) {
-    while (*lexer->current == ' ') {
-        lexer->current++;
-    }
+    lexer->current = skip_spaces(lexer->current, lexer->end);
     lexer->start = lexer->current;      // this is where the token starts
     if (*lexer->current == '#') {
         // skip characters until the end of the line
+        SCAN_VECTORS(lexer->current, lexer->end, end_of_comment);
         while (*lexer->current != '\n') {
             assert(*lexer->current != '\0' && "source code must end with a newline");
             lexer->current++;
@@ -106,21 +181,42 @@ static TokenType handle_indentation_change(Lexer *lexer, size_t indent) {
 }
 
 /**
- * \brief Compares the given keyword with the token and returns the appropriate token type.
- * \param ptr pointer to the start of the token
- * \param end pointer to the end of the token
- * \param keyword the keyword to compare
- * \param type the type of the token if the keyword matches
- * \return the type of the token, either `type` or `TOKEN_IDENTIFIER`
+ * \brief Entry of the keyword table.
  */
-static TokenType check_keyword(const char *ptr, const char *end, const char *keyword, TokenType type) {
-    while (ptr < end && *keyword != '\0' && *ptr == *keyword) {
-        ptr++;
-        keyword++;
-    }
-    return ptr == end && *keyword == '\0' ? type : TOKEN_IDENTIFIER;
+typedef struct {
+    const char *name;               //!< The keyword, NULL for unused entries
+    size_t length;                  //!< Length of the keyword
+    TokenType type;                 //!< Type of the token
+} Keyword;
+
+//! Number of entries of the keyword table, a power of two.
+#define KEYWORD_TABLE_SIZE 16
+
+//! Length of the longest keyword.
+#define MAX_KEYWORD_LENGTH 5
+
+/**
+ * \brief Perfect hash function of the keywords.
+ * \param start pointer to the start of the identifier
+ * \param length length of the identifier, must be positive
+ * \return index into the keyword table
+ */
+static inline size_t keyword_hash(const char *start, size_t length) {
+    return ((unsigned char) start[0] + 3u * (unsigned char) start[length - 1] + 4u * length) & (KEYWORD_TABLE_SIZE - 1);
 }
 
+//! Keywords indexed by `keyword_hash()`, which maps each keyword to a different entry.
+static const Keyword KEYWORDS[KEYWORD_TABLE_SIZE] = {
+        [0] = {"print", 5, TOKEN_KW_PRINT},
+        [3] = {"if", 2, TOKEN_KW_IF},
+        [4] = {"else", 4, TOKEN_KW_ELSE},
+        [7] = {"elif", 4, TOKEN_KW_ELIF},
+        [8] = {"for", 3, TOKEN_KW_FOR},
+        [9] = {"pass", 4, TOKEN_KW_PASS},
+        [10] = {"while", 5, TOKEN_KW_WHILE},
+        [11] = {"in", 2, TOKEN_KW_IN},
+};
+
 /**
  * \brief Determines whether the identifier is a keyword and returns the appropriate token type.
  * \param start pointer to the start of the token
@@ -129,31 +225,13 @@ static TokenType check_keyword(const char *ptr, const char *end, const char *key
  */
 static TokenType handle_identifier(const char *start, const char *end) {
     assert(start < end);
-    switch (*start) {
-        case 'e':
-            if (start + 2 < end && start[1] == 'l') {
-                switch (start[2]) {
-                    case 's':
-                        return check_keyword(start, end, "else", TOKEN_KW_ELSE);
-                    case 'i':
-                        return check_keyword(start, end, "elif", TOKEN_KW_ELIF);
-                }
-            }
-            break;
-        case 'i':
-            return check_keyword(start, end, "if", TOKEN_KW_IF);
-        case 'p':
-            if (start + 1 < end) {
-                switch (start[1]) {
-                    case 'a':
-                        return check_keyword(start, end, "pass", TOKEN_KW_PASS);
-                    case 'r':
-                        return check_keyword(start, end, "print", TOKEN_KW_PRINT);
-                }
-            }
-            break;
-        case 'w':
-            return check_keyword(start, end, "while", TOKEN_KW_WHILE);
+    size_t length = end - start;
+    if (length > MAX_KEYWORD_LENGTH) {
+        return TOKEN_IDENTIFIER;
+    }
+    const Keyword *keyword = &KEYWORDS[keyword_hash(start, length)];
+    if (keyword->length == length && memcmp(start, keyword->name, length) == 0) {
+        return keyword->type;
     }
     return TOKEN_IDENTIFIER;
 }
@@ -173,11 +251,9 @@ static TokenType parse_token(Lexer *lexer) {
     assert(lexer->pending_dedents == 0);
     if (lexer->empty_line) {
         // handle start of the line
-        size_t indent = 0;
-        while (*lexer->current == ' ') {
-            lexer->current++;
-            indent++;
-        }
+        const char *line_start = lexer->current;
+        lexer->current = skip_spaces(lexer->current, lexer->end);
+        size_t indent = lexer->current - line_start;
         if (*lexer->current != '#' && *lexer->current != '\n' && indent != lexer->indent_stack[lexer->indent_stack_size - 1]) {
             return handle_indentation_change(lexer, indent);
         }
@@ -185,12 +261,14 @@ static TokenType parse_token(Lexer *lexer) {
 
     skip_whitespace(lexer);
     if (isdigit(*lexer->current)) {
+        SCAN_VECTORS(lexer->current, lexer->end, end_of_digits);
         while (isdigit(*lexer->current)) {
             lexer->current++;
         }
         return TOKEN_INT_LITERAL;
     }
     if (isalpha(*lexer->current) || *lexer->current == '_') {
+        SCAN_VECTORS(lexer->current, lexer->end, end_of_identifier);
         while (isalnum(*lexer->current) || *lexer->current == '_') {
             lexer->current++;
         }
@@ -204,12 +282,28 @@ static TokenType parse_token(Lexer *lexer) {
         case '\n':
             return TOKEN_NEWLINE;
         case '+':
+            if (*lexer->current == '=') {
+                lexer->current++;
+                return TOKEN_PLUS_EQUALS;
+            }
             return TOKEN_PLUS;
         case '-':
+            if (*lexer->current == '=') {
+                lexer->current++;
+                return TOKEN_MINUS_EQUALS;
+            }
             return TOKEN_MINUS;
         case '*':
+            if (*lexer->current == '=') {
+                lexer->current++;
+                return TOKEN_STAR_EQUALS;
+            }
             return TOKEN_STAR;
         case '/':
+            if (*lexer->current == '=') {
+                lexer->current++;
+                return TOKEN_SLASH_EQUALS;
+            }
             return TOKEN_SLASH;
         case '(':
             return TOKEN_LPAREN;
@@ -219,6 +313,10 @@ static TokenType parse_token(Lexer *lexer) {
             return TOKEN_LBRACKET;
         case ']':
             return TOKEN_RBRACKET;
+        case '{':
+            return TOKEN_LBRACE;
+        case '}':
+            return TOKEN_RBRACE;
         case ',':
             return TOKEN_COMMA;
         case '=':
@@ -250,6 +348,7 @@ static TokenType parse_token(Lexer *lexer) {
             return TOKEN_GT;
         case '"':
             // todo escape sequences
+            SCAN_VECTORS(lexer->current, lexer->end, end_of_string);
             while (*lexer->current != '"') {
                 assert(*lexer->current != '\0');    // source code must end with a newline
                 if (*lexer->current == '\n') {
@@ -269,6 +368,7 @@ static TokenType parse_token(Lexer *lexer) {
 void lexer_init(Lexer *lexer, const char *source) {
     lexer->start = source;
     lexer->current = source;
+    lexer->end = source + strlen(source);
     lexer->empty_line = true;
     lexer->error_message = NULL;
     lexer->indent_stack[0] = 0;
@@ -27,6 +27,8 @@ typedef struct Parser {
     void *diag_data;                    //!< private data of the diagnostics handler
     Lexer lexer;                        //!< lexer used to tokenize the source code
     Token current;                      //!< current token
+    SymbolTable symbols;                //!< interned identifiers and literals
+    int nesting;                        //!< number of expressions being parsed, see `PARSER_MAX_NESTING`
 } Parser;
 
 /**
@@ -74,6 +76,28 @@ static bool match(Parser *parser, TokenType type, const char *message) {
 static Expr *expression(Parser *parser);
 static Stmt *block(Parser *parser);
 
+/**
+ * \brief Interns the text of a token.
+ * \param parser the parser state
+ * \param t the token
+ * \return the symbol
+ */
+static const Symbol *intern(Parser *parser, Token t) {
+    return symbol_intern(&parser->symbols, t.start, t.end - t.start);
+}
+
+/**
+ * \brief Creates a name node with the interned identifier.
+ * \param parser the parser state
+ * \param t the identifier token
+ * \return the new node
+ */
+static Expr *name(Parser *parser, Token t) {
+    Expr *expr = ast_create_expr_name(parser->arena, t.start, t.end);
+    expr->identifier.symbol = intern(parser, t);
+    return expr;
+}
+
 /**
  * \code
  * expression_list: expression (COMMA expression)* COMMA?
@@ -102,6 +126,41 @@ static Expr *expression_list(Parser *parser, TokenType sentinel) {
     }
 }
 
+/**
+ * \code
+ * dict_items: expression COLON expression (COMMA expression COLON expression)* COMMA?
+ * \endcode
+ * \return the keys and values, each key followed by its value
+ */
+static Expr *dict_items(Parser *parser) {
+    Expr *result = NULL;
+    Expr *last = NULL;
+    while (1) {
+        Expr *key = expression(parser);
+        if (!key || !match(parser, TOKEN_COLON, "expected ':'")) {
+            return NULL;
+        }
+        Expr *value = expression(parser);
+        if (!value) {
+            return NULL;
+        }
+        key->next = value;
+        if (last) {
+            last->next = key;
+        } else {
+            result = key;
+        }
+        last = value;
+        if (parser->current.type != TOKEN_COMMA) {
+            return result;
+        }
+        consume(parser);
+        if (parser->current.type == TOKEN_RBRACE) {
+            return result;
+        }
+    }
+}
+
 /**
  * \code
  * primary:
@@ -110,20 +169,24 @@ static Expr *expression_list(Parser *parser, TokenType sentinel) {
  *    | IDENTIFIER
  *    | LPAREN expression RPAREN
  *    | LBRACKET expression_list? RBRACKET
+ *    | LBRACE dict_items? RBRACE
  * \endcode
  */
 static Expr *primary(Parser *parser) {
     if (parser->current.type == TOKEN_INT_LITERAL) {
         Token t = consume(parser);
-        return ast_create_expr_int_literal(parser->arena, t.start, t.end);
+        Expr *expr = ast_create_expr_int_literal(parser->arena, t.start, t.end);
+        expr->literal.symbol = intern(parser, t);
+        return expr;
     }
     if (parser->current.type == TOKEN_STRING_LITERAL) {
         Token t = consume(parser);
-        return ast_create_expr_str_literal(parser->arena, t.start, t.end);
+        Expr *expr = ast_create_expr_str_literal(parser->arena, t.start, t.end);
+        expr->literal.symbol = intern(parser, t);
+        return expr;
     }
     if (parser->current.type == TOKEN_IDENTIFIER) {
-        Token t = consume(parser);
-        return ast_create_expr_name(parser->arena, t.start, t.end);
+        return name(parser, consume(parser));
     }
     if (parser->current.type == TOKEN_LPAREN) {
         consume(parser);
@@ -148,112 +211,200 @@ static Expr *primary(Parser *parser) {
         }
         return ast_create_expr_list_literal(parser->arena, start, end, expr);
     }
+    if (parser->current.type == TOKEN_LBRACE) {
+        const char *start = consume(parser).start;
+        const char *end;
+        Expr *items = NULL;
+        if (parser->current.type == TOKEN_RBRACE) {
+            end = consume(parser).end;
+        } else {
+            items = dict_items(parser);
+            end = parser->current.end;
+            if (!items || !match(parser, TOKEN_RBRACE, "expected closing brace")) {
+                return NULL;
+            }
+        }
+        return ast_create_expr_dict_literal(parser->arena, start, end, items);
+    }
     error(parser, "expected expression");
     return NULL;
 }
 
 /**
  * \code
- * postfix_expr: primary (LBRACKET expression RBRACKET)*
+ * slice_bound: expression | <empty>
  * \endcode
+ * \param parser the parser state
+ * \param stop the token following the bound
+ * \param result receives the bound, NULL if it is omitted
+ * \return false if an error was reported
  */
-static Expr *postfix_expr(Parser *parser) {
-    Expr *expr = primary(parser);
-    while (parser->current.type == TOKEN_LBRACKET) {
-        consume(parser);
-        Expr *index = expression(parser);
-        const char *end = parser->current.end;
-        if (!index || !match(parser, TOKEN_RBRACKET, "expected closing bracket")) {
-            return NULL;
-        }
-        expr = ast_create_expr_subscript(parser->arena, expr, index, end);
+static bool slice_bound(Parser *parser, TokenType stop, Expr **result) {
+    *result = NULL;
+    if (parser->current.type == stop) {
+        return true;
     }
-    return expr;
+    *result = expression(parser);
+    return *result != NULL;
 }
 
 /**
  * \code
- * multiplicative_expr:
- *    multiplicative_expr (STAR | SLASH) postfix_expr
- *    | postfix_expr
+ * call: LPAREN expression_list? RPAREN
  * \endcode
+ * \param parser the parser state
+ * \param callee the expression preceding the opening parenthesis, must be a name
  */
-static Expr *multiplicative_expr(Parser *parser) {
-    Expr *result = postfix_expr(parser);
-    while (result && (parser->current.type == TOKEN_STAR || parser->current.type == TOKEN_SLASH)) {
-        BinaryOp op = parser->current.type == TOKEN_STAR ? BINOP_MUL : BINOP_DIV;
-        consume(parser);
-        Expr *right = postfix_expr(parser);
-        result = right ? ast_create_expr_binary(parser->arena, result, op, right) : NULL;
+static Expr *call(Parser *parser, Expr *callee) {
+    assert(parser->current.type == TOKEN_LPAREN);
+    if (callee->kind != EXPR_NAME) {
+        parser->diag_handler(parser->diag_data, DIAG_ERROR, parser->source, ast_get_expr_start(callee),
+                             ast_get_expr_end(callee), "only functions can be called");
+        return NULL;
     }
-    return result;
+    consume(parser);
+    Expr *args = NULL;
+    if (parser->current.type != TOKEN_RPAREN) {
+        args = expression_list(parser, TOKEN_RPAREN);
+        if (!args) {
+            return NULL;
+        }
+    }
+    size_t count = 0;
+    for (const Expr *e = args; e; e = e->next) {
+        count++;
+    }
+    if (count > AST_MAX_ARGS) {
+        error(parser, "too many arguments");
+        return NULL;
+    }
+    const char *end = parser->current.end;
+    if (!match(parser, TOKEN_RPAREN, "expected ')'")) {
+        return NULL;
+    }
+    return ast_create_expr_call(parser->arena, callee, args, end);
 }
 
 /**
  * \code
- * additive_expr:
- *    additive_expr (PLUS | MINUS) multiplicative_expr
- *    | multiplicative_expr
+ * postfix_expr: primary (LBRACKET (expression | slice_bound COLON slice_bound) RBRACKET | call)*
  * \endcode
  */
-static Expr *additive_expr(Parser *parser) {
-    Expr *result = multiplicative_expr(parser);
-    while (result && (parser->current.type == TOKEN_PLUS || parser->current.type == TOKEN_MINUS)) {
-        BinaryOp op = parser->current.type == TOKEN_PLUS ? BINOP_ADD : BINOP_SUB;
+static Expr *postfix_expr(Parser *parser) {
+    Expr *expr = primary(parser);
+    while (expr && (parser->current.type == TOKEN_LBRACKET || parser->current.type == TOKEN_LPAREN)) {
+        if (parser->current.type == TOKEN_LPAREN) {
+            expr = call(parser, expr);
+            continue;
+        }
         consume(parser);
-        Expr *right = multiplicative_expr(parser);
-        result = right ? ast_create_expr_binary(parser->arena, result, op, right) : NULL;
+        Expr *index;
+        if (!slice_bound(parser, TOKEN_COLON, &index)) {
+            return NULL;
+        }
+        if (parser->current.type == TOKEN_COLON) {
+            consume(parser);
+            Expr *upper;
+            if (!slice_bound(parser, TOKEN_RBRACKET, &upper)) {
+                return NULL;
+            }
+            const char *end = parser->current.end;
+            if (!match(parser, TOKEN_RBRACKET, "expected closing bracket")) {
+                return NULL;
+            }
+            expr = ast_create_expr_slice(parser->arena, expr, index, upper, end);
+            continue;
+        }
+        const char *end = parser->current.end;
+        if (!index || !match(parser, TOKEN_RBRACKET, "expected closing bracket")) {
+            return NULL;
+        }
+        expr = ast_create_expr_subscript(parser->arena, expr, index, end);
     }
-    return result;
+    return expr;
 }
 
+/**
+ * \brief Binding powers of the binary operators, an operator with a higher power binds more tightly.
+ */
+typedef enum {
+    PREC_NONE,                          //!< The token is not a binary operator
+    PREC_RELATIONAL,                    //!< Comparisons, which do not chain
+    PREC_ADDITIVE,                      //!< Addition and subtraction
+    PREC_MULTIPLICATIVE,                //!< Multiplication and division
+} Precedence;
+
+/**
+ * \brief Parsing rule of a token following an operand.
+ */
+typedef struct {
+    Precedence precedence;              //!< Binding power of the operator, `PREC_NONE` if the token ends the operand
+    BinaryOp op;                        //!< The operator
+} BinaryRule;
+
+//! Rules of the binary operators by token type, all other tokens end the expression.
+static const BinaryRule BINARY_RULES[TOKEN_TYPE_COUNT] = {
+        [TOKEN_EQ] = {PREC_RELATIONAL, BINOP_EQ},
+        [TOKEN_NE] = {PREC_RELATIONAL, BINOP_NE},
+        [TOKEN_GT] = {PREC_RELATIONAL, BINOP_GT},
+        [TOKEN_GE] = {PREC_RELATIONAL, BINOP_GE},
+        [TOKEN_LT] = {PREC_RELATIONAL, BINOP_LT},
+        [TOKEN_LE] = {PREC_RELATIONAL, BINOP_LE},
+        [TOKEN_PLUS] = {PREC_ADDITIVE, BINOP_ADD},
+        [TOKEN_MINUS] = {PREC_ADDITIVE, BINOP_SUB},
+        [TOKEN_STAR] = {PREC_MULTIPLICATIVE, BINOP_MUL},
+        [TOKEN_SLASH] = {PREC_MULTIPLICATIVE, BINOP_DIV},
+};
+
 /**
  * \code
- * relational_expr:
- *     relational_expr (EQ | NE | GT | GE | LT | LE) additive_expr
- *     | additive_expr
+ * binary_expr:
+ *     binary_expr (STAR | SLASH) binary_expr
+ *     | binary_expr (PLUS | MINUS) binary_expr
+ *     | binary_expr (EQ | NE | GT | GE | LT | LE) binary_expr
+ *     | postfix_expr
  * \endcode
+ * Parsed by precedence climbing: operators of the same precedence are left-associative and are combined by the loop,
+ * only an operator of a higher precedence on the right needs a nested call, so the depth of the calls is bounded by
+ * the number of precedence levels instead of growing with the number of operators. Comparisons do not chain,
+ * `a < b < c` is a syntax error.
+ * \param parser the parser state
+ * \param min_precedence the lowest precedence of the operators the expression may contain
  */
-static Expr* relational_expr(Parser *parser) {
-    Expr *result = additive_expr(parser);
-    if (!result) {
-        return NULL;
-    }
-    BinaryOp op;
-    switch (parser->current.type) {
-        case TOKEN_EQ:
-            op = BINOP_EQ;
-            break;
-        case TOKEN_NE:
-            op = BINOP_NE;
-            break;
-        case TOKEN_GT:
-            op = BINOP_GT;
-            break;
-        case TOKEN_GE:
-            op = BINOP_GE;
-            break;
-        case TOKEN_LT:
-            op = BINOP_LT;
-            break;
-        case TOKEN_LE:
-            op = BINOP_LE;
+static Expr *binary_expr(Parser *parser, Precedence min_precedence) {
+    Expr *result = postfix_expr(parser);
+    Precedence max_precedence = PREC_MULTIPLICATIVE;
+    while (result) {
+        BinaryRule rule = BINARY_RULES[parser->current.type];
+        if (rule.precedence < min_precedence || rule.precedence > max_precedence) {
             break;
-        default:
-            return result;
+        }
+        consume(parser);
+        Expr *right = binary_expr(parser, rule.precedence + 1);
+        result = right ? ast_create_expr_binary(parser->arena, result, rule.op, right) : NULL;
+        if (rule.precedence == PREC_RELATIONAL) {
+            max_precedence = PREC_NONE;
+        }
     }
-    consume(parser);
-    Expr *right = additive_expr(parser);
-    return right ? ast_create_expr_binary(parser->arena, result, op, right) : NULL;
+    return result;
 }
 
 /**
  * \code
- * expression: relational_expr
+ * expression: binary_expr
  * \endcode
+ * Parentheses, brackets and braces nest expressions, the depth is limited by `PARSER_MAX_NESTING`, so that deeply
+ * nested input is reported as an error instead of overflowing the stack of the parser or of the later passes.
  */
 static Expr *expression(Parser *parser) {
-    return relational_expr(parser);
+    if (parser->nesting == PARSER_MAX_NESTING) {
+        error(parser, "expression nested too deeply");
+        return NULL;
+    }
+    parser->nesting++;
+    Expr *result = binary_expr(parser, PREC_RELATIONAL);
+    parser->nesting--;
+    return result;
 }
 
 /**
@@ -262,6 +413,7 @@ static Expr *expression(Parser *parser) {
  *     KW_PRINT LPAREN expression RPAREN
  *     | KW_PASS
  *     | expression EQUALS expression
+ *     | expression (PLUS_EQUALS | MINUS_EQUALS | STAR_EQUALS | SLASH_EQUALS) expression
  *     | expression
  * \endcode
  */
@@ -284,8 +436,25 @@ static Stmt *simple_statement(Parser *parser) {
     if (!expr) {
         return NULL;
     }
-    if (parser->current.type != TOKEN_EQUALS) {
-        return ast_create_stmt_expr(parser->arena, expr);
+    BinaryOp op;
+    switch (parser->current.type) {
+        case TOKEN_EQUALS:
+            op = BINOP_COUNT;
+            break;
+        case TOKEN_PLUS_EQUALS:
+            op = BINOP_ADD;
+            break;
+        case TOKEN_MINUS_EQUALS:
+            op = BINOP_SUB;
+            break;
+        case TOKEN_STAR_EQUALS:
+            op = BINOP_MUL;
+            break;
+        case TOKEN_SLASH_EQUALS:
+            op = BINOP_DIV;
+            break;
+        default:
+            return ast_create_stmt_expr(parser->arena, expr);
     }
     if (expr->kind != EXPR_NAME && expr->kind != EXPR_SUBSCRIPT) {
         parser->diag_handler(parser->diag_data, DIAG_ERROR, parser->source, ast_get_expr_start(expr),
@@ -294,7 +463,11 @@ static Stmt *simple_statement(Parser *parser) {
     }
     consume(parser);
     Expr *right = expression(parser);
-    return right ? ast_create_stmt_assignment(parser->arena, expr, right) : NULL;
+    if (!right) {
+        return NULL;
+    }
+    return op == BINOP_COUNT ? ast_create_stmt_assignment(parser->arena, expr, right)
+                             : ast_create_stmt_aug_assignment(parser->arena, expr, op, right);
 }
 
 /**
@@ -343,6 +516,7 @@ static Stmt *elif_block(Parser *parser) {
  * \code
  * statement:
  *     KW_WHILE expression COLON block
+ *     | KW_FOR IDENTIFIER KW_IN expression COLON block
  *     | KW_IF expression COLON block (elif_block | else_block)?
  *     | simple_statement NEWLINE
  * \endcode
@@ -358,6 +532,23 @@ static Stmt *statement(Parser *parser) {
             Stmt *body = block(parser);
             return body ? ast_create_stmt_while(parser->arena, cond, body) : NULL;
         }
+        case TOKEN_KW_FOR: {
+            consume(parser);
+            if (parser->current.type != TOKEN_IDENTIFIER) {
+                error(parser, "expected identifier");
+                return NULL;
+            }
+            Expr *target = name(parser, consume(parser));
+            if (!match(parser, TOKEN_KW_IN, "expected 'in'")) {
+                return NULL;
+            }
+            Expr *iterable = expression(parser);
+            if (!(iterable && match(parser, TOKEN_COLON, "expected ':'"))) {
+                return NULL;
+            }
+            Stmt *body = block(parser);
+            return body ? ast_create_stmt_for(parser->arena, target, iterable, body) : NULL;
+        }
         case TOKEN_KW_IF:
             // `if` differs from `elif` only in the keyword, we can use the same function to parse both
             return elif_block(parser);
@@ -412,11 +603,14 @@ Stmt *parse_file(Arena *arena, Source *source, DiagHandler diag_handler, void *d
     parser.source = source;
     parser.diag_handler = diag_handler;
     parser.diag_data = diag_data;
+    parser.symbols = symbol_table_init(arena);
+    parser.nesting = 0;
     lexer_init(&parser.lexer, source->start);
     parser.current = lexer_next_token(&parser.lexer);
 
     Stmt *result = statements(&parser, TOKEN_EOF);
     assert(result == NULL || parser.current.type == TOKEN_EOF);
+    symbol_table_free(&parser.symbols);
 
 #if ENABLE_AST_LOGGING
     StringBuilder sb = sb_init();
@@ -11,10 +11,16 @@
  */
 
 #include "natrix/parser/source.h"
+#include <fcntl.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "natrix/util/mem.h"
+#include "natrix/util/simd.h"
 
 /**
  * \brief Initializes the source code structure by copying the filename and the source code.
@@ -57,6 +63,94 @@ static Source init_source(const char *filename, const char *src, const char *src
         .end = dst,
         .line_count = line_count,
         .line_starts = NULL,
+        .mapping_size = 0,
+    };
+}
+
+/**
+ * \brief Counts the newlines in a buffer, unless it contains a carriage return.
+ * \param ptr pointer to the start of the buffer
+ * \param end pointer to the end of the buffer
+ * \param has_cr receives whether the buffer contains a carriage return, in which case the count is not valid
+ * \return the number of newlines
+ */
+static size_t count_newlines(const char *ptr, const char *end, bool *has_cr) {
+    size_t count = 0;
+#if NX_SIMD
+    for (; end - ptr >= VEC_SIZE; ptr += VEC_SIZE) {
+        Vec v = vec_load(ptr);
+        if (vec_mask(vec_eq(v, '\r')) != 0) {
+            *has_cr = true;
+            return 0;
+        }
+        count += vec_mask_count(vec_mask(vec_eq(v, '\n')));
+    }
+#endif
+    for (; ptr < end; ptr++) {
+        if (*ptr == '\r') {
+            *has_cr = true;
+            return 0;
+        }
+        count += *ptr == '\n';
+    }
+    *has_cr = false;
+    return count;
+}
+
+/**
+ * \brief Initializes the source code structure by mapping the file into memory, without copying.
+ *
+ * The file is mapped over a zero-filled anonymous mapping which is larger than the file, so that a newline can be
+ * appended and the source code is always followed by a null terminator. Only the pages that are accessed are read
+ * from the file and no page is copied, except the last one when the newline needs to be appended.
+ * \param filename the name of the file, will be copied to a new buffer
+ * \param fd the file descriptor of the file
+ * \param size the size of the file, must be positive
+ * \return the initialized source code, filled with NULLs if the file cannot be mapped or contains `\r`
+ */
+static Source map_source(const char *filename, int fd, size_t size) {
+    assert(size > 0);
+    const size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+    const size_t mapping_size = (size + 2 + page_size - 1) / page_size * page_size;
+    char *reserved = mmap(NULL, mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (reserved == MAP_FAILED) {
+        return (Source) {};
+    }
+    char *buffer = mmap(reserved, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+    if (buffer == MAP_FAILED) {
+        munmap(reserved, mapping_size);
+        return (Source) {};
+    }
+    bool has_cr;
+    size_t line_count = count_newlines(buffer, buffer + size, &has_cr) + 1;
+    if (has_cr) {
+        // line endings need to be normalized, which requires a copy anyway
+        munmap(buffer, mapping_size);
+        return (Source) {};
+    }
+    char *end = buffer + size;
+    if (end[-1] != '\n') {
+        // the page containing the end of the file may be mapped from the file, in which case it becomes a private copy
+        char *page = (char *) ((uintptr_t) end & ~(uintptr_t) (page_size - 1));
+        if (mprotect(page, page_size, PROT_READ | PROT_WRITE) != 0) {
+            munmap(buffer, mapping_size);
+            return (Source) {};
+        }
+        *end++ = '\n';
+        line_count++;
+    }
+    // the bytes after the end of the file are zero, both in the last page of the file and in the anonymous mapping
+    assert(*end == '\0');
+
+    char *filename_copy = nx_alloc(strlen(filename) + 1);
+    strcpy(filename_copy, filename);
+    return (Source) {
+        .filename = filename_copy,
+        .start = buffer,
+        .end = end,
+        .line_count = line_count,
+        .line_starts = NULL,
+        .mapping_size = mapping_size,
     };
 }
 
@@ -72,46 +166,60 @@ static const char **get_line_starts(Source *source) {
         source->line_starts = (const char **) nx_alloc((source->line_count + 1) * sizeof(char *));
         const char **line_start = source->line_starts;
         const char *ptr = source->start;
-        while (ptr < source->end) {
-            *line_start++ = ptr;
-            while (*ptr != '\n') {
-                ptr++;
+        *line_start++ = ptr;
+        // every line, including the last one, ends with a newline which is followed by the start of the next line
+#if NX_SIMD
+        for (; source->end - ptr >= VEC_SIZE; ptr += VEC_SIZE) {
+            uint64_t mask = vec_mask(vec_eq(vec_load(ptr), '\n'));
+            while (mask != 0) {
+                *line_start++ = ptr + vec_mask_first(mask) + 1;
+                mask = vec_mask_clear_first(mask);
             }
-            ptr++;
         }
-        *line_start++ = ptr;
-        *line_start = ptr + 1;      // simplifies the implementation of source_get_line_end
+#endif
+        for (; ptr < source->end; ptr++) {
+            if (*ptr == '\n') {
+                *line_start++ = ptr + 1;
+            }
+        }
+        assert(line_start == source->line_starts + source->line_count);
+        *line_start = source->end + 1;      // simplifies the implementation of source_get_line_end
     }
     return source->line_starts;
 }
 
 Source source_from_file(const char *filename) {
-    FILE *file = fopen(filename, "rb");
-    if (!file) {
-        goto error;
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return (Source) {};
     }
-    if (fseek(file, 0, SEEK_END) != 0) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
         goto error;
     }
-    const long file_size = ftell(file);
-    if (file_size < 0) {
-        goto error;
-    }
-    if (fseek(file, 0, SEEK_SET) != 0) {
-        goto error;
+    const size_t file_size = (size_t) st.st_size;
+    if (file_size > 0) {
+        Source source = map_source(filename, fd, file_size);
+        if (source.start) {
+            close(fd);
+            return source;
+        }
     }
     char *buffer = nx_alloc(file_size + 2);
-    if (fread(buffer, 1, file_size, file) != (size_t) file_size) {
-        nx_free(buffer);
-        goto error;
+    size_t total = 0;
+    while (total < file_size) {
+        ssize_t count = read(fd, buffer + total, file_size - total);
+        if (count <= 0) {
+            nx_free(buffer);
+            goto error;
+        }
+        total += count;
     }
-    fclose(file);
+    close(fd);
     return init_source(filename, buffer, buffer + file_size, buffer);
 
 error:
-    if (file) {
-        fclose(file);
-    }
+    close(fd);
     return (Source) {};
 }
 
@@ -123,7 +231,11 @@ Source source_from_string(const char *filename, const char *string) {
 
 void source_free(Source *source) {
     nx_free((char *) source->filename);
-    nx_free((char *) source->start);
+    if (source->mapping_size > 0) {
+        munmap((char *) source->start, source->mapping_size);
+    } else {
+        nx_free((char *) source->start);
+    }
     nx_free(source->line_starts);
 }
 
@@ -140,15 +252,15 @@ size_t source_get_line_number(Source *source, const char *position) {
             low = mid + 1;
         }
     }
-    return low;
+    return source->first_line + low;
 }
 
 const char *source_get_line_start(Source *source, size_t line) {
-    assert(line > 0 && line <= source->line_count);
-    return get_line_starts(source)[line - 1];
+    assert(line > source->first_line && line <= source->first_line + source->line_count);
+    return get_line_starts(source)[line - source->first_line - 1];
 }
 
 const char *source_get_line_end(Source *source, size_t line) {
-    assert(line > 0 && line <= source->line_count);
-    return get_line_starts(source)[line] - 1;
+    assert(line > source->first_line && line <= source->first_line + source->line_count);
+    return get_line_starts(source)[line - source->first_line] - 1;
 }
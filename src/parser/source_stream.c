@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file source_stream.c
+ * \brief Implementation of the streaming of source files.
+ */
+
+#include "natrix/parser/source_stream.h"
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include "natrix/util/mem.h"
+
+bool source_stream_open(SourceStream *stream, const char *filename, size_t chunk_size) {
+    assert(chunk_size > 0);
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    char *filename_copy = nx_alloc(strlen(filename) + 1);
+    strcpy(filename_copy, filename);
+    *stream = (SourceStream) {
+        .fd = fd,
+        .buffer = nx_alloc(1),
+        .capacity = 1,
+        .length = 0,
+        .consumed = 0,
+        .chunk_size = chunk_size,
+        .pending_cr = false,
+        .read_any = false,
+        .failed = false,
+        .source = {.filename = filename_copy},
+    };
+    stream->buffer[0] = '\0';
+    return true;
+}
+
+/**
+ * \brief Reads the next chunk of the file and appends it to the buffer with normalized line endings.
+ *
+ * At the end of the file, closes the file and appends a newline unless the file ends with one.
+ * \param stream the stream
+ * \return false if there is nothing more to read
+ */
+static bool read_chunk(SourceStream *stream) {
+    if (stream->fd < 0) {
+        return false;
+    }
+    // room for the chunk, the newline appended at the end of the file and the null terminator
+    if (stream->capacity - stream->length < stream->chunk_size + 2) {
+        size_t capacity = stream->capacity * 2;
+        if (capacity < stream->length + stream->chunk_size + 2) {
+            capacity = stream->length + stream->chunk_size + 2;
+        }
+        stream->buffer = nx_realloc(stream->buffer, capacity);
+        stream->capacity = capacity;
+    }
+    char *dst = stream->buffer + stream->length;
+    ssize_t count;
+    do {
+        count = read(stream->fd, dst, stream->chunk_size);
+    } while (count < 0 && errno == EINTR);
+    if (count <= 0) {
+        stream->failed = count < 0;
+        close(stream->fd);
+        stream->fd = -1;
+        // the statements returned before always end with a newline
+        if (stream->length > 0 ? stream->buffer[stream->length - 1] != '\n' : !stream->read_any) {
+            stream->buffer[stream->length++] = '\n';
+        }
+        stream->buffer[stream->length] = '\0';
+        return !stream->failed;
+    }
+    stream->read_any = true;
+    const char *src = dst;
+    const char *end = dst + count;
+    if (stream->pending_cr && *src == '\n') {
+        src++;
+    }
+    stream->pending_cr = false;
+    while (src < end) {
+        char c = *src++;
+        if (c == '\r') {
+            c = '\n';
+            if (src == end) {
+                stream->pending_cr = true;
+            } else if (*src == '\n') {
+                src++;
+            }
+        }
+        *dst++ = c;
+    }
+    stream->length = dst - stream->buffer;
+    stream->buffer[stream->length] = '\0';
+    return true;
+}
+
+/**
+ * \brief Determines whether a line is a clause of a compound statement at the top level.
+ * \param line the start of the line
+ * \param keyword the keyword starting the clause
+ * \return true if the line starts with the keyword
+ */
+static bool is_clause(const char *line, const char *keyword) {
+    size_t length = strlen(keyword);
+    return strncmp(line, keyword, length) == 0 && !isalnum((unsigned char) line[length]) && line[length] != '_';
+}
+
+/**
+ * \brief Determines whether a line starts a top-level statement.
+ *
+ * Blank lines and comments belong to the preceding statement, as do indented lines and the `elif` and `else`
+ * clauses of an `if`.
+ * \param line the start of the line, which ends with a newline
+ * \return true if the line starts a new top-level statement
+ */
+static bool starts_statement(const char *line) {
+    const char *p = line;
+    while (*p == ' ') {
+        p++;
+    }
+    if (*p == '#' || *p == '\n' || p != line) {
+        return false;
+    }
+    return !is_clause(line, "elif") && !is_clause(line, "else");
+}
+
+Source *source_stream_next(SourceStream *stream) {
+    if (stream->consumed > 0) {
+        // discard the statements returned last
+        stream->buffer[stream->consumed] = stream->saved;
+        stream->length -= stream->consumed;
+        memmove(stream->buffer, stream->buffer + stream->consumed, stream->length + 1);
+        stream->source.first_line += stream->source.line_count - 1;
+        nx_free(stream->source.line_starts);
+        stream->source.line_starts = NULL;
+        stream->consumed = 0;
+    }
+    size_t end;                 // end of the statements to return
+    size_t lines;               // number of lines before `end`
+    size_t pos = 0;             // start of the next line to classify
+    size_t pos_lines = 0;       // number of lines before `pos`
+    bool in_statement = false;
+    while (true) {
+        const char *newline = memchr(stream->buffer + pos, '\n', stream->length - pos);
+        if (!newline) {
+            if (read_chunk(stream)) {
+                continue;
+            }
+            // at the end of the file, every line ends with a newline
+            assert(stream->failed || pos == stream->length);
+            end = pos;
+            lines = pos_lines;
+            break;
+        }
+        if (starts_statement(stream->buffer + pos)) {
+            if (in_statement && pos >= stream->chunk_size) {
+                end = pos;
+                lines = pos_lines;
+                break;
+            }
+            in_statement = true;
+        }
+        pos = newline - stream->buffer + 1;
+        pos_lines++;
+    }
+    if (stream->failed || end == 0) {
+        return NULL;
+    }
+    stream->consumed = end;
+    stream->saved = stream->buffer[end];
+    stream->buffer[end] = '\0';
+    stream->source.start = stream->buffer;
+    stream->source.end = stream->buffer + end;
+    stream->source.line_count = lines + 1;
+    return &stream->source;
+}
+
+bool source_stream_failed(const SourceStream *stream) {
+    return stream->failed;
+}
+
+void source_stream_close(SourceStream *stream) {
+    if (stream->fd >= 0) {
+        close(stream->fd);
+    }
+    nx_free((char *) stream->source.filename);
+    nx_free(stream->source.line_starts);
+    nx_free(stream->buffer);
+}
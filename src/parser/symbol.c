@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file symbol.c
+ * \brief Implementation of the symbol table.
+ */
+
+#include "natrix/parser/symbol.h"
+#include <assert.h>
+#include <string.h>
+#include "natrix/util/hash.h"
+#include "natrix/util/mem.h"
+
+//! Number of buckets allocated by the first insertion.
+#define INITIAL_CAPACITY 64
+
+/**
+ * \brief Doubles the number of buckets and reinserts the symbols.
+ * \param table the table
+ */
+static void grow(SymbolTable *table) {
+    size_t capacity = table->capacity ? table->capacity * 2 : INITIAL_CAPACITY;
+    Symbol **buckets = nx_alloc(capacity * sizeof(Symbol *));
+    memset(buckets, 0, capacity * sizeof(Symbol *));
+    for (size_t i = 0; i < table->capacity; i++) {
+        Symbol *symbol = table->buckets[i];
+        if (symbol) {
+            size_t j = symbol->hash & (capacity - 1);
+            while (buckets[j]) {
+                j = (j + 1) & (capacity - 1);
+            }
+            buckets[j] = symbol;
+        }
+    }
+    nx_free(table->buckets);
+    table->buckets = buckets;
+    table->capacity = capacity;
+}
+
+SymbolTable symbol_table_init(Arena *arena) {
+    return (SymbolTable) {
+            .arena = arena,
+            .buckets = NULL,
+            .capacity = 0,
+            .count = 0,
+    };
+}
+
+void symbol_table_free(SymbolTable *table) {
+    nx_free(table->buckets);
+    *table = symbol_table_init(table->arena);
+}
+
+const Symbol *symbol_intern(SymbolTable *table, const char *start, size_t length) {
+    // the load factor is kept at most 1/2, so that the probe sequences stay short
+    if (2 * (table->count + 1) > table->capacity) {
+        grow(table);
+    }
+    uint64_t hash = hash_bytes(start, length);
+    size_t i = hash & (table->capacity - 1);
+    Symbol *symbol;
+    while ((symbol = table->buckets[i]) != NULL) {
+        if (symbol->hash == hash && symbol->length == length && memcmp(symbol->start, start, length) == 0) {
+            return symbol;
+        }
+        i = (i + 1) & (table->capacity - 1);
+    }
+    assert(table->count < UINT32_MAX);
+    symbol = arena_alloc(table->arena, sizeof(Symbol));
+    *symbol = (Symbol) {.start = start, .length = length, .hash = hash, .id = table->count++};
+    table->buckets[i] = symbol;
+    return symbol;
+}
@@ -12,15 +12,19 @@
 
 #include "natrix/util/arena.h"
 #include <assert.h>
+#include <stdbool.h>
+#include "natrix/util/counters.h"
 #include "natrix/util/log.h"
 #include "natrix/util/mem.h"
 
-//! \brief Default size of a chunk
-#define DEFAULT_CHUNK_SIZE  8192
-
 //! \brief Size of the header of each chunk,
 #define HEADER_SIZE         NX_ALIGN_UP(sizeof(ArenaChunk))
 
+//! Free regular chunks of the current thread, linked using `next_chunk`.
+static _Thread_local ArenaChunk *pool = NULL;
+//! Number of chunks in `pool`.
+static _Thread_local size_t pool_count = 0;
+
 /**
  * \brief Allocates a new chunk of memory.
  * \param size_in_bytes size of the chunk in bytes
@@ -34,15 +38,66 @@ static ArenaChunk *alloc_chunk(size_t size_in_bytes) {
     chunk->end = chunk->start + size_in_bytes;
     chunk->ptr = chunk->start;
     chunk->next_chunk = NULL;
+    counter_add(COUNTER_ARENA_CHUNKS, 1);
     return chunk;
 }
 
+/**
+ * \brief Takes a regular chunk from the pool, or allocates a new one if there is no chunk of the right size.
+ * \param size_in_bytes size of the chunk in bytes
+ * \return pointer to the chunk
+ */
+static ArenaChunk *take_chunk(size_t size_in_bytes) {
+    ArenaChunk **link = &pool;
+    for (ArenaChunk *chunk = pool; chunk != NULL; link = &chunk->next_chunk, chunk = chunk->next_chunk) {
+        if ((size_t) (chunk->end - chunk->start) == size_in_bytes) {
+            *link = chunk->next_chunk;
+            pool_count--;
+            chunk->ptr = chunk->start;
+            chunk->next_chunk = NULL;
+            return chunk;
+        }
+    }
+    return alloc_chunk(size_in_bytes);
+}
+
+/**
+ * \brief Puts a regular chunk to the pool, or deallocates it if the pool is full.
+ * \param chunk the chunk
+ */
+static void give_chunk(ArenaChunk *chunk) {
+    if (pool_count == ARENA_POOL_LIMIT) {
+        nx_free(chunk);
+        return;
+    }
+    chunk->next_chunk = pool;
+    pool = chunk;
+    pool_count++;
+}
+
+/**
+ * \brief Determines whether the chunk is a special chunk allocated for a single large object.
+ * \param arena the arena
+ * \param chunk the chunk
+ * \return true if the chunk is larger than the regular chunks of the arena
+ */
+static bool is_special(const Arena *arena, const ArenaChunk *chunk) {
+    return (size_t) (chunk->end - chunk->start) > arena->chunk_size;
+}
+
 Arena arena_init() {
-    ArenaChunk *chunk = alloc_chunk(DEFAULT_CHUNK_SIZE);
+    return arena_init_with_chunk_size(ARENA_DEFAULT_CHUNK_SIZE);
+}
+
+Arena arena_init_with_chunk_size(size_t chunk_size) {
+    assert(chunk_size > 0);
+    chunk_size = NX_ALIGN_UP(chunk_size);
+    ArenaChunk *chunk = take_chunk(chunk_size);
     return (Arena) {
         .first_chunk = chunk,
         .current_chunk = chunk,
         .alloc_count = 0,
+        .chunk_size = chunk_size,
     };
 }
 
@@ -55,7 +110,11 @@ void arena_free(Arena *arena) {
     ArenaChunk *chunk = arena->first_chunk;
     while (chunk != NULL) {
         ArenaChunk *next = chunk->next_chunk;
-        nx_free(chunk);
+        if (is_special(arena, chunk)) {
+            nx_free(chunk);
+        } else {
+            give_chunk(chunk);
+        }
         chunk = next;
     }
 }
@@ -63,7 +122,7 @@ void arena_free(Arena *arena) {
 void *arena_alloc(Arena *arena, size_t size) {
     size = NX_ALIGN_UP(size);
     arena->alloc_count++;
-    if (size > DEFAULT_CHUNK_SIZE) {
+    if (size > arena->chunk_size) {
         ArenaChunk *chunk = alloc_chunk(size);
         chunk->next_chunk = arena->first_chunk;
         arena->first_chunk = chunk;
@@ -71,15 +130,64 @@ void *arena_alloc(Arena *arena, size_t size) {
         return chunk->start;
     }
     if (arena->current_chunk->ptr + size > arena->current_chunk->end) {
-        ArenaChunk *chunk = alloc_chunk(DEFAULT_CHUNK_SIZE);
-        arena->current_chunk->next_chunk = chunk;
-        arena->current_chunk = chunk;
+        if (arena->current_chunk->next_chunk == NULL) {
+            arena->current_chunk->next_chunk = take_chunk(arena->chunk_size);
+        }
+        // chunks following the current one are empty, they were kept by arena_rewind() or arena_reset()
+        arena->current_chunk = arena->current_chunk->next_chunk;
     }
     void *ptr = arena->current_chunk->ptr;
     arena->current_chunk->ptr += size;
     return ptr;
 }
 
+ArenaMark arena_mark(const Arena *arena) {
+    return (ArenaMark) {
+        .first_chunk = arena->first_chunk,
+        .current_chunk = arena->current_chunk,
+        .ptr = arena->current_chunk->ptr,
+        .alloc_count = arena->alloc_count,
+    };
+}
+
+void arena_rewind(Arena *arena, ArenaMark mark) {
+    // special chunks allocated since the mark are at the front of the list
+    while (arena->first_chunk != mark.first_chunk) {
+        ArenaChunk *next = arena->first_chunk->next_chunk;
+        assert(is_special(arena, arena->first_chunk));
+        nx_free(arena->first_chunk);
+        arena->first_chunk = next;
+    }
+    for (ArenaChunk *chunk = mark.current_chunk->next_chunk; chunk != NULL; chunk = chunk->next_chunk) {
+        chunk->ptr = chunk->start;
+    }
+    arena->current_chunk = mark.current_chunk;
+    arena->current_chunk->ptr = mark.ptr;
+    arena->alloc_count = mark.alloc_count;
+}
+
+void arena_reset(Arena *arena) {
+    ArenaChunk *chunk = arena->first_chunk;
+    while (is_special(arena, chunk)) {
+        chunk = chunk->next_chunk;
+    }
+    arena_rewind(arena, (ArenaMark) {
+        .first_chunk = chunk,
+        .current_chunk = chunk,
+        .ptr = chunk->start,
+        .alloc_count = 0,
+    });
+}
+
+void arena_release_pool() {
+    while (pool != NULL) {
+        ArenaChunk *next = pool->next_chunk;
+        nx_free(pool);
+        pool = next;
+    }
+    pool_count = 0;
+}
+
 void arena_get_stats(Arena *arena, ArenaStats *stats) {
     stats->alloc_count = arena->alloc_count;
     stats->chunk_count = 0;
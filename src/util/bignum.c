@@ -0,0 +1,363 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file bignum.c
+ * \brief Implementation of the arithmetic on arbitrary-precision unsigned integers.
+ */
+
+#include "natrix/util/bignum.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <string.h>
+#include "natrix/util/mem.h"
+
+//! Double-limb unsigned integer.
+typedef unsigned __int128 u128;
+
+//! Number of limbs of the shorter operand from which Karatsuba multiplication is used.
+#define KARATSUBA_THRESHOLD 32
+
+//! The largest power of ten which fits into a limb.
+#define DECIMAL_BASE 10000000000000000000ull
+//! Number of decimal digits stored in a limb in base `DECIMAL_BASE`.
+#define DECIMAL_BASE_DIGITS 19
+
+size_t bn_normalize(const uint64_t *a, size_t n) {
+    while (n > 0 && a[n - 1] == 0) {
+        n--;
+    }
+    return n;
+}
+
+int bn_compare(const uint64_t *a, size_t an, const uint64_t *b, size_t bn) {
+    assert(an == bn_normalize(a, an) && bn == bn_normalize(b, bn));
+    if (an != bn) {
+        return an < bn ? -1 : 1;
+    }
+    for (size_t i = an; i-- > 0;) {
+        if (a[i] != b[i]) {
+            return a[i] < b[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+uint64_t bn_add(uint64_t *r, const uint64_t *a, size_t an, const uint64_t *b, size_t bn) {
+    assert(an >= bn);
+    uint64_t carry = 0;
+    size_t i = 0;
+    for (; i < bn; i++) {
+        uint64_t sum;
+        bool c1 = __builtin_add_overflow(a[i], b[i], &sum);
+        bool c2 = __builtin_add_overflow(sum, carry, &r[i]);
+        carry = c1 | c2;
+    }
+    for (; i < an; i++) {
+        carry = __builtin_add_overflow(a[i], carry, &r[i]);
+    }
+    return carry;
+}
+
+uint64_t bn_sub(uint64_t *r, const uint64_t *a, size_t an, const uint64_t *b, size_t bn) {
+    assert(an >= bn);
+    uint64_t borrow = 0;
+    size_t i = 0;
+    for (; i < bn; i++) {
+        uint64_t diff;
+        bool b1 = __builtin_sub_overflow(a[i], b[i], &diff);
+        bool b2 = __builtin_sub_overflow(diff, borrow, &r[i]);
+        borrow = b1 | b2;
+    }
+    for (; i < an; i++) {
+        borrow = __builtin_sub_overflow(a[i], borrow, &r[i]);
+    }
+    return borrow;
+}
+
+uint64_t bn_mul_limb(uint64_t *r, size_t n, uint64_t m, uint64_t c) {
+    for (size_t i = 0; i < n; i++) {
+        u128 t = (u128) r[i] * m + c;
+        r[i] = (uint64_t) t;
+        c = (uint64_t) (t >> 64);
+    }
+    return c;
+}
+
+/**
+ * \brief Computes `r += a * m`.
+ * \param r the accumulator, `n` limbs
+ * \param a the number
+ * \param n the number of limbs of `a`
+ * \param m the multiplier
+ * \return the limb carried out of the accumulator
+ */
+static uint64_t mul_limb_add(uint64_t *r, const uint64_t *a, size_t n, uint64_t m) {
+    uint64_t carry = 0;
+    for (size_t i = 0; i < n; i++) {
+        u128 t = (u128) a[i] * m + r[i] + carry;
+        r[i] = (uint64_t) t;
+        carry = (uint64_t) (t >> 64);
+    }
+    return carry;
+}
+
+/**
+ * \brief Adds a number to an accumulator at the given limb offset, propagating the carry.
+ * \param r the accumulator, value must be large enough so that the carry does not overflow
+ * \param rn the number of limbs of `r`
+ * \param a the number to add
+ * \param an the number of limbs of `a`, at most `rn`
+ */
+static void add_into(uint64_t *r, size_t rn, const uint64_t *a, size_t an) {
+    uint64_t carry = bn_add(r, r, rn, a, an);
+    assert(carry == 0);
+    (void) carry;
+}
+
+void bn_mul(uint64_t *r, const uint64_t *a, size_t an, const uint64_t *b, size_t bn) {
+    if (an < bn) {
+        const uint64_t *t = a;
+        a = b;
+        b = t;
+        size_t tn = an;
+        an = bn;
+        bn = tn;
+    }
+    if (bn < KARATSUBA_THRESHOLD) {
+        memset(r, 0, (an + bn) * sizeof(uint64_t));
+        for (size_t j = 0; j < bn; j++) {
+            r[an + j] = mul_limb_add(r + j, a, an, b[j]);
+        }
+        return;
+    }
+    if (an >= 2 * bn) {
+        // unbalanced operands, multiply b by chunks of a of the same size
+        memset(r, 0, (an + bn) * sizeof(uint64_t));
+        uint64_t *t = nx_alloc(2 * bn * sizeof(uint64_t));
+        for (size_t offset = 0; offset < an; offset += bn) {
+            size_t len = an - offset < bn ? an - offset : bn;
+            bn_mul(t, a + offset, len, b, bn);
+            add_into(r + offset, an + bn - offset, t, len + bn);
+        }
+        nx_free(t);
+        return;
+    }
+    // a = a1 * B^m + a0, b = b1 * B^m + b0, where a1 and b1 are not empty since bn > an / 2 >= m
+    // a * b = z2 * B^2m + (z1 - z2 - z0) * B^m + z0 where z0 = a0 * b0, z2 = a1 * b1, z1 = (a0 + a1) * (b0 + b1)
+    size_t m = an / 2;
+    const uint64_t *a0 = a, *a1 = a + m, *b0 = b, *b1 = b + m;
+    size_t a1n = an - m, b1n = bn - m;
+    bn_mul(r, a0, m, b0, m);
+    bn_mul(r + 2 * m, a1, a1n, b1, b1n);
+
+    size_t san = a1n + 1;
+    size_t sbn = (b1n > m ? b1n : m) + 1;
+    uint64_t *sa = nx_alloc((san + sbn + san + sbn) * sizeof(uint64_t));
+    uint64_t *sb = sa + san;
+    uint64_t *z1 = sb + sbn;
+    sa[a1n] = bn_add(sa, a1, a1n, a0, m);
+    if (b1n >= m) {
+        sb[b1n] = bn_add(sb, b1, b1n, b0, m);
+    } else {
+        sb[m] = bn_add(sb, b0, m, b1, b1n);
+    }
+    san = bn_normalize(sa, san);
+    sbn = bn_normalize(sb, sbn);
+    bn_mul(z1, sa, san, sb, sbn);
+    size_t z1n = bn_normalize(z1, san + sbn);
+    size_t z0n = bn_normalize(r, 2 * m);
+    size_t z2n = bn_normalize(r + 2 * m, a1n + b1n);
+    bn_sub(z1, z1, z1n, r, z0n);
+    z1n = bn_normalize(z1, z1n);
+    bn_sub(z1, z1, z1n, r + 2 * m, z2n);
+    z1n = bn_normalize(z1, z1n);
+    add_into(r + m, an + bn - m, z1, z1n);
+    nx_free(sa);
+}
+
+/**
+ * \brief Computes the reciprocal of a normalized divisor, `floor((B^2 - 1) / d) - B` where `B = 2^64`.
+ * \param d the divisor, its most significant bit must be set
+ * \return the reciprocal
+ */
+static inline uint64_t reciprocal(uint64_t d) {
+    assert(d >> 63);
+    return (uint64_t) ((((u128) ~d) << 64 | ~(uint64_t) 0) / d);
+}
+
+/**
+ * \brief Divides a double-limb number by a normalized limb using its precomputed reciprocal.
+ *
+ * This is algorithm 4 from N. Möller and T. Granlund, Improved division by invariant integers, which avoids the
+ * expensive hardware division.
+ * \param rem receives the remainder
+ * \param u1 the most significant limb of the dividend, must be less than `d`
+ * \param u0 the least significant limb of the dividend
+ * \param d the divisor, its most significant bit must be set
+ * \param v the reciprocal of `d`
+ * \return the quotient
+ */
+static inline uint64_t div_2by1(uint64_t *rem, uint64_t u1, uint64_t u0, uint64_t d, uint64_t v) {
+    assert(u1 < d);
+    u128 q = (u128) v * u1 + ((u128) u1 << 64 | u0);
+    uint64_t q1 = (uint64_t) (q >> 64) + 1;
+    uint64_t q0 = (uint64_t) q;
+    uint64_t r = u0 - q1 * d;
+    if (r > q0) {
+        q1--;
+        r += d;
+    }
+    if (r >= d) {
+        q1++;
+        r -= d;
+    }
+    *rem = r;
+    return q1;
+}
+
+uint64_t bn_div_limb(uint64_t *q, const uint64_t *a, size_t n, uint64_t d) {
+    assert(d != 0);
+    if (n == 0) {
+        return 0;
+    }
+    int shift = __builtin_clzll(d);
+    d <<= shift;
+    uint64_t v = reciprocal(d);
+    uint64_t r;
+    if (shift == 0) {
+        r = 0;
+        for (size_t i = n; i-- > 0;) {
+            q[i] = div_2by1(&r, r, a[i], d, v);
+        }
+        return r;
+    }
+    r = a[n - 1] >> (64 - shift);
+    for (size_t i = n - 1; i > 0; i--) {
+        uint64_t u0 = a[i] << shift | a[i - 1] >> (64 - shift);
+        q[i] = div_2by1(&r, r, u0, d, v);
+    }
+    q[0] = div_2by1(&r, r, a[0] << shift, d, v);
+    return r >> shift;
+}
+
+void bn_divmod(uint64_t *q, uint64_t *r, const uint64_t *a, size_t an, const uint64_t *b, size_t bn) {
+    assert(bn > 0 && b[bn - 1] != 0 && an >= bn);
+    if (bn == 1) {
+        uint64_t *t = q ? q : nx_alloc(an * sizeof(uint64_t));
+        uint64_t rem = bn_div_limb(t, a, an, b[0]);
+        if (r) {
+            r[0] = rem;
+        }
+        if (!q) {
+            nx_free(t);
+        }
+        return;
+    }
+    // Knuth, The Art of Computer Programming, volume 2, algorithm 4.3.1 D
+    int shift = __builtin_clzll(b[bn - 1]);
+    uint64_t *v = nx_alloc((bn + an + 1) * sizeof(uint64_t));
+    uint64_t *u = v + bn;
+    for (size_t i = bn; i-- > 0;) {
+        v[i] = b[i] << shift | (shift && i > 0 ? b[i - 1] >> (64 - shift) : 0);
+    }
+    u[an] = shift ? a[an - 1] >> (64 - shift) : 0;
+    for (size_t i = an; i-- > 0;) {
+        u[i] = a[i] << shift | (shift && i > 0 ? a[i - 1] >> (64 - shift) : 0);
+    }
+    const uint64_t vh = v[bn - 1];
+    const uint64_t vl = v[bn - 2];
+    for (size_t j = an - bn + 1; j-- > 0;) {
+        u128 num = (u128) u[j + bn] << 64 | u[j + bn - 1];
+        u128 qhat = num / vh;
+        u128 rhat = num % vh;
+        while (qhat >> 64 || qhat * vl > (rhat << 64 | u[j + bn - 2])) {
+            qhat--;
+            rhat += vh;
+            if (rhat >> 64) {
+                break;
+            }
+        }
+        uint64_t carry = 0;
+        uint64_t borrow = 0;
+        for (size_t i = 0; i < bn; i++) {
+            u128 p = qhat * v[i] + carry;
+            carry = (uint64_t) (p >> 64);
+            uint64_t diff;
+            bool b1 = __builtin_sub_overflow(u[i + j], (uint64_t) p, &diff);
+            bool b2 = __builtin_sub_overflow(diff, borrow, &u[i + j]);
+            borrow = b1 | b2;
+        }
+        u128 sub = (u128) carry + borrow;
+        bool negative = u[j + bn] < sub;
+        u[j + bn] -= (uint64_t) sub;
+        if (negative) {
+            // the estimate was one too large, add the divisor back
+            qhat--;
+            u[j + bn] += bn_add(u + j, u + j, bn, v, bn);
+        }
+        if (q) {
+            q[j] = (uint64_t) qhat;
+        }
+    }
+    if (r) {
+        for (size_t i = 0; i < bn; i++) {
+            r[i] = u[i] >> shift | (shift && i + 1 < bn ? u[i + 1] << (64 - shift) : 0);
+        }
+    }
+    nx_free(v);
+}
+
+size_t bn_from_decimal(uint64_t *r, const char *str, size_t length) {
+    size_t n = 0;
+    size_t chunk = length % DECIMAL_BASE_DIGITS;
+    if (chunk == 0) {
+        chunk = DECIMAL_BASE_DIGITS;
+    }
+    uint64_t multiplier = 1;
+    for (size_t i = 0; i < chunk; i++) {
+        multiplier *= 10;
+    }
+    const char *end = str + length;
+    while (str < end) {
+        uint64_t value = 0;
+        for (size_t i = 0; i < chunk; i++) {
+            assert(str[i] >= '0' && str[i] <= '9');
+            value = value * 10 + (str[i] - '0');
+        }
+        str += chunk;
+        uint64_t carry = bn_mul_limb(r, n, multiplier, value);
+        if (carry) {
+            r[n++] = carry;
+        }
+        chunk = DECIMAL_BASE_DIGITS;
+        multiplier = DECIMAL_BASE;
+    }
+    return n;
+}
+
+void bn_append_decimal(StringBuilder *sb, const uint64_t *a, size_t n) {
+    n = bn_normalize(a, n);
+    if (n == 0) {
+        sb_append_char(sb, '0');
+        return;
+    }
+    // each limb needs less than two chunks of 19 digits
+    uint64_t *t = nx_alloc((n + 2 * n + 1) * sizeof(uint64_t));
+    uint64_t *chunks = t + n;
+    memcpy(t, a, n * sizeof(uint64_t));
+    size_t count = 0;
+    while (n > 0) {
+        chunks[count++] = bn_div_limb(t, t, n, DECIMAL_BASE);
+        n = bn_normalize(t, n);
+    }
+    sb_append_formatted(sb, "%lu", chunks[count - 1]);
+    for (size_t i = count - 1; i-- > 0;) {
+        sb_append_formatted(sb, "%019lu", chunks[i]);
+    }
+    nx_free(t);
+}
@@ -0,0 +1,21 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file counters.c
+ * \brief Implementation of the event counters.
+ */
+
+#include "natrix/util/counters.h"
+
+const char *const COUNTER_NAMES[COUNTER_COUNT] = {
+    [COUNTER_ENV_PROBES] = "env_probes",
+    [COUNTER_ARRAY_COPIES] = "array_copies",
+    [COUNTER_ARENA_CHUNKS] = "arena_chunks",
+};
+
+_Thread_local uint64_t counter_values[COUNTER_COUNT];
@@ -12,107 +12,997 @@
 
 #include "natrix/util/gc.h"
 #include <assert.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
 #include "natrix/util/log.h"
 #include "natrix/util/mem.h"
 #include "natrix/util/panic.h"
+#include "natrix/util/safepoint.h"
+#include "natrix/util/slab.h"
 
 #include "natrix/util/gc_internals.h"
 
 /**
- * \brief Internal state of the garbage collector.
+ * \brief State of the main heap, used by threads which have not switched to another heap.
  */
-static GcState gc = {
-    .head = NULL,
-    .objects_count = 0,
-    .threshold = 100,
-    .roots_count = 0,
-    .roots = {},
+static GcState main_state = {
+    .large = NULL,
+    .policy = {
+        .young_size = GC_DEFAULT_YOUNG_SIZE,
+        .initial_heap_size = GC_DEFAULT_INITIAL_HEAP_SIZE,
+        .growth_factor = GC_DEFAULT_GROWTH_FACTOR,
+        .max_heap_size = 0,
+        .mark_threads = GC_DEFAULT_MARK_THREADS,
+        .background_sweep = GC_DEFAULT_BACKGROUND_SWEEP,
+        .pause_budget_us = GC_DEFAULT_PAUSE_BUDGET_US,
+        .regions = {
+            .region_size = SLAB_DEFAULT_REGION_SIZE,
+            .pages = SLAB_PAGES_NORMAL,
+            .release = SLAB_RELEASE_DONTNEED,
+        },
+    },
+    .young_bytes = 0,
+    .old_bytes = 0,
+    .old_threshold = GC_DEFAULT_INITIAL_HEAP_SIZE,
+    .marked_bytes = 0,
+    .minor = false,
+    .parallel = false,
+    .marking = false,
+    .remembered = NULL,
+    .remembered_count = 0,
+    .remembered_capacity = 0,
+    .image_dirty = NULL,
+    .image_dirty_count = 0,
+    .image_dirty_capacity = 0,
+    .mark_stack = NULL,
+    .mark_stack_count = 0,
+    .mark_stack_capacity = 0,
+    .mark_stack_limit = GC_DEFAULT_MARK_STACK_LIMIT,
+    .mark_stack_overflow = false,
+    .stack_bottom = NULL,
+    .stack_roots = NULL,
+    .stack_roots_count = 0,
+    .stack_roots_capacity = 0,
+    .stats = {0},
+    .callback = NULL,
+    .callback_data = NULL,
+    .tracker = {.alloc = NULL, .collect = NULL, .data = NULL},
+    .tracked = NULL,
+    .tracked_count = 0,
+    .tracked_capacity = 0,
+    .slabs = NULL,
+    .sweeper = NULL,
+    .roots = {.items = NULL, .count = 0, .capacity = 0},
 };
 
-GcHeader *gc_alloc(size_t size_in_bytes, GcTraceFn trace_fn) {
+//! State of the heap the calling thread works with.
+static _Thread_local GcState *gc = &main_state;
+
+__thread GcRootStack gc_root_stack = {
+    .items = NULL,
+    .count = 0,
+    .capacity = 0,
+};
+
+//! Roots of the main heap, which are kept per thread, saved while the thread works with another heap.
+static _Thread_local GcRootStack main_roots = {
+    .items = NULL,
+    .count = 0,
+    .capacity = 0,
+};
+
+GcClass gc_classes[GC_MAX_CLASSES] = {
+    [GC_CLASS_LEAF] = {.trace_fn = NULL, .name = NULL, .defined = true},
+};
+
+//! Whether a heap dump has been requested by `gc_request_heap_dump()`.
+static volatile sig_atomic_t heap_dump_requested = 0;
+//! File to which the requested heap dumps are appended, NULL if none.
+static char *heap_dump_path = NULL;
+//! Protects `heap_dump_path` and serializes the writes to the file.
+static pthread_mutex_t heap_dump_lock = PTHREAD_MUTEX_INITIALIZER;
+
+//! Number of classes registered by `gc_register_class()`.
+static GcClassId dynamic_class_count = 0;
+//! Protects the registration of classes.
+static pthread_mutex_t class_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void gc_define_class(GcClassId id, GcTraceFn trace_fn, const char *name) {
+    assert(id < GC_FIRST_DYNAMIC_CLASS);
+    pthread_mutex_lock(&class_lock);
+    gc_classes[id] = (GcClass) {
+            .trace_fn = trace_fn,
+            .name = name,
+            .edge_name = gc_classes[id].edge_name,
+            .defined = true,
+    };
+    pthread_mutex_unlock(&class_lock);
+}
+
+GcClassId gc_register_class(GcTraceFn trace_fn, const char *name) {
+    pthread_mutex_lock(&class_lock);
+    GcClassId end = GC_FIRST_DYNAMIC_CLASS + dynamic_class_count;
+    for (GcClassId id = GC_FIRST_DYNAMIC_CLASS; id < end; id++) {
+        if (gc_classes[id].trace_fn == trace_fn && gc_classes[id].name == name) {
+            pthread_mutex_unlock(&class_lock);
+            return id;
+        }
+    }
+    if (end == GC_MAX_CLASSES) {
+        pthread_mutex_unlock(&class_lock);
+        PANIC("Too many classes of objects");
+    }
+    gc_classes[end] = (GcClass) {.trace_fn = trace_fn, .name = name, .defined = true};
+    dynamic_class_count++;
+    pthread_mutex_unlock(&class_lock);
+    return end;
+}
+
+void gc_set_edge_namer(GcClassId class_id, GcEdgeNameFn edge_name) {
+    assert(class_id < GC_MAX_CLASSES && gc_classes[class_id].defined);
+    pthread_mutex_lock(&class_lock);
+    gc_classes[class_id].edge_name = edge_name;
+    pthread_mutex_unlock(&class_lock);
+}
+
+/**
+ * \brief Frees a large object.
+ * \param ptr pointer to the object
+ */
+static void free_large(GcHeader *ptr) {
+    nx_free((char *) ptr - LARGE_PREFIX_SIZE);
+}
+
+/**
+ * \brief Allocates memory for an object without triggering garbage collection.
+ * \param size_in_bytes size of the object in bytes
+ * \return pointer to the object with initialized `mark` field or NULL if the memory cannot be allocated
+ */
+static GcHeader *alloc_object(size_t size_in_bytes) {
+    if (size_in_bytes <= SLAB_MAX_SIZE) {
+        GcHeader *ptr = slab_alloc(size_in_bytes);
+        if (ptr) {
+            assert(!slab_is_marked(ptr));
+            ptr->mark = GC_FLAG_SLAB;
+        }
+        return ptr;
+    }
+    char *block = nx_alloc_no_panic(LARGE_PREFIX_SIZE + size_in_bytes);
+    if (block == NULL) {
+        return NULL;
+    }
+    GcHeader *ptr = (GcHeader *) (block + LARGE_PREFIX_SIZE);
+    *gc_large_prefix(ptr) = (GcLargePrefix) {.next = gc->large, .size = size_in_bytes};
+    ptr->mark = GC_FLAG_LARGE;
+    gc->large = ptr;
+    return ptr;
+}
+
+/**
+ * \brief Records an object allocated while the allocation tracker is set.
+ * \param ptr the object
+ */
+static void track_object(GcHeader *ptr) {
+    if (gc->tracked_count == gc->tracked_capacity) {
+        gc->tracked_capacity = gc->tracked_capacity ? gc->tracked_capacity * 2 : 1024;
+        gc->tracked = nx_realloc(gc->tracked, gc->tracked_capacity * sizeof(GcTrackedObject));
+    }
+    size_t size = gc_object_size(ptr);
+    gc->tracked[gc->tracked_count++] = (GcTrackedObject) {
+            .obj = ptr,
+            .size = size,
+            .tag = gc->tracker.alloc(gc->tracker.data, size, gc_classes[ptr->class_id].name),
+    };
+}
+
+/**
+ * \brief Reports the objects recorded for the allocation tracker, must be called before the sweep.
+ */
+static void report_tracked_objects() {
+    for (size_t i = 0; i < gc->tracked_count; i++) {
+        GcTrackedObject *tracked = &gc->tracked[i];
+        gc->tracker.collect(gc->tracker.data, tracked->tag, tracked->size, gc_is_marked(tracked->obj));
+    }
+    gc->tracked_count = 0;
+}
+
+/**
+ * \brief Appends a heap dump to the file set by `gc_set_heap_dump_path()`, if any, and clears the request.
+ */
+static void dump_requested_heap() {
+    heap_dump_requested = 0;
+    pthread_mutex_lock(&heap_dump_lock);
+    FILE *out = heap_dump_path ? fopen(heap_dump_path, "a") : NULL;
+    if (out) {
+        gc_dump_heap(out, true);
+        fclose(out);
+    } else if (heap_dump_path) {
+        fprintf(stderr, "Unable to open the heap dump file %s\n", heap_dump_path);
+    }
+    pthread_mutex_unlock(&heap_dump_lock);
+}
+
+GcHeader *gc_alloc(size_t size_in_bytes, GcClassId class_id) {
+    assert(class_id < GC_MAX_CLASSES && gc_classes[class_id].defined);
     assert(size_in_bytes > sizeof(GcHeader));
-    if (gc.objects_count >= gc.threshold) {
+    if (gc->young_bytes > 0 && gc->young_bytes + size_in_bytes > gc->policy.young_size) {
+        if (gc->marking) {
+            gc_collect_step();
+        } else {
+            gc_collect_minor();
+        }
+        if (heap_dump_requested) {
+            dump_requested_heap();
+        }
+    }
+    size_t max_heap_size = gc->policy.max_heap_size;
+    if (max_heap_size && gc->old_bytes + gc->young_bytes + size_in_bytes > max_heap_size) {
         gc_collect();
+        if (gc->old_bytes + size_in_bytes > max_heap_size) {
+            PANIC("Maximum heap size exceeded");
+        }
     }
-    GcHeader *ptr = nx_alloc_no_panic(size_in_bytes);
+    GcHeader *ptr = alloc_object(size_in_bytes);
     if (ptr == NULL) {
         gc_collect();
-        ptr = nx_alloc(size_in_bytes);  // try again but panic this time
+        ptr = alloc_object(size_in_bytes);
+        if (ptr == NULL) {
+            PANIC("Out of memory");
+        }
+    }
+    ptr->class_id = class_id;
+    gc->young_bytes += gc_object_size(ptr);
+    gc->stats.allocated_objects++;
+    if (gc->tracker.alloc) {
+        track_object(ptr);
     }
-    ptr->next = gc.head;
-    ptr->trace_fn = trace_fn ? trace_fn : gc_trace_nop;
-    gc.head = ptr;
-    gc.objects_count++;
     return ptr;
 }
 
-void gc_root(GcHeader *root) {
-    if (gc.roots_count >= MAX_ROOTS) {
-        PANIC("too many GC roots");
+/**
+ * \brief Checks the validity of a policy, panics if it is invalid.
+ * \param policy the policy
+ */
+static void check_policy(const GcPolicy *policy) {
+    if (policy->young_size == 0 || policy->mark_threads == 0 || !(policy->growth_factor >= 1.0)
+            || policy->regions.region_size % SLAB_SIZE != 0) {
+        PANIC("Invalid garbage collector policy");
+    }
+}
+
+GcPolicy gc_default_policy() {
+    return (GcPolicy) {
+        .young_size = GC_DEFAULT_YOUNG_SIZE,
+        .initial_heap_size = GC_DEFAULT_INITIAL_HEAP_SIZE,
+        .growth_factor = GC_DEFAULT_GROWTH_FACTOR,
+        .max_heap_size = 0,
+        .mark_threads = GC_DEFAULT_MARK_THREADS,
+        .background_sweep = GC_DEFAULT_BACKGROUND_SWEEP,
+        .pause_budget_us = GC_DEFAULT_PAUSE_BUDGET_US,
+        .regions = slab_default_region_policy(),
+    };
+}
+
+GcPolicy gc_get_policy() {
+    return gc->policy;
+}
+
+void gc_set_policy(const GcPolicy *policy) {
+    check_policy(policy);
+    gc->policy = *policy;
+    slab_set_region_policy(&policy->regions);
+    if (gc->old_threshold < policy->initial_heap_size) {
+        gc->old_threshold = policy->initial_heap_size;
+    }
+}
+
+GcState *gc_state_create(const GcPolicy *policy) {
+    GcPolicy default_policy = gc_default_policy();
+    if (policy == NULL) {
+        policy = &default_policy;
+    }
+    check_policy(policy);
+    GcState *state = nx_alloc(sizeof(GcState));
+    memset(state, 0, sizeof(GcState));
+    state->policy = *policy;
+    state->old_threshold = policy->initial_heap_size;
+    state->mark_stack_limit = GC_DEFAULT_MARK_STACK_LIMIT;
+    state->slabs = slab_heap_create();
+    SlabHeap *prev = slab_set_heap(state->slabs);
+    slab_set_region_policy(&policy->regions);
+    slab_set_heap(prev);
+    return state;
+}
+
+void gc_state_destroy(GcState *state) {
+    assert(state != &main_state && state != gc);
+    GcState *prev = gc;
+    gc_bind_state(state);
+    gc_sweeper_stop();
+    gc_bind_state(prev);
+    GcHeader *header = state->large;
+    while (header != NULL) {
+        GcHeader *next = GC_NEXT(header);
+        free_large(header);
+        header = next;
+    }
+    slab_heap_destroy(state->slabs);
+    nx_free(state->remembered);
+    nx_free(state->image_dirty);
+    nx_free(state->mark_stack);
+    nx_free(state->stack_roots);
+    nx_free(state->tracked);
+    nx_free(state->roots.items);
+    nx_free(state);
+}
+
+GcState *gc_state_switch(GcState *state) {
+    if (state == NULL) {
+        state = &main_state;
+    }
+    GcState *prev = gc;
+    if (prev == &main_state) {
+        main_roots = gc_root_stack;
+    } else {
+        prev->roots = gc_root_stack;
+    }
+    gc_root_stack = state == &main_state ? main_roots : state->roots;
+    gc_bind_state(state);
+    return prev;
+}
+
+void gc_bind_state(GcState *state) {
+    gc = state;
+    slab_set_heap(state->slabs);
+}
+
+void gc_grow_roots() {
+    gc_root_stack.capacity = gc_root_stack.capacity ? gc_root_stack.capacity * 2 : 256;
+    gc_root_stack.items = nx_realloc(gc_root_stack.items, gc_root_stack.capacity * sizeof(GcHeader *));
+}
+
+/**
+ * \brief Pushes a marked object onto the mark stack.
+ *
+ * If the stack cannot grow, the object is left marked but untraced and the overflow flag is set,
+ * such objects are found later by `recover_mark_stack_overflow()`.
+ * \param ptr the marked object
+ */
+static void push_mark_stack(GcHeader *ptr) {
+    if (gc->mark_stack_count == gc->mark_stack_capacity) {
+        size_t new_capacity = gc->mark_stack_capacity ? gc->mark_stack_capacity * 2 : 256;
+        if (new_capacity > gc->mark_stack_limit) {
+            new_capacity = gc->mark_stack_limit;
+        }
+        GcHeader **new_stack = new_capacity > gc->mark_stack_capacity
+                               ? nx_realloc_no_panic(gc->mark_stack, new_capacity * sizeof(GcHeader *))
+                               : NULL;
+        if (new_stack == NULL) {
+            gc->mark_stack_overflow = true;
+            return;
+        }
+        gc->mark_stack = new_stack;
+        gc->mark_stack_capacity = new_capacity;
+    }
+    gc->mark_stack[gc->mark_stack_count++] = ptr;
+}
+
+/**
+ * \brief Traces the objects in the mark stack until it is empty.
+ */
+static void drain_mark_stack() {
+    while (gc->mark_stack_count > 0) {
+        GcHeader *ptr = gc->mark_stack[--gc->mark_stack_count];
+        if (gc->mark_stack_count > 0) {
+            // The next object may have been pushed long ago, start loading it while this one is traced
+            __builtin_prefetch(gc->mark_stack[gc->mark_stack_count - 1]);
+        }
+        if (gc->walk) {
+            gc_heap_walk_enter(gc->walk, ptr);
+        }
+        gc_trace(ptr);
+    }
+}
+
+/**
+ * \brief Traces a marked object and everything it schedules for tracing.
+ * \param ptr the marked object
+ */
+static void retrace(void *ptr) {
+    if (gc->walk) {
+        gc_heap_walk_enter(gc->walk, ptr);
+    }
+    gc_trace(ptr);
+    drain_mark_stack();
+}
+
+/**
+ * \brief Completes the marking after the mark stack overflowed.
+ *
+ * All marked objects are traced again, which pushes their unmarked children. Tracing is idempotent, so this is
+ * repeated until no overflow occurs. The cost is proportional to the size of the heap, but overflows are rare.
+ */
+static void recover_mark_stack_overflow() {
+    while (gc->mark_stack_overflow) {
+        gc->mark_stack_overflow = false;
+        for (size_t i = 0; i < gc_root_stack.count; i++) {
+            GcHeader *root = gc_root_stack.items[i];
+            if (!gc_is_immediate(root) && !IS_HEAP(root) && IS_MARKED(root)) {
+                retrace(root);
+            }
+        }
+        for (size_t i = 0; i < gc->image_dirty_count; i++) {
+            retrace(gc->image_dirty[i]);
+        }
+        for (GcHeader *header = gc->large; header != NULL; header = GC_NEXT(header)) {
+            if (IS_MARKED(header)) {
+                retrace(header);
+            }
+        }
+        slab_for_each_marked(retrace);
     }
-    gc.roots[gc.roots_count++] = root;
 }
 
-void gc_unroot(GcHeader *root) {
-    assert(gc.roots_count > 0);
-    assert(gc.roots[gc.roots_count - 1] == root);
-    gc.roots_count--;
+/**
+ * \brief Traces everything scheduled for tracing, handling mark stack overflows.
+ */
+static void process_mark_stack() {
+    drain_mark_stack();
+    recover_mark_stack_overflow();
 }
 
 void gc_visit(GcHeader *ptr) {
-    if (ptr == NULL) {
+    if (gc->walk) {
+        gc_heap_walk_edge(gc->walk);
+    }
+    if (ptr == NULL || gc_is_immediate(ptr)) {
         return;
     }
-    if (!IS_MARKED(ptr)) {
+    if (gc->parallel) {
+        gc_parallel_visit(ptr);
+        return;
+    }
+    // During a minor collection, old objects are already marked, thus they are not traced.
+    // Their pointers to young objects are found using the remembered set.
+    if (ptr->mark & GC_FLAG_SLAB) {
+        if (!slab_try_mark(ptr)) {
+            return;
+        }
+        gc->marked_bytes += slab_of(ptr)->cell_size;
+    } else {
+        if (IS_MARKED(ptr)) {
+            return;
+        }
         MARK(ptr);
-        ptr->trace_fn(ptr);
+        if (ptr->mark & GC_FLAG_LARGE) {
+            gc->marked_bytes += gc_object_size(ptr);
+        }
+    }
+    gc->stats.marked_objects++;
+    if (gc->walk) {
+        gc_heap_walk_add(gc->walk, ptr);
+    }
+    if (gc_trace_fn_of(ptr) != NULL) {
+        push_mark_stack(ptr);
     }
 }
 
-void gc_collect() {
-    // Mark phase
-    for (size_t i = 0; i < gc.roots_count; i++) {
-        gc_visit(gc.roots[i]);
+void gc_visit_array(GcHeader *const *items, size_t count) {
+    if (gc->parallel) {
+        gc_parallel_visit_array(items, count);
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        gc_visit(items[i]);
+    }
+}
+
+void gc_write_barrier_slow(GcHeader *obj, GcHeader *value) {
+    assert(gc_is_marked(obj) && !(obj->mark & GC_FLAG_REMEMBERED));
+    if (IS_IMAGE(obj)) {
+        if (gc->image_dirty_count == gc->image_dirty_capacity) {
+            gc->image_dirty_capacity = gc->image_dirty_capacity ? gc->image_dirty_capacity * 2 : 64;
+            gc->image_dirty = nx_realloc(gc->image_dirty, gc->image_dirty_capacity * sizeof(GcHeader *));
+        }
+        obj->mark |= GC_FLAG_REMEMBERED;
+        gc->image_dirty[gc->image_dirty_count++] = obj;
+        if (gc->marking) {
+            gc_visit(value);
+        }
+        return;
+    }
+    if (gc->marking) {
+        gc_visit(value);
+        return;
     }
+    if (gc->remembered_count == gc->remembered_capacity) {
+        gc->remembered_capacity = gc->remembered_capacity ? gc->remembered_capacity * 2 : 64;
+        gc->remembered = nx_realloc(gc->remembered, gc->remembered_capacity * sizeof(GcHeader *));
+    }
+    obj->mark |= GC_FLAG_REMEMBERED;
+    gc->remembered[gc->remembered_count++] = obj;
+}
 
-    // Sweep phase
+void gc_forget_image(const void *start, size_t size) {
     size_t count = 0;
-    GcHeader **p = &gc.head;
-    while (*p != NULL) {
-        GcHeader *header = *p;
-        if (IS_MARKED(header)) {
-            UNMARK(header);
-            assert((((uintptr_t) header->next) & 7) == 0);
-            p = &header->next;
+    for (size_t i = 0; i < gc->image_dirty_count; i++) {
+        const char *obj = (const char *) gc->image_dirty[i];
+        if (obj < (const char *) start || obj >= (const char *) start + size) {
+            gc->image_dirty[count++] = gc->image_dirty[i];
+        }
+    }
+    gc->image_dirty_count = count;
+}
+
+void gc_set_stack_bottom(const void *bottom) {
+    gc->stack_bottom = bottom;
+}
+
+/**
+ * \brief Finds the large object containing the address.
+ * \param ptr the address
+ * \return the large object or NULL if `ptr` does not point into any large object
+ */
+static GcHeader *find_large(const void *ptr) {
+    for (GcHeader *header = gc->large; header != NULL; header = GC_NEXT(header)) {
+        if ((const char *) ptr >= (const char *) header && (const char *) ptr < (char *) header + gc_object_size(header)) {
+            return header;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * \brief Records an object found by scanning the stack.
+ * \param obj the object
+ */
+static void add_stack_root(GcHeader *obj) {
+    if (gc->stack_roots_count == gc->stack_roots_capacity) {
+        gc->stack_roots_capacity = gc->stack_roots_capacity ? gc->stack_roots_capacity * 2 : 256;
+        gc->stack_roots = nx_realloc(gc->stack_roots, gc->stack_roots_capacity * sizeof(GcHeader *));
+    }
+    gc->stack_roots[gc->stack_roots_count++] = obj;
+}
+
+/**
+ * \brief Scans the C stack conservatively and records all objects it may point to.
+ *
+ * The objects are only recorded, not marked, since a major collection clears the mark bits after the stack is
+ * scanned: the mark bits are needed to recognize live objects in slabs which have not been swept yet.
+ * The function is not inlined so that its frame is below the frames of all its callers.
+ */
+__attribute__((noinline, no_sanitize_address))
+static void scan_stack() {
+    if (gc->stack_bottom == NULL) {
+        return;
+    }
+    jmp_buf registers;
+    setjmp(registers);          // spills the callee-saved registers to the stack
+    uintptr_t large_low = UINTPTR_MAX;
+    uintptr_t large_high = 0;
+    for (GcHeader *header = gc->large; header != NULL; header = GC_NEXT(header)) {
+        if ((uintptr_t) header < large_low) {
+            large_low = (uintptr_t) header;
+        }
+        if ((uintptr_t) header + gc_object_size(header) > large_high) {
+            large_high = (uintptr_t) header + gc_object_size(header);
+        }
+    }
+    const uintptr_t *word = (const uintptr_t *) ((uintptr_t) &registers & ~(sizeof(uintptr_t) - 1));
+    for (; (const void *) word < gc->stack_bottom; word++) {
+        const void *ptr = (const void *) *word;
+        GcHeader *obj = slab_find_block(ptr);
+        if (obj == NULL && *word >= large_low && *word < large_high) {
+            obj = find_large(ptr);
+        }
+        if (obj != NULL) {
+            add_stack_root(obj);
+        }
+    }
+}
+
+/**
+ * \brief Marks the objects found by `scan_stack()`.
+ */
+static void mark_stack_roots() {
+    for (size_t i = 0; i < gc->stack_roots_count; i++) {
+        gc_visit(gc->stack_roots[i]);
+    }
+    gc->stack_roots_count = 0;
+}
+
+/**
+ * \brief Marks all objects reachable from the roots.
+ *
+ * During a minor collection, roots in the old generation are traced as well, since they may have been
+ * modified without the write barrier.
+ */
+static void mark_roots() {
+    for (size_t i = 0; i < gc_root_stack.count; i++) {
+        GcHeader *root = gc_root_stack.items[i];
+        if (gc->minor && !gc_is_immediate(root) && IS_HEAP(root) && gc_is_marked(root)) {
+            gc_trace(root);
         } else {
-            assert((((uintptr_t) header->next) & 7) == 0);
-            *p = header->next;
-            nx_free(header);
-            count++;
+            gc_visit(root);
+        }
+    }
+}
+
+/**
+ * \brief Visits the roots, the objects found by scanning the stack and the pointers of the dirty image objects.
+ */
+static void visit_all_roots() {
+    mark_roots();
+    mark_stack_roots();
+    for (size_t i = 0; i < gc->image_dirty_count; i++) {
+        gc_trace(gc->image_dirty[i]);
+    }
+}
+
+/**
+ * \brief Empties the remembered set, optionally tracing its objects first.
+ * \param trace whether to trace the remembered objects
+ */
+static void process_remembered_set(bool trace) {
+    for (size_t i = 0; i < gc->remembered_count; i++) {
+        GcHeader *obj = gc->remembered[i];
+        obj->mark &= ~GC_FLAG_REMEMBERED;
+        if (trace) {
+            gc_trace(obj);
         }
     }
-    gc.objects_count -= count;
+    gc->remembered_count = 0;
+}
 
-    // Unmark roots - some of them may be statically allocated, thus they are not in
-    // the linked list and were not unmarked in the sweep phase. If kept marked, they
-    // would not get traced in the next mark phase.
-    for (size_t i = 0; i < gc.roots_count; i++) {
-        UNMARK(gc.roots[i]);
+/**
+ * \brief Removes unmarked large objects from the list of large objects.
+ *
+ * Unlike small objects, large objects are swept eagerly, since they are few and their memory is worth reclaiming
+ * as soon as possible. With background sweeping, the objects are only unlinked and freed by the sweeper thread.
+ * \return list of the unlinked objects which have not been freed
+ */
+static GcHeader *sweep_large() {
+    GcHeader *dead = NULL;
+    GcHeader *prev = NULL;
+    GcHeader *header = gc->large;
+    while (header != NULL) {
+        GcHeader *next = GC_NEXT(header);
+        if (IS_MARKED(header)) {
+            prev = header;
+        } else {
+            if (prev) {
+                GC_SET_NEXT(prev, next);
+            } else {
+                gc->large = next;
+            }
+            if (gc->policy.background_sweep) {
+                GC_SET_NEXT(header, dead);
+                dead = header;
+            } else {
+                free_large(header);
+            }
+        }
+        header = next;
     }
+    return dead;
+}
 
-    // Double the threshold if the number of surviving objects is still above 87.5% of the threshold
-    if (gc.objects_count >= gc.threshold - (gc.threshold / 8)) {
-        if (gc.threshold & (1L << 63)) {
-            PANIC("too many objects");
+/**
+ * \brief Unmarks the roots which are not allocated by the garbage collector.
+ *
+ * Such roots (e.g. statically allocated objects or structures on the C stack) are not subject to sticky marking,
+ * if kept marked, they would not get traced in the next mark phase. Roots without pointers do not need to be traced,
+ * they stay marked, so that statically allocated objects shared by all heaps are never written.
+ */
+static void unmark_roots() {
+    for (size_t i = 0; i < gc_root_stack.count; i++) {
+        GcHeader *root = gc_root_stack.items[i];
+        if (!gc_is_immediate(root) && !IS_HEAP(root) && !IS_IMAGE(root) && gc_trace_fn_of(root) != NULL) {
+            UNMARK(root);
         }
-        gc.threshold *= 2;
     }
+}
+
+/**
+ * \brief Completes a collection after the mark phase.
+ */
+static void finish_collection() {
+    report_tracked_objects();
+    GcHeader *dead = sweep_large();
+    unmark_roots();
+    slab_start_sweep();
+    if (gc->policy.background_sweep) {
+        gc_sweeper_start(dead);
+    }
+    gc->young_bytes = 0;
+}
+
+/**
+ * \brief Updates the accounting and the heap threshold after the mark phase of a major collection.
+ */
+static void finish_major_collection() {
+    gc->old_bytes = gc->marked_bytes;
+    double threshold = (double) gc->old_bytes * gc->policy.growth_factor;
+    if (gc->policy.max_heap_size && threshold > (double) gc->policy.max_heap_size) {
+        threshold = (double) gc->policy.max_heap_size;
+    }
+    gc->old_threshold = threshold > (double) gc->policy.initial_heap_size ? (size_t) threshold : gc->policy.initial_heap_size;
+}
+
+/**
+ * \brief Starts an incremental mark phase by clearing all marks and marking the roots.
+ *
+ * All slabs are swept first, since their mark bits are about to be cleared while the interpreter keeps allocating.
+ */
+static void start_marking() {
+    gc_sweeper_wait();
+    slab_release_empty();
+    slab_sweep_all();
+    scan_stack();
+    slab_clear_marks();
+    for (GcHeader *header = gc->large; header != NULL; header = GC_NEXT(header)) {
+        UNMARK(header);
+    }
+    process_remembered_set(false);
+    unmark_roots();
+    gc->marked_bytes = 0;
+    gc->marking = true;
+    visit_all_roots();
+}
+
+/**
+ * \brief Completes the incremental mark phase in a final pause.
+ *
+ * The roots may have been modified without the write barrier, so they are marked again, which also marks
+ * the objects allocated during the mark phase which are reachable from them.
+ */
+static void finish_marking() {
+    scan_stack();
+    unmark_roots();
+    visit_all_roots();
+    process_mark_stack();
+    gc->marking = false;
+    finish_collection();
+    finish_major_collection();
+}
+
+/**
+ * \brief Returns the value of a monotonic clock.
+ * \return the time in nanoseconds
+ */
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+/**
+ * \brief State at the beginning of a pause, used to compute its statistics.
+ */
+typedef struct {
+    uint64_t start_ns;              //!< Time when the pause started
+    size_t heap_bytes;              //!< Number of bytes allocated when the pause started
+} Pause;
+
+/**
+ * \brief Starts measuring a pause.
+ * \return the state at the beginning of the pause
+ */
+static Pause begin_pause() {
+    gc->stats.allocated_bytes += gc->young_bytes;
+    size_t heap_bytes = gc->old_bytes + gc->young_bytes;
+    if (heap_bytes > gc->stats.peak_heap_bytes) {
+        gc->stats.peak_heap_bytes = heap_bytes;
+    }
+    return (Pause) {.start_ns = now_ns(), .heap_bytes = heap_bytes};
+}
+
+/**
+ * \brief Finishes measuring a pause, updates the statistics and notifies the callback.
+ *
+ * Since the allocated bytes are accounted when the pause starts, `young_bytes` must not be reset between
+ * `begin_pause()` and `end_pause()` other than by the collection itself.
+ * \param kind the kind of the pause
+ * \param pause the state returned by `begin_pause()`
+ */
+static void end_pause(GcPauseKind kind, Pause pause) {
+    size_t heap_bytes = gc->old_bytes + gc->young_bytes;
+    GcEvent event = {
+        .kind = kind,
+        .duration_ns = now_ns() - pause.start_ns,
+        .freed_bytes = pause.heap_bytes > heap_bytes ? pause.heap_bytes - heap_bytes : 0,
+        .heap_bytes = heap_bytes,
+    };
+    GcStats *stats = &gc->stats;
+    if (kind == GC_PAUSE_MINOR) {
+        stats->minor_collections++;
+    } else if (kind == GC_PAUSE_MAJOR) {
+        stats->major_collections++;
+    }
+    stats->pause_count++;
+    stats->total_pause_ns += event.duration_ns;
+    if (event.duration_ns > stats->max_pause_ns) {
+        stats->max_pause_ns = event.duration_ns;
+    }
+    stats->freed_bytes += event.freed_bytes;
+    uint64_t us = event.duration_ns / 1000;
+    unsigned bucket = us == 0 ? 0 : 64 - __builtin_clzll(us);
+    stats->pause_histogram[bucket < GC_PAUSE_HISTOGRAM_SIZE ? bucket : GC_PAUSE_HISTOGRAM_SIZE - 1]++;
 
 #if ENABLE_GC_STATS
-    LOG_INFO("GC done: freed %zu objects, %zu remaining, threshold %zu", count, gc.objects_count, gc.threshold);
+    static const char *const KIND_NAMES[] = {"minor", "major", "incremental"};
+    LOG_INFO("GC %s pause: %llu ns, %zu bytes freed, %zu bytes remaining, threshold %zu", KIND_NAMES[kind],
+             (unsigned long long) event.duration_ns, event.freed_bytes, event.heap_bytes, gc->old_threshold);
 #endif
+
+    if (gc->callback) {
+        gc->callback(&event, gc->callback_data);
+    }
+}
+
+/**
+ * \brief Performs a slice of the incremental mark phase.
+ * \return true if the mark phase was completed
+ */
+static bool mark_slice() {
+    // objects allocated during the mark phase are treated as old, they are either marked or freed at its end
+    gc->old_bytes += gc->young_bytes;
+    gc->young_bytes = 0;
+    uint64_t deadline = now_ns() + (uint64_t) gc->policy.pause_budget_us * 1000;
+    while (gc->mark_stack_count > 0) {
+        for (size_t i = 0; i < GC_SLICE_CHECK_INTERVAL && gc->mark_stack_count > 0; i++) {
+            gc_trace(gc->mark_stack[--gc->mark_stack_count]);
+        }
+        if (now_ns() >= deadline) {
+            return false;
+        }
+    }
+    finish_marking();
+    return true;
+}
+
+void gc_collect_step() {
+    if (!gc->marking) {
+        return;
+    }
+    Pause pause = begin_pause();
+    end_pause(mark_slice() ? GC_PAUSE_MAJOR : GC_PAUSE_INCREMENTAL, pause);
+}
+
+/**
+ * \brief Performs a minor collection.
+ */
+static void collect_minor() {
+    gc_sweeper_wait();
+    slab_release_empty();
+    scan_stack();
+    gc->minor = true;
+    gc->marked_bytes = 0;
+    visit_all_roots();
+    process_remembered_set(true);
+    process_mark_stack();
+    finish_collection();
+    gc->minor = false;
+    gc->old_bytes += gc->marked_bytes;
+}
+
+void gc_collect_minor() {
+    Pause pause = begin_pause();
+    if (gc->marking) {
+        finish_marking();
+        end_pause(GC_PAUSE_MAJOR, pause);
+        return;
+    }
+    collect_minor();
+    end_pause(GC_PAUSE_MINOR, pause);
+    if (gc->old_bytes >= gc->old_threshold) {
+        if (gc->policy.pause_budget_us > 0) {
+            pause = begin_pause();
+            start_marking();
+            end_pause(GC_PAUSE_INCREMENTAL, pause);
+        } else {
+            gc_collect();
+        }
+    }
+}
+
+/**
+ * \brief Performs a major collection.
+ */
+static void collect_major() {
+    if (gc->marking) {
+        // abandon the incremental mark phase, the marks are cleared below anyway
+        gc->marking = false;
+        gc->mark_stack_count = 0;
+        gc->mark_stack_overflow = false;
+    }
+    gc_sweeper_wait();
+    slab_release_empty();
+    scan_stack();
+    slab_clear_marks();
+    for (GcHeader *header = gc->large; header != NULL; header = GC_NEXT(header)) {
+        UNMARK(header);
+    }
+    process_remembered_set(false);
+    gc->marked_bytes = 0;
+    if (gc->policy.mark_threads > 1 && gc->walk == NULL) {
+        gc_parallel_mark(gc->policy.mark_threads, visit_all_roots);
+    } else {
+        visit_all_roots();
+    }
+    process_mark_stack();
+    finish_collection();
+    finish_major_collection();
+}
+
+void gc_collect() {
+    assert(!gc->minor);
+    Pause pause = begin_pause();
+    collect_major();
+    end_pause(GC_PAUSE_MAJOR, pause);
+}
+
+void gc_dump_heap(FILE *out, bool objects) {
+    assert(!gc->minor);
+    GcHeapWalk *walk = gc_heap_walk_create();
+    Pause pause = begin_pause();
+    gc->walk = walk;
+    collect_major();
+    gc->walk = NULL;
+    end_pause(GC_PAUSE_MAJOR, pause);
+    gc_heap_walk_write(walk, out, objects);
+    gc_heap_walk_destroy(walk);
+}
+
+void gc_set_heap_dump_path(const char *path) {
+    pthread_mutex_lock(&heap_dump_lock);
+    nx_free(heap_dump_path);
+    heap_dump_path = NULL;
+    if (path) {
+        size_t length = strlen(path);
+        heap_dump_path = nx_alloc(length + 1);
+        memcpy(heap_dump_path, path, length + 1);
+    }
+    pthread_mutex_unlock(&heap_dump_lock);
+}
+
+void gc_request_heap_dump() {
+    heap_dump_requested = 1;
+    safepoint_signal(SAFEPOINT_HEAP_DUMP);
+}
+
+void gc_safepoint() {
+    if (heap_dump_requested) {
+        dump_requested_heap();
+    }
+}
+
+void gc_get_stats(GcStats *stats) {
+    *stats = gc->stats;
+    stats->allocated_bytes += gc->young_bytes;
+    size_t heap_bytes = gc->old_bytes + gc->young_bytes;
+    if (heap_bytes > stats->peak_heap_bytes) {
+        stats->peak_heap_bytes = heap_bytes;
+    }
+}
+
+void gc_set_callback(GcCallback callback, void *data) {
+    gc->callback = callback;
+    gc->callback_data = data;
+}
+
+void gc_set_alloc_tracker(const GcAllocTracker *tracker) {
+    gc->tracked_count = 0;
+    if (tracker) {
+        gc->tracker = *tracker;
+    } else {
+        gc->tracker = (GcAllocTracker) {.alloc = NULL, .collect = NULL, .data = NULL};
+    }
 }
 
 GcState *gc_get_internal_state() {
-    return &gc;
+    return gc;
 }
@@ -0,0 +1,320 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file gc_heap_dump.c
+ * \brief Recording of the object graph during the mark phase of a heap dump.
+ *
+ * While a heap walk is attached to the state of the collector, every object marked for the first time is recorded
+ * together with the object which was being traced when it was found and the index of the pointer within it. Since
+ * each object is marked only once, the recorded parents form a spanning tree of the live objects rooted in the
+ * roots, so following the parents yields a retention path of every live object.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "natrix/util/gc.h"
+#include "natrix/util/mem.h"
+#include "natrix/util/sb.h"
+
+#include "natrix/util/gc_internals.h"
+
+//! Parent of the objects reached directly from the roots.
+#define NO_PARENT UINT32_MAX
+
+//! Maximum number of steps of a retention path, longer paths are cut in the middle.
+#define MAX_PATH_LENGTH 32
+
+/**
+ * \brief An object marked during the heap walk.
+ */
+typedef struct {
+    GcHeader *obj;                  //!< The object
+    uint32_t parent;                //!< Index of the record of the object which points to it, `NO_PARENT` for roots
+    uint32_t edge;                  //!< Index of the pointer within the parent, or of the root in the stack of roots
+} WalkRecord;
+
+/**
+ * \brief Statistics of the live objects of a class.
+ */
+typedef struct {
+    size_t count;                   //!< Number of live objects
+    size_t bytes;                   //!< Total size of the live objects in bytes
+    GcClassId class_id;             //!< The class
+} ClassHistogram;
+
+struct GcHeapWalk {
+    WalkRecord *records;            //!< Recorded objects in the order in which they were marked
+    size_t count;                   //!< Number of records
+    size_t capacity;                //!< Capacity of the `records` array
+    uint32_t *index;                //!< Hash table of record indices plus one keyed by the address, zero if empty
+    size_t index_mask;              //!< Capacity of the hash table minus one
+    uint32_t current;               //!< Record of the object being traced, `NO_PARENT` while visiting the roots
+    uint32_t edge;                  //!< Number of pointers visited by the object being traced so far
+};
+
+/**
+ * \brief Computes the slot of an object in the hash table.
+ * \param walk the heap walk
+ * \param obj the object
+ * \return the index of the first slot to probe
+ */
+static size_t slot_of(const GcHeapWalk *walk, const GcHeader *obj) {
+    return (size_t) (((uintptr_t) obj >> 4) * 0x9E3779B97F4A7C15ull) & walk->index_mask;
+}
+
+/**
+ * \brief Doubles the capacity of the hash table and reinserts all records.
+ * \param walk the heap walk
+ */
+static void grow_index(GcHeapWalk *walk) {
+    size_t capacity = walk->index ? (walk->index_mask + 1) * 2 : 1024;
+    nx_free(walk->index);
+    walk->index = nx_alloc(capacity * sizeof(uint32_t));
+    memset(walk->index, 0, capacity * sizeof(uint32_t));
+    walk->index_mask = capacity - 1;
+    for (size_t i = 0; i < walk->count; i++) {
+        size_t slot = slot_of(walk, walk->records[i].obj);
+        while (walk->index[slot]) {
+            slot = (slot + 1) & walk->index_mask;
+        }
+        walk->index[slot] = i + 1;
+    }
+}
+
+/**
+ * \brief Finds the record of an object.
+ * \param walk the heap walk
+ * \param obj the object
+ * \return the index of the record or `NO_PARENT` if the object has not been recorded
+ */
+static uint32_t find_record(const GcHeapWalk *walk, const GcHeader *obj) {
+    if (walk->index == NULL) {
+        return NO_PARENT;
+    }
+    for (size_t slot = slot_of(walk, obj); walk->index[slot]; slot = (slot + 1) & walk->index_mask) {
+        if (walk->records[walk->index[slot] - 1].obj == obj) {
+            return walk->index[slot] - 1;
+        }
+    }
+    return NO_PARENT;
+}
+
+GcHeapWalk *gc_heap_walk_create() {
+    GcHeapWalk *walk = nx_alloc(sizeof(GcHeapWalk));
+    memset(walk, 0, sizeof(GcHeapWalk));
+    walk->current = NO_PARENT;
+    return walk;
+}
+
+void gc_heap_walk_destroy(GcHeapWalk *walk) {
+    nx_free(walk->records);
+    nx_free(walk->index);
+    nx_free(walk);
+}
+
+void gc_heap_walk_edge(GcHeapWalk *walk) {
+    walk->edge++;
+}
+
+void gc_heap_walk_enter(GcHeapWalk *walk, GcHeader *obj) {
+    walk->current = find_record(walk, obj);
+    walk->edge = 0;
+}
+
+void gc_heap_walk_add(GcHeapWalk *walk, GcHeader *obj) {
+    if (walk->count == walk->capacity) {
+        walk->capacity = walk->capacity ? walk->capacity * 2 : 1024;
+        walk->records = nx_realloc(walk->records, walk->capacity * sizeof(WalkRecord));
+    }
+    if (walk->index == NULL || (walk->count + 1) * 2 > walk->index_mask + 1) {
+        grow_index(walk);
+    }
+    walk->records[walk->count] = (WalkRecord) {.obj = obj, .parent = walk->current, .edge = walk->edge - 1};
+    size_t slot = slot_of(walk, obj);
+    while (walk->index[slot]) {
+        slot = (slot + 1) & walk->index_mask;
+    }
+    walk->index[slot] = ++walk->count;
+}
+
+/**
+ * \brief Appends the name of a class as a JSON string.
+ * \param sb the string builder
+ * \param class_id the class
+ */
+static void append_class_name(StringBuilder *sb, GcClassId class_id) {
+    const char *name = gc_classes[class_id].name;
+    if (name) {
+        sb_append_char(sb, '"');
+        sb_append_escaped_str(sb, name);
+        sb_append_char(sb, '"');
+    } else {
+        sb_append_formatted(sb, "\"#%u\"", (unsigned) class_id);
+    }
+}
+
+/**
+ * \brief Appends the retention path of an object as a JSON array, from the root to the object.
+ *
+ * Each step names the class of an object and how it is referenced: the index of the root for the first step, and
+ * the index of the pointer within the previous object (with its name, if the class of the previous object provides
+ * one) for the other steps.
+ * \param sb the string builder
+ * \param walk the heap walk
+ * \param record the index of the record of the object
+ */
+static void append_path(StringBuilder *sb, const GcHeapWalk *walk, uint32_t record) {
+    size_t length = 0;
+    for (uint32_t r = record; r != NO_PARENT; r = walk->records[r].parent) {
+        length++;
+    }
+    // keep the steps closest to the object and to the root, drop the ones in the middle
+    uint32_t path[MAX_PATH_LENGTH];
+    size_t kept = 0;
+    size_t k = 0;
+    for (uint32_t r = record; r != NO_PARENT; r = walk->records[r].parent, k++) {
+        if (length <= MAX_PATH_LENGTH || k < MAX_PATH_LENGTH / 2 || k >= length - MAX_PATH_LENGTH / 2) {
+            path[kept++] = r;
+        }
+    }
+    sb_append_char(sb, '[');
+    for (size_t i = kept; i-- > 0;) {
+        const WalkRecord *step = &walk->records[path[i]];
+        if (i + 1 < kept) {
+            sb_append_str(sb, ", ");
+        }
+        if (kept < length && i == MAX_PATH_LENGTH / 2 - 1) {
+            sb_append_formatted(sb, "{\"skipped\": %zu}, ", length - kept);
+        }
+        sb_append_str(sb, "{\"class\": ");
+        append_class_name(sb, step->obj->class_id);
+        if (step->parent == NO_PARENT) {
+            sb_append_formatted(sb, ", \"root\": %u}", step->edge);
+            continue;
+        }
+        sb_append_formatted(sb, ", \"edge\": %u", step->edge);
+        const GcHeader *parent = walk->records[step->parent].obj;
+        GcEdgeNameFn edge_name = gc_classes[parent->class_id].edge_name;
+        size_t name_length;
+        const char *name = edge_name ? edge_name(parent, step->edge, &name_length) : NULL;
+        if (name) {
+            sb_append_str(sb, ", \"name\": \"");
+            sb_append_escaped_str_len(sb, name, name_length);
+            sb_append_char(sb, '"');
+        }
+        sb_append_char(sb, '}');
+    }
+    sb_append_char(sb, ']');
+}
+
+/**
+ * \brief Writes the contents of a string builder to a file and empties it.
+ * \param sb the string builder
+ * \param out the file
+ */
+static void flush(StringBuilder *sb, FILE *out) {
+    fwrite(sb->str, 1, sb->length, out);
+    sb->length = 0;
+    sb->str[0] = '\0';
+}
+
+/**
+ * \brief Orders class histograms by decreasing size.
+ */
+static int compare_histograms(const void *a, const void *b) {
+    const ClassHistogram *ha = a;
+    const ClassHistogram *hb = b;
+    if (ha->bytes != hb->bytes) {
+        return ha->bytes < hb->bytes ? 1 : -1;
+    }
+    return ha->class_id < hb->class_id ? -1 : ha->class_id > hb->class_id;
+}
+
+void gc_heap_walk_write(const GcHeapWalk *walk, FILE *out, bool objects) {
+    ClassHistogram histogram[GC_MAX_CLASSES];
+    for (GcClassId id = 0; id < GC_MAX_CLASSES; id++) {
+        histogram[id] = (ClassHistogram) {.count = 0, .bytes = 0, .class_id = id};
+    }
+    uint32_t largest[GC_HEAP_DUMP_LARGEST];
+    size_t largest_count = 0;
+    size_t total_count = 0;
+    size_t total_bytes = 0;
+    for (uint32_t i = 0; i < walk->count; i++) {
+        const GcHeader *obj = walk->records[i].obj;
+        if (!IS_HEAP(obj)) {
+            continue;
+        }
+        size_t size = gc_object_size(obj);
+        histogram[obj->class_id].count++;
+        histogram[obj->class_id].bytes += size;
+        total_count++;
+        total_bytes += size;
+        // insertion into the array of the largest objects, sorted by decreasing size
+        size_t pos = largest_count < GC_HEAP_DUMP_LARGEST ? largest_count++ : GC_HEAP_DUMP_LARGEST;
+        while (pos > 0 && gc_object_size(walk->records[largest[pos - 1]].obj) < size) {
+            if (pos < GC_HEAP_DUMP_LARGEST) {
+                largest[pos] = largest[pos - 1];
+            }
+            pos--;
+        }
+        if (pos < GC_HEAP_DUMP_LARGEST) {
+            largest[pos] = i;
+        }
+    }
+    qsort(histogram, GC_MAX_CLASSES, sizeof(ClassHistogram), compare_histograms);
+
+    StringBuilder sb = sb_init();
+    sb_append_formatted(&sb, "{\"objects\": %zu, \"bytes\": %zu, \"classes\": [", total_count, total_bytes);
+    for (GcClassId i = 0; i < GC_MAX_CLASSES && histogram[i].count > 0; i++) {
+        sb_append_str(&sb, i ? ", {\"name\": " : "{\"name\": ");
+        append_class_name(&sb, histogram[i].class_id);
+        sb_append_formatted(&sb, ", \"count\": %zu, \"bytes\": %zu}", histogram[i].count, histogram[i].bytes);
+    }
+    sb_append_str(&sb, "], \"largest\": [");
+    for (size_t i = 0; i < largest_count; i++) {
+        const GcHeader *obj = walk->records[largest[i]].obj;
+        sb_append_formatted(&sb, "%s{\"address\": \"%p\", \"class\": ", i ? ", " : "", (const void *) obj);
+        append_class_name(&sb, obj->class_id);
+        sb_append_formatted(&sb, ", \"bytes\": %zu, \"path\": ", gc_object_size(obj));
+        append_path(&sb, walk, largest[i]);
+        sb_append_char(&sb, '}');
+        if (sb.length > 1 << 16) {
+            flush(&sb, out);
+        }
+    }
+    sb_append_char(&sb, ']');
+    if (objects) {
+        sb_append_str(&sb, ", \"heap\": [");
+        bool first = true;
+        for (uint32_t i = 0; i < walk->count; i++) {
+            const WalkRecord *record = &walk->records[i];
+            if (!IS_HEAP(record->obj)) {
+                continue;
+            }
+            sb_append_formatted(&sb, "%s{\"address\": \"%p\", \"class\": ", first ? "" : ", ", (void *) record->obj);
+            append_class_name(&sb, record->obj->class_id);
+            sb_append_formatted(&sb, ", \"bytes\": %zu", gc_object_size(record->obj));
+            if (record->parent != NO_PARENT) {
+                sb_append_formatted(&sb, ", \"parent\": \"%p\", \"edge\": %u}",
+                                    (void *) walk->records[record->parent].obj, record->edge);
+            } else {
+                sb_append_formatted(&sb, ", \"root\": %u}", record->edge);
+            }
+            first = false;
+            if (sb.length > 1 << 16) {
+                flush(&sb, out);
+            }
+        }
+        sb_append_char(&sb, ']');
+    }
+    sb_append_str(&sb, "}\n");
+    flush(&sb, out);
+    fflush(out);
+    sb_free(&sb);
+}
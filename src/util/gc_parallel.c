@@ -0,0 +1,557 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file gc_parallel.c
+ * \brief Parallel mark phase of the garbage collector.
+ *
+ * Each marking thread (worker) owns a Chase-Lev work-stealing deque. The owner pushes and takes work at the bottom
+ * of its deque without synchronization in the common case, idle workers steal work from the top of other deques.
+ * A work item is either an object to be traced or a range of an array of pointers, so that large arrays can be
+ * traced by several workers.
+ * The worker threads are created on the first parallel collection and then wait for the next one.
+ * They are shared by all heaps, so the parallel mark phases of different heaps are serialized.
+ * The mark phase ends when all workers are idle and all deques are empty.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include "natrix/util/gc.h"
+#include "natrix/util/mem.h"
+#include "natrix/util/panic.h"
+#include "natrix/util/slab.h"
+
+#include "natrix/util/gc_internals.h"
+
+//! Size of a cache line, used to avoid false sharing between workers.
+#define CACHE_LINE_SIZE 64
+//! Initial capacity of a deque.
+#define INITIAL_DEQUE_CAPACITY 256
+
+/**
+ * \brief An item of work: an object to trace (`count == 0`) or a range of an array of pointers.
+ */
+typedef struct {
+    void *ptr;                      //!< the object or the first element of the range
+    size_t count;                   //!< number of elements of the range, or zero for an object
+} Work;
+
+/**
+ * \brief A slot of a deque, accessed atomically since thieves may read it concurrently with the owner.
+ */
+typedef struct {
+    _Atomic(void *) ptr;            //!< see `Work.ptr`
+    _Atomic(size_t) count;          //!< see `Work.count`
+} WorkSlot;
+
+/**
+ * \brief Circular array of a deque.
+ *
+ * When the array is replaced by a larger one, the old array is kept until the end of the mark phase,
+ * since thieves may still be reading from it.
+ */
+typedef struct WorkArray {
+    int64_t capacity;               //!< number of slots, a power of two
+    struct WorkArray *retired;      //!< the previous, smaller array
+    WorkSlot slots[];               //!< the slots
+} WorkArray;
+
+/**
+ * \brief State of a marking thread.
+ */
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) atomic_int_fast64_t top;     //!< index of the oldest item, advanced by thieves
+    _Alignas(CACHE_LINE_SIZE) atomic_int_fast64_t bottom;  //!< index of the slot above the newest item
+    _Atomic(WorkArray *) array;     //!< the circular array of items
+    size_t marked_bytes;            //!< number of bytes marked by this worker in the current phase
+    uint64_t marked_objects;        //!< number of objects marked by this worker in the current phase
+    uint64_t random;                //!< state of the random generator used to choose victims
+    unsigned index;                 //!< index of the worker
+    uint64_t phase;                 //!< the last phase the worker participated in
+} GcWorker;
+
+//! The workers, the first one is the thread which started the collection.
+static GcWorker *workers = NULL;
+//! Number of workers.
+static unsigned worker_count = 0;
+//! The worker threads, indexed by worker index minus one.
+static pthread_t *threads = NULL;
+//! Held by the thread performing a parallel mark phase, protects the workers.
+static pthread_mutex_t mark_lock = PTHREAD_MUTEX_INITIALIZER;
+//! Protects `phase`, `phase_state`, `finished` and `stopping`.
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+//! Signalled when a new phase starts or when the threads should exit.
+static pthread_cond_t start_cond = PTHREAD_COND_INITIALIZER;
+//! Signalled when a worker thread finishes its part of a phase.
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+//! Sequence number of the current mark phase.
+static uint64_t phase = 0;
+//! State of the heap marked in the current phase.
+static GcState *phase_state = NULL;
+//! Number of worker threads which finished the current phase.
+static unsigned finished = 0;
+//! Whether the worker threads should exit.
+static bool stopping = false;
+//! Number of workers which found no work.
+static atomic_uint idle_count;
+//! The worker of the current thread, NULL outside of the parallel mark phase.
+static _Thread_local GcWorker *current_worker = NULL;
+
+/**
+ * \brief Allocates a circular array.
+ * \param capacity the number of slots, a power of two
+ * \return the array or NULL if the memory cannot be allocated
+ */
+static WorkArray *work_array_create(int64_t capacity) {
+    WorkArray *array = nx_alloc_no_panic(sizeof(WorkArray) + capacity * sizeof(WorkSlot));
+    if (array) {
+        array->capacity = capacity;
+        array->retired = NULL;
+    }
+    return array;
+}
+
+/**
+ * \brief Replaces the array of the deque by a twice as large one, called only by the owner.
+ * \param worker the owner of the deque
+ * \param array the current array
+ * \param top the index of the oldest item
+ * \param bottom the index of the slot above the newest item
+ * \return the new array or NULL if the capacity would exceed the limit or the memory cannot be allocated
+ */
+static WorkArray *deque_grow(GcWorker *worker, WorkArray *array, int64_t top, int64_t bottom) {
+    int64_t capacity = array->capacity * 2;
+    if ((size_t) capacity > gc_get_internal_state()->mark_stack_limit) {
+        return NULL;
+    }
+    WorkArray *new_array = work_array_create(capacity);
+    if (new_array == NULL) {
+        return NULL;
+    }
+    for (int64_t i = top; i < bottom; i++) {
+        WorkSlot *from = &array->slots[i & (array->capacity - 1)];
+        WorkSlot *to = &new_array->slots[i & (capacity - 1)];
+        atomic_store_explicit(&to->ptr, atomic_load_explicit(&from->ptr, memory_order_relaxed), memory_order_relaxed);
+        atomic_store_explicit(&to->count, atomic_load_explicit(&from->count, memory_order_relaxed), memory_order_relaxed);
+    }
+    new_array->retired = array;
+    atomic_store_explicit(&worker->array, new_array, memory_order_release);
+    return new_array;
+}
+
+/**
+ * \brief Pushes an item at the bottom of the deque, called only by the owner.
+ * \param worker the owner of the deque
+ * \param ptr see `Work.ptr`
+ * \param count see `Work.count`
+ * \return false if the deque is full and cannot grow
+ */
+static bool deque_push(GcWorker *worker, void *ptr, size_t count) {
+    int64_t bottom = atomic_load_explicit(&worker->bottom, memory_order_relaxed);
+    int64_t top = atomic_load_explicit(&worker->top, memory_order_acquire);
+    WorkArray *array = atomic_load_explicit(&worker->array, memory_order_relaxed);
+    if (bottom - top >= array->capacity) {
+        array = deque_grow(worker, array, top, bottom);
+        if (array == NULL) {
+            return false;
+        }
+    }
+    WorkSlot *slot = &array->slots[bottom & (array->capacity - 1)];
+    atomic_store_explicit(&slot->ptr, ptr, memory_order_relaxed);
+    atomic_store_explicit(&slot->count, count, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&worker->bottom, bottom + 1, memory_order_relaxed);
+    return true;
+}
+
+/**
+ * \brief Reads an item from a slot.
+ * \param array the circular array
+ * \param index the index of the item
+ * \return the item
+ */
+static Work read_slot(WorkArray *array, int64_t index) {
+    WorkSlot *slot = &array->slots[index & (array->capacity - 1)];
+    return (Work) {
+        .ptr = atomic_load_explicit(&slot->ptr, memory_order_relaxed),
+        .count = atomic_load_explicit(&slot->count, memory_order_relaxed),
+    };
+}
+
+/**
+ * \brief Takes the newest item from the bottom of the deque, called only by the owner.
+ * \param worker the owner of the deque
+ * \param work receives the item
+ * \return false if the deque is empty
+ */
+static bool deque_take(GcWorker *worker, Work *work) {
+    int64_t bottom = atomic_load_explicit(&worker->bottom, memory_order_relaxed) - 1;
+    WorkArray *array = atomic_load_explicit(&worker->array, memory_order_relaxed);
+    atomic_store_explicit(&worker->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t top = atomic_load_explicit(&worker->top, memory_order_relaxed);
+    if (top > bottom) {
+        atomic_store_explicit(&worker->bottom, bottom + 1, memory_order_relaxed);
+        return false;
+    }
+    *work = read_slot(array, bottom);
+    if (top == bottom) {
+        // the last item, race with the thieves
+        bool won = atomic_compare_exchange_strong_explicit(&worker->top, &top, top + 1,
+                                                           memory_order_seq_cst, memory_order_relaxed);
+        atomic_store_explicit(&worker->bottom, bottom + 1, memory_order_relaxed);
+        return won;
+    }
+    return true;
+}
+
+/**
+ * \brief Result of an attempt to steal.
+ */
+typedef enum {
+    STEAL_SUCCESS,                  //!< An item was stolen
+    STEAL_EMPTY,                    //!< The deque is empty
+    STEAL_ABORT,                    //!< Lost a race with another thread, the deque may not be empty
+} StealResult;
+
+/**
+ * \brief Steals the oldest item from the top of the deque, can be called by any thread.
+ * \param victim the owner of the deque
+ * \param work receives the item
+ * \return the result of the attempt
+ */
+static StealResult deque_steal(GcWorker *victim, Work *work) {
+    int64_t top = atomic_load_explicit(&victim->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t bottom = atomic_load_explicit(&victim->bottom, memory_order_acquire);
+    if (top >= bottom) {
+        return STEAL_EMPTY;
+    }
+    WorkArray *array = atomic_load_explicit(&victim->array, memory_order_acquire);
+    *work = read_slot(array, top);
+    if (!atomic_compare_exchange_strong_explicit(&victim->top, &top, top + 1,
+                                                 memory_order_seq_cst, memory_order_relaxed)) {
+        return STEAL_ABORT;
+    }
+    return STEAL_SUCCESS;
+}
+
+/**
+ * \brief Determines whether the deque may contain items.
+ * \param worker the owner of the deque
+ * \return true if the deque is not empty
+ */
+static bool deque_has_work(GcWorker *worker) {
+    return atomic_load_explicit(&worker->top, memory_order_acquire)
+           < atomic_load_explicit(&worker->bottom, memory_order_acquire);
+}
+
+/**
+ * \brief Visits a range of an array of pointers, pushing all but the first chunk back to the deque.
+ * \param worker the current worker
+ * \param items the first element of the range
+ * \param count the number of elements
+ */
+static void visit_range(GcWorker *worker, GcHeader *const *items, size_t count) {
+    if (count > GC_MARK_CHUNK && deque_push(worker, (void *) (items + GC_MARK_CHUNK), count - GC_MARK_CHUNK)) {
+        count = GC_MARK_CHUNK;
+    }
+    for (size_t i = 0; i < count; i++) {
+        GcHeader *ptr = items[i];
+        if (ptr != NULL && !gc_is_immediate(ptr)) {
+            gc_parallel_visit(ptr);
+        }
+    }
+}
+
+void gc_parallel_visit(GcHeader *ptr) {
+    GcWorker *worker = current_worker;
+    assert(worker != NULL);
+    uint32_t mark = __atomic_load_n(&ptr->mark, __ATOMIC_RELAXED);
+    if (mark & GC_FLAG_SLAB) {
+        if (!slab_try_mark_atomic(ptr)) {
+            return;
+        }
+        worker->marked_bytes += slab_of(ptr)->cell_size;
+    } else {
+        if (mark & GC_FLAG_MARK || __atomic_fetch_or(&ptr->mark, GC_FLAG_MARK, __ATOMIC_RELAXED) & GC_FLAG_MARK) {
+            return;
+        }
+        if (mark & GC_FLAG_LARGE) {
+            worker->marked_bytes += gc_large_prefix(ptr)->size;
+        }
+    }
+    worker->marked_objects++;
+    if (gc_trace_fn_of(ptr) != NULL && !deque_push(worker, ptr, 0)) {
+        // left marked but not traced, found later by rescanning the heap
+        __atomic_store_n(&gc_get_internal_state()->mark_stack_overflow, true, __ATOMIC_RELAXED);
+    }
+}
+
+void gc_parallel_visit_array(GcHeader *const *items, size_t count) {
+    visit_range(current_worker, items, count);
+}
+
+/**
+ * \brief Processes an item of work.
+ * \param worker the current worker
+ * \param work the item
+ */
+static void process(GcWorker *worker, Work work) {
+    if (work.count == 0) {
+        gc_trace(work.ptr);
+    } else {
+        visit_range(worker, work.ptr, work.count);
+    }
+}
+
+/**
+ * \brief Tries to steal an item from the other workers.
+ * \param worker the current worker
+ * \param work receives the item
+ * \return true if an item was stolen
+ */
+static bool steal_work(GcWorker *worker, Work *work) {
+    for (unsigned attempt = 0; attempt < 2 * worker_count; attempt++) {
+        worker->random ^= worker->random << 13;
+        worker->random ^= worker->random >> 7;
+        worker->random ^= worker->random << 17;
+        unsigned victim = worker->random % worker_count;
+        if (victim != worker->index && deque_steal(&workers[victim], work) == STEAL_SUCCESS) {
+            return true;
+        }
+    }
+    for (unsigned victim = 0; victim < worker_count; victim++) {
+        if (victim == worker->index) {
+            continue;
+        }
+        StealResult result;
+        while ((result = deque_steal(&workers[victim], work)) == STEAL_ABORT) {
+        }
+        if (result == STEAL_SUCCESS) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * \brief Determines whether any deque may contain items.
+ * \return true if there may be work to steal
+ */
+static bool any_work() {
+    for (unsigned i = 0; i < worker_count; i++) {
+        if (deque_has_work(&workers[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * \brief Marks objects until all workers run out of work.
+ * \param worker the current worker
+ */
+static void worker_loop(GcWorker *worker) {
+    Work work;
+    while (true) {
+        while (deque_take(worker, &work)) {
+            process(worker, work);
+        }
+        if (steal_work(worker, &work)) {
+            process(worker, work);
+            continue;
+        }
+        atomic_fetch_add(&idle_count, 1);
+        while (true) {
+            if (atomic_load(&idle_count) == worker_count) {
+                return;
+            }
+            if (any_work()) {
+                atomic_fetch_sub(&idle_count, 1);
+                break;
+            }
+            sched_yield();
+        }
+    }
+}
+
+/**
+ * \brief Entry point of a worker thread.
+ * \param arg the worker
+ * \return NULL
+ */
+static void *worker_main(void *arg) {
+    GcWorker *worker = arg;
+    pthread_mutex_lock(&pool_lock);
+    while (true) {
+        while (phase == worker->phase && !stopping) {
+            pthread_cond_wait(&start_cond, &pool_lock);
+        }
+        if (stopping) {
+            break;
+        }
+        worker->phase = phase;
+        gc_bind_state(phase_state);
+        pthread_mutex_unlock(&pool_lock);
+        current_worker = worker;
+        worker_loop(worker);
+        current_worker = NULL;
+        pthread_mutex_lock(&pool_lock);
+        finished++;
+        pthread_cond_signal(&done_cond);
+    }
+    pthread_mutex_unlock(&pool_lock);
+    return NULL;
+}
+
+/**
+ * \brief Returns the initial capacity of a deque, respecting `GcState.mark_stack_limit`.
+ * \return the capacity, a power of two
+ */
+static int64_t initial_capacity() {
+    size_t limit = gc_get_internal_state()->mark_stack_limit;
+    int64_t capacity = INITIAL_DEQUE_CAPACITY;
+    while (capacity > 1 && (size_t) capacity > limit) {
+        capacity /= 2;
+    }
+    return capacity;
+}
+
+/**
+ * \brief Stops the worker threads and frees the workers.
+ */
+static void stop_workers() {
+    pthread_mutex_lock(&pool_lock);
+    stopping = true;
+    pthread_cond_broadcast(&start_cond);
+    pthread_mutex_unlock(&pool_lock);
+    for (unsigned i = 1; i < worker_count; i++) {
+        pthread_join(threads[i - 1], NULL);
+    }
+    for (unsigned i = 0; i < worker_count; i++) {
+        nx_free(atomic_load(&workers[i].array));
+    }
+    free(workers);
+    nx_free(threads);
+    workers = NULL;
+    threads = NULL;
+    worker_count = 0;
+    stopping = false;
+}
+
+/**
+ * \brief Makes sure the requested number of workers exists.
+ *
+ * If a thread cannot be created, fewer workers are used.
+ * \param count the requested number of workers
+ */
+static void start_workers(unsigned count) {
+    if (worker_count == count) {
+        return;
+    }
+    if (worker_count > 0) {
+        stop_workers();
+    }
+    // the size of GcWorker is a multiple of the cache line size due to its alignment
+    workers = aligned_alloc(CACHE_LINE_SIZE, count * sizeof(GcWorker));
+    if (workers == NULL) {
+        PANIC("Out of memory");
+    }
+    threads = nx_alloc(count * sizeof(pthread_t));
+    for (unsigned i = 0; i < count; i++) {
+        GcWorker *worker = &workers[i];
+        atomic_init(&worker->top, 0);
+        atomic_init(&worker->bottom, 0);
+        atomic_init(&worker->array, work_array_create(initial_capacity()));
+        if (atomic_load(&worker->array) == NULL) {
+            PANIC("Out of memory");
+        }
+        worker->marked_bytes = 0;
+        worker->marked_objects = 0;
+        worker->random = 0x9E3779B97F4A7C15ull * (i + 1);
+        worker->index = i;
+        // the thread may start only after the next phase has begun, it must not skip it
+        worker->phase = phase;
+    }
+    worker_count = 1;
+    for (unsigned i = 1; i < count; i++) {
+        if (pthread_create(&threads[i - 1], NULL, worker_main, &workers[i]) != 0) {
+            break;
+        }
+        worker_count++;
+    }
+}
+
+/**
+ * \brief Frees the arrays replaced during the mark phase.
+ */
+static void release_arrays() {
+    for (unsigned i = 0; i < worker_count; i++) {
+        WorkArray *array = atomic_load(&workers[i].array);
+        WorkArray *retired = array->retired;
+        array->retired = NULL;
+        while (retired) {
+            WorkArray *next = retired->retired;
+            nx_free(retired);
+            retired = next;
+        }
+    }
+}
+
+void gc_parallel_mark(unsigned thread_count, void (*seed)()) {
+    GcState *gc = gc_get_internal_state();
+    pthread_mutex_lock(&mark_lock);
+    start_workers(thread_count);
+    if (worker_count < 2) {
+        pthread_mutex_unlock(&mark_lock);
+        seed();
+        return;
+    }
+    for (unsigned i = 0; i < worker_count; i++) {
+        workers[i].marked_bytes = 0;
+        workers[i].marked_objects = 0;
+        WorkArray *array = atomic_load(&workers[i].array);
+        if ((size_t) array->capacity > gc->mark_stack_limit && array->capacity > 1) {
+            // the limit was lowered since the array was allocated
+            WorkArray *new_array = work_array_create(initial_capacity());
+            if (new_array) {
+                nx_free(array);
+                atomic_store(&workers[i].array, new_array);
+            }
+        }
+    }
+    gc->parallel = true;
+    current_worker = &workers[0];
+    seed();
+    atomic_store(&idle_count, 0);
+    pthread_mutex_lock(&pool_lock);
+    finished = 0;
+    phase_state = gc;
+    phase++;
+    pthread_cond_broadcast(&start_cond);
+    pthread_mutex_unlock(&pool_lock);
+
+    worker_loop(&workers[0]);
+
+    pthread_mutex_lock(&pool_lock);
+    while (finished < worker_count - 1) {
+        pthread_cond_wait(&done_cond, &pool_lock);
+    }
+    pthread_mutex_unlock(&pool_lock);
+    current_worker = NULL;
+    gc->parallel = false;
+    for (unsigned i = 0; i < worker_count; i++) {
+        gc->marked_bytes += workers[i].marked_bytes;
+        gc->stats.marked_objects += workers[i].marked_objects;
+    }
+    release_arrays();
+    pthread_mutex_unlock(&mark_lock);
+}
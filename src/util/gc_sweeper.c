@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file gc_sweeper.c
+ * \brief Background sweeping of the garbage collector.
+ *
+ * After a collection, a single background thread frees the unreachable large objects and sweeps the slabs while
+ * the interpreter continues. The allocator and the sweeper coordinate through the epochs of the slabs (see
+ * `slab_sweep()`), whichever reaches a slab first sweeps it. Each heap has its own sweeper thread, which is created
+ * on the first background sweep of the heap and then waits for the next one until the heap is destroyed.
+ * Before the next collection starts, the sweeper is asked to stop: it finishes freeing the large objects, but leaves
+ * the remaining slabs to be swept lazily by the allocator.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "natrix/util/gc.h"
+#include "natrix/util/mem.h"
+#include "natrix/util/slab.h"
+
+#include "natrix/util/gc_internals.h"
+
+/**
+ * \brief State of the background sweeper of a heap.
+ */
+struct GcSweeper {
+    pthread_t thread;               //!< The sweeper thread
+    GcState *state;                 //!< The heap whose slabs are swept
+    pthread_mutex_t lock;           //!< Protects `pending`, `stopping`, `dead_large`, `slabs` and `slab_count`
+    pthread_cond_t start_cond;      //!< Signalled when there is a new sweep to perform or the thread should stop
+    pthread_cond_t done_cond;       //!< Signalled when the sweep is finished
+    bool pending;                   //!< Whether a sweep has been requested and not finished yet
+    bool stopping;                  //!< Whether the thread should terminate
+    atomic_bool cancelled;          //!< Whether the sweeper should stop sweeping slabs as soon as possible
+    GcHeader *dead_large;           //!< Unreachable large objects to free, linked the same way as `GcState.large`
+    Slab **slabs;                   //!< Slabs to sweep
+    size_t slab_count;              //!< Number of slabs to sweep
+};
+
+/**
+ * \brief Frees a list of unreachable large objects.
+ * \param header the first object of the list
+ */
+static void free_large_list(GcHeader *header) {
+    while (header != NULL) {
+        GcHeader *next = GC_NEXT(header);
+        nx_free((char *) header - LARGE_PREFIX_SIZE);
+        header = next;
+    }
+}
+
+/**
+ * \brief Entry point of the sweeper thread.
+ * \param arg the sweeper
+ * \return NULL
+ */
+static void *sweeper_main(void *arg) {
+    GcSweeper *sweeper = arg;
+    gc_bind_state(sweeper->state);
+    pthread_mutex_lock(&sweeper->lock);
+    while (true) {
+        while (!sweeper->pending && !sweeper->stopping) {
+            pthread_cond_wait(&sweeper->start_cond, &sweeper->lock);
+        }
+        if (sweeper->stopping) {
+            break;
+        }
+        pthread_mutex_unlock(&sweeper->lock);
+        free_large_list(sweeper->dead_large);
+        for (size_t i = 0; i < sweeper->slab_count && !atomic_load_explicit(&sweeper->cancelled, memory_order_relaxed);
+             i++) {
+            slab_sweep(sweeper->slabs[i]);
+        }
+        pthread_mutex_lock(&sweeper->lock);
+        nx_free(sweeper->slabs);
+        sweeper->slabs = NULL;
+        sweeper->slab_count = 0;
+        sweeper->dead_large = NULL;
+        sweeper->pending = false;
+        pthread_cond_signal(&sweeper->done_cond);
+    }
+    pthread_mutex_unlock(&sweeper->lock);
+    return NULL;
+}
+
+void gc_sweeper_start(GcHeader *dead) {
+    GcState *state = gc_get_internal_state();
+    GcSweeper *sweeper = state->sweeper;
+    if (sweeper == NULL) {
+        sweeper = nx_alloc(sizeof(GcSweeper));
+        sweeper->state = state;
+        pthread_mutex_init(&sweeper->lock, NULL);
+        pthread_cond_init(&sweeper->start_cond, NULL);
+        pthread_cond_init(&sweeper->done_cond, NULL);
+        sweeper->pending = false;
+        sweeper->stopping = false;
+        atomic_init(&sweeper->cancelled, false);
+        sweeper->dead_large = NULL;
+        sweeper->slabs = NULL;
+        sweeper->slab_count = 0;
+        if (pthread_create(&sweeper->thread, NULL, sweeper_main, sweeper) != 0) {
+            // the slabs are swept lazily anyway
+            nx_free(sweeper);
+            free_large_list(dead);
+            return;
+        }
+        state->sweeper = sweeper;
+    }
+    pthread_mutex_lock(&sweeper->lock);
+    assert(!sweeper->pending);
+    sweeper->dead_large = dead;
+    sweeper->slabs = slab_get_all(&sweeper->slab_count);
+    atomic_store(&sweeper->cancelled, false);
+    sweeper->pending = true;
+    pthread_cond_signal(&sweeper->start_cond);
+    pthread_mutex_unlock(&sweeper->lock);
+}
+
+void gc_sweeper_wait() {
+    GcSweeper *sweeper = gc_get_internal_state()->sweeper;
+    if (sweeper == NULL) {
+        return;
+    }
+    atomic_store(&sweeper->cancelled, true);
+    pthread_mutex_lock(&sweeper->lock);
+    while (sweeper->pending) {
+        pthread_cond_wait(&sweeper->done_cond, &sweeper->lock);
+    }
+    pthread_mutex_unlock(&sweeper->lock);
+}
+
+void gc_sweeper_stop() {
+    GcState *state = gc_get_internal_state();
+    GcSweeper *sweeper = state->sweeper;
+    if (sweeper == NULL) {
+        return;
+    }
+    gc_sweeper_wait();
+    pthread_mutex_lock(&sweeper->lock);
+    sweeper->stopping = true;
+    pthread_cond_signal(&sweeper->start_cond);
+    pthread_mutex_unlock(&sweeper->lock);
+    pthread_join(sweeper->thread, NULL);
+    pthread_cond_destroy(&sweeper->done_cond);
+    pthread_cond_destroy(&sweeper->start_cond);
+    pthread_mutex_destroy(&sweeper->lock);
+    nx_free(sweeper);
+    state->sweeper = NULL;
+}
@@ -31,11 +31,16 @@ void *nx_alloc_no_panic(size_t size_in_bytes) {
 }
 
 void *nx_realloc(void *ptr, size_t new_size_in_bytes) {
-    assert(new_size_in_bytes > 0);  // avoid implementation-defined behavior
-    void *new_ptr = realloc(ptr, new_size_in_bytes);
+    void *new_ptr = nx_realloc_no_panic(ptr, new_size_in_bytes);
     if (new_ptr == NULL) {
         PANIC("Out of memory");
     }
+    return new_ptr;
+}
+
+void *nx_realloc_no_panic(void *ptr, size_t new_size_in_bytes) {
+    assert(new_size_in_bytes > 0);  // avoid implementation-defined behavior
+    void *new_ptr = realloc(ptr, new_size_in_bytes);
     assert(NX_IS_ALIGNED(new_ptr));
     return new_ptr;
 }
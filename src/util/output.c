@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file output.c
+ * \brief Implementation of the buffered standard output.
+ */
+
+#include "natrix/util/output.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "natrix/util/mem.h"
+
+/**
+ * \brief Output buffer of a thread.
+ */
+typedef struct {
+    char *data;                 //!< Buffered data, NULL until the first write
+    size_t capacity;            //!< Size of the buffer in bytes
+    size_t length;              //!< Number of buffered bytes
+    bool line_buffered;         //!< Flush at the end of each line, since the output is a terminal
+    bool capturing;             //!< The data are kept in memory until `output_end_capture()`, the buffer grows
+} OutputBuffer;
+
+//! Two-digit decimal representations of the numbers 0 to 99.
+static const char DIGIT_PAIRS[200] =
+        "0001020304050607080910111213141516171819"
+        "2021222324252627282930313233343536373839"
+        "4041424344454647484950515253545556575859"
+        "6061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+
+//! Size of the buffers allocated by `ensure_buffer()`.
+static size_t buffer_size = OUTPUT_DEFAULT_BUFFER_SIZE;
+
+//! Output buffer of the current thread.
+static _Thread_local OutputBuffer out = {NULL, 0, 0, false, false};
+
+/**
+ * \brief Allocates the buffer of the current thread if needed.
+ */
+static void ensure_buffer() {
+    if (!out.data) {
+        out.data = nx_alloc(buffer_size);
+        out.capacity = buffer_size;
+        out.line_buffered = isatty(STDOUT_FILENO);
+    }
+}
+
+/**
+ * \brief Writes all data described by the vector to the standard output.
+ * \param iov the data, modified by the call
+ * \param count number of elements of the vector
+ */
+static void write_all(struct iovec *iov, int count) {
+    while (count > 0) {
+        ssize_t written = writev(STDOUT_FILENO, iov, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        while (count > 0 && (size_t) written >= iov->iov_len) {
+            written -= (ssize_t) iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *) iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+}
+
+void output_set_buffer_size(size_t size) {
+    assert(size > 0);
+    output_release();
+    buffer_size = size;
+}
+
+size_t output_format_int64(char *buf, int64_t value) {
+    // the digits are generated from the end, two at a time to halve the number of divisions
+    char tmp[OUTPUT_INT64_MAX_LENGTH];
+    char *p = tmp + sizeof(tmp);
+    uint64_t magnitude = value < 0 ? 0 - (uint64_t) value : (uint64_t) value;
+    while (magnitude >= 100) {
+        p -= 2;
+        memcpy(p, DIGIT_PAIRS + (magnitude % 100) * 2, 2);
+        magnitude /= 100;
+    }
+    if (magnitude >= 10) {
+        p -= 2;
+        memcpy(p, DIGIT_PAIRS + magnitude * 2, 2);
+    } else {
+        *--p = (char) ('0' + magnitude);
+    }
+    if (value < 0) {
+        *--p = '-';
+    }
+    size_t length = tmp + sizeof(tmp) - p;
+    memcpy(buf, p, length);
+    return length;
+}
+
+void output_write(const char *data, size_t length) {
+    if (out.data && length <= out.capacity - out.length) {
+        memcpy(out.data + out.length, data, length);
+        out.length += length;
+        return;
+    }
+    ensure_buffer();
+    if (out.capturing) {
+        if (length > out.capacity - out.length) {
+            out.capacity = out.length + length > 2 * out.capacity ? out.length + length : 2 * out.capacity;
+            out.data = nx_realloc(out.data, out.capacity);
+        }
+        memcpy(out.data + out.length, data, length);
+        out.length += length;
+        return;
+    }
+    if (length > out.capacity - out.length && length < out.capacity) {
+        output_flush();
+    }
+    if (length <= out.capacity - out.length) {
+        memcpy(out.data + out.length, data, length);
+        out.length += length;
+        return;
+    }
+    // too large to be buffered, written together with the buffered data in a single system call
+    struct iovec iov[2] = {
+            {.iov_base = out.data, .iov_len = out.length},
+            {.iov_base = (void *) data, .iov_len = length},
+    };
+    write_all(iov, 2);
+    out.length = 0;
+}
+
+void output_write_int64(int64_t value) {
+    char buf[OUTPUT_INT64_MAX_LENGTH];
+    output_write(buf, output_format_int64(buf, value));
+}
+
+void output_end_line() {
+    if (out.length < out.capacity) {
+        out.data[out.length++] = '\n';
+    } else {
+        output_write("\n", 1);
+    }
+    if (out.line_buffered) {
+        output_flush();
+    }
+}
+
+void output_flush() {
+    if (out.length > 0 && !out.capturing) {
+        struct iovec iov = {.iov_base = out.data, .iov_len = out.length};
+        write_all(&iov, 1);
+        out.length = 0;
+    }
+}
+
+void output_release() {
+    output_flush();
+    nx_free(out.data);
+    out = (OutputBuffer) {NULL, 0, 0, false, false};
+}
+
+void output_begin_capture() {
+    assert(!out.capturing);
+    output_flush();
+    ensure_buffer();
+    out.capturing = true;
+    out.line_buffered = false;
+}
+
+const char *output_end_capture(size_t *length) {
+    assert(out.capturing);
+    *length = out.length;
+    out.length = 0;
+    out.capturing = false;
+    out.line_buffered = isatty(STDOUT_FILENO);
+    return out.data;
+}
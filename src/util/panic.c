@@ -11,13 +11,41 @@
  */
 
 #include "natrix/util/panic.h"
+#include <assert.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include "natrix/util/log.h"
+#include "natrix/util/output.h"
+
+//! The most recently installed panic handler of the calling thread, NULL if none.
+static _Thread_local PanicHandler *current_handler = NULL;
+
+void panic_push_handler(PanicHandler *handler) {
+    handler->message[0] = '\0';
+    handler->prev = current_handler;
+    current_handler = handler;
+}
+
+void panic_pop_handler(PanicHandler *handler) {
+    (void) handler;
+    assert(current_handler == handler);
+    current_handler = current_handler->prev;
+}
 
 void panic(int line, const char *file, const char *func, const char *fmt, ...) {
+    // the output printed so far precedes the message
+    output_flush();
     va_list args;
     va_start(args, fmt);
     log_message_v(line, file, func, "PANIC", fmt, args);
     va_end(args);
+    PanicHandler *handler = current_handler;
+    if (handler) {
+        current_handler = handler->prev;
+        va_start(args, fmt);
+        vsnprintf(handler->message, sizeof(handler->message), fmt, args);
+        va_end(args);
+        longjmp(handler->jump, 1);
+    }
     exit(1);
 }
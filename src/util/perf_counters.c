@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file perf_counters.c
+ * \brief Implementation of the hardware performance counters.
+ */
+
+#include "natrix/util/perf_counters.h"
+#include <string.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+const char *const PERF_COUNTER_NAMES[PERF_COUNTER_COUNT] = {
+    [PERF_COUNTER_INSTRUCTIONS] = "instructions",
+    [PERF_COUNTER_CYCLES] = "cycles",
+    [PERF_COUNTER_CACHE_MISSES] = "cache_misses",
+    [PERF_COUNTER_BRANCH_MISSES] = "branch_misses",
+};
+
+#if defined(__linux__)
+//! Generic hardware events corresponding to the counters.
+static const uint64_t EVENT_CONFIGS[PERF_COUNTER_COUNT] = {
+    [PERF_COUNTER_INSTRUCTIONS] = PERF_COUNT_HW_INSTRUCTIONS,
+    [PERF_COUNTER_CYCLES] = PERF_COUNT_HW_CPU_CYCLES,
+    [PERF_COUNTER_CACHE_MISSES] = PERF_COUNT_HW_CACHE_MISSES,
+    [PERF_COUNTER_BRANCH_MISSES] = PERF_COUNT_HW_BRANCH_MISSES,
+};
+#endif
+
+bool perf_counters_start(PerfCounters *counters) {
+    bool available = false;
+    for (PerfCounter counter = 0; counter < PERF_COUNTER_COUNT; counter++) {
+        counters->fds[counter] = -1;
+#if defined(__linux__)
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = EVENT_CONFIGS[counter];
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        counters->fds[counter] = (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (counters->fds[counter] >= 0) {
+            ioctl(counters->fds[counter], PERF_EVENT_IOC_RESET, 0);
+            ioctl(counters->fds[counter], PERF_EVENT_IOC_ENABLE, 0);
+            available = true;
+        }
+#endif
+    }
+    return available;
+}
+
+void perf_counters_stop(const PerfCounters *counters) {
+#if defined(__linux__)
+    for (PerfCounter counter = 0; counter < PERF_COUNTER_COUNT; counter++) {
+        if (counters->fds[counter] >= 0) {
+            ioctl(counters->fds[counter], PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+#else
+    (void) counters;
+#endif
+}
+
+bool perf_counters_read(const PerfCounters *counters, PerfCounter counter, uint64_t *value) {
+    return counters->fds[counter] >= 0 && read(counters->fds[counter], value, sizeof(*value)) == sizeof(*value);
+}
+
+void perf_counters_close(PerfCounters *counters) {
+    for (PerfCounter counter = 0; counter < PERF_COUNTER_COUNT; counter++) {
+        if (counters->fds[counter] >= 0) {
+            close(counters->fds[counter]);
+            counters->fds[counter] = -1;
+        }
+    }
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file safepoint.c
+ * \brief Implementation of the cooperative safepoints.
+ */
+
+#include "natrix/util/safepoint.h"
+#include "natrix/util/gc.h"
+
+//! Safepoint of each thread.
+static _Thread_local Safepoint thread_safepoint;
+
+//! Safepoint receiving the requests made by signal handlers.
+static Safepoint *volatile signal_target = NULL;
+
+Safepoint *safepoint_current() {
+    return &thread_safepoint;
+}
+
+void safepoint_request(Safepoint *safepoint, uint32_t reasons) {
+    __atomic_fetch_or(&safepoint->requests, reasons, __ATOMIC_RELAXED);
+}
+
+void safepoint_set_signal_target(Safepoint *safepoint) {
+    signal_target = safepoint;
+}
+
+void safepoint_signal(uint32_t reasons) {
+    Safepoint *target = signal_target;
+    if (target) {
+        safepoint_request(target, reasons);
+    }
+}
+
+bool safepoint_handle(Safepoint *safepoint) {
+    uint32_t requests = __atomic_fetch_and(&safepoint->requests, SAFEPOINT_INTERRUPT, __ATOMIC_RELAXED);
+    if (requests & SAFEPOINT_HEAP_DUMP) {
+        gc_safepoint();
+    }
+    return (requests & SAFEPOINT_INTERRUPT) != 0;
+}
+
+void safepoint_clear_interrupt(Safepoint *safepoint) {
+    __atomic_fetch_and(&safepoint->requests, ~SAFEPOINT_INTERRUPT, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,649 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+/**
+ * \file slab.c
+ * \brief Implementation of the slab allocator.
+ */
+
+#include "natrix/util/slab.h"
+#include <assert.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "natrix/util/mem.h"
+
+//! Number of size classes.
+#define SIZE_CLASS_COUNT (SLAB_MAX_SIZE / NX_ALIGNMENT)
+//! Returns the index of the size class for blocks of the given size.
+#define SIZE_CLASS_INDEX(size) ((NX_ALIGN_UP(size) / NX_ALIGNMENT) - 1)
+//! Value of `Slab.epoch` while the slab is being swept.
+#define SLAB_SWEEPING UINT64_MAX
+
+/**
+ * \brief State of a size class.
+ *
+ * Slabs are allocated from in the order of the list. Since no block is freed between two sweep epochs, the slabs
+ * before the cursor are known to be full, so they are skipped until the next epoch.
+ */
+typedef struct {
+    Slab *head;                     //!< first slab of the size class
+    Slab *tail;                     //!< last slab of the size class
+    Slab *cursor;                   //!< slab from which the blocks are currently allocated
+} SizeClass;
+
+/**
+ * \brief A region of memory reserved using mmap(), divided into slabs.
+ */
+typedef struct Region {
+    struct Region *next;                        //!< Next region of the heap
+    char *base;                                 //!< Address of the first slab, aligned to `SLAB_SIZE`
+    void *mapping;                              //!< Address of the mapping, to be passed to munmap()
+    size_t mapping_size;                        //!< Size of the mapping in bytes
+    uint32_t slab_count;                        //!< Number of slabs in the region
+    uint32_t used;                              //!< Number of slabs in use
+    bool discarded;                             //!< Whether the pages of the region were returned to the system
+    uint64_t free_bits[];                       //!< Bit set for each free slab
+} Region;
+
+/**
+ * \brief Slabs of a heap.
+ */
+struct SlabHeap {
+    SizeClass size_classes[SIZE_CLASS_COUNT];   //!< The size classes
+    Slab **index;                               //!< All allocated slabs sorted by address, to recognize pointers
+    size_t count;                               //!< Number of allocated slabs
+    size_t index_capacity;                      //!< Capacity of the `index` array
+    uint64_t current_epoch;                     //!< Current sweep epoch, slabs with a different epoch need to be
+                                                //!< swept before allocating from them
+    SlabRegionPolicy region_policy;             //!< Parameters of the regions
+    Region *regions;                            //!< Regions from which the slabs are carved
+    size_t separate_count;                      //!< Number of slabs allocated separately using aligned_alloc()
+};
+
+//! The heap used by threads which have not selected another one.
+static SlabHeap main_heap = {
+    .region_policy = {
+        .region_size = SLAB_DEFAULT_REGION_SIZE,
+        .pages = SLAB_PAGES_NORMAL,
+        .release = SLAB_RELEASE_DONTNEED,
+    },
+};
+//! The heap of the calling thread.
+static _Thread_local SlabHeap *heap = &main_heap;
+
+SlabHeap *slab_heap_create() {
+    SlabHeap *new_heap = nx_alloc(sizeof(SlabHeap));
+    memset(new_heap, 0, sizeof(SlabHeap));
+    new_heap->region_policy = slab_default_region_policy();
+    return new_heap;
+}
+
+void slab_heap_destroy(SlabHeap *destroyed) {
+    assert(destroyed != &main_heap);
+    SlabHeap *prev = slab_set_heap(destroyed);
+    slab_free_all();
+    slab_set_heap(prev);
+    nx_free(destroyed->index);
+    nx_free(destroyed);
+}
+
+SlabHeap *slab_set_heap(SlabHeap *new_heap) {
+    SlabHeap *prev = heap;
+    heap = new_heap ? new_heap : &main_heap;
+    return prev;
+}
+
+SlabRegionPolicy slab_default_region_policy() {
+    return (SlabRegionPolicy) {
+        .region_size = SLAB_DEFAULT_REGION_SIZE,
+        .pages = SLAB_PAGES_NORMAL,
+        .release = SLAB_RELEASE_DONTNEED,
+    };
+}
+
+void slab_set_region_policy(const SlabRegionPolicy *policy) {
+    assert(policy->region_size % SLAB_SIZE == 0);
+    heap->region_policy = *policy;
+}
+
+/**
+ * \brief Maps memory aligned to the given alignment.
+ *
+ * More memory than requested is mapped and the excess at both ends is unmapped.
+ * \param size the size of the memory, a multiple of the page size
+ * \param alignment the alignment, a power of two and a multiple of the page size
+ * \return the address of the memory or NULL if it cannot be mapped
+ */
+static void *map_aligned(size_t size, size_t alignment) {
+    char *raw = mmap(NULL, size + alignment, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        return NULL;
+    }
+    char *aligned = (char *) NX_ROUND_UP((uintptr_t) raw, alignment);
+    if (aligned > raw) {
+        munmap(raw, aligned - raw);
+    }
+    size_t tail = (raw + size + alignment) - (aligned + size);
+    if (tail > 0) {
+        munmap(aligned + size, tail);
+    }
+    return aligned;
+}
+
+/**
+ * \brief Maps a new region according to the policy of the heap and adds it to the heap.
+ * \return the region or NULL if the memory cannot be mapped
+ */
+static Region *region_create() {
+    const SlabRegionPolicy *policy = &heap->region_policy;
+    size_t size = policy->region_size;
+    void *mapping = NULL;
+    if (policy->pages != SLAB_PAGES_NORMAL) {
+        size = NX_ROUND_UP(size, SLAB_HUGE_PAGE_SIZE);
+    }
+#ifdef MAP_HUGETLB
+    if (policy->pages == SLAB_PAGES_HUGETLB) {
+        // huge pages are aligned to their size, which is a multiple of the size of the slabs
+        mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (mapping == MAP_FAILED) {
+            mapping = NULL;
+        }
+    }
+#endif
+    if (mapping == NULL) {
+        mapping = map_aligned(size, policy->pages == SLAB_PAGES_NORMAL ? SLAB_SIZE : SLAB_HUGE_PAGE_SIZE);
+        if (mapping == NULL) {
+            return NULL;
+        }
+#ifdef MADV_HUGEPAGE
+        if (policy->pages != SLAB_PAGES_NORMAL) {
+            madvise(mapping, size, MADV_HUGEPAGE);
+        }
+#endif
+    }
+    uint32_t slab_count = size / SLAB_SIZE;
+    uint32_t words = (slab_count + 63) / 64;
+    Region *region = nx_alloc_no_panic(sizeof(Region) + words * sizeof(uint64_t));
+    if (region == NULL) {
+        munmap(mapping, size);
+        return NULL;
+    }
+    region->base = mapping;
+    region->mapping = mapping;
+    region->mapping_size = size;
+    region->slab_count = slab_count;
+    region->used = 0;
+    region->discarded = false;
+    memset(region->free_bits, 0, words * sizeof(uint64_t));
+    for (uint32_t i = 0; i < slab_count; i++) {
+        region->free_bits[i / 64] |= (uint64_t) 1 << (i % 64);
+    }
+    region->next = heap->regions;
+    heap->regions = region;
+    return region;
+}
+
+/**
+ * \brief Takes a free slab from the regions, mapping a new region if all are full.
+ * \return the memory of the slab or NULL if a new region cannot be mapped
+ */
+static void *region_take_slab() {
+    Region *region = heap->regions;
+    while (region && region->used == region->slab_count) {
+        region = region->next;
+    }
+    if (region == NULL) {
+        region = region_create();
+        if (region == NULL) {
+            return NULL;
+        }
+    }
+    for (uint32_t w = 0;; w++) {
+        if (region->free_bits[w]) {
+            uint32_t index = w * 64 + __builtin_ctzll(region->free_bits[w]);
+            region->free_bits[w] &= region->free_bits[w] - 1;
+            region->used++;
+            region->discarded = false;
+            return region->base + (size_t) index * SLAB_SIZE;
+        }
+    }
+}
+
+/**
+ * \brief Returns the memory of an empty region to the system as configured by the policy of the heap.
+ * \param region the region
+ * \param prev the region preceding it in the list of regions, NULL if it is the first one
+ */
+static void region_release(Region *region, Region *prev) {
+    assert(region->used == 0);
+    switch (heap->region_policy.release) {
+        case SLAB_RELEASE_UNMAP:
+            if (prev) {
+                prev->next = region->next;
+            } else {
+                heap->regions = region->next;
+            }
+            munmap(region->mapping, region->mapping_size);
+            nx_free(region);
+            return;
+        case SLAB_RELEASE_FREE:
+#ifdef MADV_FREE
+            madvise(region->mapping, region->mapping_size, MADV_FREE);
+            break;
+#endif
+        case SLAB_RELEASE_DONTNEED:
+            madvise(region->mapping, region->mapping_size, MADV_DONTNEED);
+            break;
+    }
+    region->discarded = true;
+}
+
+/**
+ * \brief Returns a slab to the free slabs of its region, releasing the region if it becomes empty.
+ * \param slab the slab
+ */
+static void region_put_slab(Slab *slab) {
+    Region *prev = NULL;
+    Region *region = heap->regions;
+    while ((char *) slab < region->base || (char *) slab >= region->base + (size_t) region->slab_count * SLAB_SIZE) {
+        prev = region;
+        region = region->next;
+    }
+    uint32_t index = ((char *) slab - region->base) / SLAB_SIZE;
+    region->free_bits[index / 64] |= (uint64_t) 1 << (index % 64);
+    if (--region->used == 0) {
+        region_release(region, prev);
+    }
+}
+
+/**
+ * \brief Allocates the memory of a slab, from a region or separately depending on the policy of the heap.
+ * \return the memory or NULL if it cannot be allocated
+ */
+static Slab *slab_memory_alloc() {
+    if (heap->region_policy.region_size == 0) {
+        Slab *slab = aligned_alloc(SLAB_SIZE, SLAB_SIZE);
+        if (slab) {
+            heap->separate_count++;
+        }
+        return slab;
+    }
+    return region_take_slab();
+}
+
+/**
+ * \brief Frees the memory of a slab allocated by `slab_memory_alloc()`.
+ * \param slab the slab
+ */
+static void slab_memory_free(Slab *slab) {
+    for (Region *region = heap->regions; region; region = region->next) {
+        if ((char *) slab >= region->base && (char *) slab < region->base + (size_t) region->slab_count * SLAB_SIZE) {
+            region_put_slab(slab);
+            return;
+        }
+    }
+    free(slab);
+    heap->separate_count--;
+}
+
+/**
+ * \brief Finds the position of the slab in the sorted index using binary search.
+ * \param slab the slab
+ * \return position of the slab, or the position where it would be inserted
+ */
+static size_t index_position(const Slab *slab) {
+    size_t low = 0;
+    size_t high = heap->count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (heap->index[mid] < slab) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/**
+ * \brief Adds the slab to the sorted index.
+ * \param slab the slab
+ * \return false if the index cannot grow
+ */
+static bool index_insert(Slab *slab) {
+    if (heap->count == heap->index_capacity) {
+        size_t new_capacity = heap->index_capacity ? heap->index_capacity * 2 : 64;
+        Slab **new_index = nx_realloc_no_panic(heap->index, new_capacity * sizeof(Slab *));
+        if (new_index == NULL) {
+            return false;
+        }
+        heap->index = new_index;
+        heap->index_capacity = new_capacity;
+    }
+    size_t pos = index_position(slab);
+    memmove(heap->index + pos + 1, heap->index + pos, (heap->count - pos) * sizeof(Slab *));
+    heap->index[pos] = slab;
+    heap->count++;
+    return true;
+}
+
+/**
+ * \brief Removes the slab from the sorted index.
+ * \param slab the slab
+ */
+static void index_remove(const Slab *slab) {
+    size_t pos = index_position(slab);
+    assert(pos < heap->count && heap->index[pos] == slab);
+    memmove(heap->index + pos, heap->index + pos + 1, (heap->count - pos - 1) * sizeof(Slab *));
+    heap->count--;
+}
+
+/**
+ * \brief Allocates and initializes a new slab and appends it to the size class.
+ * \param size_class the size class
+ * \param cell_size size of the cells
+ * \return the new slab or NULL if the memory cannot be allocated
+ */
+static Slab *slab_create(SizeClass *size_class, uint32_t cell_size) {
+    Slab *slab = slab_memory_alloc();
+    if (slab == NULL) {
+        return NULL;
+    }
+    if (!index_insert(slab)) {
+        slab_memory_free(slab);
+        return NULL;
+    }
+    slab->next = NULL;
+    slab->start = (char *) slab + NX_ALIGN_UP(sizeof(Slab));
+    slab->cell_size = cell_size;
+    slab->cell_count = ((char *) slab + SLAB_SIZE - slab->start) / cell_size;
+    slab->cell_reciprocal = (((uint64_t) 1 << 32) + cell_size - 1) / cell_size;
+    slab->cursor = 0;
+    slab->used = 0;
+    slab->epoch = heap->current_epoch;
+    memset(slab->alloc_bits, 0, sizeof(slab->alloc_bits));
+    memset(slab->mark_bits, 0, sizeof(slab->mark_bits));
+    if (size_class->tail) {
+        size_class->tail->next = slab;
+    } else {
+        size_class->head = slab;
+    }
+    size_class->tail = slab;
+    return slab;
+}
+
+/**
+ * \brief Counts the set bits in a bitmap.
+ * \param bits the bitmap
+ * \return the number of set bits
+ */
+static uint32_t count_bits(const uint64_t *bits) {
+    uint32_t count = 0;
+    for (size_t i = 0; i < SLAB_BITMAP_WORDS; i++) {
+        count += __builtin_popcountll(bits[i]);
+    }
+    return count;
+}
+
+/**
+ * \brief Determines whether the slab has been swept in the current epoch.
+ *
+ * Once the slab is swept, its allocation bitmap and `used` count are safe to read even if the sweep was done
+ * by another thread.
+ * \param slab the slab
+ * \return true if the slab is swept
+ */
+static bool is_swept(const Slab *slab) {
+    return __atomic_load_n(&slab->epoch, __ATOMIC_ACQUIRE) == heap->current_epoch;
+}
+
+void slab_sweep(Slab *slab) {
+    uint64_t epoch = __atomic_load_n(&slab->epoch, __ATOMIC_ACQUIRE);
+    while (epoch != heap->current_epoch) {
+        if (epoch == SLAB_SWEEPING) {
+            // another thread is sweeping the slab, which takes only a moment
+            sched_yield();
+            epoch = __atomic_load_n(&slab->epoch, __ATOMIC_ACQUIRE);
+        } else if (__atomic_compare_exchange_n(&slab->epoch, &epoch, SLAB_SWEEPING, false,
+                                               __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+            memcpy(slab->alloc_bits, slab->mark_bits, sizeof(slab->alloc_bits));
+            slab->used = count_bits(slab->alloc_bits);
+            slab->cursor = 0;
+            __atomic_store_n(&slab->epoch, heap->current_epoch, __ATOMIC_RELEASE);
+            return;
+        }
+    }
+}
+
+/**
+ * \brief Allocates a free cell of the slab.
+ * \param slab the slab, must be swept
+ * \return pointer to the cell or NULL if the slab is full
+ */
+static void *slab_alloc_cell(Slab *slab) {
+    assert(is_swept(slab));
+    uint32_t words = (slab->cell_count + 63) / 64;
+    for (uint32_t i = slab->cursor; i < words; i++) {
+        uint64_t free_bits = ~slab->alloc_bits[i];
+        if (free_bits) {
+            uint32_t index = i * 64 + __builtin_ctzll(free_bits);
+            if (index >= slab->cell_count) {
+                break;
+            }
+            slab->alloc_bits[i] |= (uint64_t) 1 << (index % 64);
+            slab->cursor = i;
+            slab->used++;
+            return slab->start + (size_t) index * slab->cell_size;
+        }
+    }
+    slab->cursor = words;
+    return NULL;
+}
+
+void *slab_alloc(size_t size_in_bytes) {
+    assert(size_in_bytes > 0 && size_in_bytes <= SLAB_MAX_SIZE);
+    SizeClass *size_class = &heap->size_classes[SIZE_CLASS_INDEX(size_in_bytes)];
+    for (Slab *slab = size_class->cursor; slab; slab = slab->next) {
+        slab_sweep(slab);
+        void *ptr = slab_alloc_cell(slab);
+        if (ptr) {
+            size_class->cursor = slab;
+            return ptr;
+        }
+    }
+    Slab *slab = slab_create(size_class, NX_ALIGN_UP(size_in_bytes));
+    if (slab == NULL) {
+        return NULL;
+    }
+    size_class->cursor = slab;
+    return slab_alloc_cell(slab);
+}
+
+void slab_clear_marks() {
+    for (size_t i = 0; i < SIZE_CLASS_COUNT; i++) {
+        for (Slab *slab = heap->size_classes[i].head; slab; slab = slab->next) {
+            memset(slab->mark_bits, 0, sizeof(slab->mark_bits));
+        }
+    }
+}
+
+void slab_for_each_marked(void (*fn)(void *ptr)) {
+    for (size_t i = 0; i < SIZE_CLASS_COUNT; i++) {
+        for (Slab *slab = heap->size_classes[i].head; slab; slab = slab->next) {
+            for (uint32_t w = 0; w < SLAB_BITMAP_WORDS; w++) {
+                uint64_t bits = slab->mark_bits[w];
+                while (bits) {
+                    uint32_t index = w * 64 + __builtin_ctzll(bits);
+                    bits &= bits - 1;
+                    fn(slab->start + (size_t) index * slab->cell_size);
+                }
+            }
+        }
+    }
+}
+
+void slab_start_sweep() {
+    heap->current_epoch++;
+    for (size_t i = 0; i < SIZE_CLASS_COUNT; i++) {
+        heap->size_classes[i].cursor = heap->size_classes[i].head;
+    }
+}
+
+void slab_sweep_all() {
+    for (size_t i = 0; i < SIZE_CLASS_COUNT; i++) {
+        for (Slab *slab = heap->size_classes[i].head; slab; slab = slab->next) {
+            slab_sweep(slab);
+        }
+    }
+}
+
+Slab **slab_get_all(size_t *count) {
+    *count = heap->count;
+    if (heap->count == 0) {
+        return NULL;
+    }
+    Slab **slabs = nx_alloc(heap->count * sizeof(Slab *));
+    memcpy(slabs, heap->index, heap->count * sizeof(Slab *));
+    return slabs;
+}
+
+/**
+ * \brief Finds the slab containing the pointer among the allocated slabs.
+ * \param ptr the pointer
+ * \return the slab or NULL if the pointer does not point into any slab
+ */
+static Slab *find_slab(const void *ptr) {
+    Slab *candidate = slab_of(ptr);
+    size_t pos = index_position(candidate);
+    return pos < heap->count && heap->index[pos] == candidate ? candidate : NULL;
+}
+
+void *slab_find_block(const void *ptr) {
+    Slab *slab = find_slab(ptr);
+    if (slab == NULL || (const char *) ptr < slab->start) {
+        return NULL;
+    }
+    uint32_t index = slab_cell_index(slab, ptr);
+    if (index >= slab->cell_count) {
+        return NULL;
+    }
+    const uint64_t *bits = is_swept(slab) ? slab->alloc_bits : slab->mark_bits;
+    if (!((bits[index / 64] >> (index % 64)) & 1)) {
+        return NULL;
+    }
+    return slab->start + (size_t) index * slab->cell_size;
+}
+
+bool slab_is_live(const void *ptr) {
+    return slab_find_block(ptr) == ptr;
+}
+
+size_t slab_get_live_count() {
+    size_t count = 0;
+    for (size_t i = 0; i < SIZE_CLASS_COUNT; i++) {
+        for (Slab *slab = heap->size_classes[i].head; slab; slab = slab->next) {
+            count += is_swept(slab) ? slab->used : count_bits(slab->mark_bits);
+        }
+    }
+    return count;
+}
+
+/**
+ * \brief Determines whether the slab contains no live blocks.
+ *
+ * Slabs which have not been swept yet are empty if none of their blocks is marked.
+ * \param slab the slab
+ * \return true if the slab is empty
+ */
+static bool slab_is_empty(const Slab *slab) {
+    if (is_swept(slab)) {
+        return slab->used == 0;
+    }
+    for (size_t i = 0; i < SLAB_BITMAP_WORDS; i++) {
+        if (slab->mark_bits[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void slab_release_empty() {
+    for (size_t i = 0; i < SIZE_CLASS_COUNT; i++) {
+        SizeClass *size_class = &heap->size_classes[i];
+        bool keep_one = true;
+        Slab *prev = NULL;
+        Slab *slab = size_class->head;
+        while (slab) {
+            Slab *next = slab->next;
+            bool empty = slab_is_empty(slab);
+            if (empty && !keep_one) {
+                if (prev) {
+                    prev->next = next;
+                } else {
+                    size_class->head = next;
+                }
+                if (size_class->tail == slab) {
+                    size_class->tail = prev;
+                }
+                if (size_class->cursor == slab) {
+                    size_class->cursor = next ? next : prev;
+                }
+                index_remove(slab);
+                slab_memory_free(slab);
+            } else {
+                if (empty) {
+                    keep_one = false;
+                }
+                prev = slab;
+            }
+            slab = next;
+        }
+    }
+}
+
+size_t slab_get_count() {
+    return heap->count;
+}
+
+size_t slab_get_region_count() {
+    size_t count = 0;
+    for (Region *region = heap->regions; region; region = region->next) {
+        count++;
+    }
+    return count;
+}
+
+size_t slab_get_mapped_bytes() {
+    size_t bytes = heap->separate_count * SLAB_SIZE;
+    for (Region *region = heap->regions; region; region = region->next) {
+        if (!region->discarded) {
+            bytes += region->mapping_size;
+        }
+    }
+    return bytes;
+}
+
+void slab_free_all() {
+    for (size_t i = 0; i < SIZE_CLASS_COUNT; i++) {
+        Slab *slab = heap->size_classes[i].head;
+        while (slab) {
+            Slab *next = slab->next;
+            slab_memory_free(slab);
+            slab = next;
+        }
+        heap->size_classes[i] = (SizeClass) {.head = NULL, .tail = NULL, .cursor = NULL};
+    }
+    heap->count = 0;
+    while (heap->regions) {
+        Region *next = heap->regions->next;
+        munmap(heap->regions->mapping, heap->regions->mapping_size);
+        nx_free(heap->regions);
+        heap->regions = next;
+    }
+}
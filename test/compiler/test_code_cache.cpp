@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <fstream>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <iterator>
+#include <string>
+#include <unistd.h>
+#include "natrix/compiler/code_cache.h"
+#include "natrix/compiler/compiler.h"
+#include "natrix/compiler/resolver.h"
+#include "natrix/interp/vm.h"
+#include "natrix/obj/nx_int.h"
+#include "natrix/parser/parser.h"
+
+static const char *const CACHE_PATH = "/tmp/natrix_test_code_cache.ntxc";
+
+static std::string execute(Env *env, Code *code) {
+    testing::internal::CaptureStdout();
+    vm_exec(env, code);
+    fflush(stdout);
+    return testing::internal::GetCapturedStdout();
+}
+
+static std::string compile_and_save(const char *source, uint32_t flags) {
+#if ENABLE_CONSERVATIVE_GC
+    gc_set_stack_bottom(__builtin_frame_address(0));
+#endif
+    Source src = source_from_string("<string>", source);
+    Arena arena = arena_init();
+    Stmt *stmt = parse_file(&arena, &src, diag_default_handler, nullptr);
+    EXPECT_NE(stmt, nullptr);
+    Env env = env_init();
+    gc_root(&env.gc_header);
+    LiteralPool literals = literal_pool_init();
+    gc_root(&literals.gc_header);
+    env_store(&env, env_declare(&env, "arg", 3), nx_int_create(7));
+    resolve_program(&env, &literals, stmt);
+    Code code = code_init();
+    gc_root(&code.gc_header);
+    compile_program(&code, &literals, stmt);
+    EXPECT_TRUE(code_cache_save(CACHE_PATH, &src, flags, &env, &code));
+    std::string output = execute(&env, &code);
+    gc_unroot(&code.gc_header);
+    code_free(&code);
+    gc_unroot(&literals.gc_header);
+    literal_pool_free(&literals);
+    gc_unroot(&env.gc_header);
+    env_free(&env);
+    gc_collect();
+    arena_free(&arena);
+    source_free(&src);
+    return output;
+}
+
+static bool load_and_run(const char *source, uint32_t flags, std::string *output = nullptr) {
+#if ENABLE_CONSERVATIVE_GC
+    gc_set_stack_bottom(__builtin_frame_address(0));
+#endif
+    Source src = source_from_string("<string>", source);
+    Env env = env_init();
+    gc_root(&env.gc_header);
+    Code code = code_init();
+    gc_root(&code.gc_header);
+    CodeCache cache;
+    bool loaded = code_cache_load(&cache, CACHE_PATH, &src, flags, &env, &code);
+    if (loaded) {
+        EXPECT_EQ(std::string(env.names[0].start, env.names[0].length), "arg");
+        env_store(&env, env_declare(&env, "arg", 3), nx_int_create(7));
+        std::string result = execute(&env, &code);
+        if (output) {
+            *output = result;
+        }
+    } else {
+        EXPECT_EQ(env.count, 0u);
+        EXPECT_EQ(code.bytecode_size, 0u);
+        EXPECT_EQ(code.constant_count, 0u);
+    }
+    gc_unroot(&code.gc_header);
+    code_free(&code);
+    gc_unroot(&env.gc_header);
+    env_free(&env);
+    code_cache_close(&cache);
+    gc_collect();
+    source_free(&src);
+    return loaded;
+}
+
+static const char *const PROGRAM =
+        "big = 123456789012345678901234567890\n"
+        "small = 0 - 42\n"
+        "s = \"abc\" + \"def\"\n"
+        "i = 0\n"
+        "while i < arg:\n"
+        "    big = big * 2 + i\n"
+        "    i = i + 1\n"
+        "print(big)\n"
+        "print(small * i)\n"
+        "print(s)\n";
+
+TEST(CodeCacheTest, Roundtrip) {
+    std::string expected = compile_and_save(PROGRAM, 0);
+    EXPECT_EQ(expected, "15802468993580246899358024690040\n-294\nabcdef\n");
+    std::string output;
+    EXPECT_TRUE(load_and_run(PROGRAM, 0, &output));
+    EXPECT_EQ(output, expected);
+    // the cache file is not modified by running the loaded program
+    output.clear();
+    EXPECT_TRUE(load_and_run(PROGRAM, 0, &output));
+    EXPECT_EQ(output, expected);
+    unlink(CACHE_PATH);
+}
+
+TEST(CodeCacheTest, RejectsModifiedSource) {
+    compile_and_save(PROGRAM, 0);
+    std::string modified(PROGRAM);
+    modified[modified.find("42")] = '3';
+    EXPECT_FALSE(load_and_run(modified.c_str(), 0));
+    EXPECT_FALSE(load_and_run("print(1)\n", 0));
+    unlink(CACHE_PATH);
+}
+
+TEST(CodeCacheTest, RejectsDifferentFlags) {
+    compile_and_save(PROGRAM, 0);
+    EXPECT_FALSE(load_and_run(PROGRAM, 1));
+    unlink(CACHE_PATH);
+}
+
+TEST(CodeCacheTest, RejectsTruncatedFile) {
+    compile_and_save(PROGRAM, 0);
+    off_t sizes[] = {0, 16, 200, 300};
+    for (off_t size : sizes) {
+        ASSERT_EQ(truncate(CACHE_PATH, size), 0);
+        EXPECT_FALSE(load_and_run(PROGRAM, 0));
+    }
+    unlink(CACHE_PATH);
+}
+
+static std::string read_cache() {
+    std::ifstream in(CACHE_PATH, std::ios::binary);
+    return {std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+}
+
+static void write_cache(const std::string &contents) {
+    std::ofstream out(CACHE_PATH, std::ios::binary | std::ios::trunc);
+    out << contents;
+}
+
+TEST(CodeCacheTest, RejectsCorruptedFile) {
+    compile_and_save(PROGRAM, 0);
+    std::string contents = read_cache();
+    for (size_t offset : {size_t(CODE_CACHE_HEADER_SIZE), contents.size() / 2, contents.size() - 1}) {
+        std::string corrupted = contents;
+        corrupted[offset] ^= 0x11;
+        write_cache(corrupted);
+        EXPECT_FALSE(load_and_run(PROGRAM, 0)) << offset;
+    }
+    unlink(CACHE_PATH);
+}
+
+//! Writes a modified cache file with a matching payload hash, so that only the bytecode checks can reject it.
+static void write_signed_cache(std::string contents) {
+    uint64_t hash = code_cache_hash_bytes(contents.data() + CODE_CACHE_HEADER_SIZE,
+                                          contents.size() - CODE_CACHE_HEADER_SIZE);
+    memcpy(&contents[CODE_CACHE_PAYLOAD_HASH_OFFSET], &hash, sizeof(hash));
+    write_cache(contents);
+}
+
+TEST(CodeCacheTest, RejectsStackUnderflow) {
+    compile_and_save(PROGRAM, 0);
+    std::string contents = read_cache();
+    write_signed_cache(contents);
+    EXPECT_TRUE(load_and_run(PROGRAM, 0));
+    // the STORE_VAR after the first CONST becomes an operator popping two values
+    size_t offset = CODE_CACHE_HEADER_SIZE + 1 + OPERAND_SIZE;
+    ASSERT_EQ(contents[offset], OP_STORE_VAR);
+    contents[offset] = OP_SUB_INT;
+    write_signed_cache(contents);
+    EXPECT_FALSE(load_and_run(PROGRAM, 0));
+    unlink(CACHE_PATH);
+}
+
+TEST(CodeCacheTest, RejectsJumpIntoInstruction) {
+    compile_and_save(PROGRAM, 0);
+    std::string contents = read_cache();
+    size_t offset = CODE_CACHE_HEADER_SIZE;
+    while (contents[offset] != OP_JUMP_IF_FALSE) {
+        bool has_operand = code_get_operand_kind((Opcode) contents[offset]) != OPERAND_NONE;
+        offset += has_operand ? 1 + OPERAND_SIZE : 1;
+        ASSERT_LT(offset, contents.size());
+    }
+    // the exit of the loop follows the LOOP instruction, one byte earlier is its operand
+    int32_t jump;
+    memcpy(&jump, &contents[offset + 1], sizeof(jump));
+    jump--;
+    memcpy(&contents[offset + 1], &jump, sizeof(jump));
+    write_signed_cache(contents);
+    EXPECT_FALSE(load_and_run(PROGRAM, 0));
+    unlink(CACHE_PATH);
+}
+
+TEST(CodeCacheTest, MissingFile) {
+    unlink(CACHE_PATH);
+    EXPECT_FALSE(load_and_run(PROGRAM, 0));
+}
@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <string>
+#include "natrix/compiler/compiler.h"
+#include "natrix/compiler/resolver.h"
+#include "natrix/parser/parser.h"
+
+static std::string compile_and_dump(const char *source) {
+    Source src = source_from_string("<string>", source);
+    Arena arena = arena_init();
+    Stmt *stmt = parse_file(&arena, &src, diag_default_handler, nullptr);
+    EXPECT_NE(stmt, nullptr);
+    Env env = env_init();
+    LiteralPool literals = literal_pool_init();
+    gc_root(&literals.gc_header);
+    resolve_program(&env, &literals, stmt);
+    Code code = code_init();
+    gc_root(&code.gc_header);
+    compile_program(&code, &literals, stmt);
+    StringBuilder sb = sb_init();
+    code_dump(&sb, &code);
+    std::string result = sb.str;
+    sb_free(&sb);
+    gc_unroot(&code.gc_header);
+    code_free(&code);
+    gc_unroot(&literals.gc_header);
+    literal_pool_free(&literals);
+    env_free(&env);
+    arena_free(&arena);
+    source_free(&src);
+    return result;
+}
+
+TEST(CompilerTest, Expression) {
+    EXPECT_EQ(compile_and_dump("print(n + 1)"),
+              "0000 LOAD_VAR 0 (n)\n"
+              "0005 CONST 0 (1)\n"
+              "0010 ADD 0\n"
+              "0015 PRINT\n"
+              "0016 HALT\n");
+}
+
+TEST(CompilerTest, Call) {
+    EXPECT_EQ(compile_and_dump("x = max(len(s), 2, n)"),
+              "0000 LOAD_VAR 1 (s)\n"
+              "0005 CALL 1 (len/1)\n"
+              "0010 CONST 0 (2)\n"
+              "0015 LOAD_VAR 2 (n)\n"
+              "0020 CALL 259 (max/3)\n"
+              "0025 STORE_VAR 0 (x)\n"
+              "0030 HALT\n");
+}
+
+TEST(CompilerTest, Assignment) {
+    EXPECT_EQ(compile_and_dump("a = [\"x\", 2]\na[0] = a\n"),
+              "0000 CONST 0 (\"x\")\n"
+              "0005 CONST 1 (2)\n"
+              "0010 LIST 2\n"
+              "0015 STORE_VAR 0 (a)\n"
+              "0020 LOAD_VAR 0 (a)\n"
+              "0025 CONST 2 (0)\n"
+              "0030 LOAD_VAR 0 (a)\n"
+              "0035 SET_ELEMENT\n"
+              "0036 HALT\n");
+}
+
+TEST(CompilerTest, While) {
+    EXPECT_EQ(compile_and_dump("while n > 0:\n  n = n - 1\n"),
+              "0000 LOAD_VAR 0 (n)\n"
+              "0005 CONST 0 (0)\n"
+              "0010 COMPARE_JUMP 0\n"
+              "0015 JUMP_IF_FALSE 25 (-> 0045)\n"
+              "0020 UPDATE_VAR 0 (n)\n"
+              "0025 CONST 1 (1)\n"
+              "0030 SUB 1\n"
+              "0035 STORE_VAR 0 (n)\n"
+              "0040 LOOP 0 (-> 0000)\n"
+              "0045 HALT\n");
+}
+
+TEST(CompilerTest, For) {
+    EXPECT_EQ(compile_and_dump("for x in range(n):\n  print(x)\n"),
+              "0000 LOAD_VAR 1 (n)\n"
+              "0005 RANGE 1\n"
+              "0010 STORE_VAR 2\n"
+              "0015 CONST 0 (0)\n"
+              "0020 STORE_VAR 3\n"
+              "0025 FOR_ITER 2\n"
+              "0030 JUMP 16 (-> 0051)\n"
+              "0035 STORE_VAR 0 (x)\n"
+              "0040 LOAD_VAR 0 (x)\n"
+              "0045 PRINT\n"
+              "0046 LOOP 0 (-> 0025)\n"
+              "0051 HALT\n");
+}
+
+TEST(CompilerTest, AugmentedAssignment) {
+    EXPECT_EQ(compile_and_dump("a[i] += x\nn -= 1\n"),
+              "0000 LOAD_VAR 0 (a)\n"
+              "0005 LOAD_VAR 1 (i)\n"
+              "0010 DUP_TWO\n"
+              "0011 GET_ELEMENT\n"
+              "0012 LOAD_VAR 2 (x)\n"
+              "0017 INPLACE 0\n"
+              "0022 SET_ELEMENT\n"
+              "0023 UPDATE_VAR 3 (n)\n"
+              "0028 CONST 0 (1)\n"
+              "0033 SUB 1\n"
+              "0038 STORE_VAR 3 (n)\n"
+              "0043 HALT\n");
+}
+
+TEST(CompilerTest, IfElse) {
+    EXPECT_EQ(compile_and_dump("if a:\n  print(1)\nelse:\n  print(2)\n"),
+              "0000 LOAD_VAR 0 (a)\n"
+              "0005 JUMP_IF_FALSE 11 (-> 0021)\n"
+              "0010 CONST 0 (1)\n"
+              "0015 PRINT\n"
+              "0016 JUMP 6 (-> 0027)\n"
+              "0021 CONST 1 (2)\n"
+              "0026 PRINT\n"
+              "0027 HALT\n");
+}
+
+TEST(CompilerTest, IfWithoutElse) {
+    EXPECT_EQ(compile_and_dump("if a:\n  a\n"),
+              "0000 LOAD_VAR 0 (a)\n"
+              "0005 JUMP_IF_FALSE 6 (-> 0016)\n"
+              "0010 LOAD_VAR 0 (a)\n"
+              "0015 POP\n"
+              "0016 HALT\n");
+}
+
+TEST(CompilerTest, MaxStack) {
+    Source src = source_from_string("<string>", "x = 1 + (2 * (3 - a[4]))\n");
+    Arena arena = arena_init();
+    Stmt *stmt = parse_file(&arena, &src, diag_default_handler, nullptr);
+    Env env = env_init();
+    LiteralPool literals = literal_pool_init();
+    gc_root(&literals.gc_header);
+    resolve_program(&env, &literals, stmt);
+    Code code = code_init();
+    gc_root(&code.gc_header);
+    compile_program(&code, &literals, stmt);
+    EXPECT_EQ(code.max_stack, 5);
+    EXPECT_EQ(code.name_count, 2);
+    EXPECT_EQ(code.constant_count, 4);
+    gc_unroot(&code.gc_header);
+    code_free(&code);
+    gc_unroot(&literals.gc_header);
+    literal_pool_free(&literals);
+    env_free(&env);
+    arena_free(&arena);
+    source_free(&src);
+}
+
+TEST(CompilerTest, LineTable) {
+    Source src = source_from_string("<string>", "i = 0\nwhile i < 3:\n  if i:\n    print(i)\n  i = i + 1\n");
+    Arena arena = arena_init();
+    Stmt *stmt = parse_file(&arena, &src, diag_default_handler, nullptr);
+    Env env = env_init();
+    LiteralPool literals = literal_pool_init();
+    gc_root(&literals.gc_header);
+    resolve_program(&env, &literals, stmt);
+    Code code = code_init();
+    gc_root(&code.gc_header);
+    compile_program(&code, &literals, stmt);
+    std::string lines;
+    for (size_t i = 0; i < code.line_count; i++) {
+        lines += std::to_string(code.lines[i].offset) + " line " +
+                 std::to_string(source_get_line_number(&src, code.lines[i].position)) + " parent " +
+                 (code.lines[i].parent == CODE_NO_PARENT ? "-" : std::to_string(code.lines[i].parent)) + "\n";
+    }
+    EXPECT_EQ(lines,
+              "0 line 1 parent -\n"
+              "10 line 2 parent -\n"
+              "30 line 3 parent 1\n"
+              "40 line 4 parent 2\n"
+              "46 line 5 parent 1\n"
+              "66 line 2 parent -\n");
+    gc_unroot(&code.gc_header);
+    code_free(&code);
+    gc_unroot(&literals.gc_header);
+    literal_pool_free(&literals);
+    env_free(&env);
+    arena_free(&arena);
+    source_free(&src);
+}
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "natrix/compiler/compiler.h"
+#include "natrix/compiler/jit.h"
+#include "natrix/compiler/resolver.h"
+#include "natrix/interp/vm.h"
+#include "natrix/obj/nx_int.h"
+#include "natrix/parser/parser.h"
+
+/**
+ * \brief Loop record after the execution, with the native code replaced by whether it existed.
+ */
+struct LoopState {
+    bool compiled;
+    bool failed;
+    uint32_t deoptimized;
+};
+
+static std::string run(const char *source, int64_t arg, std::vector<LoopState> *loops = nullptr) {
+#if ENABLE_CONSERVATIVE_GC
+    gc_set_stack_bottom(__builtin_frame_address(0));
+#endif
+    JitPolicy policy = jit_default_policy();
+    policy.threshold = 2;
+    jit_set_policy(&policy);
+    Source src = source_from_string("<string>", source);
+    Arena arena = arena_init();
+    Stmt *stmt = parse_file(&arena, &src, diag_default_handler, nullptr);
+    EXPECT_NE(stmt, nullptr);
+    Env env = env_init();
+    gc_root(&env.gc_header);
+    LiteralPool literals = literal_pool_init();
+    gc_root(&literals.gc_header);
+    env_store(&env, env_declare(&env, "arg", 3), nx_int_create(arg));
+    resolve_program(&env, &literals, stmt);
+    Code code = code_init();
+    gc_root(&code.gc_header);
+    compile_program(&code, &literals, stmt);
+    testing::internal::CaptureStdout();
+    vm_exec(&env, &code);
+    fflush(stdout);
+    std::string output = testing::internal::GetCapturedStdout();
+    if (loops) {
+        for (size_t i = 0; i < code.loop_count; i++) {
+            loops->push_back({code.loops[i].native != nullptr, code.loops[i].failed, code.loops[i].deoptimized});
+        }
+    }
+    gc_unroot(&code.gc_header);
+    code_free(&code);
+    gc_unroot(&literals.gc_header);
+    literal_pool_free(&literals);
+    gc_unroot(&env.gc_header);
+    env_free(&env);
+    gc_collect();
+    arena_free(&arena);
+    source_free(&src);
+    policy = jit_default_policy();
+    jit_set_policy(&policy);
+#if ENABLE_CONSERVATIVE_GC
+    gc_set_stack_bottom(nullptr);
+#endif
+    return output;
+}
+
+TEST(JitTest, NestedLoops) {
+    if (!jit_is_supported()) {
+        GTEST_SKIP();
+    }
+    std::vector<LoopState> loops;
+    EXPECT_EQ(run("i = 0\ns = 0\nwhile i < arg:\n    j = 0\n    while j < 100:\n"
+                  "        if j / 3 * 3 == j:\n            s = s + i * j\n        else:\n            s = s - 1\n"
+                  "        j = j + 1\n    i = i + 1\nprint(s)\nprint(i)\n", 1000, &loops),
+              "840592500\n1000\n");
+    ASSERT_EQ(loops.size(), 2);
+    EXPECT_TRUE(loops[0].compiled);
+    EXPECT_TRUE(loops[1].compiled);
+    EXPECT_EQ(loops[0].deoptimized, 0);
+}
+
+TEST(JitTest, Comparisons) {
+    if (!jit_is_supported()) {
+        GTEST_SKIP();
+    }
+    std::vector<LoopState> loops;
+    EXPECT_EQ(run("i = 0 - 5\nc = 0\nwhile i < 5:\n"
+                  "    if i == 0:\n        c = c + 1\n    if i != 1:\n        c = c + 10\n"
+                  "    if i <= 2:\n        c = c + 100\n    if i > 3:\n        c = c + 1000\n"
+                  "    if i >= 0:\n        c = c + 10000\n"
+                  "    c = c + (0 - 7) / 2 * 100000\n    i = i + 1\nprint(c)\n", 0, &loops),
+              "-2948109\n");
+    ASSERT_EQ(loops.size(), 1);
+    EXPECT_TRUE(loops[0].compiled);
+}
+
+TEST(JitTest, ComparisonValues) {
+    if (!jit_is_supported()) {
+        GTEST_SKIP();
+    }
+    // the comparisons produce `bool` objects, so the loop is interpreted
+    std::vector<LoopState> loops;
+    EXPECT_EQ(run("i = 0\nc = 0\nwhile i < 10:\n    c = c + (i < 3)\n    i = i + 1\nprint(c)\nprint(i < 3)\n", 0,
+                  &loops),
+              "3\nFalse\n");
+    ASSERT_EQ(loops.size(), 1);
+    EXPECT_FALSE(loops[0].compiled);
+}
+
+TEST(JitTest, DeoptimizesOnOverflow) {
+    if (!jit_is_supported()) {
+        GTEST_SKIP();
+    }
+    std::vector<LoopState> loops;
+    EXPECT_EQ(run("x = 1\ni = 0\nwhile i < 45:\n    x = x * 3\n    i = i + 1\nprint(x)\nprint(i)\n", 0, &loops),
+              "2954312706550833698643\n45\n");
+    ASSERT_EQ(loops.size(), 1);
+    EXPECT_GE(loops[0].deoptimized, 1);
+}
+
+TEST(JitTest, DeoptimizesOnDivisionByZero) {
+    if (!jit_is_supported()) {
+        GTEST_SKIP();
+    }
+    EXPECT_DEATH(run("i = 10\nwhile i > 0 - 5:\n    x = 100 / i\n    i = i - 1\n", 0), "Division by zero");
+}
+
+TEST(JitTest, UnsupportedLoops) {
+    if (!jit_is_supported()) {
+        GTEST_SKIP();
+    }
+    std::vector<LoopState> loops;
+    // the first loop prints, the second one starts with a big integer in a variable
+    EXPECT_EQ(run("i = 0\nwhile i < 3:\n    print(i)\n    i = i + 1\n"
+                  "b = 100000000000000000000\nx = 0\nwhile i < 40:\n    x = b + i\n    i = i + 1\nprint(x)\n", 0, &loops),
+              "0\n1\n2\n100000000000000000039\n");
+    ASSERT_EQ(loops.size(), 2);
+    EXPECT_FALSE(loops[0].compiled);
+    EXPECT_TRUE(loops[0].failed);
+    EXPECT_FALSE(loops[1].compiled);
+    EXPECT_TRUE(loops[1].failed);
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <string>
+#include "natrix/compiler/optimizer.h"
+#include "natrix/compiler/resolver.h"
+#include "natrix/interp/ast_interp.h"
+#include "natrix/obj/nx_int.h"
+#include "natrix/parser/parser.h"
+
+static std::string optimize(const char *source, bool execute = false) {
+#if ENABLE_CONSERVATIVE_GC
+    gc_set_stack_bottom(__builtin_frame_address(0));
+#endif
+    Source src = source_from_string("<string>", source);
+    Arena arena = arena_init();
+    Stmt *stmt = parse_file(&arena, &src, diag_default_handler, nullptr);
+    EXPECT_NE(stmt, nullptr);
+    Env env = env_init();
+    gc_root(&env.gc_header);
+    LiteralPool literals = literal_pool_init();
+    gc_root(&literals.gc_header);
+    env_store(&env, env_declare(&env, "arg", 3), nx_int_create(5));
+    resolve_program(&env, &literals, stmt);
+    stmt = optimize_program(&arena, &env, &literals, stmt);
+    std::string result;
+    if (execute) {
+        testing::internal::CaptureStdout();
+        ast_interp_exec(&env, &literals, stmt);
+        fflush(stdout);
+        result = testing::internal::GetCapturedStdout();
+    } else {
+        StringBuilder sb = sb_init();
+        ast_dump(&sb, stmt);
+        result = sb.str;
+        sb_free(&sb);
+    }
+    gc_unroot(&literals.gc_header);
+    literal_pool_free(&literals);
+    gc_unroot(&env.gc_header);
+    env_free(&env);
+    gc_collect();
+    arena_free(&arena);
+    source_free(&src);
+#if ENABLE_CONSERVATIVE_GC
+    gc_set_stack_bottom(nullptr);
+#endif
+    return result;
+}
+
+TEST(OptimizerTest, FoldsConstants) {
+    EXPECT_EQ(optimize("print(60 * 60 * 24 - arg)\nprint(\"a\" + \"b\")\nprint([1 + 2, 7 / 0, 1 + \"x\"])\n"),
+              "AST dump:\n"
+              "  STMT_PRINT\n"
+              "    expr: EXPR_BINARY {op: SUB}\n"
+              "      left: EXPR_INT_LITERAL {literal: \"86400\"}\n"
+              "      right: EXPR_NAME {identifier: \"arg\"}\n"
+              "  STMT_PRINT\n"
+              "    expr: EXPR_STR_LITERAL {literal: \"ab\"}\n"
+              "  STMT_PRINT\n"
+              "    expr: EXPR_LIST_LITERAL\n"
+              "      EXPR_INT_LITERAL {literal: \"3\"}\n"
+              "      EXPR_BINARY {op: DIV}\n"
+              "        left: EXPR_INT_LITERAL {literal: \"7\"}\n"
+              "        right: EXPR_INT_LITERAL {literal: \"0\"}\n"
+              "      EXPR_BINARY {op: ADD}\n"
+              "        left: EXPR_INT_LITERAL {literal: \"1\"}\n"
+              "        right: EXPR_STR_LITERAL {literal: \"x\"}\n");
+    EXPECT_EQ(optimize("print(9223372036854775807 + 1 - 10 / 3 * (2 < 3))\n", true), "9223372036854775805\n");
+}
+
+TEST(OptimizerTest, PrunesBranches) {
+    EXPECT_EQ(optimize("if 1 < 2:\n    pass\n    print(1)\nelse:\n    print(2)\n"
+                       "while 0:\n    print(3)\n"
+                       "if arg:\n    pass\nelse:\n    if \"\":\n        print(4)\n"),
+              "AST dump:\n"
+              "  STMT_PRINT\n"
+              "    expr: EXPR_INT_LITERAL {literal: \"1\"}\n"
+              "  STMT_IF\n"
+              "    condition: EXPR_NAME {identifier: \"arg\"}\n"
+              "    then_body:\n"
+              "      STMT_PASS\n"
+              "    else_body:\n"
+              "      STMT_PASS\n");
+    EXPECT_EQ(optimize("pass\nif 0:\n    pass\n"), "AST dump:\n");
+}
+
+TEST(OptimizerTest, HoistsInvariants) {
+    EXPECT_EQ(optimize("n = arg + 1\ni = 0\nwhile i < n * 2:\n    i = i + n * 2 + (n - 1) / 2\n"),
+              "AST dump:\n"
+              "  STMT_ASSIGNMENT\n"
+              "    left: EXPR_NAME {identifier: \"n\"}\n"
+              "    right: EXPR_BINARY {op: ADD}\n"
+              "      left: EXPR_NAME {identifier: \"arg\"}\n"
+              "      right: EXPR_INT_LITERAL {literal: \"1\"}\n"
+              "  STMT_ASSIGNMENT\n"
+              "    left: EXPR_NAME {identifier: \"i\"}\n"
+              "    right: EXPR_INT_LITERAL {literal: \"0\"}\n"
+              "  STMT_ASSIGNMENT\n"
+              "    left: EXPR_NAME {identifier: \"$3\"}\n"
+              "    right: EXPR_BINARY {op: MUL}\n"
+              "      left: EXPR_NAME {identifier: \"n\"}\n"
+              "      right: EXPR_INT_LITERAL {literal: \"2\"}\n"
+              "  STMT_ASSIGNMENT\n"
+              "    left: EXPR_NAME {identifier: \"$4\"}\n"
+              "    right: EXPR_BINARY {op: DIV}\n"
+              "      left: EXPR_BINARY {op: SUB}\n"
+              "        left: EXPR_NAME {identifier: \"n\"}\n"
+              "        right: EXPR_INT_LITERAL {literal: \"1\"}\n"
+              "      right: EXPR_INT_LITERAL {literal: \"2\"}\n"
+              "  STMT_WHILE\n"
+              "    condition: EXPR_BINARY {op: LT}\n"
+              "      left: EXPR_NAME {identifier: \"i\"}\n"
+              "      right: EXPR_NAME {identifier: \"$3\"}\n"
+              "    body:\n"
+              "      STMT_ASSIGNMENT\n"
+              "        left: EXPR_NAME {identifier: \"i\"}\n"
+              "        right: EXPR_BINARY {op: ADD}\n"
+              "          left: EXPR_BINARY {op: ADD}\n"
+              "            left: EXPR_NAME {identifier: \"i\"}\n"
+              "            right: EXPR_NAME {identifier: \"$3\"}\n"
+              "          right: EXPR_NAME {identifier: \"$4\"}\n");
+}
+
+TEST(OptimizerTest, KeepsUnsafeExpressions) {
+    // s is not an integer, d may be zero, m is not assigned on all paths and k changes in the loop
+    const char *source = "s = \"a\"\nd = arg - 5\nif arg:\n    m = 1\nk = 0\n"
+                         "while k < 2:\n    print(s + s)\n    print(arg / d)\n    print(m * 2)\n    k = k + 1\n";
+    std::string dump = optimize(source);
+    EXPECT_EQ(dump.find("$"), std::string::npos) << dump;
+}
+
+TEST(OptimizerTest, PreservesBehavior) {
+    EXPECT_EQ(optimize("i = 0\nt = 0\nwhile i < arg:\n    j = 0\n    while j < arg * 2:\n        t = t + i * arg + j\n"
+                       "        j = j + 1\n    i = i + 1\n    if 2 > 3:\n        t = \"x\"\nprint(t)\n", true),
+              "725\n");
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "natrix/compiler/resolver.h"
+#include "natrix/obj/nx_int.h"
+#include "natrix/obj/nx_str.h"
+#include "natrix/parser/parser.h"
+
+TEST(ResolverTest, AssignsSlots) {
+    Source src = source_from_string("<string>", "a = b\nwhile a:\n  b = [a, c]\n");
+    Arena arena = arena_init();
+    Stmt *stmt = parse_file(&arena, &src, diag_default_handler, nullptr);
+    ASSERT_NE(stmt, nullptr);
+    Env env = env_init();
+    LiteralPool literals = literal_pool_init();
+    uint32_t c = env_declare(&env, "c", 1);
+    resolve_program(&env, &literals, stmt);
+
+    EXPECT_EQ(env.count, 3);
+    EXPECT_EQ(c, 0);
+    uint32_t a = stmt->assignment.left->identifier.slot;
+    uint32_t b = stmt->assignment.right->identifier.slot;
+    EXPECT_EQ(a, 1);
+    EXPECT_EQ(b, 2);
+    const Stmt *loop = stmt->next;
+    EXPECT_EQ(loop->while_stmt.condition->identifier.slot, a);
+    const Stmt *body = loop->while_stmt.body;
+    EXPECT_EQ(body->assignment.left->identifier.slot, b);
+    const Expr *items = body->assignment.right->literal.head;
+    EXPECT_EQ(items->identifier.slot, a);
+    EXPECT_EQ(items->next->identifier.slot, c);
+    EXPECT_EQ(literals.count, 0);
+
+    literal_pool_free(&literals);
+    env_free(&env);
+    arena_free(&arena);
+    source_free(&src);
+}
+
+TEST(ResolverTest, MaterializesLiterals) {
+    Source src = source_from_string("<string>", "x = [300, \"ab\"]\nprint(x[0] + 300)\n");
+    Arena arena = arena_init();
+    Stmt *stmt = parse_file(&arena, &src, diag_default_handler, nullptr);
+    ASSERT_NE(stmt, nullptr);
+    Env env = env_init();
+    LiteralPool literals = literal_pool_init();
+    gc_root(&literals.gc_header);
+    resolve_program(&env, &literals, stmt);
+    gc_collect();
+
+    // the second 300 shares the value of the first one
+    ASSERT_EQ(literals.count, 3);
+    const Expr *items = stmt->assignment.right->literal.head;
+    EXPECT_EQ(items->literal.index, 0);
+    EXPECT_EQ(items->next->literal.index, 1);
+    EXPECT_EQ(nx_int_get_value(literal_pool_get(&literals, 0)), 300);
+    EXPECT_STREQ(nx_str_get_cstr(literal_pool_get(&literals, 1)), "ab");
+    const Expr *index = stmt->next->expr->binary.left->subscript.index;
+    EXPECT_EQ(index->literal.index, 2);
+    EXPECT_EQ(nx_int_get_value(literal_pool_get(&literals, 2)), 0);
+    EXPECT_EQ(stmt->next->expr->binary.right->literal.index, 0);
+
+    gc_unroot(&literals.gc_header);
+    literal_pool_free(&literals);
+    env_free(&env);
+    arena_free(&arena);
+    source_free(&src);
+}
+
+TEST(ResolverTest, NewSlotsAreUndefined) {
+    std::vector<std::string> names;
+    for (int i = 0; i < 100; i++) {
+        names.push_back("v" + std::to_string(i));
+    }
+    Env env = env_init();
+    for (int i = 0; i < 100; i++) {
+        EXPECT_EQ(env_declare(&env, names[i].data(), names[i].size()), i);
+        EXPECT_EQ(env.values[i], nullptr);
+    }
+    EXPECT_EQ(env_declare(&env, "v42", 3), 42);
+    EXPECT_EQ(env.count, 100);
+    env_free(&env);
+}
+
+TEST(ResolverTest, NamesAreCopied) {
+    Env env = env_init();
+    std::string name = "abc";
+    EXPECT_EQ(env_declare(&env, name.data(), name.size()), 0);
+    name[0] = 'x';
+    EXPECT_EQ(std::string(env.names[0].start, env.names[0].length), "abc");
+    EXPECT_EQ(env_declare(&env, "abc", 3), 0);
+    EXPECT_EQ(env_declare(&env, name.data(), name.size()), 1);
+    env_free(&env);
+}
+
+TEST(ResolverTest, SharesInternedLiterals) {
+    Source src = source_from_string("<string>", "a = \"k\" + \"xy\"\nb = \"xy\"\nc = \"yx\"\nd = {\"xy\": 7}\n");
+    Arena arena = arena_init();
+    Stmt *stmt = parse_file(&arena, &src, diag_default_handler, nullptr);
+    ASSERT_NE(stmt, nullptr);
+    Env env = env_init();
+    LiteralPool literals = literal_pool_init();
+    gc_root(&literals.gc_header);
+    resolve_program(&env, &literals, stmt);
+
+    // "k", "xy", "yx" and 7
+    EXPECT_EQ(literals.count, 4);
+    uint32_t xy = stmt->assignment.right->binary.right->literal.index;
+    EXPECT_EQ(stmt->next->assignment.right->literal.index, xy);
+    EXPECT_EQ(stmt->next->next->next->assignment.right->literal.head->literal.index, xy);
+    EXPECT_NE(stmt->next->next->assignment.right->literal.index, xy);
+    EXPECT_NE(((NxStr *) literal_pool_get(&literals, xy))->hash, 0u);
+
+    gc_unroot(&literals.gc_header);
+    literal_pool_free(&literals);
+    env_free(&env);
+    arena_free(&arena);
+    source_free(&src);
+}
+
+TEST(ResolverTest, ManyNames) {
+    std::string source;
+    for (int i = 0; i < 5000; i++) {
+        source += "v" + std::to_string(i) + " = v" + std::to_string(i / 2) + "\n";
+    }
+    Source src = source_from_string("<string>", source.c_str());
+    Arena arena = arena_init();
+    Stmt *stmt = parse_file(&arena, &src, diag_default_handler, nullptr);
+    ASSERT_NE(stmt, nullptr);
+    Env env = env_init();
+    LiteralPool literals = literal_pool_init();
+    resolve_program(&env, &literals, stmt);
+
+    EXPECT_EQ(env.count, 5000);
+    int i = 0;
+    for (const Stmt *s = stmt; s; s = s->next, i++) {
+        EXPECT_EQ(s->assignment.left->identifier.slot, (uint32_t) i);
+        EXPECT_EQ(s->assignment.right->identifier.slot, (uint32_t) (i / 2));
+    }
+    EXPECT_EQ(env_declare(&env, "v4999", 5), 4999);
+
+    literal_pool_free(&literals);
+    env_free(&env);
+    arena_free(&arena);
+    source_free(&src);
+}
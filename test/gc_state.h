@@ -10,9 +10,13 @@
 
 #include "natrix/util/gc.h"
 #include "natrix/util/gc_internals.h"
+#include "natrix/util/mem.h"
 
 class GcStateW {
 public:
+    //! Size of the small objects used by the tests, as accounted by the collector.
+    static constexpr size_t OBJECT_SIZE = 16;
+
     GcStateW() : state(gc_get_internal_state()) {
         reset();
     }
@@ -22,39 +26,71 @@ public:
     }
 
     void reset() {
-        state->head = nullptr;
-        state->objects_count = 0;
-        state->threshold = 100;
-        state->roots_count = 0;
+        gc_sweeper_wait();
+        slab_free_all();
+        // objects left by a test are not finalized, only their memory is released
+        for (GcHeader *current = state->large; current != nullptr;) {
+            GcHeader *next = GC_NEXT(current);
+            nx_free(gc_large_prefix(current));
+            current = next;
+        }
+        state->large = nullptr;
+        state->policy = gc_default_policy();
+        state->policy.young_size = 100 * OBJECT_SIZE;
+        state->policy.initial_heap_size = 1000 * OBJECT_SIZE;
+        state->young_bytes = 0;
+        state->old_bytes = 0;
+        state->old_threshold = 1000 * OBJECT_SIZE;
+        state->remembered_count = 0;
+        nx_free(state->mark_stack);
+        state->mark_stack = nullptr;
+        state->mark_stack_count = 0;
+        state->mark_stack_capacity = 0;
+        state->mark_stack_limit = GC_DEFAULT_MARK_STACK_LIMIT;
+        state->mark_stack_overflow = false;
+        gc_root_stack.count = 0;
+        state->stack_bottom = nullptr;
+        state->stack_roots_count = 0;
+        state->parallel = false;
+        state->marking = false;
+        state->stats = {};
+        state->callback = nullptr;
+        state->callback_data = nullptr;
+        state->tracker = {};
+        state->tracked_count = 0;
     }
 
     bool is_valid(const void *obj) const {
-        GcHeader *current = state->head;
-        while (current != nullptr) {
-            if (current == obj) {
-                return true;
-            }
-            current = current->next;
-        }
-        return false;
+        return is_large(obj) || slab_is_live(obj);
+    }
+
+    bool is_old(const void *obj) const {
+        return is_valid(obj) && gc_is_marked((const GcHeader *) obj);
     }
 
     [[nodiscard]] bool check_count(size_t expected_count) const {
-        size_t count = 0;
-        GcHeader *current = state->head;
-        while (current != nullptr) {
+        size_t count = slab_get_live_count();
+        for (GcHeader *current = state->large; current != nullptr; current = GC_NEXT(current)) {
             count++;
-            current = current->next;
         }
-        return count == state->objects_count && count == expected_count;
+        return count == expected_count;
     }
 
     [[nodiscard]] size_t threshold() const {
-        return state->threshold;
+        return state->policy.young_size / OBJECT_SIZE;
     }
 
 private:
     GcState *state;
+
+    bool is_large(const void *obj) const {
+        for (GcHeader *current = state->large; current != nullptr; current = GC_NEXT(current)) {
+            if (current == obj) {
+                return true;
+            }
+        }
+        return false;
+    }
 };
 
 #endif //GC_STATE_H
@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include "natrix/interp/builtins.h"
+#include "natrix/obj/nx_int.h"
+#include "natrix/obj/nx_list.h"
+#include "natrix/obj/nx_str.h"
+#include "../gc_state.h"
+
+static std::string int_to_string(NxObject *value) {
+    StringBuilder sb = sb_init();
+    nx_int_append_to(&sb, value);
+    std::string result = sb.str;
+    sb_free(&sb);
+    return result;
+}
+
+TEST(BuiltinsTest, Lookup) {
+    EXPECT_EQ(builtin_lookup("len", 3), BUILTIN_LEN);
+    EXPECT_EQ(builtin_lookup("range(", 5), BUILTIN_RANGE);
+    EXPECT_EQ(builtin_lookup("su", 2), BUILTIN_COUNT);
+    EXPECT_EQ(builtin_lookup("print", 5), BUILTIN_COUNT);
+    for (uint32_t i = 0; i < BUILTIN_COUNT; i++) {
+        const char *name = builtin_get(i)->name;
+        EXPECT_EQ(builtin_lookup(name, strlen(name)), i);
+    }
+}
+
+TEST(BuiltinsTest, Range) {
+    GcStateW gc_state;
+    NxObject *args[] = {nx_int_create(5), nx_int_create(0), nx_int_create(-2)};
+    NxObject *list = builtin_call(BUILTIN_RANGE, args, 3);
+    gc_root(nxo_gc_header(list));
+    EXPECT_EQ(((NxList *) list)->strategy, NX_LIST_INTS);
+    EXPECT_EQ(nx_list_get_length(list), 3);
+    EXPECT_EQ(nxo_get_element(list, nx_int_create(2)), nx_int_create(1));
+    EXPECT_EQ(nx_list_get_length(builtin_call(BUILTIN_RANGE, args + 1, 1)), 0);
+    EXPECT_EQ(nx_list_get_length(builtin_call(BUILTIN_RANGE, args, 1)), 5);
+    NxObject *bounds[] = {nx_int_create(NX_INT_IMMEDIATE_MAX - 2), nx_int_create(NX_INT_IMMEDIATE_MAX)};
+    NxObject *top = builtin_call(BUILTIN_RANGE, bounds, 2);
+    EXPECT_EQ(nx_list_get_length(top), 2);
+    EXPECT_EQ(nxo_get_element(top, nx_int_create(1)), nx_int_create(NX_INT_IMMEDIATE_MAX - 1));
+    gc_unroot(nxo_gc_header(list));
+    gc_collect();
+    EXPECT_TRUE(gc_state.check_count(0));
+}
+
+TEST(BuiltinsTest, SumOfInts) {
+    GcStateW gc_state;
+    NxObject *list = nx_list_create(16);
+    gc_root(nxo_gc_header(list));
+    EXPECT_EQ(builtin_call(BUILTIN_SUM, &list, 1), nx_int_create(0));
+    for (int i = 0; i < 1001; i++) {
+        nx_list_append(list, nx_int_create(i % 2 ? NX_INT_IMMEDIATE_MIN : NX_INT_IMMEDIATE_MAX));
+    }
+    ASSERT_EQ(((NxList *) list)->strategy, NX_LIST_INTS);
+    // 501 * (2^62 - 1) - 500 * 2^62
+    EXPECT_EQ(int_to_string(builtin_call(BUILTIN_SUM, &list, 1)), "4611686018427387403");
+    for (int i = 0; i < 1001; i++) {
+        nxo_set_element(list, nx_int_create(i), nx_int_create(NX_INT_IMMEDIATE_MIN));
+    }
+    EXPECT_EQ(int_to_string(builtin_call(BUILTIN_SUM, &list, 1)), "-4616297704445815291904");
+    gc_unroot(nxo_gc_header(list));
+    gc_collect();
+    EXPECT_TRUE(gc_state.check_count(0));
+}
+
+TEST(BuiltinsTest, SumOfObjects) {
+    GcStateW gc_state;
+    NxObject *big = nx_int_create(INT64_MAX);
+    gc_root(nxo_gc_header(big));
+    NxObject *items[] = {nx_int_create(1), big, big};
+    NxObject *list = nx_list_create_from(items, 3);
+    gc_unroot(nxo_gc_header(big));
+    gc_root(nxo_gc_header(list));
+    EXPECT_EQ(((NxList *) list)->strategy, NX_LIST_OBJECTS);
+    EXPECT_EQ(int_to_string(builtin_call(BUILTIN_SUM, &list, 1)), "18446744073709551615");
+    gc_unroot(nxo_gc_header(list));
+    gc_collect();
+    EXPECT_TRUE(gc_state.check_count(0));
+}
+
+TEST(BuiltinsTest, MinMax) {
+    GcStateW gc_state;
+    NxObject *list = nx_list_create(16);
+    gc_root(nxo_gc_header(list));
+    for (int i = 0; i < 37; i++) {
+        nx_list_append(list, nx_int_create((i * 7919) % 101 - 50));
+    }
+    int64_t lowest = INT64_MAX;
+    int64_t highest = INT64_MIN;
+    for (int i = 0; i < 37; i++) {
+        lowest = std::min<int64_t>(lowest, (i * 7919) % 101 - 50);
+        highest = std::max<int64_t>(highest, (i * 7919) % 101 - 50);
+    }
+    EXPECT_EQ(builtin_call(BUILTIN_MIN, &list, 1), nx_int_create(lowest));
+    EXPECT_EQ(builtin_call(BUILTIN_MAX, &list, 1), nx_int_create(highest));
+    NxObject *big = nx_int_create(INT64_MIN);
+    nxo_set_element(list, nx_int_create(20), big);
+    EXPECT_EQ(((NxList *) list)->strategy, NX_LIST_OBJECTS);
+    EXPECT_EQ(builtin_call(BUILTIN_MIN, &list, 1), big);
+    EXPECT_EQ(builtin_call(BUILTIN_MAX, &list, 1), nx_int_create(highest));
+    NxObject *args[] = {nx_int_create(3), nx_int_create(-1), nx_int_create(2)};
+    EXPECT_EQ(builtin_call(BUILTIN_MIN, args, 3), nx_int_create(-1));
+    EXPECT_EQ(builtin_call(BUILTIN_MAX, args, 3), nx_int_create(3));
+    gc_unroot(nxo_gc_header(list));
+    gc_collect();
+    EXPECT_TRUE(gc_state.check_count(0));
+}
+
+TEST(BuiltinsTest, Len) {
+    GcStateW gc_state;
+    NxObject *str = nx_str_create("hello", 5);
+    gc_root(nxo_gc_header(str));
+    EXPECT_EQ(builtin_call(BUILTIN_LEN, &str, 1), nx_int_create(5));
+    gc_unroot(nxo_gc_header(str));
+    gc_collect();
+    NxObject *one = nx_int_create(1);
+    EXPECT_DEATH(builtin_call(BUILTIN_LEN, &one, 1), "len\\(\\) argument must be a list, a string or a dict");
+}
+
+TEST(BuiltinsTest, ReadFileAndLines) {
+    GcStateW gc_state;
+    const char *path = "/tmp/natrix_test_read.txt";
+    FILE *f = fopen(path, "wb");
+    ASSERT_NE(f, nullptr);
+    fputs("first line\nsecond line\n", f);
+    fclose(f);
+    NxObject *name = nx_str_create(path, strlen(path));
+    gc_root(nxo_gc_header(name));
+    NxObject *contents = builtin_call(BUILTIN_READ_FILE, &name, 1);
+    EXPECT_STREQ(nx_str_get_cstr(contents), "first line\nsecond line\n");
+    NxObject *lines = builtin_call(BUILTIN_READ_LINES, &name, 1);
+    gc_root(nxo_gc_header(lines));
+    int64_t position = 0;
+    EXPECT_STREQ(nx_str_get_cstr(nxo_iter_next(lines, &position)), "first line");
+    EXPECT_STREQ(nx_str_get_cstr(nxo_iter_next(lines, &position)), "second line");
+    EXPECT_EQ(nxo_iter_next(lines, &position), nullptr);
+    EXPECT_EQ(position, 2);
+    gc_unroot(nxo_gc_header(lines));
+    gc_unroot(nxo_gc_header(name));
+    gc_collect();
+    EXPECT_TRUE(gc_state.check_count(0));
+    unlink(path);
+    EXPECT_DEATH(builtin_call(BUILTIN_READ_FILE, &name, 1), "Cannot open /tmp/natrix_test_read.txt");
+    NxObject *one = nx_int_create(1);
+    EXPECT_DEATH(builtin_call(BUILTIN_READ_LINES, &one, 1), "read_lines\\(\\) argument must be a string");
+}
@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <string>
+#include "natrix/compiler/compiler.h"
+#include "natrix/compiler/jit.h"
+#include "natrix/compiler/resolver.h"
+#include "natrix/interp/ast_interp.h"
+#include "natrix/interp/exec_counts.h"
+#include "natrix/interp/vm.h"
+#include "natrix/obj/nx_int.h"
+#include "natrix/parser/parser.h"
+
+static ExecCounts count(const char *source, bool use_vm) {
+#if ENABLE_CONSERVATIVE_GC
+    gc_set_stack_bottom(__builtin_frame_address(0));
+#endif
+    ExecCounts counts;
+    exec_counts_start(&counts);
+    Source src = source_from_string("<string>", source);
+    Arena arena = arena_init();
+    Stmt *stmt = parse_file(&arena, &src, diag_default_handler, nullptr);
+    EXPECT_NE(stmt, nullptr);
+    Env env = env_init();
+    gc_root(&env.gc_header);
+    LiteralPool literals = literal_pool_init();
+    gc_root(&literals.gc_header);
+    env_store(&env, env_declare(&env, "arg", 3), nx_int_create(0));
+    resolve_program(&env, &literals, stmt);
+    testing::internal::CaptureStdout();
+    if (use_vm) {
+        Code code = code_init();
+        gc_root(&code.gc_header);
+        compile_program(&code, &literals, stmt);
+        vm_exec(&env, &code);
+        gc_unroot(&code.gc_header);
+        code_free(&code);
+    } else {
+        ast_interp_exec(&env, &literals, stmt);
+    }
+    fflush(stdout);
+    testing::internal::GetCapturedStdout();
+    gc_unroot(&literals.gc_header);
+    literal_pool_free(&literals);
+    gc_unroot(&env.gc_header);
+    env_free(&env);
+    gc_collect();
+    arena_free(&arena);
+    source_free(&src);
+    exec_counts_stop(&counts);
+#if ENABLE_CONSERVATIVE_GC
+    gc_set_stack_bottom(nullptr);
+#endif
+    return counts;
+}
+
+static const char *LOOP =
+        "i = 0\n"
+        "while i < 2000:\n"
+        "    i += 1\n";
+
+TEST(ExecCountsTest, CountsInstructions) {
+    JitPolicy saved = jit_get_policy();
+    JitPolicy policy = saved;
+    policy.enabled = true;
+    jit_set_policy(&policy);
+    // the loop would be compiled after JIT_DEFAULT_THRESHOLD iterations if not counting
+    ExecCounts counts = count(LOOP, true);
+    jit_set_policy(&saved);
+    EXPECT_EQ(counts.opcodes[OP_LOOP], 2000);
+    EXPECT_EQ(counts.opcodes[OP_HALT], 1);
+    for (uint64_t value : counts.stmts) {
+        EXPECT_EQ(value, 0);
+    }
+    for (uint64_t value : counts.exprs) {
+        EXPECT_EQ(value, 0);
+    }
+}
+
+TEST(ExecCountsTest, CountsNodes) {
+    ExecCounts counts = count(LOOP, false);
+    EXPECT_EQ(counts.stmts[STMT_ASSIGNMENT], 1);
+    EXPECT_EQ(counts.stmts[STMT_WHILE], 1);
+    EXPECT_EQ(counts.stmts[STMT_AUG_ASSIGNMENT], 2000);
+    EXPECT_EQ(counts.exprs[EXPR_BINARY], 2001);
+    for (uint64_t value : counts.opcodes) {
+        EXPECT_EQ(value, 0);
+    }
+}
+
+TEST(ExecCountsTest, CountsAreDeterministic) {
+    const char *source =
+            "a = []\n"
+            "s = \"\"\n"
+            "for i in range(1000):\n"
+            "    s = s + \"x\"\n"
+            "    a += [s]\n"
+            "d = {}\n"
+            "for s in a:\n"
+            "    d[s] = len(s)\n"
+            "print(len(d))\n";
+    ExecCounts first = count(source, true);
+    ExecCounts second = count(source, true);
+    EXPECT_GT(first.events[COUNTER_ENV_PROBES], 0);
+    EXPECT_GT(first.events[COUNTER_ARRAY_COPIES], 0);
+    EXPECT_GT(first.gc.allocated_objects, 1000);
+    EXPECT_GT(first.gc.marked_objects, 0);
+    StringBuilder sb1 = sb_init();
+    exec_counts_to_json(&first, &sb1);
+    StringBuilder sb2 = sb_init();
+    exec_counts_to_json(&second, &sb2);
+    EXPECT_STREQ(sb1.str, sb2.str);
+    sb_free(&sb1);
+    sb_free(&sb2);
+}
+
+TEST(ExecCountsTest, Json) {
+    ExecCounts counts;
+    exec_counts_start(&counts);
+    exec_counts_stop(&counts);
+    counts.opcodes[OP_CONST] = 2;
+    counts.opcodes[OP_PRINT] = 1;
+    counts.gc = {};
+    for (uint64_t &value : counts.events) {
+        value = 0;
+    }
+    counts.events[COUNTER_ARENA_CHUNKS] = 3;
+    StringBuilder sb = sb_init();
+    exec_counts_to_json(&counts, &sb);
+    EXPECT_STREQ(sb.str, "{\n"
+                         "  \"instructions\": 3,\n"
+                         "  \"opcodes\": {\n"
+                         "    \"CONST\": 2,\n"
+                         "    \"PRINT\": 1\n"
+                         "  },\n"
+                         "  \"statements\": 0,\n"
+                         "  \"stmts\": {},\n"
+                         "  \"expressions\": 0,\n"
+                         "  \"exprs\": {},\n"
+                         "  \"gc_allocations\": 0,\n"
+                         "  \"gc_allocated_bytes\": 0,\n"
+                         "  \"gc_minor_collections\": 0,\n"
+                         "  \"gc_major_collections\": 0,\n"
+                         "  \"gc_marked_objects\": 0,\n"
+                         "  \"env_probes\": 0,\n"
+                         "  \"array_copies\": 0,\n"
+                         "  \"arena_chunks\": 3\n"
+                         "}\n");
+    sb_free(&sb);
+}
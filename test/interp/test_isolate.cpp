@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "natrix/interp/isolate.h"
+#include "natrix/util/arena.h"
+#include "natrix/util/output.h"
+
+static bool run(NxIsolate *isolate, const char *text, int64_t arg) {
+    Source source = source_from_string("<string>", text);
+    bool result = nx_isolate_run_source(isolate, &source, arg);
+    EXPECT_EQ(source.start, nullptr);
+    return result;
+}
+
+//! Allocates lists and strings, then prints `2000 * 1999 / 2 + 2000 * arg`.
+static const char *const WORKLOAD =
+        "i = 0\n"
+        "total = 0\n"
+        "s = \"xyz\"\n"
+        "while i < 2000:\n"
+        "    t = \"ab\" + s[0:3]\n"
+        "    l = [t, [i, t[0]], s]\n"
+        "    s = l[1][1] + l[2][0:40] + t\n"
+        "    total = total + l[1][0] + arg\n"
+        "    i = i + 1\n"
+        "print(total)\n";
+
+static int64_t workload_result(int64_t arg) {
+    return 2000 * 1999 / 2 + 2000 * arg;
+}
+
+TEST(IsolateTest, VariablesPersistAcrossRuns) {
+    NxIsolate *isolate = nx_isolate_create(nullptr);
+    testing::internal::CaptureStdout();
+    EXPECT_TRUE(run(isolate, "x = arg * 2\ns = \"a\" + \"b\"\n", 7));
+    EXPECT_TRUE(run(isolate, "print(x + arg)\nprint(s)\n", 1));
+    fflush(stdout);
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), "15\nab\n");
+    nx_isolate_destroy(isolate);
+}
+
+TEST(IsolateTest, SyntaxError) {
+    NxIsolate *isolate = nx_isolate_create(nullptr);
+    testing::internal::CaptureStderr();
+    EXPECT_FALSE(run(isolate, "x = \n", 0));
+    EXPECT_NE(testing::internal::GetCapturedStderr(), "");
+    nx_isolate_destroy(isolate);
+}
+
+TEST(IsolateTest, IndependentHeaps) {
+    size_t main_slabs = slab_get_count();
+    GcStats main_stats;
+    gc_get_stats(&main_stats);
+    GcPolicy policy = gc_default_policy();
+    policy.young_size = 4096;
+    NxIsolate *first = nx_isolate_create(&policy);
+    NxIsolate *second = nx_isolate_create(&policy);
+    testing::internal::CaptureStdout();
+    EXPECT_TRUE(run(first, "x = arg\n", 1));
+    EXPECT_TRUE(run(second, "x = arg\n", 2));
+    EXPECT_TRUE(run(first, WORKLOAD, 3));
+    EXPECT_TRUE(run(second, "print(x)\n", 0));
+    EXPECT_TRUE(run(first, "print(x)\n", 0));
+    fflush(stdout);
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), std::to_string(workload_result(3)) + "\n2\n1\n");
+    nx_isolate_destroy(second);
+    nx_isolate_destroy(first);
+    GcStats stats;
+    gc_get_stats(&stats);
+    EXPECT_EQ(stats.allocated_objects, main_stats.allocated_objects);
+    EXPECT_EQ(slab_get_count(), main_slabs);
+}
+
+TEST(IsolateTest, ParallelThreads) {
+    constexpr int THREAD_COUNT = 4;
+    testing::internal::CaptureStdout();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        threads.emplace_back([i]() {
+            GcPolicy policy = gc_default_policy();
+            policy.young_size = 4096;
+            policy.initial_heap_size = 16384;
+            policy.background_sweep = i % 2 == 1;
+            policy.mark_threads = i == 2 ? 2 : 1;
+            policy.pause_budget_us = i == 3 ? 50 : 0;
+            NxIsolate *isolate = nx_isolate_create(&policy);
+            for (int round = 0; round < 3; round++) {
+                EXPECT_TRUE(run(isolate, WORKLOAD, i * 10 + round));
+            }
+            nx_isolate_destroy(isolate);
+            arena_release_pool();
+            output_release();
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    fflush(stdout);
+    std::istringstream output(testing::internal::GetCapturedStdout());
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(output, line);) {
+        lines.push_back(line);
+    }
+    std::vector<std::string> expected;
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        for (int round = 0; round < 3; round++) {
+            expected.push_back(std::to_string(workload_result(i * 10 + round)));
+        }
+    }
+    std::sort(lines.begin(), lines.end());
+    std::sort(expected.begin(), expected.end());
+    EXPECT_EQ(lines, expected);
+}
+
+static bool run_program(NxIsolate *isolate, const char *text, int64_t arg, NxRunStats *stats) {
+    Source source = source_from_string("<string>", text);
+    bool result = nx_isolate_run_program(isolate, &source, arg, stats);
+    EXPECT_EQ(source.start, nullptr);
+    return result;
+}
+
+TEST(IsolateTest, ProgramsAreCached) {
+    NxIsolate *isolate = nx_isolate_create(nullptr);
+    NxRunStats stats;
+    testing::internal::CaptureStdout();
+    EXPECT_TRUE(run(isolate, "x = 100\n", 0));
+    EXPECT_TRUE(run_program(isolate, WORKLOAD, 1, &stats));
+    EXPECT_TRUE(stats.executed);
+    EXPECT_FALSE(stats.cached);
+    EXPECT_GT(stats.compile_ns, 0u);
+    EXPECT_GT(stats.allocated_bytes, 0u);
+    EXPECT_TRUE(run_program(isolate, WORKLOAD, 2, &stats));
+    EXPECT_TRUE(stats.cached);
+    EXPECT_EQ(stats.compile_ns, 0u);
+    // each run has its own variables
+    EXPECT_TRUE(run_program(isolate, "y = arg\nprint(arg)\n", 3, &stats));
+    EXPECT_FALSE(stats.cached);
+    EXPECT_TRUE(run_program(isolate, "y = arg\nprint(arg)\n", 4, &stats));
+    EXPECT_TRUE(stats.cached);
+    fflush(stdout);
+    EXPECT_EQ(testing::internal::GetCapturedStdout(),
+              std::to_string(workload_result(1)) + "\n" + std::to_string(workload_result(2)) + "\n3\n4\n");
+    testing::internal::CaptureStderr();
+    EXPECT_FALSE(run_program(isolate, "x = \n", 0, &stats));
+    EXPECT_NE(testing::internal::GetCapturedStderr(), "");
+    EXPECT_FALSE(stats.executed);
+    nx_isolate_destroy(isolate);
+}
+
+TEST(IsolateTest, LeastRecentlyUsedProgramIsDropped) {
+    NxIsolate *isolate = nx_isolate_create(nullptr);
+    NxRunStats stats;
+    testing::internal::CaptureStdout();
+    for (int i = 0; i <= NX_ISOLATE_PROGRAM_CACHE_SIZE; i++) {
+        std::string program = "print(arg + " + std::to_string(i) + ")\n";
+        EXPECT_TRUE(run_program(isolate, program.c_str(), 0, &stats));
+        EXPECT_FALSE(stats.cached);
+        if (i == 1) {
+            // the first program is used again, so the second one is the least recently used
+            EXPECT_TRUE(run_program(isolate, "print(arg + 0)\n", 0, &stats));
+            EXPECT_TRUE(stats.cached);
+        }
+    }
+    EXPECT_TRUE(run_program(isolate, "print(arg + 0)\n", 0, &stats));
+    EXPECT_TRUE(stats.cached);
+    EXPECT_TRUE(run_program(isolate, "print(arg + 1)\n", 0, &stats));
+    EXPECT_FALSE(stats.cached);
+    testing::internal::GetCapturedStdout();
+    nx_isolate_destroy(isolate);
+}
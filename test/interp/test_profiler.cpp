@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <string>
+#include "natrix/compiler/compiler.h"
+#include "natrix/compiler/resolver.h"
+#include "natrix/interp/ast_interp.h"
+#include "natrix/interp/profiler.h"
+#include "natrix/interp/vm.h"
+#include "natrix/parser/parser.h"
+
+//! Program spending most of its time in the concatenations, which are not compiled to native code.
+static const char *const PROGRAM =
+        "i = 0\n"
+        "s = \"\"\n"
+        "while i < 200000:\n"
+        "    s = \"ab\" + \"cd\" + \"ef\" + \"gh\" + \"ij\" + \"kl\"\n"
+        "    i = i + 1\n"
+        "print(i)\n";
+
+//! Output of a profiled program and the reports of the profiler.
+struct Profile {
+    std::string output;
+    uint64_t samples;
+    std::string collapsed;
+    std::string hot_lines;
+    std::string allocations;
+};
+
+static std::string dump(void (*fn)(StringBuilder *, size_t), size_t max_lines) {
+    StringBuilder sb = sb_init();
+    fn(&sb, max_lines);
+    std::string result = sb.str;
+    sb_free(&sb);
+    return result;
+}
+
+static Profile profile(const char *program, bool use_vm, const ProfilerOptions &options) {
+    Profile result;
+#if ENABLE_CONSERVATIVE_GC
+    gc_set_stack_bottom(__builtin_frame_address(0));
+#endif
+    Source src = source_from_string("<string>", program);
+    Arena arena = arena_init();
+    Stmt *stmt = parse_file(&arena, &src, diag_default_handler, nullptr);
+    EXPECT_NE(stmt, nullptr);
+    Env env = env_init();
+    gc_root(&env.gc_header);
+    LiteralPool literals = literal_pool_init();
+    gc_root(&literals.gc_header);
+    resolve_program(&env, &literals, stmt);
+    Code code = code_init();
+    gc_root(&code.gc_header);
+    compile_program(&code, &literals, stmt);
+    testing::internal::CaptureStdout();
+    profiler_start(&src, &options);
+    EXPECT_TRUE(profiler_is_running());
+    if (use_vm) {
+        profiler_attach_code(&code);
+        vm_exec(&env, &code);
+    } else {
+        profiler_attach_ast(stmt);
+        ast_interp_exec(&env, &literals, stmt);
+    }
+    profiler_stop();
+    EXPECT_FALSE(profiler_is_running());
+    result.output = testing::internal::GetCapturedStdout();
+    result.samples = profiler_sample_count();
+    StringBuilder sb = sb_init();
+    profiler_dump_collapsed(&sb);
+    result.collapsed = sb.str;
+    sb_free(&sb);
+    result.hot_lines = dump(profiler_dump_hot_lines, 1);
+    result.allocations = dump(profiler_dump_allocations, 10);
+    profiler_free();
+    gc_unroot(&code.gc_header);
+    code_free(&code);
+    gc_unroot(&literals.gc_header);
+    literal_pool_free(&literals);
+    gc_unroot(&env.gc_header);
+    env_free(&env);
+    gc_collect();
+    arena_free(&arena);
+    source_free(&src);
+#if ENABLE_CONSERVATIVE_GC
+    gc_set_stack_bottom(nullptr);
+#endif
+    return result;
+}
+
+static void expect_hot_concatenation(bool use_vm) {
+    Profile result = profile(PROGRAM, use_vm, {.interval_us = 100, .allocations = false});
+    EXPECT_EQ(result.output, "200000\n");
+    EXPECT_GT(result.samples, 0u);
+    const std::string &collapsed = result.collapsed;
+    const std::string &hot_lines = result.hot_lines;
+    EXPECT_NE(collapsed.find("<string>:3 while i < 200000:;<string>:4 s = \"ab\" + \"cd\""), std::string::npos)
+            << collapsed;
+    EXPECT_NE(hot_lines.find("  self   total  line\n"), std::string::npos) << hot_lines;
+    // only the hottest line is reported
+    EXPECT_NE(hot_lines.find("%  <string>:4 s = \"ab\" + \"cd\""), std::string::npos) << hot_lines;
+    EXPECT_EQ(hot_lines.find("<string>:3"), std::string::npos) << hot_lines;
+}
+
+TEST(ProfilerTest, Vm) {
+    expect_hot_concatenation(true);
+}
+
+TEST(ProfilerTest, AstInterp) {
+    expect_hot_concatenation(false);
+}
+
+TEST(ProfilerTest, NoSamplesAfterStop) {
+    Source src = source_from_string("<string>", "pass\n");
+    ProfilerOptions options = {.interval_us = 100, .allocations = false};
+    profiler_start(&src, &options);
+    profiler_stop();
+    uint64_t count = profiler_sample_count();
+    volatile uint64_t sum = 0;
+    for (int i = 0; i < 10000000; i++) {
+        sum = sum + i;
+    }
+    EXPECT_EQ(profiler_sample_count(), count);
+    StringBuilder sb = sb_init();
+    profiler_dump_collapsed(&sb);
+    EXPECT_EQ(std::string(sb.str), count > 0 ? "(interpreter) " + std::to_string(count) + "\n" : "");
+    sb_free(&sb);
+    profiler_free();
+    source_free(&src);
+}
+
+//! Program allocating short-lived strings in the loop and a list which survives.
+static const char *const ALLOC_PROGRAM =
+        "a = [1, 2, 3]\n"
+        "i = 0\n"
+        "while i < 10000:\n"
+        "    s = \"ab\" + \"cd\"\n"
+        "    i = i + 1\n"
+        "a[0] = s\n"
+        "print(len(a))\n";
+
+static void expect_allocations(bool use_vm) {
+    GcPolicy policy = gc_get_policy();
+    GcPolicy young = policy;
+    young.young_size = 64 * 1024;
+    gc_set_policy(&young);
+    Profile result = profile(ALLOC_PROGRAM, use_vm, {.interval_us = 0, .allocations = true});
+    gc_set_policy(&policy);
+    EXPECT_EQ(result.output, "3\n");
+    EXPECT_EQ(result.samples, 0u);
+    const std::string &report = result.allocations;
+    EXPECT_NE(report.find("   objects         bytes  survived  type\n"), std::string::npos) << report;
+    // the concatenations are the only allocations in the loop
+    size_t line = report.find("str           <string>:4 s = \"ab\" + \"cd\"\n");
+    ASSERT_NE(line, std::string::npos) << report;
+    EXPECT_EQ(report.substr(report.rfind('\n', line) + 1, 10), "     10000") << report;
+    EXPECT_NE(report.find("list          <string>:1 a = [1, 2, 3]\n"), std::string::npos) << report;
+    EXPECT_NE(report.find("int array     <string>:1 a = [1, 2, 3]\n"), std::string::npos) << report;
+    // storing a string converts the integers of the list to objects
+    EXPECT_NE(report.find("object array  <string>:6 a[0] = s\n"), std::string::npos) << report;
+    EXPECT_EQ(report.find("<string>:5"), std::string::npos) << report;
+}
+
+TEST(ProfilerTest, AllocationsVm) {
+    expect_allocations(true);
+}
+
+TEST(ProfilerTest, AllocationsAstInterp) {
+    expect_allocations(false);
+}
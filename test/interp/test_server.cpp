@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include "natrix/interp/server.h"
+
+static const char *const REQUESTS_PATH = "/tmp/natrix_test_server_requests.txt";
+static const char *const RESULTS_PATH = "/tmp/natrix_test_server_results.txt";
+static const char *const SUM_PATH = "/tmp/natrix_test_server_sum.ntx";
+static const char *const ERROR_PATH = "/tmp/natrix_test_server_error.ntx";
+static const char *const PANIC_PATH = "/tmp/natrix_test_server_panic.ntx";
+
+static void write_file(const char *path, const std::string &contents) {
+    std::ofstream(path) << contents;
+}
+
+//! Returns the value of a field of a result line, without the quotes of strings.
+static std::string field(const std::string &line, const std::string &name) {
+    size_t start = line.find("\"" + name + "\": ");
+    if (start == std::string::npos) {
+        return "";
+    }
+    start += name.size() + 4;
+    if (line[start] == '"') {
+        return line.substr(start + 1, line.find('"', start + 1) - start - 1);
+    }
+    return line.substr(start, line.find_first_of(",}", start) - start);
+}
+
+TEST(ServerTest, RunsRequestedJobs) {
+    constexpr int JOB_COUNT = 40;
+    write_file(SUM_PATH, "total = 0\nfor i in range(arg):\n    total = total + i\nprint(total)\n");
+    write_file(ERROR_PATH, "x = \n");
+    std::string requests;
+    for (int i = 0; i < JOB_COUNT; i++) {
+        requests += std::string(SUM_PATH) + " " + std::to_string(i * 100) + "\n";
+    }
+    requests += std::string(ERROR_PATH) + "\n\n/nonexistent/file.ntx\n" + SUM_PATH + " x\n";
+    write_file(REQUESTS_PATH, requests);
+    int in_fd = open(REQUESTS_PATH, O_RDONLY);
+    int out_fd = open(RESULTS_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    ASSERT_GE(in_fd, 0);
+    ASSERT_GE(out_fd, 0);
+    NxServer *server = nx_server_create(3, nullptr);
+    testing::internal::CaptureStderr();
+    EXPECT_EQ(nx_server_serve(server, in_fd, out_fd), JOB_COUNT + 3u);
+    EXPECT_NE(testing::internal::GetCapturedStderr(), "");
+    nx_server_destroy(server);
+    close(in_fd);
+    close(out_fd);
+
+    std::ifstream results(RESULTS_PATH);
+    std::map<int, std::string> lines;
+    for (std::string line; std::getline(results, line);) {
+        int id = std::stoi(field(line, "id"));
+        EXPECT_EQ(lines.count(id), 0u);
+        lines[id] = line;
+    }
+    ASSERT_EQ(lines.size(), JOB_COUNT + 3u);
+    int cached = 0;
+    for (int i = 0; i < JOB_COUNT; i++) {
+        const std::string &line = lines[i];
+        int64_t n = i * 100;
+        EXPECT_EQ(field(line, "status"), "ok");
+        EXPECT_EQ(field(line, "output"), std::to_string(n * (n - 1) / 2) + "\\n");
+        cached += field(line, "cached") == "true";
+    }
+    // every worker compiles the program at most once
+    EXPECT_GE(cached, JOB_COUNT - 3);
+    EXPECT_EQ(field(lines[JOB_COUNT], "status"), "error");
+    EXPECT_EQ(field(lines[JOB_COUNT], "output"), "");
+    EXPECT_EQ(field(lines[JOB_COUNT + 1], "status"), "unreadable");
+    EXPECT_EQ(field(lines[JOB_COUNT + 2], "status"), "invalid");
+    EXPECT_EQ(field(lines[JOB_COUNT + 2], "path"), SUM_PATH);
+    unlink(REQUESTS_PATH);
+    unlink(RESULTS_PATH);
+    unlink(SUM_PATH);
+    unlink(ERROR_PATH);
+}
+
+TEST(ServerTest, RuntimeErrorFailsOnlyItsJob) {
+    write_file(SUM_PATH, "total = 0\nfor i in range(arg):\n    total = total + i\nprint(total)\n");
+    write_file(PANIC_PATH, "print(\"before\")\nx = [1, 2, 3]\nprint(x[0] / 0)\n");
+    std::string requests = std::string(PANIC_PATH) + "\n" + SUM_PATH + " 10\n" + PANIC_PATH + "\n" + SUM_PATH + " 5\n";
+    write_file(REQUESTS_PATH, requests);
+    int in_fd = open(REQUESTS_PATH, O_RDONLY);
+    int out_fd = open(RESULTS_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    ASSERT_GE(in_fd, 0);
+    ASSERT_GE(out_fd, 0);
+    // a single worker runs the jobs in order, each failing job is followed by a succeeding one
+    NxServer *server = nx_server_create(1, nullptr);
+    testing::internal::CaptureStderr();
+    EXPECT_EQ(nx_server_serve(server, in_fd, out_fd), 4u);
+    EXPECT_NE(testing::internal::GetCapturedStderr().find("Division by zero"), std::string::npos);
+    nx_server_destroy(server);
+    close(in_fd);
+    close(out_fd);
+
+    std::ifstream results(RESULTS_PATH);
+    std::map<int, std::string> lines;
+    for (std::string line; std::getline(results, line);) {
+        lines[std::stoi(field(line, "id"))] = line;
+    }
+    ASSERT_EQ(lines.size(), 4u);
+    for (int id : {0, 2}) {
+        EXPECT_EQ(field(lines[id], "status"), "error");
+        EXPECT_EQ(field(lines[id], "message"), "Division by zero");
+        EXPECT_EQ(field(lines[id], "output"), "before\\n");
+    }
+    EXPECT_EQ(field(lines[1], "status"), "ok");
+    EXPECT_EQ(field(lines[1], "output"), "45\\n");
+    EXPECT_EQ(field(lines[3], "status"), "ok");
+    EXPECT_EQ(field(lines[3], "output"), "10\\n");
+    unlink(REQUESTS_PATH);
+    unlink(RESULTS_PATH);
+    unlink(SUM_PATH);
+    unlink(PANIC_PATH);
+}
@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cstring>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <iterator>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "natrix/compiler/compiler.h"
+#include "natrix/compiler/resolver.h"
+#include "natrix/interp/snapshot.h"
+#include "natrix/interp/vm.h"
+#include "natrix/obj/nx_int.h"
+#include "natrix/obj/nx_list.h"
+#include "natrix/obj/nx_object_array.h"
+#include "natrix/parser/parser.h"
+#include "natrix/util/mem.h"
+
+static const char *const SNAPSHOT_PATH = "/tmp/natrix_test_snapshot.nxs";
+
+static std::string execute(Env *env, const char *source) {
+    Source src = source_from_string("<string>", source);
+    Arena arena = arena_init();
+    Stmt *stmt = parse_file(&arena, &src, diag_default_handler, nullptr);
+    EXPECT_NE(stmt, nullptr);
+    LiteralPool literals = literal_pool_init();
+    gc_root(&literals.gc_header);
+    resolve_program(env, &literals, stmt);
+    Code code = code_init();
+    gc_root(&code.gc_header);
+    compile_program(&code, &literals, stmt);
+    testing::internal::CaptureStdout();
+    vm_exec(env, &code);
+    fflush(stdout);
+    std::string output = testing::internal::GetCapturedStdout();
+    gc_unroot(&code.gc_header);
+    code_free(&code);
+    gc_unroot(&literals.gc_header);
+    literal_pool_free(&literals);
+    arena_free(&arena);
+    source_free(&src);
+    return output;
+}
+
+static bool run_and_save(const char *source) {
+#if ENABLE_CONSERVATIVE_GC
+    gc_set_stack_bottom(__builtin_frame_address(0));
+#endif
+    Env env = env_init();
+    gc_root(&env.gc_header);
+    execute(&env, source);
+    bool saved = snapshot_save(SNAPSHOT_PATH, &env);
+    gc_unroot(&env.gc_header);
+    env_free(&env);
+    gc_collect();
+    return saved;
+}
+
+static bool load_and_run(const char *source, std::string *output = nullptr, bool *image = nullptr) {
+#if ENABLE_CONSERVATIVE_GC
+    gc_set_stack_bottom(__builtin_frame_address(0));
+#endif
+    Env env = env_init();
+    gc_root(&env.gc_header);
+    Snapshot snapshot;
+    bool loaded = snapshot_load(&snapshot, SNAPSHOT_PATH, &env);
+    if (loaded) {
+        if (image) {
+            *image = env.count > 0 && (env.values[0]->gc_header.mark & GC_FLAG_IMAGE);
+        }
+        std::string result = execute(&env, source);
+        if (output) {
+            *output = result;
+        }
+    } else {
+        EXPECT_EQ(env.count, 0u);
+    }
+    gc_unroot(&env.gc_header);
+    env_free(&env);
+    gc_collect();
+    snapshot_close(&snapshot);
+    return loaded;
+}
+
+static const char *const PRELUDE =
+        "squares = []\n"
+        "for i in range(20):\n"
+        "    squares += [i * i]\n"
+        "table = {\"big\": 123456789012345678901234567890, \"flag\": 1 < 2, \"items\": [1, \"two\", 1 > 2]}\n"
+        "w = \"abcdefghijklmnopqrstuvwxyz0123456789\"\n"
+        "rope = w + w + w\n"
+        "view = rope[5:40]\n"
+        "r = range(2, 10, 3)\n"
+        "unset = 0\n"
+        "if unset:\n"
+        "    never = 1\n";
+
+static const char *const PROGRAM =
+        "print(squares[19])\n"
+        "print(table[\"big\"] + 1)\n"
+        "print(table[\"flag\"])\n"
+        "print(table[\"items\"][1])\n"
+        "print(table[\"items\"][2])\n"
+        "print(len(rope))\n"
+        "print(view)\n"
+        "print(r[2])\n";
+
+static const char *const EXPECTED =
+        "361\n"
+        "123456789012345678901234567891\n"
+        "True\n"
+        "two\n"
+        "False\n"
+        "108\n"
+        "fghijklmnopqrstuvwxyz0123456789abcd\n"
+        "8\n";
+
+TEST(SnapshotTest, Roundtrip) {
+    ASSERT_TRUE(run_and_save(PRELUDE));
+    std::string output;
+    bool image = false;
+    EXPECT_TRUE(load_and_run(PROGRAM, &output, &image));
+    EXPECT_EQ(output, EXPECTED);
+    EXPECT_TRUE(image);
+    unlink(SNAPSHOT_PATH);
+}
+
+TEST(SnapshotTest, UnassignedVariablesStayUndefined) {
+    ASSERT_TRUE(run_and_save(PRELUDE));
+    std::string output;
+    EXPECT_TRUE(load_and_run("x = 5\nprint(x)\nprint(unset)\n", &output));
+    EXPECT_EQ(output, "5\n0\n");
+    EXPECT_DEATH(load_and_run("print(never)\n"), "never");
+    unlink(SNAPSHOT_PATH);
+}
+
+TEST(SnapshotTest, RelocatesWhenPreferredAddressIsTaken) {
+    ASSERT_TRUE(run_and_save(PRELUDE));
+    void *blocker = mmap((void *) SNAPSHOT_BASE, SNAPSHOT_PAGE_SIZE, PROT_NONE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    ASSERT_EQ(blocker, (void *) SNAPSHOT_BASE);
+    std::string output;
+    EXPECT_TRUE(load_and_run(PROGRAM, &output));
+    EXPECT_EQ(output, EXPECTED);
+    munmap(blocker, SNAPSHOT_PAGE_SIZE);
+    unlink(SNAPSHOT_PATH);
+}
+
+TEST(SnapshotTest, WrittenImageObjectsAreTraced) {
+    ASSERT_TRUE(run_and_save(PRELUDE));
+    GcPolicy saved_policy = gc_get_policy();
+    GcPolicy policy = saved_policy;
+    policy.young_size = 4096;
+    gc_set_policy(&policy);
+    std::string output;
+    // the new objects are reachable only from objects of the image, which are not traced unless written
+    EXPECT_TRUE(load_and_run("table[\"new\"] = [w + w, w + \"!\"]\n"
+                             "squares += [w + \"?\"]\n"
+                             "junk = []\n"
+                             "for i in range(20000):\n"
+                             "    junk += [w + w]\n"
+                             "print(table[\"new\"][1])\n"
+                             "print(squares[20])\n", &output));
+    EXPECT_EQ(output, "abcdefghijklmnopqrstuvwxyz0123456789!\nabcdefghijklmnopqrstuvwxyz0123456789?\n");
+    gc_set_policy(&saved_policy);
+    unlink(SNAPSHOT_PATH);
+}
+
+TEST(SnapshotTest, RejectsUnsupportedObjects) {
+    Env env = env_init();
+    gc_root(&env.gc_header);
+    env_store(&env, env_declare(&env, "t", 1), (NxObject *) &nx_type_int);
+    EXPECT_FALSE(snapshot_save(SNAPSHOT_PATH, &env));
+    gc_unroot(&env.gc_header);
+    env_free(&env);
+    EXPECT_NE(access(SNAPSHOT_PATH, F_OK), 0);
+}
+
+TEST(SnapshotTest, RejectsInvalidFile) {
+    EXPECT_FALSE(load_and_run(PROGRAM));
+    ASSERT_TRUE(run_and_save(PRELUDE));
+    FILE *f = fopen(SNAPSHOT_PATH, "r+b");
+    ASSERT_NE(f, nullptr);
+    fputc('X', f);
+    fclose(f);
+    EXPECT_FALSE(load_and_run(PROGRAM));
+    ASSERT_TRUE(run_and_save(PRELUDE));
+    off_t sizes[] = {0, 16, 200, SNAPSHOT_PAGE_SIZE + 8};
+    for (off_t size : sizes) {
+        ASSERT_EQ(truncate(SNAPSHOT_PATH, size), 0);
+        EXPECT_FALSE(load_and_run(PROGRAM));
+    }
+    unlink(SNAPSHOT_PATH);
+}
+
+static std::string read_snapshot() {
+    std::ifstream in(SNAPSHOT_PATH, std::ios::binary);
+    return {std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+}
+
+//! Overwrites a field of the first object of a class in the image after the roots and saves the modified file.
+static void corrupt_object(std::string contents, GcClassId class_id, size_t field, int64_t value) {
+    // the names and relocations of the prelude fit in the first page, the image starts with the roots
+    size_t image = SNAPSHOT_PAGE_SIZE;
+    GcHeader header;
+    memcpy(&header, &contents[image], sizeof(header));
+    ASSERT_EQ(header.class_id, NX_CLASS_OBJECT_ARRAY);
+    for (size_t offset = image + NX_ALIGNMENT; offset < contents.size(); offset += NX_ALIGNMENT) {
+        memcpy(&header, &contents[offset], sizeof(header));
+        if (header.mark == (GC_FLAG_MARK | GC_FLAG_IMAGE) && header.class_id == class_id) {
+            memcpy(&contents[offset + field], &value, sizeof(value));
+            std::ofstream out(SNAPSHOT_PATH, std::ios::binary | std::ios::trunc);
+            out << contents;
+            return;
+        }
+    }
+    FAIL() << "no object of class " << class_id;
+}
+
+TEST(SnapshotTest, RejectsCorruptedObjects) {
+    ASSERT_TRUE(run_and_save(PRELUDE));
+    std::string contents = read_snapshot();
+    corrupt_object(contents, NX_CLASS_LIST, offsetof(NxList, length), 0);
+    EXPECT_TRUE(load_and_run("print(len(squares))\n"));
+    corrupt_object(contents, NX_CLASS_LIST, offsetof(GcHeader, class_id), 1000);
+    EXPECT_FALSE(load_and_run(PROGRAM));
+    corrupt_object(contents, NX_CLASS_OBJECT_ARRAY, offsetof(NxObjectArray, size), INT64_C(1) << 40);
+    EXPECT_FALSE(load_and_run(PROGRAM));
+    corrupt_object(contents, NX_CLASS_LIST, offsetof(NxList, length), 1000);
+    EXPECT_FALSE(load_and_run(PROGRAM));
+    unlink(SNAPSHOT_PATH);
+}
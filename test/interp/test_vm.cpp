@@ -0,0 +1,429 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <string>
+#include "natrix/compiler/compiler.h"
+#include "natrix/compiler/resolver.h"
+#include "natrix/interp/ast_interp.h"
+#include "natrix/interp/vm.h"
+#include "natrix/obj/nx_int.h"
+#include "natrix/parser/parser.h"
+
+static std::string run(const char *source, int64_t arg, bool use_vm, std::string *sites = nullptr,
+                       std::string *bytecode = nullptr) {
+#if ENABLE_CONSERVATIVE_GC
+    gc_set_stack_bottom(__builtin_frame_address(0));
+#endif
+    Source src = source_from_string("<string>", source);
+    Arena arena = arena_init();
+    Stmt *stmt = parse_file(&arena, &src, diag_default_handler, nullptr);
+    EXPECT_NE(stmt, nullptr);
+    Env env = env_init();
+    gc_root(&env.gc_header);
+    LiteralPool literals = literal_pool_init();
+    gc_root(&literals.gc_header);
+    env_store(&env, env_declare(&env, "arg", 3), nx_int_create(arg));
+    resolve_program(&env, &literals, stmt);
+    testing::internal::CaptureStdout();
+    if (use_vm) {
+        Code code = code_init();
+        gc_root(&code.gc_header);
+        compile_program(&code, &literals, stmt);
+        vm_exec(&env, &code);
+        if (sites) {
+            StringBuilder sb = sb_init();
+            code_dump_sites(&sb, &code);
+            *sites = sb.str;
+            sb_free(&sb);
+        }
+        if (bytecode) {
+            StringBuilder sb = sb_init();
+            code_dump(&sb, &code);
+            *bytecode = sb.str;
+            sb_free(&sb);
+        }
+        gc_unroot(&code.gc_header);
+        code_free(&code);
+    } else {
+        ast_interp_exec(&env, &literals, stmt);
+    }
+    fflush(stdout);
+    std::string output = testing::internal::GetCapturedStdout();
+    gc_unroot(&literals.gc_header);
+    literal_pool_free(&literals);
+    gc_unroot(&env.gc_header);
+    env_free(&env);
+    gc_collect();
+    arena_free(&arena);
+    source_free(&src);
+#if ENABLE_CONSERVATIVE_GC
+    gc_set_stack_bottom(nullptr);
+#endif
+    return output;
+}
+
+static void expect_output(const char *source, int64_t arg, const char *expected) {
+    EXPECT_EQ(run(source, arg, false), expected);
+    EXPECT_EQ(run(source, arg, true), expected);
+}
+
+static const char *EXAMPLE =
+        "a = [\"Hello\", \"world!\"]\n"
+        "a[0] = \"Goodbye\"\n"
+        "print(a[0] + \" \" + a[1])\n"
+        "if arg >= 200:\n"
+        "    sum = 0\n"
+        "    n = arg - 200\n"
+        "    while n > 0:\n"
+        "        sum = sum + n\n"
+        "        n = n - 1\n"
+        "    print(sum)\n"
+        "elif arg >= 100:\n"
+        "    fact = 1\n"
+        "    n = arg - 100\n"
+        "    while n > 0:\n"
+        "        fact = fact * n\n"
+        "        n = n - 1\n"
+        "    print(fact)\n"
+        "else:\n"
+        "    a = 0\n"
+        "    b = 1\n"
+        "    n = arg\n"
+        "    while n > 0:\n"
+        "        t = a + b\n"
+        "        a = b\n"
+        "        b = t\n"
+        "        n = n - 1\n"
+        "    print(a)\n";
+
+TEST(VmTest, Example) {
+    expect_output(EXAMPLE, 210, "Goodbye world!\n55\n");
+    expect_output(EXAMPLE, 110, "Goodbye world!\n3628800\n");
+    expect_output(EXAMPLE, 30, "Goodbye world!\n832040\n");
+}
+
+TEST(VmTest, Arithmetic) {
+    expect_output("print(7 - 2 * 3 + 10 / 4)\nprint((7 - 2) * 3)\n", 0, "3\n15\n");
+}
+
+TEST(VmTest, Comparison) {
+    expect_output("print(1 < 2)\nprint(2 <= 1)\nprint(3 == 3)\nprint(3 != 3)\nprint(2 > 1)\nprint(2 >= 3)\n", 0,
+                  "True\nFalse\nTrue\nFalse\nTrue\nFalse\n");
+    expect_output("b = 1 < 2\nif b:\n    print(b + b)\nprint(b == 1)\nprint((2 < 1) * 5 - 1)\nprint(max(1 > 2, 0 - 1))\n", 0,
+                  "2\nTrue\n-1\nFalse\n");
+}
+
+TEST(VmTest, Lists) {
+    expect_output("a = [1, [2, 3], \"x\"]\na[1][0] = a[2] + \"y\"\nprint(a[1][0])\nprint(a[0])\n", 0, "xy\n1\n");
+}
+
+TEST(VmTest, Dicts) {
+    expect_output("d = {\"a\": 1, 2: [3], \"a\": 4,}\n"
+                  "d[\"b\" + \"c\"] = d[\"a\"] + d[2][0]\n"
+                  "print(d[\"bc\"])\n"
+                  "print(len(d))\n"
+                  "i = 0\n"
+                  "while i < 100:\n"
+                  "    d[i * i] = i\n"
+                  "    i = i + 1\n"
+                  "print(d[81 * 81] + d[1 == 1])\n"
+                  "print(len(d))\n"
+                  "if {}:\n"
+                  "    print(0)\n"
+                  "elif d:\n"
+                  "    print(len({}))\n", 0,
+                  "7\n3\n82\n103\n0\n");
+}
+
+TEST(VmTest, OperatorSlots) {
+    expect_output("a = [1, 2] + [\"x\"]\n"
+                  "b = 3 * [0] + a * 2\n"
+                  "print(len(b))\n"
+                  "print(b[8])\n"
+                  "print(\"abc\" < \"abd\")\n"
+                  "print(\"ab\" >= \"b\")\n"
+                  "print(\"a\" + \"b\" == \"ab\")\n"
+                  "print(\"1\" == 1)\n"
+                  "print(a != a)\n"
+                  "print((1 < 2) * 5)\n", 0,
+                  "9\nx\nTrue\nFalse\nTrue\nFalse\nFalse\n5\n");
+}
+
+TEST(VmTest, StringComparisonsInConditions) {
+    expect_output("s = \"abracadabra\"\n"
+                  "n = 0\n"
+                  "for c in s:\n"
+                  "    if c == \"a\":\n"
+                  "        n = n + 1\n"
+                  "print(n)\n"
+                  "w = \"\"\n"
+                  "while w < \"aaa\":\n"
+                  "    w = w + \"a\"\n"
+                  "print(w)\n"
+                  "if s[0:4] != \"abra\":\n"
+                  "    print(0)\n"
+                  "elif s[7:] >= \"abra\":\n"
+                  "    print(1)\n"
+                  "if s == 1:\n"
+                  "    print(2)\n", 0,
+                  "5\naaa\n1\n");
+}
+
+TEST(VmTest, Slices) {
+    expect_output("s = \"abcdefghijklmnopqrstuvwxyz\"\n"
+                  "print(s[1:4])\n"
+                  "print(s[:2] + s[0 - 2:])\n"
+                  "print(s[20:100])\n"
+                  "print(s[5:3])\n"
+                  "t = s[2:0 - 2]\n"
+                  "print(t[1:][:3])\n"
+                  "print(t)\n"
+                  "print([1, 2, 3][1:][0])\n", 0,
+                  "bcd\nabyz\nuvwxyz\n\ndef\ncdefghijklmnopqrstuvwx\n2\n");
+}
+
+TEST(VmTest, Builtins) {
+    expect_output("l = range(1, 11)\n"
+                  "print(len(l) + len(\"abc\"))\n"
+                  "print(sum(l))\n"
+                  "print(min(l) + max(l))\n"
+                  "print(max(3, 0 - 7, 5) + min([4, 2 * 1000000000000000000000]))\n"
+                  "r = range(10, 0 - 10, 0 - 3)\n"
+                  "print(len(r))\n"
+                  "print(r[6])\n"
+                  "print(sum([1, r[0], 3 * 1000000000000000000000]))\n"
+                  "sum = 0\n"
+                  "i = 0\n"
+                  "while i < len(l):\n"
+                  "    sum = sum + l[i]\n"
+                  "    i = i + 1\n"
+                  "print(sum - sum(l))\n"
+                  "print(len([]) + sum([]))\n", 0,
+                  "13\n55\n11\n9\n7\n-8\n3000000000000000000011\n0\n0\n");
+}
+
+TEST(VmTest, ForLoops) {
+    expect_output("a = [1, \"b\", [3]]\n"
+                  "for x in a:\n"
+                  "    print(len(a))\n"
+                  "    a = [x]\n"
+                  "for c in \"x\" + \"yz\":\n"
+                  "    for i in range(arg, 0 - 5, 0 - 3):\n"
+                  "        print(c + \"abcdef\"[i])\n"
+                  "s = 0\n"
+                  "for i in range(100000):\n"
+                  "    s = s + i\n"
+                  "print(s)\n"
+                  "for i in []:\n"
+                  "    s = 0\n"
+                  "print(i + s)\n", 4,
+                  "3\n1\n1\nxe\nxb\nxe\nye\nyb\nye\nze\nzb\nze\n4999950000\n5000049999\n");
+}
+
+TEST(VmTest, AugmentedAssignment) {
+    expect_output("a = [1, 2]\n"
+                  "b = a\n"
+                  "a += [\"x\"]\n"
+                  "a += a\n"
+                  "print(len(b))\n"
+                  "print(b[5])\n"
+                  "s = \"ab\"\n"
+                  "t = s\n"
+                  "s += \"c\"\n"
+                  "print(s + t)\n"
+                  "n = arg\n"
+                  "n *= 3\n"
+                  "n -= 1\n"
+                  "n /= 2\n"
+                  "print(n)\n"
+                  "c = [0, 10]\n"
+                  "i = 0\n"
+                  "while i < 5:\n"
+                  "    c[i - i + 1] += i\n"
+                  "    i += 1\n"
+                  "print(c[1])\n", 7,
+                  "6\nx\nabcab\n10\n20\n");
+}
+
+TEST(VmTest, BigIntegers) {
+    expect_output("f = 1\n"
+                  "n = 1\n"
+                  "while n <= 30:\n"
+                  "    f = f * n\n"
+                  "    n = n + 1\n"
+                  "print(f)\n"
+                  "print(f / 1000000000000000000000000 - 265252859)\n"
+                  "print(f > 9223372036854775807)\n"
+                  "print([1, 2][f - f + 1])\n"
+                  "print(\"abc\"[0 - f:f])\n"
+                  "print(100000000000000000000 - 99999999999999999999)\n", 0,
+                  "265252859812191058636308480000000\n"
+                  "0\n"
+                  "True\n"
+                  "2\n"
+                  "abc\n"
+                  "1\n");
+}
+
+//! Runs the program and returns the number of bytes it allocated on the heap.
+static uint64_t allocated_bytes(const char *source, bool use_vm, const char *expected) {
+    GcStats before, after;
+    gc_get_stats(&before);
+    EXPECT_EQ(run(source, 0, use_vm), expected);
+    gc_get_stats(&after);
+    return after.allocated_bytes - before.allocated_bytes;
+}
+
+TEST(VmTest, TemporariesStayOffTheHeap) {
+    const char *fused = "a = 12345678901234567890123\n"
+                        "x = 0\n"
+                        "for i in range(2000):\n"
+                        "    x = a * (a + i) + (a - i) * a\n"
+                        "if x * x > a * a:\n"
+                        "    print(x - 2 * a * a)\n"
+                        "print(x * 1 + 0)\n";
+    const char *split = "a = 12345678901234567890123\n"
+                        "x = 0\n"
+                        "for i in range(2000):\n"
+                        "    s = a + i\n"
+                        "    l = a * s\n"
+                        "    d = a - i\n"
+                        "    r = d * a\n"
+                        "    x = l + r\n"
+                        "print(x - 2 * a * a)\n"
+                        "print(x * 1 + 0)\n";
+    const char *expected = "0\n304831575064776735009884473769445511601910258\n";
+    for (bool use_vm : {false, true}) {
+        uint64_t fused_bytes = allocated_bytes(fused, use_vm, expected);
+        uint64_t split_bytes = allocated_bytes(split, use_vm, expected);
+        // only the stored sums reach the heap, the products and the differences are released after each statement
+        EXPECT_LT(fused_bytes * 3, split_bytes);
+    }
+}
+
+TEST(VmTest, NestedControlFlow) {
+    expect_output("i = 0\n"
+                  "while i < 5:\n"
+                  "    if i == 1:\n"
+                  "        pass\n"
+                  "    elif i == 3:\n"
+                  "        print(\"three\")\n"
+                  "    else:\n"
+                  "        print(i)\n"
+                  "    i = i + 1\n", 0,
+                  "0\n2\nthree\n4\n");
+}
+
+TEST(VmTest, GarbageCollection) {
+    expect_output("a = [0]\n"
+                  "i = 0\n"
+                  "while i < 1000:\n"
+                  "    a[0] = [a[0], \"s\" + \"t\", i * 1000]\n"
+                  "    i = i + 1\n"
+                  "print(a[0][2])\n", 0,
+                  "999000\n");
+}
+
+TEST(VmTest, DeepExpression) {
+    std::string source = "print(";
+    for (int i = 0; i < 200; i++) {
+        source += "[1, \"a\" + (";
+    }
+    source += "\"b\"";
+    for (int i = 0; i < 200; i++) {
+        source += ")][1]";
+    }
+    source += ")\n";
+    std::string expected(200, 'a');
+    expect_output(source.c_str(), 0, (expected + "b\n").c_str());
+}
+
+TEST(VmTest, Quickening) {
+    const char *source = "a = 1\n"
+                         "b = 2\n"
+                         "n = 0\n"
+                         "while n < 30:\n"
+                         "    if n == 10:\n"
+                         "        a = \"x\"\n"
+                         "        b = \"y\"\n"
+                         "    c = a + b\n"
+                         "    n = n + 1\n"
+                         "print(c)\n";
+    std::string sites;
+    EXPECT_EQ(run(source, 0, true, &sites), "xy\n");
+    // the comparisons and `n + 1` are executed by superinstructions, which do not quicken their sites
+    EXPECT_EQ(sites, "0 0040 COMPARE_JUMP specialized=0 deoptimized=0\n"
+                     "1 0060 COMPARE_JUMP specialized=0 deoptimized=0\n"
+                     "2 0100 ADD_STR specialized=2 deoptimized=1\n"
+                     "3 0120 ADD specialized=0 deoptimized=0\n");
+}
+
+TEST(VmTest, QuickeningUnstableTypes) {
+    const char *source = "n = 0\n"
+                         "while n < 300:\n"
+                         "    if n / 2 * 2 == n:\n"
+                         "        a = 1\n"
+                         "    else:\n"
+                         "        a = \"s\"\n"
+                         "    b = a + a\n"
+                         "    n = n + 1\n"
+                         "print(b)\n";
+    std::string sites;
+    EXPECT_EQ(run(source, 0, true, &sites), "ss\n");
+    EXPECT_EQ(sites, "0 0020 COMPARE_JUMP specialized=0 deoptimized=0\n"
+                     "1 0040 DIV_INT specialized=1 deoptimized=0\n"
+                     "2 0050 MUL_INT specialized=1 deoptimized=0\n"
+                     "3 0060 COMPARE_JUMP specialized=0 deoptimized=0\n"
+                     "4 0105 BINARY specialized=4 deoptimized=4\n"
+                     "5 0125 ADD specialized=0 deoptimized=0\n");
+}
+
+TEST(VmTest, SuperinstructionsFallBack) {
+    const char *source = "s = \"\"\n"
+                         "n = 9223372036854775806\n"
+                         "while len(s) < 20:\n"
+                         "    s = s + \"x\"\n"
+                         "    n = n + 1\n"
+                         "print(s)\n"
+                         "print(n)\n";
+    std::string sites;
+    EXPECT_EQ(run(source, 0, true, &sites), std::string(20, 'x') + "\n9223372036854775826\n");
+    // the concatenation executes as separate instructions, the sum with a big integer stays in the superinstruction
+    EXPECT_EQ(sites, "0 0035 COMPARE_JUMP specialized=0 deoptimized=0\n"
+                     "1 0055 ADD_STR specialized=1 deoptimized=0\n"
+                     "2 0075 ADD specialized=0 deoptimized=0\n");
+}
+
+static size_t count_lines(const std::string &text, const std::string &word) {
+    size_t count = 0;
+    for (size_t pos = 0; (pos = text.find(word + "\n", pos)) != std::string::npos; pos++) {
+        count++;
+    }
+    return count;
+}
+
+TEST(VmTest, SubscriptInlineCaches) {
+    const char *source = "a = [10, 20, \"x\"]\n"
+                         "s = \"abc\"\n"
+                         "d = {0: 5}\n"
+                         "b = a\n"
+                         "i = 0\n"
+                         "while i < 3:\n"
+                         "    print(a[i])\n"
+                         "    print(s[i - 3])\n"
+                         "    print(b[0])\n"
+                         "    b = d\n"
+                         "    i = i + 1\n";
+    std::string bytecode;
+    EXPECT_EQ(run(source, 0, true, nullptr, &bytecode), "10\na\n10\n20\nb\n5\nx\nc\n5\n");
+    EXPECT_EQ(count_lines(bytecode, "GET_ELEMENT_LIST"), 1u);
+    EXPECT_EQ(count_lines(bytecode, "GET_ELEMENT_STR"), 1u);
+    // the receiver of `b[0]` changed from a list to a dict
+    EXPECT_EQ(count_lines(bytecode, "GET_ELEMENT_ANY"), 1u);
+    EXPECT_EQ(count_lines(bytecode, "GET_ELEMENT"), 0u);
+}
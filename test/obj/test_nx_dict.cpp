@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include "natrix/obj/nx_bool.h"
+#include "natrix/obj/nx_dict.h"
+#include "natrix/obj/nx_int.h"
+#include "natrix/obj/nx_list.h"
+#include "natrix/obj/nx_str.h"
+#include "../gc_state.h"
+
+TEST(NxDictTest, SetGet) {
+    GcStateW gc_state;
+    NxObject *dict = nx_dict_create(0);
+    gc_root(nxo_gc_header(dict));
+    EXPECT_TRUE(nx_dict_is_instance(dict));
+    EXPECT_EQ(((NxDict *) dict)->table->capacity, NX_DICT_GROUP_SIZE);
+    EXPECT_EQ(nx_dict_get_length(dict), 0);
+    NxObject *key = nx_str_create("abc", 3);
+    gc_root(nxo_gc_header(key));
+    NxObject *value = nx_int_create(INT64_MAX);
+    gc_root(nxo_gc_header(value));
+    nx_dict_set(dict, key, value);
+    nx_dict_set(dict, nx_int_create(1), key);
+    EXPECT_EQ(nx_dict_get_length(dict), 2);
+    EXPECT_EQ(nx_dict_get(dict, key), value);
+    EXPECT_EQ(nx_dict_get(dict, nx_int_create(1)), key);
+    EXPECT_EQ(nx_dict_get(dict, nx_int_create(2)), nullptr);
+    nx_dict_set(dict, key, nx_int_create(3));
+    EXPECT_EQ(nx_dict_get_length(dict), 2);
+    EXPECT_EQ(nx_dict_get(dict, key), nx_int_create(3));
+    gc_unroot(nxo_gc_header(value));
+    gc_unroot(nxo_gc_header(key));
+    gc_collect();
+    EXPECT_TRUE(gc_state.is_valid(dict));
+    EXPECT_TRUE(gc_state.is_valid(((NxDict *) dict)->table));
+    EXPECT_TRUE(gc_state.is_valid(key));
+    EXPECT_FALSE(gc_state.is_valid(value));
+    EXPECT_TRUE(gc_state.check_count(3));
+    gc_unroot(nxo_gc_header(dict));
+    gc_collect();
+    EXPECT_TRUE(gc_state.check_count(0));
+}
+
+TEST(NxDictTest, EqualKeys) {
+    NxObject *dict = nx_dict_create(0);
+    gc_root(nxo_gc_header(dict));
+    std::string left(NX_STR_ROPE_MIN_LENGTH / 2, 'a');
+    std::string right(NX_STR_ROPE_MIN_LENGTH / 2, 'b');
+    NxObject *key1 = nx_str_create((left + right).c_str(), NX_STR_ROPE_MIN_LENGTH);
+    gc_root(nxo_gc_header(key1));
+    NxObject *a = nx_str_create(left.c_str(), (int64_t) left.size());
+    gc_root(nxo_gc_header(a));
+    NxObject *b = nx_str_create(right.c_str(), (int64_t) right.size());
+    gc_root(nxo_gc_header(b));
+    NxObject *key2 = nx_str_concat(a, b);
+    gc_root(nxo_gc_header(key2));
+    EXPECT_EQ(((NxStr *) key2)->data, nullptr);
+    nx_dict_set(dict, key1, nx_int_create(1));
+    EXPECT_EQ(nx_dict_get(dict, key2), nx_int_create(1));
+    EXPECT_EQ(nx_str_get_hash(key1), nx_str_get_hash(key2));
+    nx_dict_set(dict, nx_str_from_char('x'), nx_int_create(2));
+    NxObject *x = nx_str_create("x", 1);
+    gc_root(nxo_gc_header(x));
+    EXPECT_EQ(nx_dict_get(dict, x), nx_int_create(2));
+    nx_dict_set(dict, nx_int_create(1), nx_int_create(3));
+    EXPECT_EQ(nx_dict_get(dict, nx_true), nx_int_create(3));
+    nx_dict_set(dict, nx_false, nx_int_create(4));
+    EXPECT_EQ(nx_dict_get(dict, nx_int_create(0)), nx_int_create(4));
+    NxObject *boxed = nx_int_create_boxed(1);
+    EXPECT_EQ(nx_dict_get(dict, boxed), nx_int_create(3));
+    EXPECT_EQ(nx_dict_get_length(dict), 4);
+    gc_unroot(nxo_gc_header(x));
+    gc_unroot(nxo_gc_header(key2));
+    gc_unroot(nxo_gc_header(b));
+    gc_unroot(nxo_gc_header(a));
+    gc_unroot(nxo_gc_header(key1));
+    gc_unroot(nxo_gc_header(dict));
+}
+
+TEST(NxDictTest, Grow) {
+    GcStateW gc_state;
+    NxObject *dict = nx_dict_create(0);
+    gc_root(nxo_gc_header(dict));
+    const int count = 10000;
+    for (int i = 0; i < count; i++) {
+        char buf[16];
+        int length = snprintf(buf, sizeof(buf), "k%d", i);
+        NxObject *key = nx_str_create(buf, length);
+        gc_root(nxo_gc_header(key));
+        nx_dict_set(dict, key, nx_int_create(i));
+        nx_dict_set(dict, nx_int_create(i), key);
+        gc_unroot(nxo_gc_header(key));
+    }
+    gc_collect();
+    EXPECT_TRUE(gc_state.check_count(2 + count));
+    EXPECT_EQ(nx_dict_get_length(dict), 2 * count);
+    EXPECT_EQ(((NxDict *) dict)->table->capacity, 32768);
+    for (int i = 0; i < count; i++) {
+        NxObject *key = nx_dict_get(dict, nx_int_create(i));
+        ASSERT_NE(key, nullptr);
+        EXPECT_EQ(nx_dict_get(dict, key), nx_int_create(i));
+    }
+    gc_unroot(nxo_gc_header(dict));
+    gc_collect();
+    EXPECT_TRUE(gc_state.check_count(0));
+}
+
+TEST(NxDictTest, ExpectedLength) {
+    NxObject *dict = nx_dict_create(7);
+    EXPECT_EQ(((NxDict *) dict)->table->capacity, 8);
+    dict = nx_dict_create(8);
+    EXPECT_EQ(((NxDict *) dict)->table->capacity, 16);
+}
+
+TEST(NxDictTest, AsBool) {
+    NxObject *dict = nx_dict_create(0);
+    gc_root(nxo_gc_header(dict));
+    EXPECT_EQ(nxo_as_bool(dict), nx_false);
+    nx_dict_set(dict, nx_int_create(0), nx_int_create(0));
+    EXPECT_EQ(nxo_as_bool(dict), nx_true);
+    gc_unroot(nxo_gc_header(dict));
+}
+
+TEST(NxDictTest, GetSetElement) {
+    NxObject *dict = nx_dict_create(0);
+    gc_root(nxo_gc_header(dict));
+    nxo_set_element(dict, nx_int_create(5), dict);
+    EXPECT_EQ(nxo_get_element(dict, nx_int_create(5)), dict);
+    EXPECT_DEATH(nxo_get_element(dict, nx_int_create(6)), "Key not found");
+    NxObject *list = nx_list_create(1);
+    gc_root(nxo_gc_header(list));
+    EXPECT_DEATH(nxo_set_element(dict, list, list), "unhashable type: 'list'");
+    gc_unroot(nxo_gc_header(list));
+    gc_unroot(nxo_gc_header(dict));
+}
@@ -6,27 +6,60 @@
  */
 
 #include <gtest/gtest.h>
+#include <string>
 #include "natrix/obj/nx_bool.h"
 #include "natrix/obj/nx_int.h"
+#include "../gc_state.h"
 
-TEST(NxIntTest, Cached) {
+TEST(NxIntTest, Immediate) {
+    GcStateW gc_state;
     NxObject *a = nx_int_create(42);
     NxObject *b = nx_int_create(42);
     NxObject *c = nx_int_create(43);
     EXPECT_EQ(a, b);
     EXPECT_NE(a, c);
+    EXPECT_TRUE(nxo_is_immediate_int(a));
     EXPECT_TRUE(nx_int_is_instance(a));
+    EXPECT_EQ(nxo_type(a), &nx_type_int);
     EXPECT_EQ(nx_int_get_value(a), 42);
+    EXPECT_EQ(nx_int_get_value(nx_int_create(-1234)), -1234);
+    EXPECT_EQ(nx_int_get_value(nx_int_create(NX_INT_IMMEDIATE_MIN)), NX_INT_IMMEDIATE_MIN);
+    EXPECT_EQ(nx_int_get_value(nx_int_create(NX_INT_IMMEDIATE_MAX)), NX_INT_IMMEDIATE_MAX);
+    EXPECT_TRUE(gc_state.check_count(0));
 }
 
-TEST(NxIntTest, Uncached) {
-    NxObject *a = nx_int_create(-1234);
-    nxo_root(a);
-    NxObject *b = nx_int_create(-1234);
-    nxo_unroot(a);
-    EXPECT_NE(a, b);
+TEST(NxIntTest, Boxed) {
+    GcStateW gc_state;
+    NxObject *a = nx_int_create(INT64_MAX);
+    gc_root(nxo_gc_header(a));
+    NxObject *b = nx_int_create(INT64_MIN);
+    gc_root(nxo_gc_header(b));
+    NxObject *c = nx_int_create_boxed(7);
+    EXPECT_FALSE(nxo_is_immediate_int(a));
+    EXPECT_FALSE(nxo_is_immediate_int(b));
+    EXPECT_FALSE(nxo_is_immediate_int(c));
     EXPECT_TRUE(nx_int_is_instance(a));
-    EXPECT_EQ(nx_int_get_value(a), -1234);
+    EXPECT_TRUE(nx_int_is_instance(c));
+    EXPECT_EQ(nx_int_get_value(a), INT64_MAX);
+    EXPECT_EQ(nx_int_get_value(b), INT64_MIN);
+    EXPECT_EQ(nx_int_get_value(c), 7);
+    EXPECT_EQ(nx_int_get_value(nx_int_create(NX_INT_IMMEDIATE_MAX + 1)), NX_INT_IMMEDIATE_MAX + 1);
+    EXPECT_TRUE(gc_state.check_count(4));
+    gc_collect();
+    EXPECT_TRUE(gc_state.is_valid(a));
+    EXPECT_TRUE(gc_state.is_valid(b));
+    EXPECT_TRUE(gc_state.check_count(2));
+    gc_unroot(nxo_gc_header(b));
+    gc_unroot(nxo_gc_header(a));
+}
+
+TEST(NxIntTest, RootImmediate) {
+    GcStateW gc_state;
+    NxObject *a = nx_int_create(1234);
+    gc_root(nxo_gc_header(a));
+    gc_collect();
+    EXPECT_EQ(nx_int_get_value(a), 1234);
+    gc_unroot(nxo_gc_header(a));
 }
 
 TEST(NxIntTest, AsBool) {
@@ -34,4 +67,72 @@ TEST(NxIntTest, AsBool) {
     NxObject *b = nx_int_create(42);
     EXPECT_EQ(nxo_as_bool(a), nx_false);
     EXPECT_EQ(nxo_as_bool(b), nx_true);
+    EXPECT_EQ(nxo_as_bool(nx_int_create_boxed(0)), nx_false);
+}
+
+static std::string to_string(NxObject *obj) {
+    StringBuilder sb = sb_init();
+    nx_int_append_to(&sb, obj);
+    std::string result = sb.str;
+    sb_free(&sb);
+    return result;
+}
+
+TEST(NxIntTest, OverflowPromotes) {
+    GcStateW gc_state;
+    NxObject *max = nx_int_create(INT64_MAX);
+    gc_root(nxo_gc_header(max));
+    NxObject *a = nx_int_add(max, nx_int_create(1));
+    gc_root(nxo_gc_header(a));
+    EXPECT_TRUE(nx_int_is_instance(a));
+    EXPECT_FALSE(nx_int_fits_int64(a));
+    EXPECT_EQ(to_string(a), "9223372036854775808");
+    NxObject *b = nx_int_sub(a, nx_int_create(1));
+    EXPECT_TRUE(nx_int_fits_int64(b));
+    EXPECT_EQ(nx_int_get_value(b), INT64_MAX);
+    NxObject *c = nx_int_sub(a, max);
+    EXPECT_TRUE(nxo_is_immediate_int(c));
+    EXPECT_EQ(nx_int_get_value(c), 1);
+    NxObject *d = nx_int_mul(nx_int_create(NX_INT_IMMEDIATE_MAX), nx_int_create(NX_INT_IMMEDIATE_MAX));
+    EXPECT_EQ(to_string(d), "21267647932558653957237540927630737409");
+    EXPECT_EQ(nx_int_get_value(nx_int_div(d, nx_int_create(NX_INT_IMMEDIATE_MAX))), NX_INT_IMMEDIATE_MAX);
+    gc_unroot(nxo_gc_header(a));
+    gc_unroot(nxo_gc_header(max));
+    gc_collect();
+}
+
+TEST(NxIntTest, Negative) {
+    GcStateW gc_state;
+    NxObject *min = nx_int_create(INT64_MIN);
+    gc_root(nxo_gc_header(min));
+    NxObject *a = nx_int_div(min, nx_int_create(-1));
+    gc_root(nxo_gc_header(a));
+    EXPECT_EQ(to_string(a), "9223372036854775808");
+    NxObject *b = nx_int_sub(min, a);
+    gc_root(nxo_gc_header(b));
+    EXPECT_EQ(to_string(b), "-18446744073709551616");
+    EXPECT_EQ(nx_int_sign(b), -1);
+    EXPECT_LT(nx_int_compare(b, min), 0);
+    EXPECT_GT(nx_int_compare(a, min), 0);
+    EXPECT_EQ(nx_int_compare(nx_int_add(b, a), min), 0);
+    EXPECT_EQ(to_string(nx_int_div(b, nx_int_create(3))), "-6148914691236517205");
+    EXPECT_EQ(to_string(nx_int_mul(b, b)), "340282366920938463463374607431768211456");
+    EXPECT_EQ(nxo_as_bool(b), nx_true);
+    gc_unroot(nxo_gc_header(b));
+    gc_unroot(nxo_gc_header(a));
+    gc_unroot(nxo_gc_header(min));
+    gc_collect();
+}
+
+TEST(NxIntTest, FromStr) {
+    GcStateW gc_state;
+    EXPECT_EQ(nx_int_get_value(nx_int_from_str("0", 1)), 0);
+    EXPECT_EQ(nx_int_get_value(nx_int_from_str("9223372036854775807", 19)), INT64_MAX);
+    const char *big = "1000000000000000000000000000000000000000";
+    NxObject *a = nx_int_from_str(big, strlen(big));
+    gc_root(nxo_gc_header(a));
+    EXPECT_EQ(to_string(a), big);
+    EXPECT_EQ(to_string(nx_int_div(a, nx_int_from_str(big, strlen(big) - 1))), "10");
+    gc_unroot(nxo_gc_header(a));
+    gc_collect();
 }
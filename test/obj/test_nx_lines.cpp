@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "natrix/obj/nx_lines.h"
+#include "natrix/obj/nx_str.h"
+#include "../gc_state.h"
+
+static const char *const LINES_PATH = "/tmp/natrix_test_lines.txt";
+
+static int open_file(const std::string &contents) {
+    FILE *f = fopen(LINES_PATH, "wb");
+    EXPECT_NE(f, nullptr);
+    fwrite(contents.data(), 1, contents.size(), f);
+    fclose(f);
+    int fd = open(LINES_PATH, O_RDONLY);
+    EXPECT_GE(fd, 0);
+    return fd;
+}
+
+static std::vector<std::string> read_all(NxObject *lines) {
+    std::vector<std::string> result;
+    while (NxObject *line = nx_lines_next(lines)) {
+        result.emplace_back(nx_str_get_data(line), nx_str_get_length(line));
+    }
+    return result;
+}
+
+TEST(NxLinesTest, Empty) {
+    GcStateW gc_state;
+    NxObject *lines = nx_lines_create(open_file(""), true);
+    nxo_root(lines);
+    EXPECT_TRUE(read_all(lines).empty());
+    EXPECT_EQ(((NxLines *) lines)->fd, -1);
+    EXPECT_EQ(nx_lines_next(lines), nullptr);
+    nxo_unroot(lines);
+    gc_collect();
+    EXPECT_TRUE(gc_state.check_count(0));
+    unlink(LINES_PATH);
+}
+
+TEST(NxLinesTest, LinesAcrossBlocks) {
+    GcStateW gc_state;
+    std::vector<std::string> expected;
+    std::string contents;
+    for (int i = 0; contents.size() < 3 * NX_LINES_BLOCK_SIZE; i++) {
+        expected.push_back(std::to_string(i) + std::string(i % 50, 'x'));
+        contents += expected.back() + "\n";
+    }
+    expected.emplace_back("");
+    contents += "\n";
+    expected.emplace_back(NX_LINES_BLOCK_SIZE + 100, 'y');
+    contents += expected.back() + "\n";
+    expected.emplace_back("no newline at the end");
+    contents += expected.back();
+    NxObject *lines = nx_lines_create(open_file(contents), true);
+    nxo_root(lines);
+    EXPECT_EQ(read_all(lines), expected);
+    nxo_unroot(lines);
+    gc_collect();
+    EXPECT_TRUE(gc_state.check_count(0));
+    unlink(LINES_PATH);
+}
+
+TEST(NxLinesTest, LongLinesShareTheBlock) {
+    GcStateW gc_state;
+    NxObject *lines = nx_lines_create(open_file("short\nsome line long enough to be a view\n"), true);
+    nxo_root(lines);
+    NxObject *line = nx_lines_next(lines);
+    EXPECT_EQ(std::string(nx_str_get_data(line), nx_str_get_length(line)), "short");
+    line = nx_lines_next(lines);
+    ASSERT_NE(line, nullptr);
+    EXPECT_EQ(((NxRope *) line)->left, ((NxLines *) lines)->block);
+    EXPECT_STREQ(nx_str_get_cstr(line), "some line long enough to be a view");
+    EXPECT_EQ(nx_lines_next(lines), nullptr);
+    nxo_unroot(lines);
+    gc_collect();
+    EXPECT_TRUE(gc_state.check_count(0));
+    unlink(LINES_PATH);
+}
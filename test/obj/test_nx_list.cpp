@@ -14,28 +14,29 @@
 TEST(NxListTest, Append) {
     GcStateW gc_state;
     NxObject *list = nx_list_create(1);
-    nxo_root(list);
+    gc_root(nxo_gc_header(list));
     EXPECT_TRUE(nx_list_is_instance(list));
-    EXPECT_EQ(((NxList *) list)->items->size, 1);
-    EXPECT_EQ(((NxList *) list)->items->data[0], nullptr);
+    EXPECT_EQ(((NxList *) list)->strategy, NX_LIST_INTS);
+    EXPECT_EQ(((NxList *) list)->ints->size, 1);
     EXPECT_EQ(nx_list_get_length(list), 0);
-    NxObject *obj = nx_int_create(1234);
-    nxo_root(obj);
+    NxObject *obj = nx_int_create(INT64_MAX);
+    gc_root(nxo_gc_header(obj));
     nx_list_append(list, obj);
-    nxo_unroot(obj);
+    gc_unroot(nxo_gc_header(obj));
     EXPECT_EQ(nx_list_get_length(list), 1);
+    EXPECT_EQ(((NxList *) list)->strategy, NX_LIST_OBJECTS);
     nx_list_append(list, list);
     EXPECT_EQ(nx_list_get_length(list), 2);
     EXPECT_EQ(((NxList *) list)->items->size, 3);
     EXPECT_EQ(((NxList *) list)->items->data[0], obj);
     EXPECT_EQ(((NxList *) list)->items->data[1], list);
-    EXPECT_TRUE(gc_state.check_count(4));
+    EXPECT_TRUE(gc_state.check_count(5));
     gc_collect();
     EXPECT_TRUE(gc_state.is_valid(list));
     EXPECT_TRUE(gc_state.is_valid(((NxList *) list)->items));
     EXPECT_TRUE(gc_state.is_valid(obj));
     EXPECT_TRUE(gc_state.check_count(3));
-    nxo_unroot(list);
+    gc_unroot(nxo_gc_header(list));
     gc_collect();
     EXPECT_FALSE(gc_state.is_valid(list));
     EXPECT_FALSE(gc_state.is_valid(obj));
@@ -44,26 +45,201 @@ TEST(NxListTest, Append) {
 
 TEST(NxListTest, AsBool) {
     NxObject *list = nx_list_create(1);
-    nxo_root(list);
+    gc_root(nxo_gc_header(list));
     EXPECT_EQ(nxo_as_bool(list), nx_false);
-    NxObject *obj = nx_int_create(1234);
-    nxo_root(obj);
+    NxObject *obj = nx_int_create(INT64_MAX);
+    gc_root(nxo_gc_header(obj));
     nx_list_append(list, obj);
-    nxo_unroot(obj);
+    gc_unroot(nxo_gc_header(obj));
     EXPECT_EQ(nxo_as_bool(list), nx_true);
-    nxo_unroot(list);
+    gc_unroot(nxo_gc_header(list));
 }
 
 TEST(NxListTest, GetSetElement) {
     NxObject *list = nx_list_create(1);
-    nxo_root(list);
+    gc_root(nxo_gc_header(list));
     EXPECT_EQ(nxo_as_bool(list), nx_false);
-    NxObject *obj = nx_int_create(1234);
-    nxo_root(obj);
+    NxObject *obj = nx_int_create(INT64_MAX);
+    gc_root(nxo_gc_header(obj));
     nx_list_append(list, obj);
     EXPECT_EQ(nxo_get_element(list, nx_int_create(0)), obj);
     nxo_set_element(list, nx_int_create(0), list);
     EXPECT_EQ(nxo_get_element(list, nx_int_create(0)), list);
-    nxo_unroot(obj);
-    nxo_unroot(list);
+    gc_unroot(nxo_gc_header(obj));
+    gc_unroot(nxo_gc_header(list));
+}
+
+TEST(NxListTest, GetSlice) {
+    GcStateW gc_state;
+    NxObject *list = nx_list_create(3);
+    gc_root(nxo_gc_header(list));
+    for (int i = 0; i < 3; i++) {
+        nx_list_append(list, nx_int_create(i));
+    }
+    NxObject *slice = nxo_get_slice(list, nx_int_create(1), nullptr);
+    EXPECT_NE(slice, list);
+    EXPECT_EQ(nx_list_get_length(slice), 2);
+    EXPECT_EQ(nx_int_get_value(nxo_get_element(slice, nx_int_create(0))), 1);
+    EXPECT_EQ(nx_list_get_length(nxo_get_slice(list, nx_int_create(2), nx_int_create(1))), 0);
+    gc_unroot(nxo_gc_header(list));
+}
+
+TEST(NxListTest, IntStrategy) {
+    GcStateW gc_state;
+    NxObject *list = nx_list_create(1);
+    gc_root(nxo_gc_header(list));
+    for (int i = 0; i < 1000; i++) {
+        nx_list_append(list, nx_int_create(i * 3 - 500));
+    }
+    NxList *l = (NxList *) list;
+    EXPECT_EQ(l->strategy, NX_LIST_INTS);
+    EXPECT_EQ(nx_list_get_length(list), 1000);
+    EXPECT_EQ(l->ints->data[999], 2497);
+    EXPECT_EQ(nxo_get_element(list, nx_int_create(10)), nx_int_create(-470));
+    nxo_set_element(list, nx_int_create(10), nx_int_create(NX_INT_IMMEDIATE_MAX));
+    EXPECT_EQ(l->strategy, NX_LIST_INTS);
+    EXPECT_EQ(nx_int_get_value(nxo_get_element(list, nx_int_create(10))), NX_INT_IMMEDIATE_MAX);
+    NxObject *slice = nxo_get_slice(list, nx_int_create(10), nx_int_create(13));
+    EXPECT_EQ(((NxList *) slice)->strategy, NX_LIST_INTS);
+    EXPECT_EQ(nx_list_get_length(slice), 3);
+    EXPECT_EQ(nxo_get_element(slice, nx_int_create(2)), nx_int_create(-464));
+    gc_collect();
+    // the list and its storage, the items are not objects
+    EXPECT_TRUE(gc_state.check_count(2));
+    gc_unroot(nxo_gc_header(list));
+    gc_collect();
+    EXPECT_TRUE(gc_state.check_count(0));
+}
+
+TEST(NxListTest, SwitchesToObjects) {
+    GcStateW gc_state;
+    NxObject *list = nx_list_create(4);
+    gc_root(nxo_gc_header(list));
+    for (int i = 0; i < 5; i++) {
+        nx_list_append(list, nx_int_create(i));
+    }
+    NxObject *big = nx_int_create(INT64_MIN);
+    gc_root(nxo_gc_header(big));
+    nxo_set_element(list, nx_int_create(3), big);
+    gc_unroot(nxo_gc_header(big));
+    NxList *l = (NxList *) list;
+    EXPECT_EQ(l->strategy, NX_LIST_OBJECTS);
+    EXPECT_EQ(nx_list_get_length(list), 5);
+    EXPECT_EQ(nxo_get_element(list, nx_int_create(3)), big);
+    EXPECT_EQ(nxo_get_element(list, nx_int_create(4)), nx_int_create(4));
+    nx_list_append(list, nx_int_create(5));
+    EXPECT_EQ(l->strategy, NX_LIST_OBJECTS);
+    EXPECT_EQ(nxo_get_element(list, nx_int_create(5)), nx_int_create(5));
+    NxObject *slice = nxo_get_slice(list, nx_int_create(2), nx_int_create(4));
+    EXPECT_EQ(nxo_get_element(slice, nx_int_create(1)), big);
+    gc_collect();
+    EXPECT_TRUE(gc_state.is_valid(big));
+    gc_unroot(nxo_gc_header(list));
+    gc_collect();
+    EXPECT_TRUE(gc_state.check_count(0));
+}
+
+TEST(NxListTest, CreateFrom) {
+    GcStateW gc_state;
+    NxObject *ints[] = {nx_int_create(1), nx_int_create(2), nx_int_create(3)};
+    NxObject *list = nx_list_create_from(ints, 3);
+    gc_root(nxo_gc_header(list));
+    EXPECT_EQ(((NxList *) list)->strategy, NX_LIST_INTS);
+    EXPECT_EQ(nx_list_get_length(list), 3);
+    EXPECT_EQ(nxo_get_element(list, nx_int_create(2)), nx_int_create(3));
+    NxObject *mixed[] = {nx_int_create(1), list};
+    NxObject *outer = nx_list_create_from(mixed, 2);
+    gc_root(nxo_gc_header(outer));
+    EXPECT_EQ(((NxList *) outer)->strategy, NX_LIST_OBJECTS);
+    EXPECT_EQ(nxo_get_element(outer, nx_int_create(0)), nx_int_create(1));
+    EXPECT_EQ(nxo_get_element(outer, nx_int_create(1)), list);
+    gc_collect();
+    EXPECT_TRUE(gc_state.check_count(4));
+    gc_unroot(nxo_gc_header(outer));
+    gc_unroot(nxo_gc_header(list));
+    gc_collect();
+    EXPECT_TRUE(gc_state.check_count(0));
+}
+
+TEST(NxListTest, AddMul) {
+    GcStateW gc_state;
+    NxObject *ints[] = {nx_int_create(1), nx_int_create(2)};
+    NxObject *list = nx_list_create_from(ints, 2);
+    gc_root(nxo_gc_header(list));
+    NxObject *sum = nx_type_list.add_fn(list, list);
+    gc_root(nxo_gc_header(sum));
+    EXPECT_EQ(((NxList *) sum)->strategy, NX_LIST_INTS);
+    EXPECT_EQ(nx_list_get_length(sum), 4);
+    EXPECT_EQ(nxo_get_element(sum, nx_int_create(2)), nx_int_create(1));
+    NxObject *mixed[] = {list};
+    NxObject *outer = nx_list_create_from(mixed, 1);
+    gc_root(nxo_gc_header(outer));
+    NxObject *repeated = nx_type_list.mul_fn(nx_int_create(3), outer);
+    EXPECT_EQ(((NxList *) repeated)->strategy, NX_LIST_OBJECTS);
+    EXPECT_EQ(nx_list_get_length(repeated), 3);
+    EXPECT_EQ(nxo_get_element(repeated, nx_int_create(2)), list);
+    repeated = nx_type_list.add_fn(sum, outer);
+    EXPECT_EQ(nx_list_get_length(repeated), 5);
+    EXPECT_EQ(nxo_get_element(repeated, nx_int_create(3)), nx_int_create(2));
+    EXPECT_EQ(nxo_get_element(repeated, nx_int_create(4)), list);
+    EXPECT_EQ(nx_list_get_length(nx_type_list.mul_fn(list, nx_int_create(0))), 0);
+    EXPECT_EQ(nx_list_get_length(nx_type_list.mul_fn(nx_true, list)), 2);
+    EXPECT_EQ(nx_type_list.add_fn(list, nx_int_create(1)), nullptr);
+    EXPECT_EQ(nx_type_list.mul_fn(list, list), nullptr);
+    EXPECT_DEATH(nx_type_list.mul_fn(list, nx_int_create(INT64_MAX)), "List is too long");
+    gc_unroot(nxo_gc_header(outer));
+    gc_unroot(nxo_gc_header(sum));
+    gc_unroot(nxo_gc_header(list));
+    gc_collect();
+    EXPECT_TRUE(gc_state.check_count(0));
+}
+
+TEST(NxListTest, Extend) {
+    GcStateW gc_state;
+    NxObject *list = nx_list_create(1);
+    gc_root(nxo_gc_header(list));
+    NxObject *ints[] = {nx_int_create(1), nx_int_create(2), nx_int_create(3)};
+    nx_list_extend(list, ints, 3);
+    EXPECT_EQ(((NxList *) list)->strategy, NX_LIST_INTS);
+    EXPECT_EQ(nx_list_get_length(list), 3);
+    EXPECT_EQ(((NxList *) list)->ints->size, 3);
+    NxObject *mixed[] = {nx_int_create(4), list};
+    nx_list_extend(list, mixed, 2);
+    EXPECT_EQ(((NxList *) list)->strategy, NX_LIST_OBJECTS);
+    EXPECT_EQ(nx_list_get_length(list), 5);
+    EXPECT_EQ(((NxList *) list)->items->size, 7);
+    EXPECT_EQ(nxo_get_element(list, nx_int_create(2)), nx_int_create(3));
+    EXPECT_EQ(nxo_get_element(list, nx_int_create(3)), nx_int_create(4));
+    EXPECT_EQ(nxo_get_element(list, nx_int_create(4)), list);
+    nx_list_extend(list, ints, 0);
+    EXPECT_EQ(nx_list_get_length(list), 5);
+    gc_collect();
+    EXPECT_TRUE(gc_state.check_count(2));
+    gc_unroot(nxo_gc_header(list));
+    gc_collect();
+    EXPECT_TRUE(gc_state.check_count(0));
+}
+
+TEST(NxListTest, RepeatPattern) {
+    GcStateW gc_state;
+    NxObject *ints[] = {nx_int_create(1), nx_int_create(2), nx_int_create(3)};
+    NxObject *list = nx_list_create_from(ints, 3);
+    gc_root(nxo_gc_header(list));
+    NxObject *repeated = nx_type_list.mul_fn(list, nx_int_create(7));
+    ASSERT_EQ(nx_list_get_length(repeated), 21);
+    for (int64_t i = 0; i < 21; i++) {
+        EXPECT_EQ(((NxList *) repeated)->ints->data[i], i % 3 + 1);
+    }
+    NxObject *mixed[] = {nx_int_create(1), list};
+    NxObject *outer = nx_list_create_from(mixed, 2);
+    gc_root(nxo_gc_header(outer));
+    repeated = nx_type_list.mul_fn(outer, nx_int_create(5));
+    ASSERT_EQ(nx_list_get_length(repeated), 10);
+    for (int64_t i = 0; i < 10; i++) {
+        EXPECT_EQ(((NxList *) repeated)->items->data[i], mixed[i % 2]);
+    }
+    gc_unroot(nxo_gc_header(outer));
+    gc_unroot(nxo_gc_header(list));
+    gc_collect();
+    EXPECT_TRUE(gc_state.check_count(0));
 }
@@ -9,6 +9,7 @@
 #include "natrix/obj/nx_bool.h"
 #include "natrix/obj/nx_str.h"
 #include "natrix/obj/nx_int.h"
+#include "../gc_state.h"
 
 TEST(NxStrTest, CreateAddsNullTerminator) {
     NxObject *str = nx_str_create("Abcd", 3);
@@ -48,3 +49,197 @@ TEST(NxStrTest, GetElement) {
     EXPECT_EQ(((NxStr *) str2)->data[1], '\0');
     EXPECT_STREQ(((NxStr *) str2)->data, "b");
 }
+
+TEST(NxStrTest, ConcatWithEmpty) {
+    NxObject *str1 = nx_str_create("", 0);
+    nxo_root(str1);
+    NxObject *str2 = nx_str_create("Abc", 3);
+    nxo_root(str2);
+    EXPECT_EQ(nx_str_concat(str1, str2), str2);
+    EXPECT_EQ(nx_str_concat(str2, str1), str2);
+    nxo_unroot(str2);
+    nxo_unroot(str1);
+}
+
+TEST(NxStrTest, LongConcatIsFlattenedLazily) {
+    GcStateW gc_state;
+    std::string expected(NX_STR_ROPE_MIN_LENGTH, 'a');
+    expected += "b";
+    NxObject *str1 = nx_str_create(expected.c_str(), NX_STR_ROPE_MIN_LENGTH);
+    gc_root(nxo_gc_header(str1));
+    NxObject *str2 = nx_str_create("b", 1);
+    gc_root(nxo_gc_header(str2));
+    NxObject *result = nx_str_concat(str1, str2);
+    gc_unroot(nxo_gc_header(str2));
+    gc_unroot(nxo_gc_header(str1));
+    gc_root(nxo_gc_header(result));
+    EXPECT_TRUE(nx_str_is_instance(result));
+    EXPECT_EQ(nx_str_get_length(result), NX_STR_ROPE_MIN_LENGTH + 1);
+    EXPECT_EQ(((NxStr *) result)->data, nullptr);
+    gc_collect();
+    EXPECT_TRUE(gc_state.check_count(3));
+    EXPECT_STREQ(nx_str_get_cstr(result), expected.c_str());
+    EXPECT_EQ(((NxStr *) result)->data, nx_str_get_cstr(result));
+    EXPECT_EQ(((NxRope *) result)->right, nullptr);
+    gc_collect();
+    EXPECT_TRUE(gc_state.check_count(2));
+    EXPECT_STREQ(nx_str_get_cstr(result), expected.c_str());
+    gc_unroot(nxo_gc_header(result));
+}
+
+TEST(NxStrTest, RepeatedAppend) {
+    GcStateW gc_state;
+    std::string expected;
+    NxObject *str = nx_str_create("", 0);
+    gc_root(nxo_gc_header(str));
+    for (int i = 0; i < 10000; i++) {
+        std::string piece = std::to_string(i);
+        expected += piece;
+        NxObject *p = nx_str_create(piece.c_str(), (int64_t) piece.size());
+        gc_root(nxo_gc_header(p));
+        NxObject *result = nx_str_concat(str, p);
+        gc_unroot(nxo_gc_header(p));
+        gc_unroot(nxo_gc_header(str));
+        str = result;
+        gc_root(nxo_gc_header(str));
+        if (i % 1000 == 0) {
+            gc_collect();
+        }
+    }
+    EXPECT_EQ(nx_str_get_length(str), (int64_t) expected.size());
+    EXPECT_STREQ(nx_str_get_cstr(str), expected.c_str());
+    gc_unroot(nxo_gc_header(str));
+    gc_collect();
+    EXPECT_TRUE(gc_state.check_count(0));
+}
+
+TEST(NxStrTest, GetElementOfRope) {
+    NxObject *left = nx_str_create("0123456789", 10);
+    nxo_root(left);
+    NxObject *str = left;
+    nxo_root(str);
+    for (int i = 0; i < 10; i++) {
+        NxObject *result = nx_str_concat(str, left);
+        nxo_unroot(str);
+        str = result;
+        nxo_root(str);
+    }
+    NxObject *element = nxo_get_element(str, nx_int_create(107));
+    EXPECT_STREQ(nx_str_get_cstr(element), "7");
+    EXPECT_EQ(nx_str_get_cstr(str)[109], '9');
+    EXPECT_EQ(nx_str_get_cstr(str)[110], '\0');
+    nxo_unroot(str);
+    nxo_unroot(left);
+}
+
+TEST(NxStrTest, GetElementIsCached) {
+    GcStateW gc_state;
+    NxObject *str = nx_str_create("abca", 4);
+    gc_root(nxo_gc_header(str));
+    NxObject *a = nxo_get_element(str, nx_int_create(0));
+    EXPECT_EQ(nxo_get_element(str, nx_int_create(3)), a);
+    EXPECT_EQ(a, nx_str_from_char('a'));
+    EXPECT_NE(nxo_get_element(str, nx_int_create(1)), a);
+    EXPECT_TRUE(gc_state.check_count(1));
+    gc_collect();
+    EXPECT_STREQ(nx_str_get_cstr(a), "a");
+    EXPECT_STREQ(nx_str_get_cstr(nx_str_from_char('\xff')), "\xff");
+    gc_unroot(nxo_gc_header(str));
+}
+
+TEST(NxStrTest, SliceSharesBytes) {
+    GcStateW gc_state;
+    const char *text = "0123456789abcdefghijklmnopqrstuvwxyz";
+    NxObject *str = nx_str_create(text, 36);
+    gc_root(nxo_gc_header(str));
+    NxObject *slice = nxo_get_slice(str, nx_int_create(2), nx_int_create(30));
+    gc_root(nxo_gc_header(slice));
+    EXPECT_EQ(nx_str_get_length(slice), 28);
+    EXPECT_EQ(nx_str_get_data(slice), nx_str_get_data(str) + 2);
+    NxObject *nested = nxo_get_slice(slice, nx_int_create(1), nullptr);
+    EXPECT_EQ(nx_str_get_data(nested), nx_str_get_data(str) + 3);
+    EXPECT_EQ(((NxRope *) nested)->left, str);
+    EXPECT_STREQ(nx_str_get_cstr(nested), std::string(text + 3, 27).c_str());
+    gc_unroot(nxo_gc_header(slice));
+    gc_unroot(nxo_gc_header(str));
+    gc_root(nxo_gc_header(slice));
+    gc_collect();
+    EXPECT_TRUE(gc_state.is_valid(str));
+    EXPECT_TRUE(gc_state.check_count(2));
+    EXPECT_EQ(std::string(nx_str_get_data(slice), 28), std::string(text + 2, 28));
+    EXPECT_STREQ(nx_str_get_cstr(slice), std::string(text + 2, 28).c_str());
+    EXPECT_NE(nx_str_get_data(slice), nx_str_get_data(str) + 2);
+    gc_collect();
+    EXPECT_FALSE(gc_state.is_valid(str));
+    EXPECT_TRUE(gc_state.check_count(2));
+    gc_unroot(nxo_gc_header(slice));
+}
+
+TEST(NxStrTest, SliceBounds) {
+    NxObject *str = nx_str_create("Hello", 5);
+    nxo_root(str);
+    EXPECT_EQ(nxo_get_slice(str, nullptr, nullptr), str);
+    EXPECT_EQ(nxo_get_slice(str, nx_int_create(-10), nx_int_create(10)), str);
+    EXPECT_EQ(nxo_get_slice(str, nx_int_create(-1), nullptr), nx_str_from_char('o'));
+    EXPECT_STREQ(nx_str_get_cstr(nxo_get_slice(str, nx_int_create(1), nx_int_create(-1))), "ell");
+    EXPECT_EQ(nx_str_get_length(nxo_get_slice(str, nx_int_create(4), nx_int_create(2))), 0);
+    nxo_unroot(str);
+}
+
+TEST(NxStrTest, Hash) {
+    NxObject *str = nx_str_create("a", 1);
+    nxo_root(str);
+    EXPECT_EQ(((NxStr *) str)->hash, 0u);
+    EXPECT_EQ(nx_str_get_hash(str), nx_str_get_hash(nx_str_from_char('a')));
+    EXPECT_EQ(((NxStr *) str)->hash, nx_str_get_hash(str));
+    EXPECT_EQ(nx_str_get_hash(nx_str_create("", 0)), 0xcbf29ce484222325u);
+    EXPECT_EQ(nx_str_get_hash(nx_str_create("foobar", 6)), 0x85944171f73967e8u);
+    EXPECT_TRUE(nxo_eq(str, nx_str_from_char('a')));
+    EXPECT_FALSE(nxo_eq(str, nx_str_from_char('b')));
+    EXPECT_FALSE(nxo_eq(str, nx_int_create(1)));
+    nxo_unroot(str);
+}
+
+TEST(NxStrTest, Compare) {
+    NxObject *str = nx_str_create("ab", 2);
+    nxo_root(str);
+    EXPECT_EQ(nx_type_str.compare_fn(str, nx_str_from_char('b')), nx_int_create(-1));
+    EXPECT_EQ(nx_type_str.compare_fn(str, nx_str_from_char('a')), nx_int_create(1));
+    EXPECT_EQ(nx_type_str.compare_fn(str, nx_str_create("ab", 2)), nx_int_create(0));
+    EXPECT_EQ(nx_type_str.compare_fn(str, nx_int_create(0)), nullptr);
+    EXPECT_EQ(nx_type_str.add_fn(nx_int_create(0), str), nullptr);
+    nxo_unroot(str);
+}
+
+TEST(NxStrTest, EqualsAndCompareShortcuts) {
+    NxObject *a = nx_str_create("abcdefghijklmnopqrstuvwxyz0123456789", 36);
+    nxo_root(a);
+    NxObject *b = nx_str_create("abcdefghijklmnopqrstuvwxyz0123456780", 36);
+    nxo_root(b);
+    EXPECT_TRUE(nx_str_equals(a, a));
+    EXPECT_EQ(nx_str_compare(a, a), 0);
+    EXPECT_FALSE(nx_str_equals(a, b));
+    EXPECT_GT(nx_str_compare(a, b), 0);
+    EXPECT_LT(nx_str_compare(b, a), 0);
+    // the hashes differ, the bytes are not compared
+    nx_str_get_hash(a);
+    nx_str_get_hash(b);
+    EXPECT_FALSE(nx_str_equals(a, b));
+    EXPECT_FALSE(nx_str_equals(a, nx_str_from_char('a')));
+    EXPECT_LT(nx_str_compare(nx_str_from_char('a'), a), 0);
+    EXPECT_TRUE(nx_str_equals(nx_str_create("", 0), nx_str_create("", 0)));
+    EXPECT_LT(nx_str_compare(nx_str_create("", 0), a), 0);
+    // a rope and a view of the same bytes as a flat string
+    NxObject *rope = nx_str_concat(a, a);
+    nxo_root(rope);
+    NxObject *view = nxo_get_slice(rope, nx_int_create(36), nx_int_create(72));
+    nxo_root(view);
+    EXPECT_TRUE(nx_str_equals(view, a));
+    EXPECT_EQ(nx_str_compare(view, a), 0);
+    EXPECT_GT(nx_str_compare(rope, a), 0);
+    EXPECT_FALSE(nx_str_equals(rope, a));
+    nxo_unroot(view);
+    nxo_unroot(rope);
+    nxo_unroot(b);
+    nxo_unroot(a);
+}
@@ -11,3 +11,14 @@
 TEST(NxTypeTest, AsBool) {
     EXPECT_EQ(nxo_as_bool((NxObject *) &nx_type_bool), nx_true);
 }
+
+TEST(NxTypeTest, TypeFromClass) {
+    EXPECT_EQ(sizeof(NxObject), 8);
+    EXPECT_EQ(nxo_type((NxObject *) &nx_type_bool), &nx_type_type);
+    EXPECT_EQ(nxo_type(nx_true), &nx_type_bool);
+    for (GcClassId id = 0; id < NX_CLASS_COUNT; id++) {
+        if (nx_types[id] != nullptr) {
+            EXPECT_EQ(nx_types[id]->class_id, id);
+        }
+    }
+}
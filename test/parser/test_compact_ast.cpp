@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <string>
+#include "natrix/parser/compact_ast.h"
+#include "natrix/parser/parser.h"
+
+TEST(CompactAstTest, Builder) {
+    const char *src = " a[1 + abc] = [\"x\"]\n";
+    CompactAst ast = compact_ast_init(src);
+    AstId a = compact_ast_add_expr_name(&ast, src + 1, src + 2);
+    AstId one = compact_ast_add_expr_int_literal(&ast, src + 3, src + 4);
+    AstId abc = compact_ast_add_expr_name(&ast, src + 7, src + 10);
+    AstId sum = compact_ast_add_expr_binary(&ast, one, BINOP_ADD, abc);
+    AstId subscript = compact_ast_add_expr_subscript(&ast, a, sum, src + 11);
+    AstId x = compact_ast_add_expr_str_literal(&ast, src + 15, src + 18);
+    AstId list = compact_ast_add_expr_list_literal(&ast, src + 14, src + 19, x);
+    AstId assignment = compact_ast_add_stmt_assignment(&ast, subscript, list);
+    compact_ast_set_next_stmt(&ast, assignment, compact_ast_add_stmt_pass(&ast));
+    EXPECT_EQ(compact_ast_get_expr_start(&ast, sum), src + 3);
+    EXPECT_EQ(compact_ast_get_expr_end(&ast, sum), src + 10);
+    EXPECT_EQ(compact_ast_get_expr_start(&ast, subscript), src + 1);
+    EXPECT_EQ(compact_ast_get_expr_end(&ast, subscript), src + 11);
+    EXPECT_EQ(compact_ast_get_size(&ast), 9 * 17);
+    StringBuilder sb = sb_init();
+    compact_ast_dump(&sb, &ast, assignment);
+    EXPECT_STREQ(sb.str, "AST dump:\n"
+                         "  STMT_ASSIGNMENT\n"
+                         "    left: EXPR_SUBSCRIPT\n"
+                         "      receiver: EXPR_NAME {identifier: \"a\"}\n"
+                         "      index: EXPR_BINARY {op: ADD}\n"
+                         "        left: EXPR_INT_LITERAL {literal: \"1\"}\n"
+                         "        right: EXPR_NAME {identifier: \"abc\"}\n"
+                         "    right: EXPR_LIST_LITERAL\n"
+                         "      EXPR_STR_LITERAL {literal: \"x\"}\n"
+                         "  STMT_PASS\n");
+    sb_free(&sb);
+    compact_ast_free(&ast);
+}
+
+TEST(CompactAstTest, GoldenFiles) {
+    for (const auto &entry : std::filesystem::directory_iterator("parser")) {
+        std::filesystem::path path = entry.path();
+        if (path.extension() == ".ntx") {
+            Source src = source_from_file(path.c_str());
+            Arena arena = arena_init();
+            Stmt *stmt = parse_file(&arena, &src, diag_default_handler, nullptr);
+            CompactAst ast = compact_ast_init(src.start);
+            AstId root = compact_ast_add_stmts(&ast, stmt);
+            StringBuilder expected = sb_init();
+            ast_dump(&expected, stmt);
+            StringBuilder actual = sb_init();
+            compact_ast_dump(&actual, &ast, root);
+            EXPECT_STREQ(expected.str, actual.str) << path;
+            EXPECT_LE(2 * compact_ast_get_size(&ast), (ast.exprs.count * sizeof(Expr) + ast.stmts.count * sizeof(Stmt)));
+            sb_free(&actual);
+            sb_free(&expected);
+            compact_ast_free(&ast);
+            arena_free(&arena);
+            source_free(&src);
+        }
+    }
+}
@@ -183,6 +183,30 @@ TEST(LexerTest, CmpOp) {
     EXPECT_STREQ(lexer_error_message(&lexer), "invalid syntax");
 }
 
+TEST(LexerTest, AugmentedAssignment) {
+    Lexer lexer;
+    lexer_init(&lexer, "+= -= *= /= + = -\n");
+    EXPECT_EQ(lexer_next_token(&lexer), (EToken{TOKEN_PLUS_EQUALS, "+="}));
+    EXPECT_EQ(lexer_next_token(&lexer), (EToken{TOKEN_MINUS_EQUALS, "-="}));
+    EXPECT_EQ(lexer_next_token(&lexer), (EToken{TOKEN_STAR_EQUALS, "*="}));
+    EXPECT_EQ(lexer_next_token(&lexer), (EToken{TOKEN_SLASH_EQUALS, "/="}));
+    EXPECT_EQ(lexer_next_token(&lexer), (EToken{TOKEN_PLUS, "+"}));
+    EXPECT_EQ(lexer_next_token(&lexer), (EToken{TOKEN_EQUALS, "="}));
+    EXPECT_EQ(lexer_next_token(&lexer), (EToken{TOKEN_MINUS, "-"}));
+    EXPECT_EQ(lexer_next_token(&lexer), (EToken{TOKEN_NEWLINE, "\n"}));
+}
+
+TEST(LexerTest, Braces) {
+    Lexer lexer;
+    lexer_init(&lexer, "{1: x}\n");
+    EXPECT_EQ(lexer_next_token(&lexer), (EToken{TOKEN_LBRACE, "{"}));
+    EXPECT_EQ(lexer_next_token(&lexer), (EToken{TOKEN_INT_LITERAL, "1"}));
+    EXPECT_EQ(lexer_next_token(&lexer), (EToken{TOKEN_COLON, ":"}));
+    EXPECT_EQ(lexer_next_token(&lexer), (EToken{TOKEN_IDENTIFIER, "x"}));
+    EXPECT_EQ(lexer_next_token(&lexer), (EToken{TOKEN_RBRACE, "}"}));
+    EXPECT_EQ(lexer_next_token(&lexer), (EToken{TOKEN_NEWLINE, "\n"}));
+}
+
 TEST(LexerTest, StringLiteral) {
     Lexer lexer;
     lexer_init(&lexer, "\"\" \"a\\z\" \"ab\n");
@@ -191,3 +215,58 @@ TEST(LexerTest, StringLiteral) {
     EXPECT_EQ(lexer_next_token(&lexer), (EToken{TOKEN_ERROR, "\"ab"}));
     EXPECT_STREQ(lexer_error_message(&lexer), "unterminated string");
 }
+
+TEST(LexerTest, AllKeywords) {
+    Lexer lexer;
+    lexer_init(&lexer, "if elif else while pass print for in i el elsee eli passs prin print_ whil If _if fo inn\n");
+    for (TokenType type : {TOKEN_KW_IF, TOKEN_KW_ELIF, TOKEN_KW_ELSE, TOKEN_KW_WHILE, TOKEN_KW_PASS, TOKEN_KW_PRINT,
+                           TOKEN_KW_FOR, TOKEN_KW_IN}) {
+        EXPECT_EQ(lexer_next_token(&lexer).type, type);
+    }
+    for (int i = 0; i < 12; i++) {
+        EXPECT_EQ(lexer_next_token(&lexer).type, TOKEN_IDENTIFIER);
+    }
+    EXPECT_EQ(lexer_next_token(&lexer).type, TOKEN_NEWLINE);
+    EXPECT_EQ(lexer_error_message(&lexer), nullptr);
+}
+
+TEST(LexerTest, LongRuns) {
+    // the lengths cover the boundaries of the vectors used for scanning and the bytewise scanning near the end
+    for (size_t n = 1; n < 80; n++) {
+        std::string spaces(n, ' ');
+        std::string digits;
+        std::string identifier;
+        for (size_t i = 0; i < n; i++) {
+            digits += (char) ('0' + i % 10);
+            identifier += "azAZ_09"[i % 7];
+        }
+        std::string source = "x" + spaces + identifier + "`\n" + spaces + "(" + digits + "]\"" + identifier + "\"[#"
+                + spaces + "\n" + identifier + "@" + identifier + "{\n";
+        Lexer lexer;
+        lexer_init(&lexer, source.c_str());
+        EXPECT_EQ(lexer_next_token(&lexer), (EToken{TOKEN_IDENTIFIER, "x"}));
+        EXPECT_EQ(lexer_next_token(&lexer), (EToken{TOKEN_IDENTIFIER, identifier}));
+        EXPECT_EQ(lexer_next_token(&lexer), (EToken{TOKEN_ERROR, "`"}));
+        // continue after the error on the next line, the empty line at the start is skipped
+        lexer_init(&lexer, source.c_str() + 1 + n + n + 1);
+        EXPECT_EQ(lexer_next_token(&lexer), (EToken{TOKEN_INDENT, spaces}));
+        EXPECT_EQ(lexer_next_token(&lexer), (EToken{TOKEN_LPAREN, "("}));
+        EXPECT_EQ(lexer_next_token(&lexer), (EToken{TOKEN_INT_LITERAL, digits}));
+        EXPECT_EQ(lexer_next_token(&lexer), (EToken{TOKEN_RBRACKET, "]"}));
+        EXPECT_EQ(lexer_next_token(&lexer), (EToken{TOKEN_STRING_LITERAL, "\"" + identifier + "\""}));
+        EXPECT_EQ(lexer_next_token(&lexer), (EToken{TOKEN_LBRACKET, "["}));
+        EXPECT_EQ(lexer_next_token(&lexer), (EToken{TOKEN_NEWLINE, "#" + spaces + "\n"}));
+        EXPECT_EQ(lexer_next_token(&lexer), (EToken{TOKEN_DEDENT, ""}));
+        EXPECT_EQ(lexer_next_token(&lexer), (EToken{TOKEN_IDENTIFIER, identifier}));
+        EXPECT_EQ(lexer_next_token(&lexer), (EToken{TOKEN_ERROR, "@"}));
+        EXPECT_EQ(lexer_error_message(&lexer), std::string("unexpected character")) << n;
+    }
+}
+
+TEST(LexerTest, LongUnterminatedString) {
+    std::string source = "\"" + std::string(100, 'a') + "\n";
+    Lexer lexer;
+    lexer_init(&lexer, source.c_str());
+    EXPECT_EQ(lexer_next_token(&lexer).type, TOKEN_ERROR);
+    EXPECT_STREQ(lexer_error_message(&lexer), "unterminated string");
+}
@@ -66,6 +66,16 @@ TEST(ParserTest, InvalidLhsOfAssignment) {
     EXPECT_EQ(diag, "error: 1:1-5: cannot assign to expression here");
 }
 
+TEST(ParserTest, InvalidLhsOfAssignmentSlice) {
+    std::string diag = parse_and_capture_diag("a[1:2] = b");
+    EXPECT_EQ(diag, "error: 1:1-6: cannot assign to expression here");
+}
+
+TEST(ParserTest, InvalidTargetOfAugmentedAssignment) {
+    std::string diag = parse_and_capture_diag("f(x) += 1");
+    EXPECT_EQ(diag, "error: 1:1-4: cannot assign to expression here");
+}
+
 TEST(ParserTest, InvalidRhsOfAssignment) {
     std::string diag = parse_and_capture_diag("a = )");
     EXPECT_EQ(diag, "error: 1:5-1: expected expression");
@@ -101,6 +111,16 @@ TEST(ParserTest, WhileNoColon) {
     EXPECT_EQ(diag, "error: 1:8-1: expected ':'");
 }
 
+TEST(ParserTest, ForNoTarget) {
+    std::string diag = parse_and_capture_diag("for 1 in a:\n  print(1)");
+    EXPECT_EQ(diag, "error: 1:5-1: expected identifier");
+}
+
+TEST(ParserTest, ForNoIn) {
+    std::string diag = parse_and_capture_diag("for x a:\n  print(1)");
+    EXPECT_EQ(diag, "error: 1:7-1: expected 'in'");
+}
+
 TEST(ParserTest, PrintNoRParen) {
     std::string diag = parse_and_capture_diag("print(1");
     EXPECT_EQ(diag, "error: 1:8-1: expected ')'");
@@ -141,11 +161,61 @@ TEST(ParserTest, EmptyListWithComma) {
     EXPECT_EQ(diag, "error: 1:2-1: expected expression");
 }
 
+TEST(ParserTest, DictNoColon) {
+    std::string diag = parse_and_capture_diag("{1, 2}");
+    EXPECT_EQ(diag, "error: 1:3-1: expected ':'");
+}
+
+TEST(ParserTest, DictNoRBrace) {
+    std::string diag = parse_and_capture_diag("{1: 2 3: 4}");
+    EXPECT_EQ(diag, "error: 1:7-1: expected closing brace");
+}
+
 TEST(ParserTest, SubscriptNoRBracket) {
     std::string diag = parse_and_capture_diag("a[1");
     EXPECT_EQ(diag, "error: 1:4-1: expected closing bracket");
 }
 
+TEST(ParserTest, SliceNoRBracket) {
+    std::string diag = parse_and_capture_diag("a[1:2");
+    EXPECT_EQ(diag, "error: 1:6-1: expected closing bracket");
+}
+
+TEST(ParserTest, CallNoRParen) {
+    std::string diag = parse_and_capture_diag("len(a, b\n");
+    EXPECT_EQ(diag, "error: 1:9-1: expected expression");
+}
+
+TEST(ParserTest, CallOfExpression) {
+    std::string diag = parse_and_capture_diag("x = a[0](1)\n");
+    EXPECT_EQ(diag, "error: 1:5-4: only functions can be called");
+}
+
+TEST(ParserTest, CallTooManyArguments) {
+    std::string source = "max(0";
+    for (int i = 0; i < AST_MAX_ARGS; i++) {
+        source += ", 0";
+    }
+    std::string diag = parse_and_capture_diag((source + ")\n").c_str());
+    EXPECT_EQ(diag, "error: 1:" + std::to_string(source.size() + 1) + "-1: too many arguments");
+}
+
+TEST(ParserTest, ChainedComparison) {
+    std::string diag = parse_and_capture_diag("x = a < b < c\n");
+    EXPECT_EQ(diag, "error: 1:11-1: expected end of line");
+}
+
+TEST(ParserTest, NestingLimit) {
+    std::string nested = std::string(PARSER_MAX_NESTING - 1, '(') + "1" + std::string(PARSER_MAX_NESTING - 1, ')');
+    Source src = source_from_string("<string>", ("x = " + nested + "\n").c_str());
+    Arena arena = arena_init();
+    EXPECT_NE(parse_file(&arena, &src, diag_default_handler, nullptr), nullptr);
+    arena_free(&arena);
+    source_free(&src);
+    std::string diag = parse_and_capture_diag(("x = [" + nested + "]\n").c_str());
+    EXPECT_EQ(diag, "error: 1:" + std::to_string(PARSER_MAX_NESTING + 5) + "-1: expression nested too deeply");
+}
+
 TEST(ParserTest, GoldenFiles) {
     for (const auto & entry : std::filesystem::directory_iterator("parser")) {
         std::filesystem::path path = entry.path();
@@ -46,6 +46,31 @@ TEST(SourceTest, FromFile) {
     EXPECT_EQ(*source.end, '\0');
     EXPECT_EQ(source.line_starts, nullptr);
     EXPECT_EQ(source.line_count, 2);
+    EXPECT_NE(source.mapping_size, 0);
+    source_free(&source);
+}
+
+TEST(SourceTest, FromFileCrLf) {
+    Source source = source_from_file("test_source_2.ntx");
+    EXPECT_STREQ(source.start, "a\nb\n");
+    EXPECT_STREQ(source.end, source.start + 4);
+    EXPECT_EQ(source.line_count, 3);
+    EXPECT_EQ(source.mapping_size, 0);
+    source_free(&source);
+}
+
+TEST(SourceTest, FromFileLineStarts) {
+    Source source = source_from_file("test_source_3.ntx");
+    EXPECT_NE(source.mapping_size, 0);
+    EXPECT_EQ(source.line_count, 101);
+    const char *expected = source.start;
+    for (size_t line = 1; line <= 100; line++) {
+        EXPECT_EQ(source_get_line_start(&source, line), expected);
+        EXPECT_EQ(source_get_line_end(&source, line), expected + (line - 1) % 70);
+        expected += (line - 1) % 70 + 1;
+    }
+    EXPECT_EQ(source_get_line_start(&source, 101), source.end);
+    EXPECT_EQ(source_get_line_number(&source, source.end - 1), 100);
     source_free(&source);
 }
 
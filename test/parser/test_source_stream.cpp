@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "natrix/parser/source_stream.h"
+
+//! A batch of statements returned by the stream.
+struct Batch {
+    std::string text;
+    size_t first_line;
+};
+
+static std::vector<Batch> stream_file(const std::string &contents, size_t chunk_size) {
+    std::string path = testing::TempDir() + "test_source_stream.ntx";
+    std::ofstream(path, std::ios::binary) << contents;
+    SourceStream stream;
+    EXPECT_TRUE(source_stream_open(&stream, path.c_str(), chunk_size));
+    std::vector<Batch> batches;
+    while (Source *source = source_stream_next(&stream)) {
+        EXPECT_EQ(*source->end, '\0');
+        EXPECT_EQ(source_get_line_number(source, source->start), source->first_line + 1);
+        batches.push_back({std::string(source->start, source->end), source->first_line});
+    }
+    EXPECT_FALSE(source_stream_failed(&stream));
+    source_stream_close(&stream);
+    std::remove(path.c_str());
+    return batches;
+}
+
+TEST(SourceStreamTest, SplitsAfterStatements) {
+    std::string text = "a = 1\nif a:\n    b = 2\n\nelse:\n    b = 3\n# comment\nelsewhere = b\nwhile a:\n  a = 0";
+    std::vector<Batch> batches = stream_file(text, 1);
+    ASSERT_EQ(batches.size(), 4);
+    EXPECT_EQ(batches[0].text, "a = 1\n");
+    EXPECT_EQ(batches[0].first_line, 0);
+    EXPECT_EQ(batches[1].text, "if a:\n    b = 2\n\nelse:\n    b = 3\n# comment\n");
+    EXPECT_EQ(batches[1].first_line, 1);
+    EXPECT_EQ(batches[2].text, "elsewhere = b\n");
+    EXPECT_EQ(batches[2].first_line, 7);
+    EXPECT_EQ(batches[3].text, "while a:\n  a = 0\n");
+    EXPECT_EQ(batches[3].first_line, 8);
+}
+
+TEST(SourceStreamTest, BatchesStatements) {
+    std::vector<Batch> batches = stream_file("a = 1\nb = 2\nc = 3\nd = 4\ne = 5\n", 10);
+    ASSERT_EQ(batches.size(), 3);
+    EXPECT_EQ(batches[0].text, "a = 1\nb = 2\n");
+    EXPECT_EQ(batches[1].text, "c = 3\nd = 4\n");
+    EXPECT_EQ(batches[1].first_line, 2);
+    EXPECT_EQ(batches[2].text, "e = 5\n");
+}
+
+TEST(SourceStreamTest, NormalizesLineEndings) {
+    // with one byte per read, `\r\n` is split between two reads
+    std::vector<Batch> batches = stream_file("a\r\nb\rc\r\r\nd", 1);
+    ASSERT_EQ(batches.size(), 4);
+    EXPECT_EQ(batches[0].text, "a\n");
+    EXPECT_EQ(batches[1].text, "b\n");
+    EXPECT_EQ(batches[2].text, "c\n\n");
+    EXPECT_EQ(batches[3].text, "d\n");
+    EXPECT_EQ(batches[3].first_line, 4);
+}
+
+TEST(SourceStreamTest, EmptyFile) {
+    std::vector<Batch> batches = stream_file("", 16);
+    ASSERT_EQ(batches.size(), 1);
+    EXPECT_EQ(batches[0].text, "\n");
+    batches = stream_file("# only a comment\n\n", 4);
+    ASSERT_EQ(batches.size(), 1);
+    EXPECT_EQ(batches[0].text, "# only a comment\n\n");
+}
+
+TEST(SourceStreamTest, OpenFail) {
+    SourceStream stream;
+    EXPECT_FALSE(source_stream_open(&stream, "no_such_file.ntx", 16));
+}
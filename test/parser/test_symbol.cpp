@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "natrix/parser/parser.h"
+#include "natrix/parser/symbol.h"
+#include "natrix/util/hash.h"
+
+TEST(SymbolTest, InternsEqualTexts) {
+    Arena arena = arena_init();
+    SymbolTable table = symbol_table_init(&arena);
+    const char *src = "abc abd abc";
+    const Symbol *abc = symbol_intern(&table, src, 3);
+    const Symbol *abd = symbol_intern(&table, src + 4, 3);
+    EXPECT_NE(abc, abd);
+    EXPECT_EQ(symbol_intern(&table, src + 8, 3), abc);
+    EXPECT_EQ(abc->start, src);
+    EXPECT_EQ(abc->id, 0u);
+    EXPECT_EQ(abd->id, 1u);
+    EXPECT_EQ(abc->hash, hash_bytes("abc", 3));
+    EXPECT_EQ(table.count, 2u);
+    symbol_table_free(&table);
+    arena_free(&arena);
+}
+
+TEST(SymbolTest, Growth) {
+    Arena arena = arena_init();
+    SymbolTable table = symbol_table_init(&arena);
+    std::vector<std::string> names;
+    for (int i = 0; i < 1000; i++) {
+        names.push_back("name" + std::to_string(i));
+    }
+    std::vector<const Symbol *> symbols;
+    for (const std::string &name : names) {
+        symbols.push_back(symbol_intern(&table, name.data(), name.size()));
+    }
+    for (size_t i = 0; i < names.size(); i++) {
+        EXPECT_EQ(symbols[i]->id, i);
+        EXPECT_EQ(symbol_intern(&table, names[i].data(), names[i].size()), symbols[i]);
+    }
+    EXPECT_EQ(table.count, 1000u);
+    symbol_table_free(&table);
+    arena_free(&arena);
+}
+
+TEST(SymbolTest, ParserInternsNamesAndLiterals) {
+    Source src = source_from_string("<string>", "x = \"a\" + 12\nfor x in \"a\":\n    print(12)\n");
+    Arena arena = arena_init();
+    Stmt *stmt = parse_file(&arena, &src, diag_default_handler, nullptr);
+    ASSERT_NE(stmt, nullptr);
+    const Expr *x1 = stmt->assignment.left;
+    const Expr *a1 = stmt->assignment.right->binary.left;
+    const Expr *n1 = stmt->assignment.right->binary.right;
+    const Stmt *loop = stmt->next;
+    ASSERT_NE(x1->identifier.symbol, nullptr);
+    EXPECT_EQ(loop->for_stmt.target->identifier.symbol, x1->identifier.symbol);
+    EXPECT_EQ(loop->for_stmt.iterable->literal.symbol, a1->literal.symbol);
+    EXPECT_EQ(loop->for_stmt.body->expr->literal.symbol, n1->literal.symbol);
+    EXPECT_EQ(std::string(a1->literal.symbol->start, a1->literal.symbol->length), "\"a\"");
+    EXPECT_NE(a1->literal.symbol, n1->literal.symbol);
+    arena_free(&arena);
+    source_free(&src);
+}
@@ -76,3 +76,87 @@ TEST(ArenaTest, SpecialChunk) {
     EXPECT_EQ(stats.alloc_size, 112 + 8208);
     arena_free(&arena);
 }
+
+TEST(ArenaTest, MarkAndRewind) {
+    Arena arena = arena_init();
+    void *ptr1 = arena_alloc(&arena, 100);
+    ArenaMark mark = arena_mark(&arena);
+    void *ptr2 = arena_alloc(&arena, 200);
+    arena_alloc(&arena, 8100);               // second chunk
+    arena_alloc(&arena, 10000);              // special chunk
+    ArenaChunk *second = arena.current_chunk;
+    EXPECT_NE(second, mark.current_chunk);
+    arena_rewind(&arena, mark);
+    EXPECT_EQ(arena.first_chunk, mark.first_chunk);
+    EXPECT_EQ(arena.current_chunk, mark.current_chunk);
+    EXPECT_EQ(arena.current_chunk->next_chunk, second);
+    ArenaStats stats;
+    arena_get_stats(&arena, &stats);
+    EXPECT_EQ(stats.chunk_count, 2);
+    EXPECT_EQ(stats.alloc_count, 1);
+    EXPECT_EQ(stats.alloc_size, 112);
+    EXPECT_EQ(arena_alloc(&arena, 200), ptr2);
+    // the second chunk is reused instead of allocating a new one
+    EXPECT_EQ(arena_alloc(&arena, 8100), second->start);
+    EXPECT_EQ(arena.current_chunk, second);
+    EXPECT_EQ(ptr1, arena.first_chunk->start);
+    arena_free(&arena);
+}
+
+TEST(ArenaTest, Reset) {
+    Arena arena = arena_init();
+    ArenaChunk *first = arena.first_chunk;
+    arena_alloc(&arena, 10000);
+    arena_alloc(&arena, 8000);
+    arena_alloc(&arena, 8000);
+    arena_reset(&arena);
+    EXPECT_EQ(arena.first_chunk, first);
+    EXPECT_EQ(arena.current_chunk, first);
+    ArenaStats stats;
+    arena_get_stats(&arena, &stats);
+    EXPECT_EQ(stats.chunk_count, 2);
+    EXPECT_EQ(stats.chunk_size, 2 * 8192);
+    EXPECT_EQ(stats.alloc_count, 0);
+    EXPECT_EQ(stats.alloc_size, 0);
+    EXPECT_EQ(arena_alloc(&arena, 16), first->start);
+    arena_free(&arena);
+}
+
+TEST(ArenaTest, ChunkSize) {
+    Arena arena = arena_init_with_chunk_size(1000);  // rounded up to 1008
+    EXPECT_EQ(arena.current_chunk->end, arena.current_chunk->start + 1008);
+    arena_alloc(&arena, 1000);
+    arena_alloc(&arena, 1000);
+    void *special = arena_alloc(&arena, 1009);
+    EXPECT_EQ(special, arena.first_chunk->start);
+    ArenaStats stats;
+    arena_get_stats(&arena, &stats);
+    EXPECT_EQ(stats.chunk_count, 3);
+    EXPECT_EQ(stats.chunk_size, 2 * 1008 + 1024);
+    arena_free(&arena);
+}
+
+TEST(ArenaTest, Pool) {
+    arena_release_pool();
+    Arena arena = arena_init();
+    ArenaChunk *first = arena.first_chunk;
+    arena_alloc(&arena, 100);
+    arena_alloc(&arena, 8100);
+    ArenaChunk *second = arena.current_chunk;
+    EXPECT_NE(first, second);
+    arena_free(&arena);
+    // the chunks are reused in the reverse order
+    arena = arena_init();
+    EXPECT_EQ(arena.first_chunk, second);
+    EXPECT_EQ(arena.current_chunk->ptr, arena.current_chunk->start);
+    arena_alloc(&arena, 100);
+    arena_alloc(&arena, 8100);
+    EXPECT_EQ(arena.current_chunk, first);
+    arena_free(&arena);
+    // chunks of a different size are not taken from the pool
+    arena = arena_init_with_chunk_size(1024);
+    EXPECT_NE(arena.first_chunk, first);
+    EXPECT_NE(arena.first_chunk, second);
+    arena_free(&arena);
+    arena_release_pool();
+}
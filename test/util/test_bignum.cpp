@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+#include "natrix/util/bignum.h"
+
+using Num = std::vector<uint64_t>;
+
+static Num from_decimal(const std::string &str) {
+    Num r(str.length() / 19 + 1);
+    r.resize(bn_from_decimal(r.data(), str.data(), str.length()));
+    return r;
+}
+
+static std::string to_decimal(const Num &a) {
+    StringBuilder sb = sb_init();
+    bn_append_decimal(&sb, a.data(), a.size());
+    std::string result = sb.str;
+    sb_free(&sb);
+    return result;
+}
+
+static Num mul(const Num &a, const Num &b) {
+    Num r(a.size() + b.size());
+    bn_mul(r.data(), a.data(), a.size(), b.data(), b.size());
+    r.resize(bn_normalize(r.data(), r.size()));
+    return r;
+}
+
+static Num random_num(std::mt19937_64 &rng, size_t n) {
+    Num r(n);
+    for (auto &limb: r) {
+        limb = rng();
+    }
+    r[n - 1] |= 1;
+    return r;
+}
+
+TEST(BignumTest, Decimal) {
+    EXPECT_EQ(to_decimal({}), "0");
+    EXPECT_EQ(to_decimal({0, 1}), "18446744073709551616");
+    EXPECT_EQ(from_decimal("18446744073709551616"), Num({0, 1}));
+    EXPECT_EQ(from_decimal("0"), Num());
+    EXPECT_EQ(from_decimal("0000000000000000000000042"), Num({42}));
+    EXPECT_EQ(to_decimal({10000000000000000000ull}), "10000000000000000000");
+    const std::string big = "123456789012345678901234567890123456789012345678901234567890";
+    EXPECT_EQ(to_decimal(from_decimal(big)), big);
+}
+
+TEST(BignumTest, AddSub) {
+    Num a = {UINT64_MAX, UINT64_MAX};
+    Num b = {1};
+    Num r(2);
+    EXPECT_EQ(bn_add(r.data(), a.data(), 2, b.data(), 1), 1);
+    EXPECT_EQ(r, Num({0, 0}));
+    EXPECT_EQ(bn_sub(r.data(), r.data(), 2, b.data(), 1), 1);
+    EXPECT_EQ(r, a);
+    EXPECT_EQ(bn_sub(r.data(), a.data(), 2, b.data(), 1), 0);
+    EXPECT_EQ(r, Num({UINT64_MAX - 1, UINT64_MAX}));
+}
+
+TEST(BignumTest, Compare) {
+    Num a = {1, 2};
+    Num b = {2, 1};
+    EXPECT_GT(bn_compare(a.data(), 2, b.data(), 2), 0);
+    EXPECT_LT(bn_compare(b.data(), 2, a.data(), 2), 0);
+    EXPECT_EQ(bn_compare(a.data(), 2, a.data(), 2), 0);
+    EXPECT_LT(bn_compare(a.data(), 1, a.data(), 2), 0);
+}
+
+TEST(BignumTest, Mul) {
+    EXPECT_EQ(to_decimal(mul(from_decimal("123456789012345678901234567890"), from_decimal("987654321098765432109876543210"))),
+              "121932631137021795226185032733622923332237463801111263526900");
+    EXPECT_EQ(mul({UINT64_MAX}, {UINT64_MAX}), Num({1, UINT64_MAX - 1}));
+}
+
+TEST(BignumTest, KaratsubaMatchesSchoolbook) {
+    // the sizes exercise Karatsuba, the split of unbalanced operands and the schoolbook method
+    std::mt19937_64 rng(42);
+    const size_t sizes[][2] = {{40, 40}, {100, 37}, {300, 290}, {33, 200}, {31, 500}};
+    for (auto &size: sizes) {
+        Num a = random_num(rng, size[0]);
+        Num b = random_num(rng, size[1]);
+        Num ab = mul(a, b);
+        // compute a * b by multiplying b by each limb of a
+        Num expected(size[0] + size[1], 0);
+        for (size_t i = 0; i < size[0]; i++) {
+            Num t = b;
+            t.push_back(bn_mul_limb(t.data(), size[1], a[i], 0));
+            bn_add(expected.data() + i, expected.data() + i, expected.size() - i, t.data(), t.size());
+        }
+        expected.resize(bn_normalize(expected.data(), expected.size()));
+        EXPECT_EQ(ab, expected) << size[0] << "x" << size[1];
+    }
+}
+
+TEST(BignumTest, DivLimb) {
+    Num a = from_decimal("121932631137021795226185032733622923332237463801111263526901");
+    Num q(a.size());
+    EXPECT_EQ(bn_div_limb(q.data(), a.data(), a.size(), 10), 1);
+    q.resize(bn_normalize(q.data(), q.size()));
+    EXPECT_EQ(to_decimal(q), "12193263113702179522618503273362292333223746380111126352690");
+    EXPECT_EQ(bn_div_limb(a.data(), a.data(), a.size(), UINT64_MAX), 0xeb38d884435527bfull);
+}
+
+TEST(BignumTest, DivMod) {
+    std::mt19937_64 rng(7);
+    const size_t sizes[][2] = {{2, 2}, {5, 2}, {50, 3}, {100, 99}, {200, 60}};
+    for (auto &size: sizes) {
+        Num a = random_num(rng, size[0]);
+        Num b = random_num(rng, size[1]);
+        b[size[1] - 1] >>= rng() % 64;       // exercises the normalization shift, including none
+        b[size[1] - 1] |= 1;
+        Num q(size[0] - size[1] + 1);
+        Num r(size[1]);
+        bn_divmod(q.data(), r.data(), a.data(), a.size(), b.data(), b.size());
+        q.resize(bn_normalize(q.data(), q.size()));
+        r.resize(bn_normalize(r.data(), r.size()));
+        EXPECT_LT(bn_compare(r.data(), r.size(), b.data(), b.size()), 0);
+        // a == q * b + r
+        Num check = mul(q, b);
+        check.resize(a.size() + 1, 0);
+        bn_add(check.data(), check.data(), check.size(), r.data(), r.size());
+        check.resize(bn_normalize(check.data(), check.size()));
+        EXPECT_EQ(check, a) << size[0] << "/" << size[1];
+    }
+}
@@ -6,6 +6,8 @@
  */
 
 #include <gtest/gtest.h>
+#include <set>
+#include <vector>
 #include "../gc_state.h"
 
 struct Leaf : GcHeader {
@@ -16,16 +18,37 @@ struct Container : GcHeader {
     GcHeader *obj;
 };
 
+struct Pair : GcHeader {
+    GcHeader *left;
+    GcHeader *right;
+};
+
 Leaf *alloc_leaf() {
-    return (Leaf *) gc_alloc(sizeof(Leaf), nullptr);
+    return (Leaf *) gc_alloc(sizeof(Leaf), GC_CLASS_LEAF);
 }
 
 void trace_container(void *ptr) {
     gc_visit(((Container *) ptr)->obj);
 }
 
+const GcClassId container_class = gc_register_class(trace_container, nullptr);
+
 Container *alloc_container() {
-    return (Container *) gc_alloc(sizeof(Container), trace_container);
+    return (Container *) gc_alloc(sizeof(Container), container_class);
+}
+
+void trace_pair(void *ptr) {
+    gc_visit(((Pair *) ptr)->left);
+    gc_visit(((Pair *) ptr)->right);
+}
+
+const GcClassId pair_class = gc_register_class(trace_pair, nullptr);
+
+Pair *alloc_pair() {
+    Pair *pair = (Pair *) gc_alloc(sizeof(Pair), pair_class);
+    pair->left = nullptr;
+    pair->right = nullptr;
+    return pair;
 }
 
 TEST(GcTest, NoRoots) {
@@ -115,3 +138,538 @@ TEST(GcTest, Cycle) {
     EXPECT_FALSE(state.is_valid(list2));
     EXPECT_TRUE(state.check_count(0));
 }
+
+TEST(GcTest, MinorCollectionPromotesSurvivors) {
+    GcStateW state;
+    Container *root = alloc_container();
+    root->obj = nullptr;
+    gc_root(root);
+    Leaf *garbage = alloc_leaf();
+    gc_collect_minor();
+    EXPECT_TRUE(state.is_old(root));
+    EXPECT_FALSE(state.is_valid(garbage));
+    EXPECT_TRUE(state.check_count(1));
+    gc_unroot(root);
+    gc_collect_minor();
+    EXPECT_TRUE(state.is_old(root));
+    EXPECT_TRUE(state.check_count(1));
+    gc_collect();
+    EXPECT_FALSE(state.is_valid(root));
+    EXPECT_TRUE(state.check_count(0));
+}
+
+TEST(GcTest, RememberedSet) {
+    GcStateW state;
+    Container *root = alloc_container();
+    root->obj = nullptr;
+    gc_root(root);
+    Container *old = alloc_container();
+    old->obj = nullptr;
+    root->obj = old;
+    gc_collect_minor();
+    EXPECT_TRUE(state.is_old(root));
+    EXPECT_TRUE(state.is_old(old));
+
+    Leaf *young = alloc_leaf();
+    old->obj = young;
+    gc_write_barrier(old, young);
+    gc_collect_minor();
+    EXPECT_TRUE(state.is_old(young));
+    EXPECT_TRUE(state.check_count(3));
+
+    old->obj = nullptr;
+    gc_write_barrier(old, nullptr);
+    gc_collect();
+    EXPECT_FALSE(state.is_valid(young));
+    EXPECT_TRUE(state.check_count(2));
+    gc_unroot(root);
+    gc_collect();
+    EXPECT_TRUE(state.check_count(0));
+}
+
+TEST(GcTest, OldRootIsTracedInMinorCollection) {
+    GcStateW state;
+    Container *root = alloc_container();
+    root->obj = nullptr;
+    gc_root(root);
+    gc_collect_minor();
+    EXPECT_TRUE(state.is_old(root));
+    Leaf *young = alloc_leaf();
+    root->obj = young;
+    gc_collect_minor();
+    EXPECT_TRUE(state.is_old(young));
+    gc_unroot(root);
+    gc_collect();
+    EXPECT_TRUE(state.check_count(0));
+}
+
+TEST(GcTest, MajorCollectionThreshold) {
+    GcStateW state;
+    Container *root = alloc_container();
+    root->obj = nullptr;
+    gc_root(root);
+    for (int i = 0; i < 2000; i++) {
+        Container *c = alloc_container();
+        c->obj = root->obj;
+        root->obj = c;
+        gc_write_barrier(root, c);
+    }
+    gc_collect_minor();
+    EXPECT_TRUE(state.check_count(2001));
+    EXPECT_GE(gc_get_internal_state()->old_threshold, 2001 * GcStateW::OBJECT_SIZE);
+    root->obj = nullptr;
+    for (size_t i = 0; i < state.threshold(); i++) {
+        alloc_leaf();
+    }
+    EXPECT_TRUE(state.check_count(2101));
+    gc_get_internal_state()->old_threshold = 2001 * GcStateW::OBJECT_SIZE;
+    alloc_leaf();
+    EXPECT_TRUE(state.check_count(2));
+    gc_unroot(root);
+    gc_collect();
+    EXPECT_TRUE(state.check_count(0));
+}
+
+TEST(GcTest, DeepChain) {
+    GcStateW state;
+    Container *root = alloc_container();
+    root->obj = nullptr;
+    gc_root(root);
+    for (int i = 0; i < 1000000; i++) {
+        Container *c = alloc_container();
+        c->obj = root->obj;
+        root->obj = c;
+        gc_write_barrier(root, c);
+    }
+    gc_collect();
+    EXPECT_TRUE(state.check_count(1000001));
+    gc_unroot(root);
+    gc_collect();
+    EXPECT_TRUE(state.check_count(0));
+}
+
+TEST(GcTest, MarkStackOverflow) {
+    GcStateW state;
+    gc_get_internal_state()->policy.young_size = 100000 * GcStateW::OBJECT_SIZE;
+    Pair *root = alloc_pair();
+    gc_root(root);
+    // a complete binary tree of depth 10
+    std::vector<Pair *> level = {root};
+    for (int depth = 0; depth < 10; depth++) {
+        std::vector<Pair *> next;
+        for (Pair *pair : level) {
+            pair->left = alloc_pair();
+            pair->right = alloc_pair();
+            next.push_back((Pair *) pair->left);
+            next.push_back((Pair *) pair->right);
+        }
+        level = next;
+    }
+    alloc_leaf();
+    gc_get_internal_state()->mark_stack_limit = 4;
+    gc_collect();
+    EXPECT_TRUE(state.check_count(2047));
+    EXPECT_FALSE(gc_get_internal_state()->mark_stack_overflow);
+    gc_unroot(root);
+    gc_collect();
+    EXPECT_TRUE(state.check_count(0));
+}
+
+TEST(GcTest, LargeObjectsAreAccountedInBytes) {
+    GcStateW state;
+    Leaf *leaf = alloc_leaf();
+    gc_root(leaf);
+    // a single object larger than the young generation triggers a minor collection before it is allocated
+    void *large = gc_alloc(state.threshold() * GcStateW::OBJECT_SIZE, GC_CLASS_LEAF);
+    EXPECT_TRUE(state.is_old(leaf));
+    EXPECT_TRUE(state.is_valid(large));
+    alloc_leaf();
+    EXPECT_FALSE(state.is_valid(large));
+    EXPECT_TRUE(state.check_count(2));
+    gc_unroot(leaf);
+}
+
+TEST(GcTest, GrowthFactor) {
+    GcStateW state;
+    GcPolicy policy = gc_get_policy();
+    policy.growth_factor = 3.0;
+    gc_set_policy(&policy);
+    Container *root = alloc_container();
+    root->obj = nullptr;
+    gc_root(root);
+    for (int i = 0; i < 999; i++) {
+        Container *c = alloc_container();
+        c->obj = root->obj;
+        root->obj = c;
+        gc_write_barrier(root, c);
+    }
+    gc_collect();
+    EXPECT_EQ(gc_get_internal_state()->old_bytes, 1000 * GcStateW::OBJECT_SIZE);
+    EXPECT_EQ(gc_get_internal_state()->old_threshold, 3000 * GcStateW::OBJECT_SIZE);
+    root->obj = nullptr;
+    gc_collect();
+    EXPECT_EQ(gc_get_internal_state()->old_threshold, policy.initial_heap_size);
+    gc_unroot(root);
+}
+
+TEST(GcTest, MaxHeapSize) {
+    GcStateW state;
+    GcPolicy policy = gc_get_policy();
+    policy.max_heap_size = 50 * GcStateW::OBJECT_SIZE;
+    gc_set_policy(&policy);
+    for (int i = 0; i < 1000; i++) {
+        alloc_leaf();
+    }
+    EXPECT_LE(gc_get_internal_state()->young_bytes, policy.max_heap_size);
+    Container *root = alloc_container();
+    root->obj = nullptr;
+    gc_root(root);
+    EXPECT_DEATH({
+        for (int i = 0; i < 100; i++) {
+            Container *c = alloc_container();
+            c->obj = root->obj;
+            root->obj = c;
+            gc_write_barrier(root, c);
+        }
+    }, "Maximum heap size exceeded");
+    gc_unroot(root);
+}
+
+TEST(GcTest, ManyRoots) {
+    GcStateW state;
+    std::vector<Leaf *> leaves;
+    for (int i = 0; i < 10000; i++) {
+        Leaf *leaf = alloc_leaf();
+        gc_root(leaf);
+        leaves.push_back(leaf);
+    }
+    gc_collect();
+    EXPECT_TRUE(state.check_count(10000));
+    for (auto it = leaves.rbegin(); it != leaves.rend(); ++it) {
+        gc_unroot(*it);
+    }
+    gc_collect();
+    EXPECT_TRUE(state.check_count(0));
+}
+
+TEST(GcTest, Scope) {
+    GcStateW state;
+    Leaf *outer = alloc_leaf();
+    gc_root(outer);
+    GcScope scope = gc_scope_begin();
+    for (int i = 0; i < 10; i++) {
+        gc_root(alloc_leaf());
+    }
+    gc_collect();
+    EXPECT_TRUE(state.check_count(11));
+    gc_scope_end(scope);
+    gc_collect();
+    EXPECT_TRUE(state.check_count(1));
+    EXPECT_TRUE(state.is_valid(outer));
+    gc_unroot(outer);
+}
+
+TEST(GcTest, ConservativeStackScan) {
+    GcStateW state;
+    gc_set_stack_bottom(__builtin_frame_address(0));
+    Container *volatile container = alloc_container();
+    container->obj = alloc_leaf();
+    char *volatile interior = (char *) alloc_leaf() + sizeof(GcHeader);
+    void *volatile large = gc_alloc(4 * SLAB_MAX_SIZE, GC_CLASS_LEAF);
+    gc_collect();
+    EXPECT_TRUE(state.is_valid(container));
+    EXPECT_TRUE(state.is_valid(container->obj));
+    EXPECT_TRUE(state.is_valid(interior - sizeof(GcHeader)));
+    EXPECT_TRUE(state.is_valid(large));
+    gc_set_stack_bottom(nullptr);
+}
+
+struct Array : GcHeader {
+    size_t count;
+    GcHeader *items[];
+};
+
+void trace_array(void *ptr) {
+    gc_visit_array(((Array *) ptr)->items, ((Array *) ptr)->count);
+}
+
+const GcClassId array_class = gc_register_class(trace_array, nullptr);
+
+Array *alloc_array(size_t count) {
+    Array *array = (Array *) gc_alloc(sizeof(Array) + count * sizeof(GcHeader *), array_class);
+    array->count = count;
+    for (size_t i = 0; i < count; i++) {
+        array->items[i] = nullptr;
+    }
+    return array;
+}
+
+static void build_and_collect_in_parallel(size_t mark_stack_limit) {
+    GcStateW state;
+    GcPolicy policy = gc_get_policy();
+    policy.young_size = 1000000 * GcStateW::OBJECT_SIZE;
+    policy.mark_threads = 4;
+    gc_set_policy(&policy);
+    Array *root = alloc_array(5000);
+    gc_root(root);
+    size_t count = 1;
+    for (size_t i = 0; i < root->count; i++) {
+        if (i % 3 == 0) {
+            // a short chain
+            Container *c = alloc_container();
+            c->obj = alloc_leaf();
+            root->items[i] = c;
+            count += 2;
+        } else if (i % 3 == 1) {
+            root->items[i] = alloc_leaf();
+            count++;
+        } else {
+            // an immediate value
+            root->items[i] = (GcHeader *) (uintptr_t) (2 * i + 1);
+        }
+    }
+    Array *shared = alloc_array(1000);
+    count++;
+    for (size_t i = 0; i < shared->count; i++) {
+        shared->items[i] = root->items[i];
+    }
+    root->items[2] = shared;
+    gc_get_internal_state()->mark_stack_limit = mark_stack_limit;
+    gc_collect();
+    EXPECT_TRUE(state.check_count(count));
+    EXPECT_EQ(gc_get_internal_state()->old_bytes, count * GcStateW::OBJECT_SIZE
+            + (sizeof(Array) + 5000 * sizeof(GcHeader *)) - GcStateW::OBJECT_SIZE
+            + (sizeof(Array) + 1000 * sizeof(GcHeader *)) - GcStateW::OBJECT_SIZE);
+    EXPECT_FALSE(gc_get_internal_state()->parallel);
+    gc_unroot(root);
+    gc_collect();
+    EXPECT_TRUE(state.check_count(0));
+}
+
+TEST(GcTest, ParallelMark) {
+    build_and_collect_in_parallel(GC_DEFAULT_MARK_STACK_LIMIT);
+}
+
+TEST(GcTest, ParallelMarkStackOverflow) {
+    build_and_collect_in_parallel(2);
+}
+
+TEST(GcTest, BackgroundSweep) {
+    GcStateW state;
+    GcPolicy policy = gc_get_policy();
+    policy.young_size = 1000000 * GcStateW::OBJECT_SIZE;
+    policy.background_sweep = true;
+    gc_set_policy(&policy);
+    Array *root = alloc_array(1000);
+    gc_root(root);
+    for (size_t i = 0; i < 10000; i++) {
+        Leaf *leaf = alloc_leaf();
+        leaf->value = (int) i;
+        if (i % 10 == 0) {
+            root->items[i / 10] = leaf;
+        }
+        gc_alloc(4 * SLAB_MAX_SIZE, GC_CLASS_LEAF);
+    }
+    gc_collect();
+    // the sweeper runs concurrently, the allocator must not reuse the blocks of live objects
+    std::set<void *> live(root->items, root->items + root->count);
+    for (size_t i = 0; i < 20000; i++) {
+        Leaf *leaf = alloc_leaf();
+        EXPECT_EQ(live.count(leaf), 0);
+        leaf->value = -1;
+    }
+    for (size_t i = 0; i < root->count; i++) {
+        EXPECT_TRUE(state.is_valid(root->items[i]));
+        EXPECT_EQ(((Leaf *) root->items[i])->value, (int) i * 10);
+    }
+    gc_sweeper_wait();
+    EXPECT_TRUE(state.check_count(1001 + 20000));
+    gc_unroot(root);
+    gc_collect();
+    gc_sweeper_wait();
+    EXPECT_TRUE(state.check_count(0));
+}
+
+TEST(GcTest, IncrementalMarking) {
+    GcStateW state;
+    GcPolicy policy = gc_get_policy();
+    policy.young_size = 1000000 * GcStateW::OBJECT_SIZE;
+    policy.pause_budget_us = 1;
+    gc_set_policy(&policy);
+    Array *root = alloc_array(3);
+    gc_root(root);
+    Container *tail = alloc_container();
+    root->items[0] = tail;
+    for (int i = 1; i < 100000; i++) {
+        Container *c = alloc_container();
+        tail->obj = c;
+        tail = c;
+    }
+    Leaf *moved = alloc_leaf();
+    tail->obj = moved;
+    gc_get_internal_state()->old_threshold = 0;
+    gc_collect_minor();
+    ASSERT_TRUE(gc_get_internal_state()->marking);
+    // the root is traced by the first slice, the rest of the chain is not
+    gc_collect_step();
+    ASSERT_TRUE(gc_get_internal_state()->marking);
+    // without the write barrier, neither object would be found, since the root is already traced
+    root->items[1] = moved;
+    gc_write_barrier(root, moved);
+    tail->obj = nullptr;
+    Leaf *young = alloc_leaf();
+    root->items[2] = young;
+    gc_write_barrier(root, young);
+    Leaf *rooted = alloc_leaf();
+    gc_root(rooted);
+    int steps = 1;
+    while (gc_get_internal_state()->marking) {
+        gc_collect_step();
+        steps++;
+    }
+    EXPECT_GT(steps, 2);
+    EXPECT_TRUE(state.check_count(100004));
+    EXPECT_TRUE(state.is_old(moved));
+    EXPECT_TRUE(state.is_old(young));
+    EXPECT_TRUE(state.is_old(rooted));
+    gc_unroot(rooted);
+    gc_unroot(root);
+    gc_collect();
+    EXPECT_TRUE(state.check_count(0));
+}
+
+static void count_pauses(const GcEvent *event, void *data) {
+    ((std::vector<GcEvent> *) data)->push_back(*event);
+}
+
+TEST(GcTest, Stats) {
+    GcStateW state;
+    std::vector<GcEvent> events;
+    gc_set_callback(count_pauses, &events);
+    Container *root = alloc_container();
+    gc_root(root);
+    for (size_t i = 0; i < state.threshold() + 10; i++) {
+        root->obj = alloc_leaf();
+    }
+    GcStats stats;
+    gc_get_stats(&stats);
+    EXPECT_EQ(stats.minor_collections, 1);
+    EXPECT_EQ(stats.major_collections, 0);
+    EXPECT_EQ(stats.allocated_objects, state.threshold() + 11);
+    EXPECT_EQ(stats.allocated_bytes, (state.threshold() + 11) * GcStateW::OBJECT_SIZE);
+    // the container and the last leaf allocated before the collection survive
+    EXPECT_EQ(stats.freed_bytes, (state.threshold() - 2) * GcStateW::OBJECT_SIZE);
+    ASSERT_EQ(events.size(), 1);
+    EXPECT_EQ(events[0].kind, GC_PAUSE_MINOR);
+    EXPECT_EQ(events[0].freed_bytes, stats.freed_bytes);
+    EXPECT_EQ(events[0].heap_bytes, 2 * GcStateW::OBJECT_SIZE);
+    // the heap was largest just before the collection
+    EXPECT_EQ(stats.peak_heap_bytes, events[0].freed_bytes + events[0].heap_bytes);
+    gc_unroot(root);
+    gc_collect();
+    gc_get_stats(&stats);
+    EXPECT_EQ(stats.major_collections, 1);
+    EXPECT_EQ(stats.pause_count, 2);
+    EXPECT_EQ(stats.freed_bytes, stats.allocated_bytes);
+    EXPECT_EQ(stats.total_pause_ns, events[0].duration_ns + events[1].duration_ns);
+    EXPECT_GE(stats.max_pause_ns, events[1].duration_ns);
+    uint64_t histogram_count = 0;
+    for (uint64_t count : stats.pause_histogram) {
+        histogram_count += count;
+    }
+    EXPECT_EQ(histogram_count, 2);
+    ASSERT_EQ(events.size(), 2);
+    EXPECT_EQ(events[1].kind, GC_PAUSE_MAJOR);
+    EXPECT_EQ(events[1].heap_bytes, 0);
+}
+
+//! Allocations reported to the tracker, by tag.
+struct TrackedAllocations {
+    std::vector<const char *> type_names;
+    std::vector<int> survived;      // -1 until collected
+};
+
+static uint32_t track_alloc(void *data, size_t size_in_bytes, const char *type_name) {
+    auto *tracked = (TrackedAllocations *) data;
+    EXPECT_EQ(size_in_bytes, GcStateW::OBJECT_SIZE);
+    tracked->type_names.push_back(type_name);
+    tracked->survived.push_back(-1);
+    return (uint32_t) tracked->type_names.size() - 1;
+}
+
+static void track_collect(void *data, uint32_t tag, size_t size_in_bytes, bool survived) {
+    auto *tracked = (TrackedAllocations *) data;
+    EXPECT_EQ(size_in_bytes, GcStateW::OBJECT_SIZE);
+    ASSERT_LT(tag, tracked->survived.size());
+    EXPECT_EQ(tracked->survived[tag], -1);
+    tracked->survived[tag] = survived;
+}
+
+TEST(GcTest, AllocTracker) {
+    GcStateW state;
+    TrackedAllocations tracked;
+    GcAllocTracker tracker = {.alloc = track_alloc, .collect = track_collect, .data = &tracked};
+    gc_set_alloc_tracker(&tracker);
+    Container *root = (Container *) gc_alloc(sizeof(Container), gc_register_class(trace_container, "container"));
+    root->obj = nullptr;
+    gc_root(root);
+    root->obj = alloc_leaf();
+    alloc_leaf();
+    gc_collect_minor();
+    EXPECT_EQ(tracked.survived, std::vector<int>({1, 1, 0}));
+    // old objects are reported only once
+    Leaf *leaf = alloc_leaf();
+    gc_write_barrier(root, leaf);
+    root->obj = leaf;
+    gc_collect();
+    EXPECT_EQ(tracked.survived, std::vector<int>({1, 1, 0, 1}));
+    EXPECT_STREQ(tracked.type_names[0], "container");
+    EXPECT_EQ(tracked.type_names[1], nullptr);
+    alloc_leaf();
+    gc_set_alloc_tracker(nullptr);
+    alloc_leaf();
+    gc_unroot(root);
+    gc_collect();
+    EXPECT_EQ(tracked.survived, std::vector<int>({1, 1, 0, 1, -1}));
+    EXPECT_TRUE(state.check_count(0));
+}
+
+const char *pair_edge_name(const void *, size_t edge, size_t *length) {
+    *length = edge ? 5 : 4;
+    return edge ? "right" : "left";
+}
+
+TEST(GcTest, DumpHeap) {
+    GcStateW state;
+    GcClassId named_pair = gc_register_class(trace_pair, "pair");
+    GcClassId named_container = gc_register_class(trace_container, "container");
+    gc_set_edge_namer(named_pair, pair_edge_name);
+    Pair *root = (Pair *) gc_alloc(sizeof(Pair), named_pair);
+    root->left = nullptr;
+    root->right = nullptr;
+    gc_root(root);
+    Container *container = (Container *) gc_alloc(sizeof(Container), named_container);
+    container->obj = nullptr;
+    root->right = container;
+    container->obj = alloc_leaf();
+    alloc_leaf();
+    char *buf = nullptr;
+    size_t size = 0;
+    FILE *out = open_memstream(&buf, &size);
+    gc_dump_heap(out, true);
+    fclose(out);
+    std::string dump(buf, size);
+    free(buf);
+    EXPECT_EQ(dump.find("{\"objects\": 3, \"bytes\": 64, \"classes\": ["), 0) << dump;
+    EXPECT_NE(dump.find("{\"name\": \"pair\", \"count\": 1, \"bytes\": 32}"), std::string::npos) << dump;
+    EXPECT_NE(dump.find("\"path\": [{\"class\": \"pair\", \"root\": 0}, {\"class\": \"container\", \"edge\": 1, "
+                        "\"name\": \"right\"}, {\"class\": \"#0\", \"edge\": 0}]"), std::string::npos) << dump;
+    size_t parents = 0;
+    for (size_t pos = dump.find("\"parent\": "); pos != std::string::npos; pos = dump.find("\"parent\": ", pos + 1)) {
+        parents++;
+    }
+    EXPECT_EQ(parents, 2);
+    EXPECT_EQ(dump.back(), '\n');
+    EXPECT_TRUE(state.check_count(3));
+    gc_unroot(root);
+}
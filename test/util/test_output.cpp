@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <climits>
+#include <string>
+#include "natrix/util/output.h"
+
+static std::string format(int64_t value) {
+    char buf[OUTPUT_INT64_MAX_LENGTH];
+    return std::string(buf, output_format_int64(buf, value));
+}
+
+TEST(OutputTest, FormatInt64) {
+    EXPECT_EQ(format(0), "0");
+    EXPECT_EQ(format(7), "7");
+    EXPECT_EQ(format(-7), "-7");
+    EXPECT_EQ(format(10), "10");
+    EXPECT_EQ(format(99), "99");
+    EXPECT_EQ(format(100), "100");
+    EXPECT_EQ(format(-1005), "-1005");
+    EXPECT_EQ(format(INT64_MAX), "9223372036854775807");
+    EXPECT_EQ(format(INT64_MIN), "-9223372036854775808");
+    for (int64_t value = 1; value > 0 && value < INT64_MAX / 3; value = value * 3 + 1) {
+        EXPECT_EQ(format(value), std::to_string(value));
+        EXPECT_EQ(format(-value), std::to_string(-value));
+    }
+}
+
+TEST(OutputTest, Buffering) {
+    output_set_buffer_size(16);
+    testing::internal::CaptureStdout();
+    output_write("abc", 3);
+    output_write_int64(-42);
+    output_end_line();
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), "");
+    testing::internal::CaptureStdout();
+    output_write("0123456789", 10);
+    output_flush();
+    output_flush();
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), "abc-42\n0123456789");
+    output_set_buffer_size(OUTPUT_DEFAULT_BUFFER_SIZE);
+}
+
+TEST(OutputTest, LargeWrite) {
+    output_set_buffer_size(8);
+    testing::internal::CaptureStdout();
+    output_write("ab", 2);
+    output_write("0123456789", 10);
+    output_write("cd", 2);
+    std::string written = testing::internal::GetCapturedStdout();
+    testing::internal::CaptureStdout();
+    output_release();
+    std::string released = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(written, "ab0123456789");
+    EXPECT_EQ(released, "cd");
+    output_set_buffer_size(OUTPUT_DEFAULT_BUFFER_SIZE);
+}
@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include "natrix/util/perf_counters.h"
+
+TEST(PerfCountersTest, CountInstructions) {
+    PerfCounters counters;
+    bool available = perf_counters_start(&counters);
+    volatile uint64_t sum = 0;
+    for (int i = 0; i < 100000; i++) {
+        sum = sum + i;
+    }
+    perf_counters_stop(&counters);
+    uint64_t first;
+    if (!perf_counters_read(&counters, PERF_COUNTER_INSTRUCTIONS, &first)) {
+        perf_counters_close(&counters);
+        GTEST_SKIP();
+    }
+    EXPECT_TRUE(available);
+    EXPECT_GE(first, 100000);
+    // the counters do not count while stopped
+    for (int i = 0; i < 100000; i++) {
+        sum = sum + i;
+    }
+    uint64_t second;
+    ASSERT_TRUE(perf_counters_read(&counters, PERF_COUNTER_INSTRUCTIONS, &second));
+    EXPECT_EQ(first, second);
+    perf_counters_close(&counters);
+    EXPECT_FALSE(perf_counters_read(&counters, PERF_COUNTER_INSTRUCTIONS, &second));
+}
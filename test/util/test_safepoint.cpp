@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "natrix/compiler/compiler.h"
+#include "natrix/compiler/jit.h"
+#include "natrix/compiler/resolver.h"
+#include "natrix/interp/ast_interp.h"
+#include "natrix/interp/vm.h"
+#include "natrix/parser/parser.h"
+#include "natrix/util/safepoint.h"
+
+static const char *const HEAP_DUMP_PATH = "/tmp/natrix_test_safepoint.jsonl";
+
+enum class Engine { AST, VM, JIT };
+
+static bool run(const char *source, Engine engine, std::string *output) {
+#if ENABLE_CONSERVATIVE_GC
+    gc_set_stack_bottom(__builtin_frame_address(0));
+#endif
+    JitPolicy policy = jit_default_policy();
+    policy.enabled = engine == Engine::JIT;
+    policy.threshold = 2;
+    jit_set_policy(&policy);
+    Source src = source_from_string("<string>", source);
+    Arena arena = arena_init();
+    Stmt *stmt = parse_file(&arena, &src, diag_default_handler, nullptr);
+    EXPECT_NE(stmt, nullptr);
+    Env env = env_init();
+    gc_root(&env.gc_header);
+    LiteralPool literals = literal_pool_init();
+    gc_root(&literals.gc_header);
+    resolve_program(&env, &literals, stmt);
+    testing::internal::CaptureStdout();
+    bool completed;
+    if (engine == Engine::AST) {
+        completed = ast_interp_exec(&env, &literals, stmt);
+    } else {
+        Code code = code_init();
+        gc_root(&code.gc_header);
+        compile_program(&code, &literals, stmt);
+        completed = vm_exec(&env, &code);
+        gc_unroot(&code.gc_header);
+        code_free(&code);
+    }
+    fflush(stdout);
+    *output = testing::internal::GetCapturedStdout();
+    gc_unroot(&literals.gc_header);
+    literal_pool_free(&literals);
+    gc_unroot(&env.gc_header);
+    env_free(&env);
+    gc_collect();
+    arena_free(&arena);
+    source_free(&src);
+    policy = jit_default_policy();
+    jit_set_policy(&policy);
+#if ENABLE_CONSERVATIVE_GC
+    gc_set_stack_bottom(nullptr);
+#endif
+    return completed;
+}
+
+static std::vector<Engine> engines() {
+    std::vector<Engine> result = {Engine::AST, Engine::VM};
+    if (jit_is_supported()) {
+        result.push_back(Engine::JIT);
+    }
+    return result;
+}
+
+TEST(SafepointTest, InterruptIsSticky) {
+    Safepoint safepoint = {0};
+    EXPECT_FALSE(safepoint_is_pending(&safepoint));
+    safepoint_request(&safepoint, SAFEPOINT_INTERRUPT | SAFEPOINT_HEAP_DUMP);
+    EXPECT_TRUE(safepoint_is_pending(&safepoint));
+    EXPECT_TRUE(safepoint_handle(&safepoint));
+    EXPECT_EQ(safepoint.requests, SAFEPOINT_INTERRUPT);
+    EXPECT_TRUE(safepoint_handle(&safepoint));
+    safepoint_clear_interrupt(&safepoint);
+    EXPECT_FALSE(safepoint_is_pending(&safepoint));
+    safepoint_request(&safepoint, SAFEPOINT_HEAP_DUMP);
+    EXPECT_FALSE(safepoint_handle(&safepoint));
+    EXPECT_FALSE(safepoint_is_pending(&safepoint));
+}
+
+TEST(SafepointTest, InterruptStopsInfiniteLoops) {
+    const char *programs[] = {
+            "print(1)\ni = 0\nwhile 1 < 2:\n    i = i + 1\nprint(2)\n",
+            "print(1)\nwhile 1 < 2:\n    j = 0\n    while j < 10:\n        j = j + 1\nprint(2)\n",
+            "print(1)\nfor i in range(1000000000000):\n    j = i\nprint(2)\n",
+    };
+    Safepoint *safepoint = safepoint_current();
+    for (Engine engine : engines()) {
+        for (const char *program : programs) {
+            std::thread interrupter([safepoint] {
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                safepoint_request(safepoint, SAFEPOINT_INTERRUPT);
+            });
+            std::string output;
+            EXPECT_FALSE(run(program, engine, &output)) << program;
+            EXPECT_EQ(output, "1\n") << program;
+            interrupter.join();
+            safepoint_clear_interrupt(safepoint);
+        }
+    }
+}
+
+TEST(SafepointTest, PendingInterruptStopsAtFirstBackEdge) {
+    Safepoint *safepoint = safepoint_current();
+    for (Engine engine : engines()) {
+        safepoint_request(safepoint, SAFEPOINT_INTERRUPT);
+        std::string output;
+        EXPECT_FALSE(run("i = 0\nwhile i < 5:\n    print(i)\n    i = i + 1\nprint(i)\n", engine, &output));
+        EXPECT_EQ(output, "0\n");
+        safepoint_clear_interrupt(safepoint);
+        EXPECT_TRUE(run("print(1)\n", engine, &output));
+        EXPECT_EQ(output, "1\n");
+    }
+}
+
+TEST(SafepointTest, HeapDumpIsServedAtBackEdge) {
+    safepoint_set_signal_target(safepoint_current());
+    gc_set_heap_dump_path(HEAP_DUMP_PATH);
+    for (Engine engine : engines()) {
+        unlink(HEAP_DUMP_PATH);
+        gc_request_heap_dump();
+        std::string output;
+        // the loop does not allocate, so the dump is not written at a collection trigger
+        EXPECT_TRUE(run("i = 0\nwhile i < 100:\n    i = i + 1\nprint(i)\n", engine, &output));
+        EXPECT_EQ(output, "100\n");
+        EXPECT_EQ(access(HEAP_DUMP_PATH, F_OK), 0);
+        EXPECT_FALSE(safepoint_is_pending(safepoint_current()));
+    }
+    gc_set_heap_dump_path(nullptr);
+    safepoint_set_signal_target(nullptr);
+    unlink(HEAP_DUMP_PATH);
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2024, Ondrej Tethal
+ * All rights reserved.
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <set>
+#include <vector>
+#include "natrix/util/mem.h"
+#include "natrix/util/slab.h"
+
+class SlabTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        slab_free_all();
+    }
+
+    void TearDown() override {
+        slab_free_all();
+    }
+};
+
+TEST_F(SlabTest, AllocDistinctAligned) {
+    std::set<void *> seen;
+    for (size_t size = 1; size <= SLAB_MAX_SIZE; size += 7) {
+        void *ptr = slab_alloc(size);
+        ASSERT_NE(ptr, nullptr);
+        EXPECT_TRUE(NX_IS_ALIGNED(ptr));
+        EXPECT_TRUE(seen.insert(ptr).second);
+        EXPECT_TRUE(slab_is_live(ptr));
+        EXPECT_FALSE(slab_is_marked(ptr));
+        memset(ptr, 0xAB, size);
+    }
+    EXPECT_EQ(slab_get_live_count(), seen.size());
+}
+
+TEST_F(SlabTest, Mark) {
+    void *a = slab_alloc(24);
+    EXPECT_TRUE(slab_try_mark(a));
+    EXPECT_TRUE(slab_is_marked(a));
+    EXPECT_FALSE(slab_try_mark(a));
+    slab_clear_marks();
+    EXPECT_FALSE(slab_is_marked(a));
+}
+
+TEST_F(SlabTest, LazySweep) {
+    void *a = slab_alloc(32);
+    void *b = slab_alloc(32);
+    slab_try_mark(b);
+    slab_start_sweep();
+    EXPECT_FALSE(slab_is_live(a));
+    EXPECT_TRUE(slab_is_live(b));
+    EXPECT_TRUE(slab_is_marked(b));
+    EXPECT_EQ(slab_get_live_count(), 1);
+    void *c = slab_alloc(32);
+    EXPECT_EQ(a, c);
+    EXPECT_FALSE(slab_is_marked(c));
+}
+
+TEST_F(SlabTest, ReleaseEmpty) {
+    std::vector<void *> blocks;
+    for (int i = 0; i < 3 * SLAB_SIZE / 64; i++) {
+        blocks.push_back(slab_alloc(64));
+    }
+    EXPECT_GE(slab_get_count(), 3);
+    slab_start_sweep();
+    slab_alloc(64);
+    slab_release_empty();
+    EXPECT_LE(slab_get_count(), 2);
+    EXPECT_EQ(slab_get_live_count(), 1);
+}
+
+TEST_F(SlabTest, ReleaseRegions) {
+    SlabRegionPolicy policy = slab_default_region_policy();
+    policy.release = SLAB_RELEASE_UNMAP;
+    slab_set_region_policy(&policy);
+    size_t slabs_per_region = SLAB_DEFAULT_REGION_SIZE / SLAB_SIZE;
+    for (size_t i = 0; i < (slabs_per_region + 2) * (SLAB_SIZE / 64); i++) {
+        ASSERT_NE(slab_alloc(64), nullptr);
+    }
+    EXPECT_EQ(slab_get_region_count(), 2);
+    EXPECT_EQ(slab_get_mapped_bytes(), 2 * SLAB_DEFAULT_REGION_SIZE);
+    slab_start_sweep();
+    slab_release_empty();
+    EXPECT_EQ(slab_get_region_count(), 1);
+    EXPECT_EQ(slab_get_mapped_bytes(), SLAB_DEFAULT_REGION_SIZE);
+    policy = slab_default_region_policy();
+    slab_set_region_policy(&policy);
+}